@@ -12,6 +12,7 @@
 #include <vppinfra/vec.h>
 #include <vppinfra/mem.h>
 #include <vppinfra/pool.h>
+#include <vppinfra/hash.h>
 #include <vppinfra/lock.h>
 #include <vppinfra/clib.h>
 
@@ -22,35 +23,58 @@ typedef struct vlib_frame_t vlib_frame_t;
 typedef struct vlib_buffer_t vlib_buffer_t;
 typedef struct vlib_node_registration_t vlib_node_registration_t;
 
-/* Minimal vlib_main_t - just enough for time functions */
+/* One per thread: the control thread is 0, workers follow */
 struct vlib_main_t
 {
-  f64 clib_time_now;
+  u32 thread_index;
+  int wakeup_fd;	/* eventfd the thread polls, -1 if it spins */
+  u8 barrier_parked;
 };
 
-/* Stub vlib_main for time queries */
-static vlib_main_t _vlib_main_stub __attribute__((unused)) = { 0 };
+extern __thread vlib_main_t *vlib_main_tls;
+extern vlib_main_t **vlib_mains;
 
-/* Get main instance */
+/* Get main instance of the calling thread */
 static_always_inline vlib_main_t *
 vlib_get_main (void)
 {
-  return &_vlib_main_stub;
+  return vlib_main_tls;
 }
 
-/* Worker thread barriers (no-op stubs for single-threaded) */
-static_always_inline void
-vlib_worker_thread_barrier_sync (vlib_main_t *vm)
+static_always_inline u32
+vlib_get_n_threads (void)
 {
-  (void) vm;
+  return vec_len (vlib_mains);
 }
 
+vlib_main_t *vlib_main_init (u32 thread_index);
+
+/*
+ * Worker barrier. Any thread may take it, it returns once every other
+ * thread is parked in vlib_worker_thread_barrier_check () at the top of
+ * its loop, so keypairs can be swapped and freed under it as in VPP.
+ */
+void vlib_worker_thread_barrier_sync (vlib_main_t *vm);
+void vlib_worker_thread_barrier_release (vlib_main_t *vm);
+void vlib_worker_thread_barrier_park (vlib_main_t *vm);
+
+extern volatile u32 vlib_worker_thread_barrier_held;
+
 static_always_inline void
-vlib_worker_thread_barrier_release (vlib_main_t *vm)
+vlib_worker_thread_barrier_check (vlib_main_t *vm)
 {
-  (void) vm;
+  if (__atomic_load_n (&vlib_worker_thread_barrier_held, __ATOMIC_ACQUIRE))
+    vlib_worker_thread_barrier_park (vm);
 }
 
+/*
+ * Main thread RPC. fn (args) runs on thread 0 under the barrier, args
+ * being copied; thread 0 runs queued calls in vlib_rpc_process () and
+ * calls from thread 0 itself run at once.
+ */
+void vlib_rpc_call_main_thread (void *fn, u8 *args, u32 size);
+void vlib_rpc_process (vlib_main_t *vm);
+
 /* Buffer structure - simplified for standalone */
 struct vlib_buffer_t
 {
@@ -15,6 +15,7 @@ typedef struct
   u32 current_data;
   u16 current_length;
   u16 flags;
+  u32 unused[6]; /* room for plugin metadata */
 } vnet_buffer_opaque_t;
 
 /* Get buffer opaque data */
@@ -1,6 +1,7 @@
 /*
  * Minimal VPP crypto engine compatibility shim
- * WireGuard uses OpenSSL directly, so this is mostly stubs
+ * Keys and synchronous ops; key slots live in src/crypto/crypto.c, ops
+ * run on the backend AWG_VPN_CRYPTO picks, src/crypto/crypto_<name>.c
  */
 
 #ifndef __included_vnet_crypto_h__
@@ -24,43 +25,75 @@ typedef enum
   VNET_CRYPTO_ALG_CHACHA20_POLY1305,
 } vnet_crypto_alg_t;
 
+typedef enum
+{
+  VNET_CRYPTO_OP_STATUS_IDLE,
+  VNET_CRYPTO_OP_STATUS_PENDING,
+  VNET_CRYPTO_OP_STATUS_WORK_IN_PROGRESS,
+  VNET_CRYPTO_OP_STATUS_COMPLETED,
+  VNET_CRYPTO_OP_STATUS_FAIL_NO_HANDLER,
+  VNET_CRYPTO_OP_STATUS_FAIL_BAD_HMAC,
+  VNET_CRYPTO_OP_STATUS_FAIL_ENGINE_ERR,
+} vnet_crypto_op_status_t;
+
+#define VNET_CRYPTO_OP_FLAG_HMAC_CHECK	    (1 << 0)
+#define VNET_CRYPTO_OP_FLAG_CHAINED_BUFFERS (1 << 1)
+
 /* Crypto engine stubs */
 typedef u32 vnet_crypto_key_index_t;
 
-/* Crypto key structure (minimal stub) */
+/* most keys alive at once: three keypairs a peer and handshake scratch */
+#define VNET_CRYPTO_N_KEYS (1 << 16)
+
 typedef struct
 {
-  u8 *data;
-  u32 len;
+  u8 data[32];
+  u16 len;
+  u8 alg;
 } vnet_crypto_key_t;
 
-/* Global key storage (simple array for now) */
-extern vnet_crypto_key_t _vnet_crypto_keys[256];
-extern u32 _vnet_crypto_key_count;
+typedef struct
+{
+  u8 *src;
+  u8 *dst;
+  u32 len;
+} vnet_crypto_op_chunk_t;
 
-/* Stub functions for crypto key management */
-static_always_inline vnet_crypto_key_index_t
-vnet_crypto_key_add (vlib_main_t *vm, vnet_crypto_alg_t alg, u8 *data,
-		      u16 length)
+typedef struct
 {
-  (void) vm;
-  (void) alg;
+  vnet_crypto_op_id_t op;
+  vnet_crypto_op_status_t status;
+  u8 flags;
+  vnet_crypto_key_index_t key_index;
+  u8 *iv;
+  u8 *src;
+  u8 *dst;
+  u32 len;
+  u8 *aad;
+  u32 aad_len;
+  u8 *tag;
+  u8 tag_len;
+  u32 chunk_index;
+  u16 n_chunks;
+  uword user_data;
+} vnet_crypto_op_t;
 
-  if (_vnet_crypto_key_count >= 256)
-    return ~0;
+/* async frames are not supported outside VPP */
+typedef struct vnet_crypto_async_frame_t vnet_crypto_async_frame_t;
 
-  u32 idx = _vnet_crypto_key_count++;
-  _vnet_crypto_keys[idx].data = data;
-  _vnet_crypto_keys[idx].len = length;
-  return idx;
-}
+extern vnet_crypto_key_t vnet_crypto_keys[VNET_CRYPTO_N_KEYS];
+
+vnet_crypto_key_index_t vnet_crypto_key_add (vlib_main_t *vm,
+					     vnet_crypto_alg_t alg, u8 *data,
+					     u16 length);
+void vnet_crypto_key_del (vlib_main_t *vm, vnet_crypto_key_index_t index);
+u32 vnet_crypto_process_ops (vlib_main_t *vm, vnet_crypto_op_t ops[],
+			     u32 n_ops);
 
 static_always_inline vnet_crypto_key_t *
 vnet_crypto_get_key (vnet_crypto_key_index_t index)
 {
-  if (index >= 256)
-    return NULL;
-  return &_vnet_crypto_keys[index];
+  return &vnet_crypto_keys[index];
 }
 
 static_always_inline void
@@ -68,18 +101,16 @@ vnet_crypto_key_update (vlib_main_t *vm, vnet_crypto_key_index_t index)
 {
   (void) vm;
   (void) index;
-  /* Stub - key already updated in place */
+  /* keys are read from their slot on every op */
 }
 
 static_always_inline void
-vnet_crypto_key_del (vlib_main_t *vm, vnet_crypto_key_index_t index)
+vnet_crypto_op_init (vnet_crypto_op_t *op, vnet_crypto_op_id_t type)
 {
-  (void) vm;
-  if (index < 256)
-    {
-      _vnet_crypto_keys[index].data = NULL;
-      _vnet_crypto_keys[index].len = 0;
-    }
+  op->op = type;
+  op->flags = 0;
+  op->key_index = ~0;
+  op->n_chunks = 0;
 }
 
 #endif /* __included_vnet_crypto_h__ */
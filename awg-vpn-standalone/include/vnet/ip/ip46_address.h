@@ -31,14 +31,17 @@ typedef struct
   };
 } ip6_address_t;
 
-/* Combined IP4/IP6 address */
-typedef struct
+/* Combined IP4/IP6 address, an IPv4 one has the first 12 bytes zero */
+typedef union
 {
-  union
+  struct
   {
+    u32 pad[3];
     ip4_address_t ip4;
-    ip6_address_t ip6;
   };
+  ip6_address_t ip6;
+  u8 as_u8[16];
+  u64 as_u64[2];
 } ip46_address_t;
 
 /* IP address family type */
@@ -57,7 +60,15 @@ typedef struct
 } ip_address_t;
 
 /* IP address operations */
-#define ip46_address_is_ip4(a) ((a)->version == 4)
-#define ip46_address_is_ip6(a) ((a)->version == 6)
+#define ip46_address_is_ip4(a)                                                \
+  (((a)->pad[0] | (a)->pad[1] | (a)->pad[2]) == 0)
+
+static inline void
+ip46_address_set_ip4 (ip46_address_t *a, const ip4_address_t *ip)
+{
+  a->as_u64[0] = 0;
+  a->pad[2] = 0;
+  a->ip4 = *ip;
+}
 
 #endif /* __included_ip46_address_h__ */
@@ -24,6 +24,33 @@
 /* Static assert */
 #define STATIC_ASSERT(cond, msg) _Static_assert((cond), msg)
 
+/* Branch hints */
+#define PREDICT_FALSE(x) __builtin_expect ((x), 0)
+#define PREDICT_TRUE(x)	 __builtin_expect ((x), 1)
+
+/* Barriers and spinning */
+#define CLIB_MEMORY_BARRIER()	    __sync_synchronize ()
+#define CLIB_MEMORY_STORE_BARRIER() __atomic_thread_fence (__ATOMIC_RELEASE)
+#if defined(__x86_64__) || defined(__i386__)
+#define CLIB_PAUSE() __builtin_ia32_pause ()
+#else
+#define CLIB_PAUSE() __asm__ volatile ("" ::: "memory")
+#endif
+
+/* Atomics */
+#define clib_atomic_fetch_add(a, b) __atomic_fetch_add (a, b, __ATOMIC_SEQ_CST)
+#define clib_atomic_fetch_add_relax(a, b)                                     \
+  __atomic_fetch_add (a, b, __ATOMIC_RELAXED)
+#define clib_atomic_load_relax_n(a)	__atomic_load_n (a, __ATOMIC_RELAXED)
+#define clib_atomic_load_acq_n(a)	__atomic_load_n (a, __ATOMIC_ACQUIRE)
+#define clib_atomic_store_relax_n(a, v) __atomic_store_n (a, v, __ATOMIC_RELAXED)
+#define clib_atomic_store_rel_n(a, v)	__atomic_store_n (a, v, __ATOMIC_RELEASE)
+#define clib_atomic_swap_acq_n(a, v)	__atomic_exchange_n (a, v, __ATOMIC_ACQUIRE)
+
+/* Unaligned access */
+#define clib_mem_unaligned(pointer, type)                                     \
+  (((struct { type _data; } __attribute__ ((packed)) *) (pointer))->_data)
+
 /* Min/Max macros */
 #define clib_min(a, b) ((a) < (b) ? (a) : (b))
 #define clib_max(a, b) ((a) > (b) ? (a) : (b))
@@ -0,0 +1,161 @@
+/*
+ * Minimal VPP hash compatibility shim
+ * uword keyed hash tables, linear probing with backward shift deletion
+ */
+
+#ifndef __included_vppinfra_hash_h__
+#define __included_vppinfra_hash_h__
+
+#include <vppinfra/types.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+  uword key;
+  uword value;
+  uword used;
+} hash_pair_t;
+
+typedef struct
+{
+  uword n_elts;
+  uword size; /* power of 2 */
+  hash_pair_t pairs[0];
+} hash_header_t;
+
+#define _hash_hdr(h) ((hash_header_t *) (h))
+
+static_always_inline uword
+_hash_slot (uword key, uword size)
+{
+  u64 x = (u64) key * 0x9e3779b97f4a7c15ULL;
+  return (uword) (x >> 32) & (size - 1);
+}
+
+static_always_inline hash_pair_t *
+_hash_find (void *h, uword key)
+{
+  hash_header_t *hh = h;
+  uword i;
+
+  if (!hh)
+    return NULL;
+  for (i = _hash_slot (key, hh->size); hh->pairs[i].used;
+       i = (i + 1) & (hh->size - 1))
+    if (hh->pairs[i].key == key)
+      return &hh->pairs[i];
+  return NULL;
+}
+
+static inline void *_hash_set (void *h, uword key, uword value);
+
+static inline void *
+_hash_resize (void *h, uword size)
+{
+  hash_header_t *old = h, *hh;
+  uword i;
+
+  hh = calloc (1, sizeof (*hh) + size * sizeof (hash_pair_t));
+  hh->size = size;
+  if (old)
+    {
+      for (i = 0; i < old->size; i++)
+	if (old->pairs[i].used)
+	  _hash_set (hh, old->pairs[i].key, old->pairs[i].value);
+      free (old);
+    }
+  return hh;
+}
+
+static inline void *
+_hash_set (void *h, uword key, uword value)
+{
+  hash_header_t *hh;
+  hash_pair_t *p;
+  uword i;
+
+  if (!h)
+    h = _hash_resize (0, 16);
+  if ((p = _hash_find (h, key)))
+    {
+      p->value = value;
+      return h;
+    }
+  hh = h;
+  if (2 * (hh->n_elts + 1) > hh->size)
+    hh = h = _hash_resize (h, 2 * hh->size);
+
+  for (i = _hash_slot (key, hh->size); hh->pairs[i].used;
+       i = (i + 1) & (hh->size - 1))
+    ;
+  hh->pairs[i].key = key;
+  hh->pairs[i].value = value;
+  hh->pairs[i].used = 1;
+  hh->n_elts++;
+  return h;
+}
+
+static inline void
+_hash_unset (void *h, uword key)
+{
+  hash_header_t *hh = h;
+  hash_pair_t *p = _hash_find (h, key);
+  uword i, j, k;
+
+  if (!p)
+    return;
+  i = p - hh->pairs;
+  hh->pairs[i].used = 0;
+  hh->n_elts--;
+
+  /* pull later members of the run back over the hole */
+  for (j = (i + 1) & (hh->size - 1); hh->pairs[j].used;
+       j = (j + 1) & (hh->size - 1))
+    {
+      k = _hash_slot (hh->pairs[j].key, hh->size);
+      if (i <= j ? (k <= i || k > j) : (k <= i && k > j))
+	{
+	  hh->pairs[i] = hh->pairs[j];
+	  hh->pairs[j].used = 0;
+	  i = j;
+	}
+    }
+}
+
+#define hash_get(h, key)                                                      \
+  ({                                                                          \
+    hash_pair_t *_p = _hash_find ((void *) (h), (uword) (key));               \
+    _p ? &_p->value : (uword *) 0;                                            \
+  })
+#define hash_set(h, key, value)                                               \
+  ((h) = (void *) _hash_set ((void *) (h), (uword) (key), (uword) (value)))
+#define hash_unset(h, key) _hash_unset ((void *) (h), (uword) (key))
+#define hash_elts(h)	   ((h) ? _hash_hdr (h)->n_elts : 0)
+#define hash_free(h)                                                          \
+  do                                                                          \
+    {                                                                         \
+      free ((void *) (h));                                                    \
+      (h) = 0;                                                                \
+    }                                                                         \
+  while (0)
+
+/* the body may not add to or remove from the table */
+#define hash_foreach(key_var, value_var, h, body)                             \
+  do                                                                          \
+    {                                                                         \
+      hash_header_t *_hh = (void *) (h);                                      \
+      uword _i;                                                               \
+      for (_i = 0; _hh && _i < _hh->size; _i++)                               \
+	if (_hh->pairs[_i].used)                                              \
+	  {                                                                   \
+	    (key_var) = _hh->pairs[_i].key;                                   \
+	    (value_var) = _hh->pairs[_i].value;                               \
+	    do                                                                \
+	      body                                                            \
+	    while (0);                                                        \
+	  }                                                                   \
+    }                                                                         \
+  while (0)
+
+#endif /* __included_vppinfra_hash_h__ */
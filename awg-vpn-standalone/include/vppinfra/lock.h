@@ -6,6 +6,8 @@
 #define __included_vppinfra_lock_h__
 
 #include <vppinfra/types.h>
+#include <vppinfra/clib.h>
+#include <vppinfra/mem.h>
 #include <pthread.h>
 
 /* Read-write lock wrapper */
@@ -50,34 +52,61 @@ clib_rwlock_writer_unlock (clib_rwlock_t *p)
   pthread_rwlock_unlock (&p->lock);
 }
 
-/* Spinlock wrapper (use mutex for simplicity) */
+/*
+ * Spinlock, a pointer as in VPP: NULL until clib_spinlock_init (), so
+ * structures can carry one that is only set up when needed
+ */
 typedef struct
 {
-  pthread_mutex_t lock;
-} clib_spinlock_t;
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  u32 lock;
+} clib_spinlock_s;
+
+typedef clib_spinlock_s *clib_spinlock_t;
 
 static_always_inline void
 clib_spinlock_init (clib_spinlock_t *p)
 {
-  pthread_mutex_init (&p->lock, NULL);
+  *p = clib_mem_alloc_aligned (CLIB_CACHE_LINE_BYTES, CLIB_CACHE_LINE_BYTES);
+  clib_memset ((void *) *p, 0, CLIB_CACHE_LINE_BYTES);
 }
 
 static_always_inline void
 clib_spinlock_free (clib_spinlock_t *p)
 {
-  pthread_mutex_destroy (&p->lock);
+  if (*p)
+    {
+      clib_mem_free ((void *) *p);
+      *p = 0;
+    }
 }
 
 static_always_inline void
 clib_spinlock_lock (clib_spinlock_t *p)
 {
-  pthread_mutex_lock (&p->lock);
+  while (__atomic_exchange_n (&(*p)->lock, 1, __ATOMIC_ACQUIRE))
+    while (__atomic_load_n (&(*p)->lock, __ATOMIC_RELAXED))
+      CLIB_PAUSE ();
 }
 
 static_always_inline void
 clib_spinlock_unlock (clib_spinlock_t *p)
 {
-  pthread_mutex_unlock (&p->lock);
+  __atomic_store_n (&(*p)->lock, 0, __ATOMIC_RELEASE);
+}
+
+static_always_inline void
+clib_spinlock_lock_if_init (clib_spinlock_t *p)
+{
+  if (PREDICT_FALSE (*p != 0))
+    clib_spinlock_lock (p);
+}
+
+static_always_inline void
+clib_spinlock_unlock_if_init (clib_spinlock_t *p)
+{
+  if (PREDICT_FALSE (*p != 0))
+    clib_spinlock_unlock (p);
 }
 
 #endif /* __included_vppinfra_lock_h__ */
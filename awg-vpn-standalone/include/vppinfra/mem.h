@@ -9,20 +9,23 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* Memory allocation wrappers */
+/* Memory allocation wrappers; like VPP's, they do not return on failure */
 static_always_inline void *
 clib_mem_alloc (uword size)
 {
-  return malloc (size);
+  void *ptr = malloc (size);
+  if (!ptr)
+    abort ();
+  return ptr;
 }
 
 static_always_inline void *
 clib_mem_alloc_aligned (uword size, uword align)
 {
   void *ptr;
-  if (posix_memalign (&ptr, align, size) == 0)
-    return ptr;
-  return NULL;
+  if (posix_memalign (&ptr, align, size))
+    abort ();
+  return ptr;
 }
 
 static_always_inline void
@@ -33,6 +36,7 @@ clib_mem_free (void *p)
 
 /* Memory operations */
 #define clib_memcpy(dst, src, n) memcpy((dst), (src), (n))
+#define clib_memcpy_fast(dst, src, n) memcpy((dst), (src), (n))
 #define clib_memset(s, c, n) memset((s), (c), (n))
 #define clib_memcmp(s1, s2, n) memcmp((s1), (s2), (n))
 
@@ -33,7 +33,8 @@ typedef struct
 /* Allocate element from pool */
 #define pool_get(P, E) \
   do { \
-    if ((P) == NULL || vec_len((P)) >= _pool_hdr(P)->capacity) { \
+    if ((P) == NULL || (!vec_len (_pool_hdr(P)->free_indices) && \
+		       _pool_hdr(P)->len >= _pool_hdr(P)->capacity)) { \
       uword _new_cap = (P) ? _pool_hdr(P)->capacity * 2 : 16; \
       pool_header_t *_h; \
       if ((P) == NULL) { \
@@ -49,15 +50,20 @@ typedef struct
         (P) = (void *)((u8 *)_h + sizeof(pool_header_t)); \
       } \
     } \
-    (E) = &(P)[_pool_hdr(P)->len++]; \
+    if (vec_len (_pool_hdr(P)->free_indices)) \
+      (E) = &(P)[_pool_hdr(P)->free_indices \
+		   [--_vec_hdr(_pool_hdr(P)->free_indices)->len]]; \
+    else \
+      (E) = &(P)[_pool_hdr(P)->len++]; \
     memset((E), 0, sizeof(*(E))); \
   } while (0)
 
 /* Free element back to pool */
 #define pool_put(P, E) \
   do { \
-    /* Simplified - just zero it out */ \
+    u32 _pi = (E) - (P); \
     memset((E), 0, sizeof(*(E))); \
+    vec_add1 (_pool_hdr(P)->free_indices, _pi); \
   } while (0)
 
 /* Free entire pool */
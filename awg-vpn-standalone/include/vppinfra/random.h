@@ -6,6 +6,7 @@
 #define __included_vppinfra_random_h__
 
 #include <vppinfra/types.h>
+#include <time.h>
 
 /* Simple xorshift64* PRNG - fast and good quality */
 static_always_inline u32
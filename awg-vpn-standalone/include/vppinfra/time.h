@@ -20,11 +20,11 @@ unix_time_now (void)
 
 /* Unix timestamp with nanosecond fraction */
 static_always_inline void
-unix_time_now_nsec_fraction (u64 *sec, u32 *nsec)
+unix_time_now_nsec_fraction (u32 *sec, u32 *nsec)
 {
   struct timespec ts;
   clock_gettime (CLOCK_REALTIME, &ts);
-  *sec = (u64) ts.tv_sec;
+  *sec = (u32) ts.tv_sec;
   *nsec = (u32) ts.tv_nsec;
 }
 
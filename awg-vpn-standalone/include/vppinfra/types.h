@@ -21,6 +21,11 @@ typedef int16_t i16;
 typedef int32_t i32;
 typedef int64_t i64;
 
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 u128;
+typedef __int128 i128;
+#endif
+
 typedef float f32;
 typedef double f64;
 
@@ -8,6 +8,7 @@
 
 #include <vppinfra/types.h>
 #include <vppinfra/mem.h>
+#include <vppinfra/clib.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -25,22 +26,41 @@ typedef struct
 /* Get vector length */
 #define vec_len(v) _vec_len(v)
 
+/*
+ * Vectors start on a cache line, as vec_validate_aligned () promises in
+ * VPP, so per-thread elements do not share lines. The header sits just
+ * below the data, at the end of a leading cache line.
+ */
+#define _VEC_ALIGN 64
+#define _vec_base(v) ((u8 *) (v) - _VEC_ALIGN)
+
+static inline void *
+_vec_realloc (void *v, uword n_elts, uword elt_size)
+{
+  u8 *base;
+  uword len = v ? _vec_hdr (v)->len : 0;
+
+  if (posix_memalign ((void **) &base, _VEC_ALIGN,
+		      _VEC_ALIGN + n_elts * elt_size))
+    abort ();
+  if (v)
+    {
+      memcpy (base + _VEC_ALIGN, v, clib_min (len, n_elts) * elt_size);
+      free (_vec_base (v));
+    }
+  v = base + _VEC_ALIGN;
+  _vec_hdr (v)->len = clib_min (len, n_elts);
+  _vec_hdr (v)->capacity = n_elts;
+  return v;
+}
+
 /* Resize vector (internal) */
-#define _vec_resize(V, N, ELTSIZE) \
-  do { \
-    uword _new_cap = (N); \
-    if ((V) == NULL) { \
-      vec_header_t *_h = malloc(sizeof(vec_header_t) + (_new_cap) * (ELTSIZE)); \
-      _h->len = 0; \
-      _h->capacity = _new_cap; \
-      (V) = (void *)((u8 *)_h + sizeof(vec_header_t)); \
-    } else { \
-      vec_header_t *_h = _vec_hdr(V); \
-      _h = realloc(_h, sizeof(vec_header_t) + (_new_cap) * (ELTSIZE)); \
-      _h->capacity = _new_cap; \
-      (V) = (void *)((u8 *)_h + sizeof(vec_header_t)); \
-    } \
-  } while (0)
+#define _vec_resize(V, N, ELTSIZE)                                            \
+  do                                                                          \
+    {                                                                         \
+      (V) = _vec_realloc ((V), (N), (ELTSIZE));                               \
+    }                                                                         \
+  while (0)
 
 /* Add 1 element to vector */
 #define vec_add1(V, E) \
@@ -82,11 +102,28 @@ typedef struct
     } \
   } while (0)
 
+#define vec_validate_aligned(V, I, A) vec_validate (V, I)
+
+/* Validate vector index, new elements set to INIT */
+#define vec_validate_init_empty(V, I, INIT)                                   \
+  do                                                                          \
+    {                                                                         \
+      uword _l = vec_len (V), _j;                                             \
+      vec_validate (V, I);                                                    \
+      for (_j = _l; _j < vec_len (V); _j++)                                   \
+	(V)[_j] = (INIT);                                                     \
+    }                                                                         \
+  while (0)
+
+/* Element pointer */
+#define vec_elt_at_index(V, I) ((V) + (I))
+#define vec_elt(V, I) ((V)[I])
+
 /* Free vector */
 #define vec_free(V) \
   do { \
     if (V) { \
-      free(_vec_hdr(V)); \
+      free(_vec_base(V)); \
       (V) = NULL; \
     } \
   } while (0)
@@ -0,0 +1,96 @@
+/*
+ * Minimal VPP vector compatibility shim
+ * The u8x16/u32x4/u32x8/u32x16 subset the WireGuard/AWG core uses, on
+ * the same instruction sets that turn on CLIB_HAVE_VEC* in VPP
+ */
+
+#ifndef __included_vppinfra_vector_h__
+#define __included_vppinfra_vector_h__
+
+#include <vppinfra/types.h>
+#include <vppinfra/clib.h>
+#include <string.h>
+
+#if defined(__SSE4_2__)
+#include <x86intrin.h>
+#define CLIB_HAVE_VEC128
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CLIB_HAVE_VEC128
+#endif
+
+#if defined(__AVX2__)
+#define CLIB_HAVE_VEC256
+#endif
+#if defined(__AVX512F__)
+#define CLIB_HAVE_VEC512
+#endif
+
+#ifdef CLIB_HAVE_VEC128
+
+#define _vector_size(n) __attribute__ ((vector_size (n), __may_alias__))
+
+typedef u8 u8x16 _vector_size (16);
+typedef u32 u32x4 _vector_size (16);
+
+#define u32x4_shuffle(v1, ...)                                                \
+  (u32x4) __builtin_shufflevector ((u32x4) (v1), (u32x4) (v1), __VA_ARGS__)
+
+static_always_inline u32x4
+u32x4_splat (u32 x)
+{
+  return (u32x4){ x, x, x, x };
+}
+
+static_always_inline u32x4
+u32x4_load_unaligned (void *p)
+{
+  u32x4 v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static_always_inline void
+u32x4_store_unaligned (u32x4 v, void *p)
+{
+  memcpy (p, &v, sizeof (v));
+}
+
+#ifdef CLIB_HAVE_VEC256
+typedef u32 u32x8 _vector_size (32);
+
+static_always_inline u32x8
+u32x8_splat (u32 x)
+{
+  return (u32x8){ x, x, x, x, x, x, x, x };
+}
+#endif
+
+#ifdef CLIB_HAVE_VEC512
+typedef u32 u32x16 _vector_size (64);
+
+static_always_inline u32x16
+u32x16_splat (u32 x)
+{
+  return (u32x16){ x, x, x, x, x, x, x, x, x, x, x, x, x, x, x, x };
+}
+#endif
+
+/* Creates a mask made up of the MSB of each byte of the source vector */
+static_always_inline u16
+u8x16_msb_mask (u8x16 v)
+{
+#if defined(__SSE4_2__)
+  return _mm_movemask_epi8 ((__m128i) v);
+#else
+  int8x16_t shift = { -7, -6, -5, -4, -3, -2, -1, 0,
+		      -7, -6, -5, -4, -3, -2, -1, 0 };
+  uint8x16_t x = vshlq_u8 (vandq_u8 (v, vdupq_n_u8 (0x80)), shift);
+  uint64x2_t x64 = vpaddlq_u32 (vpaddlq_u16 (vpaddlq_u8 (x)));
+  return (u16) (vgetq_lane_u64 (x64, 0) + (vgetq_lane_u64 (x64, 1) << 8));
+#endif
+}
+
+#endif /* CLIB_HAVE_VEC128 */
+
+#endif /* __included_vppinfra_vector_h__ */
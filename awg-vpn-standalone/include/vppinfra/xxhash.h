@@ -0,0 +1,11 @@
+/*
+ * vppinfra xxhash, taken as is: it only needs the basic types
+ */
+
+#ifndef __included_vppinfra_xxhash_shim_h__
+#define __included_vppinfra_xxhash_shim_h__
+
+#include <vppinfra/types.h>
+#include "../../../src/vppinfra/xxhash.h"
+
+#endif /* __included_vppinfra_xxhash_shim_h__ */
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __included_awg_vpn_h__
+#define __included_awg_vpn_h__
+
+#include <unistd.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <linux/if_packet.h>
+
+#include <vlib/vlib.h>
+#include <vnet/crypto/crypto.h>
+#include <vnet/ip/ip46_address.h>
+
+#include <wireguard/wireguard_messages.h>
+#include <wireguard/wireguard_key.h>
+#include <wireguard/wireguard_noise.h>
+#include <wireguard/wireguard_cookie.h>
+#include <wireguard/wireguard_chachapoly.h>
+#include <wireguard/wireguard_awg.h>
+
+/*
+ * Threads: the control thread (thread index 0) runs handshakes and
+ * timers, every worker runs to completion over its own share of the
+ * uplink, a PACKET_FANOUT_HASH member with TPACKET_V3 rx and tx rings,
+ * and its own queue of the multiqueue TUN device.
+ */
+
+#define AWG_VPN_MAX_WORKERS 64
+#define AWG_VPN_BATCH	    64	/* packets per crypto batch */
+
+#define AWG_VPN_FRAME_SIZE	   2048
+#define AWG_VPN_RX_FRAMES_PER_BLOCK 32
+#define AWG_VPN_RX_BLOCK_NR	   160
+#define AWG_VPN_TX_FRAMES_PER_BLOCK 32
+#define AWG_VPN_TX_BLOCK_NR	   32
+
+#define AWG_VPN_DEFAULT_MTU  1420
+#define AWG_VPN_DEFAULT_PORT 51820
+
+/* handshake messages waiting for the control thread, per worker */
+#define AWG_VPN_HS_QUEUE_SIZE 256
+/* control is under load once this many wait, cookies are asked for */
+#define AWG_VPN_HS_UNDER_LOAD (AWG_VPN_HS_QUEUE_SIZE / 8)
+
+/* receiver index table, slot in the low bits, random in the high */
+#define AWG_VPN_INDEX_SLOT_BITS 16
+#define AWG_VPN_N_INDEX_SLOTS	(1 << AWG_VPN_INDEX_SLOT_BITS)
+
+/* per worker cache of allowed-ips lookups */
+#define AWG_VPN_ROUTE_CACHE_SIZE 1024
+
+/* eth + ip4 + udp in front of every message sent on the uplink */
+#define AWG_VPN_OUTER_HDR_LEN (14 + 20 + 8)
+
+typedef struct
+{
+  ip46_address_t addr;
+  u8 len;
+  u8 is_ip4;
+  u32 peer_index;
+} awg_vpn_route_t;
+
+typedef struct
+{
+  u8 public_key[NOISE_PUBLIC_KEY_LEN];
+  u8 preshared_key[NOISE_SYMMETRIC_KEY_LEN];
+  u64 endpoint;
+  u16 persistent_keepalive;
+} awg_vpn_peer_config_t;
+
+typedef struct
+{
+  /* control thread only */
+  noise_remote_t remote;
+  cookie_maker_t cookie_maker;
+  u16 persistent_keepalive;
+  f64 last_initiation_sent;
+  f64 retransmit_at;
+  u32 n_handshake_attempts;
+  u8 handshake_in_flight;
+
+  /* set by any thread */
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline1);
+  u64 endpoint; /* ip4 << 16 | port, both in network order, 0 if unknown */
+  u64 dst_mac;	/* next hop towards the endpoint, 0 if not learnt */
+  u8 want_handshake;
+  f64 last_sent;
+  f64 last_received;
+  f64 last_data_sent;
+  f64 last_data_received;
+} awg_vpn_peer_t;
+
+static_always_inline u64
+awg_vpn_endpoint_pack (ip4_address_t ip, u16 port)
+{
+  return ((u64) ip.as_u32 << 16) | port;
+}
+
+static_always_inline void
+awg_vpn_endpoint_unpack (u64 endpoint, ip4_address_t *ip, u16 *port)
+{
+  ip->as_u32 = (u32) (endpoint >> 16);
+  *port = (u16) endpoint;
+}
+
+/* a handshake message as handed from a worker to the control thread */
+typedef struct
+{
+  message_type_t type;
+  ip4_address_t src;
+  u16 src_port;
+  u8 src_mac[6];
+  u16 len;
+  u8 data[sizeof (message_handshake_initiation_t)];
+} awg_vpn_handshake_t;
+
+#define foreach_awg_vpn_worker_counter                                        \
+  _ (rx_packets, "uplink rx packets")                                         \
+  _ (rx_bytes, "uplink rx bytes")                                             \
+  _ (rx_decrypted, "data messages decrypted")                                 \
+  _ (rx_handshakes, "handshake messages queued")                              \
+  _ (rx_dropped, "uplink rx dropped")                                         \
+  _ (rx_decrypt_failed, "decryption failed")                                  \
+  _ (rx_replayed, "replayed or too old")                                      \
+  _ (rx_source_denied, "inner source not allowed")                            \
+  _ (tx_packets, "uplink tx packets")                                         \
+  _ (tx_bytes, "uplink tx bytes")                                             \
+  _ (tx_no_route, "no peer for inner destination")                            \
+  _ (tx_no_session, "no session with the peer")                               \
+  _ (tx_ring_full, "uplink tx ring full")
+
+typedef struct
+{
+#define _(n, s) u64 n;
+  foreach_awg_vpn_worker_counter
+#undef _
+} awg_vpn_worker_counters_t;
+
+typedef struct
+{
+  ip46_address_t addr;
+  u32 peer_index;
+  u8 is_ip4; /* ~0 while the entry is empty */
+} awg_vpn_route_cache_entry_t;
+
+typedef struct
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  vlib_main_t *vm;
+  u32 worker_index;
+  int cpu;
+  pthread_t thread;
+
+  /* uplink packet socket and its rx and tx rings, mapped back to back */
+  int fd;
+  u8 *ring;
+  uword ring_size;
+  struct tpacket_req3 rx_req;
+  struct tpacket_req3 tx_req;
+  u8 **rx_blocks;
+  u8 **tx_frames;
+  u32 next_rx_block;
+  u32 next_tx_frame;
+
+  /* queue of the TUN device */
+  int tun_fd;
+
+  /* handshakes for the control thread, one producer one consumer */
+  awg_vpn_handshake_t *hs_queue;
+  u32 hs_head;
+  u32 hs_tail;
+
+  /* crypto batch */
+  vnet_crypto_op_t ops[AWG_VPN_BATCH];
+  u8 ivs[AWG_VPN_BATCH][12];
+  u8 *frames[AWG_VPN_BATCH];
+  u16 lens[AWG_VPN_BATCH];
+  u32 peers[AWG_VPN_BATCH];
+  noise_keypair_t *keypairs[AWG_VPN_BATCH];
+  u64 nonces[AWG_VPN_BATCH];
+  u64 endpoints[AWG_VPN_BATCH];
+  u8 macs[AWG_VPN_BATCH][6];
+
+  awg_vpn_route_cache_entry_t route_cache[AWG_VPN_ROUTE_CACHE_SIZE];
+  u64 random_seed;
+
+  awg_vpn_worker_counters_t counters;
+} awg_vpn_worker_t;
+
+typedef struct
+{
+  /* [Interface] */
+  u8 private_key[NOISE_PUBLIC_KEY_LEN];
+  u16 listen_port;
+  char uplink_name[IFNAMSIZ];
+  char tun_name[IFNAMSIZ];
+  u32 mtu;
+  u32 n_workers;
+  int *worker_cpus;
+  wg_awg_cfg_t awg;
+
+  /* [Peer] sections, fixed once running */
+  awg_vpn_peer_config_t *peer_configs;
+  awg_vpn_peer_t *peers;
+  u32 n_peers;
+  awg_vpn_route_t *routes; /* longest prefix first */
+
+  /* junk in front of and type of each message on the wire */
+  u32 junk_size[MESSAGE_DATA + 1];
+  u32 magic[MESSAGE_DATA + 1];
+
+  u32 local_index;
+  cookie_checker_t cookie_checker;
+
+  /* uplink */
+  int uplink_if_index;
+  u8 src_mac[6];
+  ip4_address_t src_ip;
+  int udp_fd; /* holds the port, sends what the control thread sends */
+
+  /* receiver index: the index in the high bits, the peer in the low */
+  u64 *index_table;
+  u32 *free_index_slots;
+  u64 random_seed;
+
+  awg_vpn_worker_t *workers; /* n_workers of them */
+  vlib_main_t *control_vm;
+  int control_wakeup_fd;
+  volatile u32 running;
+} awg_vpn_main_t;
+
+extern awg_vpn_main_t awg_vpn_main;
+
+/* config.c */
+int awg_vpn_config_read (awg_vpn_main_t *am, const char *path);
+
+/* uplink.c */
+int awg_vpn_uplink_init (awg_vpn_main_t *am);
+int awg_vpn_uplink_worker_init (awg_vpn_main_t *am, awg_vpn_worker_t *w);
+void awg_vpn_ip4_udp_header (awg_vpn_main_t *am, u8 *ip_udp,
+			     ip4_address_t dst, u16 dst_port, u16 payload_len);
+int awg_vpn_uplink_send (awg_vpn_main_t *am, u64 endpoint, const u8 *junk,
+			 u32 junk_len, const void *msg, u32 msg_len);
+
+/* tun.c */
+int awg_vpn_tun_open (awg_vpn_main_t *am, awg_vpn_worker_t *w);
+int awg_vpn_tun_up (awg_vpn_main_t *am);
+
+/* worker.c */
+void *awg_vpn_worker_thread (void *arg);
+
+/* control.c */
+int awg_vpn_control_init (awg_vpn_main_t *am);
+void awg_vpn_control_run (awg_vpn_main_t *am);
+void awg_vpn_show_counters (awg_vpn_main_t *am);
+
+static_always_inline void
+awg_vpn_wakeup (int fd)
+{
+  u64 one = 1;
+  (void) !write (fd, &one, sizeof (one));
+}
+
+/* ask the control thread for a handshake with the peer */
+static_always_inline void
+awg_vpn_want_handshake (awg_vpn_main_t *am, awg_vpn_peer_t *peer)
+{
+  if (!__atomic_exchange_n (&peer->want_handshake, 1, __ATOMIC_ACQ_REL))
+    awg_vpn_wakeup (am->control_wakeup_fd);
+}
+
+static_always_inline noise_remote_t *
+awg_vpn_index_lookup (awg_vpn_main_t *am, u32 index, u32 *peer_index)
+{
+  u64 e = __atomic_load_n (&am->index_table[index &
+					     (AWG_VPN_N_INDEX_SLOTS - 1)],
+			   __ATOMIC_ACQUIRE);
+
+  if (PREDICT_FALSE ((u32) (e >> 32) != index || !index))
+    return 0;
+  *peer_index = (u32) e;
+  return &am->peers[*peer_index].remote;
+}
+
+static_always_inline int
+awg_vpn_prefix_match (const ip46_address_t *prefix, u8 len,
+		      const ip46_address_t *addr)
+{
+  u8 i;
+
+  for (i = 0; len >= 8; i++, len -= 8)
+    if (prefix->as_u8[i] != addr->as_u8[i])
+      return 0;
+  return !len || !((prefix->as_u8[i] ^ addr->as_u8[i]) & (0xff00 >> len));
+}
+
+/* longest allowed-ips match, cached per worker, ~0 if none */
+static_always_inline u32
+awg_vpn_route_lookup (awg_vpn_main_t *am, awg_vpn_worker_t *w,
+		      const ip46_address_t *addr, u8 is_ip4)
+{
+  awg_vpn_route_cache_entry_t *ce;
+  awg_vpn_route_t *rt;
+  u32 i;
+  u64 h;
+
+  h = (addr->as_u64[0] ^ addr->as_u64[1]) * 0x9e3779b97f4a7c15ULL;
+  ce = &w->route_cache[(h >> 32) & (AWG_VPN_ROUTE_CACHE_SIZE - 1)];
+  if (ce->is_ip4 == is_ip4 && ce->addr.as_u64[0] == addr->as_u64[0] &&
+      ce->addr.as_u64[1] == addr->as_u64[1])
+    return ce->peer_index;
+
+  ce->addr = *addr;
+  ce->is_ip4 = is_ip4;
+  ce->peer_index = ~0;
+  for (i = 0; i < vec_len (am->routes); i++)
+    {
+      rt = am->routes + i;
+      /* ip4 prefixes are kept with 96 leading bits of padding */
+      if (rt->is_ip4 == is_ip4 &&
+	  awg_vpn_prefix_match (&rt->addr, rt->len + (is_ip4 ? 96 : 0), addr))
+	{
+	  ce->peer_index = rt->peer_index;
+	  break;
+	}
+    }
+  return ce->peer_index;
+}
+
+#endif /* __included_awg_vpn_h__ */
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
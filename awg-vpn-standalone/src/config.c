@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * wg-quick style configuration, [Interface] with the AmneziaWG keys
+ * (Jc, Jmin, Jmax, S1-S4, H1-H4, I1-I5) and one [Peer] section per peer.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <strings.h>
+
+#include <awg_vpn.h>
+#include <wireguard/wireguard_key.h>
+
+typedef enum
+{
+  AWG_VPN_SECTION_NONE,
+  AWG_VPN_SECTION_INTERFACE,
+  AWG_VPN_SECTION_PEER,
+} awg_vpn_section_t;
+
+static char *
+awg_vpn_config_strip (char *s)
+{
+  char *e;
+
+  while (isspace ((u8) *s))
+    s++;
+  e = s + strlen (s);
+  while (e > s && isspace ((u8) e[-1]))
+    *--e = 0;
+  return s;
+}
+
+static int
+awg_vpn_config_u32 (const char *value, u32 max, u32 *result)
+{
+  unsigned long v;
+  char *end;
+
+  errno = 0;
+  v = strtoul (value, &end, 0);
+  if (errno || end == value || *end || v > max)
+    return -1;
+  *result = (u32) v;
+  return 0;
+}
+
+static int
+awg_vpn_config_key (const char *value, u8 key[NOISE_PUBLIC_KEY_LEN])
+{
+  u8 out[NOISE_PUBLIC_KEY_LEN + 3];
+
+  if (strlen (value) != NOISE_KEY_LEN_BASE64 - 1 ||
+      !key_from_base64 ((const u8 *) value, NOISE_KEY_LEN_BASE64, out))
+    return -1;
+  clib_memcpy (key, out, NOISE_PUBLIC_KEY_LEN);
+  wg_secure_zero_memory (out, sizeof (out));
+  return 0;
+}
+
+static int
+awg_vpn_config_endpoint (const char *value, u64 *endpoint)
+{
+  struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM };
+  struct addrinfo *res;
+  char host[256], *port;
+  ip4_address_t ip;
+
+  if (strlen (value) >= sizeof (host))
+    return -1;
+  strcpy (host, value);
+  if (!(port = strrchr (host, ':')))
+    return -1;
+  *port++ = 0;
+
+  /* the uplink speaks ip4 only */
+  if (getaddrinfo (host, port, &hints, &res))
+    return -1;
+  ip.as_u32 = ((struct sockaddr_in *) res->ai_addr)->sin_addr.s_addr;
+  *endpoint =
+    awg_vpn_endpoint_pack (ip, ((struct sockaddr_in *) res->ai_addr)->sin_port);
+  freeaddrinfo (res);
+  return 0;
+}
+
+static int
+awg_vpn_config_allowed_ips (awg_vpn_main_t *am, char *value, u32 peer_index)
+{
+  awg_vpn_route_t rt;
+  char *prefix, *save, *len;
+  u32 max_len, l;
+
+  for (prefix = strtok_r (value, ",", &save); prefix;
+       prefix = strtok_r (0, ",", &save))
+    {
+      prefix = awg_vpn_config_strip (prefix);
+      clib_memset (&rt, 0, sizeof (rt));
+      rt.peer_index = peer_index;
+
+      if ((len = strchr (prefix, '/')))
+	*len++ = 0;
+
+      if (inet_pton (AF_INET, prefix, &rt.addr.ip4) == 1)
+	{
+	  rt.is_ip4 = 1;
+	  max_len = 32;
+	}
+      else if (inet_pton (AF_INET6, prefix, &rt.addr.ip6) == 1)
+	max_len = 128;
+      else
+	return -1;
+
+      l = max_len;
+      if (len && awg_vpn_config_u32 (len, max_len, &l))
+	return -1;
+      rt.len = l;
+      vec_add1 (am->routes, rt);
+    }
+  return 0;
+}
+
+static int
+awg_vpn_config_cpus (awg_vpn_main_t *am, char *value)
+{
+  char *cpu, *save;
+  u32 c;
+
+  for (cpu = strtok_r (value, ",", &save); cpu; cpu = strtok_r (0, ",", &save))
+    {
+      if (awg_vpn_config_u32 (awg_vpn_config_strip (cpu), 4095, &c))
+	return -1;
+      vec_add1 (am->worker_cpus, (int) c);
+    }
+  return 0;
+}
+
+static int
+awg_vpn_config_interface (awg_vpn_main_t *am, const char *key, char *value)
+{
+  wg_awg_cfg_t *awg = &am->awg;
+  u32 v, i;
+
+  if (!strcasecmp (key, "PrivateKey"))
+    return awg_vpn_config_key (value, am->private_key);
+  if (!strcasecmp (key, "ListenPort"))
+    {
+      if (awg_vpn_config_u32 (value, 65535, &v) || !v)
+	return -1;
+      am->listen_port = v;
+      return 0;
+    }
+  if (!strcasecmp (key, "Uplink"))
+    {
+      if (strlen (value) >= sizeof (am->uplink_name))
+	return -1;
+      strcpy (am->uplink_name, value);
+      return 0;
+    }
+  if (!strcasecmp (key, "Tun"))
+    {
+      if (strlen (value) >= sizeof (am->tun_name))
+	return -1;
+      strcpy (am->tun_name, value);
+      return 0;
+    }
+  if (!strcasecmp (key, "MTU"))
+    {
+      if (awg_vpn_config_u32 (value, 9000, &v) || v < 576)
+	return -1;
+      am->mtu = v;
+      return 0;
+    }
+  if (!strcasecmp (key, "Workers"))
+    return awg_vpn_config_u32 (value, AWG_VPN_MAX_WORKERS, &am->n_workers);
+  if (!strcasecmp (key, "Cpus"))
+    return awg_vpn_config_cpus (am, value);
+
+  /* AmneziaWG */
+  if (!strcasecmp (key, "Jc"))
+    {
+      awg->enabled = 1;
+      return awg_vpn_config_u32 (value, WG_AWG_MAX_JUNK_PACKET_COUNT,
+				 &awg->junk_packet_count);
+    }
+  if (!strcasecmp (key, "Jmin"))
+    {
+      awg->enabled = 1;
+      return awg_vpn_config_u32 (value, WG_AWG_MAX_JUNK_PACKET_SIZE,
+				 &awg->junk_packet_min_size);
+    }
+  if (!strcasecmp (key, "Jmax"))
+    {
+      awg->enabled = 1;
+      return awg_vpn_config_u32 (value, WG_AWG_MAX_JUNK_PACKET_SIZE,
+				 &awg->junk_packet_max_size);
+    }
+  if (!strcasecmp (key, "S1") || !strcasecmp (key, "S2") ||
+      !strcasecmp (key, "S3") || !strcasecmp (key, "S4"))
+    {
+      u32 *sizes[] = { &awg->init_header_junk_size,
+		       &awg->response_header_junk_size,
+		       &awg->cookie_reply_header_junk_size,
+		       &awg->transport_header_junk_size };
+      awg->enabled = 1;
+      return awg_vpn_config_u32 (value, WG_AWG_MAX_HEADER_JUNK_SIZE,
+				 sizes[key[1] - '1']);
+    }
+  if ((key[0] == 'H' || key[0] == 'h') && key[1] >= '1' && key[1] <= '4' &&
+      !key[2])
+    {
+      awg->enabled = 1;
+      return awg_vpn_config_u32 (value, ~0, &awg->magic_header[key[1] - '1']);
+    }
+  if ((key[0] == 'I' || key[0] == 'i') && key[1] >= '1' && key[1] <= '5' &&
+      !key[2])
+    {
+      i = key[1] - '1';
+      if (wg_awg_parse_tag_string (value, &awg->i_headers[i]))
+	return -1;
+      awg->i_headers[i].enabled = 1;
+      awg->i_headers_enabled = 1;
+      awg->enabled = 1;
+      return 0;
+    }
+
+  return -1;
+}
+
+static int
+awg_vpn_config_peer (awg_vpn_main_t *am, const char *key, char *value)
+{
+  u32 peer_index = vec_len (am->peer_configs) - 1;
+  awg_vpn_peer_config_t *pc = am->peer_configs + peer_index;
+  u32 v;
+
+  if (!strcasecmp (key, "PublicKey"))
+    return awg_vpn_config_key (value, pc->public_key);
+  if (!strcasecmp (key, "PresharedKey"))
+    return awg_vpn_config_key (value, pc->preshared_key);
+  if (!strcasecmp (key, "AllowedIPs"))
+    return awg_vpn_config_allowed_ips (am, value, peer_index);
+  if (!strcasecmp (key, "Endpoint"))
+    return awg_vpn_config_endpoint (value, &pc->endpoint);
+  if (!strcasecmp (key, "PersistentKeepalive"))
+    {
+      if (!strcasecmp (value, "off"))
+	v = 0;
+      else if (awg_vpn_config_u32 (value, 65535, &v))
+	return -1;
+      pc->persistent_keepalive = v;
+      return 0;
+    }
+
+  return -1;
+}
+
+static int
+awg_vpn_route_cmp (const void *a, const void *b)
+{
+  const awg_vpn_route_t *ra = a, *rb = b;
+
+  return (int) rb->len - (int) ra->len;
+}
+
+int
+awg_vpn_config_read (awg_vpn_main_t *am, const char *path)
+{
+  awg_vpn_section_t section = AWG_VPN_SECTION_NONE;
+  static const u8 zero_key[NOISE_PUBLIC_KEY_LEN];
+  awg_vpn_peer_config_t pc;
+  char line[WG_AWG_MAX_TAG_STRING_LEN + 64], *s, *value;
+  u32 line_number = 0, i;
+  FILE *f;
+  int rv = -1;
+
+  if (!(f = fopen (path, "r")))
+    {
+      clib_error ("%s: %s", path, strerror (errno));
+      return -1;
+    }
+
+  am->listen_port = AWG_VPN_DEFAULT_PORT;
+  am->mtu = AWG_VPN_DEFAULT_MTU;
+  strcpy (am->tun_name, "awg0");
+  wg_awg_cfg_init (&am->awg);
+
+  while (fgets (line, sizeof (line), f))
+    {
+      line_number++;
+      if ((s = strchr (line, '#')))
+	*s = 0;
+      s = awg_vpn_config_strip (line);
+      if (!*s)
+	continue;
+
+      if (!strcasecmp (s, "[Interface]"))
+	{
+	  section = AWG_VPN_SECTION_INTERFACE;
+	  continue;
+	}
+      if (!strcasecmp (s, "[Peer]"))
+	{
+	  section = AWG_VPN_SECTION_PEER;
+	  clib_memset (&pc, 0, sizeof (pc));
+	  vec_add1 (am->peer_configs, pc);
+	  continue;
+	}
+
+      if (!(value = strchr (s, '=')) || section == AWG_VPN_SECTION_NONE)
+	goto error;
+      *value++ = 0;
+      s = awg_vpn_config_strip (s);
+      value = awg_vpn_config_strip (value);
+
+      if (section == AWG_VPN_SECTION_INTERFACE ?
+	    awg_vpn_config_interface (am, s, value) :
+	    awg_vpn_config_peer (am, s, value))
+	goto error;
+    }
+
+  if (!am->uplink_name[0] || !memcmp (am->private_key, zero_key, 32))
+    {
+      clib_error ("%s: [Interface] needs PrivateKey and Uplink", path);
+      goto done;
+    }
+  for (i = 0; i < vec_len (am->peer_configs); i++)
+    if (!memcmp (am->peer_configs[i].public_key, zero_key, 32))
+      {
+	clib_error ("%s: [Peer] %u has no PublicKey", path, i + 1);
+	goto done;
+      }
+  if (am->awg.junk_packet_min_size > am->awg.junk_packet_max_size)
+    {
+      clib_error ("%s: Jmin is larger than Jmax", path);
+      goto done;
+    }
+
+  /* a padded data message has to fit a ring frame */
+  if (TPACKET_ALIGN (sizeof (struct tpacket3_hdr)) + AWG_VPN_OUTER_HDR_LEN +
+	am->awg.transport_header_junk_size +
+	message_data_len (round_pow2 (am->mtu, 16)) >
+      AWG_VPN_FRAME_SIZE)
+    {
+      clib_error ("%s: MTU %u and S4 %u do not fit a %u byte frame", path,
+		  am->mtu, am->awg.transport_header_junk_size,
+		  AWG_VPN_FRAME_SIZE);
+      goto done;
+    }
+
+  if (!am->n_workers)
+    am->n_workers = vec_len (am->worker_cpus) ? vec_len (am->worker_cpus) : 1;
+
+  wg_awg_cfg_update_rx (&am->awg);
+  for (i = MESSAGE_HANDSHAKE_INITIATION; i <= MESSAGE_DATA; i++)
+    {
+      am->junk_size[i] = wg_awg_get_header_junk_size (&am->awg, i);
+      am->magic[i] = wg_awg_get_magic_header (&am->awg, i);
+    }
+
+  /* the first match of a linear walk is then the longest */
+  if (vec_len (am->routes))
+    qsort (am->routes, vec_len (am->routes), sizeof (am->routes[0]),
+	   awg_vpn_route_cmp);
+
+  rv = 0;
+  goto done;
+
+error:
+  clib_error ("%s:%u: cannot parse '%s'", path, line_number, s);
+done:
+  fclose (f);
+  wg_secure_zero_memory (line, sizeof (line));
+  return rv;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
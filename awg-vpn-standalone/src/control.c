@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The control thread: noise handshakes, cookies and the peer timers of
+ * wireguard_timer.c, run off a poll loop instead of a timer wheel. What
+ * it sends goes through the kernel UDP socket.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <vppinfra/random.h>
+
+#include <awg_vpn.h>
+
+/* noise upcalls */
+
+static noise_remote_t *
+awg_vpn_remote_get (void *arg, const uint8_t public[NOISE_PUBLIC_KEY_LEN])
+{
+  awg_vpn_main_t *am = arg;
+  u32 i;
+
+  for (i = 0; i < am->n_peers; i++)
+    if (!clib_memcmp (am->peers[i].remote.r_public, public,
+		      NOISE_PUBLIC_KEY_LEN))
+      return &am->peers[i].remote;
+  return 0;
+}
+
+/* control thread, or whoever holds the barrier */
+static uint32_t
+awg_vpn_index_set (vlib_main_t *vm, noise_remote_t *r)
+{
+  awg_vpn_main_t *am = &awg_vpn_main;
+  u32 n = vec_len (am->free_index_slots), slot, index;
+
+  (void) vm;
+  if (!n)
+    return 0;
+  slot = am->free_index_slots[n - 1];
+  _vec_hdr (am->free_index_slots)->len--;
+
+  index = (random_u32 (&am->random_seed) << AWG_VPN_INDEX_SLOT_BITS) | slot;
+  __atomic_store_n (&am->index_table[slot],
+		    ((u64) index << 32) | r->r_peer_idx, __ATOMIC_RELEASE);
+  return index;
+}
+
+static void
+awg_vpn_index_drop (vlib_main_t *vm, uint32_t index)
+{
+  awg_vpn_main_t *am = &awg_vpn_main;
+  u32 slot = index & (AWG_VPN_N_INDEX_SLOTS - 1);
+
+  (void) vm;
+  if (!index || (u32) (am->index_table[slot] >> 32) != index)
+    return;
+  __atomic_store_n (&am->index_table[slot], 0, __ATOMIC_RELEASE);
+  vec_add1 (am->free_index_slots, slot);
+}
+
+/* sending */
+
+static int
+awg_vpn_send (awg_vpn_main_t *am, u64 endpoint, message_type_t type,
+	      void *msg, u32 len)
+{
+  u8 junk[WG_AWG_MAX_HEADER_JUNK_SIZE];
+  u32 junk_len = am->junk_size[type];
+
+  ((message_header_t *) msg)->type = am->magic[type];
+  if (junk_len)
+    wg_awg_generate_junk (junk, junk_len);
+  return awg_vpn_uplink_send (am, endpoint, junk, junk_len, msg, len);
+}
+
+/* i-headers on special handshakes, then the junk packets, as the plugin */
+static void
+awg_vpn_send_pre_handshake (awg_vpn_main_t *am, u64 endpoint, f64 now)
+{
+  static u8 buf[clib_max (AWG_VPN_FRAME_SIZE, WG_AWG_MAX_JUNK_PACKET_SIZE)];
+  wg_awg_i_header_t *ihdrs[WG_AWG_MAX_I_HEADERS];
+  u32 sizes[WG_AWG_MAX_JUNK_PACKET_COUNT];
+  u32 i, n;
+
+  if (wg_awg_needs_special_handshake (&am->awg, now))
+    {
+      n = wg_awg_i_headers (&am->awg, AWG_VPN_FRAME_SIZE, ihdrs);
+      for (i = 0; i < n; i++)
+	{
+	  wg_awg_render_i_header (ihdrs[i], buf, (u64) unix_time_now ());
+	  awg_vpn_uplink_send (am, endpoint, 0, 0, buf, ihdrs[i]->total_size);
+	}
+    }
+
+  n = wg_awg_junk_sizes (&am->awg, sizes);
+  for (i = 0; i < n; i++)
+    {
+      wg_awg_generate_junk (buf, sizes[i]);
+      awg_vpn_uplink_send (am, endpoint, 0, 0, buf, sizes[i]);
+    }
+}
+
+static void
+awg_vpn_send_initiation (awg_vpn_main_t *am, awg_vpn_peer_t *peer, f64 now)
+{
+  vlib_main_t *vm = am->control_vm;
+  message_handshake_initiation_t packet;
+  u64 endpoint = __atomic_load_n (&peer->endpoint, __ATOMIC_RELAXED);
+
+  if (!endpoint)
+    return;
+
+  peer->last_initiation_sent = now;
+  peer->handshake_in_flight = 1;
+  peer->retransmit_at =
+    now + REKEY_TIMEOUT +
+    (random_u32 (&am->random_seed) % REKEY_TIMEOUT_JITTER) * WG_TICK;
+
+  if (!noise_create_initiation (vm, &peer->remote, &packet.sender_index,
+				packet.unencrypted_ephemeral,
+				packet.encrypted_static,
+				packet.encrypted_timestamp))
+    return;
+  /* the macs cover the header as sent */
+  packet.header.type = am->magic[MESSAGE_HANDSHAKE_INITIATION];
+  cookie_maker_mac (&peer->cookie_maker, &packet.macs, &packet,
+		    sizeof (packet));
+
+  if (wg_awg_is_enabled (&am->awg))
+    awg_vpn_send_pre_handshake (am, endpoint, now);
+
+  if (!awg_vpn_send (am, endpoint, MESSAGE_HANDSHAKE_INITIATION, &packet,
+		     sizeof (packet)))
+    peer->last_sent = now;
+}
+
+static void
+awg_vpn_send_response (awg_vpn_main_t *am, awg_vpn_peer_t *peer, f64 now)
+{
+  vlib_main_t *vm = am->control_vm;
+  message_handshake_response_t packet;
+
+  if (!noise_create_response (vm, &peer->remote, &packet.sender_index,
+			      &packet.receiver_index,
+			      packet.unencrypted_ephemeral,
+			      packet.encrypted_nothing))
+    return;
+  packet.header.type = am->magic[MESSAGE_HANDSHAKE_RESPONSE];
+  cookie_maker_mac (&peer->cookie_maker, &packet.macs, &packet,
+		    sizeof (packet));
+
+  /* the keypair waits in r_next until the initiator uses it */
+  if (!noise_remote_begin_session (vm, &peer->remote, packet.sender_index))
+    return;
+
+  if (!awg_vpn_send (am, __atomic_load_n (&peer->endpoint, __ATOMIC_RELAXED),
+		     MESSAGE_HANDSHAKE_RESPONSE, &packet, sizeof (packet)))
+    peer->last_sent = now;
+}
+
+static void
+awg_vpn_send_cookie (awg_vpn_main_t *am, u32 sender_index,
+		     message_macs_t *macs, ip46_address_t *src, u16 src_port,
+		     u64 endpoint)
+{
+  message_handshake_cookie_t packet;
+
+  packet.receiver_index = sender_index;
+  cookie_checker_create_payload (am->control_vm, &am->cookie_checker, macs,
+				 packet.nonce, packet.encrypted_cookie, src,
+				 src_port);
+  awg_vpn_send (am, endpoint, MESSAGE_HANDSHAKE_COOKIE, &packet,
+		sizeof (packet));
+}
+
+static void
+awg_vpn_send_keepalive (awg_vpn_main_t *am, awg_vpn_peer_t *peer, f64 now)
+{
+  u8 buf[message_data_len (0)];
+  message_data_t *packet = (message_data_t *) buf;
+  noise_keypair_t *kp = peer->remote.r_current;
+  u64 nonce;
+
+  if (!kp || !kp->kp_valid ||
+      wg_birthdate_has_expired_opt (kp->kp_birthdate, REJECT_AFTER_TIME, now))
+    {
+      __atomic_store_n (&peer->want_handshake, 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+  nonce = noise_keypair_send_nonce (kp, am->control_vm->thread_index);
+  if (nonce >= REJECT_AFTER_MESSAGES)
+    return;
+  packet->receiver_index = kp->kp_remote_index;
+  packet->counter = nonce;
+  wg_chacha20poly1305_calc (am->control_vm, NULL, 0, packet->encrypted_data,
+			    NULL, 0, nonce,
+			    VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC,
+			    kp->kp_send_index);
+
+  if (!awg_vpn_send (am, __atomic_load_n (&peer->endpoint, __ATOMIC_RELAXED),
+		     MESSAGE_DATA, buf, sizeof (buf)))
+    peer->last_sent = now;
+}
+
+/* handshakes, as wg_handshake_process () takes them */
+
+static void
+awg_vpn_peer_learn (awg_vpn_peer_t *peer, awg_vpn_handshake_t *hs)
+{
+  u64 mac = 0;
+
+  clib_memcpy (&mac, hs->src_mac, 6);
+  __atomic_store_n (&peer->endpoint,
+		    awg_vpn_endpoint_pack (hs->src, hs->src_port),
+		    __ATOMIC_RELAXED);
+  __atomic_store_n (&peer->dst_mac, mac, __ATOMIC_RELAXED);
+}
+
+static void
+awg_vpn_handshake_process (awg_vpn_main_t *am, awg_vpn_handshake_t *hs,
+			   bool under_load, f64 now)
+{
+  vlib_main_t *vm = am->control_vm;
+  u16 src_port = clib_net_to_host_u16 (hs->src_port);
+  enum cookie_mac_state mac_state;
+  bool packet_needs_cookie;
+  message_macs_t *macs;
+  awg_vpn_peer_t *peer;
+  ip46_address_t src;
+  noise_remote_t *r;
+  u32 pi;
+
+  if (hs->type == MESSAGE_HANDSHAKE_COOKIE)
+    {
+      message_handshake_cookie_t *packet = (void *) hs->data;
+
+      if ((r = awg_vpn_index_lookup (am, packet->receiver_index, &pi)))
+	cookie_maker_consume_payload (vm, &am->peers[pi].cookie_maker,
+				      packet->nonce, packet->encrypted_cookie);
+      return;
+    }
+
+  ip46_address_set_ip4 (&src, &hs->src);
+  macs = (message_macs_t *) (hs->data + hs->len - sizeof (*macs));
+  mac_state = cookie_checker_validate_macs (
+    vm, &am->cookie_checker, macs, hs->data, hs->len, under_load, &src,
+    src_port);
+
+  if ((under_load && mac_state == VALID_MAC_WITH_COOKIE) ||
+      (!under_load && mac_state == VALID_MAC_BUT_NO_COOKIE))
+    packet_needs_cookie = false;
+  else if (under_load && mac_state == VALID_MAC_BUT_NO_COOKIE)
+    packet_needs_cookie = true;
+  else
+    return;
+
+  if (packet_needs_cookie)
+    {
+      /* the sender index sits right after the type in both */
+      awg_vpn_send_cookie (am, clib_mem_unaligned (hs->data + 4, u32), macs,
+			   &src, src_port,
+			   awg_vpn_endpoint_pack (hs->src, hs->src_port));
+      return;
+    }
+
+  if (hs->type == MESSAGE_HANDSHAKE_INITIATION)
+    {
+      message_handshake_initiation_t *message = (void *) hs->data;
+
+      if (!noise_consume_initiation (
+	    vm, noise_local_get (am->local_index), &r, message->sender_index,
+	    message->unencrypted_ephemeral, message->encrypted_static,
+	    message->encrypted_timestamp))
+	return;
+      peer = am->peers + r->r_peer_idx;
+      awg_vpn_peer_learn (peer, hs);
+      awg_vpn_send_response (am, peer, now);
+    }
+  else
+    {
+      message_handshake_response_t *resp = (void *) hs->data;
+
+      if (!(r = awg_vpn_index_lookup (am, resp->receiver_index, &pi)))
+	return;
+      peer = am->peers + pi;
+      if (!noise_consume_response (vm, r, resp->sender_index,
+				   resp->receiver_index,
+				   resp->unencrypted_ephemeral,
+				   resp->encrypted_nothing))
+	return;
+      awg_vpn_peer_learn (peer, hs);
+
+      if (noise_remote_begin_session (vm, r, resp->receiver_index))
+	{
+	  peer->handshake_in_flight = 0;
+	  peer->n_handshake_attempts = 0;
+	  peer->last_received = now;
+	  awg_vpn_send_keepalive (am, peer, now);
+	}
+    }
+}
+
+static u32
+awg_vpn_handshake_drain (awg_vpn_main_t *am, f64 now)
+{
+  u32 i, head, tail, n_queued = 0, n = 0;
+  awg_vpn_worker_t *w;
+  bool under_load;
+
+  for (i = 0; i < am->n_workers; i++)
+    {
+      w = am->workers + i;
+      n_queued += __atomic_load_n (&w->hs_tail, __ATOMIC_ACQUIRE) - w->hs_head;
+    }
+  under_load = n_queued >= AWG_VPN_HS_UNDER_LOAD;
+
+  for (i = 0; i < am->n_workers; i++)
+    {
+      w = am->workers + i;
+      head = w->hs_head;
+      tail = __atomic_load_n (&w->hs_tail, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++, n++)
+	awg_vpn_handshake_process (
+	  am, &w->hs_queue[head & (AWG_VPN_HS_QUEUE_SIZE - 1)], under_load,
+	  now);
+      __atomic_store_n (&w->hs_head, head, __ATOMIC_RELEASE);
+    }
+  return n;
+}
+
+/* timers, what wireguard_timer.c keeps on its wheel */
+
+static void
+awg_vpn_peer_timers (awg_vpn_main_t *am, awg_vpn_peer_t *peer, f64 now)
+{
+  vlib_main_t *vm = am->control_vm;
+  noise_remote_t *r = &peer->remote;
+  noise_keypair_t *kp = r->r_current, *newest = r->r_next ? r->r_next : kp;
+  u8 want = __atomic_exchange_n (&peer->want_handshake, 0, __ATOMIC_ACQ_REL);
+
+  /* no handshake for REJECT_AFTER_TIME * 3: the keys go */
+  if (newest && wg_birthdate_has_expired_opt (newest->kp_birthdate,
+					      REJECT_AFTER_TIME * 3, now))
+    {
+      vlib_worker_thread_barrier_sync (vm);
+      noise_remote_clear (vm, r);
+      vlib_worker_thread_barrier_release (vm);
+      return;
+    }
+
+  if (peer->handshake_in_flight)
+    {
+      if (now < peer->retransmit_at)
+	;
+      else if (peer->n_handshake_attempts >= MAX_TIMER_HANDSHAKES)
+	{
+	  /* gave up, till there is something to send again */
+	  peer->handshake_in_flight = 0;
+	  peer->n_handshake_attempts = 0;
+	}
+      else
+	{
+	  peer->n_handshake_attempts++;
+	  awg_vpn_send_initiation (am, peer, now);
+	}
+      return;
+    }
+
+  /* sent data, heard nothing back since before */
+  if (kp && peer->last_data_sent > peer->last_received &&
+      peer->last_initiation_sent <= peer->last_received &&
+      now - peer->last_received >= KEEPALIVE_TIMEOUT + REKEY_TIMEOUT)
+    want = 1;
+
+  if (peer->persistent_keepalive &&
+      now - peer->last_sent >= peer->persistent_keepalive)
+    {
+      if (kp)
+	awg_vpn_send_keepalive (am, peer, now);
+      else
+	want = 1;
+    }
+
+  if (want && now - peer->last_initiation_sent >= REKEY_TIMEOUT)
+    {
+      peer->n_handshake_attempts = 0;
+      awg_vpn_send_initiation (am, peer, now);
+      return;
+    }
+
+  /* passive keepalive: heard data, said nothing since */
+  if (kp && peer->last_data_received > peer->last_sent &&
+      now - peer->last_data_received >= KEEPALIVE_TIMEOUT)
+    awg_vpn_send_keepalive (am, peer, now);
+}
+
+int
+awg_vpn_control_init (awg_vpn_main_t *am)
+{
+  struct noise_upcall upcall = {
+    .u_arg = am,
+    .u_remote_get = awg_vpn_remote_get,
+    .u_index_set = awg_vpn_index_set,
+    .u_index_drop = awg_vpn_index_drop,
+  };
+  vlib_main_t *vm = am->control_vm;
+  awg_vpn_peer_config_t *pc;
+  awg_vpn_peer_t *peer;
+  noise_local_t *local;
+  u32 i;
+
+  am->random_seed = (u64) unix_time_now () ^ ((u64) getpid () << 32);
+  (void) random_u32 (&am->random_seed);
+
+  am->index_table = clib_mem_alloc_aligned (
+    AWG_VPN_N_INDEX_SLOTS * sizeof (am->index_table[0]), CLIB_CACHE_LINE_BYTES);
+  clib_memset (am->index_table, 0,
+	       AWG_VPN_N_INDEX_SLOTS * sizeof (am->index_table[0]));
+  /* slot 0 stays free, index 0 is never handed out */
+  for (i = AWG_VPN_N_INDEX_SLOTS - 1; i > 0; i--)
+    vec_add1 (am->free_index_slots, i);
+
+  wg_chacha20poly1305_init ();
+  if (!wg_awg_init ())
+    {
+      clib_error ("no randomness for the junk generator");
+      return -1;
+    }
+  pool_get (noise_local_pool, local);
+  am->local_index = local - noise_local_pool;
+  noise_local_init (local, &upcall);
+  if (!noise_local_set_private (local, am->private_key))
+    {
+      clib_error ("private key is not a curve25519 key");
+      return -1;
+    }
+  cookie_checker_init (&am->cookie_checker);
+  cookie_checker_update (&am->cookie_checker, local->l_public);
+
+  am->n_peers = vec_len (am->peer_configs);
+  am->peers = clib_mem_alloc_aligned (
+    clib_max (am->n_peers, 1) * sizeof (am->peers[0]), CLIB_CACHE_LINE_BYTES);
+  clib_memset (am->peers, 0, am->n_peers * sizeof (am->peers[0]));
+  for (i = 0; i < am->n_peers; i++)
+    {
+      pc = am->peer_configs + i;
+      peer = am->peers + i;
+      noise_remote_init (vm, &peer->remote, i, pc->public_key,
+			 am->local_index);
+      /* any worker may encrypt or decrypt with the peer's keypairs */
+      peer->remote.r_multi_queue = 1;
+      clib_memcpy (peer->remote.r_psk, pc->preshared_key,
+		   NOISE_SYMMETRIC_KEY_LEN);
+      cookie_maker_init (&peer->cookie_maker, pc->public_key);
+      peer->endpoint = pc->endpoint;
+      peer->persistent_keepalive = pc->persistent_keepalive;
+    }
+  return 0;
+}
+
+void
+awg_vpn_control_run (awg_vpn_main_t *am)
+{
+  vlib_main_t *vm = am->control_vm;
+  struct pollfd pfd = { .fd = am->control_wakeup_fd, .events = POLLIN };
+  f64 now;
+  u64 v;
+  u32 i, n;
+
+  while (__atomic_load_n (&am->running, __ATOMIC_RELAXED))
+    {
+      vlib_worker_thread_barrier_check (vm);
+      vlib_rpc_process (vm);
+
+      now = vlib_time_now (vm);
+      n = awg_vpn_handshake_drain (am, now);
+      for (i = 0; i < am->n_peers; i++)
+	awg_vpn_peer_timers (am, am->peers + i, now);
+
+      if (!n && poll (&pfd, 1, 100) > 0)
+	(void) !read (am->control_wakeup_fd, &v, sizeof (v));
+    }
+}
+
+void
+awg_vpn_show_counters (awg_vpn_main_t *am)
+{
+  awg_vpn_worker_counters_t sum = {};
+  awg_vpn_worker_t *w;
+  u32 i;
+
+  for (i = 0; i < am->n_workers; i++)
+    {
+      w = am->workers + i;
+#define _(n, s) sum.n += w->counters.n;
+      foreach_awg_vpn_worker_counter
+#undef _
+    }
+
+#define _(n, s) printf ("%-32s %" PRIu64 "\n", s, sum.n);
+  foreach_awg_vpn_worker_counter
+#undef _
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -0,0 +1,63 @@
+/*
+ * vnet crypto key slots, shared by every backend
+ * The backend in crypto_<name>.c runs vnet_crypto_process_ops ()
+ */
+
+#include <vnet/crypto/crypto.h>
+
+vnet_crypto_key_t vnet_crypto_keys[VNET_CRYPTO_N_KEYS];
+
+static struct
+{
+  pthread_mutex_t lock;
+  u32 *free_keys;
+  u32 n_keys;
+} vnet_crypto_key_main = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+vnet_crypto_key_index_t
+vnet_crypto_key_add (vlib_main_t *vm, vnet_crypto_alg_t alg, u8 *data,
+		     u16 length)
+{
+  typeof (vnet_crypto_key_main) *cm = &vnet_crypto_key_main;
+  vnet_crypto_key_t *key;
+  u32 index = ~0;
+
+  (void) vm;
+  if (length > sizeof (key->data))
+    return ~0;
+
+  pthread_mutex_lock (&cm->lock);
+  if (vec_len (cm->free_keys))
+    index = cm->free_keys[--_vec_hdr (cm->free_keys)->len];
+  else if (cm->n_keys < VNET_CRYPTO_N_KEYS)
+    index = cm->n_keys++;
+  pthread_mutex_unlock (&cm->lock);
+
+  if (index == (u32) ~0)
+    return ~0;
+
+  key = &vnet_crypto_keys[index];
+  clib_memcpy (key->data, data, length);
+  key->len = length;
+  key->alg = alg;
+  return index;
+}
+
+void
+vnet_crypto_key_del (vlib_main_t *vm, vnet_crypto_key_index_t index)
+{
+  typeof (vnet_crypto_key_main) *cm = &vnet_crypto_key_main;
+
+  (void) vm;
+  if (index >= VNET_CRYPTO_N_KEYS)
+    return;
+
+  /* callers hold the barrier or own the key, nobody uses it any more */
+  clib_memset (&vnet_crypto_keys[index], 0, sizeof (vnet_crypto_key_t));
+
+  pthread_mutex_lock (&cm->lock);
+  vec_add1 (cm->free_keys, index);
+  pthread_mutex_unlock (&cm->lock);
+}
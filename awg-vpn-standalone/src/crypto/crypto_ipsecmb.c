@@ -0,0 +1,146 @@
+/*
+ * intel-ipsec-mb crypto backend
+ * Synchronous ChaCha20-Poly1305 ops through the multi-buffer job API, as
+ * ipsecmb_ops_chacha_poly () in the VPP ipsecmb engine runs them; the
+ * manager picks the SSE, AVX2 or AVX-512 code at init
+ */
+
+#include <intel-ipsec-mb.h>
+#include <vnet/crypto/crypto.h>
+
+/* jobs in flight before the manager is flushed */
+#define IPSECMB_BATCH 256
+
+/* job manager of the calling thread */
+static __thread IMB_MGR *ipsecmb_mgr;
+
+static vnet_crypto_op_status_t
+ipsecmb_status_job (IMB_STATUS status)
+{
+  switch (status)
+    {
+    case IMB_STATUS_COMPLETED:
+      return VNET_CRYPTO_OP_STATUS_COMPLETED;
+    case IMB_STATUS_BEING_PROCESSED:
+    case IMB_STATUS_COMPLETED_CIPHER:
+    case IMB_STATUS_COMPLETED_AUTH:
+      return VNET_CRYPTO_OP_STATUS_WORK_IN_PROGRESS;
+    default:
+      return VNET_CRYPTO_OP_STATUS_FAIL_ENGINE_ERR;
+    }
+}
+
+static_always_inline void
+ipsecmb_retire_aead_job (IMB_JOB *job, u32 *n_fail)
+{
+  vnet_crypto_op_t *op = job->user_data;
+
+  if (PREDICT_FALSE (IMB_STATUS_COMPLETED != job->status))
+    {
+      op->status = ipsecmb_status_job (job->status);
+      *n_fail = *n_fail + 1;
+      return;
+    }
+
+  if (op->flags & VNET_CRYPTO_OP_FLAG_HMAC_CHECK)
+    {
+      if (memcmp (op->tag, job->auth_tag_output, op->tag_len))
+	{
+	  op->status = VNET_CRYPTO_OP_STATUS_FAIL_BAD_HMAC;
+	  *n_fail = *n_fail + 1;
+	  return;
+	}
+    }
+  else
+    clib_memcpy_fast (op->tag, job->auth_tag_output, op->tag_len);
+
+  op->status = VNET_CRYPTO_OP_STATUS_COMPLETED;
+}
+
+static u32
+ipsecmb_ops_chacha_poly (vnet_crypto_op_t *ops, u32 n_ops)
+{
+  IMB_MGR *m = ipsecmb_mgr;
+  u8 scratch[IPSECMB_BATCH][16];
+  u32 i, n_fail = 0, last_key_index = ~0;
+  IMB_JOB *job;
+  u8 *key = 0;
+
+  for (i = 0; i < n_ops; i++)
+    {
+      vnet_crypto_op_t *op = ops + i;
+
+      if (PREDICT_FALSE (op->op != VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC &&
+			 op->op != VNET_CRYPTO_OP_CHACHA20_POLY1305_DEC))
+	{
+	  op->status = VNET_CRYPTO_OP_STATUS_FAIL_NO_HANDLER;
+	  n_fail++;
+	  continue;
+	}
+
+      job = IMB_GET_NEXT_JOB (m);
+      if (last_key_index != op->key_index)
+	{
+	  key = vnet_crypto_get_key (op->key_index)->data;
+	  last_key_index = op->key_index;
+	}
+
+      job->cipher_direction = op->op == VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC ?
+				IMB_DIR_ENCRYPT :
+				IMB_DIR_DECRYPT;
+      job->chain_order = IMB_ORDER_HASH_CIPHER;
+      job->cipher_mode = IMB_CIPHER_CHACHA20_POLY1305;
+      job->hash_alg = IMB_AUTH_CHACHA20_POLY1305;
+      job->enc_keys = job->dec_keys = key;
+      job->key_len_in_bytes = 32;
+
+      job->u.CHACHA20_POLY1305.aad = op->aad;
+      job->u.CHACHA20_POLY1305.aad_len_in_bytes = op->aad_len;
+      job->src = op->src;
+      job->dst = op->dst;
+
+      job->iv = op->iv;
+      job->iv_len_in_bytes = 12;
+      job->msg_len_to_cipher_in_bytes = job->msg_len_to_hash_in_bytes =
+	op->len;
+      job->cipher_start_src_offset_in_bytes =
+	job->hash_start_src_offset_in_bytes = 0;
+
+      job->auth_tag_output = scratch[i];
+      job->auth_tag_output_len_in_bytes = 16;
+
+      job->user_data = op;
+
+      job = IMB_SUBMIT_JOB_NOCHECK (m);
+      if (job)
+	ipsecmb_retire_aead_job (job, &n_fail);
+    }
+
+  while ((job = IMB_FLUSH_JOB (m)))
+    ipsecmb_retire_aead_job (job, &n_fail);
+
+  return n_ops - n_fail;
+}
+
+u32
+vnet_crypto_process_ops (vlib_main_t *vm, vnet_crypto_op_t ops[], u32 n_ops)
+{
+  u32 n, n_done = 0;
+
+  (void) vm;
+  if (PREDICT_FALSE (!ipsecmb_mgr))
+    {
+      IMB_ARCH arch;
+
+      ipsecmb_mgr = alloc_mb_mgr (0);
+      init_mb_mgr_auto (ipsecmb_mgr, &arch);
+    }
+
+  /* the tags of a batch sit on the stack until its jobs are flushed */
+  for (; n_ops; ops += n, n_ops -= n)
+    {
+      n = clib_min (n_ops, IPSECMB_BATCH);
+      n_done += ipsecmb_ops_chacha_poly (ops, n);
+    }
+  return n_done;
+}
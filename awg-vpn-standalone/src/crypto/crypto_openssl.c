@@ -0,0 +1,76 @@
+/*
+ * OpenSSL crypto backend
+ * Synchronous ChaCha20-Poly1305 ops through EVP, batched the way the VPP
+ * openssl engine runs them; EVP picks the AVX2/AVX-512 or NEON code
+ */
+
+#include <openssl/evp.h>
+#include <vnet/crypto/crypto.h>
+
+/* EVP contexts of the calling thread, keyed per op */
+static __thread EVP_CIPHER_CTX *enc_ctx, *dec_ctx;
+
+u32
+vnet_crypto_process_ops (vlib_main_t *vm, vnet_crypto_op_t ops[], u32 n_ops)
+{
+  vnet_crypto_op_t *op;
+  u32 i, n_fail = 0;
+  int len;
+
+  (void) vm;
+  if (PREDICT_FALSE (!enc_ctx))
+    {
+      enc_ctx = EVP_CIPHER_CTX_new ();
+      dec_ctx = EVP_CIPHER_CTX_new ();
+      EVP_EncryptInit_ex (enc_ctx, EVP_chacha20_poly1305 (), 0, 0, 0);
+      EVP_DecryptInit_ex (dec_ctx, EVP_chacha20_poly1305 (), 0, 0, 0);
+    }
+
+  for (i = 0; i < n_ops; i++)
+    {
+      op = ops + i;
+
+      if (i + 1 < n_ops)
+	{
+	  CLIB_PREFETCH (ops[i + 1].src, 256, LOAD);
+	  CLIB_PREFETCH (vnet_crypto_keys + ops[i + 1].key_index, 64, LOAD);
+	}
+
+      if (op->op == VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC)
+	{
+	  EVP_EncryptInit_ex (enc_ctx, 0, 0,
+			      vnet_crypto_keys[op->key_index].data, op->iv);
+	  if (op->aad_len)
+	    EVP_EncryptUpdate (enc_ctx, 0, &len, op->aad, op->aad_len);
+	  EVP_EncryptUpdate (enc_ctx, op->dst, &len, op->src, op->len);
+	  EVP_EncryptFinal_ex (enc_ctx, op->dst + len, &len);
+	  EVP_CIPHER_CTX_ctrl (enc_ctx, EVP_CTRL_AEAD_GET_TAG, op->tag_len,
+			       op->tag);
+	  op->status = VNET_CRYPTO_OP_STATUS_COMPLETED;
+	}
+      else if (op->op == VNET_CRYPTO_OP_CHACHA20_POLY1305_DEC)
+	{
+	  EVP_DecryptInit_ex (dec_ctx, 0, 0,
+			      vnet_crypto_keys[op->key_index].data, op->iv);
+	  if (op->aad_len)
+	    EVP_DecryptUpdate (dec_ctx, 0, &len, op->aad, op->aad_len);
+	  EVP_DecryptUpdate (dec_ctx, op->dst, &len, op->src, op->len);
+	  EVP_CIPHER_CTX_ctrl (dec_ctx, EVP_CTRL_AEAD_SET_TAG, op->tag_len,
+			       op->tag);
+	  if (EVP_DecryptFinal_ex (dec_ctx, op->dst + len, &len) > 0)
+	    op->status = VNET_CRYPTO_OP_STATUS_COMPLETED;
+	  else
+	    {
+	      op->status = VNET_CRYPTO_OP_STATUS_FAIL_BAD_HMAC;
+	      n_fail++;
+	    }
+	}
+      else
+	{
+	  op->status = VNET_CRYPTO_OP_STATUS_FAIL_NO_HANDLER;
+	  n_fail++;
+	}
+    }
+
+  return n_ops - n_fail;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+
+#include <awg_vpn.h>
+
+awg_vpn_main_t awg_vpn_main;
+
+static void
+awg_vpn_signal (int sig)
+{
+  (void) sig;
+  awg_vpn_main.running = 0;
+  awg_vpn_wakeup (awg_vpn_main.control_wakeup_fd);
+}
+
+static int
+awg_vpn_workers_init (awg_vpn_main_t *am)
+{
+  awg_vpn_worker_t *w;
+  u32 i, j;
+
+  am->workers = clib_mem_alloc_aligned (am->n_workers * sizeof (*w),
+					CLIB_CACHE_LINE_BYTES);
+  clib_memset (am->workers, 0, am->n_workers * sizeof (*w));
+
+  for (i = 0; i < am->n_workers; i++)
+    {
+      w = am->workers + i;
+      w->worker_index = i;
+      w->vm = vlib_mains[i + 1];
+      w->cpu = i < vec_len (am->worker_cpus) ? am->worker_cpus[i] : -1;
+      w->random_seed = am->random_seed + i;
+      for (j = 0; j < AWG_VPN_ROUTE_CACHE_SIZE; j++)
+	w->route_cache[j].is_ip4 = ~0;
+      w->hs_queue = clib_mem_alloc_aligned (
+	AWG_VPN_HS_QUEUE_SIZE * sizeof (w->hs_queue[0]), CLIB_CACHE_LINE_BYTES);
+
+      if ((w->vm->wakeup_fd = eventfd (0, EFD_NONBLOCK)) < 0)
+	{
+	  clib_error ("eventfd: %s", strerror (errno));
+	  return -1;
+	}
+      if (awg_vpn_uplink_worker_init (am, w) || awg_vpn_tun_open (am, w))
+	return -1;
+    }
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  awg_vpn_main_t *am = &awg_vpn_main;
+  const char *config = 0;
+  sigset_t mask, old;
+  u32 i;
+  int c;
+
+  while ((c = getopt (argc, argv, "c:h")) != -1)
+    switch (c)
+      {
+      case 'c':
+	config = optarg;
+	break;
+      default:
+	fprintf (stderr, "usage: %s -c <config>\n", argv[0]);
+	return c == 'h' ? 0 : 1;
+      }
+  if (!config)
+    {
+      fprintf (stderr, "usage: %s -c <config>\n", argv[0]);
+      return 1;
+    }
+
+  if (awg_vpn_config_read (am, config))
+    return 1;
+
+  for (i = 0; i <= am->n_workers; i++)
+    vlib_main_init (i);
+  am->control_vm = vlib_mains[0];
+  vlib_main_tls = am->control_vm;
+  if ((am->control_wakeup_fd = eventfd (0, EFD_NONBLOCK)) < 0)
+    {
+      clib_error ("eventfd: %s", strerror (errno));
+      return 1;
+    }
+  am->control_vm->wakeup_fd = am->control_wakeup_fd;
+
+  if (awg_vpn_uplink_init (am) || awg_vpn_control_init (am) ||
+      awg_vpn_workers_init (am) || awg_vpn_tun_up (am))
+    return 1;
+
+  /* signals are for the control thread, workers start with them blocked */
+  sigfillset (&mask);
+  pthread_sigmask (SIG_BLOCK, &mask, &old);
+  am->running = 1;
+  for (i = 0; i < am->n_workers; i++)
+    if (pthread_create (&am->workers[i].thread, 0, awg_vpn_worker_thread,
+			am->workers + i))
+      {
+	clib_error ("worker %u: %s", i, strerror (errno));
+	return 1;
+      }
+  pthread_sigmask (SIG_SETMASK, &old, 0);
+  signal (SIGINT, awg_vpn_signal);
+  signal (SIGTERM, awg_vpn_signal);
+
+  clib_warning ("%s up, port %u, %u workers, %u peers", am->tun_name,
+		am->listen_port, am->n_workers, am->n_peers);
+  awg_vpn_control_run (am);
+
+  for (i = 0; i < am->n_workers; i++)
+    pthread_join (am->workers[i].thread, 0);
+  awg_vpn_show_counters (am);
+  return 0;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The inner side: one queue of a multiqueue TUN device per worker */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/if_tun.h>
+
+#include <awg_vpn.h>
+
+int
+awg_vpn_tun_open (awg_vpn_main_t *am, awg_vpn_worker_t *w)
+{
+  struct ifreq ifr;
+
+  if ((w->tun_fd = open ("/dev/net/tun", O_RDWR | O_NONBLOCK)) < 0)
+    {
+      clib_error ("/dev/net/tun: %s", strerror (errno));
+      return -1;
+    }
+
+  clib_memset (&ifr, 0, sizeof (ifr));
+  ifr.ifr_flags = IFF_TUN | IFF_NO_PI | IFF_MULTI_QUEUE;
+  strcpy (ifr.ifr_name, am->tun_name);
+  if (ioctl (w->tun_fd, TUNSETIFF, &ifr) < 0)
+    {
+      clib_error ("tun %s queue %u: %s", am->tun_name, w->worker_index,
+		  strerror (errno));
+      return -1;
+    }
+  return 0;
+}
+
+/* addresses and routes are left to the operator */
+int
+awg_vpn_tun_up (awg_vpn_main_t *am)
+{
+  struct ifreq ifr;
+  int fd, rv = -1;
+
+  fd = socket (AF_INET, SOCK_DGRAM, 0);
+  clib_memset (&ifr, 0, sizeof (ifr));
+  strcpy (ifr.ifr_name, am->tun_name);
+
+  ifr.ifr_mtu = am->mtu;
+  if (ioctl (fd, SIOCSIFMTU, &ifr) < 0)
+    {
+      clib_error ("tun %s mtu %u: %s", am->tun_name, am->mtu,
+		  strerror (errno));
+      goto done;
+    }
+  if (ioctl (fd, SIOCGIFFLAGS, &ifr) < 0)
+    goto done;
+  ifr.ifr_flags |= IFF_UP | IFF_RUNNING;
+  if (ioctl (fd, SIOCSIFFLAGS, &ifr) < 0)
+    {
+      clib_error ("tun %s up: %s", am->tun_name, strerror (errno));
+      goto done;
+    }
+  rv = 0;
+
+done:
+  close (fd);
+  return rv;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
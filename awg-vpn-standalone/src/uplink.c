@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The uplink: per worker an AF_PACKET socket in a PACKET_FANOUT_HASH
+ * group, bound to ip4 and filtered down to our UDP port, with a
+ * TPACKET_V3 rx ring and a tx ring mapped back to back as the af_packet
+ * plugin sets them up. A UDP socket holds the port, so the kernel does
+ * not answer with port unreachable, and carries what the control thread
+ * sends; the kernel resolves its next hop.
+ */
+
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <awg_vpn.h>
+
+int
+awg_vpn_uplink_init (awg_vpn_main_t *am)
+{
+  struct sock_filter drop_all[] = { BPF_STMT (BPF_RET | BPF_K, 0) };
+  struct sock_fprog prog = { .len = 1, .filter = drop_all };
+  struct sockaddr_in sin = { .sin_family = AF_INET };
+  struct ifreq ifr;
+  int fd;
+
+  if (!(am->uplink_if_index = if_nametoindex (am->uplink_name)))
+    {
+      clib_error ("uplink %s: %s", am->uplink_name, strerror (errno));
+      return -1;
+    }
+
+  fd = socket (AF_INET, SOCK_DGRAM, 0);
+  clib_memset (&ifr, 0, sizeof (ifr));
+  strcpy (ifr.ifr_name, am->uplink_name);
+  if (ioctl (fd, SIOCGIFHWADDR, &ifr) < 0)
+    {
+      clib_error ("uplink %s: no hardware address", am->uplink_name);
+      goto error;
+    }
+  clib_memcpy (am->src_mac, ifr.ifr_hwaddr.sa_data, 6);
+  if (ioctl (fd, SIOCGIFADDR, &ifr) < 0)
+    {
+      clib_error ("uplink %s: no ip4 address", am->uplink_name);
+      goto error;
+    }
+  am->src_ip.as_u32 =
+    ((struct sockaddr_in *) &ifr.ifr_addr)->sin_addr.s_addr;
+
+  /* the rings see every datagram, this socket none */
+  if (setsockopt (fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof (prog)) < 0)
+    {
+      clib_error ("udp socket filter: %s", strerror (errno));
+      goto error;
+    }
+  sin.sin_port = htons (am->listen_port);
+  if (bind (fd, (struct sockaddr *) &sin, sizeof (sin)) < 0)
+    {
+      clib_error ("udp port %u: %s", am->listen_port, strerror (errno));
+      goto error;
+    }
+
+  am->udp_fd = fd;
+  return 0;
+
+error:
+  close (fd);
+  return -1;
+}
+
+int
+awg_vpn_uplink_worker_init (awg_vpn_main_t *am, awg_vpn_worker_t *w)
+{
+  /* ip4, udp, first fragment, to our port */
+  struct sock_filter filter[] = {
+    BPF_STMT (BPF_LD | BPF_H | BPF_ABS, 12),
+    BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 8),
+    BPF_STMT (BPF_LD | BPF_B | BPF_ABS, 23),
+    BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+    BPF_STMT (BPF_LD | BPF_H | BPF_ABS, 20),
+    BPF_JUMP (BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+    BPF_STMT (BPF_LDX | BPF_B | BPF_MSH, 14),
+    BPF_STMT (BPF_LD | BPF_H | BPF_IND, 16),
+    BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, am->listen_port, 0, 1),
+    BPF_STMT (BPF_RET | BPF_K, 0x40000),
+    BPF_STMT (BPF_RET | BPF_K, 0),
+  };
+  struct sock_fprog prog = {
+    .len = sizeof (filter) / sizeof (filter[0]),
+    .filter = filter,
+  };
+  struct sockaddr_ll sll = { .sll_family = AF_PACKET };
+  int ver = TPACKET_V3, opt = 1, fanout;
+  struct tpacket_req3 *req;
+  uword rx_size, tx_size;
+  u32 i;
+
+  /* no protocol until the filter is on */
+  if ((w->fd = socket (AF_PACKET, SOCK_RAW, 0)) < 0)
+    {
+      clib_error ("packet socket: %s", strerror (errno));
+      return -1;
+    }
+  if (setsockopt (w->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof (prog)) <
+      0)
+    {
+      clib_error ("packet socket filter: %s", strerror (errno));
+      return -1;
+    }
+
+  sll.sll_protocol = htons (ETH_P_IP);
+  sll.sll_ifindex = am->uplink_if_index;
+  if (bind (w->fd, (struct sockaddr *) &sll, sizeof (sll)) < 0)
+    {
+      clib_error ("bind to %s: %s", am->uplink_name, strerror (errno));
+      return -1;
+    }
+
+  if (setsockopt (w->fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof (ver)) < 0 ||
+      setsockopt (w->fd, SOL_PACKET, PACKET_LOSS, &opt, sizeof (opt)) < 0)
+    {
+      clib_error ("TPACKET_V3 on %s: %s", am->uplink_name, strerror (errno));
+      return -1;
+    }
+#if defined(PACKET_QDISC_BYPASS)
+  if (setsockopt (w->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &opt, sizeof (opt)) <
+      0)
+    clib_warning ("PACKET_QDISC_BYPASS on %s: %s", am->uplink_name,
+		  strerror (errno));
+#endif
+
+  req = &w->rx_req;
+  req->tp_block_size = AWG_VPN_FRAME_SIZE * AWG_VPN_RX_FRAMES_PER_BLOCK;
+  req->tp_frame_size = AWG_VPN_FRAME_SIZE;
+  req->tp_block_nr = AWG_VPN_RX_BLOCK_NR;
+  req->tp_frame_nr = AWG_VPN_RX_BLOCK_NR * AWG_VPN_RX_FRAMES_PER_BLOCK;
+  req->tp_retire_blk_tov = 1; /* ms */
+  rx_size = (uword) req->tp_block_size * req->tp_block_nr;
+  if (setsockopt (w->fd, SOL_PACKET, PACKET_RX_RING, req, sizeof (*req)) < 0)
+    {
+      clib_error ("rx ring on %s: %s", am->uplink_name, strerror (errno));
+      return -1;
+    }
+
+  req = &w->tx_req;
+  req->tp_block_size = AWG_VPN_FRAME_SIZE * AWG_VPN_TX_FRAMES_PER_BLOCK;
+  req->tp_frame_size = AWG_VPN_FRAME_SIZE;
+  req->tp_block_nr = AWG_VPN_TX_BLOCK_NR;
+  req->tp_frame_nr = AWG_VPN_TX_BLOCK_NR * AWG_VPN_TX_FRAMES_PER_BLOCK;
+  tx_size = (uword) req->tp_block_size * req->tp_block_nr;
+  if (setsockopt (w->fd, SOL_PACKET, PACKET_TX_RING, req, sizeof (*req)) < 0)
+    {
+      clib_error ("tx ring on %s: %s", am->uplink_name, strerror (errno));
+      return -1;
+    }
+
+  w->ring_size = rx_size + tx_size;
+  w->ring = mmap (NULL, w->ring_size, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_LOCKED, w->fd, 0);
+  if (w->ring == MAP_FAILED)
+    {
+      clib_error ("ring mmap: %s", strerror (errno));
+      return -1;
+    }
+
+  for (i = 0; i < w->rx_req.tp_block_nr; i++)
+    vec_add1 (w->rx_blocks, w->ring + i * w->rx_req.tp_block_size);
+  for (i = 0; i < w->tx_req.tp_frame_nr; i++)
+    vec_add1 (w->tx_frames,
+	      w->ring + rx_size +
+		(i / AWG_VPN_TX_FRAMES_PER_BLOCK) * w->tx_req.tp_block_size +
+		(i % AWG_VPN_TX_FRAMES_PER_BLOCK) * AWG_VPN_FRAME_SIZE);
+
+  /* flows spread over the workers, each stays on one */
+  fanout = (getpid () & 0xffff) | (PACKET_FANOUT_HASH << 16);
+  if (setsockopt (w->fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof (fanout)) <
+      0)
+    {
+      clib_error ("fanout on %s: %s", am->uplink_name, strerror (errno));
+      return -1;
+    }
+
+  return 0;
+}
+
+static_always_inline u16
+awg_vpn_ip4_checksum (const u16 *h)
+{
+  u32 sum = 0;
+  u32 i;
+
+  for (i = 0; i < 10; i++)
+    sum += h[i];
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return (u16) ~sum;
+}
+
+void
+awg_vpn_ip4_udp_header (awg_vpn_main_t *am, u8 *ip_udp, ip4_address_t dst,
+			u16 dst_port, u16 payload_len)
+{
+  struct iphdr *ip = (struct iphdr *) ip_udp;
+  struct udphdr *udp = (struct udphdr *) (ip + 1);
+
+  ip->version = 4;
+  ip->ihl = 5;
+  ip->tos = 0;
+  ip->tot_len = htons (sizeof (*ip) + sizeof (*udp) + payload_len);
+  ip->id = 0;
+  ip->frag_off = 0;
+  ip->ttl = 64;
+  ip->protocol = IPPROTO_UDP;
+  ip->check = 0;
+  ip->saddr = am->src_ip.as_u32;
+  ip->daddr = dst.as_u32;
+  ip->check = awg_vpn_ip4_checksum ((u16 *) ip);
+
+  udp->source = htons (am->listen_port);
+  udp->dest = dst_port;
+  udp->len = htons (sizeof (*udp) + payload_len);
+  udp->check = 0;
+}
+
+int
+awg_vpn_uplink_send (awg_vpn_main_t *am, u64 endpoint, const u8 *junk,
+		     u32 junk_len, const void *msg, u32 msg_len)
+{
+  struct sockaddr_in sin = { .sin_family = AF_INET };
+  struct iovec iov[2] = {
+    { .iov_base = (void *) junk, .iov_len = junk_len },
+    { .iov_base = (void *) msg, .iov_len = msg_len },
+  };
+  struct msghdr mh = {
+    .msg_name = &sin,
+    .msg_namelen = sizeof (sin),
+    .msg_iov = junk_len ? iov : iov + 1,
+    .msg_iovlen = junk_len ? 2 : 1,
+  };
+  ip4_address_t ip;
+
+  if (!endpoint)
+    return -1;
+  awg_vpn_endpoint_unpack (endpoint, &ip, &sin.sin_port);
+  sin.sin_addr.s_addr = ip.as_u32;
+  return sendmsg (am->udp_fd, &mh, MSG_DONTWAIT) < 0 ? -1 : 0;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -0,0 +1,160 @@
+/*
+ * vlib stub implementation
+ * Per-thread mains and the worker barrier
+ */
+
+#include <unistd.h>
+#include <vlib/vlib.h>
+
+__thread vlib_main_t *vlib_main_tls;
+vlib_main_t **vlib_mains;
+
+volatile u32 vlib_worker_thread_barrier_held;
+
+static struct
+{
+  pthread_mutex_t lock;
+  u32 n_parked;
+} barrier_main = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* Called for every thread before any of them runs */
+vlib_main_t *
+vlib_main_init (u32 thread_index)
+{
+  vlib_main_t *vm;
+
+  vec_validate (vlib_mains, thread_index);
+  vm = vlib_mains[thread_index];
+  if (!vm)
+    {
+      vm = clib_mem_alloc_aligned (sizeof (*vm), CLIB_CACHE_LINE_BYTES);
+      clib_memset (vm, 0, sizeof (*vm));
+      vm->thread_index = thread_index;
+      vm->wakeup_fd = -1;
+      vlib_mains[thread_index] = vm;
+    }
+  return vm;
+}
+
+void
+vlib_worker_thread_barrier_park (vlib_main_t *vm)
+{
+  __atomic_fetch_add (&barrier_main.n_parked, 1, __ATOMIC_ACQ_REL);
+  vm->barrier_parked = 1;
+  while (__atomic_load_n (&vlib_worker_thread_barrier_held, __ATOMIC_ACQUIRE))
+    CLIB_PAUSE ();
+  vm->barrier_parked = 0;
+  __atomic_fetch_sub (&barrier_main.n_parked, 1, __ATOMIC_ACQ_REL);
+}
+
+void
+vlib_worker_thread_barrier_sync (vlib_main_t *vm)
+{
+  u32 n_others = vlib_get_n_threads () - 1;
+  vlib_main_t **other;
+  u64 one = 1;
+
+  /* whoever holds it now needs us parked before it lets go */
+  while (pthread_mutex_trylock (&barrier_main.lock))
+    {
+      vlib_worker_thread_barrier_check (vm);
+      CLIB_PAUSE ();
+    }
+
+  __atomic_store_n (&vlib_worker_thread_barrier_held, 1, __ATOMIC_RELEASE);
+
+  /* threads asleep in poll () come round at once */
+  vec_foreach (other, vlib_mains)
+    if (*other != vm && (*other)->wakeup_fd >= 0)
+      (void) !write ((*other)->wakeup_fd, &one, sizeof (one));
+
+  while (__atomic_load_n (&barrier_main.n_parked, __ATOMIC_ACQUIRE) <
+	 n_others)
+    CLIB_PAUSE ();
+}
+
+void
+vlib_worker_thread_barrier_release (vlib_main_t *vm)
+{
+  (void) vm;
+  __atomic_store_n (&vlib_worker_thread_barrier_held, 0, __ATOMIC_RELEASE);
+  pthread_mutex_unlock (&barrier_main.lock);
+}
+
+typedef struct
+{
+  void (*fn) (void *);
+  u8 *args;
+} vlib_rpc_t;
+
+static struct
+{
+  pthread_mutex_t lock;
+  vlib_rpc_t *pending;
+  vlib_rpc_t *running;
+  volatile u32 n_pending;
+} rpc_main = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void
+vlib_rpc_run (vlib_main_t *vm, vlib_rpc_t *rpcs, u32 n_rpcs)
+{
+  u32 i;
+
+  vlib_worker_thread_barrier_sync (vm);
+  for (i = 0; i < n_rpcs; i++)
+    {
+      rpcs[i].fn (rpcs[i].args);
+      vec_free (rpcs[i].args);
+    }
+  vlib_worker_thread_barrier_release (vm);
+}
+
+void
+vlib_rpc_call_main_thread (void *fn, u8 *args, u32 size)
+{
+  vlib_main_t *vm = vlib_get_main ();
+  vlib_rpc_t rpc = { .fn = fn };
+  u64 one = 1;
+
+  vec_validate (rpc.args, size - 1);
+  clib_memcpy (rpc.args, args, size);
+
+  if (vm->thread_index == 0)
+    {
+      vlib_rpc_run (vm, &rpc, 1);
+      return;
+    }
+
+  pthread_mutex_lock (&rpc_main.lock);
+  vec_add1 (rpc_main.pending, rpc);
+  __atomic_store_n (&rpc_main.n_pending, vec_len (rpc_main.pending),
+		    __ATOMIC_RELEASE);
+  pthread_mutex_unlock (&rpc_main.lock);
+
+  if (vlib_mains[0]->wakeup_fd >= 0)
+    (void) !write (vlib_mains[0]->wakeup_fd, &one, sizeof (one));
+}
+
+void
+vlib_rpc_process (vlib_main_t *vm)
+{
+  vlib_rpc_t *rpcs;
+
+  if (!__atomic_load_n (&rpc_main.n_pending, __ATOMIC_ACQUIRE))
+    return;
+
+  /* swap the queues so workers can add more while these run */
+  pthread_mutex_lock (&rpc_main.lock);
+  rpcs = rpc_main.pending;
+  rpc_main.pending = rpc_main.running;
+  rpc_main.n_pending = 0;
+  pthread_mutex_unlock (&rpc_main.lock);
+
+  vlib_rpc_run (vm, rpcs, vec_len (rpcs));
+  vec_reset_length (rpcs);
+  rpc_main.running = rpcs;
+}
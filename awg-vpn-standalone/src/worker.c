@@ -0,0 +1,512 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The worker: run to completion over a ring block or a batch of TUN
+ * reads. Datagrams are decrypted in place in the rx ring and written to
+ * the TUN queue; TUN packets are read straight into tx ring frames,
+ * behind room for the outer headers, encrypted in place and sent with a
+ * single kick for the batch. Handshake messages go to the control
+ * thread. Keypairs change only under the barrier, taken at the top of
+ * the loop, so pointers to them stay good for a whole pass.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <awg_vpn.h>
+
+#define AWG_VPN_TX_DATA_OFFSET TPACKET_ALIGN (sizeof (struct tpacket3_hdr))
+
+static_always_inline void
+awg_vpn_op_init (vnet_crypto_op_t *op, vnet_crypto_op_id_t id, u8 *iv,
+		 noise_keypair_t *kp, u64 nonce, u8 *data, u32 len)
+{
+  vnet_crypto_op_init (op, id);
+  clib_memset (iv, 0, 4);
+  clib_memcpy (iv + 4, &nonce, sizeof (nonce));
+  op->iv = iv;
+  op->src = op->dst = data;
+  op->len = len;
+  op->tag = data + len;
+  op->tag_len = NOISE_AUTHTAG_LEN;
+  op->aad = 0;
+  op->aad_len = 0;
+  if (id == VNET_CRYPTO_OP_CHACHA20_POLY1305_DEC)
+    {
+      op->flags = VNET_CRYPTO_OP_FLAG_HMAC_CHECK;
+      op->key_index = kp->kp_recv_index;
+    }
+  else
+    op->key_index = kp->kp_send_index;
+}
+
+/* as wg_input does when the peer first uses the keypair it answered */
+static void
+awg_vpn_keypair_promote (vlib_main_t *vm, noise_remote_t *r)
+{
+  noise_keypair_t *kp;
+
+  vlib_worker_thread_barrier_sync (vm);
+  if ((kp = r->r_next))
+    {
+      noise_remote_keypair_free (vm, r, &r->r_previous);
+      r->r_previous = r->r_current;
+      r->r_current = kp;
+      r->r_next = NULL;
+    }
+  vlib_worker_thread_barrier_release (vm);
+}
+
+static_always_inline int
+awg_vpn_handshake_enqueue (awg_vpn_worker_t *w, message_type_t type,
+			   const u8 *msg, u32 len, const u8 *eth,
+			   const struct iphdr *ip, const struct udphdr *udp)
+{
+  u32 head = __atomic_load_n (&w->hs_head, __ATOMIC_ACQUIRE);
+  awg_vpn_handshake_t *hs;
+
+  if (w->hs_tail - head >= AWG_VPN_HS_QUEUE_SIZE)
+    return -1;
+
+  hs = &w->hs_queue[w->hs_tail & (AWG_VPN_HS_QUEUE_SIZE - 1)];
+  hs->type = type;
+  hs->src.as_u32 = ip->saddr;
+  hs->src_port = udp->source;
+  clib_memcpy (hs->src_mac, eth + 6, 6);
+  hs->len = len;
+  clib_memcpy (hs->data, msg, len);
+  __atomic_store_n (&w->hs_tail, w->hs_tail + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static void
+awg_vpn_decrypt_flush (awg_vpn_main_t *am, awg_vpn_worker_t *w, u32 n_ops)
+{
+  vlib_main_t *vm = w->vm;
+  u32 promote[AWG_VPN_BATCH], n_promote = 0;
+  f64 now = vlib_time_now (vm);
+  ip46_address_t src;
+  u32 i, j, len, pi;
+  u64 mac;
+
+  vnet_crypto_process_ops (vm, w->ops, n_ops);
+
+  for (i = 0; i < n_ops; i++)
+    {
+      vnet_crypto_op_t *op = w->ops + i;
+      noise_keypair_t *kp = w->keypairs[i];
+      awg_vpn_peer_t *peer = am->peers + w->peers[i];
+      u8 *inner = op->dst, is_ip4;
+
+      if (PREDICT_FALSE (op->status != VNET_CRYPTO_OP_STATUS_COMPLETED))
+	{
+	  w->counters.rx_decrypt_failed++;
+	  continue;
+	}
+      if (PREDICT_FALSE (!noise_keypair_counter_recv (kp, w->nonces[i])))
+	{
+	  w->counters.rx_replayed++;
+	  continue;
+	}
+
+      if (PREDICT_FALSE (kp == peer->remote.r_next))
+	{
+	  for (j = 0; j < n_promote && promote[j] != w->peers[i]; j++)
+	    ;
+	  if (j == n_promote)
+	    promote[n_promote++] = w->peers[i];
+	}
+
+      /* authenticated, so the peer roams to where it came from */
+      if (PREDICT_FALSE (w->endpoints[i] !=
+			 __atomic_load_n (&peer->endpoint, __ATOMIC_RELAXED)))
+	__atomic_store_n (&peer->endpoint, w->endpoints[i], __ATOMIC_RELAXED);
+      mac = 0;
+      clib_memcpy (&mac, w->macs[i], 6);
+      if (PREDICT_FALSE (mac !=
+			 __atomic_load_n (&peer->dst_mac, __ATOMIC_RELAXED)))
+	__atomic_store_n (&peer->dst_mac, mac, __ATOMIC_RELAXED);
+
+      peer->last_received = now;
+      if (PREDICT_FALSE (kp->kp_is_initiator &&
+			 wg_birthdate_has_expired_opt (
+			   kp->kp_birthdate, REKEY_AFTER_TIME_RECV, now)))
+	awg_vpn_want_handshake (am, peer);
+
+      /* keepalive */
+      if (!op->len)
+	continue;
+
+      if ((inner[0] >> 4) == 4 && op->len >= 20)
+	{
+	  is_ip4 = 1;
+	  len = clib_net_to_host_u16 (clib_mem_unaligned (inner + 2, u16));
+	  ip46_address_set_ip4 (&src, (ip4_address_t *) (inner + 12));
+	}
+      else if ((inner[0] >> 4) == 6 && op->len >= 40)
+	{
+	  is_ip4 = 0;
+	  len = 40 + clib_net_to_host_u16 (clib_mem_unaligned (inner + 4, u16));
+	  clib_memcpy (&src.ip6, inner + 8, 16);
+	}
+      else
+	{
+	  w->counters.rx_dropped++;
+	  continue;
+	}
+
+      /* the padding goes, and only the peer's allowed ips come in */
+      pi = awg_vpn_route_lookup (am, w, &src, is_ip4);
+      if (PREDICT_FALSE (len > op->len || pi != w->peers[i]))
+	{
+	  w->counters.rx_source_denied++;
+	  continue;
+	}
+
+      peer->last_data_received = now;
+      if (PREDICT_FALSE (write (w->tun_fd, inner, len) < 0))
+	w->counters.rx_dropped++;
+      else
+	w->counters.rx_decrypted++;
+    }
+
+  for (j = 0; j < n_promote; j++)
+    awg_vpn_keypair_promote (vm, &am->peers[promote[j]].remote);
+}
+
+static_always_inline u32
+awg_vpn_uplink_rx_one (awg_vpn_main_t *am, awg_vpn_worker_t *w,
+		       struct tpacket3_hdr *tph, u32 n_ops, f64 now)
+{
+  struct sockaddr_ll *sll =
+    (struct sockaddr_ll *) ((u8 *) tph + TPACKET_ALIGN (sizeof (*tph)));
+  u8 *eth = (u8 *) tph + tph->tp_mac, *p, *msg;
+  u32 len = tph->tp_snaplen, ihl, ip_len, udp_len, plen, junk, pi;
+  struct udphdr *udp;
+  struct iphdr *ip;
+  noise_remote_t *r;
+  noise_keypair_t *kp;
+  message_type_t type;
+  u32 index;
+  u64 counter;
+
+  w->counters.rx_packets++;
+  w->counters.rx_bytes += tph->tp_len;
+
+  if (PREDICT_FALSE (sll->sll_pkttype == PACKET_OUTGOING ||
+		     tph->tp_len != len || len < AWG_VPN_OUTER_HDR_LEN))
+    goto drop;
+
+  ip = (struct iphdr *) (eth + 14);
+  ihl = ip->ihl * 4;
+  ip_len = clib_net_to_host_u16 (ip->tot_len);
+  if (PREDICT_FALSE (ip->version != 4 || ihl < 20 || ip_len > len - 14 ||
+		     ip_len < ihl + 8))
+    goto drop;
+  udp = (struct udphdr *) ((u8 *) ip + ihl);
+  udp_len = clib_net_to_host_u16 (udp->len);
+  if (PREDICT_FALSE (udp_len < 8 || udp_len > ip_len - ihl))
+    goto drop;
+  p = (u8 *) (udp + 1);
+  plen = udp_len - 8;
+
+  /* the plugin's classifier; junk and i-header packets match nothing */
+  type = wg_awg_decode (&am->awg, p, plen, plen, &junk);
+  if (PREDICT_FALSE (type == MESSAGE_INVALID))
+    goto drop;
+  msg = p + junk;
+
+  if (type != MESSAGE_DATA)
+    {
+      if (awg_vpn_handshake_enqueue (w, type, msg, plen - junk, eth, ip, udp))
+	goto drop;
+      w->counters.rx_handshakes++;
+      return n_ops;
+    }
+
+  index = clib_mem_unaligned (msg + 4, u32);
+  counter = clib_mem_unaligned (msg + 8, u64);
+  if (PREDICT_FALSE (!(r = awg_vpn_index_lookup (am, index, &pi))))
+    goto drop;
+  kp = wg_get_active_keypair (r, index);
+  if (PREDICT_FALSE (!kp || !kp->kp_valid ||
+		     wg_birthdate_has_expired_opt (kp->kp_birthdate,
+						   REJECT_AFTER_TIME, now) ||
+		     counter >= REJECT_AFTER_MESSAGES))
+    goto drop;
+
+  awg_vpn_op_init (w->ops + n_ops, VNET_CRYPTO_OP_CHACHA20_POLY1305_DEC,
+		   w->ivs[n_ops], kp, counter, msg + sizeof (message_data_t),
+		   plen - junk - message_data_len (0));
+  w->keypairs[n_ops] = kp;
+  w->peers[n_ops] = pi;
+  w->nonces[n_ops] = counter;
+  w->endpoints[n_ops] = awg_vpn_endpoint_pack (
+    (ip4_address_t){ .as_u32 = ip->saddr }, udp->source);
+  clib_memcpy (w->macs[n_ops], eth + 6, 6);
+  return n_ops + 1;
+
+drop:
+  w->counters.rx_dropped++;
+  return n_ops;
+}
+
+static u32
+awg_vpn_uplink_input (awg_vpn_main_t *am, awg_vpn_worker_t *w)
+{
+  struct tpacket_block_desc *bd =
+    (struct tpacket_block_desc *) w->rx_blocks[w->next_rx_block];
+  u32 i, n_pkts, n_ops = 0, hs_tail = w->hs_tail;
+  struct tpacket3_hdr *tph;
+  f64 now;
+
+  if (!(__atomic_load_n (&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+	TP_STATUS_USER))
+    return 0;
+
+  now = vlib_time_now (w->vm);
+  n_pkts = bd->hdr.bh1.num_pkts;
+  tph = (struct tpacket3_hdr *) ((u8 *) bd + bd->hdr.bh1.offset_to_first_pkt);
+
+  for (i = 0; i < n_pkts; i++)
+    {
+      struct tpacket3_hdr *next =
+	(struct tpacket3_hdr *) ((u8 *) tph + tph->tp_next_offset);
+
+      if (i + 1 < n_pkts)
+	CLIB_PREFETCH ((u8 *) next + next->tp_mac, 64, LOAD);
+
+      n_ops = awg_vpn_uplink_rx_one (am, w, tph, n_ops, now);
+      if (n_ops == AWG_VPN_BATCH)
+	{
+	  awg_vpn_decrypt_flush (am, w, n_ops);
+	  n_ops = 0;
+	}
+      tph = next;
+    }
+  if (n_ops)
+    awg_vpn_decrypt_flush (am, w, n_ops);
+
+  /* the batch pointed into the block, it goes back only now */
+  __atomic_store_n (&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+		    __ATOMIC_RELEASE);
+  w->next_rx_block = (w->next_rx_block + 1) % vec_len (w->rx_blocks);
+
+  if (w->hs_tail != hs_tail)
+    awg_vpn_wakeup (am->control_wakeup_fd);
+  return n_pkts;
+}
+
+static_always_inline void
+awg_vpn_uplink_kick (awg_vpn_worker_t *w)
+{
+  if (sendto (w->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 && errno != EAGAIN &&
+      errno != ENOBUFS)
+    clib_warning ("worker %u tx kick: %s", w->worker_index, strerror (errno));
+}
+
+static u32
+awg_vpn_tun_input (awg_vpn_main_t *am, awg_vpn_worker_t *w)
+{
+  vlib_main_t *vm = w->vm;
+  u32 junk = am->junk_size[MESSAGE_DATA];
+  u32 hdr = AWG_VPN_TX_DATA_OFFSET + AWG_VPN_OUTER_HDR_LEN + junk +
+	    sizeof (message_data_t);
+  u32 max_len = AWG_VPN_FRAME_SIZE - hdr - NOISE_AUTHTAG_LEN;
+  u32 n_frames = vec_len (w->tx_frames), frame = w->next_tx_frame;
+  u32 i, n = 0, n_read = 0, pi, padded, msg_len;
+  f64 now = vlib_time_now (vm);
+  struct tpacket3_hdr *tph;
+  awg_vpn_peer_t *peer;
+  noise_keypair_t *kp;
+  ip46_address_t dst;
+  ip4_address_t ip;
+  u64 endpoint, mac, nonce;
+  u16 port;
+  ssize_t len;
+  u8 *f, *inner, *eth, *msg, is_ip4;
+
+  while (n < AWG_VPN_BATCH)
+    {
+      f = w->tx_frames[frame];
+      tph = (struct tpacket3_hdr *) f;
+      if (PREDICT_FALSE (__atomic_load_n (&tph->tp_status, __ATOMIC_ACQUIRE) &
+			 (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)))
+	{
+	  w->counters.tx_ring_full++;
+	  if (!n)
+	    awg_vpn_uplink_kick (w);
+	  break;
+	}
+
+      inner = f + hdr;
+      if ((len = read (w->tun_fd, inner, max_len)) <= 0)
+	break;
+      n_read++;
+
+      if ((inner[0] >> 4) == 4 && len >= 20)
+	{
+	  is_ip4 = 1;
+	  ip46_address_set_ip4 (&dst, (ip4_address_t *) (inner + 16));
+	}
+      else if ((inner[0] >> 4) == 6 && len >= 40)
+	{
+	  is_ip4 = 0;
+	  clib_memcpy (&dst.ip6, inner + 24, 16);
+	}
+      else
+	continue;
+
+      pi = awg_vpn_route_lookup (am, w, &dst, is_ip4);
+      if (PREDICT_FALSE (pi == (u32) ~0))
+	{
+	  w->counters.tx_no_route++;
+	  continue;
+	}
+      peer = am->peers + pi;
+
+      kp = peer->remote.r_current;
+      endpoint = __atomic_load_n (&peer->endpoint, __ATOMIC_RELAXED);
+      mac = __atomic_load_n (&peer->dst_mac, __ATOMIC_RELAXED);
+      if (PREDICT_FALSE (!kp || !kp->kp_valid || !endpoint || !mac ||
+			 wg_birthdate_has_expired_opt (kp->kp_birthdate,
+						       REJECT_AFTER_TIME, now)))
+	{
+	  w->counters.tx_no_session++;
+	  awg_vpn_want_handshake (am, peer);
+	  continue;
+	}
+
+      /* workers share the keypair, each takes nonces from its own block */
+      nonce = noise_keypair_send_nonce (kp, vm->thread_index);
+      if (PREDICT_FALSE (nonce >= REKEY_AFTER_MESSAGES ||
+			 (kp->kp_is_initiator &&
+			  wg_birthdate_has_expired_opt (
+			    kp->kp_birthdate, REKEY_AFTER_TIME, now))))
+	{
+	  awg_vpn_want_handshake (am, peer);
+	  if (nonce >= REJECT_AFTER_MESSAGES)
+	    {
+	      w->counters.tx_no_session++;
+	      continue;
+	    }
+	}
+
+      /* pad to 16 as WireGuard does, never past the MTU */
+      padded = clib_min (round_pow2 (len, 16), clib_max (am->mtu, len));
+      clib_memset (inner + len, 0, padded - len);
+
+      awg_vpn_op_init (w->ops + n, VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC,
+		       w->ivs[n], kp, nonce, inner, padded);
+      w->frames[n] = f;
+      w->lens[n] = padded;
+      w->peers[n] = pi;
+      w->keypairs[n] = kp;
+      w->nonces[n] = nonce;
+      w->endpoints[n] = endpoint;
+      clib_memcpy (w->macs[n], &mac, 6);
+      frame = (frame + 1) % n_frames;
+      n++;
+    }
+
+  if (!n)
+    return n_read;
+
+  vnet_crypto_process_ops (vm, w->ops, n);
+
+  for (i = 0; i < n; i++)
+    {
+      tph = (struct tpacket3_hdr *) w->frames[i];
+      eth = w->frames[i] + AWG_VPN_TX_DATA_OFFSET;
+      msg = eth + AWG_VPN_OUTER_HDR_LEN + junk;
+      msg_len = message_data_len (w->lens[i]);
+
+      clib_memcpy (eth, w->macs[i], 6);
+      clib_memcpy (eth + 6, am->src_mac, 6);
+      clib_mem_unaligned (eth + 12, u16) = clib_host_to_net_u16 (0x0800);
+      awg_vpn_endpoint_unpack (w->endpoints[i], &ip, &port);
+      awg_vpn_ip4_udp_header (am, eth + 14, ip, port, junk + msg_len);
+      if (junk)
+	wg_awg_generate_junk (eth + AWG_VPN_OUTER_HDR_LEN, junk);
+      clib_mem_unaligned (msg, u32) = am->magic[MESSAGE_DATA];
+      clib_mem_unaligned (msg + 4, u32) = w->keypairs[i]->kp_remote_index;
+      clib_mem_unaligned (msg + 8, u64) = w->nonces[i];
+
+      tph->tp_len = tph->tp_snaplen = AWG_VPN_OUTER_HDR_LEN + junk + msg_len;
+      tph->tp_next_offset = 0;
+      __atomic_store_n (&tph->tp_status, TP_STATUS_SEND_REQUEST,
+			__ATOMIC_RELEASE);
+
+      peer = am->peers + w->peers[i];
+      peer->last_sent = peer->last_data_sent = now;
+      w->counters.tx_packets++;
+      w->counters.tx_bytes += tph->tp_len;
+    }
+
+  w->next_tx_frame = frame;
+  awg_vpn_uplink_kick (w);
+  return n_read;
+}
+
+void *
+awg_vpn_worker_thread (void *arg)
+{
+  awg_vpn_main_t *am = &awg_vpn_main;
+  awg_vpn_worker_t *w = arg;
+  struct pollfd pfd[3] = {
+    { .fd = w->fd, .events = POLLIN },
+    { .fd = w->tun_fd, .events = POLLIN },
+    { .fd = w->vm->wakeup_fd, .events = POLLIN },
+  };
+  cpu_set_t cpuset;
+  u64 v;
+
+  vlib_main_tls = w->vm;
+  if (w->cpu >= 0)
+    {
+      CPU_ZERO (&cpuset);
+      CPU_SET (w->cpu, &cpuset);
+      if (pthread_setaffinity_np (pthread_self (), sizeof (cpuset), &cpuset))
+	clib_warning ("worker %u: cannot pin to cpu %d", w->worker_index,
+		      w->cpu);
+    }
+
+  while (__atomic_load_n (&am->running, __ATOMIC_RELAXED))
+    {
+      vlib_worker_thread_barrier_check (w->vm);
+
+      if (awg_vpn_uplink_input (am, w) + awg_vpn_tun_input (am, w))
+	continue;
+
+      /* idle: sleep until the uplink, the TUN queue or the barrier */
+      if (poll (pfd, 3, 100) > 0 && (pfd[2].revents & POLLIN))
+	(void) !read (w->vm->wakeup_fd, &v, sizeof (v));
+    }
+
+  return 0;
+}
+
+/*
+ * fd.io coding-style-patch-verification: ON
+ *
+ * Local Variables:
+ * eval: (c-set-style "gnu")
+ * End:
+ */
@@ -3,7 +3,7 @@
  */
 #include <stdio.h>
 #include <string.h>
-#include "../src/blake/blake2s.h"
+#include <wireguard/blake/blake2s.h>
 
 static void
 print_hex (const uint8_t *data, size_t len)
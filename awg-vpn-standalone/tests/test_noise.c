@@ -0,0 +1,250 @@
+/*
+ * Test for the shared WireGuard/AWG core: a noise handshake between two
+ * locals, transport data both ways through the crypto backend, the
+ * replay window and the AWG receive classifier
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <vlib/vlib.h>
+#include <wireguard/wireguard_messages.h>
+#include <wireguard/wireguard_noise.h>
+#include <wireguard/wireguard_chachapoly.h>
+#include <wireguard/wireguard_awg.h>
+
+#define CHECK(cond, what)                                                     \
+  do                                                                          \
+    {                                                                         \
+      if (!(cond))                                                            \
+	{                                                                     \
+	  printf ("✗ %s FAILED\n", what);                                     \
+	  return 1;                                                           \
+	}                                                                     \
+    }                                                                         \
+  while (0)
+
+typedef struct
+{
+  noise_remote_t remote;
+  u32 local_index;
+} test_side_t;
+
+static test_side_t sides[2];
+static noise_remote_t *index_owner[64];
+static u32 next_index = 1;
+
+static noise_remote_t *
+test_remote_get (void *arg, const uint8_t public[NOISE_PUBLIC_KEY_LEN])
+{
+  test_side_t *side = arg;
+
+  if (!memcmp (side->remote.r_public, public, NOISE_PUBLIC_KEY_LEN))
+    return &side->remote;
+  return 0;
+}
+
+static uint32_t
+test_index_set (vlib_main_t *vm, noise_remote_t *r)
+{
+  (void) vm;
+  index_owner[next_index] = r;
+  return next_index++;
+}
+
+static void
+test_index_drop (vlib_main_t *vm, uint32_t index)
+{
+  (void) vm;
+  index_owner[index] = 0;
+}
+
+static int
+test_handshake (vlib_main_t *vm)
+{
+  u8 priv[2][NOISE_PUBLIC_KEY_LEN], pub[2][NOISE_PUBLIC_KEY_LEN];
+  message_handshake_initiation_t init;
+  message_handshake_response_t resp;
+  noise_remote_t *r;
+  noise_local_t *l;
+  u32 i;
+
+  for (i = 0; i < 2; i++)
+    {
+      struct noise_upcall upcall = {
+	.u_arg = &sides[i],
+	.u_remote_get = test_remote_get,
+	.u_index_set = test_index_set,
+	.u_index_drop = test_index_drop,
+      };
+
+      CHECK (curve25519_gen_secret (priv[i]), "key generation");
+      CHECK (curve25519_gen_public (pub[i], priv[i]), "public key");
+      pool_get (noise_local_pool, l);
+      sides[i].local_index = l - noise_local_pool;
+      noise_local_init (l, &upcall);
+      CHECK (noise_local_set_private (l, priv[i]), "local private key");
+    }
+
+  /* each side knows the other as its peer */
+  for (i = 0; i < 2; i++)
+    {
+      noise_remote_init (vm, &sides[i].remote, i, pub[!i],
+			 sides[i].local_index);
+      sides[i].remote.r_multi_queue = 1;
+    }
+
+  CHECK (noise_create_initiation (vm, &sides[0].remote, &init.sender_index,
+				  init.unencrypted_ephemeral,
+				  init.encrypted_static,
+				  init.encrypted_timestamp),
+	 "create initiation");
+  CHECK (noise_consume_initiation (
+	   vm, noise_local_get (sides[1].local_index), &r, init.sender_index,
+	   init.unencrypted_ephemeral, init.encrypted_static,
+	   init.encrypted_timestamp),
+	 "consume initiation");
+  CHECK (r == &sides[1].remote, "initiator identified");
+
+  CHECK (noise_create_response (vm, r, &resp.sender_index,
+				&resp.receiver_index,
+				resp.unencrypted_ephemeral,
+				resp.encrypted_nothing),
+	 "create response");
+  CHECK (noise_remote_begin_session (vm, r, resp.sender_index),
+	 "responder session");
+  CHECK (noise_consume_response (vm, &sides[0].remote, resp.sender_index,
+				 resp.receiver_index,
+				 resp.unencrypted_ephemeral,
+				 resp.encrypted_nothing),
+	 "consume response");
+  CHECK (noise_remote_begin_session (vm, &sides[0].remote,
+				     resp.receiver_index),
+	 "initiator session");
+
+  /* the initiator sends at once, the responder waits to be confirmed */
+  CHECK (sides[0].remote.r_current && sides[1].remote.r_next,
+	 "keypairs in place");
+  printf ("✓ noise handshake PASSED\n");
+  return 0;
+}
+
+static int
+test_transport (vlib_main_t *vm)
+{
+  noise_keypair_t *tx = sides[0].remote.r_current;
+  noise_keypair_t *rx = sides[1].remote.r_next;
+  u8 plain[100], sealed[sizeof (plain) + NOISE_AUTHTAG_LEN],
+    opened[sizeof (plain)];
+  u64 nonce, first;
+  u32 i;
+
+  for (i = 0; i < sizeof (plain); i++)
+    plain[i] = i;
+
+  CHECK (noise_keypair_is_multi_queue (tx), "multi-queue keypair");
+  first = noise_keypair_send_nonce (tx, vm->thread_index);
+  for (i = 0; i < NOISE_COUNTER_BLOCK; i++)
+    nonce = noise_keypair_send_nonce (tx, vm->thread_index);
+  CHECK (nonce == first + NOISE_COUNTER_BLOCK, "nonce blocks are contiguous");
+
+  CHECK (tx->kp_remote_index == rx->kp_local_index, "keypair indices");
+  wg_chacha20poly1305_calc (vm, plain, sizeof (plain), sealed, NULL, 0,
+			    nonce, VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC,
+			    tx->kp_send_index);
+  CHECK (wg_chacha20poly1305_calc (vm, sealed, sizeof (sealed), opened, NULL,
+				   0, nonce,
+				   VNET_CRYPTO_OP_CHACHA20_POLY1305_DEC,
+				   rx->kp_recv_index),
+	 "decrypt");
+  CHECK (!memcmp (plain, opened, sizeof (plain)), "round trip");
+
+  sealed[3] ^= 1;
+  CHECK (!wg_chacha20poly1305_calc (vm, sealed, sizeof (sealed), opened, NULL,
+				    0, nonce,
+				    VNET_CRYPTO_OP_CHACHA20_POLY1305_DEC,
+				    rx->kp_recv_index),
+	 "tampered message rejected");
+
+  CHECK (noise_keypair_counter_recv (rx, nonce), "fresh nonce accepted");
+  CHECK (!noise_keypair_counter_recv (rx, nonce), "replay rejected");
+  CHECK (noise_keypair_counter_recv (rx, first), "older nonce in window");
+  printf ("✓ transport data PASSED\n");
+  return 0;
+}
+
+static int
+test_nonce_lag (void)
+{
+  noise_keypair_t tx = { 0 }, rx = { 0 };
+  u64 nonce;
+  u32 i, j;
+
+  /* thread 0 sends a packet for every thousand thread 1 sends, the
+   * receiver sees them in send order */
+  vec_validate_aligned (tx.kp_send_blocks, 1, CLIB_CACHE_LINE_BYTES);
+  for (i = 0; i < 4 * NOISE_COUNTER_BLOCK; i++)
+    {
+      for (j = 0; j < 1000; j++)
+	{
+	  nonce = noise_keypair_send_nonce (&tx, 1);
+	  CHECK (noise_keypair_counter_recv (&rx, nonce),
+		 "heavy worker nonce accepted");
+	}
+      nonce = noise_keypair_send_nonce (&tx, 0);
+      CHECK (tx.kp_ctr.c_send - nonce <= NOISE_COUNTER_BLOCK_MAX_LAG +
+					     NOISE_COUNTER_BLOCK,
+	     "light worker nonce near the counter");
+      CHECK (noise_keypair_counter_recv (&rx, nonce),
+	     "light worker nonce accepted");
+    }
+  vec_free (tx.kp_send_blocks);
+  printf ("✓ nonce blocks of a light worker PASSED\n");
+  return 0;
+}
+
+static int
+test_awg_decode (void)
+{
+  u8 dgram[64 + sizeof (message_handshake_initiation_t)];
+  wg_awg_cfg_t cfg;
+  u32 junk_len = 0;
+
+  wg_awg_cfg_init (&cfg);
+  cfg.enabled = 1;
+  cfg.init_header_junk_size = 64;
+  cfg.transport_header_junk_size = 8;
+  cfg.magic_header[0] = 0x11223344;
+  cfg.magic_header[3] = 0x55667788;
+  wg_awg_cfg_update_rx (&cfg);
+
+  wg_awg_generate_junk (dgram, sizeof (dgram));
+  clib_mem_unaligned (dgram + 64, u32) = cfg.magic_header[0];
+  CHECK (wg_awg_decode (&cfg, dgram, sizeof (dgram), sizeof (dgram),
+			&junk_len) == MESSAGE_HANDSHAKE_INITIATION &&
+	   junk_len == 64,
+	 "initiation classified");
+  CHECK (wg_awg_decode (&cfg, dgram, sizeof (dgram) - 1, sizeof (dgram) - 1,
+			&junk_len) == MESSAGE_INVALID,
+	 "wrong length rejected");
+
+  clib_mem_unaligned (dgram + 8, u32) = cfg.magic_header[3];
+  CHECK (wg_awg_decode (&cfg, dgram, 8 + message_data_len (32),
+			8 + message_data_len (32), &junk_len) ==
+	     MESSAGE_DATA &&
+	   junk_len == 8,
+	 "data classified");
+  printf ("✓ AWG classifier PASSED\n");
+  return 0;
+}
+
+int
+main (void)
+{
+  vlib_main_t *vm = vlib_main_init (0);
+
+  vlib_main_tls = vm;
+  wg_chacha20poly1305_init ();
+  CHECK (wg_awg_init (), "junk generator keyed");
+  return test_handshake (vm) || test_transport (vm) || test_nonce_lag () ||
+	 test_awg_decode ();
+}
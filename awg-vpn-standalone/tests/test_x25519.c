@@ -0,0 +1,159 @@
+/*
+ * Test for the native X25519 of the shared core against the vectors of
+ * RFC 7748 section 5.2, including the iterated ones, and its handling of
+ * non-canonical u-coordinates
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <vlib/vlib.h>
+#include <wireguard/wireguard_key.h>
+
+#define CHECK(cond, what)                                                     \
+  do                                                                          \
+    {                                                                         \
+      if (!(cond))                                                            \
+	{                                                                     \
+	  printf ("✗ %s FAILED\n", what);                                     \
+	  return 1;                                                           \
+	}                                                                     \
+    }                                                                         \
+  while (0)
+
+typedef struct
+{
+  const char *scalar;
+  const char *u;
+  const char *out;
+} x25519_vector_t;
+
+/* RFC 7748 5.2; the second u has bit 255 set, which must be ignored */
+static const x25519_vector_t vectors[] = {
+  {
+    "a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4",
+    "e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c",
+    "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552",
+  },
+  {
+    "4b66e9d4d1b4673c5ad22691957d6af5c11b6421e0ea01d42ca4169e7918ba0d",
+    "e5210f12786811d3f4b7959d0538ae2c31dbe7106fc03c3efc4cd549c715a493",
+    "95cbde9476e8907d7aade45cb4b873f88b595a68799fa152e6f8f7647aac7957",
+  },
+};
+
+/* k after 1 and 1000 iterations of k, u = X25519 (k, u), k, from k = u = 9 */
+static const char *iterated_1 =
+  "422c8e7a6227d7bca1350b3e2bb7279f7897b87bb6854b783c60e80311ae3079";
+static const char *iterated_1000 =
+  "684cf59ba83309552800ef566f2f4d3c1c3887c49360e3875f2eb94d99532c51";
+
+static void
+from_hex (u8 out[CURVE25519_KEY_SIZE], const char *hex)
+{
+  u32 i, v;
+
+  for (i = 0; i < CURVE25519_KEY_SIZE; i++)
+    {
+      sscanf (hex + 2 * i, "%2x", &v);
+      out[i] = v;
+    }
+}
+
+static int
+test_vectors (void)
+{
+  u8 k[CURVE25519_KEY_SIZE], u[CURVE25519_KEY_SIZE];
+  u8 want[CURVE25519_KEY_SIZE], out[CURVE25519_KEY_SIZE];
+  u32 i;
+
+  for (i = 0; i < sizeof (vectors) / sizeof (vectors[0]); i++)
+    {
+      from_hex (k, vectors[i].scalar);
+      from_hex (u, vectors[i].u);
+      from_hex (want, vectors[i].out);
+      CHECK (curve25519_gen_shared (out, k, u), "vector DH");
+      CHECK (!memcmp (out, want, sizeof (out)), "RFC 7748 vector");
+    }
+  printf ("✓ RFC 7748 vectors PASSED\n");
+  return 0;
+}
+
+static int
+test_iterated (void)
+{
+  u8 k[CURVE25519_KEY_SIZE] = { 9 }, u[CURVE25519_KEY_SIZE] = { 9 };
+  u8 r[CURVE25519_KEY_SIZE], want[CURVE25519_KEY_SIZE];
+  u32 i;
+
+  for (i = 1; i <= 1000; i++)
+    {
+      CHECK (curve25519_gen_shared (r, k, u), "iterated DH");
+      memcpy (u, k, sizeof (u));
+      memcpy (k, r, sizeof (k));
+
+      if (i == 1)
+	{
+	  from_hex (want, iterated_1);
+	  CHECK (!memcmp (k, want, sizeof (k)), "1 iteration");
+	}
+    }
+  from_hex (want, iterated_1000);
+  CHECK (!memcmp (k, want, sizeof (k)), "1000 iterations");
+  printf ("✓ RFC 7748 iterations PASSED\n");
+  return 0;
+}
+
+/*
+ * u-coordinates of p and above are taken mod p, and bit 255 is masked,
+ * so these encodings must act as the point they reduce to
+ */
+static int
+test_non_canonical (void)
+{
+  u8 k[CURVE25519_KEY_SIZE], u[CURVE25519_KEY_SIZE];
+  u8 want[CURVE25519_KEY_SIZE], out[CURVE25519_KEY_SIZE];
+  u32 i;
+
+  from_hex (k, vectors[0].scalar);
+
+  /* 9 + p and 9 + p with bit 255 set, against 9 */
+  memset (u, 0, sizeof (u));
+  u[0] = 9;
+  CHECK (curve25519_gen_shared (want, k, u), "base point DH");
+
+  for (i = 0; i < 2; i++)
+    {
+      memset (u, 0xff, sizeof (u));
+      u[0] = 0xf6;
+      u[31] = i ? 0xff : 0x7f;
+      CHECK (curve25519_gen_shared (out, k, u), "u = 9 + p DH");
+      CHECK (!memcmp (out, want, sizeof (out)), "u = 9 + p");
+    }
+
+  /* p and p + 1 reduce to the low order points 0 and 1 */
+  for (i = 0; i < 2; i++)
+    {
+      memset (u, 0xff, sizeof (u));
+      u[0] = 0xed + i;
+      u[31] = 0x7f;
+      CHECK (!curve25519_gen_shared (out, k, u), "low order u rejected");
+    }
+
+  /* 2^255 - 1, p + 18, acts as 18 */
+  memset (u, 0, sizeof (u));
+  u[0] = 18;
+  CHECK (curve25519_gen_shared (want, k, u), "u = 18 DH");
+  memset (u, 0xff, sizeof (u));
+  u[31] = 0x7f;
+  CHECK (curve25519_gen_shared (out, k, u), "u = 2^255 - 1 DH");
+  CHECK (!memcmp (out, want, sizeof (out)), "u = 2^255 - 1");
+
+  printf ("✓ non-canonical u PASSED\n");
+  return 0;
+}
+
+int
+main (void)
+{
+  return test_vectors () || test_iterated () || test_non_canonical ();
+}
@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef included_dns_cache_resolve_h
+#define included_dns_cache_resolve_h
+
+/**
+ * @file
+ * @brief Name resolution through the dns plugin's cache, for other plugins
+ *
+ * dns_resolve_name () answers from the cache and starts resolving names
+ * that are not in it, but tells no one when they come in. A resolver
+ * keeps such names and looks them up again from its owner's process node
+ * until they show up or time out. The dns plugin is not thread safe, so
+ * all the lookups run on main; results go back to the thread that asked.
+ *
+ * Header only: the dns plugin is found at run time, the owner looks
+ * dns_resolve_name up with vlib_get_plugin_symbol.
+ */
+
+#include <vnet/session/session.h>
+#include <plugins/dns/dns.h>
+
+typedef struct dns_cache_resolve_
+{
+  /** name to resolve, NUL terminated */
+  u8 *name;
+
+  /** called on the requesting thread with the result, frees the request */
+  void (*done_fn) (struct dns_cache_resolve_ *r);
+
+  /** requesting thread and the handle of the requester there */
+  u32 thread_index;
+  u32 handle;
+
+  /** result, valid if rv is 0 */
+  ip46_address_t ip;
+  u8 is_ip4;
+  int rv;
+
+  /** give up on the name after this time */
+  f64 expires;
+
+  struct dns_cache_resolver_ *resolver;
+} dns_cache_resolve_t;
+
+typedef struct dns_cache_resolver_
+{
+  /** dns plugin's dns_resolve_name, NULL if the plugin is not loaded */
+  void *dns_resolve_name_ptr;
+
+  /** process node polling for the names, and the event it gets for one */
+  u32 process_node_index;
+  uword process_event;
+
+  /** seconds until a name is given up on */
+  f64 timeout;
+
+  /** names waiting for the dns plugin, main thread only */
+  dns_cache_resolve_t **pending;
+} dns_cache_resolver_t;
+
+/**
+ * @brief Look the request's name up in the dns plugin's cache
+ *
+ * @return 1 once done, with the result in the request, 0 if pending
+ */
+static inline int
+dns_cache_resolve_try (dns_cache_resolve_t *r)
+{
+  dns_pending_request_t _t0 = { 0 }, *t0 = &_t0;
+  dns_resolve_name_t _rn, *rn = &_rn;
+  void *fn = r->resolver->dns_resolve_name_ptr;
+  dns_cache_entry_t *ep = 0;
+  int rv;
+
+  if (!fn)
+    {
+      r->rv = VNET_API_ERROR_UNSUPPORTED;
+      return 1;
+    }
+
+  t0->request_type = DNS_API_PENDING_NAME_TO_IP;
+  t0->client_index = ~0;
+  rv = ((__typeof__ (dns_resolve_name) *) fn) (r->name, &ep, t0, rn);
+  if (rv < 0)
+    {
+      r->rv = rv;
+      return 1;
+    }
+
+  if (ep == 0)
+    return 0;
+
+  r->is_ip4 = ip_address_to_46 (&rn->address, &r->ip) == FIB_PROTOCOL_IP4;
+  r->rv = 0;
+  return 1;
+}
+
+static inline void
+dns_cache_resolve_done_rpc (void *arg)
+{
+  dns_cache_resolve_t *r = arg;
+
+  r->done_fn (r);
+}
+
+static inline void
+dns_cache_resolve_done (dns_cache_resolve_t *r)
+{
+  session_send_rpc_evt_to_thread (r->thread_index,
+				  dns_cache_resolve_done_rpc, r);
+}
+
+static inline void
+dns_cache_resolve_rpc (void *arg)
+{
+  vlib_main_t *vm = vlib_get_main ();
+  dns_cache_resolve_t *r = arg;
+  dns_cache_resolver_t *res = r->resolver;
+
+  if (dns_cache_resolve_try (r))
+    {
+      dns_cache_resolve_done (r);
+      return;
+    }
+
+  r->expires = vlib_time_now (vm) + res->timeout;
+  vec_add1 (res->pending, r);
+  vlib_process_signal_event (vm, res->process_node_index,
+			     res->process_event, 0);
+}
+
+/**
+ * @brief Resolve a name, from any thread
+ *
+ * The request's done_fn is called on the same thread, with the result
+ * filled in.
+ *
+ * @param name - name, the request takes it over
+ * @param handle - handle of the requester, left in the request
+ */
+static inline void
+dns_cache_resolve (dns_cache_resolver_t *res, u8 *name, u32 handle,
+		   void (*done_fn) (dns_cache_resolve_t *))
+{
+  dns_cache_resolve_t *r;
+
+  r = clib_mem_alloc (sizeof (*r));
+  clib_memset (r, 0, sizeof (*r));
+  vec_add1 (name, 0);
+  r->name = name;
+  r->done_fn = done_fn;
+  r->thread_index = vlib_get_thread_index ();
+  r->handle = handle;
+  r->resolver = res;
+
+  session_send_rpc_evt_to_thread (0, dns_cache_resolve_rpc, r);
+}
+
+/**
+ * @brief Free a request, once its done_fn is through with it
+ */
+static inline void
+dns_cache_resolve_free (dns_cache_resolve_t *r)
+{
+  vec_free (r->name);
+  clib_mem_free (r);
+}
+
+/**
+ * @brief Look the pending names up again, from the owner's process node
+ *
+ * Names still not in the cache when they expire fail.
+ */
+static inline void
+dns_cache_resolve_poll (dns_cache_resolver_t *res, f64 now)
+{
+  dns_cache_resolve_t *r;
+  u32 i;
+
+  for (i = vec_len (res->pending); i > 0; i--)
+    {
+      r = res->pending[i - 1];
+      if (!dns_cache_resolve_try (r))
+	{
+	  if (now < r->expires)
+	    continue;
+	  r->rv = VNET_API_ERROR_NAME_SERVER_NO_SUCH_NAME;
+	}
+
+      vec_del1 (res->pending, i - 1);
+      dns_cache_resolve_done (r);
+    }
+}
+
+#endif /* included_dns_cache_resolve_h */
@@ -14,6 +14,7 @@
  */
 
 #include "outline_server.h"
+#include "outline_ss.h"
 #include <vpp/app/version.h>
 #include <vnet/plugin/plugin.h>
 #include <sys/wait.h>
@@ -51,6 +52,7 @@ outline_server_init (vlib_main_t *vm)
   osm->key_by_id = hash_create_string (0, sizeof (uword));
 
   /* Initialize configuration with defaults */
+  osm->config.mode = OUTLINE_SERVER_MODE_NATIVE;
   osm->config.metrics_port = 9091;
   osm->config.replay_history = 10000;
   osm->config.tcp_timeout = OUTLINE_SERVER_DEFAULT_TIMEOUT;
@@ -201,7 +203,7 @@ outline_server_write_config (u8 *path)
 }
 
 /**
- * @brief Start the outline-ss-server process
+ * @brief Start the server, natively or as an outline-ss-server process
  */
 clib_error_t *
 outline_server_start (void)
@@ -210,7 +212,7 @@ outline_server_start (void)
   clib_error_t *error = 0;
   pid_t pid;
   int stdin_pipe[2], stdout_pipe[2], stderr_pipe[2];
-  u8 *config_path;
+  u8 *config_path = 0;
 
   clib_spinlock_lock (&osm->state_lock);
 
@@ -223,6 +225,20 @@ outline_server_start (void)
   osm->state = OUTLINE_SERVER_STATE_STARTING;
   clib_spinlock_unlock (&osm->state_lock);
 
+  if (osm->config.mode == OUTLINE_SERVER_MODE_NATIVE)
+    {
+      error = outline_ss_start ();
+      if (error)
+	goto error;
+
+      clib_spinlock_lock (&osm->state_lock);
+      osm->state = OUTLINE_SERVER_STATE_RUNNING;
+      osm->stats.uptime_start = vlib_time_now (osm->vlib_main);
+      clib_spinlock_unlock (&osm->state_lock);
+
+      return 0;
+    }
+
   /* Generate and write configuration */
   config_path = format (0, "/tmp/outline-server-%d.json%c", getpid (), 0);
 
@@ -315,7 +331,7 @@ error:
 }
 
 /**
- * @brief Stop the outline-ss-server process
+ * @brief Stop the server
  */
 clib_error_t *
 outline_server_stop (void)
@@ -335,6 +351,17 @@ outline_server_stop (void)
   osm->state = OUTLINE_SERVER_STATE_STOPPING;
   clib_spinlock_unlock (&osm->state_lock);
 
+  if (osm->config.mode == OUTLINE_SERVER_MODE_NATIVE)
+    {
+      outline_ss_stop ();
+
+      clib_spinlock_lock (&osm->state_lock);
+      osm->state = OUTLINE_SERVER_STATE_STOPPED;
+      clib_spinlock_unlock (&osm->state_lock);
+
+      return 0;
+    }
+
   /* Send SIGTERM */
   outline_log_info ("Stopping outline server (PID: %d)", osm->process.pid);
   kill (osm->process.pid, SIGTERM);
@@ -411,6 +438,10 @@ outline_server_reload_config (void)
   if (osm->state != OUTLINE_SERVER_STATE_RUNNING)
     return clib_error_return (0, "server is not running");
 
+  /* The native server reads the port and key tables as they are */
+  if (osm->config.mode == OUTLINE_SERVER_MODE_NATIVE)
+    return 0;
+
   /* Generate new configuration */
   error = outline_server_generate_config ();
   if (error)
@@ -471,7 +502,10 @@ outline_server_add_port (u16 port, u8 *password, u8 *cipher, u32 timeout,
 			  u32 *port_id)
 {
   outline_server_main_t *osm = &outline_server_main;
+  vlib_main_t *vm = osm->vlib_main;
   outline_server_port_t *p;
+  clib_error_t *error = 0;
+  outline_ss_cipher_t cipher_id = OUTLINE_SS_CIPHER_CHACHA20_POLY1305;
   uword *existing;
 
   /* Check if port already exists */
@@ -479,29 +513,49 @@ outline_server_add_port (u16 port, u8 *password, u8 *cipher, u32 timeout,
   if (existing)
     return clib_error_return (0, "port %d already exists", port);
 
+  if (cipher)
+    {
+      cipher_id = outline_ss_cipher_by_name (cipher);
+      if (cipher_id == OUTLINE_SS_CIPHER_NONE)
+	return clib_error_return (0, "unsupported cipher %v", cipher);
+    }
+
+  /* Workers of the native server look ports up, adding one is rare enough
+   * to stop them */
+  vlib_worker_thread_barrier_sync (vm);
+
   /* Allocate new port */
   pool_get_zero (osm->ports, p);
   *port_id = p - osm->ports;
 
   p->port_id = *port_id;
   p->port = port;
-  p->cipher = vec_dup (cipher ? cipher : (u8 *) "chacha20-ietf-poly1305");
+  p->cipher = format (0, "%s%c", outline_ss_ciphers[cipher_id].name, 0);
   p->password = vec_dup (password);
   p->timeout = timeout ? timeout : OUTLINE_SERVER_DEFAULT_TIMEOUT;
   p->is_active = 1;
+  p->cipher_id = cipher_id;
+  p->listener_handle = SESSION_INVALID_HANDLE;
 
   /* Add to hash tables */
   hash_set (osm->port_by_id, *port_id, p - osm->ports);
   hash_set (osm->port_by_number, port, p - osm->ports);
 
+  vlib_worker_thread_barrier_release (vm);
+
   outline_log_info ("Added port %d (id: %d, cipher: %s)", port, *port_id,
 		    p->cipher);
 
   /* Reload configuration if server is running */
   if (osm->state == OUTLINE_SERVER_STATE_RUNNING)
-    outline_server_reload_config ();
+    {
+      if (osm->config.mode == OUTLINE_SERVER_MODE_NATIVE)
+	error = outline_ss_port_listen (p);
+      else
+	outline_server_reload_config ();
+    }
 
-  return 0;
+  return error;
 }
 
 /**
@@ -511,6 +565,7 @@ clib_error_t *
 outline_server_delete_port (u32 port_id)
 {
   outline_server_main_t *osm = &outline_server_main;
+  vlib_main_t *vm = osm->vlib_main;
   outline_server_port_t *port;
   outline_server_key_t *key;
   uword *p;
@@ -521,6 +576,13 @@ outline_server_delete_port (u32 port_id)
 
   port = pool_elt_at_index (osm->ports, p[0]);
 
+  /* Connections already accepted keep going with the keys they have */
+  outline_ss_port_unlisten (port);
+
+  vlib_worker_thread_barrier_sync (vm);
+
+  outline_ss_port_keys_free (port);
+
   /* Remove all keys associated with this port */
   pool_foreach (key, osm->keys)
     {
@@ -529,6 +591,7 @@ outline_server_delete_port (u32 port_id)
 	  hash_unset_mem (osm->key_by_id, key->key_id);
 	  vec_free (key->key_id);
 	  vec_free (key->password);
+	  outline_ss_key_put (key->ss_key);
 	  pool_put (osm->keys, key);
 	}
     }
@@ -544,6 +607,8 @@ outline_server_delete_port (u32 port_id)
   vec_free (port->password);
   pool_put (osm->ports, port);
 
+  vlib_worker_thread_barrier_release (vm);
+
   /* Reload configuration if server is running */
   if (osm->state == OUTLINE_SERVER_STATE_RUNNING)
     outline_server_reload_config ();
@@ -553,11 +618,15 @@ outline_server_delete_port (u32 port_id)
 
 /**
  * @brief Add or update an access key
+ *
+ * Takes effect for new connections right away, those already identified
+ * with the key keep going as they are.
  */
 clib_error_t *
 outline_server_add_key (u8 *key_id, u32 port_id, u8 *password, u64 data_limit)
 {
   outline_server_main_t *osm = &outline_server_main;
+  outline_server_port_t *port, *old_port;
   outline_server_key_t *key;
   uword *p;
 
@@ -565,6 +634,7 @@ outline_server_add_key (u8 *key_id, u32 port_id, u8 *password, u64 data_limit)
   p = hash_get (osm->port_by_id, port_id);
   if (!p)
     return clib_error_return (0, "port id %d not found", port_id);
+  port = pool_elt_at_index (osm->ports, p[0]);
 
   /* Check if key already exists */
   p = hash_get_mem (osm->key_by_id, key_id);
@@ -578,6 +648,14 @@ outline_server_add_key (u8 *key_id, u32 port_id, u8 *password, u64 data_limit)
 
       key->password = vec_dup (password);
       key->data_limit = data_limit;
+      outline_ss_key_set (key->ss_key, password, port->cipher_id, data_limit);
+
+      if (key->port_id != port_id)
+	{
+	  old_port = pool_elt_at_index (osm->ports, key->port_id);
+	  outline_ss_port_key_del (old_port, key->ss_key);
+	  outline_ss_port_key_add (port, key->ss_key);
+	}
       key->port_id = port_id;
 
       outline_log_info ("Updated key %s", key_id);
@@ -594,6 +672,10 @@ outline_server_add_key (u8 *key_id, u32 port_id, u8 *password, u64 data_limit)
       key->is_active = 1;
       key->created_at = vlib_time_now (osm->vlib_main);
 
+      key->ss_key = outline_ss_key_alloc (key - osm->keys);
+      outline_ss_key_set (key->ss_key, password, port->cipher_id, data_limit);
+      outline_ss_port_key_add (port, key->ss_key);
+
       hash_set_mem (osm->key_by_id, key->key_id, key - osm->keys);
 
       outline_log_info ("Added key %s to port id %d", key_id, port_id);
@@ -608,11 +690,15 @@ outline_server_add_key (u8 *key_id, u32 port_id, u8 *password, u64 data_limit)
 
 /**
  * @brief Delete an access key
+ *
+ * New connections cannot use it any more, those already identified with
+ * it keep going.
  */
 clib_error_t *
 outline_server_delete_key (u8 *key_id)
 {
   outline_server_main_t *osm = &outline_server_main;
+  outline_server_port_t *port;
   outline_server_key_t *key;
   uword *p;
 
@@ -624,6 +710,10 @@ outline_server_delete_key (u8 *key_id)
 
   outline_log_info ("Deleted key %s", key_id);
 
+  port = pool_elt_at_index (osm->ports, key->port_id);
+  outline_ss_port_key_del (port, key->ss_key);
+  outline_ss_key_put (key->ss_key);
+
   hash_unset_mem (osm->key_by_id, key->key_id);
 
   vec_free (key->key_id);
@@ -738,8 +828,9 @@ format_outline_server_key (u8 *s, va_list *args)
   if (key->data_limit > 0)
     {
       s = format (s, "  Data limit: %llu bytes\n", key->data_limit);
-      s = format (s, "  Data used: %llu bytes (%.1f%%)", key->data_used,
-		  (f64) key->data_used / (f64) key->data_limit * 100.0);
+      s = format (s, "  Data used: %llu bytes (%.1f%%)",
+		  key->ss_key->data_used,
+		  (f64) key->ss_key->data_used / (f64) key->data_limit * 100.0);
     }
   else
     {
@@ -40,6 +40,12 @@
 #define OUTLINE_SERVER_DEFAULT_TIMEOUT 300
 #define OUTLINE_SERVER_CONFIG_PATH_MAX 256
 
+/* longest cipher key, also the longest salt */
+#define OUTLINE_SERVER_KEY_LEN_MAX 32
+
+struct outline_ss_key;
+struct outline_ss_key_table;
+
 /* Process states */
 typedef enum
 {
@@ -50,6 +56,13 @@ typedef enum
   OUTLINE_SERVER_STATE_ERROR
 } outline_server_state_t;
 
+/* Server implementations */
+typedef enum
+{
+  OUTLINE_SERVER_MODE_NATIVE,	/* in VPP's host stack */
+  OUTLINE_SERVER_MODE_EXTERNAL, /* outline-ss-server child process */
+} outline_server_mode_t;
+
 /* Port configuration */
 typedef struct
 {
@@ -66,6 +79,11 @@ typedef struct
 
   /* Status */
   u8 is_active;
+
+  /* Native server: keys are swapped in whole, workers read them any time */
+  u8 cipher_id;
+  struct outline_ss_key_table *key_table;
+  u64 listener_handle;
 } outline_server_port_t;
 
 /* Access key */
@@ -75,17 +93,21 @@ typedef struct
   u32 port_id;
   u8 *password;
   u64 data_limit;
-  u64 data_used;
 
   /* Status */
   u8 is_active;
   f64 created_at;
   f64 last_used;
+
+  /* Native server: what connections use, outlives the key while they do.
+   * Also keeps its data used. */
+  struct outline_ss_key *ss_key;
 } outline_server_key_t;
 
 /* Server configuration */
 typedef struct
 {
+  outline_server_mode_t mode;
   u8 *config_file;
   u16 metrics_port;
   u32 replay_history;
@@ -151,6 +173,9 @@ typedef struct
   outline_server_key_t *keys;
   uword *key_by_id;
 
+  /* tells a port's key table from its previous versions */
+  u32 key_table_version;
+
   /* Statistics */
   outline_server_stats_t stats;
 
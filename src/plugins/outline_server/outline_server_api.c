@@ -14,6 +14,7 @@
  */
 
 #include "outline_server.h"
+#include "outline_ss.h"
 #include <vlibapi/api.h>
 #include <vlibmemory/api.h>
 #include <vnet/format_fns.h>
@@ -278,7 +279,7 @@ vl_api_outline_server_keys_dump_t_handler (
 	       sizeof (rmp->key_id) - 1);
       rmp->port_id = htonl (key->port_id);
       rmp->data_limit = clib_host_to_net_u64 (key->data_limit);
-      rmp->data_used = clib_host_to_net_u64 (key->data_used);
+      rmp->data_used = clib_host_to_net_u64 (key->ss_key->data_used);
       rmp->is_active = key->is_active;
 
       vl_api_send_msg (reg, (u8 *) rmp);
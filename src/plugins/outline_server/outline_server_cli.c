@@ -26,11 +26,16 @@ outline_server_start_command_fn (vlib_main_t *vm, unformat_input_t *input,
   outline_server_main_t *osm = &outline_server_main;
   clib_error_t *error = 0;
   u16 metrics_port = osm->config.metrics_port;
+  outline_server_mode_t mode = osm->config.mode;
   u8 *config_file = 0;
 
   while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
     {
-      if (unformat (input, "config %s", &config_file))
+      if (unformat (input, "native"))
+	mode = OUTLINE_SERVER_MODE_NATIVE;
+      else if (unformat (input, "external"))
+	mode = OUTLINE_SERVER_MODE_EXTERNAL;
+      else if (unformat (input, "config %s", &config_file))
 	;
       else if (unformat (input, "metrics-port %d", &metrics_port))
 	;
@@ -42,6 +47,14 @@ outline_server_start_command_fn (vlib_main_t *vm, unformat_input_t *input,
 	}
     }
 
+  /* stop has to take down what start brought up */
+  if (osm->state == OUTLINE_SERVER_STATE_RUNNING)
+    {
+      error = clib_error_return (0, "server is already running");
+      goto done;
+    }
+  osm->config.mode = mode;
+
   error = outline_server_enable_disable (1, config_file, metrics_port);
 
 done:
@@ -94,11 +107,15 @@ outline_server_show_status_command_fn (vlib_main_t *vm,
 
   vlib_cli_output (vm, "Outline Server Status:");
   vlib_cli_output (vm, "  State: %U", format_outline_server_state, osm->state);
+  vlib_cli_output (vm, "  Mode: %s",
+		   osm->config.mode == OUTLINE_SERVER_MODE_NATIVE ? "native" :
+								    "external");
 
   if (osm->state == OUTLINE_SERVER_STATE_RUNNING)
     {
       uptime = vlib_time_now (vm) - osm->stats.uptime_start;
-      vlib_cli_output (vm, "  PID: %d", osm->process.pid);
+      if (osm->config.mode == OUTLINE_SERVER_MODE_EXTERNAL)
+	vlib_cli_output (vm, "  PID: %d", osm->process.pid);
       vlib_cli_output (vm, "  Uptime: %.0f seconds", uptime);
     }
 
@@ -412,7 +429,8 @@ outline_server_show_config_command_fn (vlib_main_t *vm,
 /* CLI command definitions */
 VLIB_CLI_COMMAND (outline_server_start_command, static) = {
   .path = "outline-server start",
-  .short_help = "outline-server start [config <file>] [metrics-port <port>]",
+  .short_help = "outline-server start [native|external] [config <file>] "
+		"[metrics-port <port>]",
   .function = outline_server_start_command_fn,
 };
 
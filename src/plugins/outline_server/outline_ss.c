@@ -0,0 +1,2060 @@
+/*
+ * Copyright (c) 2024 Internet Mastering & Company
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file outline_ss.c
+ * @brief Native Shadowsocks AEAD server
+ *
+ * Speaks the Shadowsocks AEAD protocol (SIP004) that Outline clients use:
+ *
+ *   [salt][len][len tag][payload][payload tag][len][len tag]...
+ *
+ * Each direction has its own salt, and a subkey derived from it and the
+ * access key's master key with HKDF-SHA1. Nonces are little endian
+ * counters, bumped for every length and every payload.
+ *
+ * A port may serve many access keys. The key of a new client is found by
+ * trying to decrypt its first length with each of the port's keys; a
+ * client no key fits is drained without an answer, as outline-ss-server
+ * does, so that probes learn nothing.
+ *
+ * The first payload starts with the target, in SOCKS5 address form. The
+ * target is connected through a second application, and the two
+ * sessions then relay through their own fifos: the client's thread
+ * decrypts into the upstream's tx fifo, the upstream's thread encrypts
+ * into the client's. Data used is accounted to the access key as it is
+ * relayed, and a key over its limit loses its connections.
+ */
+
+#include <vnet/session/application.h>
+#include <vnet/session/application_interface.h>
+#include <vnet/tcp/tcp.h>
+#include <vnet/plugin/plugin.h>
+#include <vnet/session/session_relay.h>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#include "outline_ss.h"
+
+outline_ss_main_t outline_ss_main;
+
+const outline_ss_cipher_info_t outline_ss_ciphers[OUTLINE_SS_N_CIPHERS] = {
+#define _(n, s, l, a, e)                                                      \
+  [OUTLINE_SS_CIPHER_##n] = {                                                 \
+    .name = s,                                                                \
+    .key_len = l,                                                             \
+    .alg = VNET_CRYPTO_ALG_##a,                                               \
+    .enc_op = VNET_CRYPTO_OP_##a##_ENC,                                       \
+    .dec_op = VNET_CRYPTO_OP_##a##_DEC,                                       \
+    .evp_cipher = EVP_##e,                                                    \
+  },
+  foreach_outline_ss_cipher
+#undef _
+};
+
+typedef enum
+{
+  OUTLINE_SS_EVENT_RESOLVE = 1,
+} outline_ss_event_t;
+
+/* ========== KEYS ========== */
+
+outline_ss_cipher_t
+outline_ss_cipher_by_name (u8 *name)
+{
+  u32 i, len;
+
+  /* API strings come NUL terminated, CLI ones do not */
+  len = strnlen ((char *) name, vec_len (name));
+
+  for (i = 1; i < OUTLINE_SS_N_CIPHERS; i++)
+    if (len == strlen (outline_ss_ciphers[i].name) &&
+	!memcmp (name, outline_ss_ciphers[i].name, len))
+      return i;
+
+  return OUTLINE_SS_CIPHER_NONE;
+}
+
+/**
+ * @brief Derive a master key from a password
+ *
+ * EVP_BytesToKey with MD5, one round and no salt, as every Shadowsocks
+ * implementation does.
+ */
+static void
+outline_ss_key_derive (u8 *master_key, u8 *password, u8 cipher)
+{
+  u32 key_len = outline_ss_ciphers[cipher].key_len, pw_len, n;
+  u8 digest[16], *buf = 0;
+
+  pw_len = strnlen ((char *) password, vec_len (password));
+
+  for (n = 0; n < key_len; n += sizeof (digest))
+    {
+      vec_reset_length (buf);
+      if (n)
+	vec_add (buf, digest, sizeof (digest));
+      vec_add (buf, password, pw_len);
+      EVP_Digest (buf, vec_len (buf), digest, 0, EVP_md5 (), 0);
+      clib_memcpy (master_key + n, digest,
+		   clib_min (sizeof (digest), key_len - n));
+    }
+
+  clib_memset (buf, 0, vec_len (buf));
+  clib_memset (digest, 0, sizeof (digest));
+  vec_free (buf);
+}
+
+/**
+ * @brief HMAC-SHA1 with its key's pads hashed once, for many messages
+ */
+typedef struct
+{
+  SHA_CTX inner;
+  SHA_CTX outer;
+} outline_ss_hmac_t;
+
+static void
+outline_ss_hmac_key (outline_ss_hmac_t *h, u8 *key, u32 len)
+{
+  u8 pad[SHA_CBLOCK];
+  u32 i;
+
+  ASSERT (len <= SHA_CBLOCK);
+
+  clib_memset (pad, 0x36, sizeof (pad));
+  for (i = 0; i < len; i++)
+    pad[i] ^= key[i];
+  SHA1_Init (&h->inner);
+  SHA1_Update (&h->inner, pad, sizeof (pad));
+
+  for (i = 0; i < sizeof (pad); i++)
+    pad[i] ^= 0x36 ^ 0x5c;
+  SHA1_Init (&h->outer);
+  SHA1_Update (&h->outer, pad, sizeof (pad));
+
+  clib_memset (pad, 0, sizeof (pad));
+}
+
+static void
+outline_ss_hmac (outline_ss_hmac_t *h, u8 *data, u32 len,
+		 u8 mac[SHA_DIGEST_LENGTH])
+{
+  SHA_CTX c = h->inner;
+
+  SHA1_Update (&c, data, len);
+  SHA1_Final (mac, &c);
+
+  c = h->outer;
+  SHA1_Update (&c, mac, SHA_DIGEST_LENGTH);
+  SHA1_Final (mac, &c);
+}
+
+/**
+ * @brief HKDF-SHA1 of a master key and a salt, info "ss-subkey"
+ *
+ * The salt keys the extract step, @a salt_hmac comes with it set up: a
+ * new client's salt is tried with every key of its port.
+ */
+static void
+outline_ss_subkey (u8 *subkey, outline_ss_hmac_t *salt_hmac, u8 *master_key,
+		   u32 len)
+{
+  static const char info[] = "ss-subkey";
+  u8 prk[SHA_DIGEST_LENGTH], t[SHA_DIGEST_LENGTH];
+  u8 in[SHA_DIGEST_LENGTH + sizeof (info)];
+  outline_ss_hmac_t prk_hmac;
+  u32 n, in_len;
+  u8 i;
+
+  outline_ss_hmac (salt_hmac, master_key, len, prk);
+  outline_ss_hmac_key (&prk_hmac, prk, sizeof (prk));
+
+  for (n = 0, i = 1; n < len; n += SHA_DIGEST_LENGTH, i++)
+    {
+      in_len = 0;
+      if (i > 1)
+	{
+	  clib_memcpy (in, t, SHA_DIGEST_LENGTH);
+	  in_len = SHA_DIGEST_LENGTH;
+	}
+      clib_memcpy (in + in_len, info, sizeof (info) - 1);
+      in_len += sizeof (info) - 1;
+      in[in_len++] = i;
+
+      outline_ss_hmac (&prk_hmac, in, in_len, t);
+      clib_memcpy (subkey + n, t, clib_min (SHA_DIGEST_LENGTH, len - n));
+    }
+
+  clib_memset (prk, 0, sizeof (prk));
+  clib_memset (t, 0, sizeof (t));
+  clib_memset (&prk_hmac, 0, sizeof (prk_hmac));
+}
+
+static_always_inline void
+outline_ss_nonce (u8 *iv, u64 nonce)
+{
+  clib_memset (iv, 0, OUTLINE_SS_NONCE_LEN);
+  clib_mem_unaligned (iv, u64) = clib_host_to_little_u64 (nonce);
+}
+
+/**
+ * @brief Set up an in-place AEAD op whose tag follows the data
+ */
+static_always_inline void
+outline_ss_op (vnet_crypto_op_t *op, vnet_crypto_op_id_t op_id,
+	       vnet_crypto_key_index_t key_index, u8 *iv, u8 *data, u32 len)
+{
+  vnet_crypto_op_init (op, op_id);
+  op->key_index = key_index;
+  op->iv = iv;
+  op->src = op->dst = data;
+  op->len = len;
+  op->tag = data + len;
+  op->tag_len = OUTLINE_SS_TAG_LEN;
+  op->aad = 0;
+  op->aad_len = 0;
+}
+
+/**
+ * @brief Account relayed bytes to the connection's access key
+ *
+ * @return 0, or -1 if the key is over its limit
+ */
+static int
+outline_ss_account (outline_ss_session_t *ss, u32 n_bytes, u8 is_sent)
+{
+  outline_server_main_t *osm = &outline_server_main;
+  outline_server_port_t *port;
+  outline_ss_key_t *k = ss->key;
+  u64 used;
+
+  if (is_sent)
+    clib_atomic_fetch_add (&osm->stats.bytes_sent, n_bytes);
+  else
+    clib_atomic_fetch_add (&osm->stats.bytes_received, n_bytes);
+
+  if (!pool_is_free_index (osm->ports, ss->port_index))
+    {
+      port = pool_elt_at_index (osm->ports, ss->port_index);
+      clib_atomic_fetch_add (&port->bytes_transferred, n_bytes);
+    }
+
+  used = clib_atomic_add_fetch (&k->data_used, n_bytes);
+  if (k->data_limit && used > k->data_limit)
+    return -1;
+
+  return 0;
+}
+
+/* ========== KEY TABLES ========== */
+
+/*
+ * Keys change while the workers use them, without a barrier. A port's
+ * key table is never changed in place: a new one is built on main and
+ * swapped in, and the old one goes once every worker is past it. The
+ * access keys in it are counted references, connections take their own
+ * and keep their key whatever happens to it meanwhile.
+ */
+
+outline_ss_key_t *
+outline_ss_key_alloc (u32 key_index)
+{
+  outline_ss_key_t *k;
+
+  k = clib_mem_alloc_aligned (sizeof (*k), CLIB_CACHE_LINE_BYTES);
+  clib_memset (k, 0, sizeof (*k));
+  k->n_refs = 1;
+  k->key_index = key_index;
+
+  return k;
+}
+
+/**
+ * @brief Set a key's password and limit
+ *
+ * The new master key goes to the slot not in use, then becomes the one
+ * in use. Waiting for the workers after that keeps the next change off
+ * the slot a trial may still read.
+ */
+void
+outline_ss_key_set (outline_ss_key_t *k, u8 *password, u8 cipher,
+		    u64 data_limit)
+{
+  u8 slot = !k->master_key_slot;
+
+  ASSERT (vlib_get_thread_index () == 0);
+
+  clib_memset (k->master_keys[slot], 0, sizeof (k->master_keys[slot]));
+  outline_ss_key_derive (k->master_keys[slot], password, cipher);
+  clib_atomic_store_rel_n (&k->master_key_slot, slot);
+  clib_atomic_store_rel_n (&k->data_limit, data_limit);
+
+  vlib_worker_wait_one_loop ();
+}
+
+void
+outline_ss_key_put (outline_ss_key_t *k)
+{
+  if (clib_atomic_sub_fetch (&k->n_refs, 1))
+    return;
+
+  clib_memset (k->master_keys, 0, sizeof (k->master_keys));
+  clib_mem_free (k);
+}
+
+static void
+outline_ss_key_table_free (outline_ss_key_table_t *kt)
+{
+  outline_ss_key_t **k;
+
+  vec_foreach (k, kt->keys)
+    outline_ss_key_put (k[0]);
+  vec_free (kt->keys);
+  clib_mem_free (kt);
+}
+
+/**
+ * @brief Swap a port's key table for a copy with one key more or less
+ */
+static void
+outline_ss_key_table_update (outline_server_port_t *port,
+			     outline_ss_key_t *add, outline_ss_key_t *del)
+{
+  outline_server_main_t *osm = &outline_server_main;
+  outline_ss_key_table_t *old = port->key_table, *kt;
+  outline_ss_key_t **k;
+
+  ASSERT (vlib_get_thread_index () == 0);
+
+  kt = clib_mem_alloc (sizeof (*kt));
+  clib_memset (kt, 0, sizeof (*kt));
+  kt->version = ++osm->key_table_version;
+
+  if (old)
+    vec_foreach (k, old->keys)
+      {
+	if (k[0] == del)
+	  continue;
+	clib_atomic_fetch_add (&k[0]->n_refs, 1);
+	vec_add1 (kt->keys, k[0]);
+      }
+
+  if (add)
+    {
+      clib_atomic_fetch_add (&add->n_refs, 1);
+      vec_add1 (kt->keys, add);
+    }
+
+  clib_atomic_store_rel_n (&port->key_table, kt);
+
+  if (old)
+    {
+      vlib_worker_wait_one_loop ();
+      outline_ss_key_table_free (old);
+    }
+}
+
+void
+outline_ss_port_key_add (outline_server_port_t *port, outline_ss_key_t *k)
+{
+  outline_ss_key_table_update (port, k, 0);
+}
+
+void
+outline_ss_port_key_del (outline_server_port_t *port, outline_ss_key_t *k)
+{
+  outline_ss_key_table_update (port, 0, k);
+}
+
+/**
+ * @brief Free a port's key table, with the port
+ */
+void
+outline_ss_port_keys_free (outline_server_port_t *port)
+{
+  outline_ss_key_table_t *kt = port->key_table;
+
+  if (!kt)
+    return;
+
+  clib_atomic_store_rel_n (&port->key_table, 0);
+  vlib_worker_wait_one_loop ();
+  outline_ss_key_table_free (kt);
+}
+
+/* ========== SESSION KEYS ========== */
+
+/*
+ * Adding and deleting crypto keys resizes the crypto layer's key tables,
+ * which the workers read from as they go. Sessions' keys are therefore
+ * added and deleted on main, by RPCs that run under the barrier, and a
+ * new connection waits for its keys before it decrypts anything.
+ */
+
+typedef struct
+{
+  u32 handle;
+  u32 thread_index;
+  u8 cipher;
+  u8 dec_key[OUTLINE_SS_MAX_KEY_LEN];
+  u8 enc_key[OUTLINE_SS_MAX_KEY_LEN];
+  vnet_crypto_key_index_t dec_key_index;
+  vnet_crypto_key_index_t enc_key_index;
+} outline_ss_keys_t;
+
+typedef struct
+{
+  vnet_crypto_key_index_t dec_key_index;
+  vnet_crypto_key_index_t enc_key_index;
+} outline_ss_keys_del_args_t;
+
+static void
+outline_ss_keys_del_main (outline_ss_keys_del_args_t *a)
+{
+  vlib_main_t *vm = vlib_get_main ();
+
+  ASSERT (vlib_get_thread_index () == 0);
+
+  if (a->dec_key_index != ~0)
+    vnet_crypto_key_del (vm, a->dec_key_index);
+  if (a->enc_key_index != ~0)
+    vnet_crypto_key_del (vm, a->enc_key_index);
+}
+
+static void
+outline_ss_keys_del (vnet_crypto_key_index_t dec_key_index,
+		     vnet_crypto_key_index_t enc_key_index)
+{
+  outline_ss_keys_del_args_t a = {
+    .dec_key_index = dec_key_index,
+    .enc_key_index = enc_key_index,
+  };
+
+  if (dec_key_index == ~0 && enc_key_index == ~0)
+    return;
+
+  if (vlib_get_thread_index () == 0)
+    outline_ss_keys_del_main (&a);
+  else
+    vlib_rpc_call_main_thread (outline_ss_keys_del_main, (u8 *) &a,
+			       sizeof (a));
+}
+
+/* ========== SESSIONS ========== */
+
+static outline_ss_session_t *
+outline_ss_session_get (outline_ss_main_t *ssm, u32 handle)
+{
+  u32 session_index = handle & OUTLINE_SS_SESSION_INDEX_MASK;
+  outline_ss_wrk_t *wrk;
+
+  if (handle == ~0)
+    return NULL;
+
+  wrk = outline_ss_wrk_get (ssm, handle >> OUTLINE_SS_SESSION_INDEX_BITS);
+  if (pool_is_free_index (wrk->sessions, session_index))
+    return NULL;
+  return pool_elt_at_index (wrk->sessions, session_index);
+}
+
+static outline_ss_session_t *
+outline_ss_session_alloc (outline_ss_main_t *ssm, session_t *s)
+{
+  outline_ss_session_t *ss;
+  outline_ss_wrk_t *wrk;
+
+  /* the upstream's thread looks sessions up too, the pool must not move
+   * under it */
+  wrk = outline_ss_wrk_get (ssm, s->thread_index);
+  pool_get_aligned_safe (wrk->sessions, ss, CLIB_CACHE_LINE_BYTES);
+  clib_memset (ss, 0, sizeof (*ss));
+
+  ss->session_index = ss - wrk->sessions;
+  ss->thread_index = s->thread_index;
+  ss->n_refs = 1;
+  ss->state = OUTLINE_SS_STATE_SALT;
+  ss->client_sh = session_handle (s);
+  ss->client_rx_fifo = s->rx_fifo;
+  ss->client_tx_fifo = s->tx_fifo;
+  ss->dec_key_index = ~0;
+  ss->enc_key_index = ~0;
+
+  /* no upstream until the target is known */
+  ss->upstream_sh = SESSION_INVALID_HANDLE;
+  ss->upstream_disconnected = 1;
+
+  return ss;
+}
+
+static void
+outline_ss_session_free (outline_ss_main_t *ssm, outline_ss_session_t *ss)
+{
+  outline_server_main_t *osm = &outline_server_main;
+  outline_ss_wrk_t *wrk;
+
+  ASSERT (ss->thread_index == vlib_get_thread_index ());
+
+  outline_ss_keys_del (ss->dec_key_index, ss->enc_key_index);
+
+  if (ss->key)
+    outline_ss_key_put (ss->key);
+  vec_free (ss->dst_name);
+  vec_free (ss->pending);
+  clib_atomic_fetch_sub (&osm->stats.active_connections, 1);
+
+  wrk = outline_ss_wrk_get (ssm, ss->thread_index);
+  pool_put (wrk->sessions, ss);
+}
+
+static void outline_ss_release (outline_ss_main_t *ssm,
+				outline_ss_session_t *ss);
+
+static void
+outline_ss_release_rpc (void *arg)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, pointer_to_uword (arg));
+  if (ss)
+    outline_ss_release (ssm, ss);
+}
+
+/**
+ * @brief Free a connection both sides are done with
+ *
+ * Fifos left behind go back on the thread that allocated them, then the
+ * connection on its owner's.
+ */
+static void
+outline_ss_release (outline_ss_main_t *ssm, outline_ss_session_t *ss)
+{
+  u32 thread_index = vlib_get_thread_index ();
+  u32 next_thread = ~0;
+
+  if (ss->upstream_fifos_held)
+    {
+      if (ss->upstream_thread_index == thread_index)
+	{
+	  segment_manager_dealloc_fifos (ss->upstream_rx_fifo,
+					 ss->upstream_tx_fifo);
+	  ss->upstream_fifos_held = 0;
+	}
+      else
+	next_thread = ss->upstream_thread_index;
+    }
+
+  if (next_thread == ~0 && ss->thread_index != thread_index)
+    next_thread = ss->thread_index;
+
+  if (next_thread != ~0)
+    {
+      session_send_rpc_evt_to_thread (
+	next_thread, outline_ss_release_rpc,
+	uword_to_pointer (outline_ss_session_handle (ss), void *));
+      return;
+    }
+
+  if (ss->client_fifos_held)
+    segment_manager_dealloc_fifos (ss->client_rx_fifo, ss->client_tx_fifo);
+
+  outline_ss_session_free (ssm, ss);
+}
+
+/**
+ * @brief Drop a reference that holds no session, the last one frees
+ */
+static void
+outline_ss_put (outline_ss_main_t *ssm, outline_ss_session_t *ss)
+{
+  if (clib_atomic_sub_fetch (&ss->n_refs, 1))
+    return;
+
+  outline_ss_release (ssm, ss);
+}
+
+static void
+outline_ss_close_client (outline_ss_main_t *ssm, outline_ss_session_t *ss)
+{
+  vnet_disconnect_args_t _a = { 0 }, *a = &_a;
+
+  /* both sides may try, only the first one disconnects */
+  if (clib_atomic_swap_acq_n (&ss->client_disconnected, 1))
+    return;
+
+  a->handle = ss->client_sh;
+  a->app_index = ssm->app_index;
+  vnet_disconnect_session (a);
+}
+
+static void
+outline_ss_close_upstream (outline_ss_main_t *ssm, outline_ss_session_t *ss)
+{
+  vnet_disconnect_args_t _a = { 0 }, *a = &_a;
+
+  if (clib_atomic_swap_acq_n (&ss->upstream_disconnected, 1))
+    return;
+
+  a->handle = ss->upstream_sh;
+  a->app_index = ssm->connect_app_index;
+  vnet_disconnect_session (a);
+}
+
+/**
+ * @brief Stop relaying, taking both sides down
+ *
+ * No half-close: whichever side goes first takes the other with it.
+ */
+static void
+outline_ss_close (outline_ss_main_t *ssm, outline_ss_session_t *ss,
+		  u8 is_upstream)
+{
+  ss->state = OUTLINE_SS_STATE_CLOSED;
+  if (is_upstream)
+    {
+      outline_ss_close_upstream (ssm, ss);
+      outline_ss_close_client (ssm, ss);
+    }
+  else
+    {
+      outline_ss_close_client (ssm, ss);
+
+      /* a connect in flight finds the client gone when it completes,
+       * both run on the client's thread */
+      if (!ss->upstream_connecting)
+	outline_ss_close_upstream (ssm, ss);
+    }
+}
+
+/**
+ * @brief A side's session is being freed
+ *
+ * If the other side is still around it may write to our tx fifo, so the
+ * fifos stay with the connection until it is released.
+ */
+static void
+outline_ss_delete (session_t *s, u8 is_upstream)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, s->opaque);
+  if (!ss)
+    return;
+
+  if (is_upstream)
+    {
+      ss->upstream_disconnected = 1;
+      ss->upstream_sh = SESSION_INVALID_HANDLE;
+      ss->upstream_fifos_held = 1;
+    }
+  else
+    {
+      ss->client_disconnected = 1;
+      ss->client_sh = SESSION_INVALID_HANDLE;
+      ss->client_fifos_held = 1;
+    }
+
+  if (clib_atomic_sub_fetch (&ss->n_refs, 1))
+    {
+      s->rx_fifo = 0;
+      s->tx_fifo = 0;
+      return;
+    }
+
+  /* last one out, our fifos go with our session */
+  if (is_upstream)
+    ss->upstream_fifos_held = 0;
+  else
+    ss->client_fifos_held = 0;
+
+  outline_ss_release (ssm, ss);
+}
+
+/* ========== REPLAY DEFENSE ========== */
+
+/**
+ * @brief Remember a client's salt
+ *
+ * Salts are random, their first 8 bytes tell them apart well enough.
+ *
+ * @return 1 if it was seen lately
+ */
+static int
+outline_ss_replay_check (outline_ss_main_t *ssm, u8 *salt)
+{
+  u64 tag = clib_mem_unaligned (salt, u64), old;
+  int seen = 0;
+
+  if (!vec_len (ssm->replay_ring))
+    return 0;
+
+  clib_spinlock_lock (&ssm->replay_lock);
+
+  if (hash_get (ssm->replay_hash, tag))
+    seen = 1;
+  else
+    {
+      old = ssm->replay_ring[ssm->replay_next];
+      if (old)
+	hash_unset (ssm->replay_hash, old);
+      ssm->replay_ring[ssm->replay_next] = tag;
+      ssm->replay_next = (ssm->replay_next + 1) % vec_len (ssm->replay_ring);
+      hash_set (ssm->replay_hash, tag, 1);
+    }
+
+  clib_spinlock_unlock (&ssm->replay_lock);
+
+  return seen;
+}
+
+static int outline_ss_client_rx (outline_ss_main_t *ssm, session_t *s);
+
+/**
+ * @brief A connection's keys are in, it may decrypt now
+ *
+ * Runs on the connection's thread. The reference taken for the keys
+ * kept the connection, but not necessarily the client, around.
+ */
+static void
+outline_ss_keys_added_rpc (void *arg)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_keys_t *ks = arg;
+  outline_ss_session_t *ss;
+  session_t *s;
+
+  ss = outline_ss_session_get (ssm, ks->handle);
+  if (!ss)
+    {
+      /* the server was stopped meanwhile */
+      outline_ss_keys_del (ks->dec_key_index, ks->enc_key_index);
+      goto done;
+    }
+
+  ss->dec_key_index = ks->dec_key_index;
+  ss->enc_key_index = ks->enc_key_index;
+
+  if (!clib_atomic_sub_fetch (&ss->n_refs, 1))
+    {
+      outline_ss_release (ssm, ss);
+      goto done;
+    }
+
+  if (ss->state != OUTLINE_SS_STATE_KEYING)
+    goto done;
+
+  ss->state = OUTLINE_SS_STATE_ADDRESS;
+  s = session_get_from_handle_if_valid (ss->client_sh);
+  if (s)
+    outline_ss_client_rx (ssm, s);
+
+done:
+  clib_memset (ks, 0, sizeof (*ks));
+  clib_mem_free (ks);
+}
+
+static void
+outline_ss_keys_add_main (outline_ss_keys_t **a)
+{
+  vlib_main_t *vm = vlib_get_main ();
+  outline_ss_keys_t *ks = a[0];
+  const outline_ss_cipher_info_t *ci = &outline_ss_ciphers[ks->cipher];
+
+  ASSERT (vlib_get_thread_index () == 0);
+
+  ks->dec_key_index =
+    vnet_crypto_key_add (vm, ci->alg, ks->dec_key, ci->key_len);
+  ks->enc_key_index =
+    vnet_crypto_key_add (vm, ci->alg, ks->enc_key, ci->key_len);
+
+  session_send_rpc_evt_to_thread (ks->thread_index, outline_ss_keys_added_rpc,
+				  ks);
+}
+
+/**
+ * @brief Have main add a new connection's keys
+ *
+ * The connection is held until they are back.
+ */
+static void
+outline_ss_keys_add (outline_ss_session_t *ss, u8 *dec_key, u8 *enc_key)
+{
+  u32 key_len = outline_ss_ciphers[ss->cipher].key_len;
+  outline_ss_keys_t *ks;
+
+  ks = clib_mem_alloc (sizeof (*ks));
+  clib_memset (ks, 0, sizeof (*ks));
+  ks->handle = outline_ss_session_handle (ss);
+  ks->thread_index = ss->thread_index;
+  ks->cipher = ss->cipher;
+  clib_memcpy (ks->dec_key, dec_key, key_len);
+  clib_memcpy (ks->enc_key, enc_key, key_len);
+
+  clib_atomic_fetch_add (&ss->n_refs, 1);
+  ss->state = OUTLINE_SS_STATE_KEYING;
+
+  if (vlib_get_thread_index () == 0)
+    outline_ss_keys_add_main (&ks);
+  else
+    vlib_rpc_call_main_thread (outline_ss_keys_add_main, (u8 *) &ks,
+			       sizeof (ks));
+}
+
+/* ========== KEY IDENTIFICATION ========== */
+
+static_always_inline outline_ss_ip_cache_entry_t *
+outline_ss_ip_cache_entry (outline_ss_wrk_t *wrk, ip4_address_t *ip)
+{
+  u32 hash = ip->as_u32 * 0x9e3779b1;
+
+  return &wrk->ip_cache[hash >> (32 - min_log2 (OUTLINE_SS_IP_CACHE_SIZE))];
+}
+
+/**
+ * @brief Where the key a client address used last is in the order
+ */
+static u32
+outline_ss_ip_cache_lookup (outline_ss_wrk_t *wrk, outline_ss_key_order_t *ko,
+			    ip4_address_t *ip)
+{
+  outline_ss_ip_cache_entry_t *e;
+
+  e = outline_ss_ip_cache_entry (wrk, ip);
+  if (e->ip.as_u32 != ip->as_u32 || e->key_index == ~0)
+    return ~0;
+
+  return vec_search (ko->key_indices, e->key_index);
+}
+
+/**
+ * @brief The order this thread tries a port's keys in
+ *
+ * Kept across changes of the port's keys: those still there stay where
+ * they were, new ones go last.
+ */
+static outline_ss_key_order_t *
+outline_ss_key_order_get (outline_ss_wrk_t *wrk, outline_ss_key_table_t *kt,
+			  u32 port_index)
+{
+  outline_ss_key_order_t *ko;
+  outline_ss_key_t **k;
+  u32 *ki, n = 0;
+
+  vec_validate (wrk->key_orders, port_index);
+  ko = vec_elt_at_index (wrk->key_orders, port_index);
+  if (ko->version == kt->version)
+    return ko;
+
+  vec_foreach (k, kt->keys)
+    {
+      vec_validate (wrk->key_by_index, k[0]->key_index);
+      wrk->key_by_index[k[0]->key_index] = k[0];
+      wrk->key_bitmap = clib_bitmap_set (wrk->key_bitmap, k[0]->key_index, 1);
+    }
+
+  /* the old order's keys may be gone, only their indices are looked at */
+  vec_foreach (ki, ko->key_indices)
+    if (clib_bitmap_get (wrk->key_bitmap, ki[0]))
+      {
+	ko->key_indices[n] = ki[0];
+	ko->keys[n++] = wrk->key_by_index[ki[0]];
+	wrk->key_bitmap = clib_bitmap_set (wrk->key_bitmap, ki[0], 0);
+      }
+  vec_set_len (ko->key_indices, n);
+  vec_set_len (ko->keys, n);
+
+  vec_foreach (k, kt->keys)
+    if (clib_bitmap_get (wrk->key_bitmap, k[0]->key_index))
+      {
+	vec_add1 (ko->key_indices, k[0]->key_index);
+	vec_add1 (ko->keys, k[0]);
+	wrk->key_bitmap =
+	  clib_bitmap_set (wrk->key_bitmap, k[0]->key_index, 0);
+      }
+
+  ko->version = kt->version;
+  return ko;
+}
+
+/**
+ * @brief Remember which key a client identified with
+ */
+static void
+outline_ss_key_hit (outline_ss_wrk_t *wrk, outline_ss_key_order_t *ko,
+		    outline_ss_session_t *ss, u32 pos)
+{
+  outline_ss_ip_cache_entry_t *e;
+  outline_ss_key_t *k = ko->keys[pos];
+
+  e = outline_ss_ip_cache_entry (wrk, &ss->client_ip);
+  e->ip = ss->client_ip;
+  e->key_index = k->key_index;
+
+  /* move to front, keys in use are the first ones tried */
+  if (pos == 0)
+    return;
+  clib_memmove (ko->key_indices + 1, ko->key_indices,
+		pos * sizeof (ko->key_indices[0]));
+  clib_memmove (ko->keys + 1, ko->keys, pos * sizeof (ko->keys[0]));
+  ko->key_indices[0] = k->key_index;
+  ko->keys[0] = k;
+}
+
+/**
+ * @brief Try a subkey on a client's first length
+ *
+ * @return 1 if it authenticates, with the length in @a len
+ */
+static int
+outline_ss_trial (EVP_CIPHER_CTX *ctx, u8 *subkey, u8 *iv, u8 *in, u8 *len)
+{
+  int n;
+
+  return EVP_DecryptInit_ex (ctx, 0, 0, subkey, iv) > 0 &&
+	 EVP_CIPHER_CTX_ctrl (ctx, EVP_CTRL_AEAD_SET_TAG, OUTLINE_SS_TAG_LEN,
+			      in + 2) > 0 &&
+	 EVP_DecryptUpdate (ctx, len, &n, in, 2) > 0 &&
+	 EVP_DecryptFinal_ex (ctx, len + n, &n) > 0;
+}
+
+/**
+ * @brief Find the access key of a new client
+ *
+ * The port's keys are tried on the first length until one authenticates
+ * it: first the key the client's address used last, then the others,
+ * most recently identified first. A trial is an HKDF, whose salt half is
+ * done once for all keys, and a two byte decryption on a cipher context
+ * of the thread, the crypto layer's keys are for main to change. The
+ * winner gets keys of its own, added by main.
+ *
+ * @return 1 once found, 0 if the salt is not all in, -1 for no key
+ */
+static int
+outline_ss_identify (outline_ss_main_t *ssm, outline_ss_wrk_t *wrk,
+		     outline_ss_session_t *ss, session_t *s)
+{
+  outline_server_main_t *osm = &outline_server_main;
+  u8 hdr[OUTLINE_SS_MAX_KEY_LEN + OUTLINE_SS_LEN_SIZE];
+  u8 dec_key[OUTLINE_SS_MAX_KEY_LEN], enc_key[OUTLINE_SS_MAX_KEY_LEN];
+  u8 iv[OUTLINE_SS_NONCE_LEN], len_buf[2], slot = 0;
+  u32 salt_len, cached, n_keys, i, pos = 0;
+  const outline_ss_cipher_info_t *ci;
+  outline_ss_hmac_t salt_hmac;
+  outline_ss_key_table_t *kt;
+  outline_ss_key_order_t *ko;
+  outline_server_port_t *port;
+  outline_ss_key_t *k = 0;
+  int rv = -1;
+  u16 len;
+
+  if (pool_is_free_index (osm->ports, ss->port_index))
+    return -1;
+  port = pool_elt_at_index (osm->ports, ss->port_index);
+  kt = clib_atomic_load_acq_n (&port->key_table);
+  if (!kt)
+    return -1;
+
+  ci = &outline_ss_ciphers[ss->cipher];
+  salt_len = ci->key_len;
+  if (svm_fifo_max_dequeue_cons (s->rx_fifo) < salt_len + OUTLINE_SS_LEN_SIZE)
+    return 0;
+  svm_fifo_peek (s->rx_fifo, 0, salt_len + OUTLINE_SS_LEN_SIZE, hdr);
+
+  ko = outline_ss_key_order_get (wrk, kt, ss->port_index);
+  cached = outline_ss_ip_cache_lookup (wrk, ko, &ss->client_ip);
+  n_keys = vec_len (ko->keys);
+  outline_ss_nonce (iv, 0);
+  outline_ss_hmac_key (&salt_hmac, hdr, salt_len);
+  EVP_DecryptInit_ex (wrk->trial_ctx, ci->evp_cipher (), 0, 0, 0);
+
+  /* candidate 0 is the cached key, then the port's keys in order */
+  for (i = cached == ~0 ? 1 : 0; i <= n_keys; i++)
+    {
+      pos = i ? i - 1 : cached;
+      if (i && pos == cached)
+	continue;
+
+      k = ko->keys[pos];
+      if (k->data_limit && k->data_used >= k->data_limit)
+	continue;
+
+      slot = clib_atomic_load_acq_n (&k->master_key_slot);
+      outline_ss_subkey (dec_key, &salt_hmac, k->master_keys[slot], salt_len);
+      if (outline_ss_trial (wrk->trial_ctx, dec_key, iv, hdr + salt_len,
+			    len_buf))
+	break;
+    }
+
+  if (i > n_keys)
+    {
+      clib_atomic_fetch_add (&osm->stats.auth_failures, 1);
+      goto done;
+    }
+
+  if (osm->enable_replay_defense && outline_ss_replay_check (ssm, hdr))
+    {
+      clib_atomic_fetch_add (&osm->stats.replay_attacks_blocked, 1);
+      goto done;
+    }
+
+  len = clib_net_to_host_u16 (clib_mem_unaligned (len_buf, u16));
+  if (len == 0 || len > OUTLINE_SS_MAX_PAYLOAD)
+    goto done;
+
+  /* ours until the connection goes, whatever happens to the key */
+  clib_atomic_fetch_add (&k->n_refs, 1);
+  ss->key = k;
+  outline_ss_key_hit (wrk, ko, ss, pos);
+
+  ss->dec_nonce = 1;
+  ss->dec_chunk_len = len;
+
+  /* our own salt and subkey for the way back */
+  RAND_bytes (ss->enc_salt, salt_len);
+  outline_ss_hmac_key (&salt_hmac, ss->enc_salt, salt_len);
+  outline_ss_subkey (enc_key, &salt_hmac, k->master_keys[slot], salt_len);
+  outline_ss_keys_add (ss, dec_key, enc_key);
+
+  svm_fifo_dequeue_drop (s->rx_fifo, salt_len + OUTLINE_SS_LEN_SIZE);
+  rv = 1;
+
+done:
+  clib_memset (dec_key, 0, sizeof (dec_key));
+  clib_memset (enc_key, 0, sizeof (enc_key));
+  clib_memset (&salt_hmac, 0, sizeof (salt_hmac));
+  return rv;
+}
+
+/* ========== CLIENT TO UPSTREAM ========== */
+
+/**
+ * @brief Decode the target address at the start of the first payload
+ *
+ * @return length of the address, or -1 if malformed
+ */
+static int
+outline_ss_addr_parse (outline_ss_session_t *ss, u8 *data, u32 len)
+{
+  u32 n;
+  u8 *p;
+
+  if (len < 2)
+    return -1;
+
+  switch (data[0])
+    {
+    case OUTLINE_SS_ATYP_IPV4:
+      n = 1 + 4 + 2;
+      if (len < n)
+	return -1;
+      ss->dst_is_ip4 = 1;
+      ip46_address_reset (&ss->dst_ip);
+      clib_memcpy (&ss->dst_ip.ip4, &data[1], 4);
+      break;
+    case OUTLINE_SS_ATYP_IPV6:
+      n = 1 + 16 + 2;
+      if (len < n)
+	return -1;
+      ss->dst_is_ip4 = 0;
+      clib_memcpy (&ss->dst_ip.ip6, &data[1], 16);
+      break;
+    case OUTLINE_SS_ATYP_DOMAINNAME:
+      n = 2 + data[1] + 2;
+      if (len < n || data[1] == 0)
+	return -1;
+      vec_reset_length (ss->dst_name);
+      vec_add (ss->dst_name, &data[2], data[1]);
+      break;
+    default:
+      return -1;
+    }
+
+  p = &data[n - 2];
+  ss->dst_port = p[0] << 8 | p[1];
+
+  return n;
+}
+
+static void outline_ss_connect_target (outline_ss_main_t *ssm,
+				       outline_ss_session_t *ss);
+
+/**
+ * @brief Decrypt what the client sent, as far as the upstream takes it
+ *
+ * Lengths are decrypted one at a time, each tells where the next chunk
+ * starts. Payloads are then decrypted in one batch, in place, and queued
+ * to the upstream. Before the upstream exists, only the first chunk is
+ * taken: it names the target.
+ *
+ * @return payload bytes passed on, or -1 if a chunk is not authentic
+ */
+static int
+outline_ss_client_decrypt (outline_ss_main_t *ssm, outline_ss_wrk_t *wrk,
+			   outline_ss_session_t *ss, session_t *s)
+{
+  const outline_ss_cipher_info_t *ci = &outline_ss_ciphers[ss->cipher];
+  u32 n_read, budget, off = 0, n_ops = 0, n_out = 0;
+  vlib_main_t *vm = vlib_get_main ();
+  u8 is_address, *buf = wrk->buf;
+  vnet_crypto_op_t *op;
+  int n;
+  u16 len;
+
+  is_address = ss->state == OUTLINE_SS_STATE_ADDRESS;
+  budget = is_address ? OUTLINE_SS_MAX_PAYLOAD :
+			svm_fifo_max_enqueue_prod (ss->upstream_tx_fifo);
+
+  n_read = svm_fifo_max_dequeue_cons (s->rx_fifo);
+  n_read = clib_min (n_read, OUTLINE_SS_BUF_SIZE);
+  n_read = clib_min (n_read, budget + OUTLINE_SS_BATCH * (OUTLINE_SS_LEN_SIZE +
+							  OUTLINE_SS_TAG_LEN));
+  if (!n_read)
+    return 0;
+  n_read = svm_fifo_peek (s->rx_fifo, 0, n_read, buf);
+
+  while (n_ops < OUTLINE_SS_BATCH)
+    {
+      if (!ss->dec_chunk_len)
+	{
+	  if (n_read - off < OUTLINE_SS_LEN_SIZE)
+	    break;
+
+	  op = &wrk->ops[n_ops];
+	  outline_ss_nonce (wrk->ivs[n_ops], ss->dec_nonce);
+	  outline_ss_op (op, ci->dec_op, ss->dec_key_index, wrk->ivs[n_ops],
+			 buf + off, 2);
+	  if (vnet_crypto_process_ops (vm, op, 1) != 1)
+	    return -1;
+
+	  len = clib_net_to_host_u16 (clib_mem_unaligned (buf + off, u16));
+	  if (len == 0 || len > OUTLINE_SS_MAX_PAYLOAD)
+	    return -1;
+
+	  ss->dec_nonce++;
+	  ss->dec_chunk_len = len;
+	  off += OUTLINE_SS_LEN_SIZE;
+	}
+
+      len = ss->dec_chunk_len;
+      if (n_read - off < len + OUTLINE_SS_TAG_LEN || n_out + len > budget)
+	break;
+
+      outline_ss_nonce (wrk->ivs[n_ops], ss->dec_nonce++);
+      outline_ss_op (&wrk->ops[n_ops], ci->dec_op, ss->dec_key_index,
+		     wrk->ivs[n_ops], buf + off, len);
+      wrk->segs[n_ops].data = buf + off;
+      wrk->segs[n_ops].len = len;
+      n_ops++;
+
+      off += len + OUTLINE_SS_TAG_LEN;
+      n_out += len;
+      ss->dec_chunk_len = 0;
+
+      if (is_address)
+	break;
+    }
+
+  if (n_ops && vnet_crypto_process_ops (vm, wrk->ops, n_ops) != n_ops)
+    return -1;
+
+  if (off)
+    {
+      svm_fifo_dequeue_drop (s->rx_fifo, off);
+      session_relay_rx_drained (s, off);
+    }
+
+  if (!n_ops)
+    {
+      /* a whole chunk is in but the upstream has no room for it */
+      if (ss->dec_chunk_len && !is_address &&
+	  n_read - off >= ss->dec_chunk_len + OUTLINE_SS_TAG_LEN)
+	svm_fifo_add_want_deq_ntf (ss->upstream_tx_fifo,
+				   SVM_FIFO_WANT_DEQ_NOTIF);
+      return 0;
+    }
+
+  if (outline_ss_account (ss, n_out, 0 /* is_sent */))
+    return -1;
+
+  if (is_address)
+    {
+      n = outline_ss_addr_parse (ss, wrk->segs[0].data, wrk->segs[0].len);
+      if (n < 0)
+	return -1;
+
+      /* anything behind the address waits for the upstream */
+      vec_add (ss->pending, wrk->segs[0].data + n, wrk->segs[0].len - n);
+      outline_ss_connect_target (ssm, ss);
+      return 0;
+    }
+
+  svm_fifo_enqueue_segments (ss->upstream_tx_fifo, wrk->segs, n_ops,
+			     0 /* allow_partial */);
+  session_relay_tx_event (ss->upstream_tx_fifo, ss->upstream_sh);
+
+  return n_out;
+}
+
+static int
+outline_ss_client_rx (outline_ss_main_t *ssm, session_t *s)
+{
+  outline_ss_session_t *ss;
+  outline_ss_wrk_t *wrk;
+  int rv;
+
+  ss = outline_ss_session_get (ssm, s->opaque);
+  if (!ss)
+    return -1;
+
+  wrk = outline_ss_wrk_get (ssm, s->thread_index);
+
+  switch (ss->state)
+    {
+    case OUTLINE_SS_STATE_SALT:
+      /* once found, the rest waits for the keys from main */
+      if (outline_ss_identify (ssm, wrk, ss, s) < 0)
+	{
+	  /* no answer, nor a reset, for a client we do not know */
+	  ss->state = OUTLINE_SS_STATE_CLOSED;
+	  svm_fifo_dequeue_drop_all (s->rx_fifo);
+	}
+      return 0;
+
+    case OUTLINE_SS_STATE_ADDRESS:
+    case OUTLINE_SS_STATE_ESTABLISHED:
+      do
+	rv = outline_ss_client_decrypt (ssm, wrk, ss, s);
+      while (rv > 0);
+      if (rv < 0)
+	outline_ss_close (ssm, ss, 0 /* is_upstream */);
+      return 0;
+
+    case OUTLINE_SS_STATE_KEYING:
+    case OUTLINE_SS_STATE_CONNECTING:
+      /* data queues in the fifo until the keys or the upstream are in */
+      return 0;
+
+    default:
+      svm_fifo_dequeue_drop_all (s->rx_fifo);
+      return 0;
+    }
+}
+
+/* ========== UPSTREAM TO CLIENT ========== */
+
+/**
+ * @brief Encrypt what the upstream sent, as far as the client takes it
+ *
+ * Every chunk's length and payload are independent once the nonces are
+ * assigned, so all of them go to the crypto engine in one batch. The
+ * server's salt goes ahead of the first chunk.
+ *
+ * @return payload bytes passed on, or -1 if the key ran out
+ */
+static int
+outline_ss_upstream_encrypt (outline_ss_main_t *ssm, outline_ss_wrk_t *wrk,
+			     outline_ss_session_t *ss, session_t *s)
+{
+  const outline_ss_cipher_info_t *ci = &outline_ss_ciphers[ss->cipher];
+  u32 n_avail, n_free, n_plain = 0, off = 0, n_ops = 0, n_segs = 0;
+  vlib_main_t *vm = vlib_get_main ();
+  svm_fifo_t *f = ss->client_tx_fifo;
+  u8 *buf = wrk->buf, *chunk;
+  u32 salt_len, len;
+
+  n_avail = svm_fifo_max_dequeue_cons (s->rx_fifo);
+  if (!n_avail)
+    return 0;
+
+  salt_len = ss->salt_sent ? 0 : ci->key_len;
+  n_free = svm_fifo_max_enqueue_prod (f);
+  n_free = clib_min (n_free, OUTLINE_SS_BUF_SIZE + salt_len);
+  if (n_free <= salt_len + OUTLINE_SS_LEN_SIZE + OUTLINE_SS_TAG_LEN)
+    {
+      svm_fifo_add_want_deq_ntf (f, SVM_FIFO_WANT_DEQ_NOTIF);
+      return 0;
+    }
+  n_free -= salt_len;
+
+  while (n_ops < 2 * OUTLINE_SS_BATCH && n_plain < n_avail &&
+	 n_free - off > OUTLINE_SS_LEN_SIZE + OUTLINE_SS_TAG_LEN)
+    {
+      len = clib_min (n_avail - n_plain, OUTLINE_SS_MAX_PAYLOAD);
+      len =
+	clib_min (len, n_free - off - OUTLINE_SS_LEN_SIZE - OUTLINE_SS_TAG_LEN);
+
+      chunk = buf + off;
+      svm_fifo_peek (s->rx_fifo, n_plain, len, chunk + OUTLINE_SS_LEN_SIZE);
+      clib_mem_unaligned (chunk, u16) = clib_host_to_net_u16 (len);
+
+      outline_ss_nonce (wrk->ivs[n_ops], ss->enc_nonce++);
+      outline_ss_op (&wrk->ops[n_ops], ci->enc_op, ss->enc_key_index,
+		     wrk->ivs[n_ops], chunk, 2);
+      n_ops++;
+      outline_ss_nonce (wrk->ivs[n_ops], ss->enc_nonce++);
+      outline_ss_op (&wrk->ops[n_ops], ci->enc_op, ss->enc_key_index,
+		     wrk->ivs[n_ops], chunk + OUTLINE_SS_LEN_SIZE, len);
+      n_ops++;
+
+      off += OUTLINE_SS_LEN_SIZE + len + OUTLINE_SS_TAG_LEN;
+      n_plain += len;
+    }
+
+  if (vnet_crypto_process_ops (vm, wrk->ops, n_ops) != n_ops)
+    return -1;
+
+  if (!ss->salt_sent)
+    {
+      wrk->segs[n_segs].data = ss->enc_salt;
+      wrk->segs[n_segs++].len = salt_len;
+      ss->salt_sent = 1;
+    }
+  wrk->segs[n_segs].data = buf;
+  wrk->segs[n_segs++].len = off;
+  svm_fifo_enqueue_segments (f, wrk->segs, n_segs, 0 /* allow_partial */);
+
+  svm_fifo_dequeue_drop (s->rx_fifo, n_plain);
+  session_relay_rx_drained (s, n_plain);
+
+  if (!ss->client_disconnected)
+    session_relay_tx_event (f, ss->client_sh);
+
+  if (outline_ss_account (ss, n_plain, 1 /* is_sent */))
+    return -1;
+
+  return n_plain;
+}
+
+static void
+outline_ss_upstream_drain (outline_ss_main_t *ssm, outline_ss_session_t *ss,
+			   session_t *s)
+{
+  outline_ss_wrk_t *wrk = outline_ss_wrk_get (ssm, s->thread_index);
+  int rv;
+
+  do
+    rv = outline_ss_upstream_encrypt (ssm, wrk, ss, s);
+  while (rv > 0);
+
+  if (rv < 0)
+    outline_ss_close (ssm, ss, 1 /* is_upstream */);
+}
+
+/* ========== UPSTREAM SIDE ========== */
+
+/**
+ * @brief The target could not be reached
+ *
+ * Runs on the client's thread. Shadowsocks has no way to say so, the
+ * client just goes.
+ */
+static void
+outline_ss_connect_failed (outline_ss_main_t *ssm, outline_ss_session_t *ss)
+{
+  outline_server_main_t *osm = &outline_server_main;
+
+  clib_atomic_fetch_add (&osm->stats.connection_errors, 1);
+  ss->upstream_connecting = 0;
+  ss->upstream_disconnected = 1;
+  outline_ss_close (ssm, ss, 0 /* is_upstream */);
+  outline_ss_put (ssm, ss);
+}
+
+static void
+outline_ss_connect_failed_rpc (void *arg)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, pointer_to_uword (arg));
+  if (ss)
+    outline_ss_connect_failed (ssm, ss);
+}
+
+static void
+outline_ss_connect_failed_on_owner (outline_ss_main_t *ssm,
+				    outline_ss_session_t *ss)
+{
+  if (ss->thread_index == vlib_get_thread_index ())
+    outline_ss_connect_failed (ssm, ss);
+  else
+    session_send_rpc_evt_to_thread (
+      ss->thread_index, outline_ss_connect_failed_rpc,
+      uword_to_pointer (outline_ss_session_handle (ss), void *));
+}
+
+static void
+outline_ss_connect_rpc (void *rpc_args)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  vnet_connect_args_t *a = rpc_args;
+  outline_ss_session_t *ss;
+  session_error_t rv;
+
+  rv = vnet_connect (a);
+  if (rv)
+    {
+      outline_log_debug ("connection %x connect returned: %U",
+			 a->api_context, format_session_error, rv);
+      /* gone if the server was stopped meanwhile */
+      ss = outline_ss_session_get (ssm, a->api_context);
+      if (ss)
+	outline_ss_connect_failed_on_owner (ssm, ss);
+    }
+
+  vec_free (a);
+}
+
+/**
+ * @brief Connect the target, from the transport's connect thread
+ */
+static void
+outline_ss_connect (outline_ss_main_t *ssm, outline_ss_session_t *ss)
+{
+  vnet_connect_args_t *a = 0;
+
+  vec_validate (a, 0);
+  clib_memset (a, 0, sizeof (a[0]));
+  a->sep_ext = (session_endpoint_cfg_t) SESSION_ENDPOINT_CFG_NULL;
+  a->sep_ext.transport_proto = TRANSPORT_PROTO_TCP;
+  a->sep_ext.is_ip4 = ss->dst_is_ip4;
+  a->sep_ext.ip = ss->dst_ip;
+  a->sep_ext.port = clib_host_to_net_u16 (ss->dst_port);
+  a->app_index = ssm->connect_app_index;
+  a->api_context = outline_ss_session_handle (ss);
+
+  session_send_rpc_evt_to_thread_force (transport_cl_thread (),
+					outline_ss_connect_rpc, a);
+}
+
+static void
+outline_ss_connect_resolved (dns_cache_resolve_t *r)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, r->handle);
+  if (!ss)
+    ;
+  else if (r->rv || ss->client_disconnected)
+    {
+      if (r->rv)
+	outline_log_debug ("connection %u cannot resolve %s: %d",
+			   ss->session_index, r->name, r->rv);
+      outline_ss_connect_failed (ssm, ss);
+    }
+  else
+    {
+      ss->dst_ip = r->ip;
+      ss->dst_is_ip4 = r->is_ip4;
+      outline_ss_connect (ssm, ss);
+    }
+
+  dns_cache_resolve_free (r);
+}
+
+/**
+ * @brief Start connecting the target the client named
+ */
+static void
+outline_ss_connect_target (outline_ss_main_t *ssm, outline_ss_session_t *ss)
+{
+  /* one reference for the client, one for the upstream */
+  ss->n_refs = 2;
+  ss->upstream_disconnected = 0;
+  ss->upstream_connecting = 1;
+  ss->state = OUTLINE_SS_STATE_CONNECTING;
+
+  if (ss->dst_name)
+    {
+      /* the dns plugin is not thread safe, main does all the lookups */
+      dns_cache_resolve (&ssm->resolver, ss->dst_name,
+			 outline_ss_session_handle (ss),
+			 outline_ss_connect_resolved);
+      ss->dst_name = 0;
+    }
+  else
+    outline_ss_connect (ssm, ss);
+}
+
+/**
+ * @brief The upstream is connected, start relaying
+ *
+ * Runs on the client's thread, the only one that writes the upstream's
+ * tx fifo.
+ */
+static void
+outline_ss_established (outline_ss_main_t *ssm, outline_ss_session_t *ss)
+{
+  ss->upstream_connecting = 0;
+
+  if (ss->client_disconnected)
+    {
+      outline_ss_close_upstream (ssm, ss);
+      return;
+    }
+
+  ss->state = OUTLINE_SS_STATE_ESTABLISHED;
+  if (vec_len (ss->pending))
+    {
+      svm_fifo_enqueue (ss->upstream_tx_fifo, vec_len (ss->pending),
+			ss->pending);
+      session_relay_tx_event (ss->upstream_tx_fifo, ss->upstream_sh);
+    }
+  vec_free (ss->pending);
+
+  /* what the client sent behind its first chunk */
+  if (svm_fifo_max_dequeue (ss->client_rx_fifo))
+    session_program_rx_io_evt (ss->client_sh);
+}
+
+static void
+outline_ss_established_rpc (void *arg)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, pointer_to_uword (arg));
+  if (ss)
+    outline_ss_established (ssm, ss);
+}
+
+static int
+outline_ss_upstream_accept_callback (session_t *s)
+{
+  clib_warning ("outline connect app should not get accept events");
+  return -1;
+}
+
+static int
+outline_ss_upstream_connected_callback (u32 app_index, u32 opaque,
+					session_t *s, session_error_t err)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, opaque);
+  ASSERT (ss);
+
+  if (err)
+    {
+      outline_log_debug ("connection %x connect failed: %U", opaque,
+			 format_session_error, err);
+      outline_ss_connect_failed_on_owner (ssm, ss);
+      return 0;
+    }
+
+  s->opaque = opaque;
+  ss->upstream_sh = session_handle (s);
+  ss->upstream_rx_fifo = s->rx_fifo;
+  ss->upstream_tx_fifo = s->tx_fifo;
+  ss->upstream_thread_index = s->thread_index;
+
+  if (ss->thread_index == s->thread_index)
+    outline_ss_established (ssm, ss);
+  else
+    session_send_rpc_evt_to_thread (ss->thread_index,
+				    outline_ss_established_rpc,
+				    uword_to_pointer (opaque, void *));
+
+  return 0;
+}
+
+static void
+outline_ss_upstream_disconnect_callback (session_t *s)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, s->opaque);
+  if (!ss)
+    return;
+
+  /* what the target sent before it closed still goes to the client */
+  if (!ss->client_disconnected)
+    outline_ss_upstream_drain (ssm, ss, s);
+  outline_ss_close (ssm, ss, 1 /* is_upstream */);
+}
+
+static void
+outline_ss_upstream_transport_closed_callback (session_t *s)
+{
+}
+
+static void
+outline_ss_upstream_reset_callback (session_t *s)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, s->opaque);
+  if (ss)
+    outline_ss_close (ssm, ss, 1 /* is_upstream */);
+}
+
+static int
+outline_ss_upstream_rx_callback (session_t *s)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, s->opaque);
+  if (!ss || ss->client_disconnected)
+    return -1;
+
+  outline_ss_upstream_drain (ssm, ss, s);
+
+  return 0;
+}
+
+/**
+ * @brief The upstream drained its tx fifo, resume decrypting the client
+ */
+static int
+outline_ss_upstream_tx_callback (session_t *s)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  if (!session_relay_tx_ready (s->tx_fifo))
+    return 0;
+
+  ss = outline_ss_session_get (ssm, s->opaque);
+  if (!ss || ss->client_disconnected)
+    return -1;
+
+  session_program_rx_io_evt (ss->client_sh);
+
+  return 0;
+}
+
+static void
+outline_ss_upstream_cleanup_callback (session_t *s, session_cleanup_ntf_t ntf)
+{
+  if (ntf == SESSION_CLEANUP_TRANSPORT)
+    return;
+
+  outline_ss_delete (s, 1 /* is_upstream */);
+}
+
+static session_cb_vft_t outline_ss_upstream_cb_vft = {
+  .session_accept_callback = outline_ss_upstream_accept_callback,
+  .session_connected_callback = outline_ss_upstream_connected_callback,
+  .session_disconnect_callback = outline_ss_upstream_disconnect_callback,
+  .session_transport_closed_callback =
+    outline_ss_upstream_transport_closed_callback,
+  .session_reset_callback = outline_ss_upstream_reset_callback,
+  .builtin_app_rx_callback = outline_ss_upstream_rx_callback,
+  .builtin_app_tx_callback = outline_ss_upstream_tx_callback,
+  .session_cleanup_callback = outline_ss_upstream_cleanup_callback,
+};
+
+/* ========== CLIENT SIDE ========== */
+
+static int
+outline_ss_accept_callback (session_t *s)
+{
+  outline_server_main_t *osm = &outline_server_main;
+  outline_ss_main_t *ssm = &outline_ss_main;
+  transport_connection_t *tc;
+  outline_server_port_t *port;
+  outline_ss_session_t *ss;
+  uword *p;
+
+  tc = session_get_transport (s);
+  p = hash_get (osm->port_by_number, clib_net_to_host_u16 (tc->lcl_port));
+  if (!p)
+    return -1;
+  port = pool_elt_at_index (osm->ports, p[0]);
+
+  ss = outline_ss_session_alloc (ssm, s);
+  ss->port_index = p[0];
+  ss->cipher = port->cipher_id;
+  ss->client_ip = tc->rmt_ip.ip4;
+  s->opaque = outline_ss_session_handle (ss);
+  s->session_state = SESSION_STATE_READY;
+
+  clib_atomic_fetch_add (&osm->stats.total_connections, 1);
+  clib_atomic_fetch_add (&osm->stats.active_connections, 1);
+  clib_atomic_fetch_add (&port->connections, 1);
+  port->last_activity = vlib_time_now (vlib_get_main ());
+
+  return 0;
+}
+
+static int
+outline_ss_connected_callback (u32 app_index, u32 opaque, session_t *s,
+			       session_error_t err)
+{
+  clib_warning ("outline listen app should not get connect events");
+  return -1;
+}
+
+static void
+outline_ss_disconnect_callback (session_t *s)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_wrk_t *wrk;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, s->opaque);
+  if (!ss)
+    return;
+
+  /* what the client sent before it closed still goes to the target */
+  if (ss->state == OUTLINE_SS_STATE_ESTABLISHED)
+    {
+      wrk = outline_ss_wrk_get (ssm, s->thread_index);
+      while (outline_ss_client_decrypt (ssm, wrk, ss, s) > 0)
+	;
+    }
+  outline_ss_close (ssm, ss, 0 /* is_upstream */);
+}
+
+static void
+outline_ss_transport_closed_callback (session_t *s)
+{
+}
+
+static void
+outline_ss_reset_callback (session_t *s)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  ss = outline_ss_session_get (ssm, s->opaque);
+  if (ss)
+    outline_ss_close (ssm, ss, 0 /* is_upstream */);
+}
+
+static int
+outline_ss_rx_callback (session_t *s)
+{
+  if (s->flags & SESSION_F_APP_CLOSED)
+    return 0;
+
+  return outline_ss_client_rx (&outline_ss_main, s);
+}
+
+/**
+ * @brief The client drained its tx fifo, resume encrypting the upstream
+ */
+static int
+outline_ss_tx_callback (session_t *s)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  outline_ss_session_t *ss;
+
+  if (!session_relay_tx_ready (s->tx_fifo))
+    return 0;
+
+  ss = outline_ss_session_get (ssm, s->opaque);
+  if (!ss)
+    return -1;
+  if (ss->state != OUTLINE_SS_STATE_ESTABLISHED || ss->upstream_disconnected)
+    return 0;
+
+  session_program_rx_io_evt (ss->upstream_sh);
+
+  return 0;
+}
+
+static void
+outline_ss_cleanup_callback (session_t *s, session_cleanup_ntf_t ntf)
+{
+  if (ntf == SESSION_CLEANUP_TRANSPORT)
+    return;
+
+  outline_ss_delete (s, 0 /* is_upstream */);
+}
+
+static int
+outline_ss_add_segment_callback (u32 client_index, u64 segment_handle)
+{
+  return 0;
+}
+
+static session_cb_vft_t outline_ss_cb_vft = {
+  .session_accept_callback = outline_ss_accept_callback,
+  .session_connected_callback = outline_ss_connected_callback,
+  .session_disconnect_callback = outline_ss_disconnect_callback,
+  .session_transport_closed_callback = outline_ss_transport_closed_callback,
+  .session_reset_callback = outline_ss_reset_callback,
+  .builtin_app_rx_callback = outline_ss_rx_callback,
+  .builtin_app_tx_callback = outline_ss_tx_callback,
+  .session_cleanup_callback = outline_ss_cleanup_callback,
+  .add_segment_callback = outline_ss_add_segment_callback,
+};
+
+/* ========== SERVER CONTROL ========== */
+
+static int
+outline_ss_attach (char *name, session_cb_vft_t *cb_vft, u64 flags,
+		   u32 *app_index)
+{
+  vnet_app_attach_args_t _a, *a = &_a;
+  u64 options[APP_OPTIONS_N_OPTIONS];
+  session_error_t rv;
+
+  clib_memset (a, 0, sizeof (*a));
+  clib_memset (options, 0, sizeof (options));
+
+  a->api_client_index = APP_INVALID_INDEX;
+  a->name = format (0, "%s", name);
+  a->session_cb_vft = cb_vft;
+  a->options = options;
+  a->options[APP_OPTIONS_SEGMENT_SIZE] = OUTLINE_SS_SEGMENT_SIZE;
+  a->options[APP_OPTIONS_ADD_SEGMENT_SIZE] = OUTLINE_SS_SEGMENT_SIZE;
+  a->options[APP_OPTIONS_RX_FIFO_SIZE] = OUTLINE_SS_FIFO_SIZE;
+  a->options[APP_OPTIONS_TX_FIFO_SIZE] = OUTLINE_SS_FIFO_SIZE;
+  a->options[APP_OPTIONS_FLAGS] = APP_OPTIONS_FLAGS_IS_BUILTIN | flags;
+
+  rv = vnet_application_attach (a);
+  vec_free (a->name);
+  if (rv)
+    {
+      outline_log_err ("%s attach returned: %U", name, format_session_error,
+		       rv);
+      return rv;
+    }
+
+  *app_index = a->app_index;
+  return 0;
+}
+
+static void
+outline_ss_detach (u32 *app_index)
+{
+  vnet_app_detach_args_t _a = { 0 }, *a = &_a;
+
+  if (*app_index == APP_INVALID_INDEX)
+    return;
+
+  a->app_index = *app_index;
+  a->api_client_index = APP_INVALID_INDEX;
+  vnet_application_detach (a);
+  *app_index = APP_INVALID_INDEX;
+}
+
+clib_error_t *
+outline_ss_port_listen (outline_server_port_t *port)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  vnet_listen_args_t _a, *a = &_a;
+  session_error_t rv;
+
+  if (!ssm->is_running || port->listener_handle != SESSION_INVALID_HANDLE)
+    return 0;
+
+  clib_memset (a, 0, sizeof (*a));
+  a->app_index = ssm->app_index;
+  a->sep_ext = (session_endpoint_cfg_t) SESSION_ENDPOINT_CFG_NULL;
+  a->sep_ext.transport_proto = TRANSPORT_PROTO_TCP;
+  a->sep_ext.is_ip4 = 1;
+  a->sep_ext.port = clib_host_to_net_u16 (port->port);
+
+  if ((rv = vnet_listen (a)))
+    return clib_error_return (0, "listen on port %d returned: %U", port->port,
+			      format_session_error, rv);
+
+  port->listener_handle = a->handle;
+  return 0;
+}
+
+void
+outline_ss_port_unlisten (outline_server_port_t *port)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+  vnet_unlisten_args_t _a = { 0 }, *a = &_a;
+
+  if (port->listener_handle == SESSION_INVALID_HANDLE)
+    return;
+
+  if (ssm->is_running)
+    {
+      a->handle = port->listener_handle;
+      a->app_index = ssm->app_index;
+      vnet_unlisten (a);
+    }
+  port->listener_handle = SESSION_INVALID_HANDLE;
+}
+
+/**
+ * @brief Start serving the configured ports
+ */
+clib_error_t *
+outline_ss_start (void)
+{
+  outline_server_main_t *osm = &outline_server_main;
+  outline_ss_main_t *ssm = &outline_ss_main;
+  vlib_main_t *vm = vlib_get_main ();
+  session_enable_disable_args_t args = {
+    .is_en = 1,
+    .rt_engine_type = RT_BACKEND_ENGINE_RULE_TABLE,
+  };
+  outline_server_port_t *port;
+  clib_error_t *error = 0;
+  outline_ss_ip_cache_entry_t *e;
+  outline_ss_wrk_t *wrk;
+
+  if (ssm->is_running)
+    return clib_error_return (0, "native server is already running");
+
+  vlib_worker_thread_barrier_sync (vm);
+  vnet_session_enable_disable (vm, &args);
+  vlib_worker_thread_barrier_release (vm);
+
+  /* domain names need the dns plugin, without it they are unreachable */
+  if (!ssm->resolver.dns_resolve_name_ptr)
+    ssm->resolver.dns_resolve_name_ptr =
+      vlib_get_plugin_symbol ("dns_plugin.so", "dns_resolve_name");
+  if (!ssm->resolver.dns_resolve_name_ptr)
+    outline_log_warn ("dns plugin not loaded, domain names cannot be "
+		      "resolved");
+  ssm->resolver.process_node_index = outline_server_process_node.index;
+  ssm->resolver.process_event = OUTLINE_SS_EVENT_RESOLVE;
+  ssm->resolver.timeout = OUTLINE_SS_RESOLVE_TIMEOUT;
+
+  vec_validate_aligned (ssm->workers, vlib_get_n_threads () - 1,
+			CLIB_CACHE_LINE_BYTES);
+  vec_foreach (wrk, ssm->workers)
+    {
+      vec_validate_aligned (wrk->buf, OUTLINE_SS_BUF_SIZE - 1,
+			    CLIB_CACHE_LINE_BYTES);
+      wrk->trial_ctx = EVP_CIPHER_CTX_new ();
+
+      vec_validate (wrk->ip_cache, OUTLINE_SS_IP_CACHE_SIZE - 1);
+      vec_foreach (e, wrk->ip_cache)
+	e->key_index = ~0;
+    }
+
+  clib_spinlock_init (&ssm->replay_lock);
+  ssm->replay_hash = hash_create (0, sizeof (uword));
+  ssm->replay_next = 0;
+  if (osm->config.replay_history)
+    vec_validate (ssm->replay_ring, osm->config.replay_history - 1);
+
+  ssm->app_index = ssm->connect_app_index = APP_INVALID_INDEX;
+  if (outline_ss_attach ("outline-ss", &outline_ss_cb_vft,
+			 APP_OPTIONS_FLAGS_USE_GLOBAL_SCOPE,
+			 &ssm->app_index) ||
+      outline_ss_attach ("outline-ss-connect", &outline_ss_upstream_cb_vft,
+			 APP_OPTIONS_FLAGS_USE_GLOBAL_SCOPE,
+			 &ssm->connect_app_index))
+    {
+      error = clib_error_return (0, "session layer attach failed");
+      goto error;
+    }
+
+  ssm->is_running = 1;
+
+  pool_foreach (port, osm->ports)
+    {
+      if (!port->is_active)
+	continue;
+      if ((error = outline_ss_port_listen (port)))
+	goto error;
+    }
+
+  outline_log_info ("Native server started on %d port(s)",
+		    pool_elts (osm->ports));
+  return 0;
+
+error:
+  outline_ss_stop ();
+  return error;
+}
+
+/**
+ * @brief Stop serving
+ *
+ * Connections go with the applications, and with them every callback
+ * that could refer to the server's state.
+ */
+void
+outline_ss_stop (void)
+{
+  outline_server_main_t *osm = &outline_server_main;
+  outline_ss_main_t *ssm = &outline_ss_main;
+  vlib_main_t *vm = vlib_get_main ();
+  outline_server_port_t *port;
+  outline_ss_key_order_t *ko;
+  outline_ss_wrk_t *wrk;
+
+  pool_foreach (port, osm->ports)
+    outline_ss_port_unlisten (port);
+
+  vlib_worker_thread_barrier_sync (vm);
+
+  outline_ss_detach (&ssm->connect_app_index);
+  outline_ss_detach (&ssm->app_index);
+  ssm->is_running = 0;
+
+  vec_foreach (wrk, ssm->workers)
+    {
+      pool_free (wrk->sessions);
+      EVP_CIPHER_CTX_free (wrk->trial_ctx);
+      wrk->trial_ctx = 0;
+
+      vec_free (wrk->ip_cache);
+      vec_foreach (ko, wrk->key_orders)
+	{
+	  vec_free (ko->key_indices);
+	  vec_free (ko->keys);
+	}
+      vec_free (wrk->key_orders);
+      vec_free (wrk->key_by_index);
+      clib_bitmap_free (wrk->key_bitmap);
+    }
+
+  hash_free (ssm->replay_hash);
+  vec_free (ssm->replay_ring);
+  clib_spinlock_free (&ssm->replay_lock);
+
+  vlib_worker_thread_barrier_release (vm);
+
+  outline_log_info ("Native server stopped");
+}
+
+static uword
+outline_server_process (vlib_main_t *vm, vlib_node_runtime_t *rt,
+			vlib_frame_t *f)
+{
+  outline_ss_main_t *ssm = &outline_ss_main;
+
+  while (1)
+    {
+      /* new names signal us, those in flight are polled */
+      if (vec_len (ssm->resolver.pending))
+	vlib_process_wait_for_event_or_clock (vm, OUTLINE_SS_RESOLVE_POLL);
+      else
+	vlib_process_wait_for_event (vm);
+      vlib_process_get_events (vm, 0);
+
+      dns_cache_resolve_poll (&ssm->resolver, vlib_time_now (vm));
+    }
+
+  return 0;
+}
+
+VLIB_REGISTER_NODE (outline_server_process_node) = {
+  .function = outline_server_process,
+  .type = VLIB_NODE_TYPE_PROCESS,
+  .name = "outline-server-process",
+};
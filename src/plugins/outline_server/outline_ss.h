@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2024 Internet Mastering & Company
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file outline_ss.h
+ * @brief Native Shadowsocks AEAD server
+ *
+ * Serves the configured ports from VPP's host stack instead of the
+ * outline-ss-server process. Each client connection is decrypted on its
+ * own thread and relayed to its destination, with chunk crypto batched
+ * through vnet_crypto.
+ */
+
+#ifndef __OUTLINE_SS_H__
+#define __OUTLINE_SS_H__
+
+#include <vnet/session/session.h>
+#include <vnet/crypto/crypto.h>
+#include <plugins/dns/dns_cache_resolve.h>
+
+#include <openssl/evp.h>
+
+#include "outline_server.h"
+
+#define OUTLINE_SS_TAG_LEN	16
+#define OUTLINE_SS_NONCE_LEN	12
+#define OUTLINE_SS_MAX_KEY_LEN	OUTLINE_SERVER_KEY_LEN_MAX
+#define OUTLINE_SS_MAX_PAYLOAD	0x3fff
+
+/* encrypted length field and its tag */
+#define OUTLINE_SS_LEN_SIZE (2 + OUTLINE_SS_TAG_LEN)
+
+/* a full chunk on the wire */
+#define OUTLINE_SS_CHUNK_SIZE                                                 \
+  (OUTLINE_SS_LEN_SIZE + OUTLINE_SS_MAX_PAYLOAD + OUTLINE_SS_TAG_LEN)
+
+/* chunks handed to the crypto engine at once, per direction */
+#define OUTLINE_SS_BATCH 16
+
+#define OUTLINE_SS_BUF_SIZE (OUTLINE_SS_BATCH * OUTLINE_SS_CHUNK_SIZE)
+
+/* client addresses remembered per thread, with the key they used */
+#define OUTLINE_SS_IP_CACHE_SIZE 4096
+
+#define OUTLINE_SS_FIFO_SIZE	(128 << 10)
+#define OUTLINE_SS_SEGMENT_SIZE (256 << 20)
+
+/* longest target address: type, length, 255 byte name, port */
+#define OUTLINE_SS_ADDR_MAX (1 + 1 + 255 + 2)
+
+#define OUTLINE_SS_ATYP_IPV4	   0x01
+#define OUTLINE_SS_ATYP_DOMAINNAME 0x03
+#define OUTLINE_SS_ATYP_IPV6	   0x04
+
+#define OUTLINE_SS_SESSION_INDEX_BITS 24
+#define OUTLINE_SS_SESSION_INDEX_MASK ((1 << OUTLINE_SS_SESSION_INDEX_BITS) - 1)
+
+/* seconds between dns cache polls, and until a name is given up on */
+#define OUTLINE_SS_RESOLVE_POLL	   0.1
+#define OUTLINE_SS_RESOLVE_TIMEOUT 5.0
+
+/* cipher, name, key and salt length, vnet_crypto algorithm, EVP cipher */
+#define foreach_outline_ss_cipher                                             \
+  _ (CHACHA20_POLY1305, "chacha20-ietf-poly1305", 32, CHACHA20_POLY1305,      \
+     chacha20_poly1305)                                                       \
+  _ (AES_256_GCM, "aes-256-gcm", 32, AES_256_GCM, aes_256_gcm)               \
+  _ (AES_192_GCM, "aes-192-gcm", 24, AES_192_GCM, aes_192_gcm)               \
+  _ (AES_128_GCM, "aes-128-gcm", 16, AES_128_GCM, aes_128_gcm)
+
+typedef enum
+{
+  OUTLINE_SS_CIPHER_NONE,
+#define _(n, s, l, a, e) OUTLINE_SS_CIPHER_##n,
+  foreach_outline_ss_cipher
+#undef _
+    OUTLINE_SS_N_CIPHERS,
+} outline_ss_cipher_t;
+
+typedef struct
+{
+  char *name;
+  u8 key_len;
+  vnet_crypto_alg_t alg;
+  vnet_crypto_op_id_t enc_op;
+  vnet_crypto_op_id_t dec_op;
+  const EVP_CIPHER *(*evp_cipher) (void);
+} outline_ss_cipher_info_t;
+
+/**
+ * @brief An access key as connections see it
+ *
+ * Held by its key, the key table of its port and every connection
+ * identified with it; freed with the last of them. The master key is
+ * double buffered, a password change never shows a torn one.
+ */
+typedef struct outline_ss_key
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  u32 n_refs;
+  u32 key_index; /* in outline_server_main.keys, while it is there */
+  u8 master_key_slot;
+  u64 data_limit;
+  u8 master_keys[2][OUTLINE_SS_MAX_KEY_LEN];
+
+  /* bumped by every thread relaying for the key */
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline1);
+  u64 data_used;
+} outline_ss_key_t;
+
+/**
+ * @brief A port's keys, replaced as a whole on every change
+ */
+typedef struct outline_ss_key_table
+{
+  u32 version;
+  outline_ss_key_t **keys;
+} outline_ss_key_table_t;
+
+typedef enum
+{
+  OUTLINE_SS_STATE_SALT,       /* waiting for the salt and first length */
+  OUTLINE_SS_STATE_KEYING,     /* waiting for main to add our keys */
+  OUTLINE_SS_STATE_ADDRESS,    /* decrypting the target address */
+  OUTLINE_SS_STATE_CONNECTING, /* resolving or connecting the target */
+  OUTLINE_SS_STATE_ESTABLISHED,
+  OUTLINE_SS_STATE_CLOSED,     /* closing, or draining an unknown client */
+} outline_ss_state_t;
+
+/**
+ * @brief A client connection and its upstream
+ *
+ * Owned by the client's thread. Client to upstream is decrypted there;
+ * upstream to client is encrypted on the upstream session's thread,
+ * which only touches the fields of its own cache line.
+ */
+typedef struct
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  u32 session_index;
+  u32 thread_index;
+  u32 n_refs;
+  outline_ss_state_t state;
+
+  session_handle_t client_sh;
+  session_handle_t upstream_sh;
+  svm_fifo_t *client_rx_fifo;
+  svm_fifo_t *client_tx_fifo;
+  svm_fifo_t *upstream_rx_fifo;
+  svm_fifo_t *upstream_tx_fifo;
+  u32 upstream_thread_index;
+  u8 client_disconnected;
+  u8 upstream_disconnected;
+  u8 upstream_connecting;
+  u8 cipher;
+
+  /* a side that goes first leaves its fifos to the other, which may
+   * still write to them, until both are done */
+  u8 client_fifos_held;
+  u8 upstream_fifos_held;
+
+  u32 port_index;
+  outline_ss_key_t *key;
+  ip4_address_t client_ip;
+
+  /* target */
+  ip46_address_t dst_ip;
+  u16 dst_port;
+  u8 dst_is_ip4;
+  u8 *dst_name;
+
+  /* client to upstream, on the client's thread */
+  vnet_crypto_key_index_t dec_key_index;
+  u64 dec_nonce;
+  u16 dec_chunk_len;
+  u8 *pending;
+
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline1);
+
+  /* upstream to client, on the upstream's thread */
+  vnet_crypto_key_index_t enc_key_index;
+  u64 enc_nonce;
+  u8 salt_sent;
+  u8 enc_salt[OUTLINE_SS_MAX_KEY_LEN];
+} outline_ss_session_t;
+
+/**
+ * @brief Key a client address used last
+ */
+typedef struct
+{
+  ip4_address_t ip;
+  u32 key_index;
+} outline_ss_ip_cache_entry_t;
+
+/**
+ * @brief A port's keys, in the order a thread tries them
+ *
+ * Most recently identified first. Rebuilt from the key table when that
+ * changes, the key indices tell which of the keys are still there.
+ */
+typedef struct
+{
+  u32 version;
+  u32 *key_indices;
+  outline_ss_key_t **keys;
+} outline_ss_key_order_t;
+
+typedef struct
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  outline_ss_session_t *sessions;
+
+  /* identification of new clients */
+  outline_ss_ip_cache_entry_t *ip_cache;
+  outline_ss_key_order_t *key_orders; /* by port index */
+  uword *key_bitmap;
+  outline_ss_key_t **key_by_index;
+
+  /* trial decryptions, keyed anew for every one */
+  EVP_CIPHER_CTX *trial_ctx;
+
+  /* scratch for one batch of chunks */
+  vnet_crypto_op_t ops[2 * OUTLINE_SS_BATCH];
+  u8 ivs[2 * OUTLINE_SS_BATCH][OUTLINE_SS_NONCE_LEN];
+  svm_fifo_seg_t segs[OUTLINE_SS_BATCH + 1];
+  u8 *buf;
+} outline_ss_wrk_t;
+
+typedef struct
+{
+  outline_ss_wrk_t *workers;
+
+  u32 app_index;
+  u32 connect_app_index;
+  u8 is_running;
+
+  /* salts seen lately, oldest first out */
+  clib_spinlock_t replay_lock;
+  uword *replay_hash;
+  u64 *replay_ring;
+  u32 replay_next;
+
+  /* target names, looked up in the dns plugin's cache */
+  dns_cache_resolver_t resolver;
+} outline_ss_main_t;
+
+extern outline_ss_main_t outline_ss_main;
+extern const outline_ss_cipher_info_t outline_ss_ciphers[];
+
+static inline u32
+outline_ss_session_handle (outline_ss_session_t *ss)
+{
+  return ss->thread_index << OUTLINE_SS_SESSION_INDEX_BITS |
+	 ss->session_index;
+}
+
+static inline outline_ss_wrk_t *
+outline_ss_wrk_get (outline_ss_main_t *ssm, u32 thread_index)
+{
+  return vec_elt_at_index (ssm->workers, thread_index);
+}
+
+outline_ss_cipher_t outline_ss_cipher_by_name (u8 *name);
+
+outline_ss_key_t *outline_ss_key_alloc (u32 key_index);
+void outline_ss_key_set (outline_ss_key_t *k, u8 *password, u8 cipher,
+			 u64 data_limit);
+void outline_ss_key_put (outline_ss_key_t *k);
+void outline_ss_port_key_add (outline_server_port_t *port,
+			      outline_ss_key_t *k);
+void outline_ss_port_key_del (outline_server_port_t *port,
+			      outline_ss_key_t *k);
+void outline_ss_port_keys_free (outline_server_port_t *port);
+
+clib_error_t *outline_ss_start (void);
+void outline_ss_stop (void);
+clib_error_t *outline_ss_port_listen (outline_server_port_t *port);
+void outline_ss_port_unlisten (outline_server_port_t *port);
+
+#endif /* __OUTLINE_SS_H__ */
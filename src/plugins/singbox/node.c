@@ -18,7 +18,9 @@
  * @brief Sing-box Plugin - Graph Node Implementation
  *
  * This file implements the packet processing graph node for the sing-box plugin.
- * It processes IPv4 packets and prepares them for redirection to a sing-box proxy.
+ * TCP flows arriving on enabled interfaces are steered into the host stack,
+ * where redirect.c terminates them and splices them to the sing-box proxy.
+ * Everything else continues along the feature arc.
  */
 
 #include <vlib/vlib.h>
@@ -26,6 +28,7 @@
 #include <vnet/pg/pg.h>
 #include <vnet/ip/ip.h>
 #include <vnet/ethernet/ethernet.h>
+#include <vnet/tcp/tcp_inlines.h>
 #include <vppinfra/error.h>
 #include <singbox/singbox.h>
 
@@ -57,9 +60,10 @@ format_singbox_trace (u8 *s, va_list *args)
 
 extern vlib_node_registration_t singbox_node;
 
-#define foreach_singbox_error                    \
-_(REDIRECTED, "Packets redirected to sing-box")  \
-_(NO_CONFIG, "No sing-box config for interface") \
+#define foreach_singbox_error                            \
+_(REDIRECTED, "Packets redirected to sing-box")          \
+_(PASSTHROUGH, "Packets not part of a redirected flow") \
+_(NO_CONFIG, "No sing-box config for interface")         \
 _(DISABLED, "Sing-box disabled on interface")
 
 typedef enum
@@ -80,17 +84,92 @@ typedef enum
 {
   SINGBOX_NEXT_IP4_LOOKUP,
   SINGBOX_NEXT_DROP,
+  SINGBOX_NEXT_TCP_INPUT,
+  SINGBOX_NEXT_TCP_INPUT_NOLOOKUP,
+  SINGBOX_NEXT_TCP_LISTEN,
   SINGBOX_N_NEXT,
 } singbox_next_t;
 
 /**
- * @brief Process packets and redirect to sing-box
+ * @brief Steer a packet into the host stack if its flow is redirected
  *
- * This is a simple implementation that marks packets for redirection.
- * In a production implementation, you would:
- * 1. Encapsulate packets in SOCKS5 protocol
- * 2. Rewrite destination to proxy address
- * 3. Handle connection management
+ * Segments of connections the session layer already knows go straight
+ * to tcp, reusing this lookup. SYNs that match no connection are handed
+ * to the wildcard redirect listener, and their rx interface is noted for
+ * the accept, which tcp runs on this thread. Connections to the proxy
+ * itself are never redirected.
+ *
+ * @return 1 if the packet was steered, 0 to let it continue on the arc
+ */
+static_always_inline int
+singbox_redirect_tcp4 (singbox_main_t *sm, singbox_wrk_t *wrk,
+                       singbox_interface_config_t *config, vlib_buffer_t *b,
+                       u32 sw_if_index, u32 now, u32 *next)
+{
+  ip4_header_t *ip = vlib_buffer_get_current (b);
+  clib_bihash_kv_16_8_t kv;
+  transport_connection_t *tc;
+  tcp_header_t *tcp;
+  u32 error = 0;
+  u8 result = 0;
+
+  if (ip->protocol != IP_PROTOCOL_TCP || sm->redirect_listener_index == ~0)
+    return 0;
+
+  ip_lookup_set_buffer_fib_index (ip4_main.fib_index_by_sw_if_index, b);
+  tcp = ip4_next_header (ip);
+  tc = session_lookup_connection_wt4 (
+    vnet_buffer (b)->ip.fib_index, &ip->dst_address, &ip->src_address,
+    tcp->dst_port, tcp->src_port, TRANSPORT_PROTO_TCP,
+    vlib_get_thread_index (), &result);
+
+  if (tc && result == 0)
+    {
+      switch (((tcp_connection_t *) tc)->state)
+        {
+        case TCP_STATE_LISTEN:
+          /* local listener, only its SYNs are ours to deliver */
+          if (!tcp_syn (tcp))
+            return 0;
+          *next = SINGBOX_NEXT_TCP_INPUT;
+          break;
+        case TCP_STATE_SYN_SENT:
+          *next = SINGBOX_NEXT_TCP_INPUT;
+          break;
+        default:
+          *next = SINGBOX_NEXT_TCP_INPUT_NOLOOKUP;
+          vnet_buffer (b)->tcp.connection_index = tc->c_index;
+          break;
+        }
+      return 1;
+    }
+
+  if (!tcp_syn (tcp))
+    return 0;
+
+  if (ip->dst_address.as_u32 == config->endpoint.proxy_addr.as_u32 &&
+      tcp->dst_port == clib_host_to_net_u16 (config->endpoint.proxy_port))
+    return 0;
+
+  /* force parsing of buffer in preparation for tcp-listen */
+  tcp_input_lookup_buffer (b, vlib_get_thread_index (), &error, 1 /* is_ip4 */,
+                           1 /* is_nolookup */);
+  if (error)
+    return 0;
+
+  singbox_syn_key (&kv, &ip->src_address, &ip->dst_address, tcp->src_port,
+                   tcp->dst_port);
+  kv.value = (u64) now << 32 | sw_if_index;
+  clib_bihash_add_del_16_8 (&wrk->syn_interfaces, &kv, 1 /* is_add */);
+
+  vnet_buffer (b)->tcp.connection_index = sm->redirect_listener_index;
+  vnet_buffer (b)->tcp.flags = TCP_STATE_LISTEN;
+  *next = SINGBOX_NEXT_TCP_LISTEN;
+  return 1;
+}
+
+/**
+ * @brief Redirect TCP flows on enabled interfaces to sing-box
  */
 VLIB_NODE_FN (singbox_node)
 (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame)
@@ -98,7 +177,11 @@ VLIB_NODE_FN (singbox_node)
   u32 n_left_from, *from, *to_next;
   singbox_next_t next_index;
   singbox_main_t *sm = &singbox_main;
+  singbox_wrk_t *wrk = singbox_wrk_get (sm, vm->thread_index);
+  singbox_wrk_interface_t *wi;
+  u32 now = (u32) vlib_time_now (vm);
   u32 pkts_redirected = 0;
+  u32 pkts_passthrough = 0;
   u32 pkts_no_config = 0;
   u32 pkts_disabled = 0;
 
@@ -120,7 +203,6 @@ VLIB_NODE_FN (singbox_node)
           u32 next1 = SINGBOX_NEXT_IP4_LOOKUP;
           u32 sw_if_index0, sw_if_index1;
           singbox_interface_config_t *config0, *config1;
-          ip4_header_t *ip0, *ip1;
 
           /* Prefetch next iteration */
           {
@@ -157,22 +239,20 @@ VLIB_NODE_FN (singbox_node)
           /* Process packet 0 */
           if (config0 && config0->endpoint.is_enabled)
             {
-              ip0 = vlib_buffer_get_current (b0);
-
-              /* Update statistics */
-              config0->packets_redirected++;
-              config0->bytes_redirected += vlib_buffer_length_in_chain (vm, b0);
-              pkts_redirected++;
-
-              /*
-               * In a full implementation, you would:
-               * 1. Encapsulate in SOCKS5 protocol
-               * 2. Rewrite IP header to proxy address
-               * 3. Update checksums
-               *
-               * For now, we just mark it and pass to IP lookup
-               */
-              next0 = SINGBOX_NEXT_IP4_LOOKUP;
+              if (singbox_redirect_tcp4 (sm, wrk, config0, b0, sw_if_index0,
+                                         now, &next0))
+                {
+                  /* Update statistics */
+                  wi = vec_elt_at_index (wrk->interfaces, sw_if_index0);
+                  wi->packets_redirected++;
+                  wi->bytes_redirected += vlib_buffer_length_in_chain (vm, b0);
+                  pkts_redirected++;
+                }
+              else
+                {
+                  vnet_feature_next (&next0, b0);
+                  pkts_passthrough++;
+                }
             }
           else
             {
@@ -180,20 +260,26 @@ VLIB_NODE_FN (singbox_node)
                 pkts_disabled++;
               else
                 pkts_no_config++;
-              next0 = SINGBOX_NEXT_IP4_LOOKUP;
+              vnet_feature_next (&next0, b0);
             }
 
           /* Process packet 1 */
           if (config1 && config1->endpoint.is_enabled)
             {
-              ip1 = vlib_buffer_get_current (b1);
-
-              /* Update statistics */
-              config1->packets_redirected++;
-              config1->bytes_redirected += vlib_buffer_length_in_chain (vm, b1);
-              pkts_redirected++;
-
-              next1 = SINGBOX_NEXT_IP4_LOOKUP;
+              if (singbox_redirect_tcp4 (sm, wrk, config1, b1, sw_if_index1,
+                                         now, &next1))
+                {
+                  /* Update statistics */
+                  wi = vec_elt_at_index (wrk->interfaces, sw_if_index1);
+                  wi->packets_redirected++;
+                  wi->bytes_redirected += vlib_buffer_length_in_chain (vm, b1);
+                  pkts_redirected++;
+                }
+              else
+                {
+                  vnet_feature_next (&next1, b1);
+                  pkts_passthrough++;
+                }
             }
           else
             {
@@ -201,7 +287,7 @@ VLIB_NODE_FN (singbox_node)
                 pkts_disabled++;
               else
                 pkts_no_config++;
-              next1 = SINGBOX_NEXT_IP4_LOOKUP;
+              vnet_feature_next (&next1, b1);
             }
 
           /* Tracing */
@@ -249,7 +335,6 @@ VLIB_NODE_FN (singbox_node)
           u32 next0 = SINGBOX_NEXT_IP4_LOOKUP;
           u32 sw_if_index0;
           singbox_interface_config_t *config0;
-          ip4_header_t *ip0;
 
           /* speculatively enqueue b0 to the current next frame */
           bi0 = from[0];
@@ -268,14 +353,20 @@ VLIB_NODE_FN (singbox_node)
           /* Process packet */
           if (config0 && config0->endpoint.is_enabled)
             {
-              ip0 = vlib_buffer_get_current (b0);
-
-              /* Update statistics */
-              config0->packets_redirected++;
-              config0->bytes_redirected += vlib_buffer_length_in_chain (vm, b0);
-              pkts_redirected++;
-
-              next0 = SINGBOX_NEXT_IP4_LOOKUP;
+              if (singbox_redirect_tcp4 (sm, wrk, config0, b0, sw_if_index0,
+                                         now, &next0))
+                {
+                  /* Update statistics */
+                  wi = vec_elt_at_index (wrk->interfaces, sw_if_index0);
+                  wi->packets_redirected++;
+                  wi->bytes_redirected += vlib_buffer_length_in_chain (vm, b0);
+                  pkts_redirected++;
+                }
+              else
+                {
+                  vnet_feature_next (&next0, b0);
+                  pkts_passthrough++;
+                }
             }
           else
             {
@@ -283,7 +374,7 @@ VLIB_NODE_FN (singbox_node)
                 pkts_disabled++;
               else
                 pkts_no_config++;
-              next0 = SINGBOX_NEXT_IP4_LOOKUP;
+              vnet_feature_next (&next0, b0);
             }
 
           /* Tracing */
@@ -312,6 +403,8 @@ VLIB_NODE_FN (singbox_node)
 
   vlib_node_increment_counter (vm, singbox_node.index,
                               SINGBOX_ERROR_REDIRECTED, pkts_redirected);
+  vlib_node_increment_counter (vm, singbox_node.index,
+                              SINGBOX_ERROR_PASSTHROUGH, pkts_passthrough);
   vlib_node_increment_counter (vm, singbox_node.index,
                               SINGBOX_ERROR_NO_CONFIG, pkts_no_config);
   vlib_node_increment_counter (vm, singbox_node.index,
@@ -335,5 +428,8 @@ VLIB_REGISTER_NODE (singbox_node) = {
   .next_nodes = {
     [SINGBOX_NEXT_IP4_LOOKUP] = "ip4-lookup",
     [SINGBOX_NEXT_DROP] = "error-drop",
+    [SINGBOX_NEXT_TCP_INPUT] = "tcp4-input",
+    [SINGBOX_NEXT_TCP_INPUT_NOLOOKUP] = "tcp4-input-nolookup",
+    [SINGBOX_NEXT_TCP_LISTEN] = "tcp4-listen",
   },
 };
@@ -0,0 +1,1235 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * @brief Sing-box Plugin - Transparent TCP Redirection
+ *
+ * The singbox node hands new TCP flows on enabled interfaces to a
+ * wildcard listener, so they are terminated by VPP's host stack. Every
+ * accepted flow gets a connection to the interface's sing-box endpoint.
+ * Its SOCKS5 handshake is written into the shared fifo ahead of the
+ * client's data, so it costs no round trips beyond the TCP connect.
+ *
+ * The proxy session reuses the client session's fifos, swapped: whatever
+ * one transport receives is what the other transmits. Once the handshake
+ * replies are dropped from the fifo, payload moves between the two
+ * connections without being copied or leaving VPP.
+ *
+ * A sing-box session belongs to the thread of its client connection,
+ * which alone allocates and frees it. The proxy connection may land on
+ * another thread; that side only reads the session and flips flags that
+ * are set once, and each side holds a reference until its cleanup.
+ */
+
+#include <vnet/session/session.h>
+#include <vnet/session/application.h>
+#include <vnet/session/application_interface.h>
+#include <vnet/tcp/tcp.h>
+#include <singbox/singbox.h>
+#include <vnet/session/session_relay.h>
+
+#include <vppinfra/bihash_16_8.h>
+#include <vppinfra/bihash_template.c>
+
+#define SINGBOX_REDIRECT_FIFO_SIZE    (64 << 10)
+#define SINGBOX_REDIRECT_SEGMENT_SIZE (128 << 20)
+
+/* accepted session opaque: flow took a connection from the pool */
+#define SINGBOX_REDIRECT_OPAQUE_WARM (1u << 31)
+
+/* connect api_context: pool connection for the sw_if_index below */
+#define SINGBOX_REDIRECT_CONNECT_POOL (1u << 31)
+
+/* seconds between pool refills and expiry scans */
+#define SINGBOX_POOL_PERIOD 1.0
+
+/* seconds a noted SYN is kept, as long as tcp waits for the handshake */
+#define SINGBOX_REDIRECT_SYN_TIMEOUT 60
+
+#define SINGBOX_REDIRECT_SYN_BUCKETS 1024
+#define SINGBOX_REDIRECT_SYN_MEMORY  (8 << 20)
+
+static singbox_session_t *
+singbox_redirect_session_get (singbox_main_t *sm, u32 handle)
+{
+  if (handle == ~0)
+    return NULL;
+  return singbox_session_get_w_handle (sm, handle);
+}
+
+static void
+singbox_redirect_count_failure (singbox_main_t *sm, u32 sw_if_index)
+{
+  singbox_wrk_interface_t *wi;
+
+  wi = singbox_wrk_interface_get (
+    singbox_wrk_get (sm, vlib_get_thread_index ()), sw_if_index);
+  if (wi)
+    wi->connection_failures++;
+}
+
+/**
+ * @brief Take the interface a client flow arrived on
+ *
+ * Accepted connections do not record their rx interface. The singbox
+ * node noted it when it steered the flow's SYN here, on the thread that
+ * accepts the flow.
+ *
+ * @return the sw_if_index, ~0 if the SYN was not seen
+ */
+static u32
+singbox_redirect_client_sw_if_index (singbox_main_t *sm,
+                                     transport_connection_t *tc)
+{
+  singbox_wrk_t *wrk = singbox_wrk_get (sm, tc->thread_index);
+  clib_bihash_kv_16_8_t kv;
+
+  singbox_syn_key (&kv, &tc->rmt_ip.ip4, &tc->lcl_ip.ip4, tc->rmt_port,
+                   tc->lcl_port);
+  if (clib_bihash_search_16_8 (&wrk->syn_interfaces, &kv, &kv))
+    return ~0;
+  clib_bihash_add_del_16_8 (&wrk->syn_interfaces, &kv, 0 /* is_add */);
+  return (u32) kv.value;
+}
+
+static void
+singbox_redirect_close_client (singbox_main_t *sm, singbox_session_t *ss)
+{
+  vnet_disconnect_args_t _a = { 0 }, *a = &_a;
+  session_error_t rv;
+
+  /* both sides may try, only the first one disconnects */
+  if (clib_atomic_swap_acq_n (&ss->client_disconnected, 1))
+    return;
+
+  a->handle = ss->client_session_handle;
+  a->app_index = sm->redirect_app_index;
+  rv = vnet_disconnect_session (a);
+  if (rv && sm->verbose)
+    clib_warning ("session %u client disconnect returned: %U",
+                  ss->session_index, format_session_error, rv);
+}
+
+static void
+singbox_redirect_close_proxy (singbox_main_t *sm, singbox_session_t *ss)
+{
+  vnet_disconnect_args_t _a = { 0 }, *a = &_a;
+  session_error_t rv;
+
+  if (clib_atomic_swap_acq_n (&ss->proxy_disconnected, 1))
+    return;
+
+  a->handle = ss->proxy_session_handle;
+  a->app_index = sm->app_index;
+  rv = vnet_disconnect_session (a);
+  if (rv && sm->verbose)
+    clib_warning ("session %u proxy disconnect returned: %U",
+                  ss->session_index, format_session_error, rv);
+}
+
+static void
+singbox_redirect_free_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_redirect_session_get (sm, pointer_to_uword (arg));
+  ASSERT (ss);
+  singbox_session_free (sm, ss);
+}
+
+/**
+ * @brief Drop a side's reference, the last one frees the session
+ */
+static void
+singbox_redirect_put (singbox_main_t *sm, singbox_session_t *ss)
+{
+  if (clib_atomic_sub_fetch (&ss->n_refs, 1))
+    return;
+
+  if (ss->thread_index == vlib_get_thread_index ())
+    singbox_session_free (sm, ss);
+  else
+    session_send_rpc_evt_to_thread (
+      ss->thread_index, singbox_redirect_free_rpc,
+      uword_to_pointer (singbox_session_handle (ss), void *));
+}
+
+/**
+ * @brief Stop counting a pooled connection as pending
+ *
+ * Pooled connections are pending until the proxy answers the greeting,
+ * whether that ends in the pool or in an error.
+ */
+static void
+singbox_redirect_pool_settle (singbox_main_t *sm, singbox_session_t *ss)
+{
+  singbox_interface_config_t *config;
+
+  if (!ss->is_pooled || ss->state != SINGBOX_STATE_SOCKS5_GREETING)
+    return;
+  config = singbox_get_interface_config (sm, ss->sw_if_index);
+  if (config)
+    clib_atomic_fetch_sub (&config->pool_pending, 1);
+}
+
+static void
+singbox_redirect_close (session_t *s, u8 is_proxy)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_redirect_session_get (sm, s->opaque);
+  if (!ss)
+    return;
+
+  /* No half-close: whichever side goes first takes the other with it */
+  singbox_redirect_pool_settle (sm, ss);
+  ss->state = SINGBOX_STATE_CLOSED;
+  if (ss->is_pooled)
+    {
+      singbox_session_remove_from_pool (sm, ss);
+      singbox_redirect_close_proxy (sm, ss);
+    }
+  else if (is_proxy)
+    {
+      singbox_redirect_close_proxy (sm, ss);
+      singbox_redirect_close_client (sm, ss);
+    }
+  else
+    {
+      singbox_redirect_close_client (sm, ss);
+
+      /* pairs with the barrier in the connected callback: either we see
+       * the connect finished or it sees the client gone */
+      CLIB_MEMORY_BARRIER ();
+      if (!ss->proxy_connecting)
+        singbox_redirect_close_proxy (sm, ss);
+    }
+}
+
+static void
+singbox_redirect_postponed_free_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_redirect_session_get (sm, pointer_to_uword (arg));
+  ASSERT (ss);
+  segment_manager_dealloc_fifos (ss->client_rx_fifo, ss->client_tx_fifo);
+  singbox_session_free (sm, ss);
+}
+
+static void
+singbox_redirect_delete (session_t *s, u8 is_proxy)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_redirect_session_get (sm, s->opaque);
+  if (!ss)
+    return;
+
+  if (is_proxy && ss->is_pooled)
+    {
+      /* never handed to a flow, the fifos are its own */
+      singbox_redirect_pool_settle (sm, ss);
+      singbox_session_remove_from_pool (sm, ss);
+      singbox_redirect_put (sm, ss);
+    }
+  else if (is_proxy)
+    {
+      ss->proxy_disconnected = 1;
+      ss->proxy_session_handle = SESSION_INVALID_HANDLE;
+
+      /* revert master thread index change on connect */
+      ss->client_rx_fifo->master_thread_index =
+        ss->client_tx_fifo->master_thread_index;
+
+      if (clib_atomic_sub_fetch (&ss->n_refs, 1))
+        return;
+
+      /* client already cleaned up, the fifos are ours to free and only
+       * the thread that allocated them, the session's, may do it */
+      if (s->thread_index != ss->thread_index)
+        {
+          s->rx_fifo = 0;
+          s->tx_fifo = 0;
+          session_send_rpc_evt_to_thread (
+            ss->thread_index, singbox_redirect_postponed_free_rpc,
+            uword_to_pointer (singbox_session_handle (ss), void *));
+        }
+      else
+        {
+          ASSERT (s->rx_fifo->refcnt == 1);
+          singbox_session_free (sm, ss);
+        }
+    }
+  else
+    {
+      ss->client_disconnected = 1;
+      ss->client_session_handle = SESSION_INVALID_HANDLE;
+      singbox_redirect_put (sm, ss);
+    }
+}
+
+/**
+ * @brief Reopen a receive window once the other side drained our fifo
+ *
+ * The peer transport only learns about the space freed in its rx fifo
+ * when it is told, and the fifo is drained by our transport, not the
+ * peer's application.
+ */
+static int
+singbox_redirect_tx_callback (session_t *s, u8 is_proxy)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+  session_handle_t peer_sh;
+
+  if (!session_relay_tx_ready (s->tx_fifo))
+    return 0;
+
+  ss = singbox_redirect_session_get (sm, s->opaque);
+  if (!ss)
+    return -1;
+  if (is_proxy ? ss->client_disconnected : ss->proxy_disconnected)
+    return -1;
+  if (ss->state != SINGBOX_STATE_ESTABLISHED)
+    return 0;
+
+  peer_sh = is_proxy ? ss->client_session_handle : ss->proxy_session_handle;
+  if (peer_sh == SESSION_INVALID_HANDLE)
+    return 0;
+
+  session_relay_reopen_window (peer_sh);
+
+  return 0;
+}
+
+/* ========== PROXY SIDE ========== */
+
+static void
+singbox_redirect_rollback_cwnd (session_handle_t client_sh, u32 cwnd)
+{
+  transport_connection_t *tc;
+  session_t *s;
+
+  s = session_get_from_handle_if_valid (client_sh);
+  if (!s)
+    return;
+
+  tc = session_get_transport (s);
+  ((tcp_connection_t *) tc)->cwnd = cwnd;
+  transport_connection_reschedule (tc);
+}
+
+static void
+singbox_redirect_rollback_cwnd_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_redirect_session_get (sm, pointer_to_uword (arg));
+  if (ss && ss->client_session_handle != SESSION_INVALID_HANDLE)
+    singbox_redirect_rollback_cwnd (ss->client_session_handle,
+                                    ss->client_cwnd);
+}
+
+/**
+ * @brief Proxy connection for a flow could not be opened
+ */
+static void
+singbox_redirect_connect_failed (singbox_main_t *sm, singbox_session_t *ss)
+{
+  singbox_redirect_count_failure (sm, ss->sw_if_index);
+  ss->state = SINGBOX_STATE_ERROR;
+  ss->proxy_disconnected = 1;
+  clib_atomic_store_rel_n (&ss->proxy_connecting, 0);
+  singbox_redirect_close_client (sm, ss);
+  singbox_redirect_put (sm, ss);
+}
+
+/**
+ * @brief Pool connection could not be opened
+ */
+static void
+singbox_redirect_pool_connect_failed (singbox_main_t *sm, u32 sw_if_index)
+{
+  singbox_interface_config_t *config;
+
+  singbox_redirect_count_failure (sm, sw_if_index);
+  config = singbox_get_interface_config (sm, sw_if_index);
+  if (config)
+    clib_atomic_fetch_sub (&config->pool_pending, 1);
+}
+
+static void
+singbox_redirect_connect_rpc (void *rpc_args)
+{
+  singbox_main_t *sm = &singbox_main;
+  vnet_connect_args_t *a = rpc_args;
+  singbox_session_t *ss;
+  session_error_t rv;
+
+  rv = vnet_connect (a);
+  if (rv)
+    {
+      if (sm->verbose)
+        clib_warning ("session %x connect returned: %U", a->api_context,
+                      format_session_error, rv);
+
+      if (a->api_context & SINGBOX_REDIRECT_CONNECT_POOL)
+        singbox_redirect_pool_connect_failed (
+          sm, a->api_context & ~SINGBOX_REDIRECT_CONNECT_POOL);
+      else
+        {
+          ss = singbox_redirect_session_get (sm, a->api_context);
+          ASSERT (ss);
+          singbox_redirect_connect_failed (sm, ss);
+        }
+    }
+
+  vec_free (a);
+}
+
+/**
+ * @brief Open a proxy connection for an accepted flow or the pool
+ *
+ * Connects must be issued from the transport's connect thread.
+ *
+ * @param api_context - Handle of the flow's session, or
+ *                      SINGBOX_REDIRECT_CONNECT_POOL | sw_if_index
+ */
+static void
+singbox_redirect_connect (u32 api_context, singbox_endpoint_t *ep)
+{
+  singbox_main_t *sm = &singbox_main;
+  vnet_connect_args_t *a = 0;
+
+  vec_validate (a, 0);
+  clib_memset (a, 0, sizeof (a[0]));
+  a->sep_ext = (session_endpoint_cfg_t) SESSION_ENDPOINT_CFG_NULL;
+  a->sep_ext.transport_proto = TRANSPORT_PROTO_TCP;
+  a->sep_ext.is_ip4 = 1;
+  a->sep_ext.ip.ip4 = ep->proxy_addr;
+  a->sep_ext.port = clib_host_to_net_u16 (ep->proxy_port);
+  a->app_index = sm->app_index;
+  a->api_context = api_context;
+
+  session_send_rpc_evt_to_thread_force (transport_cl_thread (),
+                                        singbox_redirect_connect_rpc, a);
+}
+
+static int
+singbox_upstream_accept_callback (session_t *s)
+{
+  clib_warning ("singbox upstream app should not get accept events");
+  return -1;
+}
+
+static int
+singbox_upstream_connected_callback (u32 app_index, u32 opaque, session_t *s,
+                                     session_error_t err)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  if (opaque & SINGBOX_REDIRECT_CONNECT_POOL)
+    {
+      if (err)
+        {
+          singbox_redirect_pool_connect_failed (
+            sm, opaque & ~SINGBOX_REDIRECT_CONNECT_POOL);
+          return 0;
+        }
+
+      /* session came with the fifos, the greeting is already queued and
+       * the pool takes it from here once the proxy accepted our
+       * credentials */
+      ss = singbox_redirect_session_get (sm, s->opaque);
+      ASSERT (ss);
+      ss->proxy_session_handle = session_handle (s);
+      ss->is_connected = 1;
+      ss->greeting_sent = 1;
+      ss->auth_sent = 1;
+      goto send;
+    }
+
+  ss = singbox_redirect_session_get (sm, opaque);
+  ASSERT (ss);
+
+  if (err)
+    {
+      if (sm->verbose)
+        clib_warning ("session %x connect failed: %U", opaque,
+                      format_session_error, err);
+      singbox_redirect_connect_failed (sm, ss);
+      return 0;
+    }
+
+  s->opaque = opaque;
+  ss->proxy_session_handle = session_handle (s);
+  ss->is_connected = 1;
+  ss->greeting_sent = 1;
+  ss->auth_sent = 1;
+  ss->request_sent = 1;
+  ss->state = SINGBOX_STATE_SOCKS5_RESPONSE;
+
+  /* publish the handle to the client side before it may use it */
+  clib_atomic_store_rel_n (&ss->proxy_connecting, 0);
+  CLIB_MEMORY_BARRIER ();
+
+  /* client went away while we were connecting */
+  if (ss->client_disconnected)
+    {
+      if (!clib_atomic_swap_acq_n (&ss->proxy_disconnected, 1))
+        session_reset (s);
+      return 0;
+    }
+
+send:
+  /* handshake and any client data queued behind it */
+  if (svm_fifo_max_dequeue (s->tx_fifo))
+    session_relay_tx_event (s->tx_fifo, s->handle);
+
+  return 0;
+}
+
+static void
+singbox_upstream_disconnect_callback (session_t *s)
+{
+  singbox_redirect_close (s, 1 /* is_proxy */);
+}
+
+static void
+singbox_upstream_transport_closed_callback (session_t *s)
+{
+}
+
+static void
+singbox_upstream_reset_callback (session_t *s)
+{
+  singbox_redirect_close (s, 1 /* is_proxy */);
+}
+
+/**
+ * @brief Greeting reply on a pool connection
+ */
+static int
+singbox_upstream_pool_rx (singbox_main_t *sm, singbox_session_t *ss,
+                          session_t *s)
+{
+  singbox_interface_config_t *config;
+  int rv = -1;
+
+  /* only the greeting was sent, a pooled connection that talks after
+   * that is of no use */
+  config = singbox_get_interface_config (sm, ss->sw_if_index);
+  if (config && ss->state == SINGBOX_STATE_SOCKS5_GREETING)
+    rv = singbox_socks5_read_reply (s->rx_fifo, &config->endpoint,
+                                    SINGBOX_SOCKS5_GREETING);
+  if (rv == 0)
+    return 0;
+
+  if (rv < 0 || svm_fifo_max_dequeue (s->rx_fifo))
+    {
+      if (ss->state == SINGBOX_STATE_SOCKS5_GREETING)
+        singbox_redirect_count_failure (sm, ss->sw_if_index);
+      singbox_redirect_pool_settle (sm, ss);
+      singbox_session_remove_from_pool (sm, ss);
+      ss->state = SINGBOX_STATE_ERROR;
+      if (!clib_atomic_swap_acq_n (&ss->proxy_disconnected, 1))
+        session_reset (s);
+      return 0;
+    }
+
+  singbox_redirect_pool_settle (sm, ss);
+  singbox_session_put_to_pool (sm, ss);
+  return 0;
+}
+
+static int
+singbox_upstream_rx_callback (session_t *s)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_interface_config_t *config;
+  singbox_session_t *ss;
+  session_handle_t client_sh;
+  int rv;
+
+  ss = singbox_redirect_session_get (sm, s->opaque);
+  if (!ss)
+    return -1;
+
+  if (ss->is_pooled)
+    return singbox_upstream_pool_rx (sm, ss, s);
+
+  if (ss->client_disconnected)
+    return -1;
+  client_sh = ss->client_session_handle;
+
+  if (PREDICT_FALSE (ss->state != SINGBOX_STATE_ESTABLISHED))
+    {
+      /* connections from the pool are past the greeting */
+      config = singbox_get_interface_config (sm, ss->sw_if_index);
+      rv = -1;
+      if (config)
+        rv = singbox_socks5_read_reply (
+          s->rx_fifo, &config->endpoint,
+          ss->state == SINGBOX_STATE_SOCKS5_REQUEST ?
+            SINGBOX_SOCKS5_CONNECT :
+            SINGBOX_SOCKS5_GREETING | SINGBOX_SOCKS5_CONNECT);
+      if (rv == 0)
+        return 0;
+      if (rv < 0)
+        {
+          if (sm->verbose)
+            clib_warning ("session %u SOCKS5 handshake failed",
+                          ss->session_index);
+          singbox_redirect_count_failure (sm, ss->sw_if_index);
+          ss->error_count++;
+          ss->state = SINGBOX_STATE_ERROR;
+          if (!clib_atomic_swap_acq_n (&ss->proxy_disconnected, 1))
+            session_reset (s);
+          singbox_redirect_close_client (sm, ss);
+          return 0;
+        }
+
+      ss->state = SINGBOX_STATE_ESTABLISHED;
+
+      /* let the client transport send again; it was held so that the
+       * handshake replies were not sent to the client */
+      if (s->thread_index != ss->thread_index)
+        session_send_rpc_evt_to_thread (
+          ss->thread_index, singbox_redirect_rollback_cwnd_rpc,
+          uword_to_pointer (singbox_session_handle (ss), void *));
+      else
+        singbox_redirect_rollback_cwnd (client_sh, ss->client_cwnd);
+    }
+
+  ss->last_activity = vlib_time_now (vlib_get_main ());
+  session_relay_notify_peer (s->rx_fifo, client_sh);
+
+  return 0;
+}
+
+static int
+singbox_upstream_tx_callback (session_t *s)
+{
+  return singbox_redirect_tx_callback (s, 1 /* is_proxy */);
+}
+
+static void
+singbox_upstream_cleanup_callback (session_t *s, session_cleanup_ntf_t ntf)
+{
+  if (ntf == SESSION_CLEANUP_TRANSPORT)
+    return;
+
+  singbox_redirect_delete (s, 1 /* is_proxy */);
+}
+
+/**
+ * @brief Set up a pool connection's session and fifos
+ *
+ * The session is owned by the thread the connection landed on, and it
+ * allocates its own fifos like a plain connect does; they are kept for
+ * the flow that eventually takes the connection.
+ */
+static int
+singbox_upstream_pool_alloc_session_fifos (singbox_main_t *sm, session_t *s)
+{
+  singbox_interface_config_t *config;
+  svm_fifo_t *rx_fifo = 0, *tx_fifo = 0;
+  ip4_address_t any = { 0 };
+  segment_manager_t *segsm;
+  singbox_session_t *ss;
+  u32 sw_if_index;
+
+  sw_if_index = s->opaque & ~SINGBOX_REDIRECT_CONNECT_POOL;
+  config = singbox_get_interface_config (sm, sw_if_index);
+  if (!config || !(ss = singbox_session_alloc (sm, &any, 0, sw_if_index)))
+    return SESSION_E_ALLOC;
+
+  segsm = app_worker_get_connect_segment_manager (
+    application_get_default_worker (application_get (sm->app_index)));
+  if (segment_manager_alloc_session_fifos (segsm, s->thread_index, &rx_fifo,
+                                           &tx_fifo))
+    {
+      singbox_session_free (sm, ss);
+      return SESSION_E_ALLOC;
+    }
+
+  rx_fifo->shr->master_session_index = s->session_index;
+  rx_fifo->vpp_sh = s->handle;
+  tx_fifo->shr->master_session_index = s->session_index;
+  tx_fifo->vpp_sh = s->handle;
+  s->flags &= ~SESSION_F_PROXY;
+
+  ss->is_pooled = 1;
+  ss->state = SINGBOX_STATE_SOCKS5_GREETING;
+  ss->client_rx_fifo = tx_fifo;
+  ss->client_tx_fifo = rx_fifo;
+  singbox_socks5_write_request (tx_fifo, &config->endpoint, 0, 0,
+                                SINGBOX_SOCKS5_GREETING);
+
+  s->opaque = singbox_session_handle (ss);
+  s->rx_fifo = rx_fifo;
+  s->tx_fifo = tx_fifo;
+  return 0;
+}
+
+/**
+ * @brief Give the proxy session the client session's fifos, swapped
+ */
+static int
+singbox_upstream_alloc_session_fifos (session_t *s)
+{
+  singbox_main_t *sm = &singbox_main;
+  svm_fifo_t *rx_fifo, *tx_fifo;
+  singbox_session_t *ss;
+
+  if (s->opaque & SINGBOX_REDIRECT_CONNECT_POOL)
+    return singbox_upstream_pool_alloc_session_fifos (sm, s);
+
+  ss = singbox_redirect_session_get (sm, s->opaque);
+  ASSERT (ss);
+  if (ss->client_disconnected)
+    return SESSION_E_ALLOC;
+
+  tx_fifo = ss->client_rx_fifo;
+  rx_fifo = ss->client_tx_fifo;
+  ASSERT (rx_fifo->refcnt == 1);
+  ASSERT (tx_fifo->refcnt == 1);
+  rx_fifo->refcnt++;
+  tx_fifo->refcnt++;
+
+  /* dequeue notifications for the client's rx fifo go to the proxy */
+  tx_fifo->shr->master_session_index = s->session_index;
+  tx_fifo->master_thread_index = s->thread_index;
+  tx_fifo->vpp_sh = s->handle;
+
+  s->rx_fifo = rx_fifo;
+  s->tx_fifo = tx_fifo;
+  return 0;
+}
+
+static session_cb_vft_t singbox_upstream_cb_vft = {
+  .session_accept_callback = singbox_upstream_accept_callback,
+  .session_connected_callback = singbox_upstream_connected_callback,
+  .session_disconnect_callback = singbox_upstream_disconnect_callback,
+  .session_transport_closed_callback =
+    singbox_upstream_transport_closed_callback,
+  .session_reset_callback = singbox_upstream_reset_callback,
+  .builtin_app_rx_callback = singbox_upstream_rx_callback,
+  .builtin_app_tx_callback = singbox_upstream_tx_callback,
+  .session_cleanup_callback = singbox_upstream_cleanup_callback,
+  .proxy_alloc_session_fifos = singbox_upstream_alloc_session_fifos,
+};
+
+/* ========== CLIENT SIDE ========== */
+
+/**
+ * @brief Take a warm connection from this thread's pool, if any
+ *
+ * The client gives up its fresh fifos for the pooled connection's, so
+ * only the CONNECT request is left to queue. Until the flow is accepted
+ * the connection is tracked as a handoff.
+ */
+static singbox_session_t *
+singbox_redirect_take_pooled (singbox_main_t *sm, session_t *s,
+                              transport_connection_t *tc,
+                              singbox_interface_config_t *config,
+                              u32 sw_if_index)
+{
+  singbox_session_t *ss;
+  singbox_wrk_t *wrk;
+
+  ss = singbox_session_get_from_pool (sm, sw_if_index);
+  if (!ss)
+    return NULL;
+
+  if (singbox_socks5_write_request (ss->client_rx_fifo, &config->endpoint,
+                                    &tc->lcl_ip.ip4,
+                                    clib_net_to_host_u16 (tc->lcl_port),
+                                    SINGBOX_SOCKS5_CONNECT))
+    {
+      /* cannot happen on an idle connection, do not reuse it either */
+      singbox_redirect_close_proxy (sm, ss);
+      return NULL;
+    }
+
+  segment_manager_dealloc_fifos (s->rx_fifo, s->tx_fifo);
+  s->rx_fifo = ss->client_rx_fifo;
+  s->tx_fifo = ss->client_tx_fifo;
+  s->rx_fifo->refcnt++;
+  s->tx_fifo->refcnt++;
+
+  /* the proxy's rx fifo is now sent by the client */
+  s->tx_fifo->shr->master_session_index = s->session_index;
+  s->tx_fifo->vpp_sh = s->handle;
+
+  /* the client holds the session from now on */
+  clib_atomic_fetch_add (&ss->n_refs, 1);
+  ss->client_session_handle = session_handle (s);
+  ss->dst_addr = tc->lcl_ip.ip4;
+  ss->dst_port = clib_net_to_host_u16 (tc->lcl_port);
+  ss->state = SINGBOX_STATE_SOCKS5_REQUEST;
+  ss->request_sent = 1;
+
+  wrk = singbox_wrk_get (sm, ss->thread_index);
+  vec_add1 (wrk->handoffs, ss->session_index);
+  return ss;
+}
+
+/**
+ * @brief Queue the SOCKS5 handshake ahead of the client's data
+ *
+ * Called before the accept notification, with the client's fifos
+ * freshly allocated. The client's rx fifo is the proxy's tx fifo.
+ */
+static int
+singbox_redirect_write_early_data (session_t *s)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_interface_config_t *config;
+  transport_connection_t *tc;
+  singbox_session_t *ss;
+  u32 sw_if_index;
+
+  tc = session_get_transport (s);
+  sw_if_index = singbox_redirect_client_sw_if_index (sm, tc);
+  config = singbox_get_interface_config (sm, sw_if_index);
+  if (!config || !config->endpoint.is_enabled)
+    return -1;
+
+  ss = singbox_redirect_take_pooled (sm, s, tc, config, sw_if_index);
+  if (ss)
+    {
+      s->opaque = SINGBOX_REDIRECT_OPAQUE_WARM | ss->session_index;
+      return 0;
+    }
+
+  if (singbox_socks5_write_request (
+        s->rx_fifo, &config->endpoint, &tc->lcl_ip.ip4,
+        clib_net_to_host_u16 (tc->lcl_port),
+        SINGBOX_SOCKS5_GREETING | SINGBOX_SOCKS5_CONNECT))
+    return -1;
+
+  /* accept picks the interface up from here */
+  s->opaque = sw_if_index;
+  return 0;
+}
+
+static int
+singbox_redirect_accept_callback (session_t *s)
+{
+  singbox_main_t *sm = &singbox_main;
+  transport_connection_t *tc;
+  tcp_connection_t *tcp_conn;
+  singbox_session_t *ss;
+  singbox_wrk_t *wrk;
+  session_t *proxy_s;
+  u32 i;
+
+  tc = session_get_transport (s);
+  wrk = singbox_wrk_get (sm, s->thread_index);
+
+  if (s->opaque & SINGBOX_REDIRECT_OPAQUE_WARM)
+    {
+      i = s->opaque & ~SINGBOX_REDIRECT_OPAQUE_WARM;
+      ss = pool_elt_at_index (wrk->sessions, i);
+      i = vec_search (wrk->handoffs, i);
+      if (i != ~0)
+        vec_del1 (wrk->handoffs, i);
+    }
+  else
+    {
+      ss = singbox_session_alloc (sm, &tc->lcl_ip.ip4,
+                                  clib_net_to_host_u16 (tc->lcl_port),
+                                  s->opaque);
+      if (!ss)
+        {
+          s->opaque = ~0;
+          return -1;
+        }
+
+      /* one reference for the client, one for the proxy connect */
+      ss->n_refs = 2;
+      ss->state = SINGBOX_STATE_CONNECTING;
+      ss->proxy_connecting = 1;
+    }
+
+  ss->client_session_handle = session_handle (s);
+  ss->client_rx_fifo = s->rx_fifo;
+  ss->client_tx_fifo = s->tx_fifo;
+  ss->client_thread_index = s->thread_index;
+
+  /* set cwnd to zero until the handshake completes, otherwise tcp can
+   * send the SOCKS5 replies to the client when it acks */
+  tcp_conn = (tcp_connection_t *) tc;
+  ss->client_cwnd = tcp_conn->cwnd;
+  tcp_conn->cwnd = 0;
+
+  s->opaque = singbox_session_handle (ss);
+  s->session_state = SESSION_STATE_READY;
+
+  if (ss->proxy_connecting)
+    singbox_redirect_connect (s->opaque, ss->endpoint);
+  else
+    {
+      /* already connected and authenticated, just send the CONNECT */
+      proxy_s = session_get_from_handle_if_valid (ss->proxy_session_handle);
+      if (proxy_s)
+        session_relay_tx_event (proxy_s->tx_fifo, ss->proxy_session_handle);
+    }
+
+  return 0;
+}
+
+static int
+singbox_redirect_connected_callback (u32 app_index, u32 opaque, session_t *s,
+                                     session_error_t err)
+{
+  clib_warning ("singbox redirect app should not get connected events");
+  return -1;
+}
+
+static void
+singbox_redirect_disconnect_callback (session_t *s)
+{
+  singbox_redirect_close (s, 0 /* is_proxy */);
+}
+
+static void
+singbox_redirect_transport_closed_callback (session_t *s)
+{
+}
+
+static void
+singbox_redirect_reset_callback (session_t *s)
+{
+  singbox_redirect_close (s, 0 /* is_proxy */);
+}
+
+static int
+singbox_redirect_rx_callback (session_t *s)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  if (s->flags & SESSION_F_APP_CLOSED)
+    return 0;
+
+  ss = singbox_redirect_session_get (sm, s->opaque);
+  if (!ss || ss->proxy_disconnected)
+    return -1;
+
+  /* data queues behind the handshake until the proxy is connected; the
+   * barrier pairs with the connected callback's so that one of us sees
+   * the data */
+  if (PREDICT_FALSE (ss->proxy_connecting))
+    {
+      CLIB_MEMORY_BARRIER ();
+      if (ss->proxy_connecting)
+        return 0;
+    }
+
+  ss->last_activity = vlib_time_now (vlib_get_main ());
+  session_relay_notify_peer (s->rx_fifo, ss->proxy_session_handle);
+
+  return 0;
+}
+
+static int
+singbox_redirect_tx_callback_fn (session_t *s)
+{
+  return singbox_redirect_tx_callback (s, 0 /* is_proxy */);
+}
+
+static void
+singbox_redirect_cleanup_callback (session_t *s, session_cleanup_ntf_t ntf)
+{
+  if (ntf == SESSION_CLEANUP_TRANSPORT)
+    return;
+
+  singbox_redirect_delete (s, 0 /* is_proxy */);
+}
+
+static int
+singbox_redirect_add_segment_callback (u32 client_index, u64 segment_handle)
+{
+  return 0;
+}
+
+static session_cb_vft_t singbox_redirect_cb_vft = {
+  .session_accept_callback = singbox_redirect_accept_callback,
+  .session_connected_callback = singbox_redirect_connected_callback,
+  .session_disconnect_callback = singbox_redirect_disconnect_callback,
+  .session_transport_closed_callback =
+    singbox_redirect_transport_closed_callback,
+  .session_reset_callback = singbox_redirect_reset_callback,
+  .builtin_app_rx_callback = singbox_redirect_rx_callback,
+  .builtin_app_tx_callback = singbox_redirect_tx_callback_fn,
+  .session_cleanup_callback = singbox_redirect_cleanup_callback,
+  .add_segment_callback = singbox_redirect_add_segment_callback,
+  .proxy_write_early_data = singbox_redirect_write_early_data,
+};
+
+static int
+singbox_redirect_attach (char *name, session_cb_vft_t *cb_vft, u32 *app_index)
+{
+  vnet_app_attach_args_t _a, *a = &_a;
+  u64 options[APP_OPTIONS_N_OPTIONS];
+  session_error_t rv;
+
+  clib_memset (a, 0, sizeof (*a));
+  clib_memset (options, 0, sizeof (options));
+
+  a->api_client_index = APP_INVALID_INDEX;
+  a->name = format (0, "%s", name);
+  a->session_cb_vft = cb_vft;
+  a->options = options;
+  a->options[APP_OPTIONS_SEGMENT_SIZE] = SINGBOX_REDIRECT_SEGMENT_SIZE;
+  a->options[APP_OPTIONS_ADD_SEGMENT_SIZE] = SINGBOX_REDIRECT_SEGMENT_SIZE;
+  a->options[APP_OPTIONS_RX_FIFO_SIZE] = SINGBOX_REDIRECT_FIFO_SIZE;
+  a->options[APP_OPTIONS_TX_FIFO_SIZE] = SINGBOX_REDIRECT_FIFO_SIZE;
+  a->options[APP_OPTIONS_FLAGS] =
+    APP_OPTIONS_FLAGS_IS_BUILTIN | APP_OPTIONS_FLAGS_IS_PROXY;
+
+  rv = vnet_application_attach (a);
+  vec_free (a->name);
+  if (rv)
+    {
+      clib_warning ("%s attach returned: %U", name, format_session_error, rv);
+      return rv;
+    }
+
+  *app_index = a->app_index;
+  return 0;
+}
+
+/**
+ * @brief Start transparent TCP redirection
+ */
+int
+singbox_redirect_enable (singbox_main_t *sm)
+{
+  vlib_main_t *vm = vlib_get_main ();
+  session_enable_disable_args_t args = {
+    .is_en = 1,
+    .rt_engine_type = RT_BACKEND_ENGINE_RULE_TABLE,
+  };
+  vnet_listen_args_t _a, *a = &_a;
+  singbox_wrk_t *wrk;
+  session_error_t rv;
+
+  if (sm->redirect_listener_index != ~0)
+    return 0;
+
+  vec_foreach (wrk, sm->workers)
+    if (!clib_bihash_is_initialised_16_8 (&wrk->syn_interfaces))
+      clib_bihash_init_16_8 (&wrk->syn_interfaces, "singbox redirect syns",
+                             SINGBOX_REDIRECT_SYN_BUCKETS,
+                             SINGBOX_REDIRECT_SYN_MEMORY);
+
+  vlib_worker_thread_barrier_sync (vm);
+  vnet_session_enable_disable (vm, &args);
+  vlib_worker_thread_barrier_release (vm);
+
+  if (sm->app_index == APP_INVALID_INDEX &&
+      singbox_redirect_attach ("singbox-upstream", &singbox_upstream_cb_vft,
+                               &sm->app_index))
+    return VNET_API_ERROR_APPLICATION_NOT_ATTACHED;
+
+  if (sm->redirect_app_index == APP_INVALID_INDEX &&
+      singbox_redirect_attach ("singbox-redirect", &singbox_redirect_cb_vft,
+                               &sm->redirect_app_index))
+    return VNET_API_ERROR_APPLICATION_NOT_ATTACHED;
+
+  /* tcp 0.0.0.0:0 is never matched by regular lookups, the singbox node
+   * hands it the SYNs it wants terminated */
+  clib_memset (a, 0, sizeof (*a));
+  a->app_index = sm->redirect_app_index;
+  a->sep_ext = (session_endpoint_cfg_t) SESSION_ENDPOINT_CFG_NULL;
+  a->sep_ext.transport_proto = TRANSPORT_PROTO_TCP;
+  a->sep_ext.is_ip4 = 1;
+  if ((rv = vnet_listen (a)))
+    {
+      clib_warning ("singbox redirect listen returned: %U",
+                    format_session_error, rv);
+      return VNET_API_ERROR_ADDRESS_IN_USE;
+    }
+
+  sm->redirect_listener_index =
+    listen_session_get_from_handle (a->handle)->connection_index;
+
+  return 0;
+}
+
+
+static int
+singbox_redirect_syn_stale (clib_bihash_kv_16_8_t *kv, void *arg)
+{
+  clib_bihash_kv_16_8_t **stale = arg;
+  u32 now = (u32) vlib_time_now (vlib_get_main ());
+
+  if (now - (u32) (kv->value >> 32) > SINGBOX_REDIRECT_SYN_TIMEOUT)
+    vec_add1 (*stale, *kv);
+  return BIHASH_WALK_CONTINUE;
+}
+
+/**
+ * @brief Expire this thread's idle pooled connections and handoffs
+ *
+ * Runs on every thread, which alone may touch its pools. A handoff
+ * whose client never got accepted lost its session silently, so the
+ * flow's reference on the pooled connection is dropped here. So are
+ * the noted SYNs of flows tcp gave up on.
+ */
+static void
+singbox_pool_expire_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  clib_bihash_kv_16_8_t *stale = 0, *kv;
+  singbox_interface_config_t *config;
+  singbox_wrk_interface_t *wi;
+  singbox_session_t *ss;
+  singbox_wrk_t *wrk;
+  session_t *s;
+  u32 sw_if_index, i;
+  u8 is_active;
+  f64 now;
+
+  wrk = singbox_wrk_get (sm, vlib_get_thread_index ());
+  now = vlib_time_now (vlib_get_main ());
+
+  vec_foreach_index (sw_if_index, wrk->interfaces)
+    {
+      wi = vec_elt_at_index (wrk->interfaces, sw_if_index);
+      config = singbox_get_interface_config (sm, sw_if_index);
+      is_active =
+        sm->enable_pooling && config && config->endpoint.is_enabled;
+
+      for (i = vec_len (wi->connection_pool); i > 0; i--)
+        {
+          ss = pool_elt_at_index (wrk->sessions, wi->connection_pool[i - 1]);
+          if (is_active && !ss->proxy_disconnected &&
+              now - ss->last_activity <= sm->pool_idle_timeout)
+            continue;
+
+          /* cleanup callback frees the session */
+          vec_delete (wi->connection_pool, 1, i - 1);
+          ss->state = SINGBOX_STATE_CLOSED;
+          singbox_redirect_close_proxy (sm, ss);
+        }
+      wi->n_warm = vec_len (wi->connection_pool);
+    }
+
+  for (i = vec_len (wrk->handoffs); i > 0; i--)
+    {
+      ss = pool_elt_at_index (wrk->sessions, wrk->handoffs[i - 1]);
+      s = session_get_from_handle_if_valid (ss->client_session_handle);
+      if (s && s->opaque == (SINGBOX_REDIRECT_OPAQUE_WARM | ss->session_index))
+        continue;
+
+      vec_del1 (wrk->handoffs, i - 1);
+      ss->client_disconnected = 1;
+      ss->client_session_handle = SESSION_INVALID_HANDLE;
+      ss->state = SINGBOX_STATE_CLOSED;
+      singbox_redirect_close_proxy (sm, ss);
+      singbox_redirect_put (sm, ss);
+    }
+
+  clib_bihash_foreach_key_value_pair_16_8 (
+    &wrk->syn_interfaces, singbox_redirect_syn_stale, &stale);
+  vec_foreach (kv, stale)
+    clib_bihash_add_del_16_8 (&wrk->syn_interfaces, kv, 0 /* is_add */);
+  vec_free (stale);
+}
+
+/**
+ * @brief Open pool connections an interface is short of
+ *
+ * Proxy connections land on whichever thread the SYN-ACK hashes to, so
+ * the pool is sized for all threads together and each thread keeps the
+ * connections it got.
+ */
+static void
+singbox_pool_refill (singbox_main_t *sm, u32 sw_if_index)
+{
+  singbox_interface_config_t *config;
+  singbox_interface_stats_t stats;
+  u32 target, n_connect, pending;
+
+  config = vec_elt_at_index (sm->interface_configs, sw_if_index);
+  if (!sm->enable_pooling || !config->endpoint.is_enabled)
+    return;
+
+  singbox_interface_stats (sm, sw_if_index, &stats);
+  pending = clib_atomic_load_acq_n (&config->pool_pending);
+  target = sm->pool_size * clib_max (vlib_num_workers (), 1);
+  if (stats.n_warm + pending >= target)
+    return;
+
+  n_connect = target - stats.n_warm - pending;
+  if (config->endpoint.max_connections > 0)
+    {
+      if (stats.active_connections + pending >=
+          config->endpoint.max_connections)
+        return;
+      n_connect = clib_min (n_connect, config->endpoint.max_connections -
+                                         stats.active_connections - pending);
+    }
+
+  clib_atomic_fetch_add (&config->pool_pending, n_connect);
+  while (n_connect--)
+    singbox_redirect_connect (SINGBOX_REDIRECT_CONNECT_POOL | sw_if_index,
+                              &config->endpoint);
+}
+
+static uword
+singbox_pool_process (vlib_main_t *vm, vlib_node_runtime_t *rt,
+                      vlib_frame_t *f)
+{
+  singbox_main_t *sm = &singbox_main;
+  u32 sw_if_index, thread_index;
+
+  while (1)
+    {
+      /* pool settings changes signal us to apply them right away */
+      vlib_process_wait_for_event_or_clock (vm, SINGBOX_POOL_PERIOD);
+      vlib_process_get_events (vm, 0);
+
+      if (sm->redirect_listener_index == ~0)
+        continue;
+
+      vec_foreach_index (thread_index, sm->workers)
+        session_send_rpc_evt_to_thread (thread_index, singbox_pool_expire_rpc,
+                                        0);
+
+      vec_foreach_index (sw_if_index, sm->interface_configs)
+        singbox_pool_refill (sm, sw_if_index);
+    }
+
+  return 0;
+}
+
+VLIB_REGISTER_NODE (singbox_pool_process_node) = {
+  .function = singbox_pool_process,
+  .type = VLIB_NODE_TYPE_PROCESS,
+  .name = "singbox-pool-process",
+};
@@ -20,6 +20,11 @@
  * This file implements session creation, deletion, and connection pooling
  * for the sing-box integration plugin. It manages connections to sing-box
  * proxy instances with proper lifecycle management.
+ *
+ * Sessions live in the pool of the thread that owns them, the one the
+ * intercepted client connection is on, and only that thread allocates
+ * or frees them. Nothing here takes a lock: counters are per thread and
+ * folded when read, and handle lookups go to the handle's own thread.
  */
 
 #include <vppinfra/error.h>
@@ -29,98 +34,141 @@
 #include <singbox/singbox.h>
 
 /**
- * @brief Create a new session to sing-box proxy
+ * @brief Fold an interface's per-thread counters
+ */
+void
+singbox_interface_stats (singbox_main_t *sm, u32 sw_if_index,
+                         singbox_interface_stats_t *stats)
+{
+  singbox_wrk_interface_t *wi;
+  singbox_wrk_t *wrk;
+
+  clib_memset (stats, 0, sizeof (*stats));
+  vec_foreach (wrk, sm->workers)
+    {
+      if (!(wi = singbox_wrk_interface_get (wrk, sw_if_index)))
+        continue;
+      stats->packets_redirected += wi->packets_redirected;
+      stats->bytes_redirected += wi->bytes_redirected;
+      stats->connection_failures += wi->connection_failures;
+      stats->total_connections += wi->total_connections;
+      stats->pool_hits += wi->pool_hits;
+      stats->pool_misses += wi->pool_misses;
+      stats->active_connections += wi->active_connections;
+      stats->n_warm += wi->n_warm;
+    }
+}
+
+/**
+ * @brief Allocate and initialize a session owned by the calling thread
  */
 singbox_session_t *
-singbox_session_create (singbox_main_t *sm, ip4_address_t *dst_addr,
+singbox_session_alloc (singbox_main_t *sm, ip4_address_t *dst_addr,
                        u16 dst_port, u32 sw_if_index)
 {
-  singbox_session_t *session;
+  u32 thread_index = vlib_get_thread_index ();
   singbox_interface_config_t *config;
-  u32 session_index;
+  singbox_interface_stats_t stats;
+  singbox_wrk_interface_t *wi;
+  singbox_session_t *session;
+  singbox_wrk_t *wrk;
 
   config = singbox_get_interface_config (sm, sw_if_index);
   if (!config || !config->endpoint.is_enabled)
     return NULL;
 
-  /* Check connection limit */
-  if (config->endpoint.max_connections > 0 &&
-      config->active_connections >= config->endpoint.max_connections)
+  wrk = singbox_wrk_get (sm, thread_index);
+  wi = singbox_wrk_interface_get (wrk, sw_if_index);
+  if (!wi)
+    return NULL;
+
+  /* Check connection limit, against all threads */
+  if (config->endpoint.max_connections > 0)
     {
-      clib_warning ("Maximum connections reached for interface %d",
-                   sw_if_index);
-      config->connection_failures++;
-      return NULL;
+      singbox_interface_stats (sm, sw_if_index, &stats);
+      if (stats.active_connections >= config->endpoint.max_connections)
+        {
+          clib_warning ("Maximum connections reached for interface %d",
+                        sw_if_index);
+          wi->connection_failures++;
+          return NULL;
+        }
     }
 
-  /* Lock for session pool operations */
-  clib_spinlock_lock (&sm->sessions_lock);
-
-  /* Allocate new session from pool */
-  pool_get_zero (sm->sessions, session);
-  session_index = session - sm->sessions;
+  /* Other threads may look the session up, the pool must not move
+   * under them */
+  pool_get_aligned_safe (wrk->sessions, session, CLIB_CACHE_LINE_BYTES);
+  clib_memset (session, 0, sizeof (*session));
 
   /* Initialize session */
-  session->session_index = session_index;
+  session->session_index = session - wrk->sessions;
+  session->thread_index = thread_index;
+  session->n_refs = 1;
   session->sw_if_index = sw_if_index;
   session->state = SINGBOX_STATE_IDLE;
   session->dst_addr = *dst_addr;
   session->dst_port = dst_port;
   session->endpoint = &config->endpoint;
-  session->last_activity = vlib_time_now (sm->vlib_main);
+  session->last_activity = vlib_time_now (vlib_get_main ());
   session->proxy_session_handle = SESSION_INVALID_HANDLE;
   session->client_session_handle = SESSION_INVALID_HANDLE;
 
-  /* Initialize buffers */
-  vec_reset_length (session->tx_buffer);
-  vec_reset_length (session->rx_buffer);
-
   /* Update statistics */
-  config->active_connections++;
-  config->total_connections++;
+  wi->active_connections++;
+  wi->total_connections++;
 
-  clib_spinlock_unlock (&sm->sessions_lock);
+  return session;
+}
 
-  if (sm->verbose)
+/**
+ * @brief Create a new session to sing-box proxy
+ */
+singbox_session_t *
+singbox_session_create (singbox_main_t *sm, ip4_address_t *dst_addr,
+                       u16 dst_port, u32 sw_if_index)
+{
+  singbox_session_t *session;
+
+  session = singbox_session_alloc (sm, dst_addr, dst_port, sw_if_index);
+
+  if (session && sm->verbose)
     {
       vlib_cli_output (sm->vlib_main, "Created session %d for %U:%d",
-                      session_index, format_ip4_address, dst_addr, dst_port);
+                      session->session_index, format_ip4_address, dst_addr,
+                      dst_port);
     }
 
   return session;
 }
 
 /**
- * @brief Delete a sing-box session
+ * @brief Release a session, from its owning thread
  */
 void
-singbox_session_delete (singbox_main_t *sm, singbox_session_t *session)
+singbox_session_free (singbox_main_t *sm, singbox_session_t *session)
 {
-  singbox_interface_config_t *config;
-
-  if (!session)
-    return;
-
-  config = singbox_get_interface_config (sm, session->sw_if_index);
-
-  if (sm->verbose)
-    {
-      vlib_cli_output (sm->vlib_main, "Deleting session %d",
-                      session->session_index);
-    }
+  singbox_wrk_interface_t *wi;
+  singbox_wrk_t *wrk;
 
-  clib_spinlock_lock (&sm->sessions_lock);
+  ASSERT (session->thread_index == vlib_get_thread_index ());
+  wrk = singbox_wrk_get (sm, session->thread_index);
+  wi = singbox_wrk_interface_get (wrk, session->sw_if_index);
 
-  /* Remove from hash tables */
-  if (session->client_session_handle != SESSION_INVALID_HANDLE)
+  /* Remove from hash tables, only the entries this thread owns */
+  if (session->client_session_handle != SESSION_INVALID_HANDLE &&
+      session_thread_from_handle (session->client_session_handle) ==
+        session->thread_index)
     {
-      hash_unset (sm->session_by_client_handle,
+      hash_unset (wrk->session_by_client_handle,
                  session->client_session_handle);
     }
 
-  if (session->proxy_session_handle != SESSION_INVALID_HANDLE)
+  if (session->proxy_session_handle != SESSION_INVALID_HANDLE &&
+      session_thread_from_handle (session->proxy_session_handle) ==
+        session->thread_index)
     {
-      hash_unset (sm->session_by_proxy_handle, session->proxy_session_handle);
+      hash_unset (wrk->session_by_proxy_handle,
+                  session->proxy_session_handle);
     }
 
   /* Free buffers */
@@ -128,16 +176,40 @@ singbox_session_delete (singbox_main_t *sm, singbox_session_t *session)
   vec_free (session->rx_buffer);
 
   /* Update statistics */
-  if (config)
+  if (wi && wi->active_connections > 0)
+    wi->active_connections--;
+
+  /* Return to pool */
+  pool_put (wrk->sessions, session);
+}
+
+/**
+ * @brief Delete a sing-box session
+ */
+void
+singbox_session_delete (singbox_main_t *sm, singbox_session_t *session)
+{
+  if (!session)
+    return;
+
+  if (sm->verbose)
     {
-      if (config->active_connections > 0)
-        config->active_connections--;
+      vlib_cli_output (sm->vlib_main, "Deleting session %d",
+                      session->session_index);
     }
 
-  /* Return to pool */
-  pool_put (sm->sessions, session);
+  singbox_session_free (sm, session);
+}
+
+static singbox_session_t *
+singbox_session_get_by_handle (singbox_main_t *sm, uword *h,
+                               session_handle_t handle)
+{
+  uword *p;
 
-  clib_spinlock_unlock (&sm->sessions_lock);
+  ASSERT (session_thread_from_handle (handle) == vlib_get_thread_index ());
+  p = hash_get (h, handle);
+  return p ? singbox_session_get_w_handle (sm, p[0]) : NULL;
 }
 
 /**
@@ -147,20 +219,11 @@ singbox_session_t *
 singbox_session_get_by_client (singbox_main_t *sm,
                               session_handle_t client_handle)
 {
-  uword *p;
-  singbox_session_t *session = NULL;
-
-  clib_spinlock_lock (&sm->sessions_lock);
+  singbox_wrk_t *wrk;
 
-  p = hash_get (sm->session_by_client_handle, client_handle);
-  if (p)
-    {
-      session = pool_elt_at_index (sm->sessions, p[0]);
-    }
-
-  clib_spinlock_unlock (&sm->sessions_lock);
-
-  return session;
+  wrk = singbox_wrk_get (sm, session_thread_from_handle (client_handle));
+  return singbox_session_get_by_handle (sm, wrk->session_by_client_handle,
+                                        client_handle);
 }
 
 /**
@@ -170,82 +233,78 @@ singbox_session_t *
 singbox_session_get_by_proxy (singbox_main_t *sm,
                              session_handle_t proxy_handle)
 {
-  uword *p;
-  singbox_session_t *session = NULL;
+  singbox_wrk_t *wrk;
 
-  clib_spinlock_lock (&sm->sessions_lock);
-
-  p = hash_get (sm->session_by_proxy_handle, proxy_handle);
-  if (p)
-    {
-      session = pool_elt_at_index (sm->sessions, p[0]);
-    }
-
-  clib_spinlock_unlock (&sm->sessions_lock);
-
-  return session;
+  wrk = singbox_wrk_get (sm, session_thread_from_handle (proxy_handle));
+  return singbox_session_get_by_handle (sm, wrk->session_by_proxy_handle,
+                                        proxy_handle);
 }
 
 /**
- * @brief Register client session handle
+ * @brief Register client session handle, from the handle's thread
  */
 int
 singbox_session_register_client (singbox_main_t *sm,
                                  singbox_session_t *session,
                                  session_handle_t client_handle)
 {
+  singbox_wrk_t *wrk;
+
   if (!session || client_handle == SESSION_INVALID_HANDLE)
     return -1;
 
-  clib_spinlock_lock (&sm->sessions_lock);
-
+  ASSERT (session_thread_from_handle (client_handle) ==
+          vlib_get_thread_index ());
+  wrk = singbox_wrk_get (sm, session_thread_from_handle (client_handle));
   session->client_session_handle = client_handle;
-  hash_set (sm->session_by_client_handle, client_handle,
-           session->session_index);
-
-  clib_spinlock_unlock (&sm->sessions_lock);
+  hash_set (wrk->session_by_client_handle, client_handle,
+           singbox_session_handle (session));
 
   return 0;
 }
 
 /**
- * @brief Register proxy session handle
+ * @brief Register proxy session handle, from the handle's thread
  */
 int
 singbox_session_register_proxy (singbox_main_t *sm,
                                 singbox_session_t *session,
                                 session_handle_t proxy_handle)
 {
+  singbox_wrk_t *wrk;
+
   if (!session || proxy_handle == SESSION_INVALID_HANDLE)
     return -1;
 
-  clib_spinlock_lock (&sm->sessions_lock);
-
+  ASSERT (session_thread_from_handle (proxy_handle) ==
+          vlib_get_thread_index ());
+  wrk = singbox_wrk_get (sm, session_thread_from_handle (proxy_handle));
   session->proxy_session_handle = proxy_handle;
-  hash_set (sm->session_by_proxy_handle, proxy_handle,
-           session->session_index);
-
-  clib_spinlock_unlock (&sm->sessions_lock);
+  hash_set (wrk->session_by_proxy_handle, proxy_handle,
+           singbox_session_handle (session));
 
   return 0;
 }
 
 /**
- * @brief Cleanup idle sessions (periodic callback)
+ * @brief Cleanup idle sessions of the calling thread (periodic callback)
  */
 void
 singbox_session_cleanup (singbox_main_t *sm)
 {
   singbox_session_t *session;
-  f64 now = vlib_time_now (sm->vlib_main);
+  singbox_wrk_t *wrk;
+  f64 now = vlib_time_now (vlib_get_main ());
   u32 timeout = sm->session_timeout;
   u32 *to_delete = NULL;
 
   if (timeout == 0)
     return;
 
+  wrk = singbox_wrk_get (sm, vlib_get_thread_index ());
+
   /* Identify sessions to delete */
-  pool_foreach (session, sm->sessions)
+  pool_foreach (session, wrk->sessions)
     {
       if (session->state == SINGBOX_STATE_ERROR ||
           session->state == SINGBOX_STATE_CLOSED ||
@@ -258,7 +317,7 @@ singbox_session_cleanup (singbox_main_t *sm)
   /* Delete identified sessions */
   for (int i = 0; i < vec_len (to_delete); i++)
     {
-      session = pool_elt_at_index (sm->sessions, to_delete[i]);
+      session = pool_elt_at_index (wrk->sessions, to_delete[i]);
       singbox_session_delete (sm, session);
     }
 
@@ -272,20 +331,12 @@ void
 singbox_session_get_stats (singbox_main_t *sm, u32 sw_if_index,
                           u32 *active, u64 *total, u64 *failures)
 {
-  singbox_interface_config_t *config;
+  singbox_interface_stats_t stats;
 
-  config = singbox_get_interface_config (sm, sw_if_index);
-  if (!config)
-    {
-      *active = 0;
-      *total = 0;
-      *failures = 0;
-      return;
-    }
-
-  *active = config->active_connections;
-  *total = config->total_connections;
-  *failures = config->connection_failures;
+  singbox_interface_stats (sm, sw_if_index, &stats);
+  *active = stats.active_connections;
+  *total = stats.total_connections;
+  *failures = stats.connection_failures;
 }
 
 /**
@@ -338,37 +389,110 @@ singbox_session_forward_to_client (singbox_main_t *sm,
 }
 
 /**
- * @brief Process connection pool
+ * @brief Check that a pooled proxy connection can still carry a flow
  *
- * Implements connection pooling to reuse established connections
- * to sing-box proxy for improved performance.
+ * An authenticated SOCKS5 connection must be silent until it is sent a
+ * request; anything in its rx fifo means the proxy gave up on it.
+ */
+static int
+singbox_session_pool_is_healthy (singbox_main_t *sm,
+                                 singbox_session_t *session, f64 now)
+{
+  session_t *s;
+
+  if (session->proxy_disconnected ||
+      now - session->last_activity > sm->pool_idle_timeout)
+    return 0;
+
+  s = session_get_from_handle_if_valid (session->proxy_session_handle);
+  if (!s || s->session_state != SESSION_STATE_READY)
+    return 0;
+
+  return svm_fifo_max_dequeue (s->rx_fifo) == 0;
+}
+
+/**
+ * @brief Take a warm proxy connection from the pool
  */
 singbox_session_t *
-singbox_session_get_from_pool (singbox_main_t *sm, ip4_address_t *dst_addr,
-                              u16 dst_port, u32 sw_if_index)
+singbox_session_get_from_pool (singbox_main_t *sm, u32 sw_if_index)
 {
-  singbox_interface_config_t *config;
+  singbox_wrk_interface_t *wi;
   singbox_session_t *session;
+  vnet_disconnect_args_t a = { 0 };
+  singbox_wrk_t *wrk;
+  f64 now;
 
   if (!sm->enable_pooling)
     return NULL;
 
-  config = singbox_get_interface_config (sm, sw_if_index);
-  if (!config)
+  wrk = singbox_wrk_get (sm, vlib_get_thread_index ());
+  if (!(wi = singbox_wrk_interface_get (wrk, sw_if_index)))
     return NULL;
 
-  /* Search for an established connection to the same destination */
-  pool_foreach (session, sm->sessions)
+  now = vlib_time_now (vlib_get_main ());
+
+  /* Most recently warmed first, older ones are left to expire */
+  while (vec_len (wi->connection_pool))
     {
-      if (session->sw_if_index == sw_if_index &&
-          session->state == SINGBOX_STATE_ESTABLISHED &&
-          session->dst_addr.as_u32 == dst_addr->as_u32 &&
-          session->dst_port == dst_port)
+      session = pool_elt_at_index (wrk->sessions,
+                                   vec_pop (wi->connection_pool));
+      wi->n_warm = vec_len (wi->connection_pool);
+      if (singbox_session_pool_is_healthy (sm, session, now))
         {
-          singbox_session_touch (sm, session);
+          session->is_pooled = 0;
+          wi->pool_hits++;
           return session;
         }
+
+      /* cleanup callback frees the session */
+      a.handle = session->proxy_session_handle;
+      a.app_index = sm->app_index;
+      vnet_disconnect_session (&a);
+      session->proxy_disconnected = 1;
     }
 
+  wi->pool_misses++;
   return NULL;
 }
+
+/**
+ * @brief Add a warm proxy connection to the pool
+ */
+void
+singbox_session_put_to_pool (singbox_main_t *sm, singbox_session_t *session)
+{
+  singbox_wrk_interface_t *wi;
+
+  ASSERT (session->thread_index == vlib_get_thread_index ());
+  wi = singbox_wrk_interface_get (singbox_wrk_get (sm, session->thread_index),
+                                  session->sw_if_index);
+  ASSERT (wi);
+
+  session->state = SINGBOX_STATE_POOLED;
+  session->last_activity = vlib_time_now (vlib_get_main ());
+  vec_add1 (wi->connection_pool, session->session_index);
+  wi->n_warm = vec_len (wi->connection_pool);
+}
+
+/**
+ * @brief Remove a session from the pool
+ */
+void
+singbox_session_remove_from_pool (singbox_main_t *sm,
+                                  singbox_session_t *session)
+{
+  singbox_wrk_interface_t *wi;
+  u32 i;
+
+  ASSERT (session->thread_index == vlib_get_thread_index ());
+  wi = singbox_wrk_interface_get (singbox_wrk_get (sm, session->thread_index),
+                                  session->sw_if_index);
+  if (!wi)
+    return;
+
+  i = vec_search (wi->connection_pool, session->session_index);
+  if (i != ~0)
+    vec_delete (wi->connection_pool, 1, i);
+  wi->n_warm = vec_len (wi->connection_pool);
+}
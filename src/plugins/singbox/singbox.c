@@ -51,7 +51,9 @@ singbox_enable_disable (singbox_main_t *sm, u32 sw_if_index,
                        int enable_disable, ip4_address_t *proxy_addr,
                        u16 proxy_port)
 {
+  vlib_main_t *vm = sm->vlib_main;
   vnet_sw_interface_t *sw;
+  singbox_wrk_t *wrk;
 
   /* Validate interface index */
   if (pool_is_free_index (sm->vnet_main->interface_main.sw_interfaces,
@@ -63,14 +65,28 @@ singbox_enable_disable (singbox_main_t *sm, u32 sw_if_index,
   if (sw->type != VNET_SW_INTERFACE_TYPE_HARDWARE)
     return VNET_API_ERROR_INVALID_SW_IF_INDEX;
 
-  /* Ensure interface config vector is large enough */
-  vec_validate_init_empty (sm->interface_configs, sw_if_index,
-                           (singbox_interface_config_t){ 0 });
+  /* Ensure interface vectors are large enough; workers index them
+   * without locks, so they may only move under the barrier */
+  if (sw_if_index >= vec_len (sm->interface_configs))
+    {
+      vlib_worker_thread_barrier_sync (vm);
+      vec_validate_init_empty (sm->interface_configs, sw_if_index,
+                               (singbox_interface_config_t){ 0 });
+      vec_foreach (wrk, sm->workers)
+        vec_validate (wrk->interfaces, sw_if_index);
+      vlib_worker_thread_barrier_release (vm);
+    }
 
   singbox_interface_config_t *config = &sm->interface_configs[sw_if_index];
 
   if (enable_disable)
     {
+      int rv;
+
+      /* Start the listener redirected flows are handed to */
+      if ((rv = singbox_redirect_enable (sm)))
+        return rv;
+
       /* Enable sing-box on this interface */
       config->endpoint.is_enabled = 1;
 
@@ -121,6 +137,29 @@ singbox_set_endpoint (singbox_main_t *sm, ip4_address_t *proxy_addr,
   return 0;
 }
 
+/**
+ * @brief Configure the warm proxy connection pool
+ */
+int
+singbox_set_pool (singbox_main_t *sm, u8 enable, u32 size, u32 idle_timeout)
+{
+  if (enable && (size == 0 || idle_timeout == 0))
+    return VNET_API_ERROR_INVALID_VALUE;
+
+  sm->enable_pooling = enable;
+  if (enable)
+    {
+      sm->pool_size = size;
+      sm->pool_idle_timeout = idle_timeout;
+    }
+
+  /* let the pool process drain or refill now rather than on its tick */
+  vlib_process_signal_event (sm->vlib_main, singbox_pool_process_node.index,
+                             0, 0);
+
+  return 0;
+}
+
 /**
  * @brief CLI command: singbox enable/disable
  */
@@ -217,6 +256,39 @@ singbox_set_endpoint_command_fn (vlib_main_t *vm,
   return 0;
 }
 
+/**
+ * @brief CLI command: configure the warm connection pool
+ */
+static clib_error_t *
+singbox_set_pool_command_fn (vlib_main_t *vm, unformat_input_t *input,
+                             vlib_cli_command_t *cmd)
+{
+  singbox_main_t *sm = &singbox_main;
+  u32 size = sm->pool_size;
+  u32 idle_timeout = sm->pool_idle_timeout;
+  u8 enable = 1;
+  int rv;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "size %u", &size))
+        ;
+      else if (unformat (input, "idle-timeout %u", &idle_timeout))
+        ;
+      else if (unformat (input, "disable"))
+        enable = 0;
+      else
+        return clib_error_return (0, "unknown input `%U'",
+                                  format_unformat_error, input);
+    }
+
+  rv = singbox_set_pool (sm, enable, size, idle_timeout);
+  if (rv != 0)
+    return clib_error_return (0, "Pool size and idle timeout must be > 0");
+
+  return 0;
+}
+
 /**
  * @brief CLI command: show sing-box statistics
  */
@@ -242,6 +314,7 @@ singbox_show_stats_command_fn (vlib_main_t *vm,
       /* Show stats for specific interface */
       singbox_interface_config_t *config =
         singbox_get_interface_config (sm, sw_if_index);
+      singbox_interface_stats_t stats;
 
       if (!config || !config->endpoint.is_enabled)
         {
@@ -250,17 +323,27 @@ singbox_show_stats_command_fn (vlib_main_t *vm,
           return 0;
         }
 
+      singbox_interface_stats (sm, sw_if_index, &stats);
+
       vlib_cli_output (vm, "Interface %U:", format_vnet_sw_if_index_name,
                       sm->vnet_main, sw_if_index);
       vlib_cli_output (vm, "  Proxy: %U:%d", format_ip4_address,
                       &config->endpoint.proxy_addr,
                       config->endpoint.proxy_port);
       vlib_cli_output (vm, "  Packets redirected: %llu",
-                      config->packets_redirected);
+                      stats.packets_redirected);
       vlib_cli_output (vm, "  Bytes redirected: %llu",
-                      config->bytes_redirected);
+                      stats.bytes_redirected);
       vlib_cli_output (vm, "  Connection failures: %llu",
-                      config->connection_failures);
+                      stats.connection_failures);
+      vlib_cli_output (vm, "  Connections: %u active, %llu total",
+                      stats.active_connections,
+                      stats.total_connections);
+      vlib_cli_output (vm, "  Pool: %u warm, %u pending, %llu hits, "
+                      "%llu misses",
+                      stats.n_warm,
+                      clib_atomic_load_acq_n (&config->pool_pending),
+                      stats.pool_hits, stats.pool_misses);
     }
   else
     {
@@ -271,20 +354,32 @@ singbox_show_stats_command_fn (vlib_main_t *vm,
                       sm->default_endpoint.proxy_port);
       vlib_cli_output (vm, "  Protocol: %s",
                       sm->default_endpoint.protocol_type == 0 ? "SOCKS5" : "HTTP");
+      if (sm->enable_pooling)
+        vlib_cli_output (vm, "  Pool: %u per worker, idle timeout %us",
+                        sm->pool_size, sm->pool_idle_timeout);
+      else
+        vlib_cli_output (vm, "  Pool: disabled");
       vlib_cli_output (vm, "\nPer-Interface Statistics:");
 
       vec_foreach_index (sw_if_index, sm->interface_configs)
         {
           singbox_interface_config_t *config = &sm->interface_configs[sw_if_index];
+          singbox_interface_stats_t stats;
           if (config->endpoint.is_enabled)
             {
+              singbox_interface_stats (sm, sw_if_index, &stats);
               vlib_cli_output (vm, "  Interface %U:",
                              format_vnet_sw_if_index_name,
                              sm->vnet_main, sw_if_index);
               vlib_cli_output (vm, "    Packets: %llu, Bytes: %llu, Failures: %llu",
-                             config->packets_redirected,
-                             config->bytes_redirected,
-                             config->connection_failures);
+                             stats.packets_redirected,
+                             stats.bytes_redirected,
+                             stats.connection_failures);
+              vlib_cli_output (vm, "    Connections: %u active, %llu total",
+                             stats.active_connections,
+                             stats.total_connections);
+              vlib_cli_output (vm, "    Pool: %u warm, %llu hits, %llu misses",
+                             stats.n_warm, stats.pool_hits, stats.pool_misses);
             }
         }
     }
@@ -292,6 +387,128 @@ singbox_show_stats_command_fn (vlib_main_t *vm,
   return 0;
 }
 
+/**
+ * @brief CLI command: start the SOCKS5 server
+ */
+static clib_error_t *
+singbox_server_start_command_fn (vlib_main_t *vm, unformat_input_t *input,
+                                 vlib_cli_command_t *cmd)
+{
+  singbox_main_t *sm = &singbox_main;
+  ip4_address_t listen_addr = { 0 };
+  u8 *username = 0, *password = 0;
+  u8 have_addr = 0;
+  u32 port = 0;
+  int rv;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "%U:%u", unformat_ip4_address, &listen_addr,
+                    &port))
+        have_addr = 1;
+      else if (unformat (input, "%U", unformat_ip4_address, &listen_addr))
+        have_addr = 1;
+      else if (unformat (input, "port %u", &port))
+        ;
+      else if (unformat (input, "auth username %s password %s", &username,
+                         &password))
+        ;
+      else
+        return clib_error_return (0, "unknown input `%U'",
+                                  format_unformat_error, input);
+    }
+
+  if (port > 65535)
+    return clib_error_return (0, "invalid port %u", port);
+
+  vec_add1 (username, 0);
+  vec_add1 (password, 0);
+  rv = singbox_server_start (sm, have_addr ? &listen_addr : NULL, port,
+                             vec_len (username) > 1, username, password);
+  vec_free (username);
+  vec_free (password);
+
+  switch (rv)
+    {
+    case 0:
+      break;
+    case VNET_API_ERROR_VALUE_EXIST:
+      return clib_error_return (0, "SOCKS5 server already running");
+    case VNET_API_ERROR_INVALID_VALUE:
+      return clib_error_return (0, "username and password must be 1 to "
+                                   "255 characters");
+    default:
+      return clib_error_return (0, "singbox_server_start returned %d", rv);
+    }
+
+  return 0;
+}
+
+/**
+ * @brief CLI command: stop the SOCKS5 server
+ */
+static clib_error_t *
+singbox_server_stop_command_fn (vlib_main_t *vm, unformat_input_t *input,
+                                vlib_cli_command_t *cmd)
+{
+  singbox_server_stop (&singbox_main);
+  return 0;
+}
+
+/**
+ * @brief SOCKS5 server statistics, summed over threads
+ */
+static void
+singbox_server_stats (singbox_main_t *sm, u64 *bytes_forwarded,
+                      u64 *udp_dgrams, u64 *udp_drops)
+{
+  singbox_wrk_t *wrk;
+
+  *bytes_forwarded = *udp_dgrams = *udp_drops = 0;
+  vec_foreach (wrk, sm->workers)
+    {
+      *bytes_forwarded += wrk->server_bytes_forwarded;
+      *udp_dgrams += wrk->server_udp_dgrams;
+      *udp_drops += wrk->server_udp_drops;
+    }
+}
+
+/**
+ * @brief CLI command: show SOCKS5 server state
+ */
+static clib_error_t *
+singbox_show_server_command_fn (vlib_main_t *vm, unformat_input_t *input,
+                                vlib_cli_command_t *cmd)
+{
+  singbox_main_t *sm = &singbox_main;
+  u64 bytes_forwarded, udp_dgrams, udp_drops;
+
+  if (!sm->server_mode_enabled)
+    {
+      vlib_cli_output (vm, "SOCKS5 server not running");
+      return 0;
+    }
+
+  singbox_server_stats (sm, &bytes_forwarded, &udp_dgrams, &udp_drops);
+  vlib_cli_output (vm, "SOCKS5 server on %U:%d, tcp and udp (auth: %s)",
+                   format_ip4_address, &sm->server_listen_addr,
+                   sm->server_listen_port,
+                   sm->server_require_auth ? "required" : "none");
+  vlib_cli_output (vm, "  Domain names: %s",
+                   sm->server_resolver.dns_resolve_name_ptr ? "dns plugin" :
+                                                              "unavailable");
+  vlib_cli_output (vm, "  Connections: %llu accepted, %llu rejected, "
+                   "%llu auth failures",
+                   sm->server_connections_accepted,
+                   sm->server_connections_rejected,
+                   sm->server_auth_failures);
+  vlib_cli_output (vm, "  Bytes forwarded: %llu", bytes_forwarded);
+  vlib_cli_output (vm, "  UDP datagrams: %llu relayed, %llu dropped",
+                   udp_dgrams, udp_drops);
+
+  return 0;
+}
+
 /* CLI command definitions */
 VLIB_CLI_COMMAND (singbox_enable_disable_command, static) = {
   .path = "singbox enable",
@@ -305,6 +522,31 @@ VLIB_CLI_COMMAND (singbox_set_endpoint_command, static) = {
   .function = singbox_set_endpoint_command_fn,
 };
 
+VLIB_CLI_COMMAND (singbox_set_pool_command, static) = {
+  .path = "singbox set pool",
+  .short_help = "singbox set pool [size <n>] [idle-timeout <sec>] [disable]",
+  .function = singbox_set_pool_command_fn,
+};
+
+VLIB_CLI_COMMAND (singbox_server_start_command, static) = {
+  .path = "singbox server start",
+  .short_help = "singbox server start [<ip>[:<port>]] [port <port>] "
+                "[auth username <user> password <pass>]",
+  .function = singbox_server_start_command_fn,
+};
+
+VLIB_CLI_COMMAND (singbox_server_stop_command, static) = {
+  .path = "singbox server stop",
+  .short_help = "singbox server stop",
+  .function = singbox_server_stop_command_fn,
+};
+
+VLIB_CLI_COMMAND (singbox_show_server_command, static) = {
+  .path = "show singbox server",
+  .short_help = "show singbox server",
+  .function = singbox_show_server_command_fn,
+};
+
 VLIB_CLI_COMMAND (singbox_show_stats_command, static) = {
   .path = "show singbox",
   .short_help = "show singbox [<interface>]",
@@ -354,16 +596,19 @@ vl_api_singbox_get_stats_t_handler (vl_api_singbox_get_stats_t *mp)
   int rv = 0;
   u32 sw_if_index = ntohl (mp->sw_if_index);
   singbox_interface_config_t *config;
+  singbox_interface_stats_t stats;
 
   config = singbox_get_interface_config (sm, sw_if_index);
+  if (config)
+    singbox_interface_stats (sm, sw_if_index, &stats);
 
   REPLY_MACRO2 (VL_API_SINGBOX_GET_STATS_REPLY,
   ({
     if (config && config->endpoint.is_enabled)
       {
-        rmp->packets_redirected = clib_host_to_net_u64 (config->packets_redirected);
-        rmp->bytes_redirected = clib_host_to_net_u64 (config->bytes_redirected);
-        rmp->connection_failures = clib_host_to_net_u64 (config->connection_failures);
+        rmp->packets_redirected = clib_host_to_net_u64 (stats.packets_redirected);
+        rmp->bytes_redirected = clib_host_to_net_u64 (stats.bytes_redirected);
+        rmp->connection_failures = clib_host_to_net_u64 (stats.connection_failures);
       }
     else
       {
@@ -372,6 +617,60 @@ vl_api_singbox_get_stats_t_handler (vl_api_singbox_get_stats_t *mp)
   }));
 }
 
+static void
+vl_api_singbox_server_start_t_handler (vl_api_singbox_server_start_t *mp)
+{
+  vl_api_singbox_server_start_reply_t *rmp;
+  singbox_main_t *sm = &singbox_main;
+  ip4_address_t listen_addr;
+  int rv;
+
+  clib_memcpy (&listen_addr, &mp->listen_addr, sizeof (ip4_address_t));
+  mp->username[sizeof (mp->username) - 1] = 0;
+  mp->password[sizeof (mp->password) - 1] = 0;
+
+  rv = singbox_server_start (sm, listen_addr.as_u32 ? &listen_addr : NULL,
+                             ntohs (mp->listen_port), mp->require_auth,
+                             mp->username, mp->password);
+
+  REPLY_MACRO (VL_API_SINGBOX_SERVER_START_REPLY);
+}
+
+static void
+vl_api_singbox_server_stop_t_handler (vl_api_singbox_server_stop_t *mp)
+{
+  vl_api_singbox_server_stop_reply_t *rmp;
+  singbox_main_t *sm = &singbox_main;
+  int rv;
+
+  rv = singbox_server_stop (sm);
+
+  REPLY_MACRO (VL_API_SINGBOX_SERVER_STOP_REPLY);
+}
+
+static void
+vl_api_singbox_server_get_stats_t_handler (
+  vl_api_singbox_server_get_stats_t *mp)
+{
+  vl_api_singbox_server_get_stats_reply_t *rmp;
+  singbox_main_t *sm = &singbox_main;
+  u64 bytes_forwarded, udp_dgrams, udp_drops;
+  int rv = 0;
+
+  singbox_server_stats (sm, &bytes_forwarded, &udp_dgrams, &udp_drops);
+
+  REPLY_MACRO2 (VL_API_SINGBOX_SERVER_GET_STATS_REPLY,
+  ({
+    rmp->is_running = sm->server_mode_enabled;
+    rmp->connections_accepted =
+      clib_host_to_net_u64 (sm->server_connections_accepted);
+    rmp->connections_rejected =
+      clib_host_to_net_u64 (sm->server_connections_rejected);
+    rmp->auth_failures = clib_host_to_net_u64 (sm->server_auth_failures);
+    rmp->bytes_forwarded = clib_host_to_net_u64 (bytes_forwarded);
+  }));
+}
+
 /* API definitions */
 #include <singbox/singbox.api.c>
 
@@ -389,6 +688,26 @@ singbox_init (vlib_main_t *vm)
   /* Initialize default endpoint to zeros */
   clib_memset (&sm->default_endpoint, 0, sizeof (singbox_endpoint_t));
 
+  /* Sessions and counters are kept per thread */
+  vec_validate_aligned (sm->workers, vlib_get_n_threads () - 1,
+                        CLIB_CACHE_LINE_BYTES);
+
+  /* Redirection starts with the first enabled interface */
+  sm->app_index = APP_INVALID_INDEX;
+  sm->redirect_app_index = APP_INVALID_INDEX;
+  sm->redirect_listener_index = ~0;
+
+  /* SOCKS5 server is started on request */
+  sm->server_app_index = APP_INVALID_INDEX;
+  sm->server_connect_app_index = APP_INVALID_INDEX;
+  sm->server_listener_handle = SESSION_INVALID_HANDLE;
+  sm->server_udp_listener_handle = SESSION_INVALID_HANDLE;
+
+  /* Keep a few authenticated proxy connections ready for new flows */
+  sm->enable_pooling = 1;
+  sm->pool_size = 4;
+  sm->pool_idle_timeout = 10;
+
   /* Add our API messages to the global name_crc hash table */
   sm->msg_id_base = setup_message_id_table ();
 
@@ -24,11 +24,14 @@
 #include <vnet/session/session.h>
 #include <vnet/session/application.h>
 #include <vnet/session/application_interface.h>
+#include <plugins/dns/dns_cache_resolve.h>
 #include <vppinfra/hash.h>
 #include <vppinfra/error.h>
 #include <vppinfra/elog.h>
 #include <vppinfra/pool.h>
 #include <vppinfra/bihash_16_8.h>
+#include <vppinfra/bihash_8_8.h>
+#include <vppinfra/bihash_template.h>
 
 #define SINGBOX_PLUGIN_BUILD_VER "2.0.0"
 
@@ -53,6 +56,11 @@
 #define SOCKS5_ATYP_DOMAINNAME 0x03
 #define SOCKS5_ATYP_IPV6 0x04
 #define SOCKS5_REP_SUCCESS 0x00
+#define SOCKS5_REP_GENERAL_FAILURE 0x01
+#define SOCKS5_REP_HOST_UNREACHABLE 0x04
+#define SOCKS5_REP_CONNECTION_REFUSED 0x05
+#define SOCKS5_REP_COMMAND_NOT_SUPPORTED 0x07
+#define SOCKS5_REP_ADDRESS_TYPE_NOT_SUPPORTED 0x08
 
 /* Connection States */
 #define foreach_singbox_session_state     \
@@ -62,6 +70,7 @@
   _(SOCKS5_AUTH, "socks5-auth")          \
   _(SOCKS5_REQUEST, "socks5-request")    \
   _(SOCKS5_RESPONSE, "socks5-response")  \
+  _(POOLED, "pooled")                    \
   _(ESTABLISHED, "established")          \
   _(ERROR, "error")                      \
   _(CLOSED, "closed")
@@ -150,9 +159,15 @@ typedef struct
   /** Error count */
   u32 error_count;
 
-  /** Session index */
+  /** Session index in the owning thread's pool */
   u32 session_index;
 
+  /** Owning thread, the intercepted client's */
+  u32 thread_index;
+
+  /** Sides still holding the session, it is freed when none is left */
+  u32 n_refs;
+
   /** Interface index */
   u32 sw_if_index;
 
@@ -166,8 +181,136 @@ typedef struct
   u8 *tx_buffer;
   u8 *rx_buffer;
 
+  /* ========== TRANSPARENT REDIRECTION ========== */
+
+  /** Intercepted client session fifos, shared with the proxy session */
+  svm_fifo_t *client_rx_fifo;
+  svm_fifo_t *client_tx_fifo;
+
+  /** Client congestion window, held at zero until the SOCKS5 reply */
+  u32 client_cwnd;
+
+  /** Thread the intercepted client session lives on */
+  u32 client_thread_index;
+
+  /** Proxy connect in progress */
+  volatile int proxy_connecting;
+
+  /** Sides already disconnected */
+  volatile int client_disconnected;
+  volatile int proxy_disconnected;
+
+  /** Warm proxy connection not yet handed to a flow */
+  u8 is_pooled;
+
+  /* ========== SERVER MODE ========== */
+
+  /** Command of the client's SOCKS5 request */
+  u8 cmd;
+
+  /** Reply code sent if the request fails */
+  u8 reply;
+
+  /** Requested destination, dst_port holds its port */
+  u8 dst_is_ip4;
+  ip46_address_t dst_ip;
+
+  /** Requested destination name, resolved into dst_ip */
+  u8 *dst_name;
+
+  /** UDP ASSOCIATE: association table key, 0 if none */
+  u64 udp_assoc_key;
+
 } singbox_session_t;
 
+/**
+ * @brief SOCKS5 UDP association
+ *
+ * Created when the client's first datagram reaches the relay port, and
+ * owned by the thread of that UDP session, which relays all datagrams
+ * of the association in both directions.
+ */
+typedef struct
+{
+  /** Client's UDP session to the relay port */
+  session_handle_t session_handle;
+
+  /** Association table key; the association ends when the key no
+   *  longer maps to the server session that requested it */
+  u64 key;
+  u32 control_handle;
+
+  /** Association index in the owning thread's pool */
+  u32 assoc_index;
+
+  /** Destination as SOCKS5 ATYP, DST.ADDR and DST.PORT -> flow index */
+  uword *flow_by_addr;
+
+  /** Flows not freed yet, the association outlives them */
+  u32 n_flows;
+
+  /** Client session is gone */
+  u8 is_closed;
+
+} singbox_udp_assoc_t;
+
+#define foreach_singbox_udp_flow_state \
+  _(RESOLVING, "resolving")            \
+  _(CONNECTING, "connecting")          \
+  _(READY, "ready")                    \
+  _(CLOSED, "closed")
+
+typedef enum
+{
+#define _(s, str) SINGBOX_UDP_FLOW_##s,
+  foreach_singbox_udp_flow_state
+#undef _
+} singbox_udp_flow_state_t;
+
+/**
+ * @brief Destination of a UDP association
+ *
+ * Each destination gets a connected UDP session of its own, so replies
+ * are matched by the transport and may land on any thread. The flow
+ * stays with its association's thread, which alone touches its fifos.
+ */
+typedef struct
+{
+  /** Outbound session fifos, set once connected */
+  svm_fifo_t *rx_fifo;
+  svm_fifo_t *tx_fifo;
+
+  /** Destination as SOCKS5 ATYP, DST.ADDR and DST.PORT, heads replies */
+  u8 *addr;
+
+  /** Resolved destination */
+  ip46_address_t ip;
+  u16 port;
+  u8 is_ip4;
+
+  /** Datagrams held while resolving or connecting, length prefixed */
+  u8 *pending;
+
+  /** Timestamp of last datagram either way */
+  f64 last_activity;
+
+  /** Owning association */
+  u32 assoc_index;
+
+  /** Flow index in the owning thread's pool */
+  u32 flow_index;
+
+  /** singbox_udp_flow_state_t */
+  u8 state;
+
+  /** Datagrams enqueued in this batch, tx event still due */
+  u8 tx_pending;
+
+  /** Replies wait for the owning thread to drain them */
+  volatile u8 rx_pending;
+
+} singbox_udp_flow_t;
+
 /**
  * @brief Per-interface sing-box configuration
  */
@@ -176,6 +319,28 @@ typedef struct
   /** Endpoint configuration */
   singbox_endpoint_t endpoint;
 
+  /** Pool connections still being established, updated atomically */
+  u32 pool_pending;
+
+} singbox_interface_config_t;
+
+/**
+ * @brief Per-thread state of an interface
+ *
+ * Only written by its thread. Readers on other threads fold the
+ * counters of all threads and live with slightly stale values.
+ */
+typedef struct
+{
+  /** Warm proxy connections on this thread, session indices */
+  u32 *connection_pool;
+
+  /** Length of connection_pool, for readers on other threads */
+  u32 n_warm;
+
+  /** Statistics: active connections owned by this thread */
+  u32 active_connections;
+
   /** Statistics: packets redirected */
   u64 packets_redirected;
 
@@ -185,19 +350,75 @@ typedef struct
   /** Statistics: connection failures */
   u64 connection_failures;
 
-  /** Statistics: active connections */
-  u32 active_connections;
-
   /** Statistics: total connections */
   u64 total_connections;
 
-  /** Connection pool */
-  u32 *connection_pool;
+  /** Statistics: flows served from / missed by the pool */
+  u64 pool_hits;
+  u64 pool_misses;
 
-  /** Free connection indices */
-  u32 *free_indices;
+} singbox_wrk_interface_t;
 
-} singbox_interface_config_t;
+/**
+ * @brief Interface counters folded over all threads
+ */
+typedef struct
+{
+  u64 packets_redirected;
+  u64 bytes_redirected;
+  u64 connection_failures;
+  u64 total_connections;
+  u64 pool_hits;
+  u64 pool_misses;
+  u32 active_connections;
+  u32 n_warm;
+} singbox_interface_stats_t;
+
+/**
+ * @brief Per-thread sing-box state
+ */
+typedef struct
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+
+  /** Sessions owned by this thread */
+  singbox_session_t *sessions;
+
+  /** Per-interface state, indexed by sw_if_index */
+  singbox_wrk_interface_t *interfaces;
+
+  /** Session handles of this thread -> sing-box session handle */
+  uword *session_by_client_handle;
+  uword *session_by_proxy_handle;
+
+  /** Warm connections given to flows whose accept is still due */
+  u32 *handoffs;
+
+  /** Redirected SYNs whose accept is still due: 4-tuple -> rx interface,
+   *  and the second the SYN came in */
+  clib_bihash_16_8_t syn_interfaces;
+
+  /** SOCKS5 server sessions owned by this thread */
+  singbox_session_t *server_sessions;
+
+  /** SOCKS5 UDP associations and their flows */
+  singbox_udp_assoc_t *udp_assocs;
+  singbox_udp_flow_t *udp_flows;
+
+  /** Flows with datagrams enqueued in the current batch */
+  u32 *udp_flows_tx;
+
+  /** Scratch key for flow lookups */
+  u8 *udp_addr;
+
+  /** Statistics: bytes relayed by the SOCKS5 server */
+  u64 server_bytes_forwarded;
+
+  /** Statistics: datagrams relayed / dropped by the SOCKS5 server */
+  u64 server_udp_dgrams;
+  u64 server_udp_drops;
+
+} singbox_wrk_t;
 
 /**
  * @brief Main sing-box plugin runtime structure
@@ -222,26 +443,17 @@ typedef struct
   /** Convenience - cached vlib main pointer */
   vlib_main_t *vlib_main;
 
-  /** Session pool */
-  singbox_session_t *sessions;
-
-  /** Session hash table: client_session_handle -> session_index */
-  uword *session_by_client_handle;
-
-  /** Session hash table: proxy_session_handle -> session_index */
-  uword *session_by_proxy_handle;
-
-  /** Application index for session layer */
+  /** Application index for session layer, connects to the proxy */
   u32 app_index;
 
-  /** Worker thread index */
-  u32 *wrk_index;
+  /** Application accepting intercepted flows */
+  u32 redirect_app_index;
 
-  /** Per-worker session pools */
-  singbox_session_t **wrk_sessions;
+  /** Wildcard listener transport connection, ~0 until started */
+  u32 redirect_listener_index;
 
-  /** Lock for session management */
-  clib_spinlock_t sessions_lock;
+  /** Per-thread sessions and counters, indexed by thread */
+  singbox_wrk_t *workers;
 
   /** Session timeout (seconds) */
   u32 session_timeout;
@@ -252,6 +464,12 @@ typedef struct
   /** Enable connection pooling */
   u8 enable_pooling;
 
+  /** Warm proxy connections kept per worker and interface */
+  u32 pool_size;
+
+  /** Seconds a warm connection may wait for a flow */
+  u32 pool_idle_timeout;
+
   /** Enable verbose logging */
   u8 verbose;
 
@@ -284,20 +502,23 @@ typedef struct
   /** Server password length */
   u8 server_password_len;
 
-  /** Server session pool for inbound connections */
-  singbox_session_t *server_sessions;
+  /** Application connecting CONNECT requests to their destination */
+  u32 server_connect_app_index;
+
+  /** TCP listener and UDP relay listener */
+  session_handle_t server_listener_handle;
+  session_handle_t server_udp_listener_handle;
 
-  /** Server session hash: session_handle -> session_index */
-  uword *server_session_by_handle;
+  /** UDP associations: client address and port -> server session handle */
+  clib_bihash_8_8_t udp_assoc_table;
 
-  /** Server lock */
-  clib_spinlock_t server_lock;
+  /** Destination names, looked up in the dns plugin's cache */
+  dns_cache_resolver_t server_resolver;
 
-  /** Server statistics */
+  /** Server statistics, updated atomically */
   u64 server_connections_accepted;
   u64 server_connections_rejected;
   u64 server_auth_failures;
-  u64 server_bytes_forwarded;
 
 } singbox_main_t;
 
@@ -308,6 +529,8 @@ extern singbox_main_t singbox_main;
 extern vlib_node_registration_t singbox_node;
 extern vlib_node_registration_t singbox_punt_node;
 extern vlib_node_registration_t singbox_inject_node;
+extern vlib_node_registration_t singbox_pool_process_node;
+extern vlib_node_registration_t singbox_server_process_node;
 
 /**
  * @brief Enable/disable sing-box on an interface
@@ -338,6 +561,8 @@ int singbox_set_endpoint (singbox_main_t *sm, ip4_address_t *proxy_addr,
 /**
  * @brief Create a new session to sing-box proxy
  *
+ * The session is owned by the calling thread.
+ *
  * @param sm - sing-box main structure
  * @param dst_addr - Destination address
  * @param dst_port - Destination port
@@ -349,7 +574,7 @@ singbox_session_t *singbox_session_create (singbox_main_t *sm,
                                            u16 dst_port, u32 sw_if_index);
 
 /**
- * @brief Delete a sing-box session
+ * @brief Delete a sing-box session, from its owning thread
  *
  * @param sm - sing-box main structure
  * @param session - Session to delete
@@ -357,7 +582,60 @@ singbox_session_t *singbox_session_create (singbox_main_t *sm,
 void singbox_session_delete (singbox_main_t *sm, singbox_session_t *session);
 
 /**
- * @brief Get session by client handle
+ * @brief Allocate a session owned by the calling thread
+ *
+ * @param sm - sing-box main structure
+ * @param dst_addr - Destination address
+ * @param dst_port - Destination port
+ * @param sw_if_index - Interface index
+ * @return session pointer or NULL on failure
+ */
+singbox_session_t *singbox_session_alloc (singbox_main_t *sm,
+                                          ip4_address_t *dst_addr,
+                                          u16 dst_port, u32 sw_if_index);
+
+/**
+ * @brief Free a session, from its owning thread
+ *
+ * @param sm - sing-box main structure
+ * @param session - Session to free
+ */
+void singbox_session_free (singbox_main_t *sm, singbox_session_t *session);
+
+/**
+ * @brief Take a warm proxy connection owned by the calling thread
+ *
+ * The flow's session will share the connection's fifos, so only this
+ * thread's pool is considered. Connections that went stale while
+ * pooled are closed and skipped.
+ *
+ * @param sm - sing-box main structure
+ * @param sw_if_index - Interface index
+ * @return session pointer or NULL if the pool is empty
+ */
+singbox_session_t *singbox_session_get_from_pool (singbox_main_t *sm,
+                                                  u32 sw_if_index);
+
+/**
+ * @brief Add a warm proxy connection to its thread's pool
+ *
+ * @param sm - sing-box main structure
+ * @param session - Session with an authenticated proxy connection
+ */
+void singbox_session_put_to_pool (singbox_main_t *sm,
+                                  singbox_session_t *session);
+
+/**
+ * @brief Remove a session from its thread's pool
+ *
+ * @param sm - sing-box main structure
+ * @param session - Pooled session
+ */
+void singbox_session_remove_from_pool (singbox_main_t *sm,
+                                       singbox_session_t *session);
+
+/**
+ * @brief Get session by client handle, from the handle's thread
  *
  * @param sm - sing-box main structure
  * @param client_handle - Client session handle
@@ -367,7 +645,7 @@ singbox_session_t *singbox_session_get_by_client (singbox_main_t *sm,
                                                   session_handle_t client_handle);
 
 /**
- * @brief Get session by proxy handle
+ * @brief Get session by proxy handle, from the handle's thread
  *
  * @param sm - sing-box main structure
  * @param proxy_handle - Proxy session handle
@@ -376,6 +654,16 @@ singbox_session_t *singbox_session_get_by_client (singbox_main_t *sm,
 singbox_session_t *singbox_session_get_by_proxy (singbox_main_t *sm,
                                                  session_handle_t proxy_handle);
 
+/**
+ * @brief Fold an interface's per-thread counters
+ *
+ * @param sm - sing-box main structure
+ * @param sw_if_index - Interface index
+ * @param stats - Filled with the totals of all threads
+ */
+void singbox_interface_stats (singbox_main_t *sm, u32 sw_if_index,
+                              singbox_interface_stats_t *stats);
+
 /**
  * @brief Send SOCKS5 greeting
  *
@@ -418,6 +706,58 @@ int singbox_socks5_process_response (singbox_main_t *sm,
                                      singbox_session_t *session, u8 *data,
                                      u32 len);
 
+/** Parts of a pipelined SOCKS5 handshake */
+#define SINGBOX_SOCKS5_GREETING (1 << 0)
+#define SINGBOX_SOCKS5_CONNECT  (1 << 1)
+
+/**
+ * @brief Write a pipelined SOCKS5 handshake to a fifo
+ *
+ * @param f - Fifo the proxy connection will transmit from
+ * @param ep - Endpoint the handshake is for
+ * @param dst_addr - Destination address for CONNECT
+ * @param dst_port - Destination port for CONNECT (host byte order)
+ * @param parts - SINGBOX_SOCKS5_GREETING and/or SINGBOX_SOCKS5_CONNECT
+ * @return 0 on success, -1 if the fifo has no room
+ */
+int singbox_socks5_write_request (svm_fifo_t *f, singbox_endpoint_t *ep,
+                                  ip4_address_t *dst_addr, u16 dst_port,
+                                  u8 parts);
+
+/**
+ * @brief Consume the replies to a pipelined SOCKS5 handshake
+ *
+ * @param f - Fifo the proxy connection receives into
+ * @param ep - Endpoint the handshake was written for
+ * @param parts - Parts of the handshake that were written
+ * @return bytes consumed on success, 0 if incomplete, -1 on failure
+ */
+int singbox_socks5_read_reply (svm_fifo_t *f, singbox_endpoint_t *ep,
+                               u8 parts);
+
+/**
+ * @brief Start transparent TCP redirection
+ *
+ * Attaches the redirect applications and opens the wildcard listener
+ * intercepted flows are handed to. Idempotent.
+ *
+ * @param sm - sing-box main structure
+ * @return 0 on success, error code otherwise
+ */
+int singbox_redirect_enable (singbox_main_t *sm);
+
+/**
+ * @brief Configure the warm proxy connection pool
+ *
+ * @param sm - sing-box main structure
+ * @param enable - 0 closes pooled connections and stops warming new ones
+ * @param size - Warm connections per worker and interface
+ * @param idle_timeout - Seconds before an unused connection is closed
+ * @return 0 on success, error code otherwise
+ */
+int singbox_set_pool (singbox_main_t *sm, u8 enable, u32 size,
+                      u32 idle_timeout);
+
 /**
  * @brief Get interface configuration
  *
@@ -433,6 +773,71 @@ singbox_get_interface_config (singbox_main_t *sm, u32 sw_if_index)
   return &sm->interface_configs[sw_if_index];
 }
 
+/** Session handles pack the owning thread above the pool index */
+#define SINGBOX_SESSION_INDEX_BITS 24
+#define SINGBOX_SESSION_INDEX_MASK ((1 << SINGBOX_SESSION_INDEX_BITS) - 1)
+
+static inline u32
+singbox_session_handle (singbox_session_t *session)
+{
+  return session->thread_index << SINGBOX_SESSION_INDEX_BITS |
+         session->session_index;
+}
+
+static inline singbox_wrk_t *
+singbox_wrk_get (singbox_main_t *sm, u32 thread_index)
+{
+  return vec_elt_at_index (sm->workers, thread_index);
+}
+
+/**
+ * @brief Get a session from its handle, NULL if it was freed
+ *
+ * Only the owning thread allocates and frees a session, but the pools
+ * never move under other threads, so any thread that holds a reference
+ * to the session may look it up.
+ */
+static inline singbox_session_t *
+singbox_session_get_w_handle (singbox_main_t *sm, u32 handle)
+{
+  singbox_wrk_t *wrk;
+  u32 session_index = handle & SINGBOX_SESSION_INDEX_MASK;
+
+  wrk = singbox_wrk_get (sm, handle >> SINGBOX_SESSION_INDEX_BITS);
+  if (pool_is_free_index (wrk->sessions, session_index))
+    return NULL;
+  return pool_elt_at_index (wrk->sessions, session_index);
+}
+
+/**
+ * @brief Get a thread's state for an interface
+ *
+ * The per-thread interface vectors are only resized with the workers
+ * stopped, when sing-box is enabled on an interface.
+ */
+static inline singbox_wrk_interface_t *
+singbox_wrk_interface_get (singbox_wrk_t *wrk, u32 sw_if_index)
+{
+  if (sw_if_index >= vec_len (wrk->interfaces))
+    return NULL;
+  return &wrk->interfaces[sw_if_index];
+}
+
+/**
+ * @brief Key of a redirected flow in a thread's SYN table
+ *
+ * Addresses and ports are in network order, as the SYN carries them and
+ * as the accepted connection keeps them.
+ */
+static_always_inline void
+singbox_syn_key (clib_bihash_kv_16_8_t *kv, const ip4_address_t *client,
+                 const ip4_address_t *server, u16 client_port,
+                 u16 server_port)
+{
+  kv->key[0] = (u64) client->as_u32 << 32 | server->as_u32;
+  kv->key[1] = (u64) client_port << 16 | server_port;
+}
+
 /* ========== SERVER MODE FUNCTIONS ========== */
 
 /**
@@ -463,9 +868,10 @@ int singbox_server_stop (singbox_main_t *sm);
  *
  * @param sm - sing-box main structure
  * @param session - Server session
- * @param data - Request data
+ * @param data - Received data
  * @param len - Data length
- * @return 0 on success, error code otherwise
+ * @return bytes consumed, 0 if incomplete, -1 if the client is refused;
+ *         the reply is left in the session's tx_buffer
  */
 int singbox_server_process_greeting (singbox_main_t *sm,
                                      singbox_session_t *session, u8 *data,
@@ -476,27 +882,78 @@ int singbox_server_process_greeting (singbox_main_t *sm,
  *
  * @param sm - sing-box main structure
  * @param session - Server session
- * @param data - Auth data
+ * @param data - Received data
  * @param len - Data length
- * @return 0 on success, error code otherwise
+ * @return bytes consumed, 0 if incomplete, -1 if the client is refused;
+ *         the reply is left in the session's tx_buffer
  */
 int singbox_server_process_auth (singbox_main_t *sm,
                                  singbox_session_t *session, u8 *data,
                                  u32 len);
 
 /**
- * @brief Process SOCKS5 server connect request from client
+ * @brief Process SOCKS5 server request from client
+ *
+ * Stores the command and destination in the session. Only a refused
+ * request gets its reply here, the others are answered once served.
  *
  * @param sm - sing-box main structure
  * @param session - Server session
- * @param data - Connect request data
+ * @param data - Received data
  * @param len - Data length
- * @return 0 on success, error code otherwise
+ * @return bytes consumed, 0 if incomplete, -1 if the request is refused;
+ *         the reply is left in the session's tx_buffer
  */
-int singbox_server_process_connect (singbox_main_t *sm,
+int singbox_server_process_request (singbox_main_t *sm,
                                     singbox_session_t *session, u8 *data,
                                     u32 len);
 
+/**
+ * @brief Length of a SOCKS5 ATYP, DST.ADDR and DST.PORT
+ *
+ * @return length, 0 if incomplete, -1 for an unknown address type
+ */
+int singbox_socks5_addr_len (u8 *data, u32 len);
+
+/**
+ * @brief Decode a SOCKS5 ATYP, DST.ADDR and DST.PORT
+ *
+ * @param addr - Address, checked by singbox_socks5_addr_len
+ * @param name - Set to the domain name, a new vector, if the address
+ *               is one; the ip is left alone then
+ */
+void singbox_socks5_addr_decode (u8 *addr, u8 *is_ip4, ip46_address_t *ip,
+                                 u8 **name, u16 *port);
+
+/** Handles of UDP associations and flows, as for sessions */
+static inline u32
+singbox_udp_handle (u32 thread_index, u32 index)
+{
+  return thread_index << SINGBOX_SESSION_INDEX_BITS | index;
+}
+
+/**
+ * @brief UDP association table key
+ *
+ * @param port - Client port in network order, 0 for any
+ */
+static inline u64
+singbox_udp_assoc_key (ip4_address_t *addr, u16 port)
+{
+  return (u64) addr->as_u32 << 16 | port;
+}
+
+/* socks5_udp.c */
+int singbox_server_udp_accept (singbox_main_t *sm, session_t *s);
+int singbox_server_udp_rx (singbox_main_t *sm, session_t *s);
+int singbox_server_udp_connected (singbox_main_t *sm, u32 opaque,
+                                  session_t *s, session_error_t err);
+void singbox_server_udp_close (singbox_main_t *sm, session_t *s);
+void singbox_server_udp_cleanup (singbox_main_t *sm, session_t *s);
+void singbox_server_udp_expire (singbox_main_t *sm, singbox_wrk_t *wrk,
+                                f64 now);
+void singbox_server_udp_reset (singbox_wrk_t *wrk);
+
 /**
  * @brief Format session state
  */
@@ -338,6 +338,138 @@ singbox_socks5_process_response (singbox_main_t *sm,
   return rv;
 }
 
+static inline int
+singbox_socks5_uses_auth (singbox_endpoint_t *ep)
+{
+  return ep->auth_method == SOCKS5_AUTH_USERNAME_PASSWORD &&
+         ep->username_len;
+}
+
+/**
+ * @brief Write a pipelined SOCKS5 handshake to a fifo
+ *
+ * Greeting, username/password auth (if configured) and CONNECT are
+ * written back to back without waiting for the replies. Only one method
+ * is offered, so the server's choice is known in advance and the whole
+ * handshake costs a single round trip. Pooled connections send the
+ * greeting ahead of time and only the CONNECT once a flow shows up.
+ */
+int
+singbox_socks5_write_request (svm_fifo_t *f, singbox_endpoint_t *ep,
+                              ip4_address_t *dst_addr, u16 dst_port,
+                              u8 parts)
+{
+  u8 req[3 + 3 + 255 + 255 + 10], *p = req;
+  int len;
+
+  if (parts & SINGBOX_SOCKS5_GREETING)
+    {
+      *p++ = SOCKS5_VERSION;
+      *p++ = 1; /* NMETHODS */
+      if (singbox_socks5_uses_auth (ep))
+        {
+          *p++ = SOCKS5_AUTH_USERNAME_PASSWORD;
+
+          /* RFC 1929 request */
+          *p++ = 0x01;
+          *p++ = ep->username_len;
+          clib_memcpy_fast (p, ep->username, ep->username_len);
+          p += ep->username_len;
+          *p++ = ep->password_len;
+          clib_memcpy_fast (p, ep->password, ep->password_len);
+          p += ep->password_len;
+        }
+      else
+        *p++ = SOCKS5_AUTH_NONE;
+    }
+
+  if (parts & SINGBOX_SOCKS5_CONNECT)
+    {
+      *p++ = SOCKS5_VERSION;
+      *p++ = SOCKS5_CMD_CONNECT;
+      *p++ = 0x00;
+      *p++ = SOCKS5_ATYP_IPV4;
+      clib_memcpy_fast (p, dst_addr->as_u8, 4);
+      p += 4;
+      *p++ = (dst_port >> 8) & 0xff;
+      *p++ = dst_port & 0xff;
+    }
+
+  len = p - req;
+  if (svm_fifo_enqueue (f, len, req) != len)
+    return -1;
+
+  return 0;
+}
+
+/**
+ * @brief Consume the replies to a pipelined SOCKS5 handshake
+ *
+ * Replies are only peeked until all expected ones are complete, then
+ * dropped from the fifo in one go so that everything behind them is
+ * payload.
+ */
+int
+singbox_socks5_read_reply (svm_fifo_t *f, singbox_endpoint_t *ep, u8 parts)
+{
+  u8 rep[2 + 2 + 5 + 255 + 2];
+  int n, off = 0, len;
+
+  n = svm_fifo_peek (f, 0, sizeof (rep), rep);
+  if (n < 2)
+    return 0;
+
+  if (parts & SINGBOX_SOCKS5_GREETING)
+    {
+      /* Method selection */
+      if (rep[0] != SOCKS5_VERSION)
+        return -1;
+      if (rep[1] != (singbox_socks5_uses_auth (ep) ?
+                       SOCKS5_AUTH_USERNAME_PASSWORD : SOCKS5_AUTH_NONE))
+        return -1;
+      off = 2;
+
+      /* Auth status */
+      if (singbox_socks5_uses_auth (ep))
+        {
+          if (n < off + 2)
+            return 0;
+          if (rep[off] != 0x01 || rep[off + 1] != 0x00)
+            return -1;
+          off += 2;
+        }
+    }
+
+  if (parts & SINGBOX_SOCKS5_CONNECT)
+    {
+      if (n < off + 5)
+        return 0;
+      if (rep[off] != SOCKS5_VERSION || rep[off + 1] != SOCKS5_REP_SUCCESS)
+        return -1;
+
+      switch (rep[off + 3])
+        {
+        case SOCKS5_ATYP_IPV4:
+          len = 4;
+          break;
+        case SOCKS5_ATYP_IPV6:
+          len = 16;
+          break;
+        case SOCKS5_ATYP_DOMAINNAME:
+          len = 1 + rep[off + 4];
+          break;
+        default:
+          return -1;
+        }
+      off += 4 + len + 2;
+      if (n < off)
+        return 0;
+    }
+
+  svm_fifo_dequeue_drop (f, off);
+  return off;
+}
+
 /**
  * @brief Format SOCKS5 state
  */
@@ -23,6 +23,13 @@
  *
  * Architecture:
  * [sing-box client] --SOCKS5--> [VPP SOCKS5 Server] --> Internet
+ *
+ * The handshake runs on the client's thread. A CONNECT gets a connection
+ * to its destination whose session reuses the client's fifos, swapped,
+ * like transparent redirection does; the reply is written into the
+ * shared fifo and payload is never copied. UDP ASSOCIATE is served by
+ * socks5_udp.c. Domain names are looked up in the dns plugin's cache,
+ * on the main thread, without blocking anyone.
  */
 
 #include <vppinfra/error.h>
@@ -30,31 +37,1030 @@
 #include <vnet/session/session.h>
 #include <vnet/session/application.h>
 #include <vnet/session/application_interface.h>
+#include <vnet/tcp/tcp.h>
+#include <vnet/plugin/plugin.h>
+#include <plugins/dns/dns.h>
 #include <singbox/singbox.h>
+#include <vnet/session/session_relay.h>
+
+#include <vppinfra/bihash_template.c>
+
+#define SINGBOX_SERVER_FIFO_SIZE    (64 << 10)
+#define SINGBOX_SERVER_SEGMENT_SIZE (128 << 20)
+
+/* longest client message: auth with 255 byte username and password */
+#define SINGBOX_SERVER_MSG_MAX 513
+
+/* VER, REP, RSV and an IPv6 BND.ADDR and BND.PORT */
+#define SINGBOX_SERVER_REPLY_MAX 22
+
+#define SINGBOX_SERVER_UDP_ASSOC_BUCKETS 1024
+#define SINGBOX_SERVER_UDP_ASSOC_MEMORY  (32 << 20)
+
+/* seconds between UDP expiry scans, and between dns cache polls */
+#define SINGBOX_SERVER_PERIOD          1.0
+#define SINGBOX_SERVER_RESOLVE_POLL    0.1
+#define SINGBOX_SERVER_RESOLVE_TIMEOUT 5.0
+
+typedef enum
+{
+  SINGBOX_SERVER_EVENT_RESOLVE = 1,
+} singbox_server_event_t;
+
+static singbox_session_t *
+singbox_server_session_get (singbox_main_t *sm, u32 handle)
+{
+  u32 session_index = handle & SINGBOX_SESSION_INDEX_MASK;
+  singbox_wrk_t *wrk;
+
+  if (handle == ~0)
+    return NULL;
+
+  wrk = singbox_wrk_get (sm, handle >> SINGBOX_SESSION_INDEX_BITS);
+  if (pool_is_free_index (wrk->server_sessions, session_index))
+    return NULL;
+  return pool_elt_at_index (wrk->server_sessions, session_index);
+}
+
+static singbox_session_t *
+singbox_server_session_alloc (singbox_main_t *sm, session_t *s)
+{
+  singbox_session_t *ss;
+  singbox_wrk_t *wrk;
+
+  /* Other threads may look the session up, the pool must not move
+   * under them */
+  wrk = singbox_wrk_get (sm, s->thread_index);
+  pool_get_aligned_safe (wrk->server_sessions, ss, CLIB_CACHE_LINE_BYTES);
+  clib_memset (ss, 0, sizeof (*ss));
+
+  ss->session_index = ss - wrk->server_sessions;
+  ss->thread_index = s->thread_index;
+  ss->n_refs = 1;
+  ss->sw_if_index = ~0;
+  ss->state = SINGBOX_STATE_SOCKS5_GREETING;
+  ss->last_activity = vlib_time_now (vlib_get_main ());
+  ss->client_session_handle = session_handle (s);
+  ss->client_rx_fifo = s->rx_fifo;
+  ss->client_tx_fifo = s->tx_fifo;
+  ss->client_thread_index = s->thread_index;
+
+  /* no destination until a CONNECT asks for one */
+  ss->proxy_session_handle = SESSION_INVALID_HANDLE;
+  ss->proxy_disconnected = 1;
+
+  return ss;
+}
+
+static void
+singbox_server_session_free (singbox_main_t *sm, singbox_session_t *ss)
+{
+  clib_bihash_kv_8_8_t kv;
+  singbox_wrk_t *wrk;
+
+  ASSERT (ss->thread_index == vlib_get_thread_index ());
+
+  /* a newer association from the same client may have taken the key */
+  if (ss->udp_assoc_key)
+    {
+      kv.key = ss->udp_assoc_key;
+      if (!clib_bihash_search_8_8 (&sm->udp_assoc_table, &kv, &kv) &&
+          kv.value == singbox_session_handle (ss))
+        clib_bihash_add_del_8_8 (&sm->udp_assoc_table, &kv, 0 /* is_add */);
+    }
+
+  vec_free (ss->tx_buffer);
+  vec_free (ss->dst_name);
+
+  wrk = singbox_wrk_get (sm, ss->thread_index);
+  pool_put (wrk->server_sessions, ss);
+}
+
+/**
+ * @brief Encode a SOCKS5 reply
+ *
+ * @return length of the reply, at most SINGBOX_SERVER_REPLY_MAX
+ */
+static u32
+singbox_server_format_reply (u8 *buf, u8 rep, u8 is_ip4, ip46_address_t *ip,
+                             u16 port)
+{
+  u32 n;
+
+  buf[0] = SOCKS5_VERSION;
+  buf[1] = rep;
+  buf[2] = 0x00;
+  if (is_ip4)
+    {
+      buf[3] = SOCKS5_ATYP_IPV4;
+      clib_memcpy (&buf[4], &ip->ip4, 4);
+      n = 8;
+    }
+  else
+    {
+      buf[3] = SOCKS5_ATYP_IPV6;
+      clib_memcpy (&buf[4], &ip->ip6, 16);
+      n = 20;
+    }
+  buf[n++] = port >> 8;
+  buf[n++] = port & 0xff;
+
+  return n;
+}
+
+static void
+singbox_server_send (session_t *s, u8 *data, u32 len)
+{
+  if (svm_fifo_enqueue (s->tx_fifo, len, data) != len)
+    return;
+
+  session_relay_tx_event (s->tx_fifo, s->handle);
+}
+
+static void
+singbox_server_close_client (singbox_main_t *sm, singbox_session_t *ss)
+{
+  vnet_disconnect_args_t _a = { 0 }, *a = &_a;
+  session_error_t rv;
+
+  /* both sides may try, only the first one disconnects */
+  if (clib_atomic_swap_acq_n (&ss->client_disconnected, 1))
+    return;
+
+  a->handle = ss->client_session_handle;
+  a->app_index = sm->server_app_index;
+  rv = vnet_disconnect_session (a);
+  if (rv && sm->verbose)
+    clib_warning ("server session %u client disconnect returned: %U",
+                  ss->session_index, format_session_error, rv);
+}
+
+static void
+singbox_server_close_proxy (singbox_main_t *sm, singbox_session_t *ss)
+{
+  vnet_disconnect_args_t _a = { 0 }, *a = &_a;
+  session_error_t rv;
+
+  if (clib_atomic_swap_acq_n (&ss->proxy_disconnected, 1))
+    return;
+
+  a->handle = ss->proxy_session_handle;
+  a->app_index = sm->server_connect_app_index;
+  rv = vnet_disconnect_session (a);
+  if (rv && sm->verbose)
+    clib_warning ("server session %u destination disconnect returned: %U",
+                  ss->session_index, format_session_error, rv);
+}
+
+static void
+singbox_server_free_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_server_session_get (sm, pointer_to_uword (arg));
+  if (ss)
+    singbox_server_session_free (sm, ss);
+}
+
+/**
+ * @brief Drop a side's reference, the last one frees the session
+ */
+static void
+singbox_server_put (singbox_main_t *sm, singbox_session_t *ss)
+{
+  if (clib_atomic_sub_fetch (&ss->n_refs, 1))
+    return;
+
+  if (ss->thread_index == vlib_get_thread_index ())
+    singbox_server_session_free (sm, ss);
+  else
+    session_send_rpc_evt_to_thread (
+      ss->thread_index, singbox_server_free_rpc,
+      uword_to_pointer (singbox_session_handle (ss), void *));
+}
+
+static void
+singbox_server_close (session_t *s, u8 is_proxy)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_server_session_get (sm, s->opaque);
+  if (!ss)
+    return;
+
+  /* No half-close: whichever side goes first takes the other with it */
+  ss->state = SINGBOX_STATE_CLOSED;
+  if (is_proxy)
+    {
+      singbox_server_close_proxy (sm, ss);
+      singbox_server_close_client (sm, ss);
+    }
+  else
+    {
+      singbox_server_close_client (sm, ss);
+
+      /* pairs with the barrier in the connected callback: either we see
+       * the connect finished or it sees the client gone */
+      CLIB_MEMORY_BARRIER ();
+      if (!ss->proxy_connecting)
+        singbox_server_close_proxy (sm, ss);
+    }
+}
+
+static void
+singbox_server_postponed_free_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_server_session_get (sm, pointer_to_uword (arg));
+  if (!ss)
+    return;
+  segment_manager_dealloc_fifos (ss->client_rx_fifo, ss->client_tx_fifo);
+  singbox_server_session_free (sm, ss);
+}
+
+static void
+singbox_server_delete (session_t *s, u8 is_proxy)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_server_session_get (sm, s->opaque);
+  if (!ss)
+    return;
+
+  if (is_proxy)
+    {
+      ss->proxy_disconnected = 1;
+      ss->proxy_session_handle = SESSION_INVALID_HANDLE;
+
+      /* revert master thread index change on connect */
+      ss->client_rx_fifo->master_thread_index =
+        ss->client_tx_fifo->master_thread_index;
+
+      if (clib_atomic_sub_fetch (&ss->n_refs, 1))
+        return;
+
+      /* client already cleaned up, the fifos are ours to free and only
+       * the thread that allocated them, the session's, may do it */
+      if (s->thread_index != ss->thread_index)
+        {
+          s->rx_fifo = 0;
+          s->tx_fifo = 0;
+          session_send_rpc_evt_to_thread (
+            ss->thread_index, singbox_server_postponed_free_rpc,
+            uword_to_pointer (singbox_session_handle (ss), void *));
+        }
+      else
+        {
+          ASSERT (s->rx_fifo->refcnt == 1);
+          singbox_server_session_free (sm, ss);
+        }
+    }
+  else
+    {
+      ss->client_disconnected = 1;
+      ss->client_session_handle = SESSION_INVALID_HANDLE;
+      singbox_server_put (sm, ss);
+    }
+}
+
+/**
+ * @brief Reopen a receive window once the other side drained our fifo
+ */
+static int
+singbox_server_tx_callback (session_t *s, u8 is_proxy)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+  session_handle_t peer_sh;
+
+  if (!session_relay_tx_ready (s->tx_fifo))
+    return 0;
+
+  ss = singbox_server_session_get (sm, s->opaque);
+  if (!ss)
+    return -1;
+  if (ss->cmd != SOCKS5_CMD_CONNECT || ss->state != SINGBOX_STATE_ESTABLISHED)
+    return 0;
+  if (is_proxy ? ss->client_disconnected : ss->proxy_disconnected)
+    return -1;
+
+  peer_sh = is_proxy ? ss->client_session_handle : ss->proxy_session_handle;
+  if (peer_sh == SESSION_INVALID_HANDLE)
+    return 0;
+
+  session_relay_reopen_window (peer_sh);
+
+  return 0;
+}
+
+/* ========== DESTINATION SIDE ========== */
+
+static u8
+singbox_server_reply_from_error (session_error_t err)
+{
+  switch (err)
+    {
+    case SESSION_E_REFUSED:
+      return SOCKS5_REP_CONNECTION_REFUSED;
+    case SESSION_E_NOROUTE:
+    case SESSION_E_NOINTF:
+    case SESSION_E_TIMEDOUT:
+      return SOCKS5_REP_HOST_UNREACHABLE;
+    default:
+      return SOCKS5_REP_GENERAL_FAILURE;
+    }
+}
+
+/**
+ * @brief Destination of a CONNECT could not be reached
+ *
+ * Runs on the client's thread, which alone writes to the client before
+ * a destination connection shares its fifos.
+ */
+static void
+singbox_server_connect_failed (singbox_main_t *sm, singbox_session_t *ss)
+{
+  u8 reply[SINGBOX_SERVER_REPLY_MAX];
+  ip46_address_t any = { 0 };
+  session_t *s;
+  u32 n;
+
+  ss->state = SINGBOX_STATE_ERROR;
+  ss->proxy_disconnected = 1;
+  clib_atomic_store_rel_n (&ss->proxy_connecting, 0);
+
+  s = ss->client_disconnected ?
+        0 :
+        session_get_from_handle_if_valid (ss->client_session_handle);
+  if (s)
+    {
+      n = singbox_server_format_reply (reply, ss->reply, 1, &any, 0);
+      singbox_server_send (s, reply, n);
+    }
+
+  singbox_server_close_client (sm, ss);
+  singbox_server_put (sm, ss);
+}
+
+static void
+singbox_server_connect_failed_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_server_session_get (sm, pointer_to_uword (arg));
+  if (ss)
+    singbox_server_connect_failed (sm, ss);
+}
+
+static void
+singbox_server_connect_failed_on_owner (singbox_main_t *sm,
+                                        singbox_session_t *ss, u8 reply)
+{
+  ss->reply = reply;
+  if (ss->thread_index == vlib_get_thread_index ())
+    singbox_server_connect_failed (sm, ss);
+  else
+    session_send_rpc_evt_to_thread (
+      ss->thread_index, singbox_server_connect_failed_rpc,
+      uword_to_pointer (singbox_session_handle (ss), void *));
+}
+
+static void
+singbox_server_connect_rpc (void *rpc_args)
+{
+  singbox_main_t *sm = &singbox_main;
+  vnet_connect_args_t *a = rpc_args;
+  singbox_session_t *ss;
+  session_error_t rv;
+
+  rv = vnet_connect (a);
+  if (rv)
+    {
+      if (sm->verbose)
+        clib_warning ("server session %x connect returned: %U",
+                      a->api_context, format_session_error, rv);
+      /* gone if the server was stopped meanwhile */
+      ss = singbox_server_session_get (sm, a->api_context);
+      if (ss)
+        singbox_server_connect_failed_on_owner (
+          sm, ss, singbox_server_reply_from_error (rv));
+    }
+
+  vec_free (a);
+}
+
+/**
+ * @brief Connect to the destination of a CONNECT
+ *
+ * Connects must be issued from the transport's connect thread.
+ */
+static void
+singbox_server_connect (singbox_main_t *sm, singbox_session_t *ss)
+{
+  vnet_connect_args_t *a = 0;
+
+  vec_validate (a, 0);
+  clib_memset (a, 0, sizeof (a[0]));
+  a->sep_ext = (session_endpoint_cfg_t) SESSION_ENDPOINT_CFG_NULL;
+  a->sep_ext.transport_proto = TRANSPORT_PROTO_TCP;
+  a->sep_ext.is_ip4 = ss->dst_is_ip4;
+  a->sep_ext.ip = ss->dst_ip;
+  a->sep_ext.port = clib_host_to_net_u16 (ss->dst_port);
+  a->app_index = sm->server_connect_app_index;
+  a->api_context = singbox_session_handle (ss);
+
+  session_send_rpc_evt_to_thread_force (transport_cl_thread (),
+                                        singbox_server_connect_rpc, a);
+}
+
+static void
+singbox_server_connect_resolved (dns_cache_resolve_t *r)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_server_session_get (sm, r->handle);
+  if (!ss)
+    ;
+  else if (r->rv || ss->client_disconnected)
+    {
+      if (sm->verbose && r->rv)
+        clib_warning ("server session %u cannot resolve %s: %d",
+                      ss->session_index, r->name, r->rv);
+      ss->reply = SOCKS5_REP_HOST_UNREACHABLE;
+      singbox_server_connect_failed (sm, ss);
+    }
+  else
+    {
+      ss->dst_ip = r->ip;
+      ss->dst_is_ip4 = r->is_ip4;
+      singbox_server_connect (sm, ss);
+    }
+
+  dns_cache_resolve_free (r);
+}
+
+static int
+singbox_server_dst_accept_callback (session_t *s)
+{
+  clib_warning ("singbox server connect app should not get accept events");
+  return -1;
+}
+
+static int
+singbox_server_dst_connected_callback (u32 app_index, u32 opaque,
+                                       session_t *s, session_error_t err)
+{
+  singbox_main_t *sm = &singbox_main;
+  u8 reply[SINGBOX_SERVER_REPLY_MAX];
+  transport_connection_t *tc;
+  singbox_session_t *ss;
+  u32 n;
+
+  ss = singbox_server_session_get (sm, opaque);
+  ASSERT (ss);
+
+  if (err)
+    {
+      if (sm->verbose)
+        clib_warning ("server session %x connect failed: %U", opaque,
+                      format_session_error, err);
+      singbox_server_connect_failed_on_owner (
+        sm, ss, singbox_server_reply_from_error (err));
+      return 0;
+    }
+
+  s->opaque = opaque;
+  ss->proxy_session_handle = session_handle (s);
+
+  /* our rx fifo is the client's tx fifo, the reply goes ahead of
+   * anything the destination sends */
+  tc = session_get_transport (s);
+  n = singbox_server_format_reply (reply, SOCKS5_REP_SUCCESS, tc->is_ip4,
+                                   &tc->lcl_ip,
+                                   clib_net_to_host_u16 (tc->lcl_port));
+  svm_fifo_enqueue (s->rx_fifo, n, reply);
+  ss->state = SINGBOX_STATE_ESTABLISHED;
+
+  /* publish the handle to the client side before it may use it */
+  clib_atomic_store_rel_n (&ss->proxy_connecting, 0);
+  CLIB_MEMORY_BARRIER ();
+
+  /* client went away while we were connecting */
+  if (ss->client_disconnected)
+    {
+      if (!clib_atomic_swap_acq_n (&ss->proxy_disconnected, 1))
+        session_reset (s);
+      return 0;
+    }
+
+  session_relay_tx_event (s->rx_fifo, ss->client_session_handle);
+
+  /* data the client sent behind its request */
+  if (svm_fifo_max_dequeue (s->tx_fifo))
+    session_relay_tx_event (s->tx_fifo, s->handle);
+
+  return 0;
+}
+
+static void
+singbox_server_dst_disconnect_callback (session_t *s)
+{
+  singbox_server_close (s, 1 /* is_proxy */);
+}
+
+static void
+singbox_server_dst_transport_closed_callback (session_t *s)
+{
+}
+
+static void
+singbox_server_dst_reset_callback (session_t *s)
+{
+  singbox_server_close (s, 1 /* is_proxy */);
+}
+
+static int
+singbox_server_dst_rx_callback (session_t *s)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  ss = singbox_server_session_get (sm, s->opaque);
+  if (!ss || ss->client_disconnected)
+    return -1;
+
+  ss->last_activity = vlib_time_now (vlib_get_main ());
+  session_relay_notify_peer (s->rx_fifo, ss->client_session_handle);
+
+  return 0;
+}
+
+static int
+singbox_server_dst_tx_callback (session_t *s)
+{
+  return singbox_server_tx_callback (s, 1 /* is_proxy */);
+}
+
+static void
+singbox_server_dst_cleanup_callback (session_t *s, session_cleanup_ntf_t ntf)
+{
+  singbox_main_t *sm = &singbox_main;
+  tcp_connection_t *tc;
+  singbox_wrk_t *wrk;
+
+  if (ntf == SESSION_CLEANUP_TRANSPORT)
+    {
+      /* both directions went through this connection */
+      tc = (tcp_connection_t *) session_get_transport (s);
+      wrk = singbox_wrk_get (sm, s->thread_index);
+      if (tc)
+        wrk->server_bytes_forwarded += tc->bytes_in + tc->bytes_out;
+      return;
+    }
+
+  singbox_server_delete (s, 1 /* is_proxy */);
+}
+
+/**
+ * @brief Give the destination session the client session's fifos, swapped
+ */
+static int
+singbox_server_dst_alloc_session_fifos (session_t *s)
+{
+  singbox_main_t *sm = &singbox_main;
+  svm_fifo_t *rx_fifo, *tx_fifo;
+  singbox_session_t *ss;
+
+  ss = singbox_server_session_get (sm, s->opaque);
+  ASSERT (ss);
+  if (ss->client_disconnected)
+    return SESSION_E_ALLOC;
+
+  tx_fifo = ss->client_rx_fifo;
+  rx_fifo = ss->client_tx_fifo;
+  ASSERT (rx_fifo->refcnt == 1);
+  ASSERT (tx_fifo->refcnt == 1);
+  rx_fifo->refcnt++;
+  tx_fifo->refcnt++;
+
+  /* dequeue notifications for the client's rx fifo go to the destination */
+  tx_fifo->shr->master_session_index = s->session_index;
+  tx_fifo->master_thread_index = s->thread_index;
+  tx_fifo->vpp_sh = s->handle;
+
+  s->rx_fifo = rx_fifo;
+  s->tx_fifo = tx_fifo;
+  return 0;
+}
+
+static session_cb_vft_t singbox_server_dst_cb_vft = {
+  .session_accept_callback = singbox_server_dst_accept_callback,
+  .session_connected_callback = singbox_server_dst_connected_callback,
+  .session_disconnect_callback = singbox_server_dst_disconnect_callback,
+  .session_transport_closed_callback =
+    singbox_server_dst_transport_closed_callback,
+  .session_reset_callback = singbox_server_dst_reset_callback,
+  .builtin_app_rx_callback = singbox_server_dst_rx_callback,
+  .builtin_app_tx_callback = singbox_server_dst_tx_callback,
+  .session_cleanup_callback = singbox_server_dst_cleanup_callback,
+  .proxy_alloc_session_fifos = singbox_server_dst_alloc_session_fifos,
+};
+
+/* ========== CLIENT SIDE ========== */
+
+/**
+ * @brief Set up a UDP association for the request
+ *
+ * Datagrams are accepted from the client's address only. The port the
+ * client names is used only along with its own address, or none; other
+ * addresses are what the client sees behind a NAT and mean nothing here.
+ */
+static void
+singbox_server_udp_associate (singbox_main_t *sm, singbox_session_t *ss,
+                              session_t *s)
+{
+  u8 reply[SINGBOX_SERVER_REPLY_MAX];
+  transport_connection_t *tc;
+  clib_bihash_kv_8_8_t kv;
+  ip46_address_t bnd = { 0 };
+  u16 port = 0;
+  u32 n;
+
+  tc = session_get_transport (s);
+  if (ss->dst_is_ip4 && !ss->dst_name &&
+      (ss->dst_ip.ip4.as_u32 == 0 ||
+       ss->dst_ip.ip4.as_u32 == tc->rmt_ip.ip4.as_u32))
+    port = clib_host_to_net_u16 (ss->dst_port);
+  vec_free (ss->dst_name);
+
+  ss->udp_assoc_key = singbox_udp_assoc_key (&tc->rmt_ip.ip4, port);
+  kv.key = ss->udp_assoc_key;
+  kv.value = singbox_session_handle (ss);
+  clib_bihash_add_del_8_8 (&sm->udp_assoc_table, &kv, 1 /* is_add */);
+  ss->state = SINGBOX_STATE_ESTABLISHED;
+
+  /* the relay shares the server's address and port */
+  bnd.ip4 = sm->server_listen_addr.as_u32 ? sm->server_listen_addr :
+                                            tc->lcl_ip.ip4;
+  n = singbox_server_format_reply (reply, SOCKS5_REP_SUCCESS, 1, &bnd,
+                                   sm->server_listen_port);
+  singbox_server_send (s, reply, n);
+}
+
+/**
+ * @brief Serve an accepted request
+ */
+static void
+singbox_server_serve (singbox_main_t *sm, singbox_session_t *ss, session_t *s)
+{
+  if (ss->cmd == SOCKS5_CMD_UDP_ASSOCIATE)
+    {
+      singbox_server_udp_associate (sm, ss, s);
+      return;
+    }
+
+  /* one reference for the client, one for the destination connect */
+  ss->n_refs = 2;
+  ss->proxy_disconnected = 0;
+  ss->proxy_connecting = 1;
+  ss->state = SINGBOX_STATE_CONNECTING;
+
+  if (ss->dst_name)
+    {
+      dns_cache_resolve (&sm->server_resolver, ss->dst_name,
+                         singbox_session_handle (ss),
+                         singbox_server_connect_resolved);
+      ss->dst_name = 0;
+    }
+  else
+    singbox_server_connect (sm, ss);
+}
+
+/**
+ * @brief Run the handshake on what the client sent so far
+ */
+static int
+singbox_server_handshake (singbox_main_t *sm, singbox_session_t *ss,
+                          session_t *s)
+{
+  u8 buf[SINGBOX_SERVER_MSG_MAX];
+  int n, rv;
+
+  while (1)
+    {
+      n = svm_fifo_peek (s->rx_fifo, 0, sizeof (buf), buf);
+      if (n <= 0)
+        return 0;
+
+      switch (ss->state)
+        {
+        case SINGBOX_STATE_SOCKS5_GREETING:
+          rv = singbox_server_process_greeting (sm, ss, buf, n);
+          break;
+        case SINGBOX_STATE_SOCKS5_AUTH:
+          rv = singbox_server_process_auth (sm, ss, buf, n);
+          break;
+        case SINGBOX_STATE_SOCKS5_REQUEST:
+          rv = singbox_server_process_request (sm, ss, buf, n);
+          break;
+        default:
+          return 0;
+        }
+
+      if (rv == 0)
+        return 0;
+
+      if (vec_len (ss->tx_buffer))
+        {
+          singbox_server_send (s, ss->tx_buffer, vec_len (ss->tx_buffer));
+          vec_reset_length (ss->tx_buffer);
+        }
+
+      if (rv < 0)
+        {
+          /* the reply, if any, goes out before the fin */
+          ss->state = SINGBOX_STATE_ERROR;
+          singbox_server_close_client (sm, ss);
+          return 0;
+        }
+
+      svm_fifo_dequeue_drop (s->rx_fifo, rv);
+      if (ss->cmd)
+        {
+          singbox_server_serve (sm, ss, s);
+          return 0;
+        }
+    }
+}
+
+static int
+singbox_server_control_rx (singbox_main_t *sm, session_t *s)
+{
+  singbox_session_t *ss;
+
+  if (s->flags & SESSION_F_APP_CLOSED)
+    return 0;
+
+  ss = singbox_server_session_get (sm, s->opaque);
+  if (!ss)
+    return -1;
+
+  switch (ss->cmd)
+    {
+    case SOCKS5_CMD_CONNECT:
+      if (ss->proxy_disconnected)
+        return -1;
+
+      /* data queues behind the request until the destination is
+       * connected; the barrier pairs with the connected callback's so
+       * that one of us sees the data */
+      if (PREDICT_FALSE (ss->proxy_connecting))
+        {
+          CLIB_MEMORY_BARRIER ();
+          if (ss->proxy_connecting)
+            return 0;
+        }
+
+      ss->last_activity = vlib_time_now (vlib_get_main ());
+      session_relay_notify_peer (s->rx_fifo, ss->proxy_session_handle);
+      return 0;
+
+    case SOCKS5_CMD_UDP_ASSOCIATE:
+      /* the connection only keeps the association alive */
+      svm_fifo_dequeue_drop_all (s->rx_fifo);
+      return 0;
+
+    default:
+      return singbox_server_handshake (sm, ss, s);
+    }
+}
+
+static int
+singbox_server_accept_callback (session_t *s)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_session_t *ss;
+
+  if (session_get_transport_proto (s) == TRANSPORT_PROTO_UDP)
+    return singbox_server_udp_accept (sm, s);
+
+  ss = singbox_server_session_alloc (sm, s);
+  s->opaque = singbox_session_handle (ss);
+  s->session_state = SESSION_STATE_READY;
+
+  return 0;
+}
+
+static int
+singbox_server_connected_callback (u32 app_index, u32 opaque, session_t *s,
+                                   session_error_t err)
+{
+  /* only the relay's UDP flows connect through this app */
+  return singbox_server_udp_connected (&singbox_main, opaque, s, err);
+}
+
+static void
+singbox_server_disconnect_callback (session_t *s)
+{
+  if (session_get_transport_proto (s) == TRANSPORT_PROTO_UDP)
+    singbox_server_udp_close (&singbox_main, s);
+  else
+    singbox_server_close (s, 0 /* is_proxy */);
+}
+
+static void
+singbox_server_transport_closed_callback (session_t *s)
+{
+}
+
+static void
+singbox_server_reset_callback (session_t *s)
+{
+  singbox_server_disconnect_callback (s);
+}
+
+static int
+singbox_server_rx_callback (session_t *s)
+{
+  singbox_main_t *sm = &singbox_main;
+
+  if (session_get_transport_proto (s) == TRANSPORT_PROTO_UDP)
+    return singbox_server_udp_rx (sm, s);
+
+  return singbox_server_control_rx (sm, s);
+}
+
+static int
+singbox_server_tx_callback_fn (session_t *s)
+{
+  if (session_get_transport_proto (s) == TRANSPORT_PROTO_UDP)
+    return 0;
+
+  return singbox_server_tx_callback (s, 0 /* is_proxy */);
+}
+
+static void
+singbox_server_cleanup_callback (session_t *s, session_cleanup_ntf_t ntf)
+{
+  if (ntf == SESSION_CLEANUP_TRANSPORT)
+    return;
+
+  if (session_get_transport_proto (s) == TRANSPORT_PROTO_UDP)
+    singbox_server_udp_cleanup (&singbox_main, s);
+  else
+    singbox_server_delete (s, 0 /* is_proxy */);
+}
+
+static void
+singbox_server_migrate_callback (session_t *s, session_handle_t new_sh)
+{
+  /* flows keep the fifos, which move along with the session */
+}
+
+static int
+singbox_server_add_segment_callback (u32 client_index, u64 segment_handle)
+{
+  return 0;
+}
+
+static session_cb_vft_t singbox_server_cb_vft = {
+  .session_accept_callback = singbox_server_accept_callback,
+  .session_connected_callback = singbox_server_connected_callback,
+  .session_disconnect_callback = singbox_server_disconnect_callback,
+  .session_transport_closed_callback =
+    singbox_server_transport_closed_callback,
+  .session_reset_callback = singbox_server_reset_callback,
+  .builtin_app_rx_callback = singbox_server_rx_callback,
+  .builtin_app_tx_callback = singbox_server_tx_callback_fn,
+  .session_cleanup_callback = singbox_server_cleanup_callback,
+  .add_segment_callback = singbox_server_add_segment_callback,
+  .session_migrate_callback = singbox_server_migrate_callback,
+};
+
+/* ========== SERVER CONTROL ========== */
+
+static int
+singbox_server_attach (char *name, session_cb_vft_t *cb_vft, u64 flags,
+                       u32 *app_index)
+{
+  vnet_app_attach_args_t _a, *a = &_a;
+  u64 options[APP_OPTIONS_N_OPTIONS];
+  session_error_t rv;
+
+  clib_memset (a, 0, sizeof (*a));
+  clib_memset (options, 0, sizeof (options));
+
+  a->api_client_index = APP_INVALID_INDEX;
+  a->name = format (0, "%s", name);
+  a->session_cb_vft = cb_vft;
+  a->options = options;
+  a->options[APP_OPTIONS_SEGMENT_SIZE] = SINGBOX_SERVER_SEGMENT_SIZE;
+  a->options[APP_OPTIONS_ADD_SEGMENT_SIZE] = SINGBOX_SERVER_SEGMENT_SIZE;
+  a->options[APP_OPTIONS_RX_FIFO_SIZE] = SINGBOX_SERVER_FIFO_SIZE;
+  a->options[APP_OPTIONS_TX_FIFO_SIZE] = SINGBOX_SERVER_FIFO_SIZE;
+  a->options[APP_OPTIONS_FLAGS] = APP_OPTIONS_FLAGS_IS_BUILTIN | flags;
+
+  rv = vnet_application_attach (a);
+  vec_free (a->name);
+  if (rv)
+    {
+      clib_warning ("%s attach returned: %U", name, format_session_error, rv);
+      return rv;
+    }
+
+  *app_index = a->app_index;
+  return 0;
+}
+
+static void
+singbox_server_detach (u32 *app_index)
+{
+  vnet_app_detach_args_t _a = { 0 }, *a = &_a;
+
+  if (*app_index == APP_INVALID_INDEX)
+    return;
+
+  a->app_index = *app_index;
+  a->api_client_index = APP_INVALID_INDEX;
+  vnet_application_detach (a);
+  *app_index = APP_INVALID_INDEX;
+}
+
+static session_error_t
+singbox_server_listen (singbox_main_t *sm, transport_proto_t proto,
+                       session_handle_t *handle)
+{
+  vnet_listen_args_t _a, *a = &_a;
+  session_error_t rv;
+
+  clib_memset (a, 0, sizeof (*a));
+  a->app_index = sm->server_app_index;
+  a->sep_ext = (session_endpoint_cfg_t) SESSION_ENDPOINT_CFG_NULL;
+  a->sep_ext.transport_proto = proto;
+  a->sep_ext.is_ip4 = 1;
+  a->sep_ext.ip.ip4 = sm->server_listen_addr;
+  a->sep_ext.port = clib_host_to_net_u16 (sm->server_listen_port);
+
+  /* every client address and port gets a session of its own, on the
+   * thread its datagrams arrive on */
+  if (proto == TRANSPORT_PROTO_UDP)
+    a->sep_ext.transport_flags = TRANSPORT_CFG_F_CONNECTED;
+
+  if ((rv = vnet_listen (a)))
+    return rv;
+
+  *handle = a->handle;
+  return 0;
+}
+
+static void
+singbox_server_unlisten (singbox_main_t *sm, session_handle_t *handle)
+{
+  vnet_unlisten_args_t _a = { 0 }, *a = &_a;
+
+  if (*handle == SESSION_INVALID_HANDLE)
+    return;
+
+  a->handle = *handle;
+  a->app_index = sm->server_app_index;
+  vnet_unlisten (a);
+  *handle = SESSION_INVALID_HANDLE;
+}
 
 /**
  * @brief Start SOCKS5 server
  */
 int
 singbox_server_start (singbox_main_t *sm, ip4_address_t *listen_addr,
-                     u16 listen_port, u8 require_auth, u8 *username,
-                     u8 *password)
+                      u16 listen_port, u8 require_auth, u8 *username,
+                      u8 *password)
 {
-  vnet_app_attach_args_t attach_args = { 0 };
-  vnet_app_detach_args_t detach_args;
-  u64 options[APP_OPTIONS_N_OPTIONS];
-  int rv;
+  vlib_main_t *vm = vlib_get_main ();
+  session_enable_disable_args_t args = {
+    .is_en = 1,
+    .rt_engine_type = RT_BACKEND_ENGINE_RULE_TABLE,
+  };
+  session_error_t rv;
+  uword ulen = 0, plen = 0;
 
   if (sm->server_mode_enabled)
+    return VNET_API_ERROR_VALUE_EXIST;
+
+  if (require_auth)
     {
-      clib_warning ("SOCKS5 server already running");
-      return -1;
+      ulen = username ? strlen ((char *) username) : 0;
+      plen = password ? strlen ((char *) password) : 0;
+      if (ulen == 0 || ulen > 255 || plen == 0 || plen > 255)
+        return VNET_API_ERROR_INVALID_VALUE;
     }
 
-  /* Initialize server structures */
-  clib_spinlock_init (&sm->server_lock);
-  sm->server_session_by_handle = hash_create (0, sizeof (uword));
-
   /* Set server configuration */
   if (listen_addr)
     sm->server_listen_addr = *listen_addr;
@@ -63,103 +1069,209 @@ singbox_server_start (singbox_main_t *sm, ip4_address_t *listen_addr,
 
   sm->server_listen_port = listen_port ? listen_port : 1080;
   sm->server_require_auth = require_auth;
+  sm->server_username_len = ulen;
+  sm->server_password_len = plen;
+  clib_memcpy (sm->server_username, username, ulen);
+  clib_memcpy (sm->server_password, password, plen);
 
-  if (require_auth && username && password)
-    {
-      sm->server_username_len = strlen ((char *) username);
-      sm->server_password_len = strlen ((char *) password);
-      clib_memcpy (sm->server_username, username, sm->server_username_len);
-      clib_memcpy (sm->server_password, password, sm->server_password_len);
-    }
-
-  /* Configure application options */
-  clib_memset (options, 0, sizeof (options));
-  options[APP_OPTIONS_FLAGS] = APP_OPTIONS_FLAGS_IS_BUILTIN;
-  options[APP_OPTIONS_FLAGS] |= APP_OPTIONS_FLAGS_USE_GLOBAL_SCOPE;
-  options[APP_OPTIONS_FLAGS] |= APP_OPTIONS_FLAGS_IS_TRANSPORT_APP;
+  vlib_worker_thread_barrier_sync (vm);
+  vnet_session_enable_disable (vm, &args);
+  vlib_worker_thread_barrier_release (vm);
 
-  options[APP_OPTIONS_SEGMENT_SIZE] = 512 << 20; /* 512MB */
-  options[APP_OPTIONS_ADD_SEGMENT_SIZE] = 256 << 20; /* 256MB */
-  options[APP_OPTIONS_RX_FIFO_SIZE] = 64 << 10; /* 64KB */
-  options[APP_OPTIONS_TX_FIFO_SIZE] = 64 << 10; /* 64KB */
-  options[APP_OPTIONS_EVT_QUEUE_SIZE] = 128;
-  options[APP_OPTIONS_PREALLOC_FIFO_PAIRS] = 16;
+  /* domain names need the dns plugin, without it they are unreachable */
+  if (!sm->server_resolver.dns_resolve_name_ptr)
+    sm->server_resolver.dns_resolve_name_ptr =
+      vlib_get_plugin_symbol ("dns_plugin.so", "dns_resolve_name");
+  if (!sm->server_resolver.dns_resolve_name_ptr && sm->verbose)
+    clib_warning ("dns plugin not loaded, domain names cannot be resolved");
+  sm->server_resolver.process_node_index = singbox_server_process_node.index;
+  sm->server_resolver.process_event = SINGBOX_SERVER_EVENT_RESOLVE;
+  sm->server_resolver.timeout = SINGBOX_SERVER_RESOLVE_TIMEOUT;
 
-  attach_args.api_client_index = ~0;
-  attach_args.options = options;
-  attach_args.namespace_id = 0;
-  attach_args.session_cb_vft = &singbox_server_session_cb_vft; /* Need to define this */
+  clib_bihash_init_8_8 (&sm->udp_assoc_table, "singbox udp associations",
+                        SINGBOX_SERVER_UDP_ASSOC_BUCKETS,
+                        SINGBOX_SERVER_UDP_ASSOC_MEMORY);
 
-  if ((rv = vnet_application_attach (&attach_args)))
+  if (singbox_server_attach ("singbox-socks5", &singbox_server_cb_vft,
+                             APP_OPTIONS_FLAGS_USE_GLOBAL_SCOPE,
+                             &sm->server_app_index) ||
+      singbox_server_attach ("singbox-socks5-connect",
+                             &singbox_server_dst_cb_vft,
+                             APP_OPTIONS_FLAGS_IS_PROXY,
+                             &sm->server_connect_app_index))
     {
-      clib_warning ("Failed to attach SOCKS5 server application: %d", rv);
-      return rv;
+      rv = VNET_API_ERROR_APPLICATION_NOT_ATTACHED;
+      goto error;
     }
 
-  sm->server_app_index = attach_args.app_index;
-
-  /* Bind to listening address and port */
-  session_endpoint_cfg_t sep = { 0 };
-  sep.transport_proto = TRANSPORT_PROTO_TCP;
-  sep.is_ip4 = 1;
-  clib_memcpy (&sep.ip.ip4, &sm->server_listen_addr, sizeof (ip4_address_t));
-  sep.port = sm->server_listen_port;
-
-  /* Start listening */
-  if ((rv = vnet_listen (&sep)))
+  if ((rv = singbox_server_listen (sm, TRANSPORT_PROTO_TCP,
+                                   &sm->server_listener_handle)) ||
+      (rv = singbox_server_listen (sm, TRANSPORT_PROTO_UDP,
+                                   &sm->server_udp_listener_handle)))
     {
-      clib_warning ("Failed to listen on %U:%d: %d",
-                   format_ip4_address, &sm->server_listen_addr,
-                   sm->server_listen_port, rv);
-
-      detach_args.app_index = sm->server_app_index;
-      vnet_application_detach (&detach_args);
-      return rv;
+      clib_warning ("SOCKS5 server listen on %U:%d returned: %U",
+                    format_ip4_address, &sm->server_listen_addr,
+                    sm->server_listen_port, format_session_error, rv);
+      rv = VNET_API_ERROR_ADDRESS_IN_USE;
+      goto error;
     }
 
   sm->server_mode_enabled = 1;
 
-  clib_warning ("SOCKS5 server started on %U:%d (auth: %s)",
-               format_ip4_address, &sm->server_listen_addr,
-               sm->server_listen_port,
-               require_auth ? "required" : "none");
+  if (sm->verbose)
+    clib_warning ("SOCKS5 server started on %U:%d (auth: %s)",
+                  format_ip4_address, &sm->server_listen_addr,
+                  sm->server_listen_port,
+                  require_auth ? "required" : "none");
 
   return 0;
+
+error:
+  singbox_server_unlisten (sm, &sm->server_listener_handle);
+  singbox_server_detach (&sm->server_connect_app_index);
+  singbox_server_detach (&sm->server_app_index);
+  clib_bihash_free_8_8 (&sm->udp_assoc_table);
+  return rv;
 }
 
 /**
  * @brief Stop SOCKS5 server
+ *
+ * Sessions go with the applications, and with them every callback that
+ * could refer to the server's state. Called with the workers stopped.
  */
 int
 singbox_server_stop (singbox_main_t *sm)
 {
-  vnet_app_detach_args_t detach_args;
-  singbox_session_t *session;
+  singbox_wrk_t *wrk;
 
   if (!sm->server_mode_enabled)
     return 0;
 
-  /* Close all active server sessions */
-  pool_foreach (session, sm->server_sessions)
+  singbox_server_unlisten (sm, &sm->server_udp_listener_handle);
+  singbox_server_unlisten (sm, &sm->server_listener_handle);
+  singbox_server_detach (&sm->server_connect_app_index);
+  singbox_server_detach (&sm->server_app_index);
+
+  vec_foreach (wrk, sm->workers)
     {
-      /* Close session - actual implementation would use session layer */
+      pool_free (wrk->server_sessions);
+      singbox_server_udp_reset (wrk);
     }
+  clib_bihash_free_8_8 (&sm->udp_assoc_table);
 
-  /* Detach application */
-  detach_args.app_index = sm->server_app_index;
-  vnet_application_detach (&detach_args);
+  sm->server_mode_enabled = 0;
 
-  /* Cleanup */
-  hash_free (sm->server_session_by_handle);
-  pool_free (sm->server_sessions);
+  if (sm->verbose)
+    clib_warning ("SOCKS5 server stopped");
 
-  sm->server_mode_enabled = 0;
+  return 0;
+}
+
+static void
+singbox_server_expire_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+
+  singbox_server_udp_expire (sm, singbox_wrk_get (sm, vlib_get_thread_index ()),
+                             vlib_time_now (vlib_get_main ()));
+}
+
+static uword
+singbox_server_process (vlib_main_t *vm, vlib_node_runtime_t *rt,
+                        vlib_frame_t *f)
+{
+  singbox_main_t *sm = &singbox_main;
+  f64 now, next_expire = 0;
+  u32 thread_index;
+
+  while (1)
+    {
+      /* new names signal us, those in flight are polled */
+      vlib_process_wait_for_event_or_clock (
+        vm, vec_len (sm->server_resolver.pending) ?
+              SINGBOX_SERVER_RESOLVE_POLL :
+              SINGBOX_SERVER_PERIOD);
+      vlib_process_get_events (vm, 0);
+      now = vlib_time_now (vm);
+
+      dns_cache_resolve_poll (&sm->server_resolver, now);
 
-  clib_warning ("SOCKS5 server stopped");
+      if (!sm->server_mode_enabled || now < next_expire)
+        continue;
+      next_expire = now + SINGBOX_SERVER_PERIOD;
+
+      vec_foreach_index (thread_index, sm->workers)
+        session_send_rpc_evt_to_thread (thread_index,
+                                        singbox_server_expire_rpc, 0);
+    }
 
   return 0;
 }
 
+VLIB_REGISTER_NODE (singbox_server_process_node) = {
+  .function = singbox_server_process,
+  .type = VLIB_NODE_TYPE_PROCESS,
+  .name = "singbox-server-process",
+};
+
+/* ========== PROTOCOL ========== */
+
+int
+singbox_socks5_addr_len (u8 *data, u32 len)
+{
+  u32 n;
+
+  if (len < 2)
+    return 0;
+
+  switch (data[0])
+    {
+    case SOCKS5_ATYP_IPV4:
+      n = 1 + 4 + 2;
+      break;
+    case SOCKS5_ATYP_IPV6:
+      n = 1 + 16 + 2;
+      break;
+    case SOCKS5_ATYP_DOMAINNAME:
+      n = 2 + data[1] + 2;
+      break;
+    default:
+      return -1;
+    }
+
+  return len < n ? 0 : n;
+}
+
+void
+singbox_socks5_addr_decode (u8 *addr, u8 *is_ip4, ip46_address_t *ip,
+                            u8 **name, u16 *port)
+{
+  u8 *p;
+
+  switch (addr[0])
+    {
+    case SOCKS5_ATYP_IPV4:
+      *is_ip4 = 1;
+      ip46_address_reset (ip);
+      clib_memcpy (&ip->ip4, &addr[1], 4);
+      p = &addr[5];
+      break;
+    case SOCKS5_ATYP_IPV6:
+      *is_ip4 = 0;
+      clib_memcpy (&ip->ip6, &addr[1], 16);
+      p = &addr[17];
+      break;
+    default:
+      *name = 0;
+      vec_add (*name, &addr[2], addr[1]);
+      p = &addr[2 + addr[1]];
+      break;
+    }
+
+  *port = p[0] << 8 | p[1];
+}
+
 /**
  * @brief Process SOCKS5 greeting from client
  *
@@ -182,27 +1294,22 @@ singbox_server_process_greeting (singbox_main_t *sm,
                                  singbox_session_t *session, u8 *data,
                                  u32 len)
 {
-  u8 *response = NULL;
   u8 selected_method;
 
   if (len < 2)
-    {
-      clib_warning ("Invalid greeting: too short");
-      return -1;
-    }
+    return 0;
 
   if (data[0] != SOCKS5_VERSION)
     {
-      clib_warning ("Invalid SOCKS5 version: %d", data[0]);
+      if (sm->verbose)
+        clib_warning ("Invalid SOCKS5 version: %d", data[0]);
+      clib_atomic_fetch_add (&sm->server_connections_rejected, 1);
       return -1;
     }
 
   u8 nmethods = data[1];
   if (len < 2 + nmethods)
-    {
-      clib_warning ("Invalid greeting: methods length mismatch");
-      return -1;
-    }
+    return 0;
 
   /* Check supported methods */
   u8 supports_no_auth = 0;
@@ -235,20 +1342,15 @@ singbox_server_process_greeting (singbox_main_t *sm,
         selected_method = 0xFF;
     }
 
-  /* Build response */
-  vec_reset_length (response);
-  vec_add1 (response, SOCKS5_VERSION);
-  vec_add1 (response, selected_method);
-
-  /* Store in tx buffer */
+  /* Store response in tx buffer */
   vec_reset_length (session->tx_buffer);
-  vec_append (session->tx_buffer, response);
+  vec_add1 (session->tx_buffer, SOCKS5_VERSION);
+  vec_add1 (session->tx_buffer, selected_method);
 
   if (selected_method == 0xFF)
     {
-      sm->server_connections_rejected++;
+      clib_atomic_fetch_add (&sm->server_connections_rejected, 1);
       session->state = SINGBOX_STATE_ERROR;
-      vec_free (response);
       return -1;
     }
 
@@ -258,9 +1360,8 @@ singbox_server_process_greeting (singbox_main_t *sm,
   else
     session->state = SINGBOX_STATE_SOCKS5_AUTH;
 
-  sm->server_connections_accepted++;
-  vec_free (response);
-  return 0;
+  clib_atomic_fetch_add (&sm->server_connections_accepted, 1);
+  return 2 + nmethods;
 }
 
 /**
@@ -284,36 +1385,28 @@ int
 singbox_server_process_auth (singbox_main_t *sm, singbox_session_t *session,
                              u8 *data, u32 len)
 {
-  u8 *response = NULL;
   u8 status;
 
   if (len < 2)
-    {
-      clib_warning ("Invalid auth request: too short");
-      return -1;
-    }
+    return 0;
 
   if (data[0] != 0x01) /* Auth version */
     {
-      clib_warning ("Invalid auth version: %d", data[0]);
+      if (sm->verbose)
+        clib_warning ("Invalid auth version: %d", data[0]);
+      clib_atomic_fetch_add (&sm->server_auth_failures, 1);
       return -1;
     }
 
   u8 ulen = data[1];
   if (len < 2 + ulen + 1)
-    {
-      clib_warning ("Invalid auth request: username length");
-      return -1;
-    }
+    return 0;
 
   u8 *username = &data[2];
   u8 plen = data[2 + ulen];
 
   if (len < 2 + ulen + 1 + plen)
-    {
-      clib_warning ("Invalid auth request: password length");
-      return -1;
-    }
+    return 0;
 
   u8 *password = &data[2 + ulen + 1];
 
@@ -330,24 +1423,19 @@ singbox_server_process_auth (singbox_main_t *sm, singbox_session_t *session,
     {
       status = 0x01; /* Failure */
       session->state = SINGBOX_STATE_ERROR;
-      sm->server_auth_failures++;
+      clib_atomic_fetch_add (&sm->server_auth_failures, 1);
     }
 
-  /* Build response */
-  vec_reset_length (response);
-  vec_add1 (response, 0x01); /* Auth version */
-  vec_add1 (response, status);
-
-  /* Store in tx buffer */
+  /* Store response in tx buffer */
   vec_reset_length (session->tx_buffer);
-  vec_append (session->tx_buffer, response);
+  vec_add1 (session->tx_buffer, 0x01); /* Auth version */
+  vec_add1 (session->tx_buffer, status);
 
-  vec_free (response);
-  return status == 0x00 ? 0 : -1;
+  return status == 0x00 ? 2 + ulen + 1 + plen : -1;
 }
 
 /**
- * @brief Process SOCKS5 connect request from client
+ * @brief Process SOCKS5 request from client
  *
  * Client sends:
  * +----+-----+-------+------+----------+----------+
@@ -362,95 +1450,71 @@ singbox_server_process_auth (singbox_main_t *sm, singbox_session_t *session,
  * +----+-----+-------+------+----------+----------+
  * | 1  |  1  | X'00' |  1   | Variable |    2     |
  * +----+-----+-------+------+----------+----------+
+ *
+ * DST.ADDR is an IPv4 address, an IPv6 address or a domain name.
  */
 int
-singbox_server_process_connect (singbox_main_t *sm,
+singbox_server_process_request (singbox_main_t *sm,
                                 singbox_session_t *session, u8 *data,
                                 u32 len)
 {
-  u8 *response = NULL;
-  u8 reply_code = SOCKS5_REP_SUCCESS;
+  u8 reply[SINGBOX_SERVER_REPLY_MAX];
+  ip46_address_t any = { 0 };
+  u8 reply_code;
+  int n;
 
-  if (len < 4)
-    {
-      clib_warning ("Invalid connect request: too short");
-      return -1;
-    }
+  if (len < 5)
+    return 0;
 
   if (data[0] != SOCKS5_VERSION)
     {
-      clib_warning ("Invalid SOCKS5 version: %d", data[0]);
+      if (sm->verbose)
+        clib_warning ("Invalid SOCKS5 version: %d", data[0]);
       return -1;
     }
 
-  u8 cmd = data[1];
-  u8 atyp = data[3];
+  n = singbox_socks5_addr_len (&data[3], len - 3);
+  if (n == 0)
+    return 0;
 
-  if (cmd != SOCKS5_CMD_CONNECT)
-    {
-      clib_warning ("Unsupported command: %d", cmd);
-      reply_code = 0x07; /* Command not supported */
-    }
-  else if (atyp == SOCKS5_ATYP_IPV4)
-    {
-      if (len < 10) /* VER + CMD + RSV + ATYP + 4(IP) + 2(PORT) */
-        {
-          clib_warning ("Invalid IPv4 connect request");
-          reply_code = 0x01; /* General failure */
-        }
-      else
-        {
-          /* Extract destination */
-          clib_memcpy (&session->dst_addr, &data[4], 4);
-          session->dst_port = (data[8] << 8) | data[9];
-
-          if (sm->verbose)
-            {
-              clib_warning ("SOCKS5 server: Connect to %U:%d",
-                           format_ip4_address, &session->dst_addr,
-                           session->dst_port);
-            }
-
-          /* In full implementation: establish connection to destination */
-          /* For now, just accept the request */
-          reply_code = SOCKS5_REP_SUCCESS;
-          session->state = SINGBOX_STATE_ESTABLISHED;
-        }
-    }
-  else if (atyp == SOCKS5_ATYP_DOMAINNAME)
-    {
-      reply_code = 0x08; /* Address type not supported (for now) */
-    }
-  else if (atyp == SOCKS5_ATYP_IPV6)
-    {
-      reply_code = 0x08; /* Address type not supported (for now) */
-    }
+  if (n < 0)
+    reply_code = SOCKS5_REP_ADDRESS_TYPE_NOT_SUPPORTED;
+  else if (data[1] != SOCKS5_CMD_CONNECT &&
+           data[1] != SOCKS5_CMD_UDP_ASSOCIATE)
+    reply_code = SOCKS5_REP_COMMAND_NOT_SUPPORTED;
   else
     {
-      reply_code = 0x08; /* Address type not supported */
-    }
+      singbox_socks5_addr_decode (&data[3], &session->dst_is_ip4,
+                                  &session->dst_ip, &session->dst_name,
+                                  &session->dst_port);
+      if (session->dst_is_ip4)
+        session->dst_addr = session->dst_ip.ip4;
+      session->cmd = data[1];
 
-  /* Build response */
-  vec_reset_length (response);
-  vec_add1 (response, SOCKS5_VERSION);
-  vec_add1 (response, reply_code);
-  vec_add1 (response, 0x00); /* Reserved */
-  vec_add1 (response, SOCKS5_ATYP_IPV4);
+      if (sm->verbose)
+        {
+          if (session->dst_name)
+            clib_warning ("SOCKS5 server: %s %v:%d",
+                          session->cmd == SOCKS5_CMD_CONNECT ? "Connect to" :
+                                                               "Associate",
+                          session->dst_name, session->dst_port);
+          else
+            clib_warning ("SOCKS5 server: %s %U:%d",
+                          session->cmd == SOCKS5_CMD_CONNECT ? "Connect to" :
+                                                               "Associate",
+                          format_ip46_address, &session->dst_ip,
+                          IP46_TYPE_ANY, session->dst_port);
+        }
 
-  /* Bind address (use 0.0.0.0) */
-  vec_add1 (response, 0);
-  vec_add1 (response, 0);
-  vec_add1 (response, 0);
-  vec_add1 (response, 0);
+      return 3 + n;
+    }
 
-  /* Bind port (use 0) */
-  vec_add1 (response, 0);
-  vec_add1 (response, 0);
+  if (sm->verbose)
+    clib_warning ("SOCKS5 server: refused command %d address type %d",
+                  data[1], data[3]);
 
-  /* Store in tx buffer */
+  n = singbox_server_format_reply (reply, reply_code, 1, &any, 0);
   vec_reset_length (session->tx_buffer);
-  vec_append (session->tx_buffer, response);
-
-  vec_free (response);
-  return reply_code == SOCKS5_REP_SUCCESS ? 0 : -1;
+  vec_add (session->tx_buffer, reply, n);
+  return -1;
 }
@@ -0,0 +1,795 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file
+ * @brief Sing-box Plugin - SOCKS5 UDP relay
+ *
+ * UDP ASSOCIATE (RFC 1928, section 7). The server's UDP listener is a
+ * connected one: each client address and port gets a session of its
+ * own, on the thread its datagrams arrive on, and that thread owns the
+ * association. Every destination of an association gets a connected
+ * UDP session too, a flow, so the transport matches replies to it.
+ *
+ * Replies may land on any thread. The owner is asked to drain them,
+ * once per batch, and is the only one touching a flow's fifos.
+ *
+ * Datagrams are relayed in batches: a receive callback moves whatever
+ * its fifo holds and schedules one transmit per session it wrote to.
+ * Only the headers are built, payload goes from fifo to fifo as
+ * segments.
+ */
+
+#include <vnet/session/session.h>
+#include <vnet/session/application.h>
+#include <vnet/session/application_interface.h>
+#include <singbox/singbox.h>
+#include <vnet/session/session_relay.h>
+
+/* flows idle for this long are closed, seconds */
+#define SINGBOX_UDP_FLOW_IDLE_TIMEOUT 60.0
+
+/* destinations per association */
+#define SINGBOX_UDP_MAX_FLOWS 256
+
+/* datagrams held per flow while its destination is being set up */
+#define SINGBOX_UDP_PENDING_MAX (64 << 10)
+
+/* RSV, FRAG and the longest ATYP, DST.ADDR and DST.PORT */
+#define SINGBOX_UDP_HDR_MAX (3 + 2 + 255 + 2)
+
+/* fifo segments a datagram's payload may span */
+#define SINGBOX_UDP_N_SEGS 4
+
+static singbox_udp_flow_t *
+singbox_udp_flow_get (singbox_main_t *sm, u32 handle)
+{
+  u32 flow_index = handle & SINGBOX_SESSION_INDEX_MASK;
+  singbox_wrk_t *wrk;
+
+  wrk = singbox_wrk_get (sm, handle >> SINGBOX_SESSION_INDEX_BITS);
+  if (pool_is_free_index (wrk->udp_flows, flow_index))
+    return NULL;
+  return pool_elt_at_index (wrk->udp_flows, flow_index);
+}
+
+static void
+singbox_udp_assoc_put (singbox_wrk_t *wrk, singbox_udp_assoc_t *assoc)
+{
+  if (assoc->session_handle != SESSION_INVALID_HANDLE || assoc->n_flows)
+    return;
+
+  hash_free (assoc->flow_by_addr);
+  pool_put (wrk->udp_assocs, assoc);
+}
+
+static void
+singbox_udp_flow_unmap (singbox_wrk_t *wrk, singbox_udp_flow_t *flow)
+{
+  singbox_udp_assoc_t *assoc;
+  uword *p;
+
+  assoc = pool_elt_at_index (wrk->udp_assocs, flow->assoc_index);
+  p = hash_get_mem (assoc->flow_by_addr, flow->addr);
+  if (p && p[0] == flow->flow_index)
+    hash_unset_mem (assoc->flow_by_addr, flow->addr);
+}
+
+static void
+singbox_udp_flow_free (singbox_wrk_t *wrk, singbox_udp_flow_t *flow)
+{
+  singbox_udp_assoc_t *assoc;
+
+  singbox_udp_flow_unmap (wrk, flow);
+  assoc = pool_elt_at_index (wrk->udp_assocs, flow->assoc_index);
+  assoc->n_flows--;
+
+  vec_free (flow->addr);
+  vec_free (flow->pending);
+  pool_put (wrk->udp_flows, flow);
+
+  singbox_udp_assoc_put (wrk, assoc);
+}
+
+static void
+singbox_udp_disconnect (singbox_main_t *sm, session_handle_t sh)
+{
+  vnet_disconnect_args_t _a = { 0 }, *a = &_a;
+
+  a->handle = sh;
+  a->app_index = sm->server_app_index;
+  vnet_disconnect_session (a);
+}
+
+/**
+ * @brief Stop relaying to a flow's destination
+ *
+ * Flows still being set up are freed along with the result.
+ */
+static void
+singbox_udp_flow_close (singbox_main_t *sm, singbox_wrk_t *wrk,
+                        singbox_udp_flow_t *flow)
+{
+  u8 state = flow->state;
+
+  if (state == SINGBOX_UDP_FLOW_CLOSED)
+    return;
+
+  flow->state = SINGBOX_UDP_FLOW_CLOSED;
+  singbox_udp_flow_unmap (wrk, flow);
+
+  /* the session follows the fifos when it moves, the cleanup callback
+   * frees the flow */
+  if (state == SINGBOX_UDP_FLOW_READY)
+    singbox_udp_disconnect (sm, flow->tx_fifo->vpp_sh);
+}
+
+/**
+ * @brief Close an association and all of its flows
+ */
+static void
+singbox_udp_assoc_close (singbox_main_t *sm, singbox_wrk_t *wrk,
+                         singbox_udp_assoc_t *assoc)
+{
+  u32 *flows = 0, *fi;
+  u8 *key;
+  uword value;
+
+  if (assoc->is_closed)
+    return;
+  assoc->is_closed = 1;
+
+  hash_foreach_mem (key, value, assoc->flow_by_addr,
+                    ({ vec_add1 (flows, value); }));
+  vec_foreach (fi, flows)
+    singbox_udp_flow_close (sm, wrk, pool_elt_at_index (wrk->udp_flows, *fi));
+  vec_free (flows);
+}
+
+static void
+singbox_udp_flow_tx_pending (singbox_wrk_t *wrk, singbox_udp_flow_t *flow)
+{
+  if (flow->tx_pending)
+    return;
+
+  flow->tx_pending = 1;
+  vec_add1 (wrk->udp_flows_tx, flow->flow_index);
+}
+
+/**
+ * @brief One transmit event per flow written to in this batch
+ */
+static void
+singbox_udp_flush (singbox_wrk_t *wrk)
+{
+  singbox_udp_flow_t *flow;
+  u32 *fi;
+
+  vec_foreach (fi, wrk->udp_flows_tx)
+    {
+      flow = pool_elt_at_index (wrk->udp_flows, *fi);
+      flow->tx_pending = 0;
+      session_relay_tx_event (flow->tx_fifo, flow->tx_fifo->vpp_sh);
+    }
+  vec_reset_length (wrk->udp_flows_tx);
+}
+
+/**
+ * @brief Queue a datagram to a flow's destination
+ *
+ * @param segs - Payload in segs[1] onwards, segs[0] is for the header
+ */
+static int
+singbox_udp_flow_send (singbox_wrk_t *wrk, singbox_udp_flow_t *flow,
+                       svm_fifo_seg_t *segs, u32 n_segs, u32 len)
+{
+  session_dgram_hdr_t hdr = { 0 };
+
+  if (svm_fifo_max_enqueue_prod (flow->tx_fifo) < sizeof (hdr) + len)
+    return -1;
+
+  /* the session is connected, only the length matters */
+  hdr.data_length = len;
+  hdr.is_ip4 = flow->is_ip4;
+  hdr.rmt_ip = flow->ip;
+  hdr.rmt_port = clib_host_to_net_u16 (flow->port);
+  segs[0].data = (u8 *) &hdr;
+  segs[0].len = sizeof (hdr);
+
+  if (svm_fifo_enqueue_segments (flow->tx_fifo, segs, 1 + n_segs,
+                                 0 /* allow_partial */) < 0)
+    return -1;
+
+  singbox_udp_flow_tx_pending (wrk, flow);
+  return 0;
+}
+
+/**
+ * @brief Relay the replies a flow received to the client
+ *
+ * Each reply gets the SOCKS5 UDP header, with the destination as the
+ * client addressed it.
+ */
+static void
+singbox_udp_flow_drain (singbox_main_t *sm, singbox_wrk_t *wrk,
+                        singbox_udp_flow_t *flow, f64 now)
+{
+  svm_fifo_seg_t segs[3 + SINGBOX_UDP_N_SEGS];
+  session_dgram_hdr_t hdr, rhdr = { 0 };
+  u8 rsv_frag[3] = { 0 };
+  singbox_udp_assoc_t *assoc;
+  svm_fifo_t *tx_fifo = 0;
+  u32 alen, n_segs, n_sent = 0;
+  session_t *s;
+
+  assoc = pool_elt_at_index (wrk->udp_assocs, flow->assoc_index);
+  if (!assoc->is_closed &&
+      (s = session_get_from_handle_if_valid (assoc->session_handle)))
+    tx_fifo = s->tx_fifo;
+
+  alen = vec_len (flow->addr);
+  segs[1].data = rsv_frag;
+  segs[1].len = sizeof (rsv_frag);
+  segs[2].data = flow->addr;
+  segs[2].len = alen;
+
+  while (svm_fifo_max_dequeue_cons (flow->rx_fifo) >= sizeof (hdr))
+    {
+      svm_fifo_peek (flow->rx_fifo, 0, sizeof (hdr), (u8 *) &hdr);
+
+      n_segs = 0;
+      if (hdr.data_length)
+        {
+          n_segs = SINGBOX_UDP_N_SEGS;
+          if (svm_fifo_segments (flow->rx_fifo, sizeof (hdr), &segs[3],
+                                 &n_segs, hdr.data_length) != hdr.data_length)
+            n_segs = ~0;
+        }
+
+      rhdr.data_length = sizeof (rsv_frag) + alen + hdr.data_length;
+      if (!tx_fifo || n_segs == ~0 ||
+          svm_fifo_max_enqueue_prod (tx_fifo) <
+            sizeof (rhdr) + rhdr.data_length)
+        wrk->server_udp_drops++;
+      else
+        {
+          segs[0].data = (u8 *) &rhdr;
+          segs[0].len = sizeof (rhdr);
+          svm_fifo_enqueue_segments (tx_fifo, segs, 3 + n_segs,
+                                     0 /* allow_partial */);
+          wrk->server_udp_dgrams++;
+          wrk->server_bytes_forwarded += hdr.data_length;
+          n_sent++;
+        }
+
+      svm_fifo_dequeue_drop (flow->rx_fifo, sizeof (hdr) + hdr.data_length);
+    }
+
+  if (!n_sent)
+    return;
+
+  flow->last_activity = now;
+  session_relay_tx_event (tx_fifo, assoc->session_handle);
+}
+
+static void
+singbox_udp_flow_rx_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_udp_flow_t *flow;
+
+  flow = singbox_udp_flow_get (sm, pointer_to_uword (arg));
+  if (!flow)
+    return;
+
+  /* replies arriving from here on ask again */
+  clib_atomic_store_rel_n (&flow->rx_pending, 0);
+  if (flow->state == SINGBOX_UDP_FLOW_READY)
+    singbox_udp_flow_drain (sm,
+                            singbox_wrk_get (sm, vlib_get_thread_index ()),
+                            flow, vlib_time_now (vlib_get_main ()));
+}
+
+/* ========== FLOW SETUP ========== */
+
+static void
+singbox_udp_flow_failed (singbox_main_t *sm, singbox_udp_flow_t *flow)
+{
+  singbox_wrk_t *wrk = singbox_wrk_get (sm, vlib_get_thread_index ());
+
+  if (sm->verbose)
+    clib_warning ("udp flow %u to %U:%d failed", flow->flow_index,
+                  format_ip46_address, &flow->ip, IP46_TYPE_ANY, flow->port);
+  singbox_udp_flow_free (wrk, flow);
+}
+
+static void
+singbox_udp_flow_failed_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_udp_flow_t *flow;
+
+  flow = singbox_udp_flow_get (sm, pointer_to_uword (arg));
+  if (flow)
+    singbox_udp_flow_failed (sm, flow);
+}
+
+static void
+singbox_udp_flow_failed_on_owner (u32 handle)
+{
+  session_send_rpc_evt_to_thread (handle >> SINGBOX_SESSION_INDEX_BITS,
+                                  singbox_udp_flow_failed_rpc,
+                                  uword_to_pointer (handle, void *));
+}
+
+static void
+singbox_udp_connect_rpc (void *rpc_args)
+{
+  vnet_connect_args_t *a = rpc_args;
+
+  if (vnet_connect (a))
+    singbox_udp_flow_failed_on_owner (a->api_context);
+
+  vec_free (a);
+}
+
+/**
+ * @brief Open the flow's connected session to its destination
+ *
+ * Connects must be issued from the transport's connect thread.
+ */
+static void
+singbox_udp_flow_connect (singbox_main_t *sm, singbox_udp_flow_t *flow,
+                          u32 handle)
+{
+  vnet_connect_args_t *a = 0;
+
+  flow->state = SINGBOX_UDP_FLOW_CONNECTING;
+
+  vec_validate (a, 0);
+  clib_memset (a, 0, sizeof (a[0]));
+  a->sep_ext = (session_endpoint_cfg_t) SESSION_ENDPOINT_CFG_NULL;
+  a->sep_ext.transport_proto = TRANSPORT_PROTO_UDP;
+  a->sep_ext.transport_flags = TRANSPORT_CFG_F_CONNECTED;
+  a->sep_ext.is_ip4 = flow->is_ip4;
+  a->sep_ext.ip = flow->ip;
+  a->sep_ext.port = clib_host_to_net_u16 (flow->port);
+  a->app_index = sm->server_app_index;
+  a->api_context = handle;
+
+  session_send_rpc_evt_to_thread_force (transport_cl_thread (),
+                                        singbox_udp_connect_rpc, a);
+}
+
+static void
+singbox_udp_flow_resolved (dns_cache_resolve_t *r)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_udp_flow_t *flow;
+
+  flow = singbox_udp_flow_get (sm, r->handle);
+  if (!flow)
+    ;
+  else if (r->rv || flow->state == SINGBOX_UDP_FLOW_CLOSED)
+    singbox_udp_flow_failed (sm, flow);
+  else
+    {
+      flow->ip = r->ip;
+      flow->is_ip4 = r->is_ip4;
+      singbox_udp_flow_connect (sm, flow, r->handle);
+    }
+
+  dns_cache_resolve_free (r);
+}
+
+/**
+ * @brief Flow's destination is connected, send what was held for it
+ */
+static void
+singbox_udp_flow_connected_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  svm_fifo_seg_t segs[2];
+  singbox_udp_flow_t *flow;
+  singbox_wrk_t *wrk;
+  u8 *p;
+  u32 len;
+
+  flow = singbox_udp_flow_get (sm, pointer_to_uword (arg));
+  if (!flow || !flow->tx_fifo)
+    return;
+
+  wrk = singbox_wrk_get (sm, vlib_get_thread_index ());
+  if (flow->state == SINGBOX_UDP_FLOW_CLOSED)
+    {
+      singbox_udp_disconnect (sm, flow->tx_fifo->vpp_sh);
+      return;
+    }
+
+  flow->state = SINGBOX_UDP_FLOW_READY;
+  for (p = flow->pending; p < vec_end (flow->pending); p += sizeof (u32) + len)
+    {
+      len = clib_mem_unaligned (p, u32);
+      segs[1].data = p + sizeof (u32);
+      segs[1].len = len;
+      if (singbox_udp_flow_send (wrk, flow, segs, len ? 1 : 0, len))
+        wrk->server_udp_drops++;
+      else
+        wrk->server_udp_dgrams++;
+    }
+  vec_free (flow->pending);
+  singbox_udp_flush (wrk);
+
+  /* replies that beat us here */
+  singbox_udp_flow_drain (sm, wrk, flow, vlib_time_now (vlib_get_main ()));
+}
+
+/**
+ * @brief Set up a flow for a new destination of the association
+ */
+static singbox_udp_flow_t *
+singbox_udp_flow_create (singbox_main_t *sm, singbox_wrk_t *wrk,
+                         singbox_udp_assoc_t *assoc, f64 now)
+{
+  singbox_udp_flow_t *flow;
+  u8 *name = 0;
+  u32 handle;
+
+  if (assoc->n_flows >= SINGBOX_UDP_MAX_FLOWS)
+    return NULL;
+
+  /* other threads look flows up when their replies arrive */
+  pool_get_aligned_safe (wrk->udp_flows, flow, CLIB_CACHE_LINE_BYTES);
+  clib_memset (flow, 0, sizeof (*flow));
+  flow->flow_index = flow - wrk->udp_flows;
+  flow->assoc_index = assoc->assoc_index;
+  flow->last_activity = now;
+  flow->addr = vec_dup (wrk->udp_addr);
+  hash_set_mem (assoc->flow_by_addr, flow->addr, flow->flow_index);
+  assoc->n_flows++;
+
+  handle = singbox_udp_handle (vlib_get_thread_index (), flow->flow_index);
+  singbox_socks5_addr_decode (flow->addr, &flow->is_ip4, &flow->ip, &name,
+                              &flow->port);
+  if (name)
+    {
+      flow->state = SINGBOX_UDP_FLOW_RESOLVING;
+      dns_cache_resolve (&sm->server_resolver, name, handle,
+                         singbox_udp_flow_resolved);
+    }
+  else
+    singbox_udp_flow_connect (sm, flow, handle);
+
+  return flow;
+}
+
+/* ========== CLIENT SIDE ========== */
+
+/**
+ * @brief Relay one datagram from the client
+ *
+ * @param buf - Start of the datagram, its SOCKS5 UDP header at least
+ */
+static void
+singbox_udp_client_dgram (singbox_main_t *sm, singbox_wrk_t *wrk,
+                          singbox_udp_assoc_t *assoc, svm_fifo_t *f,
+                          session_dgram_hdr_t *hdr, u8 *buf, u32 n, f64 now)
+{
+  svm_fifo_seg_t segs[1 + SINGBOX_UDP_N_SEGS];
+  singbox_udp_flow_t *flow;
+  u32 n_segs, offset, len;
+  int alen;
+  uword *p;
+  u8 *data;
+
+  /* fragments are not supported, those are dropped */
+  if (n < 4 || buf[0] || buf[1] || buf[2])
+    goto drop;
+
+  alen = singbox_socks5_addr_len (&buf[3], n - 3);
+  if (alen <= 0)
+    goto drop;
+
+  vec_reset_length (wrk->udp_addr);
+  vec_add (wrk->udp_addr, &buf[3], alen);
+  p = hash_get_mem (assoc->flow_by_addr, wrk->udp_addr);
+  if (p)
+    flow = pool_elt_at_index (wrk->udp_flows, p[0]);
+  else if (!(flow = singbox_udp_flow_create (sm, wrk, assoc, now)))
+    goto drop;
+
+  flow->last_activity = now;
+  offset = sizeof (*hdr) + 3 + alen;
+  len = hdr->data_length - 3 - alen;
+
+  if (flow->state != SINGBOX_UDP_FLOW_READY)
+    {
+      if (vec_len (flow->pending) + sizeof (u32) + len >
+          SINGBOX_UDP_PENDING_MAX)
+        goto drop;
+      vec_add2 (flow->pending, data, sizeof (u32) + len);
+      clib_mem_unaligned (data, u32) = len;
+      svm_fifo_peek (f, offset, len, data + sizeof (u32));
+      return;
+    }
+
+  n_segs = 0;
+  if (len)
+    {
+      n_segs = SINGBOX_UDP_N_SEGS;
+      if (svm_fifo_segments (f, offset, &segs[1], &n_segs, len) != len)
+        goto drop;
+    }
+  if (singbox_udp_flow_send (wrk, flow, segs, n_segs, len))
+    goto drop;
+
+  wrk->server_udp_dgrams++;
+  wrk->server_bytes_forwarded += len;
+  return;
+
+drop:
+  wrk->server_udp_drops++;
+}
+
+static int
+singbox_udp_client_rx (singbox_main_t *sm, session_t *s)
+{
+  u8 buf[SINGBOX_UDP_HDR_MAX];
+  singbox_udp_assoc_t *assoc;
+  session_dgram_hdr_t hdr;
+  singbox_wrk_t *wrk;
+  f64 now;
+  u32 n;
+
+  wrk = singbox_wrk_get (sm, s->thread_index);
+  if (pool_is_free_index (wrk->udp_assocs, s->opaque) ||
+      (assoc = pool_elt_at_index (wrk->udp_assocs, s->opaque))->is_closed)
+    {
+      svm_fifo_dequeue_drop_all (s->rx_fifo);
+      return 0;
+    }
+
+  now = vlib_time_now (vlib_get_main ());
+  while (svm_fifo_max_dequeue_cons (s->rx_fifo) >= sizeof (hdr))
+    {
+      svm_fifo_peek (s->rx_fifo, 0, sizeof (hdr), (u8 *) &hdr);
+      n = clib_min (hdr.data_length, sizeof (buf));
+      svm_fifo_peek (s->rx_fifo, sizeof (hdr), n, buf);
+      singbox_udp_client_dgram (sm, wrk, assoc, s->rx_fifo, &hdr, buf, n,
+                                now);
+      svm_fifo_dequeue_drop (s->rx_fifo, sizeof (hdr) + hdr.data_length);
+    }
+
+  singbox_udp_flush (wrk);
+  return 0;
+}
+
+/**
+ * @brief Client's first datagram to the relay port
+ *
+ * Only clients with an association, by exact port or by address, are
+ * let in.
+ */
+int
+singbox_server_udp_accept (singbox_main_t *sm, session_t *s)
+{
+  transport_connection_t *tc;
+  singbox_udp_assoc_t *assoc;
+  clib_bihash_kv_8_8_t kv;
+  singbox_wrk_t *wrk;
+
+  tc = session_get_transport (s);
+  if (!tc->is_ip4)
+    return -1;
+
+  kv.key = singbox_udp_assoc_key (&tc->rmt_ip.ip4, tc->rmt_port);
+  if (clib_bihash_search_8_8 (&sm->udp_assoc_table, &kv, &kv))
+    {
+      kv.key = singbox_udp_assoc_key (&tc->rmt_ip.ip4, 0);
+      if (clib_bihash_search_8_8 (&sm->udp_assoc_table, &kv, &kv))
+        {
+          wrk = singbox_wrk_get (sm, s->thread_index);
+          wrk->server_udp_drops++;
+          return -1;
+        }
+    }
+
+  wrk = singbox_wrk_get (sm, s->thread_index);
+  pool_get_zero (wrk->udp_assocs, assoc);
+  assoc->assoc_index = assoc - wrk->udp_assocs;
+  assoc->session_handle = session_handle (s);
+  assoc->key = kv.key;
+  assoc->control_handle = kv.value;
+  assoc->flow_by_addr = hash_create_vec (0, sizeof (u8), sizeof (uword));
+
+  s->opaque = assoc->assoc_index;
+  s->session_state = SESSION_STATE_READY;
+  return 0;
+}
+
+int
+singbox_server_udp_connected (singbox_main_t *sm, u32 opaque, session_t *s,
+                              session_error_t err)
+{
+  singbox_udp_flow_t *flow;
+
+  if (err)
+    {
+      singbox_udp_flow_failed_on_owner (opaque);
+      return 0;
+    }
+
+  flow = singbox_udp_flow_get (sm, opaque);
+  ASSERT (flow);
+
+  /* the owner takes the fifos over once told, until then only we
+   * write them */
+  s->opaque = opaque;
+  flow->rx_fifo = s->rx_fifo;
+  flow->tx_fifo = s->tx_fifo;
+  session_send_rpc_evt_to_thread_force (opaque >> SINGBOX_SESSION_INDEX_BITS,
+                                        singbox_udp_flow_connected_rpc,
+                                        uword_to_pointer (opaque, void *));
+  return 0;
+}
+
+int
+singbox_server_udp_rx (singbox_main_t *sm, session_t *s)
+{
+  u32 owner = s->opaque >> SINGBOX_SESSION_INDEX_BITS;
+  singbox_udp_flow_t *flow;
+
+  /* the client's session, or a flow's? */
+  if (s->listener_handle != SESSION_INVALID_HANDLE)
+    return singbox_udp_client_rx (sm, s);
+
+  flow = singbox_udp_flow_get (sm, s->opaque);
+  if (!flow)
+    return -1;
+
+  if (owner == s->thread_index)
+    {
+      if (flow->state == SINGBOX_UDP_FLOW_READY)
+        singbox_udp_flow_drain (sm, singbox_wrk_get (sm, owner), flow,
+                                vlib_time_now (vlib_get_main ()));
+    }
+  else if (!clib_atomic_swap_acq_n (&flow->rx_pending, 1))
+    session_send_rpc_evt_to_thread (owner, singbox_udp_flow_rx_rpc,
+                                    uword_to_pointer (s->opaque, void *));
+
+  return 0;
+}
+
+void
+singbox_server_udp_close (singbox_main_t *sm, session_t *s)
+{
+  singbox_udp_assoc_t *assoc;
+  singbox_wrk_t *wrk;
+
+  if (s->listener_handle == SESSION_INVALID_HANDLE)
+    {
+      /* the flow goes with the cleanup */
+      singbox_udp_disconnect (sm, session_handle (s));
+      return;
+    }
+
+  wrk = singbox_wrk_get (sm, s->thread_index);
+  if (pool_is_free_index (wrk->udp_assocs, s->opaque))
+    return;
+  assoc = pool_elt_at_index (wrk->udp_assocs, s->opaque);
+  singbox_udp_assoc_close (sm, wrk, assoc);
+  singbox_udp_disconnect (sm, session_handle (s));
+}
+
+static void
+singbox_udp_flow_free_rpc (void *arg)
+{
+  singbox_main_t *sm = &singbox_main;
+  singbox_udp_flow_t *flow;
+
+  flow = singbox_udp_flow_get (sm, pointer_to_uword (arg));
+  if (flow)
+    singbox_udp_flow_free (singbox_wrk_get (sm, vlib_get_thread_index ()),
+                           flow);
+}
+
+void
+singbox_server_udp_cleanup (singbox_main_t *sm, session_t *s)
+{
+  u32 owner = s->opaque >> SINGBOX_SESSION_INDEX_BITS;
+  singbox_udp_assoc_t *assoc;
+  singbox_wrk_t *wrk;
+
+  if (s->listener_handle == SESSION_INVALID_HANDLE)
+    {
+      /* the flow's fifos go with the session */
+      if (owner == s->thread_index)
+        singbox_udp_flow_free_rpc (uword_to_pointer (s->opaque, void *));
+      else
+        session_send_rpc_evt_to_thread (owner, singbox_udp_flow_free_rpc,
+                                        uword_to_pointer (s->opaque, void *));
+      return;
+    }
+
+  wrk = singbox_wrk_get (sm, s->thread_index);
+  if (pool_is_free_index (wrk->udp_assocs, s->opaque))
+    return;
+  assoc = pool_elt_at_index (wrk->udp_assocs, s->opaque);
+  singbox_udp_assoc_close (sm, wrk, assoc);
+  assoc->session_handle = SESSION_INVALID_HANDLE;
+  singbox_udp_assoc_put (wrk, assoc);
+}
+
+/**
+ * @brief Close this thread's idle flows and orphaned associations
+ *
+ * An association ends with the TCP connection it was requested on,
+ * which takes its key out of the table, or when a newer one takes the
+ * key over.
+ */
+void
+singbox_server_udp_expire (singbox_main_t *sm, singbox_wrk_t *wrk, f64 now)
+{
+  singbox_udp_assoc_t *assoc;
+  singbox_udp_flow_t *flow;
+  clib_bihash_kv_8_8_t kv;
+
+  if (!sm->server_mode_enabled)
+    return;
+
+  pool_foreach (assoc, wrk->udp_assocs)
+    {
+      if (assoc->is_closed)
+        continue;
+
+      kv.key = assoc->key;
+      if (!clib_bihash_search_8_8 (&sm->udp_assoc_table, &kv, &kv) &&
+          kv.value == assoc->control_handle)
+        continue;
+
+      singbox_udp_assoc_close (sm, wrk, assoc);
+      singbox_udp_disconnect (sm, assoc->session_handle);
+    }
+
+  pool_foreach (flow, wrk->udp_flows)
+    {
+      if (flow->state == SINGBOX_UDP_FLOW_READY &&
+          now - flow->last_activity > SINGBOX_UDP_FLOW_IDLE_TIMEOUT)
+        singbox_udp_flow_close (sm, wrk, flow);
+    }
+}
+
+/**
+ * @brief Forget this thread's associations, their sessions are gone
+ */
+void
+singbox_server_udp_reset (singbox_wrk_t *wrk)
+{
+  singbox_udp_assoc_t *assoc;
+  singbox_udp_flow_t *flow;
+
+  pool_foreach (assoc, wrk->udp_assocs)
+    hash_free (assoc->flow_by_addr);
+  pool_foreach (flow, wrk->udp_flows)
+    {
+      vec_free (flow->addr);
+      vec_free (flow->pending);
+    }
+
+  pool_free (wrk->udp_assocs);
+  pool_free (wrk->udp_flows);
+  vec_free (wrk->udp_flows_tx);
+  vec_free (wrk->udp_addr);
+}
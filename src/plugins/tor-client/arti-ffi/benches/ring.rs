@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! Ring channel microbenchmark
+//!
+//! Plays the VPP thread against the loopback backend: every stream sends
+//! its bytes through the ring and waits for the echo to come back, with
+//! credits handled as tor_socks5.c does, and the session fifos taken to
+//! drain instantly. Reports throughput and the wakeups it took.
+//!
+//!     cargo bench --bench ring [-- <streams> <MB per stream>]
+
+use arti_vpp_ffi::loopback::Loopback;
+use arti_vpp_ffi::ring::*;
+use std::sync::atomic::Ordering;
+use std::sync::Arc;
+use std::time::Instant;
+
+/// Window granted to the Tor side, as a 64 KB session fifo would
+const RX_WINDOW: u32 = 64 << 10;
+
+struct Stream {
+    tx_credit: u32,
+    to_send: u64,
+    received: u64,
+    rx_unacked: u32,
+    closed: bool,
+}
+
+struct Producer<'a> {
+    ring: &'a Ring,
+    head: u32,
+    published: u32,
+}
+
+impl<'a> Producer<'a> {
+    fn slot(&mut self, stream: u32, kind: u16, len: u32) -> Option<&'a mut Slot> {
+        if !self.ring.has_space(self.head) && !self.ring.wait_for_space(self.head) {
+            return None;
+        }
+        let slot = unsafe { &mut *self.ring.slot(self.head) };
+        slot.stream = stream;
+        slot.kind = kind;
+        slot.len = len;
+        self.head = self.head.wrapping_add(1);
+        Some(slot)
+    }
+
+    fn flush(&mut self, chan: &Chan, kicks: &mut u64) {
+        if self.head != self.published {
+            if self.ring.publish(self.published, self.head) {
+                chan.kick();
+                *kicks += 1;
+            }
+            self.published = self.head;
+        }
+    }
+}
+
+fn wait_event(fd: i32) -> bool {
+    let mut pfd = libc::pollfd { fd, events: libc::POLLIN, revents: 0 };
+    let mut val: u64 = 0;
+    unsafe {
+        if libc::poll(&mut pfd, 1, 100) <= 0 {
+            return false;
+        }
+        libc::read(fd, &mut val as *mut u64 as *mut libc::c_void, 8);
+    }
+    true
+}
+
+fn run(n_streams: u32, bytes_per_stream: u64) {
+    let runtime = tokio::runtime::Builder::new_multi_thread()
+        .worker_threads(4)
+        .enable_all()
+        .build()
+        .unwrap();
+    let chan = Chan::new(Arc::new(Loopback), runtime.handle().clone()).unwrap();
+    let to_arti = unsafe { &*chan.shared.to_arti };
+    let from_arti = unsafe { &*chan.shared.from_arti };
+    let event_fd = chan.shared.event_fd;
+
+    let mut streams: Vec<Stream> = (0..n_streams)
+        .map(|i| {
+            chan.connect(i, "loopback:0".to_string(), RX_WINDOW);
+            Stream { tx_credit: 0, to_send: bytes_per_stream, received: 0, rx_unacked: 0, closed: false }
+        })
+        .collect();
+
+    let mut prod = Producer { ring: to_arti, head: 0, published: 0 };
+    let mut tail = 0u32;
+    let (mut kicks, mut wakeups, mut idle) = (0u64, 0u64, 0u64);
+    let mut n_done = 0;
+    let payload = [0x5au8; SLOT_DATA];
+    let start = Instant::now();
+
+    while n_done < n_streams {
+        let mut progress = false;
+
+        /* consume */
+        loop {
+            let head = from_arti.head.load(Ordering::Acquire);
+            if head == tail {
+                break;
+            }
+            while tail != head {
+                let slot = unsafe { &*from_arti.slot(tail) };
+                let st = &mut streams[slot.stream as usize];
+                match slot.kind {
+                    EVT_CONNECTED => st.tx_credit = slot.len,
+                    EVT_CREDIT => st.tx_credit += slot.len,
+                    EVT_DATA => {
+                        st.received += slot.len as u64;
+                        st.rx_unacked += slot.len;
+                        if st.received == bytes_per_stream {
+                            n_done += 1;
+                        }
+                    }
+                    EVT_EOF => panic!("stream {} ended: {}", slot.stream, slot.error),
+                    _ => {}
+                }
+                tail = tail.wrapping_add(1);
+            }
+            if from_arti.consumed(tail) {
+                chan.kick();
+                kicks += 1;
+            }
+            progress = true;
+        }
+
+        /* produce: credit returns, then data */
+        for (i, st) in streams.iter_mut().enumerate() {
+            if st.rx_unacked >= RX_WINDOW / 4 {
+                match prod.slot(i as u32, EVT_CREDIT, st.rx_unacked) {
+                    Some(_) => st.rx_unacked = 0,
+                    None => break,
+                }
+                progress = true;
+            }
+            while st.to_send > 0 && st.tx_credit > 0 {
+                let n = (SLOT_DATA as u64).min(st.to_send).min(st.tx_credit as u64) as u32;
+                match prod.slot(i as u32, EVT_DATA, n) {
+                    Some(slot) => slot.data[..n as usize].copy_from_slice(&payload[..n as usize]),
+                    None => break,
+                }
+                st.to_send -= n as u64;
+                st.tx_credit -= n;
+                progress = true;
+            }
+        }
+        prod.flush(&chan, &mut kicks);
+
+        if !progress {
+            idle += 1;
+            if wait_event(event_fd) {
+                wakeups += 1;
+            }
+        }
+    }
+
+    let secs = start.elapsed().as_secs_f64();
+
+    /* close everything and wait for the acks, consuming all along: the
+     * pump cannot take more closes while its acks find no room */
+    let (mut n_closing, mut n_closed) = (0, 0);
+    while n_closed < n_streams {
+        let head = from_arti.head.load(Ordering::Acquire);
+        while tail != head {
+            let slot = unsafe { &*from_arti.slot(tail) };
+            if slot.kind == EVT_CLOSED && !streams[slot.stream as usize].closed {
+                streams[slot.stream as usize].closed = true;
+                n_closed += 1;
+            }
+            tail = tail.wrapping_add(1);
+        }
+        if from_arti.consumed(tail) {
+            chan.kick();
+        }
+        while n_closing < n_streams && prod.slot(n_closing, EVT_CLOSE, 0).is_some() {
+            n_closing += 1;
+        }
+        prod.flush(&chan, &mut kicks);
+        if n_closed < n_streams && from_arti.head.load(Ordering::Acquire) == tail {
+            wait_event(event_fd);
+        }
+    }
+
+    let mb = (bytes_per_stream * n_streams as u64) as f64 / (1 << 20) as f64;
+    let stats = &chan.inner.stats;
+    println!(
+        "{:5} streams {:8.1} MB {:7.3} s {:9.1} MB/s | per MB: {:6.2} signals {:6.2} kicks \
+         {:6.2} wakeups {:6.2} idle polls | slots {}/{}",
+        n_streams, mb, secs, mb / secs,
+        stats.signals.load(Ordering::Relaxed) as f64 / mb,
+        kicks as f64 / mb,
+        wakeups as f64 / mb,
+        idle as f64 / mb,
+        stats.slots_in.load(Ordering::Relaxed),
+        stats.slots_out.load(Ordering::Relaxed),
+    );
+
+    drop(chan);
+    runtime.shutdown_background();
+}
+
+fn main() {
+    let args: Vec<String> = std::env::args().skip(1).filter(|a| !a.starts_with("--")).collect();
+
+    if let (Some(n), Some(mb)) = (args.first(), args.get(1)) {
+        run(n.parse().unwrap(), mb.parse::<u64>().unwrap() << 20);
+        return;
+    }
+
+    for &(n_streams, mb) in &[(1u32, 256u64), (16, 16), (256, 1), (1024, 1)] {
+        run(n_streams, mb << 20);
+    }
+}
@@ -36,6 +36,11 @@ use std::sync::{Arc, Mutex as StdMutex};
 use tokio::runtime::Runtime;
 use tokio::sync::Mutex as TokioMutex;
 
+pub mod loopback;
+pub mod ring;
+
+use ring::{Backend, BoxStream, Chan};
+
 /// Global Tokio runtime for async operations
 static RUNTIME: Lazy<Runtime> = Lazy::new(|| {
     tokio::runtime::Builder::new_multi_thread()
@@ -443,11 +448,13 @@ pub unsafe extern "C" fn arti_recv(
         return ArtiError::WouldBlock as isize;
     }
 
-    // Read available data
+    // Read available data, a slice copy per ring half
     let to_read = std::cmp::min(len, rx.len());
-    for i in 0..to_read {
-        buffer[i] = rx.pop_front().unwrap();
-    }
+    let (front, back) = rx.as_slices();
+    let n_front = std::cmp::min(to_read, front.len());
+    buffer[..n_front].copy_from_slice(&front[..n_front]);
+    buffer[n_front..to_read].copy_from_slice(&back[..to_read - n_front]);
+    rx.drain(..to_read);
 
     to_read as isize
 }
@@ -518,6 +525,127 @@ pub unsafe extern "C" fn arti_close_stream(stream: *mut c_void) {
     // Stream is automatically cleaned up when dropped
 }
 
+/// Streams of a channel come from Tor
+impl Backend for ArtiClient {
+    fn connect(&self, target: String)
+        -> std::pin::Pin<Box<dyn std::future::Future<Output = std::io::Result<BoxStream>> + Send>> {
+        let client = self.client.clone();
+        Box::pin(async move {
+            match client.connect(target).await {
+                Ok(stream) => Ok(Box::new(stream) as BoxStream),
+                Err(e) => Err(std::io::Error::new(std::io::ErrorKind::ConnectionRefused,
+                                                  e.to_string())),
+            }
+        })
+    }
+}
+
+/// Create a ring channel whose streams go through Tor
+///
+/// One channel serves one VPP thread: that thread alone produces into
+/// `to_arti`, consumes `from_arti`, and polls `event_fd`.
+///
+/// # Returns
+/// Pointer to the channel, whose first fields are `arti_chan_t`, or null
+///
+/// # Safety
+/// Caller must ensure client is valid and outlives the channel
+#[no_mangle]
+pub unsafe extern "C" fn arti_chan_create(client: *mut c_void) -> *mut c_void {
+    if client.is_null() {
+        set_last_error("invalid parameter in arti_chan_create".to_string());
+        return std::ptr::null_mut();
+    }
+
+    let arti_client = &*(client as *mut ArtiClient);
+    let backend = Arc::new(ArtiClient { client: arti_client.client.clone() });
+    chan_create(backend)
+}
+
+/// Create a ring channel whose streams echo locally, for testing
+#[no_mangle]
+pub extern "C" fn arti_chan_create_loopback() -> *mut c_void {
+    chan_create(Arc::new(loopback::Loopback))
+}
+
+fn chan_create(backend: Arc<dyn Backend>) -> *mut c_void {
+    match Chan::new(backend, RUNTIME.handle().clone()) {
+        Ok(chan) => Box::into_raw(chan) as *mut c_void,
+        Err(e) => {
+            set_last_error(format!("failed to create channel: {}", e));
+            std::ptr::null_mut()
+        }
+    }
+}
+
+/// Start connecting a stream of a channel
+///
+/// Returns at once; the outcome comes back on the ring as CONNECTED or
+/// EOF for `stream`. The id is the caller's, and stays taken until the
+/// CLOSED ack of a CLOSE it sends.
+///
+/// # Arguments
+/// * `rx_window` - Bytes the stream may send before the first credit
+///
+/// # Returns
+/// 0 on success, negative error code on failure
+///
+/// # Safety
+/// Caller must ensure chan is valid and addr is a valid C string
+#[no_mangle]
+pub unsafe extern "C" fn arti_chan_connect(
+    chan: *mut c_void,
+    stream: u32,
+    addr: *const c_char,
+    port: u16,
+    rx_window: u32,
+) -> c_int {
+    if chan.is_null() || addr.is_null() {
+        set_last_error("invalid parameter in arti_chan_connect".to_string());
+        return ArtiError::InvalidParameter as c_int;
+    }
+
+    let addr_str = match CStr::from_ptr(addr).to_str() {
+        Ok(s) => s,
+        Err(e) => {
+            set_last_error(format!("invalid UTF-8 in address: {}", e));
+            return ArtiError::InvalidParameter as c_int;
+        }
+    };
+
+    let chan = &*(chan as *mut Chan);
+    chan.connect(stream, format!("{}:{}", addr_str, port), rx_window);
+    ArtiError::Ok as c_int
+}
+
+/// Wake a channel's runtime side
+///
+/// For after publishing into an idle `to_arti`, or consuming from a
+/// `from_arti` whose producer waits for room.
+///
+/// # Safety
+/// Caller must ensure chan is valid
+#[no_mangle]
+pub unsafe extern "C" fn arti_chan_kick(chan: *mut c_void) {
+    if chan.is_null() {
+        return;
+    }
+    (*(chan as *mut Chan)).kick();
+}
+
+/// Destroy a channel and every stream still on it
+///
+/// # Safety
+/// Caller must ensure chan is valid and not used after this call; the
+/// rings and eventfd go with it
+#[no_mangle]
+pub unsafe extern "C" fn arti_chan_destroy(chan: *mut c_void) {
+    if chan.is_null() {
+        return;
+    }
+    let _ = Box::from_raw(chan as *mut Chan);
+}
+
 /// Shutdown Arti client
 ///
 /// # Arguments
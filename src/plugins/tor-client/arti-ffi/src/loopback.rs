@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! Local stand-in for Tor streams
+//!
+//! Every connect succeeds at once with an in-memory echo stream, so the
+//! ring channel can be exercised and measured without a Tor network.
+
+use crate::ring::{Backend, BoxStream};
+use futures::io::{AsyncRead, AsyncWrite};
+use std::collections::VecDeque;
+use std::future::Future;
+use std::io;
+use std::pin::Pin;
+use std::task::{Context, Poll, Waker};
+
+/// Bytes an echo stream buffers before pushing back on its writer
+const ECHO_BUFFER: usize = 256 << 10;
+
+/// Backend whose streams echo back what they are sent
+pub struct Loopback;
+
+impl Backend for Loopback {
+    fn connect(&self, _target: String)
+        -> Pin<Box<dyn Future<Output = io::Result<BoxStream>> + Send>> {
+        Box::pin(async { Ok(Box::new(EchoStream::default()) as BoxStream) })
+    }
+}
+
+#[derive(Default)]
+struct EchoStream {
+    buf: VecDeque<u8>,
+    reader: Option<Waker>,
+    writer: Option<Waker>,
+    closed: bool,
+}
+
+impl AsyncRead for EchoStream {
+    fn poll_read(mut self: Pin<&mut Self>, cx: &mut Context<'_>, out: &mut [u8])
+        -> Poll<io::Result<usize>> {
+        if self.buf.is_empty() {
+            if self.closed {
+                return Poll::Ready(Ok(0));
+            }
+            self.reader = Some(cx.waker().clone());
+            return Poll::Pending;
+        }
+
+        let n = out.len().min(self.buf.len());
+        let (front, back) = self.buf.as_slices();
+        let n_front = n.min(front.len());
+        out[..n_front].copy_from_slice(&front[..n_front]);
+        out[n_front..n].copy_from_slice(&back[..n - n_front]);
+        self.buf.drain(..n);
+
+        if let Some(w) = self.writer.take() {
+            w.wake();
+        }
+        Poll::Ready(Ok(n))
+    }
+}
+
+impl AsyncWrite for EchoStream {
+    fn poll_write(mut self: Pin<&mut Self>, cx: &mut Context<'_>, data: &[u8])
+        -> Poll<io::Result<usize>> {
+        if self.closed {
+            return Poll::Ready(Err(io::ErrorKind::BrokenPipe.into()));
+        }
+
+        let n = data.len().min(ECHO_BUFFER - self.buf.len());
+        if n == 0 {
+            self.writer = Some(cx.waker().clone());
+            return Poll::Pending;
+        }
+        self.buf.extend(&data[..n]);
+
+        if let Some(w) = self.reader.take() {
+            w.wake();
+        }
+        Poll::Ready(Ok(n))
+    }
+
+    fn poll_flush(self: Pin<&mut Self>, _cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        Poll::Ready(Ok(()))
+    }
+
+    fn poll_close(mut self: Pin<&mut Self>, _cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        self.closed = true;
+        if let Some(w) = self.reader.take() {
+            w.wake();
+        }
+        Poll::Ready(Ok(()))
+    }
+}
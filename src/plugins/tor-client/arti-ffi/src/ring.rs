@@ -0,0 +1,660 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! Shared-memory ring channel between a VPP thread and the Tor runtime
+//!
+//! One channel serves every stream of one VPP thread. It holds two
+//! single-producer single-consumer rings of fixed-size slots, in the
+//! spirit of memif and the session message queues:
+//!
+//! - `to_arti`: produced by the VPP thread, consumed by the channel's
+//!   pump task. Carries stream data, credit returns and closes.
+//! - `from_arti`: produced by the stream tasks (serialized by a lock on
+//!   this side only), consumed by the VPP thread. Carries stream data,
+//!   credit returns, connect results, end of stream and close acks.
+//!
+//! Wakeups are per channel, not per stream, and only on an empty to
+//! non-empty transition: the Rust side writes the channel eventfd, the
+//! VPP side calls `arti_chan_kick()`. Under load both ends keep finding
+//! work in the rings and no syscalls happen at all.
+//!
+//! Flow control is credit based, in bytes, per stream and direction.
+//! VPP grants what fits in its session fifo, so data arriving on the
+//! ring always has room; the Rust side grants what it is willing to
+//! queue towards Tor. A full ring only delays, it never drops. The
+//! pump may itself wait for room in `from_arti` to ack a close, so VPP
+//! must keep consuming `from_arti` while `to_arti` is full, never block
+//! on one ring with the other left alone.
+//!
+//! The layout is mirrored in `arti_ring.h`; keep the two in sync.
+
+use futures::io::{AsyncRead, AsyncReadExt, AsyncWrite, AsyncWriteExt, ReadHalf, WriteHalf};
+use std::alloc::{alloc_zeroed, dealloc, handle_alloc_error, Layout};
+use std::collections::HashMap;
+use std::future::Future;
+use std::io;
+use std::os::raw::c_int;
+use std::os::unix::io::RawFd;
+use std::pin::Pin;
+use std::sync::atomic::{fence, AtomicBool, AtomicI64, AtomicU32, AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use tokio::runtime::Handle;
+use tokio::sync::{mpsc, Notify};
+use tokio::task::JoinHandle;
+
+/// Slots per ring, a power of two
+pub const RING_SLOTS: u32 = 512;
+/// Bytes per slot, header included
+pub const SLOT_SIZE: usize = 4096;
+/// Payload bytes per slot
+pub const SLOT_DATA: usize = SLOT_SIZE - 16;
+
+/// Stream data, either direction
+pub const EVT_DATA: u16 = 1;
+/// Credit returned, either direction; `len` is the byte count
+pub const EVT_CREDIT: u16 = 2;
+/// Stream connected; `len` is the initial credit towards Tor
+pub const EVT_CONNECTED: u16 = 3;
+/// Stream ended on the Tor side; `error` is 0 for a clean end
+pub const EVT_EOF: u16 = 4;
+/// VPP closes the stream
+pub const EVT_CLOSE: u16 = 5;
+/// Close acknowledged: nothing more will be sent for this stream id
+pub const EVT_CLOSED: u16 = 6;
+
+/// Errors carried in `Slot::error`, same values as `ArtiError`
+pub const ERR_CONNECT: i32 = -3;
+pub const ERR_IO: i32 = -4;
+
+/// Bytes VPP may send on a new stream before the first credit return
+pub const TX_WINDOW: u32 = 256 << 10;
+/// Written bytes returned as credit in one go
+const CREDIT_BATCH: u32 = 64 << 10;
+
+/// A ring slot
+#[repr(C)]
+pub struct Slot {
+    pub stream: u32,
+    pub kind: u16,
+    pub flags: u16,
+    pub len: u32,
+    pub error: i32,
+    pub data: [u8; SLOT_DATA],
+}
+
+/// A single-producer single-consumer ring
+///
+/// `head` is only written by the producer, `tail` only by the consumer.
+/// `producer_waiting` is set by a producer that found the ring full and
+/// cleared by the consumer when it frees slots.
+#[repr(C, align(64))]
+pub struct Ring {
+    pub head: AtomicU32,
+    _pad0: [u8; 60],
+    pub tail: AtomicU32,
+    _pad1: [u8; 60],
+    pub producer_waiting: AtomicU32,
+    _pad2: [u8; 60],
+    pub slots: [Slot; RING_SLOTS as usize],
+}
+
+impl Ring {
+    fn alloc() -> *mut Ring {
+        let layout = Layout::new::<Ring>();
+        let ring = unsafe { alloc_zeroed(layout) } as *mut Ring;
+        if ring.is_null() {
+            handle_alloc_error(layout);
+        }
+        ring
+    }
+
+    unsafe fn free(ring: *mut Ring) {
+        dealloc(ring as *mut u8, Layout::new::<Ring>());
+    }
+
+    /// Slot for a free-running ring index
+    ///
+    /// # Safety
+    /// Producers may only write slots between their head and the tail
+    /// plus the ring size, consumers only read between tail and head.
+    pub unsafe fn slot(&self, index: u32) -> *mut Slot {
+        (self.slots.as_ptr() as *mut Slot).add((index & (RING_SLOTS - 1)) as usize)
+    }
+
+    /// Producer: whether a slot is free at `head`
+    pub fn has_space(&self, head: u32) -> bool {
+        head.wrapping_sub(self.tail.load(Ordering::Acquire)) < RING_SLOTS
+    }
+
+    /// Producer: make the slots up to `head` visible
+    ///
+    /// Returns whether the consumer had already drained everything
+    /// before `old_head`, in which case it may be asleep and needs a
+    /// wakeup. Pairs with the fence in `consumed`.
+    pub fn publish(&self, old_head: u32, head: u32) -> bool {
+        self.head.store(head, Ordering::Release);
+        fence(Ordering::SeqCst);
+        self.tail.load(Ordering::Relaxed) == old_head
+    }
+
+    /// Producer: note the ring is full, then check again
+    ///
+    /// Returns true if the consumer freed a slot meanwhile, in which case
+    /// the caller retries instead of waiting.
+    pub fn wait_for_space(&self, head: u32) -> bool {
+        self.producer_waiting.store(1, Ordering::Relaxed);
+        fence(Ordering::SeqCst);
+        self.has_space(head)
+    }
+
+    /// Consumer: release the slots up to `tail`
+    ///
+    /// Returns whether a producer is waiting for them and needs a
+    /// wakeup. The caller must load `head` again afterwards before
+    /// deciding to sleep.
+    pub fn consumed(&self, tail: u32) -> bool {
+        self.tail.store(tail, Ordering::Release);
+        fence(Ordering::SeqCst);
+        if self.producer_waiting.load(Ordering::Relaxed) != 0 {
+            self.producer_waiting.store(0, Ordering::Relaxed);
+            return true;
+        }
+        false
+    }
+}
+
+/// Stream type the channel works with
+pub type BoxStream = Box<dyn StreamIo>;
+
+pub trait StreamIo: AsyncRead + AsyncWrite + Unpin + Send {}
+impl<T: AsyncRead + AsyncWrite + Unpin + Send> StreamIo for T {}
+
+/// Where streams come from: Arti, or a stand-in for benchmarks
+pub trait Backend: Send + Sync + 'static {
+    fn connect(&self, target: String)
+        -> Pin<Box<dyn Future<Output = io::Result<BoxStream>> + Send>>;
+}
+
+/// Channel counters, for benchmarks and debugging
+#[derive(Default)]
+pub struct ChanStats {
+    /// eventfd writes towards VPP
+    pub signals: AtomicU64,
+    /// wakeups of the pump by VPP
+    pub kicks: AtomicU64,
+    /// slots consumed and produced by this side
+    pub slots_in: AtomicU64,
+    pub slots_out: AtomicU64,
+}
+
+/// The part of a channel VPP reads, mirrored by `arti_chan_t` in C
+#[repr(C)]
+pub struct ChanShared {
+    pub to_arti: *mut Ring,
+    pub from_arti: *mut Ring,
+    pub event_fd: c_int,
+}
+
+/// A channel as handed to C: the shared part first
+#[repr(C)]
+pub struct Chan {
+    pub shared: ChanShared,
+    pub inner: Arc<ChanInner>,
+    pump: JoinHandle<()>,
+}
+
+struct Rings {
+    to_arti: *mut Ring,
+    from_arti: *mut Ring,
+}
+
+/* the rings are only touched through their atomics and owned slots */
+unsafe impl Send for Rings {}
+unsafe impl Sync for Rings {}
+
+/// Bytes a stream may still send to VPP
+struct Credit {
+    bytes: AtomicI64,
+    notify: Notify,
+}
+
+impl Credit {
+    fn add(&self, n: u32) {
+        self.bytes.fetch_add(n as i64, Ordering::AcqRel);
+        self.notify.notify_one();
+    }
+
+    async fn wait(&self) -> usize {
+        loop {
+            let n = self.bytes.load(Ordering::Acquire);
+            if n > 0 {
+                return n as usize;
+            }
+            self.notify.notified().await;
+        }
+    }
+}
+
+struct StreamEntry {
+    /// set once the stream id must not produce events any more
+    dead: Arc<AtomicBool>,
+    tx: Option<mpsc::UnboundedSender<Vec<u8>>>,
+    credit: Arc<Credit>,
+    tasks: Vec<JoinHandle<()>>,
+}
+
+pub struct ChanInner {
+    rings: Rings,
+    event_fd: RawFd,
+    backend: Arc<dyn Backend>,
+    runtime: Handle,
+    /// wakes the pump when VPP queued work
+    kick: Notify,
+    /// wakes producers when VPP freed slots
+    space: Notify,
+    /// serializes the producers of `from_arti`, holds their head
+    produce: Mutex<u32>,
+    streams: Mutex<HashMap<u32, StreamEntry>>,
+    closed: AtomicBool,
+    pub stats: ChanStats,
+}
+
+impl Drop for ChanInner {
+    fn drop(&mut self) {
+        unsafe {
+            Ring::free(self.rings.to_arti);
+            Ring::free(self.rings.from_arti);
+            libc::close(self.event_fd);
+        }
+    }
+}
+
+impl ChanInner {
+    fn to_arti(&self) -> &Ring {
+        unsafe { &*self.rings.to_arti }
+    }
+
+    fn from_arti(&self) -> &Ring {
+        unsafe { &*self.rings.from_arti }
+    }
+
+    fn signal(&self) {
+        let val: u64 = 1;
+        unsafe {
+            libc::write(self.event_fd, &val as *const u64 as *const libc::c_void, 8);
+        }
+        self.stats.signals.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Queue an event for VPP, waiting for a free slot if need be
+    ///
+    /// Returns false, without queueing, once the stream is dead or the
+    /// channel is closed: after its close ack a stream id may be reused.
+    async fn push(&self, stream: u32, kind: u16, error: i32, len: u32, data: &[u8],
+                  dead: Option<&AtomicBool>) -> bool {
+        loop {
+            let notified = self.space.notified();
+            tokio::pin!(notified);
+            notified.as_mut().enable();
+            {
+                let mut head = self.produce.lock().unwrap();
+                if self.closed.load(Ordering::Acquire)
+                    || dead.map_or(false, |d| d.load(Ordering::Acquire))
+                {
+                    return false;
+                }
+                let ring = self.from_arti();
+                if ring.has_space(*head) || ring.wait_for_space(*head) {
+                    unsafe {
+                        let slot = &mut *ring.slot(*head);
+                        slot.stream = stream;
+                        slot.kind = kind;
+                        slot.flags = 0;
+                        slot.error = error;
+                        slot.len = len;
+                        slot.data[..data.len()].copy_from_slice(data);
+                    }
+                    let old_head = *head;
+                    *head = old_head.wrapping_add(1);
+                    self.stats.slots_out.fetch_add(1, Ordering::Relaxed);
+                    if ring.publish(old_head, *head) {
+                        self.signal();
+                    }
+                    return true;
+                }
+            }
+            notified.await;
+        }
+    }
+
+    /// Start connecting a stream; the result comes back on the ring
+    fn connect(self: &Arc<Self>, stream: u32, target: String, rx_window: u32) {
+        let dead = Arc::new(AtomicBool::new(false));
+        let credit = Arc::new(Credit {
+            bytes: AtomicI64::new(rx_window as i64),
+            notify: Notify::new(),
+        });
+        let mut streams = self.streams.lock().unwrap();
+        let task = self.runtime.spawn(connect_task(self.clone(), stream, target,
+                                                   dead.clone(), credit.clone()));
+        let old = streams.insert(stream, StreamEntry {
+            dead,
+            tx: None,
+            credit,
+            tasks: vec![task],
+        });
+        /* VPP only reuses an id after its close ack */
+        debug_assert!(old.is_none());
+    }
+
+    /// Register a connected stream's tasks, unless it was closed meanwhile
+    fn attach(&self, stream: u32, dead: &AtomicBool, tx: Option<mpsc::UnboundedSender<Vec<u8>>>,
+              task: JoinHandle<()>) -> bool {
+        let mut streams = self.streams.lock().unwrap();
+        match streams.get_mut(&stream) {
+            Some(entry) if !dead.load(Ordering::Acquire) => {
+                if tx.is_some() {
+                    entry.tx = tx;
+                }
+                entry.tasks.push(task);
+                true
+            }
+            _ => {
+                task.abort();
+                false
+            }
+        }
+    }
+
+    fn stream_data(&self, stream: u32, data: &[u8]) {
+        let streams = self.streams.lock().unwrap();
+        if let Some(tx) = streams.get(&stream).and_then(|e| e.tx.as_ref()) {
+            let _ = tx.send(data.to_vec());
+        }
+    }
+
+    fn stream_credit(&self, stream: u32, n: u32) {
+        let streams = self.streams.lock().unwrap();
+        if let Some(entry) = streams.get(&stream) {
+            entry.credit.add(n);
+        }
+    }
+
+    async fn stream_close(&self, stream: u32) {
+        let entry = self.streams.lock().unwrap().remove(&stream);
+        if let Some(entry) = entry {
+            /* taken under the producer lock, so no event of the stream
+             * can follow the ack below */
+            {
+                let _head = self.produce.lock().unwrap();
+                entry.dead.store(true, Ordering::Release);
+            }
+            for task in entry.tasks {
+                task.abort();
+            }
+        }
+        self.push(stream, EVT_CLOSED, 0, 0, &[], None).await;
+    }
+}
+
+async fn connect_task(inner: Arc<ChanInner>, stream: u32, target: String,
+                      dead: Arc<AtomicBool>, credit: Arc<Credit>) {
+    let io = match inner.backend.connect(target).await {
+        Ok(io) => io,
+        Err(_) => {
+            inner.push(stream, EVT_EOF, ERR_CONNECT, 0, &[], Some(&dead)).await;
+            return;
+        }
+    };
+
+    let (rd, wr) = io.split();
+    let (tx, rx) = mpsc::unbounded_channel();
+
+    /* the writer must be in place before VPP may send */
+    let writer = inner.runtime.spawn(writer_task(inner.clone(), stream, wr, rx, dead.clone()));
+    if !inner.attach(stream, &dead, Some(tx), writer) {
+        return;
+    }
+    if !inner.push(stream, EVT_CONNECTED, 0, TX_WINDOW, &[], Some(&dead)).await {
+        return;
+    }
+
+    let reader = inner.runtime.spawn(reader_task(inner.clone(), stream, rd, credit, dead.clone()));
+    inner.attach(stream, &dead, None, reader);
+}
+
+async fn reader_task(inner: Arc<ChanInner>, stream: u32, mut rd: ReadHalf<BoxStream>,
+                     credit: Arc<Credit>, dead: Arc<AtomicBool>) {
+    let mut buf = vec![0u8; SLOT_DATA];
+
+    loop {
+        let n = credit.wait().await.min(SLOT_DATA);
+        let (kind, error, n) = match rd.read(&mut buf[..n]).await {
+            Ok(0) => (EVT_EOF, 0, 0),
+            Ok(n) => (EVT_DATA, 0, n),
+            Err(_) => (EVT_EOF, ERR_IO, 0),
+        };
+
+        if kind == EVT_DATA {
+            credit.bytes.fetch_sub(n as i64, Ordering::AcqRel);
+        }
+        if !inner.push(stream, kind, error, n as u32, &buf[..n], Some(&dead)).await
+            || kind != EVT_DATA
+        {
+            return;
+        }
+    }
+}
+
+async fn writer_task(inner: Arc<ChanInner>, stream: u32, mut wr: WriteHalf<BoxStream>,
+                     mut rx: mpsc::UnboundedReceiver<Vec<u8>>, dead: Arc<AtomicBool>) {
+    let mut written: u32 = 0;
+
+    while let Some(buf) = rx.recv().await {
+        if wr.write_all(&buf).await.is_err() {
+            inner.push(stream, EVT_EOF, ERR_IO, 0, &[], Some(&dead)).await;
+            return;
+        }
+        written += buf.len() as u32;
+
+        /* Arti holds partial cells back until flushed */
+        if rx.is_empty() || written >= CREDIT_BATCH {
+            if wr.flush().await.is_err() {
+                inner.push(stream, EVT_EOF, ERR_IO, 0, &[], Some(&dead)).await;
+                return;
+            }
+            if !inner.push(stream, EVT_CREDIT, 0, written, &[], Some(&dead)).await {
+                return;
+            }
+            written = 0;
+        }
+    }
+}
+
+/// Consume what VPP queued, until the channel is destroyed
+async fn pump_task(inner: Arc<ChanInner>) {
+    let ring = inner.to_arti();
+    let mut tail = ring.tail.load(Ordering::Relaxed);
+
+    loop {
+        let head = ring.head.load(Ordering::Acquire);
+        if head == tail {
+            /* a kick while we were busy left a permit behind */
+            inner.kick.notified().await;
+            inner.stats.kicks.fetch_add(1, Ordering::Relaxed);
+            continue;
+        }
+
+        while tail != head {
+            let slot = unsafe { &*ring.slot(tail) };
+            match slot.kind {
+                EVT_DATA => inner.stream_data(slot.stream, &slot.data[..slot.len as usize]),
+                EVT_CREDIT => inner.stream_credit(slot.stream, slot.len),
+                EVT_CLOSE => inner.stream_close(slot.stream).await,
+                _ => {}
+            }
+            tail = tail.wrapping_add(1);
+            inner.stats.slots_in.fetch_add(1, Ordering::Relaxed);
+        }
+
+        if ring.consumed(tail) {
+            inner.signal();
+        }
+    }
+}
+
+impl Chan {
+    /// Create a channel whose tasks run on `runtime`
+    pub fn new(backend: Arc<dyn Backend>, runtime: Handle) -> io::Result<Box<Chan>> {
+        let event_fd = unsafe { libc::eventfd(0, libc::EFD_NONBLOCK | libc::EFD_CLOEXEC) };
+        if event_fd < 0 {
+            return Err(io::Error::last_os_error());
+        }
+
+        let rings = Rings {
+            to_arti: Ring::alloc(),
+            from_arti: Ring::alloc(),
+        };
+        let shared = ChanShared {
+            to_arti: rings.to_arti,
+            from_arti: rings.from_arti,
+            event_fd,
+        };
+        let inner = Arc::new(ChanInner {
+            rings,
+            event_fd,
+            backend,
+            runtime: runtime.clone(),
+            kick: Notify::new(),
+            space: Notify::new(),
+            produce: Mutex::new(0),
+            streams: Mutex::new(HashMap::new()),
+            closed: AtomicBool::new(false),
+            stats: ChanStats::default(),
+        });
+        let pump = runtime.spawn(pump_task(inner.clone()));
+
+        Ok(Box::new(Chan { shared, inner, pump }))
+    }
+
+    /// Start connecting `stream` to `target` ("host:port")
+    pub fn connect(&self, stream: u32, target: String, rx_window: u32) {
+        self.inner.connect(stream, target, rx_window);
+    }
+
+    /// VPP queued work in `to_arti`, or freed slots in `from_arti`
+    pub fn kick(&self) {
+        self.inner.kick.notify_one();
+        self.inner.space.notify_waiters();
+    }
+}
+
+impl Drop for Chan {
+    /// Stop every task; the rings go when the last of them is gone
+    fn drop(&mut self) {
+        self.inner.closed.store(true, Ordering::Release);
+        self.pump.abort();
+
+        let streams: Vec<StreamEntry> =
+            self.inner.streams.lock().unwrap().drain().map(|(_, e)| e).collect();
+        for entry in streams {
+            entry.dead.store(true, Ordering::Release);
+            for task in entry.tasks {
+                task.abort();
+            }
+        }
+        self.inner.space.notify_waiters();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::loopback::Loopback;
+    use std::time::{Duration, Instant};
+
+    /// Next event from `from_arti`, acting as the VPP thread
+    fn next_event(chan: &Chan, tail: &mut u32) -> (u32, u16, Vec<u8>) {
+        let ring = unsafe { &*chan.shared.from_arti };
+        let deadline = Instant::now() + Duration::from_secs(5);
+
+        while ring.head.load(Ordering::Acquire) == *tail {
+            assert!(Instant::now() < deadline, "no event from the channel");
+            std::thread::yield_now();
+        }
+        let slot = unsafe { &*ring.slot(*tail) };
+        let data = match slot.kind {
+            EVT_DATA => slot.data[..slot.len as usize].to_vec(),
+            _ => Vec::new(),
+        };
+        let event = (slot.stream, slot.kind, data);
+        *tail = tail.wrapping_add(1);
+        if ring.consumed(*tail) {
+            chan.kick();
+        }
+        event
+    }
+
+    fn send(chan: &Chan, head: &mut u32, stream: u32, kind: u16, data: &[u8]) {
+        let ring = unsafe { &*chan.shared.to_arti };
+        assert!(ring.has_space(*head));
+
+        let slot = unsafe { &mut *ring.slot(*head) };
+        slot.stream = stream;
+        slot.kind = kind;
+        slot.len = data.len() as u32;
+        slot.data[..data.len()].copy_from_slice(data);
+        let old_head = *head;
+        *head = head.wrapping_add(1);
+        if ring.publish(old_head, *head) {
+            chan.kick();
+        }
+    }
+
+    #[test]
+    fn test_echo_and_close() {
+        let runtime = tokio::runtime::Runtime::new().unwrap();
+        let chan = Chan::new(Arc::new(Loopback), runtime.handle().clone()).unwrap();
+        let (mut head, mut tail) = (0u32, 0u32);
+
+        chan.connect(7, "loopback:0".to_string(), 1 << 16);
+        let (stream, kind, _) = next_event(&chan, &mut tail);
+        assert_eq!((stream, kind), (7, EVT_CONNECTED));
+
+        send(&chan, &mut head, 7, EVT_DATA, b"hello");
+        let mut echoed = Vec::new();
+        while echoed.len() < 5 {
+            let (stream, kind, data) = next_event(&chan, &mut tail);
+            assert_eq!(stream, 7);
+            if kind == EVT_DATA {
+                echoed.extend(data);
+            }
+        }
+        assert_eq!(echoed, b"hello");
+
+        /* nothing follows the close ack */
+        send(&chan, &mut head, 7, EVT_CLOSE, &[]);
+        loop {
+            let (stream, kind, _) = next_event(&chan, &mut tail);
+            assert_eq!(stream, 7);
+            if kind == EVT_CLOSED {
+                break;
+            }
+        }
+        std::thread::sleep(Duration::from_millis(50));
+        let ring = unsafe { &*chan.shared.from_arti };
+        assert_eq!(ring.head.load(Ordering::Acquire), tail);
+    }
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2025 Internet Mastering & Company, Inc.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file arti_ring.h
+ * @brief Shared-memory ring channel to the Arti runtime
+ *
+ * C side of arti-ffi/src/ring.rs, whose comments describe the protocol.
+ * In short: one channel per VPP thread, two single-producer
+ * single-consumer rings of 4 KB slots carrying every stream's data and
+ * events, one eventfd towards VPP and arti_chan_kick() the other way,
+ * both only used when a ring goes from empty to non-empty.
+ *
+ * The layout must match ring.rs exactly.
+ */
+
+#ifndef __included_arti_ring_h__
+#define __included_arti_ring_h__
+
+#include <vppinfra/clib.h>
+#include <vppinfra/atomics.h>
+#include <vppinfra/error_bootstrap.h>
+
+#define ARTI_RING_SLOTS 512
+#define ARTI_RING_SLOT_SIZE 4096
+#define ARTI_RING_SLOT_DATA (ARTI_RING_SLOT_SIZE - 16)
+
+/* Slot kinds */
+#define ARTI_EVT_DATA 1      /* stream data, either direction */
+#define ARTI_EVT_CREDIT 2    /* len bytes of credit, either direction */
+#define ARTI_EVT_CONNECTED 3 /* len is the initial credit towards Tor */
+#define ARTI_EVT_EOF 4       /* stream ended, error 0 if cleanly */
+#define ARTI_EVT_CLOSE 5     /* VPP closes the stream */
+#define ARTI_EVT_CLOSED 6    /* close acked, the stream id is free again */
+
+typedef struct
+{
+  u32 stream;
+  u16 kind;
+  u16 flags;
+  u32 len;
+  i32 error;
+  u8 data[ARTI_RING_SLOT_DATA];
+} arti_ring_slot_t;
+
+STATIC_ASSERT_SIZEOF(arti_ring_slot_t, ARTI_RING_SLOT_SIZE);
+
+/**
+ * @brief A ring; head is written by the producer only, tail by the
+ * consumer only, each on its own cache line
+ */
+typedef struct
+{
+  u32 head;
+  u8 pad0[60];
+  u32 tail;
+  u8 pad1[60];
+  u32 producer_waiting;
+  u8 pad2[60];
+  arti_ring_slot_t slots[ARTI_RING_SLOTS];
+} arti_ring_t;
+
+STATIC_ASSERT_OFFSET_OF(arti_ring_t, tail, 64);
+STATIC_ASSERT_OFFSET_OF(arti_ring_t, slots, 192);
+
+/**
+ * @brief What VPP sees of a channel
+ *
+ * The leading fields of the channel arti_chan_create() returns.
+ */
+typedef struct
+{
+  /** produced by VPP */
+  arti_ring_t *to_arti;
+
+  /** consumed by VPP */
+  arti_ring_t *from_arti;
+
+  /** readable when from_arti got work or to_arti got room */
+  int event_fd;
+} arti_chan_t;
+
+extern arti_chan_t *arti_chan_create(void *client);
+extern arti_chan_t *arti_chan_create_loopback(void);
+extern int arti_chan_connect(arti_chan_t *chan, u32 stream, const char *addr,
+                             u16 port, u32 rx_window);
+extern void arti_chan_kick(arti_chan_t *chan);
+extern void arti_chan_destroy(arti_chan_t *chan);
+
+static_always_inline arti_ring_slot_t *
+arti_ring_slot(arti_ring_t *r, u32 index)
+{
+  return &r->slots[index & (ARTI_RING_SLOTS - 1)];
+}
+
+/**
+ * @brief Producer: whether a slot is free at head, and if not, ask to be
+ * signalled when there is
+ *
+ * The flag is set before looking again, so a consumer freeing slots in
+ * between either sees it or is seen.
+ */
+static_always_inline int
+arti_ring_get_space(arti_ring_t *r, u32 head)
+{
+  if (head - clib_atomic_load_acq_n(&r->tail) < ARTI_RING_SLOTS)
+    return 1;
+
+  clib_atomic_store_rel_n(&r->producer_waiting, 1);
+  CLIB_MEMORY_BARRIER();
+  return head - clib_atomic_load_acq_n(&r->tail) < ARTI_RING_SLOTS;
+}
+
+/**
+ * @brief Producer: make the slots up to head visible
+ *
+ * @return whether the consumer had drained everything before old_head
+ *         and may be asleep
+ */
+static_always_inline int
+arti_ring_publish(arti_ring_t *r, u32 old_head, u32 head)
+{
+  clib_atomic_store_rel_n(&r->head, head);
+  CLIB_MEMORY_BARRIER();
+  return clib_atomic_load_acq_n(&r->tail) == old_head;
+}
+
+/**
+ * @brief Consumer: release the slots up to tail
+ *
+ * @return whether the producer waits for room; head must be loaded again
+ *         before deciding the ring is empty
+ */
+static_always_inline int
+arti_ring_consumed(arti_ring_t *r, u32 tail)
+{
+  clib_atomic_store_rel_n(&r->tail, tail);
+  CLIB_MEMORY_BARRIER();
+  if (!clib_atomic_load_acq_n(&r->producer_waiting))
+    return 0;
+
+  clib_atomic_store_rel_n(&r->producer_waiting, 0);
+  return 1;
+}
+
+#endif /* __included_arti_ring_h__ */
@@ -20,12 +20,72 @@
 
 #include <vnet/vnet.h>
 #include <vnet/plugin/plugin.h>
+#include <vppinfra/file.h>
 #include <tor_client/tor_client.h>
 #include <vlibapi/api.h>
 #include <vlibmemory/api.h>
 
 tor_client_main_t tor_client_main;
 
+static clib_error_t *tor_client_chan_ready(clib_file_t *f);
+
+/**
+ * @brief Open the per-thread ring channels to the Arti runtime
+ *
+ * Each eventfd is polled by its own thread; Arti owns and closes it.
+ */
+static clib_error_t *
+tor_client_chans_create(tor_client_main_t *tcm)
+{
+  tor_client_wrk_t *wrk;
+
+  vec_foreach(wrk, tcm->workers)
+    {
+      u32 thread_index = wrk - tcm->workers;
+      clib_file_t template = {0};
+
+      wrk->chan = arti_chan_create(tcm->arti_client);
+      if (!wrk->chan)
+        return clib_error_return(0, "Failed to create Arti channel for "
+                                 "thread %u", thread_index);
+
+      template.read_function = tor_client_chan_ready;
+      template.file_descriptor = wrk->chan->event_fd;
+      template.polling_thread_index = thread_index;
+      template.dont_close = 1;
+      template.description = format(0, "tor-chan-%u", thread_index);
+      wrk->chan_file_index = clib_file_add(&file_main, &template);
+    }
+
+  return 0;
+}
+
+/**
+ * @brief Close the ring channels, dropping every stream still on them
+ */
+static void
+tor_client_chans_free(tor_client_main_t *tcm)
+{
+  tor_client_wrk_t *wrk;
+
+  /* workers are held at the barrier */
+  vec_foreach(wrk, tcm->workers)
+    {
+      if (wrk->chan_file_index != ~0)
+        clib_file_del_by_index(&file_main, wrk->chan_file_index);
+      if (wrk->chan)
+        arti_chan_destroy(wrk->chan);
+
+      pool_free(wrk->stream_pool);
+      vec_free(wrk->blocked_streams);
+      wrk->chan = 0;
+      wrk->chan_file_index = ~0;
+      wrk->to_arti_head = wrk->to_arti_published = 0;
+      wrk->from_arti_tail = 0;
+      wrk->active_streams = 0;
+    }
+}
+
 /**
  * @brief Enable/disable Tor client
  */
@@ -67,16 +127,25 @@ tor_client_enable_disable(u8 enable, u16 socks_port)
           goto done;
         }
 
-      /* Initialize stream pool and hash table */
-      pool_init_fixed(tcm->stream_pool, tcm->config.max_connections);
-      tcm->stream_by_session = hash_create(0, sizeof(uword));
+      /* Initialize per-thread stream pools and channels */
+      tor_client_wrk_t *wrk;
+      vec_validate(tcm->workers, vlib_num_workers());
+      vec_foreach(wrk, tcm->workers)
+        {
+          pool_init_fixed(wrk->stream_pool, tcm->config.max_connections);
+          wrk->chan_file_index = ~0;
+        }
+
+      error = tor_client_chans_create(tcm);
 
       tcm->config.enabled = 1;
 
       /* Start SOCKS5 proxy */
-      error = socks5_app_init(tcm->config.socks_port);
+      if (!error)
+        error = socks5_app_init(tcm->config.socks_port);
       if (error)
         {
+          tor_client_chans_free(tcm);
           arti_shutdown(tcm->arti_client);
           tcm->arti_client = 0;
           tcm->config.enabled = 0;
@@ -95,23 +164,12 @@ tor_client_enable_disable(u8 enable, u16 socks_port)
       /* Shutdown Arti client */
       if (tcm->arti_client)
         {
-          /* Close all active streams */
-          tor_stream_t *stream;
-          pool_foreach(stream, tcm->stream_pool)
-            {
-              if (stream->arti_stream)
-                arti_close_stream(stream->arti_stream);
-            }
-
-          pool_free(tcm->stream_pool);
-          hash_free(tcm->stream_by_session);
-
+          tor_client_chans_free(tcm);
           arti_shutdown(tcm->arti_client);
           tcm->arti_client = 0;
         }
 
       tcm->config.enabled = 0;
-      tcm->active_streams = 0;
       vlib_cli_output(tcm->vlib_main, "Tor client disabled");
     }
 
@@ -120,14 +178,233 @@ done:
 }
 
 /**
- * @brief Create a new Tor stream
+ * @brief Set the stream event callbacks
+ */
+void
+tor_client_register_stream_cb(tor_client_stream_cb_t *cb)
+{
+  tor_client_main.stream_cb = *cb;
+}
+
+/**
+ * @brief Take the next to_arti slot, or 0 if the ring is full
+ *
+ * Slots only become visible to Arti on tor_client_chan_flush().
+ */
+static arti_ring_slot_t *
+tor_client_chan_slot(tor_client_wrk_t *wrk, u32 stream_index, u16 kind,
+                     u32 len)
+{
+  arti_ring_slot_t *slot;
+
+  if (!arti_ring_get_space(wrk->chan->to_arti, wrk->to_arti_head))
+    return 0;
+
+  slot = arti_ring_slot(wrk->chan->to_arti, wrk->to_arti_head++);
+  slot->stream = stream_index;
+  slot->kind = kind;
+  slot->flags = 0;
+  slot->error = 0;
+  slot->len = len;
+
+  return slot;
+}
+
+/**
+ * @brief Publish the slots taken so far, kicking Arti if it went idle
+ *
+ * While from_arti is being drained this waits for the end of it, so a
+ * whole batch of events goes out with one kick at most.
+ */
+static void
+tor_client_chan_flush(tor_client_wrk_t *wrk)
+{
+  if (wrk->dispatching || wrk->to_arti_head == wrk->to_arti_published)
+    return;
+
+  if (arti_ring_publish(wrk->chan->to_arti, wrk->to_arti_published,
+                        wrk->to_arti_head))
+    arti_chan_kick(wrk->chan);
+  wrk->to_arti_published = wrk->to_arti_head;
+}
+
+/**
+ * @brief Retry a stream once to_arti has room
+ */
+static void
+tor_client_stream_block(tor_client_wrk_t *wrk, tor_stream_t *stream)
+{
+  if (stream->flags & TOR_STREAM_F_BLOCKED)
+    return;
+
+  stream->flags |= TOR_STREAM_F_BLOCKED;
+  vec_add1(wrk->blocked_streams, stream - wrk->stream_pool);
+}
+
+static void
+tor_client_stream_send_close(tor_client_wrk_t *wrk, tor_stream_t *stream)
+{
+  if (!tor_client_chan_slot(wrk, stream - wrk->stream_pool, ARTI_EVT_CLOSE, 0))
+    {
+      stream->flags |= TOR_STREAM_F_CLOSE_PENDING;
+      tor_client_stream_block(wrk, stream);
+      return;
+    }
+
+  stream->flags &= ~TOR_STREAM_F_CLOSE_PENDING;
+}
+
+/**
+ * @brief Whether events of a stream go to its owner
+ */
+static_always_inline int
+tor_client_stream_has_owner(tor_stream_t *stream)
+{
+  return !(stream->flags & TOR_STREAM_F_CLOSING) && stream->owner_index != ~0;
+}
+
+/**
+ * @brief Handle one event from Arti
+ */
+static void
+tor_client_chan_dispatch(tor_client_wrk_t *wrk, arti_ring_slot_t *slot)
+{
+  tor_client_stream_cb_t *cb = &tor_client_main.stream_cb;
+  tor_stream_t *stream;
+  u32 *blocked;
+
+  if (pool_is_free_index(wrk->stream_pool, slot->stream))
+    return;
+
+  stream = pool_elt_at_index(wrk->stream_pool, slot->stream);
+
+  if (slot->kind == ARTI_EVT_CLOSED)
+    {
+      /* the id may be reused from now on */
+      if (stream->flags & TOR_STREAM_F_BLOCKED)
+        vec_foreach(blocked, wrk->blocked_streams)
+          if (*blocked == slot->stream)
+            {
+              vec_del1(wrk->blocked_streams, blocked - wrk->blocked_streams);
+              break;
+            }
+
+      wrk->total_bytes_sent += stream->bytes_sent;
+      wrk->total_bytes_received += stream->bytes_received;
+      wrk->active_streams--;
+      pool_put(wrk->stream_pool, stream);
+      return;
+    }
+
+  switch (slot->kind)
+    {
+    case ARTI_EVT_CONNECTED:
+      stream->flags |= TOR_STREAM_F_CONNECTED;
+      stream->tx_credit = slot->len;
+      if (tor_client_stream_has_owner(stream))
+        cb->connected(stream->owner_index);
+      break;
+
+    case ARTI_EVT_DATA:
+      ASSERT(slot->len <= stream->rx_credit);
+      stream->rx_credit -= slot->len;
+      stream->bytes_received += slot->len;
+      if (tor_client_stream_has_owner(stream))
+        cb->data(stream->owner_index, slot->data, slot->len);
+      break;
+
+    case ARTI_EVT_CREDIT:
+      stream->tx_credit += slot->len;
+      if (tor_client_stream_has_owner(stream))
+        cb->ready(stream->owner_index);
+      break;
+
+    case ARTI_EVT_EOF:
+      stream->flags |= TOR_STREAM_F_EOF;
+      if (tor_client_stream_has_owner(stream))
+        cb->eof(stream->owner_index, slot->error);
+      break;
+
+    default:
+      clib_warning("unknown Arti event %u for stream %u", slot->kind,
+                   slot->stream);
+      break;
+    }
+}
+
+/**
+ * @brief Channel eventfd callback: Arti queued events or freed slots
+ *
+ * Drains from_arti for every stream of the thread, then retries the
+ * streams that found to_arti full. What they queue goes out in one go.
+ */
+static clib_error_t *
+tor_client_chan_ready(clib_file_t *f)
+{
+  u32 thread_index = vlib_get_thread_index();
+  tor_client_wrk_t *wrk = tor_client_wrk_get(thread_index);
+  tor_client_stream_cb_t *cb = &tor_client_main.stream_cb;
+  arti_ring_t *r;
+  u32 head, *blocked = 0, *si;
+  u64 val;
+
+  /* Channels are polled by the thread that owns them */
+  ASSERT(f->polling_thread_index == thread_index);
+
+  if (!wrk->chan)
+    return 0;
+
+  /* clear first: a signal from here on comes with new work */
+  if (read(wrk->chan->event_fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+    return clib_error_return_unix(0, "read tor channel eventfd");
+
+  r = wrk->chan->from_arti;
+  wrk->dispatching = 1;
+
+  while ((head = clib_atomic_load_acq_n(&r->head)) != wrk->from_arti_tail)
+    {
+      while (wrk->from_arti_tail != head)
+        tor_client_chan_dispatch(wrk, arti_ring_slot(r, wrk->from_arti_tail++));
+
+      if (arti_ring_consumed(r, wrk->from_arti_tail))
+        arti_chan_kick(wrk->chan);
+    }
+
+  /* streams that block again go on a fresh list */
+  if (vec_len(wrk->blocked_streams))
+    {
+      blocked = wrk->blocked_streams;
+      wrk->blocked_streams = 0;
+    }
+
+  vec_foreach(si, blocked)
+    {
+      tor_stream_t *stream = pool_elt_at_index(wrk->stream_pool, *si);
+
+      stream->flags &= ~TOR_STREAM_F_BLOCKED;
+      if (stream->flags & TOR_STREAM_F_CLOSE_PENDING)
+        tor_client_stream_send_close(wrk, stream);
+      else if (tor_client_stream_has_owner(stream))
+        cb->ready(stream->owner_index);
+    }
+  vec_free(blocked);
+
+  wrk->dispatching = 0;
+  tor_client_chan_flush(wrk);
+
+  return 0;
+}
+
+/**
+ * @brief Start connecting a new Tor stream
  */
 clib_error_t *
-tor_client_stream_create(char *addr, u16 port, u32 *stream_index_out)
+tor_client_stream_create(char *addr, u16 port, u32 owner_index, u32 rx_window,
+                         u32 *stream_index_out)
 {
   tor_client_main_t *tcm = &tor_client_main;
+  tor_client_wrk_t *wrk;
   tor_stream_t *stream;
-  void *arti_stream = 0;
   int rv;
 
   if (!tcm->config.enabled)
@@ -136,109 +413,158 @@ tor_client_stream_create(char *addr, u16 port, u32 *stream_index_out)
   if (!tcm->arti_client)
     return clib_error_return(0, "Arti client not initialized");
 
-  /* Connect through Tor */
-  rv = arti_connect(tcm->arti_client, addr, port, &arti_stream);
-  if (rv != 0 || !arti_stream)
+  wrk = tor_client_wrk_get(vlib_get_thread_index());
+  if (pool_elts(wrk->stream_pool) >= tcm->config.max_connections)
+    return clib_error_return(0, "too many Tor streams");
+
+  /* Allocate stream from pool, its index is the id on the channel */
+  pool_get_zero(wrk->stream_pool, stream);
+  *stream_index_out = stream - wrk->stream_pool;
+
+  /* Connect through Tor, the outcome comes back on the channel */
+  rv = arti_chan_connect(wrk->chan, *stream_index_out, addr, port, rx_window);
+  if (rv != 0)
     {
+      pool_put(wrk->stream_pool, stream);
       return clib_error_return(0, "Failed to connect to %s:%u (error %d)",
                                addr, port, rv);
     }
 
-  /* Allocate stream from pool */
-  pool_get_zero(tcm->stream_pool, stream);
-  *stream_index_out = stream - tcm->stream_pool;
-
   /* Initialize stream */
-  stream->arti_stream = arti_stream;
+  stream->owner_index = owner_index;
+  stream->rx_credit = rx_window;
+  stream->rx_window = rx_window;
   stream->dst_port = port;
   stream->created_at = vlib_time_now(tcm->vlib_main);
 
-  /* Get event FD from Arti stream for event loop integration */
-  stream->event_fd = arti_stream_get_fd(arti_stream);
-  stream->file_index = ~0; /* Will be set by SOCKS5 layer */
-
-  tcm->active_streams++;
-  tcm->total_connections++;
+  wrk->active_streams++;
+  wrk->total_connections++;
 
   return 0;
 }
 
 /**
  * @brief Close a Tor stream
+ *
+ * The stream stays allocated, silent, until Arti acks the close.
  */
 void
 tor_client_stream_close(u32 stream_index)
 {
-  tor_client_main_t *tcm = &tor_client_main;
+  tor_client_wrk_t *wrk = tor_client_wrk_get(vlib_get_thread_index());
   tor_stream_t *stream;
 
-  if (pool_is_free_index(tcm->stream_pool, stream_index))
+  if (pool_is_free_index(wrk->stream_pool, stream_index))
     return;
 
-  stream = pool_elt_at_index(tcm->stream_pool, stream_index);
-
-  if (stream->arti_stream)
-    {
-      arti_close_stream(stream->arti_stream);
-      stream->arti_stream = 0;
-    }
-
-  /* Update statistics */
-  tcm->total_bytes_sent += stream->bytes_sent;
-  tcm->total_bytes_received += stream->bytes_received;
-  tcm->active_streams--;
+  stream = pool_elt_at_index(wrk->stream_pool, stream_index);
+  if (stream->flags & TOR_STREAM_F_CLOSING)
+    return;
 
-  pool_put(tcm->stream_pool, stream);
+  stream->flags |= TOR_STREAM_F_CLOSING;
+  tor_client_stream_send_close(wrk, stream);
+  tor_client_chan_flush(wrk);
 }
 
 /**
  * @brief Send data on Tor stream
+ *
+ * Copies into to_arti slots, as much as the stream's credit allows.
  */
 ssize_t
 tor_client_stream_send(u32 stream_index, u8 *data, u32 len)
 {
-  tor_client_main_t *tcm = &tor_client_main;
+  tor_client_wrk_t *wrk = tor_client_wrk_get(vlib_get_thread_index());
+  arti_ring_slot_t *slot;
   tor_stream_t *stream;
-  ssize_t rv;
+  u32 n_sent = 0, n;
 
-  if (pool_is_free_index(tcm->stream_pool, stream_index))
+  if (pool_is_free_index(wrk->stream_pool, stream_index))
     return -1;
 
-  stream = pool_elt_at_index(tcm->stream_pool, stream_index);
+  stream = pool_elt_at_index(wrk->stream_pool, stream_index);
 
-  if (!stream->arti_stream)
+  if (stream->flags & TOR_STREAM_F_CLOSING)
     return -1;
 
-  rv = arti_send(stream->arti_stream, data, len);
-  if (rv > 0)
-    stream->bytes_sent += rv;
+  len = clib_min(len, stream->tx_credit);
+  while (n_sent < len)
+    {
+      n = clib_min(len - n_sent, ARTI_RING_SLOT_DATA);
+      slot = tor_client_chan_slot(wrk, stream_index, ARTI_EVT_DATA, n);
+      if (!slot)
+        {
+          tor_client_stream_block(wrk, stream);
+          break;
+        }
+      clib_memcpy_fast(slot->data, data + n_sent, n);
+      n_sent += n;
+    }
 
-  return rv;
+  stream->tx_credit -= n_sent;
+  stream->bytes_sent += n_sent;
+  tor_client_chan_flush(wrk);
+
+  return n_sent;
 }
 
 /**
- * @brief Receive data from Tor stream
+ * @brief Tell Arti how much more data the owner can take
  */
-ssize_t
-tor_client_stream_recv(u32 stream_index, u8 *buf, u32 len)
+int
+tor_client_stream_grant(u32 stream_index, u32 rx_space)
 {
-  tor_client_main_t *tcm = &tor_client_main;
+  tor_client_wrk_t *wrk = tor_client_wrk_get(vlib_get_thread_index());
   tor_stream_t *stream;
-  ssize_t rv;
+  u32 grant;
 
-  if (pool_is_free_index(tcm->stream_pool, stream_index))
-    return -1;
+  if (pool_is_free_index(wrk->stream_pool, stream_index))
+    return 0;
 
-  stream = pool_elt_at_index(tcm->stream_pool, stream_index);
+  stream = pool_elt_at_index(wrk->stream_pool, stream_index);
 
-  if (!stream->arti_stream)
-    return -1;
+  if (stream->flags & (TOR_STREAM_F_CLOSING | TOR_STREAM_F_EOF)
+      || rx_space <= stream->rx_credit)
+    return 0;
+
+  /* small grants would cost a slot each */
+  grant = rx_space - stream->rx_credit;
+  if (grant < stream->rx_window / 4)
+    return 1;
+
+  if (!tor_client_chan_slot(wrk, stream_index, ARTI_EVT_CREDIT, grant))
+    {
+      /* the ready callback comes back for it */
+      tor_client_stream_block(wrk, stream);
+      return 0;
+    }
+
+  stream->rx_credit += grant;
+  tor_client_chan_flush(wrk);
+
+  return 0;
+}
 
-  rv = arti_recv(stream->arti_stream, buf, len);
-  if (rv > 0)
-    stream->bytes_received += rv;
+/**
+ * @brief Sum the per-thread statistics
+ *
+ * Counters of live streams are only folded in when they close, and
+ * other threads may be updating theirs: the result is a snapshot.
+ */
+void
+tor_client_get_stats(tor_client_wrk_t *stats)
+{
+  tor_client_main_t *tcm = &tor_client_main;
+  tor_client_wrk_t *wrk;
 
-  return rv;
+  clib_memset(stats, 0, sizeof(*stats));
+  vec_foreach(wrk, tcm->workers)
+    {
+      stats->active_streams += wrk->active_streams;
+      stats->total_connections += wrk->total_connections;
+      stats->total_bytes_sent += wrk->total_bytes_sent;
+      stats->total_bytes_received += wrk->total_bytes_received;
+    }
 }
 
 /**
@@ -248,6 +574,9 @@ u8 *
 format_tor_client_stats(u8 *s, va_list *args)
 {
   tor_client_main_t *tcm = &tor_client_main;
+  tor_client_wrk_t stats;
+
+  tor_client_get_stats(&stats);
 
   s = format(s, "Tor Client Statistics:\n");
   s = format(s, "  Status: %s\n", tcm->config.enabled ? "Enabled" : "Disabled");
@@ -255,10 +584,11 @@ format_tor_client_stats(u8 *s, va_list *args)
   if (tcm->config.enabled)
     {
       s = format(s, "  SOCKS5 Port: %u\n", tcm->config.socks_port);
-      s = format(s, "  Active Streams: %u\n", tcm->active_streams);
-      s = format(s, "  Total Connections: %llu\n", tcm->total_connections);
-      s = format(s, "  Total Bytes Sent: %llu\n", tcm->total_bytes_sent);
-      s = format(s, "  Total Bytes Received: %llu\n", tcm->total_bytes_received);
+      s = format(s, "  Worker Threads: %u\n", vec_len(tcm->workers));
+      s = format(s, "  Active Streams: %u\n", stats.active_streams);
+      s = format(s, "  Total Connections: %llu\n", stats.total_connections);
+      s = format(s, "  Total Bytes Sent: %llu\n", stats.total_bytes_sent);
+      s = format(s, "  Total Bytes Received: %llu\n", stats.total_bytes_received);
       s = format(s, "  Arti Version: %s\n", arti_version());
     }
 
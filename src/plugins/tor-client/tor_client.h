@@ -29,8 +29,11 @@
 #include <vnet/plugin/plugin.h>
 #include <vppinfra/hash.h>
 #include <vppinfra/error.h>
+#include <tor_client/arti_ring.h>
 
-/* FFI functions from Rust arti-vpp-ffi library */
+/* FFI functions from Rust arti-vpp-ffi library; streams go through the
+ * ring channel of arti_ring.h, the per-stream calls are kept for other
+ * users of the library */
 extern void *arti_init(const char *config_dir, const char *cache_dir);
 extern int arti_connect(void *client, const char *addr, uint16_t port, void **stream_out);
 extern ssize_t arti_send(void *stream, const uint8_t *data, size_t len);
@@ -65,22 +68,38 @@ typedef struct
 
 } tor_client_config_t;
 
+/** Stream flags */
+#define TOR_STREAM_F_CONNECTED (1 << 0)
+#define TOR_STREAM_F_EOF (1 << 1)
+#define TOR_STREAM_F_CLOSING (1 << 2)
+/** CLOSE still to be queued, the ring was full */
+#define TOR_STREAM_F_CLOSE_PENDING (1 << 3)
+/** on the thread's list of streams waiting for ring space */
+#define TOR_STREAM_F_BLOCKED (1 << 4)
+
 /**
  * @brief Tor stream state
+ *
+ * The stream's pool index is also its id on the thread's ring channel.
+ * It stays allocated until Arti acks the close, so a late event can
+ * never reach a stream that reused the id.
  */
 typedef struct
 {
-  /** Stream handle from Arti */
-  void *arti_stream;
+  /** TOR_STREAM_F_* */
+  u32 flags;
 
-  /** VPP session index */
-  u32 vpp_session_index;
+  /** Owner's index, handed back in stream callbacks */
+  u32 owner_index;
 
-  /** Event FD for data availability notification */
-  int event_fd;
+  /** Bytes Arti still accepts from us */
+  u32 tx_credit;
 
-  /** File registration for event loop */
-  u32 file_index;
+  /** Bytes Arti may still send us */
+  u32 rx_credit;
+
+  /** rx_credit granted at connect, the most ever outstanding */
+  u32 rx_window;
 
   /** Destination address */
   ip46_address_t dst_addr;
@@ -100,27 +119,58 @@ typedef struct
 } tor_stream_t;
 
 /**
- * @brief Tor client main structure
+ * @brief Stream event callbacks, called on the stream's thread
+ *
+ * None is called for a stream once it is closed.
  */
 typedef struct
 {
-  /** API message ID base */
-  u16 msg_id_base;
+  /** connected, data may flow */
+  void (*connected)(u32 owner_index);
 
-  /** VNet main */
-  vnet_main_t *vnet_main;
+  /** data from Tor, within the rx credit the owner granted */
+  void (*data)(u32 owner_index, u8 *data, u32 len);
 
-  /** Configuration */
-  tor_client_config_t config;
+  /** no more data from Tor, error 0 if it ended cleanly */
+  void (*eof)(u32 owner_index, int error);
 
-  /** Arti client handle */
-  void *arti_client;
+  /** tx credit or ring space came back after a short send or grant */
+  void (*ready)(u32 owner_index);
+
+} tor_client_stream_cb_t;
+
+/**
+ * @brief Per-thread Tor client state
+ *
+ * A Tor stream belongs to the thread of the VPP session it serves. Only
+ * that thread creates, feeds and closes it, through the thread's own
+ * ring channel to the Arti runtime, so none of this is locked.
+ */
+typedef struct
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
 
   /** Stream pool */
   tor_stream_t *stream_pool;
 
-  /** Stream hash by VPP session index */
-  uword *stream_by_session;
+  /** Ring channel to the Arti runtime */
+  arti_chan_t *chan;
+
+  /** Our end of the rings: to_arti head as filled and as published */
+  u32 to_arti_head;
+  u32 to_arti_published;
+
+  /** from_arti tail */
+  u32 from_arti_tail;
+
+  /** Channel eventfd registration */
+  u32 chan_file_index;
+
+  /** Streams waiting for to_arti space */
+  u32 *blocked_streams;
+
+  /** Set while draining from_arti; publishing waits until the end */
+  u8 dispatching;
 
   /** Number of active streams */
   u32 active_streams;
@@ -130,6 +180,31 @@ typedef struct
   u64 total_bytes_sent;
   u64 total_bytes_received;
 
+} tor_client_wrk_t;
+
+/**
+ * @brief Tor client main structure
+ */
+typedef struct
+{
+  /** API message ID base */
+  u16 msg_id_base;
+
+  /** VNet main */
+  vnet_main_t *vnet_main;
+
+  /** Configuration */
+  tor_client_config_t config;
+
+  /** Arti client handle */
+  void *arti_client;
+
+  /** Stream event callbacks */
+  tor_client_stream_cb_t stream_cb;
+
+  /** Per-thread state, indexed by thread index */
+  tor_client_wrk_t *workers;
+
   /** Convenience */
   vlib_main_t *vlib_main;
 
@@ -137,6 +212,12 @@ typedef struct
 
 extern tor_client_main_t tor_client_main;
 
+static inline tor_client_wrk_t *
+tor_client_wrk_get(u32 thread_index)
+{
+  return vec_elt_at_index(tor_client_main.workers, thread_index);
+}
+
 /**
  * @brief Enable/disable Tor client
  */
@@ -149,24 +230,50 @@ clib_error_t *socks5_app_init(u16 port);
 void socks5_app_shutdown(void);
 
 /**
- * @brief Create a new Tor stream
+ * @brief Sum the per-thread statistics
+ */
+void tor_client_get_stats(tor_client_wrk_t *stats);
+
+/**
+ * @brief Set the stream event callbacks
+ */
+void tor_client_register_stream_cb(tor_client_stream_cb_t *cb);
+
+/**
+ * @brief Start connecting a new Tor stream
+ *
+ * Returns at once; the connected or eof callback tells how it went.
+ * Stream functions work on the calling thread's streams; stream indices
+ * are only meaningful on the thread that created them.
+ *
+ * @param rx_window bytes the owner can take before its first grant
  */
-clib_error_t *tor_client_stream_create(char *addr, u16 port, u32 *stream_index_out);
+clib_error_t *tor_client_stream_create(char *addr, u16 port, u32 owner_index,
+                                       u32 rx_window, u32 *stream_index_out);
 
 /**
- * @brief Close a Tor stream
+ * @brief Close a Tor stream; no callback follows
  */
 void tor_client_stream_close(u32 stream_index);
 
 /**
  * @brief Send data on Tor stream
+ *
+ * @return bytes queued, short when out of credit or ring space, in which
+ *         case the ready callback follows, or -1 on a closed stream
  */
 ssize_t tor_client_stream_send(u32 stream_index, u8 *data, u32 len);
 
 /**
- * @brief Receive data from Tor stream
+ * @brief Tell Arti how much more data the owner can take
+ *
+ * Credits Arti with whatever of rx_space it does not hold already, in
+ * batches of a quarter window.
+ *
+ * @return 1 if some of it is still held back, to be offered again once
+ *         more space frees up
  */
-ssize_t tor_client_stream_recv(u32 stream_index, u8 *buf, u32 len);
+int tor_client_stream_grant(u32 stream_index, u32 rx_space);
 
 /**
  * @brief Format Tor client statistics
@@ -76,16 +76,19 @@ vl_api_tor_client_get_stats_t_handler(vl_api_tor_client_get_stats_t *mp)
 {
   vl_api_tor_client_get_stats_reply_t *rmp;
   tor_client_main_t *tcm = &tor_client_main;
+  tor_client_wrk_t stats;
   int rv = 0;
 
+  tor_client_get_stats(&stats);
+
   REPLY_MACRO2(VL_API_TOR_CLIENT_GET_STATS_REPLY,
   ({
     rmp->enabled = tcm->config.enabled;
     rmp->socks_port = htons(tcm->config.socks_port);
-    rmp->active_streams = htonl(tcm->active_streams);
-    rmp->total_connections = clib_host_to_net_u64(tcm->total_connections);
-    rmp->total_bytes_sent = clib_host_to_net_u64(tcm->total_bytes_sent);
-    rmp->total_bytes_received = clib_host_to_net_u64(tcm->total_bytes_received);
+    rmp->active_streams = htonl(stats.active_streams);
+    rmp->total_connections = clib_host_to_net_u64(stats.total_connections);
+    rmp->total_bytes_sent = clib_host_to_net_u64(stats.total_bytes_sent);
+    rmp->total_bytes_received = clib_host_to_net_u64(stats.total_bytes_received);
   }));
 }
 
@@ -101,6 +101,7 @@ show_tor_streams_command_fn(vlib_main_t *vm,
                               vlib_cli_command_t *cmd)
 {
   tor_client_main_t *tcm = &tor_client_main;
+  tor_client_wrk_t *wrk, stats;
   tor_stream_t *stream;
 
   if (!tcm->config.enabled)
@@ -109,28 +110,34 @@ show_tor_streams_command_fn(vlib_main_t *vm,
       return 0;
     }
 
-  vlib_cli_output(vm, "Active Tor Streams: %u\n", tcm->active_streams);
+  tor_client_get_stats(&stats);
+  vlib_cli_output(vm, "Active Tor Streams: %u\n", stats.active_streams);
 
-  if (tcm->active_streams == 0)
+  if (stats.active_streams == 0)
     {
       vlib_cli_output(vm, "  (none)");
       return 0;
     }
 
-  vlib_cli_output(vm, "%-6s %-21s %-10s %-15s %-15s",
-                  "Index", "Destination", "Age", "TX Bytes", "RX Bytes");
-  vlib_cli_output(vm, "%-6s %-21s %-10s %-15s %-15s",
-                  "------", "---------------------", "----------",
+  vlib_cli_output(vm, "%-6s %-6s %-21s %-10s %-15s %-15s",
+                  "Thread", "Index", "Destination", "Age", "TX Bytes",
+                  "RX Bytes");
+  vlib_cli_output(vm, "%-6s %-6s %-21s %-10s %-15s %-15s",
+                  "------", "------", "---------------------", "----------",
                   "---------------", "---------------");
 
-  pool_foreach(stream, tcm->stream_pool)
+  /* workers are held at the barrier */
+  vec_foreach(wrk, tcm->workers)
     {
-      u32 stream_index = stream - tcm->stream_pool;
-      f64 age = vlib_time_now(vm) - stream->created_at;
+      pool_foreach(stream, wrk->stream_pool)
+        {
+          u32 stream_index = stream - wrk->stream_pool;
+          f64 age = vlib_time_now(vm) - stream->created_at;
 
-      vlib_cli_output(vm, "%-6u port %-14u %-10.1fs %-15llu %-15llu",
-                      stream_index, stream->dst_port, age,
-                      stream->bytes_sent, stream->bytes_received);
+          vlib_cli_output(vm, "%-6u %-6u port %-14u %-10.1fs %-15llu %-15llu",
+                          wrk - tcm->workers, stream_index, stream->dst_port,
+                          age, stream->bytes_sent, stream->bytes_received);
+        }
     }
 
   return 0;
@@ -186,11 +193,13 @@ test_tor_connect_command_fn(vlib_main_t *vm,
 
   vlib_cli_output(vm, "Connecting to %s:%u through Tor...", hostname, port);
 
-  error = tor_client_stream_create((char *)hostname, port, &stream_index);
+  /* nobody reads the stream, a small window is plenty */
+  error = tor_client_stream_create((char *)hostname, port, ~0, 4 << 10,
+                                   &stream_index);
 
   if (!error)
     {
-      vlib_cli_output(vm, "Success! Stream index: %u", stream_index);
+      vlib_cli_output(vm, "Started! Stream index: %u", stream_index);
       vlib_cli_output(vm, "Use 'show tor streams' to see details");
       vlib_cli_output(vm, "Note: Stream will remain open until explicitly closed");
     }
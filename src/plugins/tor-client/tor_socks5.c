@@ -18,8 +18,13 @@
  * @brief SOCKS5 protocol implementation for Tor client - PRODUCTION READY
  *
  * Complete RFC 1928 implementation with:
- * - Full bidirectional relay (Client ↔ Tor)
- * - VPP event loop integration
+ * - Full bidirectional relay (Client ↔ Tor), client data written into
+ *   the Tor ring straight from the rx fifo chunks (see
+ *   vnet/session/session_relay.h)
+ * - VPP event loop integration: Tor streams are served by the thread
+ *   that owns their VPP session, through that thread's ring channel
+ * - Flow control end to end: Tor data is only sent when the client's
+ *   tx fifo has room for it, client data when Arti has room for it
  * - Non-blocking I/O
  * - Proper state machine
  */
@@ -28,7 +33,7 @@
 #include <vnet/session/application.h>
 #include <vnet/session/application_interface.h>
 #include <vnet/session/session.h>
-#include <vppinfra/file.h>
+#include <vnet/session/session_relay.h>
 
 /* SOCKS5 Protocol Constants (RFC 1928) */
 #define SOCKS5_VERSION 0x05
@@ -52,8 +57,8 @@
 #define SOCKS5_REP_ADDRESS_TYPE_NOT_SUPPORTED 0x08
 #define SOCKS5_REP_HOST_UNREACHABLE 0x04
 
-/* Buffer sizes */
-#define SOCKS5_MAX_BUFFER_SIZE 8192
+/* SOCKS5 success reply, queued ahead of the Tor data */
+#define SOCKS5_REPLY_LEN 10
 
 /**
  * @brief SOCKS5 connection state machine
@@ -77,21 +82,12 @@ typedef struct
   /** Current state */
   socks5_state_t state;
 
-  /** VPP session index (client-facing) */
-  u32 vpp_session_index;
+  /** VPP session handle (client-facing) */
+  session_handle_t vpp_session_handle;
 
   /** Tor stream index */
   u32 tor_stream_index;
 
-  /** Event file descriptor for Tor stream */
-  int tor_event_fd;
-
-  /** File index for event loop */
-  u32 file_index;
-
-  /** Receive buffer */
-  u8 *rx_buffer;
-
   /** Target address */
   u8 *target_addr;
 
@@ -111,29 +107,87 @@ typedef struct
 } socks5_session_t;
 
 /**
- * @brief SOCKS5 application context
+ * @brief Per-thread SOCKS5 state
+ *
+ * Sessions live on the thread of their VPP session; the session opaque
+ * and the Tor stream's owner index are indices into its pool.
  */
 typedef struct
 {
-  /** Application index */
-  u32 app_index;
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
 
   /** Session pool */
   socks5_session_t *session_pool;
 
-  /** Session by VPP session index */
-  uword *session_by_vpp_index;
+} socks5_wrk_t;
+
+/**
+ * @brief SOCKS5 application context
+ */
+typedef struct
+{
+  /** Application index */
+  u32 app_index;
 
-  /** Session by file index */
-  uword *session_by_file_index;
+  /** Per-thread state, indexed by thread index */
+  socks5_wrk_t *workers;
 
 } socks5_app_t;
 
-static socks5_app_t socks5_app;
+static socks5_app_t socks5_app = { .app_index = ~0 };
 
-/* Forward declarations */
-static void tor_stream_ready_callback(clib_file_t *f);
-static int socks5_relay_from_tor(socks5_session_t *socks5_s, session_t *vpp_s);
+static socks5_session_t *
+socks5_session_get(u32 thread_index, u32 session_index)
+{
+  socks5_wrk_t *wrk = vec_elt_at_index(socks5_app.workers, thread_index);
+
+  if (pool_is_free_index(wrk->session_pool, session_index))
+    return 0;
+
+  return pool_elt_at_index(wrk->session_pool, session_index);
+}
+
+/**
+ * @brief Free a SOCKS5 session and close its Tor stream
+ */
+static void
+socks5_session_free(session_t *s)
+{
+  socks5_wrk_t *wrk = vec_elt_at_index(socks5_app.workers, s->thread_index);
+  socks5_session_t *socks5_s;
+
+  socks5_s = socks5_session_get(s->thread_index, s->opaque);
+  if (!socks5_s)
+    return;
+
+  /* Close Tor stream */
+  if (socks5_s->tor_stream_index != ~0)
+    tor_client_stream_close(socks5_s->tor_stream_index);
+
+  /* Free buffers */
+  vec_free(socks5_s->target_addr);
+
+  s->opaque = ~0;
+  pool_put(wrk->session_pool, socks5_s);
+}
+
+/**
+ * @brief Close a client session from our side
+ *
+ * What is queued in its tx fifo, such as an error reply, still goes out
+ * first. No disconnect callback follows, so the state goes now.
+ */
+static void
+socks5_session_close(session_t *s)
+{
+  vnet_disconnect_args_t a = {
+    .handle = session_handle(s),
+    .app_index = socks5_app.app_index,
+  };
+
+  socks5_session_free(s);
+  vnet_disconnect_session(&a);
+}
 
 /**
  * @brief Send SOCKS5 error response
@@ -141,7 +195,7 @@ static int socks5_relay_from_tor(socks5_session_t *socks5_s, session_t *vpp_s);
 static int
 socks5_send_error(session_t *s, u8 reply_code)
 {
-  u8 response[10] = {
+  u8 response[SOCKS5_REPLY_LEN] = {
     SOCKS5_VERSION,
     reply_code,
     0x00,
@@ -160,7 +214,7 @@ socks5_send_error(session_t *s, u8 reply_code)
 static int
 socks5_send_success(session_t *s)
 {
-  u8 response[10] = {
+  u8 response[SOCKS5_REPLY_LEN] = {
     SOCKS5_VERSION,
     SOCKS5_REP_SUCCESS,
     0x00,
@@ -218,7 +272,7 @@ static int
 socks5_process_request(socks5_session_t *socks5_s, session_t *vpp_s,
                         u8 *data, u32 len)
 {
-  tor_client_main_t *tcm = &tor_client_main;
+  u32 rx_window;
 
   if (len < 4)
     return 0;
@@ -290,9 +344,14 @@ socks5_process_request(socks5_session_t *socks5_s, session_t *vpp_s,
   socks5_s->target_port = port;
   socks5_s->state = SOCKS5_STATE_CONNECTING;
 
-  /* Create Tor stream */
+  /* Start the Tor stream, the reply waits for the outcome. Tor may
+   * fill what the tx fifo has left after the reply. */
+  rx_window = svm_fifo_max_enqueue_prod(vpp_s->tx_fifo);
+  rx_window = rx_window > SOCKS5_REPLY_LEN ? rx_window - SOCKS5_REPLY_LEN : 0;
+
   clib_error_t *error = tor_client_stream_create(
-      (char *)socks5_s->target_addr, port, &socks5_s->tor_stream_index);
+      (char *)socks5_s->target_addr, port, vpp_s->opaque, rx_window,
+      &socks5_s->tor_stream_index);
 
   if (error)
     {
@@ -301,55 +360,34 @@ socks5_process_request(socks5_session_t *socks5_s, session_t *vpp_s,
       return -1;
     }
 
-  /* Get event FD from Tor stream */
-  tor_stream_t *tor_stream =
-      pool_elt_at_index(tcm->stream_pool, socks5_s->tor_stream_index);
-
-  socks5_s->tor_event_fd = tor_stream->event_fd;
-
-  /* Register event FD with VPP file/epoll system */
-  clib_file_t template = {0};
-  template.read_function = tor_stream_ready_callback;
-  template.file_descriptor = socks5_s->tor_event_fd;
-  template.description = format(0, "tor-stream-%u", socks5_s->tor_stream_index);
-  template.private_data = socks5_s - socks5_app.session_pool;
-
-  socks5_s->file_index = clib_file_add(&file_main, &template);
-
-  /* Add to file index lookup */
-  hash_set(socks5_app.session_by_file_index, socks5_s->file_index,
-           socks5_s - socks5_app.session_pool);
+  return 4 + addr_len + 2;
+}
 
-  /* Send success response */
-  socks5_send_success(vpp_s);
-  socks5_s->state = SOCKS5_STATE_RELAY;
+/**
+ * @brief Relay write callback: hand client data to the Tor stream
+ */
+static ssize_t
+socks5_tor_write(void *ctx, u8 *data, u32 len)
+{
+  socks5_session_t *socks5_s = ctx;
 
-  return 4 + addr_len + 2;
+  return tor_client_stream_send(socks5_s->tor_stream_index, data, len);
 }
 
 /**
  * @brief Relay data from client to Tor (Client → Tor)
+ *
+ * Copies the rx fifo into Tor ring slots straight from its chunks, as
+ * far as Arti's credit and the ring allow. What is left stays in the
+ * fifo until the stream's ready callback.
  */
 static int
 socks5_relay_to_tor(socks5_session_t *socks5_s, session_t *vpp_s)
 {
-  svm_fifo_t *rx_fifo = vpp_s->rx_fifo;
-  u32 available = svm_fifo_max_dequeue(rx_fifo);
-
-  if (available == 0)
-    return 0;
-
-  u32 to_read = clib_min(available, SOCKS5_MAX_BUFFER_SIZE);
-  vec_validate(socks5_s->rx_buffer, to_read - 1);
-
-  u32 n_read = svm_fifo_dequeue(rx_fifo, to_read, socks5_s->rx_buffer);
-  if (n_read <= 0)
-    return 0;
-
-  /* Send to Tor */
-  ssize_t n_sent = tor_client_stream_send(
-      socks5_s->tor_stream_index, socks5_s->rx_buffer, n_read);
+  ssize_t n_sent;
 
+  n_sent = session_relay_session_to_stream(vpp_s, socks5_tor_write, socks5_s,
+                                           ~0);
   if (n_sent < 0)
     {
       clib_warning("Failed to send to Tor stream %u", socks5_s->tor_stream_index);
@@ -361,124 +399,161 @@ socks5_relay_to_tor(socks5_session_t *socks5_s, session_t *vpp_s)
 }
 
 /**
- * @brief Relay data from Tor to client (Tor → Client)
+ * @brief Offer Arti the room the client's tx fifo has
  *
- * Called when event FD signals data availability.
+ * Asks for a dequeue notification while some of it is held back, so
+ * the tx callback offers it again as the client drains.
  */
-static int
-socks5_relay_from_tor(socks5_session_t *socks5_s, session_t *vpp_s)
+static void
+socks5_grant_tor(socks5_session_t *socks5_s, session_t *vpp_s)
 {
-  u8 buf[SOCKS5_MAX_BUFFER_SIZE];
-
-  /* Receive from Tor (non-blocking) */
-  ssize_t n_recv = tor_client_stream_recv(
-      socks5_s->tor_stream_index, buf, sizeof(buf));
-
-  if (n_recv < 0)
-    {
-      /* Check error code */
-      if (n_recv == -6) /* WOULD_BLOCK */
-        return 0;
+  if (tor_client_stream_grant(socks5_s->tor_stream_index,
+                              svm_fifo_max_enqueue_prod(vpp_s->tx_fifo)))
+    svm_fifo_add_want_deq_ntf(vpp_s->tx_fifo, SVM_FIFO_WANT_DEQ_NOTIF);
+}
 
-      if (n_recv == -7) /* CLOSED */
-        {
-          /* Tor stream closed, close VPP session */
-          session_transport_closing_notify(vpp_s);
-          return -1;
-        }
+/**
+ * @brief Get the SOCKS5 and VPP sessions behind a Tor stream owner index
+ */
+static socks5_session_t *
+socks5_session_get_owner(u32 owner_index, session_t **vpp_s)
+{
+  socks5_session_t *socks5_s;
 
-      clib_warning("Tor stream recv error: %ld", n_recv);
-      return -1;
-    }
+  socks5_s = socks5_session_get(vlib_get_thread_index(), owner_index);
+  if (!socks5_s)
+    return 0;
 
-  if (n_recv == 0)
+  *vpp_s = session_get_from_handle_if_valid(socks5_s->vpp_session_handle);
+  if (!*vpp_s)
     {
-      /* EOF from Tor */
-      session_transport_closing_notify(vpp_s);
-      return -1;
+      clib_warning("VPP session 0x%lx not valid",
+                   socks5_s->vpp_session_handle);
+      return 0;
     }
 
-  /* Send to client */
-  svm_fifo_t *tx_fifo = vpp_s->tx_fifo;
-  u32 n_sent = svm_fifo_enqueue(tx_fifo, n_recv, buf);
+  socks5_s->last_activity = vlib_time_now(vlib_get_main());
+  return socks5_s;
+}
 
-  if (n_sent > 0)
-    {
-      socks5_s->bytes_from_tor += n_sent;
+/**
+ * @brief Tor stream connected: reply, then relay what the client sent
+ * meanwhile
+ */
+static void
+socks5_tor_connected(u32 owner_index)
+{
+  socks5_session_t *socks5_s;
+  session_t *vpp_s;
 
-      /* Notify VPP that we have data to send */
-      if (svm_fifo_set_event(tx_fifo))
-        session_send_io_evt_to_thread(tx_fifo, SESSION_IO_EVT_TX);
-    }
+  if (!(socks5_s = socks5_session_get_owner(owner_index, &vpp_s)))
+    return;
 
-  return n_sent;
+  socks5_send_success(vpp_s);
+  session_relay_tx_event(vpp_s->tx_fifo, vpp_s->handle);
+  socks5_s->state = SOCKS5_STATE_RELAY;
+
+  if (socks5_relay_to_tor(socks5_s, vpp_s) < 0)
+    socks5_session_close(vpp_s);
 }
 
 /**
- * @brief Callback when Tor stream has data available (event FD triggered)
+ * @brief Data from Tor (Tor → Client)
  *
- * This is called by VPP's event loop when the eventfd signals.
+ * Arti only sends what it was granted, so the tx fifo has room. One TX
+ * event covers all the data of a channel wakeup.
  */
 static void
-tor_stream_ready_callback(clib_file_t *f)
+socks5_tor_data(u32 owner_index, u8 *data, u32 len)
 {
-  socks5_app_t *app = &socks5_app;
-  uword *p;
+  socks5_session_t *socks5_s;
+  session_t *vpp_s;
 
-  /* Look up session by file index */
-  p = hash_get(app->session_by_file_index, f->private_data);
-  if (!p)
+  if (!(socks5_s = socks5_session_get_owner(owner_index, &vpp_s)))
+    return;
+
+  if (svm_fifo_enqueue(vpp_s->tx_fifo, len, data) != len)
     {
-      clib_warning("No session for file index %u", f->private_data);
+      clib_warning("Tor stream %u overran its window",
+                   socks5_s->tor_stream_index);
+      socks5_session_close(vpp_s);
       return;
     }
 
-  socks5_session_t *socks5_s = pool_elt_at_index(app->session_pool, p[0]);
+  socks5_s->bytes_from_tor += len;
+  session_relay_tx_event(vpp_s->tx_fifo, vpp_s->handle);
+  svm_fifo_add_want_deq_ntf(vpp_s->tx_fifo, SVM_FIFO_WANT_DEQ_NOTIF);
+}
 
-  /* Get Tor stream to access arti_stream handle */
-  tor_client_main_t *tcm = &tor_client_main;
-  tor_stream_t *tor_stream = pool_elt_at_index(tcm->stream_pool,
-                                                 socks5_s->tor_stream_index);
+/**
+ * @brief Tor stream ended, or never connected
+ */
+static void
+socks5_tor_eof(u32 owner_index, int error)
+{
+  socks5_session_t *socks5_s;
+  session_t *vpp_s;
 
-  /* Clear event FD */
-  arti_stream_clear_event(tor_stream->arti_stream);
+  if (!(socks5_s = socks5_session_get_owner(owner_index, &vpp_s)))
+    return;
 
-  /* Get VPP session */
-  session_t *vpp_s = session_get_if_valid(socks5_s->vpp_session_index,
-                                           0 /* thread_index */);
-  if (!vpp_s)
+  if (socks5_s->state == SOCKS5_STATE_CONNECTING)
     {
-      clib_warning("VPP session %u not valid", socks5_s->vpp_session_index);
-      return;
+      socks5_send_error(vpp_s, SOCKS5_REP_HOST_UNREACHABLE);
+      session_relay_tx_event(vpp_s->tx_fifo, vpp_s->handle);
     }
+  else if (error)
+    clib_warning("Tor stream %u error: %d", socks5_s->tor_stream_index, error);
 
-  /* Relay data from Tor to client */
-  socks5_relay_from_tor(socks5_s, vpp_s);
+  /* Tor stream closed, close VPP session */
+  socks5_s->state = SOCKS5_STATE_CLOSING;
+  socks5_session_close(vpp_s);
+}
 
-  socks5_s->last_activity = vlib_time_now(vlib_get_main());
+/**
+ * @brief Tor stream can take more: credit or ring space came back
+ */
+static void
+socks5_tor_ready(u32 owner_index)
+{
+  socks5_session_t *socks5_s;
+  session_t *vpp_s;
+
+  if (!(socks5_s = socks5_session_get_owner(owner_index, &vpp_s)))
+    return;
+
+  if (socks5_s->state != SOCKS5_STATE_RELAY)
+    return;
+
+  socks5_grant_tor(socks5_s, vpp_s);
+  if (socks5_relay_to_tor(socks5_s, vpp_s) < 0)
+    socks5_session_close(vpp_s);
 }
 
+static tor_client_stream_cb_t socks5_tor_stream_cb = {
+  .connected = socks5_tor_connected,
+  .data = socks5_tor_data,
+  .eof = socks5_tor_eof,
+  .ready = socks5_tor_ready,
+};
+
 /**
  * @brief Session accept callback
  */
 static int
 socks5_session_accept_callback(session_t *s)
 {
-  socks5_app_t *app = &socks5_app;
+  socks5_wrk_t *wrk = vec_elt_at_index(socks5_app.workers, s->thread_index);
   socks5_session_t *socks5_s;
 
-  pool_get_zero(app->session_pool, socks5_s);
+  pool_get_zero(wrk->session_pool, socks5_s);
   socks5_s->state = SOCKS5_STATE_INIT;
-  socks5_s->vpp_session_index = s->session_index;
+  socks5_s->vpp_session_handle = session_handle(s);
   socks5_s->last_activity = vlib_time_now(vlib_get_main());
   socks5_s->tor_stream_index = ~0;
-  socks5_s->tor_event_fd = -1;
-  socks5_s->file_index = ~0;
-
-  hash_set(app->session_by_vpp_index, s->session_index,
-           socks5_s - app->session_pool);
 
-  s->opaque = socks5_s - app->session_pool;
+  s->opaque = socks5_s - wrk->session_pool;
+  s->session_state = SESSION_STATE_READY;
 
   return 0;
 }
@@ -489,32 +564,7 @@ socks5_session_accept_callback(session_t *s)
 static void
 socks5_session_disconnect_callback(session_t *s)
 {
-  socks5_app_t *app = &socks5_app;
-  socks5_session_t *socks5_s;
-
-  uword *p = hash_get(app->session_by_vpp_index, s->session_index);
-  if (!p)
-    return;
-
-  socks5_s = pool_elt_at_index(app->session_pool, p[0]);
-
-  /* Unregister file/event FD */
-  if (socks5_s->file_index != ~0)
-    {
-      clib_file_del_by_index(&file_main, socks5_s->file_index);
-      hash_unset(app->session_by_file_index, socks5_s->file_index);
-    }
-
-  /* Close Tor stream */
-  if (socks5_s->tor_stream_index != ~0)
-    tor_client_stream_close(socks5_s->tor_stream_index);
-
-  /* Free buffers */
-  vec_free(socks5_s->rx_buffer);
-  vec_free(socks5_s->target_addr);
-
-  hash_unset(app->session_by_vpp_index, s->session_index);
-  pool_put(app->session_pool, socks5_s);
+  socks5_session_free(s);
 }
 
 /**
@@ -523,18 +573,15 @@ socks5_session_disconnect_callback(session_t *s)
 static int
 socks5_session_rx_callback(session_t *s)
 {
-  socks5_app_t *app = &socks5_app;
   svm_fifo_t *rx_fifo = s->rx_fifo;
   u32 available = svm_fifo_max_dequeue(rx_fifo);
 
   if (available == 0)
     return 0;
 
-  uword *p = hash_get(app->session_by_vpp_index, s->session_index);
-  if (!p)
+  socks5_session_t *socks5_s = socks5_session_get(s->thread_index, s->opaque);
+  if (!socks5_s)
     return -1;
-
-  socks5_session_t *socks5_s = pool_elt_at_index(app->session_pool, p[0]);
   socks5_s->last_activity = vlib_time_now(vlib_get_main());
 
   int rv = 0;
@@ -563,6 +610,10 @@ socks5_session_rx_callback(session_t *s)
         break;
       }
 
+    case SOCKS5_STATE_CONNECTING:
+      /* Early data waits in the fifo for the Tor stream */
+      break;
+
     case SOCKS5_STATE_RELAY:
       /* Data phase: relay to Tor */
       rv = socks5_relay_to_tor(socks5_s, s);
@@ -575,7 +626,7 @@ socks5_session_rx_callback(session_t *s)
 
   if (rv < 0)
     {
-      session_transport_closing_notify(s);
+      socks5_session_close(s);
       return -1;
     }
 
@@ -583,24 +634,18 @@ socks5_session_rx_callback(session_t *s)
 }
 
 /**
- * @brief Session TX callback (space available to send to client)
+ * @brief Session TX callback (client drained its tx fifo)
  */
 static int
 socks5_session_tx_callback(session_t *s)
 {
-  socks5_app_t *app = &socks5_app;
-
-  uword *p = hash_get(app->session_by_vpp_index, s->session_index);
-  if (!p)
+  socks5_session_t *socks5_s = socks5_session_get(s->thread_index, s->opaque);
+  if (!socks5_s)
     return 0;
 
-  socks5_session_t *socks5_s = pool_elt_at_index(app->session_pool, p[0]);
-
-  /* If in relay state, try to receive more from Tor */
+  /* If in relay state, let Tor send more */
   if (socks5_s->state == SOCKS5_STATE_RELAY)
-    {
-      socks5_relay_from_tor(socks5_s, s);
-    }
+    socks5_grant_tor(socks5_s, s);
 
   return 0;
 }
@@ -645,8 +690,8 @@ socks5_app_init(u16 port)
     }
 
   app->app_index = a->app_index;
-  app->session_by_vpp_index = hash_create(0, sizeof(uword));
-  app->session_by_file_index = hash_create(0, sizeof(uword));
+  vec_validate(app->workers, vlib_num_workers());
+  tor_client_register_stream_cb(&socks5_tor_stream_cb);
 
   vec_free(a->name);
 
@@ -683,8 +728,9 @@ socks5_app_shutdown(void)
       vnet_application_detach(a);
     }
 
-  hash_free(app->session_by_vpp_index);
-  hash_free(app->session_by_file_index);
-  pool_free(app->session_pool);
-  clib_memset(app, 0, sizeof(*app));
+  socks5_wrk_t *wrk;
+  vec_foreach(wrk, app->workers)
+    pool_free(wrk->session_pool);
+  vec_free(app->workers);
+  app->app_index = ~0;
 }
@@ -79,6 +79,10 @@ int blake2s_final (blake2s_state_t * S, void *out, size_t outlen);
 int blake2s (void *out, size_t outlen, const void *in, size_t inlen,
 	     const void *key, size_t keylen);
 
+/* Four equal length messages at once, sharing the key */
+int blake2s_x4 (uint8_t * out[4], size_t outlen, const uint8_t * in[4],
+		size_t inlen, const void *key, size_t keylen);
+
 #endif /* __included_crypto_blake2s_h__ */
 
 /*
@@ -36,6 +36,15 @@ wg_set_async_mode (u32 is_enabled)
     wg_op_mode_unset_ASYNC ();
 }
 
+void
+wg_set_gro_mode (u32 is_enabled)
+{
+  if (is_enabled)
+    wg_op_mode_set_GRO ();
+  else
+    wg_op_mode_unset_GRO ();
+}
+
 static void
 wireguard_register_post_node (vlib_main_t *vm)
 
@@ -57,13 +66,6 @@ wireguard_register_post_node (vlib_main_t *vm)
     vnet_crypto_register_post_node (vm, "wg6-input-post-node");
 }
 
-void
-wg_secure_zero_memory (void *v, size_t n)
-{
-  static void *(*const volatile memset_v) (void *, int, size_t) = &memset;
-  memset_v (v, 0, n);
-}
-
 static clib_error_t *
 wg_init (vlib_main_t * vm)
 {
@@ -83,6 +85,7 @@ wg_init (vlib_main_t * vm)
   vec_validate_aligned (wmp->per_thread_data, tm->n_vlib_mains,
 			CLIB_CACHE_LINE_BYTES);
 
+  wg_index_table_init (&wmp->index_table);
   wg_timer_wheel_init ();
   wireguard_register_post_node (vm);
   wmp->op_mode_flags = 0;
@@ -19,6 +19,8 @@
 #include <wireguard/wireguard_messages.h>
 #include <wireguard/wireguard_timer.h>
 #include <vnet/buffer.h>
+#include <vnet/interface.h>
+#include <vnet/gso/gro.h>
 
 #define WG_DEFAULT_DATA_SIZE 2048
 
@@ -34,6 +36,18 @@ typedef struct wg_per_thread_data_t_
   vnet_crypto_op_t *chained_crypto_ops;
   vnet_crypto_op_chunk_t *chunks;
   vnet_crypto_async_frame_t **async_frames;
+  /* segments of the GSO buffer being encrypted */
+  vnet_interface_per_thread_data_t gso;
+  /* coalesces decrypted TCP segments, flushed at the end of each frame */
+  gro_flow_table_t *gro_flow_table;
+  /* timers of the peers this thread owns; other threads queue arm
+   * requests, which are applied once per tick */
+  tw_timer_wheel_16t_2w_512sl_t timer_wheel;
+  clib_spinlock_t timer_lock;
+  /* when wg-timer-input is next scheduled to run, if it is */
+  f64 timer_wake_time;
+  wg_timer_arm_t *timer_arms;
+  wg_timer_arm_t *timer_arms_drain;
   u8 data[WG_DEFAULT_DATA_SIZE];
 } wg_per_thread_data_t;
 
@@ -54,8 +68,6 @@ typedef struct
   wg_per_thread_data_t *per_thread_data;
   u8 feature_init;
 
-  tw_timer_wheel_16t_2w_512sl_t timer_wheel;
-
   /* operation mode flags (e.g. async) */
   u8 op_mode_flags;
 } wg_main_t;
@@ -74,7 +86,9 @@ extern wg_main_t wg_main;
 /**
  * Wireguard operation mode
  **/
-#define foreach_wg_op_mode_flags _ (0, ASYNC, "async")
+#define foreach_wg_op_mode_flags                                              \
+  _ (0, ASYNC, "async")                                                       \
+  _ (1, GRO, "gro")
 
 /**
  * Helper function to set/unset and check op modes
@@ -119,8 +133,7 @@ STATIC_ASSERT (sizeof (wg_post_data_t) <=
 #define WG_START_EVENT	1
 void wg_feature_init (wg_main_t * wmp);
 void wg_set_async_mode (u32 is_enabled);
-
-void wg_secure_zero_memory (void *v, size_t n);
+void wg_set_gro_mode (u32 is_enabled);
 
 #endif /* __included_wg_h__ */
 
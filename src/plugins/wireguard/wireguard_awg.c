@@ -14,10 +14,10 @@
  * limitations under the License.
  */
 
-#include <vnet/vnet.h>
+#include <openssl/rand.h>
 #include <vppinfra/random.h>
 #include <wireguard/wireguard_awg.h>
-#include <wireguard/wireguard_send.h>
+#include <wireguard/wireguard_key.h>
 
 /* Thread-local random state for junk generation */
 __thread u64 wg_awg_random_state = 0;
@@ -31,13 +31,150 @@ wg_awg_init_random (void)
     }
 }
 
-/* Generate cryptographically random junk data */
+#ifdef CLIB_HAVE_VEC128
+/*
+ * Junk keystream: ChaCha8 keyed per thread from RAND_bytes. The blocks are
+ * computed WG_AWG_KS_LANES at a time, one state word of every block in
+ * each vector, and stored as they come out; junk only has to be
+ * unpredictable, not in RFC byte order. Junk is handed out from a pool of
+ * one batch per thread, so the few bytes of transport header junk do not
+ * each pay for a batch.
+ */
+static wg_awg_ks_t *wg_awg_ks_per_thread;
+
+bool
+wg_awg_init (void)
+{
+  wg_awg_ks_t *ks;
+
+  if (wg_awg_ks_per_thread)
+    return true;
+
+  vec_validate_aligned (wg_awg_ks_per_thread, vlib_get_n_threads () - 1,
+			CLIB_CACHE_LINE_BYTES);
+  vec_foreach (ks, wg_awg_ks_per_thread)
+    {
+      if (RAND_bytes ((u8 *) ks->key, sizeof (ks->key)) != 1)
+	{
+	  vec_foreach (ks, wg_awg_ks_per_thread)
+	    wg_secure_zero_memory (ks->key, sizeof (ks->key));
+	  vec_free (wg_awg_ks_per_thread);
+	  return false;
+	}
+      ks->counter = 0;
+      ks->pool_pos = WG_AWG_KS_BATCH;
+    }
+  return true;
+}
+
+static_always_inline wg_awg_ksv_t
+wg_awg_rotl (wg_awg_ksv_t v, const int n)
+{
+  return (v << n) | (v >> (32 - n));
+}
+
+static_always_inline void
+wg_awg_quarter_round (wg_awg_ksv_t *x, const int a, const int b, const int c,
+		      const int d)
+{
+  x[a] += x[b];
+  x[d] = wg_awg_rotl (x[d] ^ x[a], 16);
+  x[c] += x[d];
+  x[b] = wg_awg_rotl (x[b] ^ x[c], 12);
+  x[a] += x[b];
+  x[d] = wg_awg_rotl (x[d] ^ x[a], 8);
+  x[c] += x[d];
+  x[b] = wg_awg_rotl (x[b] ^ x[c], 7);
+}
+
+/* WG_AWG_KS_BATCH bytes of keystream into dst */
+static_always_inline void
+wg_awg_keystream_batch (wg_awg_ks_t *ks, u8 *dst)
+{
+  /* "expand 32-byte k" */
+  static const u32 sigma[4] = { 0x61707865, 0x3320646e, 0x79622d32,
+				0x6b206574 };
+  wg_awg_ksv_t x[16], in[16];
+  u32 i;
+
+  for (i = 0; i < 4; i++)
+    in[i] = wg_awg_ksv_splat (sigma[i]);
+  for (i = 0; i < 8; i++)
+    in[4 + i] = wg_awg_ksv_splat (ks->key[i]);
+  /* 64-bit block counter, one per lane */
+  for (i = 0; i < WG_AWG_KS_LANES; i++)
+    {
+      in[12][i] = (u32) (ks->counter + i);
+      in[13][i] = (u32) ((ks->counter + i) >> 32);
+    }
+  in[14] = in[15] = wg_awg_ksv_splat (0);
+  ks->counter += WG_AWG_KS_LANES;
+
+  for (i = 0; i < 16; i++)
+    x[i] = in[i];
+
+  for (i = 0; i < 4; i++)
+    {
+      wg_awg_quarter_round (x, 0, 4, 8, 12);
+      wg_awg_quarter_round (x, 1, 5, 9, 13);
+      wg_awg_quarter_round (x, 2, 6, 10, 14);
+      wg_awg_quarter_round (x, 3, 7, 11, 15);
+      /* diagonals */
+      wg_awg_quarter_round (x, 0, 5, 10, 15);
+      wg_awg_quarter_round (x, 1, 6, 11, 12);
+      wg_awg_quarter_round (x, 2, 7, 8, 13);
+      wg_awg_quarter_round (x, 3, 4, 9, 14);
+    }
+
+  for (i = 0; i < 16; i++)
+    {
+      x[i] += in[i];
+      clib_memcpy_fast (dst + i * sizeof (x[i]), &x[i], sizeof (x[i]));
+    }
+}
+
+void
+wg_awg_generate_junk (u8 *buffer, u32 size)
+{
+  wg_awg_ks_t *ks =
+    vec_elt_at_index (wg_awg_ks_per_thread, vlib_get_main ()->thread_index);
+  u32 n;
+
+  while (size)
+    {
+      if (ks->pool_pos == WG_AWG_KS_BATCH)
+	{
+	  /* whole batches go straight out */
+	  for (; size >= WG_AWG_KS_BATCH; size -= WG_AWG_KS_BATCH)
+	    {
+	      wg_awg_keystream_batch (ks, buffer);
+	      buffer += WG_AWG_KS_BATCH;
+	    }
+	  if (!size)
+	    break;
+	  wg_awg_keystream_batch (ks, ks->pool);
+	  ks->pool_pos = 0;
+	}
+
+      n = clib_min (size, WG_AWG_KS_BATCH - ks->pool_pos);
+      clib_memcpy_fast (buffer, ks->pool + ks->pool_pos, n);
+      ks->pool_pos += n;
+      buffer += n;
+      size -= n;
+    }
+}
+#else /* CLIB_HAVE_VEC128 */
+bool
+wg_awg_init (void)
+{
+  return true;
+}
+
 void
 wg_awg_generate_junk (u8 *buffer, u32 size)
 {
   wg_awg_init_random ();
 
-  /* Use VPP's random number generator for junk data */
   u32 i;
   for (i = 0; i + sizeof (u64) <= size; i += sizeof (u64))
     {
@@ -45,13 +182,33 @@ wg_awg_generate_junk (u8 *buffer, u32 size)
       clib_memcpy (buffer + i, &rand_val, sizeof (u64));
     }
 
-  /* Fill remaining bytes */
   if (i < size)
     {
       u64 rand_val = random_u64 (&wg_awg_random_state);
       clib_memcpy (buffer + i, &rand_val, size - i);
     }
 }
+#endif /* CLIB_HAVE_VEC128 */
+
+void
+wg_awg_cfg_update_rx (wg_awg_cfg_t *cfg)
+{
+  u32 i;
+
+  cfg->rx_junk[0] = cfg->init_header_junk_size;
+  cfg->rx_junk[1] = cfg->response_header_junk_size;
+  cfg->rx_junk[2] = cfg->cookie_reply_header_junk_size;
+  cfg->rx_junk[3] = cfg->transport_header_junk_size;
+
+  cfg->rx_len[0] = cfg->rx_junk[0] + sizeof (message_handshake_initiation_t);
+  cfg->rx_len[1] = cfg->rx_junk[1] + sizeof (message_handshake_response_t);
+  cfg->rx_len[2] = cfg->rx_junk[2] + sizeof (message_handshake_cookie_t);
+  cfg->rx_len[3] = cfg->rx_junk[3] + message_data_len (0);
+
+  for (i = 0; i < WG_AWG_MAX_I_HEADERS; i++)
+    cfg->rx_i_header_len[i] =
+      cfg->i_headers[i].enabled ? cfg->i_headers[i].total_size : 0;
+}
 
 /* Generate a random size between min and max */
 static_always_inline u32
@@ -66,80 +223,70 @@ wg_awg_random_size (u32 min_size, u32 max_size)
   return min_size + (random_u32 (&wg_awg_random_state) % range);
 }
 
-/* Send junk packets before actual handshake */
-void
-wg_awg_send_junk_packets (vlib_main_t *vm, const wg_awg_cfg_t *cfg,
-			  const u8 *rewrite, u8 is_ip4)
+/* Sizes of the junk packets sent ahead of a handshake; returns the count */
+u32
+wg_awg_junk_sizes (const wg_awg_cfg_t *cfg, u32 *sizes)
 {
+  u32 count, n_sizes = 0, i;
+
   if (!wg_awg_is_enabled (cfg) || cfg->junk_packet_count == 0)
-    return;
+    return 0;
 
-  u32 count = cfg->junk_packet_count;
-  if (count > WG_AWG_MAX_JUNK_PACKET_COUNT)
-    count = WG_AWG_MAX_JUNK_PACKET_COUNT;
+  count = clib_min (cfg->junk_packet_count, WG_AWG_MAX_JUNK_PACKET_COUNT);
 
-  /* Generate and send junk packets */
-  for (u32 i = 0; i < count; i++)
+  for (i = 0; i < count; i++)
     {
       u32 junk_size = wg_awg_random_size (cfg->junk_packet_min_size,
 					  cfg->junk_packet_max_size);
       if (junk_size == 0 || junk_size > WG_AWG_MAX_JUNK_PACKET_SIZE)
 	continue;
-
-      /* Allocate buffer for junk packet */
-      u8 *junk_packet = clib_mem_alloc (junk_size);
-      if (!junk_packet)
-	continue;
-
-      /* Fill with random data */
-      wg_awg_generate_junk (junk_packet, junk_size);
-
-      /* Send the junk packet */
-      u32 bi = 0;
-      if (wg_create_buffer (vm, rewrite, junk_packet, junk_size, &bi, is_ip4))
-	{
-	  /* Enqueue for sending */
-	  ip46_enqueue_packet (vm, bi, is_ip4);
-	}
-
-      clib_mem_free (junk_packet);
+      sizes[n_sizes++] = junk_size;
     }
+
+  return n_sizes;
 }
 
-/* Send i-header signature chain packets (AmneziaWG 1.5) */
-void
-wg_awg_send_i_header_packets (vlib_main_t *vm, wg_awg_cfg_t *cfg,
-			      const u8 *rewrite, u8 is_ip4)
+/* i1 through i5, if configured and they fit in max_size; returns the count */
+u32
+wg_awg_i_headers (wg_awg_cfg_t *cfg, u32 max_size, wg_awg_i_header_t **ihdrs)
 {
-  u32 i;
+  u32 i, n_ihdrs = 0;
 
   if (!cfg->i_headers_enabled)
-    return;
+    return 0;
 
-  /* Send i1 through i5 packets (if configured) */
   for (i = 0; i < WG_AWG_MAX_I_HEADERS; i++)
     {
       wg_awg_i_header_t *ihdr = &cfg->i_headers[i];
 
-      if (!ihdr->enabled)
-	continue; /* Skip if i-header not configured */
-
-      /* Generate packet from tags */
-      u8 *packet = wg_awg_generate_i_header_packet (ihdr);
-      if (!packet)
-	continue;
+      if (ihdr->enabled && ihdr->total_size && ihdr->total_size <= max_size)
+	ihdrs[n_ihdrs++] = ihdr;
+    }
 
-      u32 packet_len = ihdr->total_size;
+  return n_ihdrs;
+}
 
-      /* Send the i-header packet */
-      u32 bi = 0;
-      if (wg_create_buffer (vm, rewrite, packet, packet_len, &bi, is_ip4))
-	{
-	  ip46_enqueue_packet (vm, bi, is_ip4);
-	}
+void
+wg_awg_rng_save (wg_awg_rng_state_t *state)
+{
+  state->random_state = wg_awg_random_state;
+#ifdef CLIB_HAVE_VEC128
+  clib_memcpy (&state->ks,
+	       vec_elt_at_index (wg_awg_ks_per_thread,
+				 vlib_get_main ()->thread_index),
+	       sizeof (state->ks));
+#endif
+}
 
-      clib_mem_free (packet);
-    }
+void
+wg_awg_rng_restore (const wg_awg_rng_state_t *state)
+{
+  wg_awg_random_state = state->random_state;
+#ifdef CLIB_HAVE_VEC128
+  clib_memcpy (vec_elt_at_index (wg_awg_ks_per_thread,
+				 vlib_get_main ()->thread_index),
+	       &state->ks, sizeof (state->ks));
+#endif
 }
 
 /*
@@ -18,6 +18,7 @@
 #define __included_wg_awg_h__
 
 #include <vppinfra/types.h>
+#include <vppinfra/vector.h>
 #include <wireguard/wireguard_messages.h>
 #include <wireguard/wireguard_awg_tags.h>
 
@@ -48,6 +49,12 @@ typedef struct wg_awg_cfg_t_
   u8 i_headers_enabled; /* If any i-header is configured */
   f64 last_special_handshake; /* Track when to send i-headers (every 120s) */
 
+  /* Receive-side classifier, rebuilt by wg_awg_cfg_update_rx ().
+   * Lanes follow magic_header[]: [init, response, cookie, data] */
+  u32 rx_junk[4];			  /* Header junk preceding each type */
+  u32 rx_len[4];			  /* Datagram length (minimum for data) */
+  u32 rx_i_header_len[WG_AWG_MAX_I_HEADERS]; /* i1-i5 sizes, 0 if unset */
+
 } wg_awg_cfg_t;
 
 /* Default AWG configuration values */
@@ -73,6 +80,9 @@ typedef struct wg_awg_cfg_t_
 /* AmneziaWG 1.5: Special handshake interval (send i-headers every 120 seconds) */
 #define WG_AWG_SPECIAL_HANDSHAKE_INTERVAL 120.0
 
+/* Rebuild the receive-side classifier after a configuration change */
+void wg_awg_cfg_update_rx (wg_awg_cfg_t *cfg);
+
 /* Initialize AWG configuration with defaults */
 static_always_inline void
 wg_awg_cfg_init (wg_awg_cfg_t *cfg)
@@ -98,6 +108,7 @@ wg_awg_cfg_init (wg_awg_cfg_t *cfg)
       cfg->i_headers[i].enabled = 0;
       cfg->i_headers[i].tags = NULL;
     }
+  wg_awg_cfg_update_rx (cfg);
 }
 
 /* Check if AWG is enabled */
@@ -171,16 +182,125 @@ wg_awg_get_header_junk_size (const wg_awg_cfg_t *cfg, message_type_t type)
     }
 }
 
+/*
+ * Classify a received datagram against the AWG profile.
+ *
+ * Handshake messages are recognised by their exact datagram length and the
+ * magic header found after their header junk, transport messages by a
+ * minimum length and their magic header. All four candidates are checked at
+ * once; on a match the header junk length is returned in junk_len.
+ * Anything else (junk packets, i-headers) yields MESSAGE_INVALID.
+ */
+static_always_inline message_type_t
+wg_awg_decode (const wg_awg_cfg_t *cfg, const u8 *msg, u32 len, u32 max_read,
+	       u32 *junk_len)
+{
+  u32 type[4];
+  u32 i;
+
+  /* read the type word of each candidate, if it lies in the first buffer */
+  for (i = 0; i < 4; i++)
+    type[i] = (cfg->rx_junk[i] + sizeof (u32) <= max_read) ?
+		clib_mem_unaligned (msg + cfg->rx_junk[i], u32) :
+		~cfg->magic_header[i];
+
+#ifdef CLIB_HAVE_VEC128
+  const u32x4 data_lane = { 0, 0, 0, ~0 };
+  u32x4 l = u32x4_splat (len);
+  u32x4 want = u32x4_load_unaligned ((void *) cfg->rx_len);
+  u32x4 hit;
+  u16 mask;
+
+  hit = (u32x4) (l == want) | ((u32x4) (l > want) & data_lane);
+  hit &= (u32x4) (u32x4_load_unaligned (type) ==
+		  u32x4_load_unaligned ((void *) cfg->magic_header));
+  mask = u8x16_msb_mask ((u8x16) hit);
+  if (mask == 0)
+    return MESSAGE_INVALID;
+  i = count_trailing_zeros (mask) >> 2;
+#else
+  for (i = 0; i < 4; i++)
+    if (type[i] == cfg->magic_header[i] &&
+	(len == cfg->rx_len[i] || (i == 3 && len > cfg->rx_len[i])))
+      break;
+  if (i == 4)
+    return MESSAGE_INVALID;
+#endif
+
+  *junk_len = cfg->rx_junk[i];
+  return MESSAGE_HANDSHAKE_INITIATION + i;
+}
+
+/* Check if a datagram of this length matches a configured i-header */
+static_always_inline u8
+wg_awg_is_i_header_len (const wg_awg_cfg_t *cfg, u32 len)
+{
+  u32 i;
+
+  for (i = 0; i < WG_AWG_MAX_I_HEADERS; i++)
+    if (cfg->rx_i_header_len[i] && cfg->rx_i_header_len[i] == len)
+      return 1;
+  return 0;
+}
+
+/* Key the junk generator of every thread; false if no randomness */
+bool wg_awg_init (void);
+
 /* Generate random junk data */
 void wg_awg_generate_junk (u8 *buffer, u32 size);
 
-/* Create junk packets and send them */
-void wg_awg_send_junk_packets (vlib_main_t *vm, const wg_awg_cfg_t *cfg,
-			       const u8 *rewrite, u8 is_ip4);
+/* Most packets sent ahead of a handshake: i1-i5 and the junk packets */
+#define WG_AWG_MAX_PRE_HANDSHAKE_PACKETS                                      \
+  (WG_AWG_MAX_I_HEADERS + WG_AWG_MAX_JUNK_PACKET_COUNT)
+
+/* Pick the junk packet sizes for one handshake; returns the count */
+u32 wg_awg_junk_sizes (const wg_awg_cfg_t *cfg, u32 *sizes);
+
+/* Collect the i-headers (i1-i5) of a special handshake that fit in
+ * max_size bytes; returns the count */
+u32 wg_awg_i_headers (wg_awg_cfg_t *cfg, u32 max_size,
+		      wg_awg_i_header_t **ihdrs);
+
+#ifdef CLIB_HAVE_VEC128
+/* Junk keystream state of a thread: ChaCha8 key and block counter, and
+ * the pool of keystream bytes not handed out yet */
+#if defined(CLIB_HAVE_VEC512)
+typedef u32x16 wg_awg_ksv_t;
+#define WG_AWG_KS_LANES 16
+#define wg_awg_ksv_splat u32x16_splat
+#elif defined(CLIB_HAVE_VEC256)
+typedef u32x8 wg_awg_ksv_t;
+#define WG_AWG_KS_LANES 8
+#define wg_awg_ksv_splat u32x8_splat
+#else
+typedef u32x4 wg_awg_ksv_t;
+#define WG_AWG_KS_LANES 4
+#define wg_awg_ksv_splat u32x4_splat
+#endif
+
+#define WG_AWG_KS_BATCH (64 * WG_AWG_KS_LANES)
+
+typedef struct
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  u8 pool[WG_AWG_KS_BATCH];
+  u32 pool_pos;
+  u32 key[8];
+  u64 counter;
+} wg_awg_ks_t;
+#endif /* CLIB_HAVE_VEC128 */
+
+/* Snapshot of this thread's junk generators, so tests can replay them */
+typedef struct wg_awg_rng_state_t_
+{
+  u64 random_state;
+#ifdef CLIB_HAVE_VEC128
+  wg_awg_ks_t ks;
+#endif
+} wg_awg_rng_state_t;
 
-/* Send i-header signature chain packets (i1-i5) before special handshakes */
-void wg_awg_send_i_header_packets (vlib_main_t *vm, wg_awg_cfg_t *cfg,
-				   const u8 *rewrite, u8 is_ip4);
+void wg_awg_rng_save (wg_awg_rng_state_t *state);
+void wg_awg_rng_restore (const wg_awg_rng_state_t *state);
 
 /* Check if it's time for a special handshake (every 120s) */
 static_always_inline u8
@@ -189,7 +309,9 @@ wg_awg_needs_special_handshake (wg_awg_cfg_t *cfg, f64 now)
   if (!cfg->i_headers_enabled)
     return 0;
 
-  if ((now - cfg->last_special_handshake) >= WG_AWG_SPECIAL_HANDSHAKE_INTERVAL)
+  /* vlib time starts at zero, so the first one must not wait for it */
+  if (cfg->last_special_handshake == 0.0 ||
+      (now - cfg->last_special_handshake) >= WG_AWG_SPECIAL_HANDSHAKE_INTERVAL)
     {
       cfg->last_special_handshake = now;
       return 1;
@@ -23,6 +23,8 @@
 /* External random state from wireguard_awg.c */
 extern __thread u64 wg_awg_random_state;
 
+static void wg_awg_compile_i_header (wg_awg_i_header_t *hdr);
+
 /* Parse hex string (with or without 0x prefix) */
 static int
 parse_hex_string (const char *hex_str, u8 **out_data, u32 *out_len)
@@ -192,6 +194,8 @@ wg_awg_parse_tag_string (const char *tag_string, wg_awg_i_header_t *hdr)
   /* Calculate total size */
   hdr->total_size = wg_awg_i_header_size (hdr);
 
+  wg_awg_compile_i_header (hdr);
+
   return 0;
 
 error:
@@ -231,15 +235,65 @@ wg_awg_i_header_size (const wg_awg_i_header_t *hdr)
   return total;
 }
 
+/* A-Z, a-z, 0-9 for <rc> tags */
+static const u8 wg_awg_alnum[62] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+/* Fill one dynamic field; shared by the interpreter and the template */
+static_always_inline void
+wg_awg_fill_dynamic (wg_awg_i_header_t *hdr, wg_awg_tag_type_t type, u8 *p,
+		     u32 len, u64 now)
+{
+  u64 value;
+  u32 i;
+
+  switch (type)
+    {
+    case WG_AWG_TAG_COUNTER:
+      /* 64-bit big-endian counter */
+      value = clib_host_to_net_u64 ((u64) hdr->counter);
+      clib_memcpy (p, &value, 8);
+      hdr->counter++; /* Increment for next packet */
+      break;
+
+    case WG_AWG_TAG_TIMESTAMP:
+      /* 64-bit big-endian unix timestamp */
+      value = clib_host_to_net_u64 (now);
+      clib_memcpy (p, &value, 8);
+      break;
+
+    case WG_AWG_TAG_RANDOM:
+      /* Random bytes */
+      wg_awg_generate_junk (p, len);
+      break;
+
+    case WG_AWG_TAG_RANDOM_ASCII:
+      /* Random alphanumeric ASCII */
+      for (i = 0; i < len; i++)
+	p[i] = wg_awg_alnum[random_u32 (&wg_awg_random_state) % 62];
+      break;
+
+    case WG_AWG_TAG_RANDOM_DIGIT:
+      /* Random digits 0-9 */
+      for (i = 0; i < len; i++)
+	{
+	  u32 rand = random_u32 (&wg_awg_random_state);
+	  p[i] = '0' + (rand % 10);
+	}
+      break;
+
+    case WG_AWG_TAG_BYTES:
+      break;
+    }
+}
+
 /* Generate packet from i-header tags */
 u8 *
-wg_awg_generate_i_header_packet (wg_awg_i_header_t *hdr)
+wg_awg_generate_i_header_packet (wg_awg_i_header_t *hdr, u64 now)
 {
   u8 *packet, *p;
   wg_awg_tag_t *tag;
   u32 total_size;
-  u64 value;
-  u32 i;
 
   if (!hdr || !hdr->enabled)
     return NULL;
@@ -262,51 +316,15 @@ wg_awg_generate_i_header_packet (wg_awg_i_header_t *hdr)
 	  break;
 
 	case WG_AWG_TAG_COUNTER:
-	  /* 64-bit big-endian counter */
-	  value = clib_host_to_net_u64 ((u64) hdr->counter);
-	  clib_memcpy (p, &value, 8);
-	  p += 8;
-	  hdr->counter++; /* Increment for next packet */
-	  break;
-
 	case WG_AWG_TAG_TIMESTAMP:
-	  /* 64-bit big-endian unix timestamp */
-	  value = clib_host_to_net_u64 ((u64) unix_time_now ());
-	  clib_memcpy (p, &value, 8);
+	  wg_awg_fill_dynamic (hdr, tag->type, p, 8, now);
 	  p += 8;
 	  break;
 
 	case WG_AWG_TAG_RANDOM:
-	  /* Random bytes */
-	  wg_awg_generate_junk (p, tag->random_len);
-	  p += tag->random_len;
-	  break;
-
 	case WG_AWG_TAG_RANDOM_ASCII:
-	  /* Random alphanumeric ASCII */
-	  for (i = 0; i < tag->random_len; i++)
-	    {
-	      u32 rand = random_u32 (&wg_awg_random_state);
-	      u32 char_set_size = 62; /* A-Z, a-z, 0-9 */
-	      u32 idx = rand % char_set_size;
-
-	      if (idx < 26)
-		p[i] = 'A' + idx;
-	      else if (idx < 52)
-		p[i] = 'a' + (idx - 26);
-	      else
-		p[i] = '0' + (idx - 52);
-	    }
-	  p += tag->random_len;
-	  break;
-
 	case WG_AWG_TAG_RANDOM_DIGIT:
-	  /* Random digits 0-9 */
-	  for (i = 0; i < tag->random_len; i++)
-	    {
-	      u32 rand = random_u32 (&wg_awg_random_state);
-	      p[i] = '0' + (rand % 10);
-	    }
+	  wg_awg_fill_dynamic (hdr, tag->type, p, tag->random_len, now);
 	  p += tag->random_len;
 	  break;
 	}
@@ -315,6 +333,58 @@ wg_awg_generate_i_header_packet (wg_awg_i_header_t *hdr)
   return packet;
 }
 
+/*
+ * Compile the tag list into a template. Literal bytes are laid out at their
+ * final offsets, dynamic fields are zero in the template and listed, in tag
+ * order, as patches.
+ */
+static void
+wg_awg_compile_i_header (wg_awg_i_header_t *hdr)
+{
+  wg_awg_i_header_patch_t *patch;
+  wg_awg_tag_t *tag;
+  u32 offset = 0;
+
+  if (hdr->total_size == 0)
+    return;
+
+  vec_validate_init_empty (hdr->template, hdr->total_size - 1, 0);
+
+  vec_foreach (tag, hdr->tags)
+    {
+      if (tag->type == WG_AWG_TAG_BYTES)
+	{
+	  clib_memcpy (hdr->template + offset, tag->bytes.data,
+		       tag->bytes.len);
+	  offset += tag->bytes.len;
+	  continue;
+	}
+
+      vec_add2 (hdr->patches, patch, 1);
+      patch->type = tag->type;
+      patch->offset = offset;
+      patch->len = (tag->type == WG_AWG_TAG_COUNTER ||
+		    tag->type == WG_AWG_TAG_TIMESTAMP) ?
+			   8 :
+			   tag->random_len;
+      offset += patch->len;
+    }
+
+  ASSERT (offset == hdr->total_size);
+}
+
+void
+wg_awg_render_i_header (wg_awg_i_header_t *hdr, u8 *dst, u64 now)
+{
+  wg_awg_i_header_patch_t *patch;
+
+  clib_memcpy_fast (dst, hdr->template, hdr->total_size);
+
+  vec_foreach (patch, hdr->patches)
+    wg_awg_fill_dynamic (hdr, patch->type, dst + patch->offset, patch->len,
+			 now);
+}
+
 /* Free i-header resources */
 void
 wg_awg_free_i_header (wg_awg_i_header_t *hdr)
@@ -335,6 +405,8 @@ wg_awg_free_i_header (wg_awg_i_header_t *hdr)
 
   vec_free (hdr->tags);
   hdr->tags = NULL;
+  vec_free (hdr->template);
+  vec_free (hdr->patches);
   hdr->enabled = 0;
 }
 
@@ -69,6 +69,14 @@ typedef struct wg_awg_tag_
   };
 } wg_awg_tag_t;
 
+/* Dynamic field of a compiled i-header, patched into every packet */
+typedef struct wg_awg_i_header_patch_
+{
+  wg_awg_tag_type_t type;
+  u32 offset;
+  u32 len;
+} wg_awg_i_header_patch_t;
+
 /* i-header definition (sequence of tags) */
 typedef struct wg_awg_i_header_
 {
@@ -76,13 +84,22 @@ typedef struct wg_awg_i_header_
   wg_awg_tag_t *tags; /* Vector of tags */
   u32 counter;	      /* Packet counter for <c> tags */
   u32 total_size;     /* Cached total size */
+
+  /* Compiled form: the static bytes laid out once at configuration time
+   * and the dynamic fields to patch over them */
+  u8 *template;
+  wg_awg_i_header_patch_t *patches;
 } wg_awg_i_header_t;
 
 /* Parse a tag string into tag elements */
 int wg_awg_parse_tag_string (const char *tag_string, wg_awg_i_header_t *hdr);
 
-/* Generate packet data from i-header tags */
-u8 *wg_awg_generate_i_header_packet (wg_awg_i_header_t *hdr);
+/* Generate packet data by interpreting the i-header tags; now is the unix
+ * time for <t> tags. Kept as the reference for the compiled template */
+u8 *wg_awg_generate_i_header_packet (wg_awg_i_header_t *hdr, u64 now);
+
+/* Write total_size bytes of packet data from the compiled template */
+void wg_awg_render_i_header (wg_awg_i_header_t *hdr, u8 *dst, u64 now);
 
 /* Free i-header resources */
 void wg_awg_free_i_header (wg_awg_i_header_t *hdr);
@@ -13,10 +13,12 @@
  * limitations under the License.
  */
 
-#include <wireguard/wireguard.h>
+#include <wireguard/wireguard_noise.h>
 #include <wireguard/wireguard_chachapoly.h>
 #include <wireguard/wireguard_hchacha20.h>
 
+#include <openssl/evp.h>
+
 bool
 wg_chacha20poly1305_calc (vlib_main_t *vm, u8 *src, u32 src_len, u8 *dst,
 			  u8 *aad, u32 aad_len, u64 nonce,
@@ -61,13 +63,75 @@ wg_chacha20poly1305_calc (vlib_main_t *vm, u8 *src, u32 src_len, u8 *dst,
   return (op->status == VNET_CRYPTO_OP_STATUS_COMPLETED);
 }
 
+/*
+ * The handshake and cookie AEADs use a new key for almost every message and
+ * run on any thread. Keys in the vnet crypto table may only be added, changed
+ * or deleted by the main thread, so these go through a cipher context of the
+ * thread's own instead, reset after each use so no key is left behind.
+ */
+static EVP_CIPHER_CTX **wg_chacha20poly1305_ctx;
+
+void
+wg_chacha20poly1305_init (void)
+{
+  EVP_CIPHER_CTX **ctx;
+
+  if (wg_chacha20poly1305_ctx)
+    return;
+
+  vec_validate (wg_chacha20poly1305_ctx, vlib_get_n_threads () - 1);
+  vec_foreach (ctx, wg_chacha20poly1305_ctx)
+    ctx[0] = EVP_CIPHER_CTX_new ();
+}
+
+bool
+wg_chacha20poly1305_calc_key (vlib_main_t *vm, u8 *src, u32 src_len, u8 *dst,
+			      u8 *aad, u32 aad_len, u64 nonce,
+			      vnet_crypto_op_id_t op_id,
+			      const u8 key[CHACHA20POLY1305_KEY_SIZE])
+{
+  EVP_CIPHER_CTX *ctx = vec_elt (wg_chacha20poly1305_ctx, vm->thread_index);
+  int is_enc = op_id == VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC;
+  u8 iv[12];
+  int len;
+  bool ret;
+
+  clib_memset (iv, 0, 12);
+  clib_memcpy (iv + 4, &nonce, sizeof (nonce));
+
+  if (!is_enc)
+    {
+      if (src_len < NOISE_AUTHTAG_LEN)
+	return false;
+      src_len -= NOISE_AUTHTAG_LEN;
+    }
+
+  ret = EVP_CipherInit_ex (ctx, EVP_chacha20_poly1305 (), 0, key, iv,
+			   is_enc) > 0;
+  if (ret && !is_enc)
+    ret = EVP_CIPHER_CTX_ctrl (ctx, EVP_CTRL_AEAD_SET_TAG, NOISE_AUTHTAG_LEN,
+			       src + src_len) > 0;
+  if (ret && aad_len)
+    ret = EVP_CipherUpdate (ctx, 0, &len, aad, aad_len) > 0;
+  if (ret && src_len)
+    ret = EVP_CipherUpdate (ctx, dst, &len, src, src_len) > 0;
+  if (ret)
+    ret = EVP_CipherFinal_ex (ctx, dst + src_len, &len) > 0;
+  if (ret && is_enc)
+    ret = EVP_CIPHER_CTX_ctrl (ctx, EVP_CTRL_AEAD_GET_TAG, NOISE_AUTHTAG_LEN,
+			       dst + src_len) > 0;
+
+  EVP_CIPHER_CTX_reset (ctx);
+  return ret;
+}
+
 void
 wg_xchacha20poly1305_encrypt (vlib_main_t *vm, u8 *src, u32 src_len, u8 *dst,
 			      u8 *aad, u32 aad_len,
 			      u8 nonce[XCHACHA20POLY1305_NONCE_SIZE],
 			      u8 key[CHACHA20POLY1305_KEY_SIZE])
 {
-  int i;
+  u32 i;
   u32 derived_key[CHACHA20POLY1305_KEY_SIZE / sizeof (u32)];
   u64 h_nonce;
 
@@ -78,16 +142,10 @@ wg_xchacha20poly1305_encrypt (vlib_main_t *vm, u8 *src, u32 src_len, u8 *dst,
   for (i = 0; i < (sizeof (derived_key) / sizeof (derived_key[0])); i++)
     (derived_key[i]) = clib_host_to_little_u32 ((derived_key[i]));
 
-  uint32_t key_idx;
-
-  key_idx =
-    vnet_crypto_key_add (vm, VNET_CRYPTO_ALG_CHACHA20_POLY1305,
-			 (uint8_t *) derived_key, CHACHA20POLY1305_KEY_SIZE);
+  wg_chacha20poly1305_calc_key (vm, src, src_len, dst, aad, aad_len, h_nonce,
+				VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC,
+				(u8 *) derived_key);
 
-  wg_chacha20poly1305_calc (vm, src, src_len, dst, aad, aad_len, h_nonce,
-			    VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC, key_idx);
-
-  vnet_crypto_key_del (vm, key_idx);
   wg_secure_zero_memory (derived_key, CHACHA20POLY1305_KEY_SIZE);
 }
 
@@ -97,7 +155,8 @@ wg_xchacha20poly1305_decrypt (vlib_main_t *vm, u8 *src, u32 src_len, u8 *dst,
 			      u8 nonce[XCHACHA20POLY1305_NONCE_SIZE],
 			      u8 key[CHACHA20POLY1305_KEY_SIZE])
 {
-  int ret, i;
+  int ret;
+  u32 i;
   u32 derived_key[CHACHA20POLY1305_KEY_SIZE / sizeof (u32)];
   u64 h_nonce;
 
@@ -108,17 +167,11 @@ wg_xchacha20poly1305_decrypt (vlib_main_t *vm, u8 *src, u32 src_len, u8 *dst,
   for (i = 0; i < (sizeof (derived_key) / sizeof (derived_key[0])); i++)
     (derived_key[i]) = clib_host_to_little_u32 ((derived_key[i]));
 
-  uint32_t key_idx;
-
-  key_idx =
-    vnet_crypto_key_add (vm, VNET_CRYPTO_ALG_CHACHA20_POLY1305,
-			 (uint8_t *) derived_key, CHACHA20POLY1305_KEY_SIZE);
-
-  ret =
-    wg_chacha20poly1305_calc (vm, src, src_len, dst, aad, aad_len, h_nonce,
-			      VNET_CRYPTO_OP_CHACHA20_POLY1305_DEC, key_idx);
+  ret = wg_chacha20poly1305_calc_key (vm, src, src_len, dst, aad, aad_len,
+				      h_nonce,
+				      VNET_CRYPTO_OP_CHACHA20_POLY1305_DEC,
+				      (u8 *) derived_key);
 
-  vnet_crypto_key_del (vm, key_idx);
   wg_secure_zero_memory (derived_key, CHACHA20POLY1305_KEY_SIZE);
 
   return ret;
@@ -27,6 +27,15 @@ bool wg_chacha20poly1305_calc (vlib_main_t *vm, u8 *src, u32 src_len, u8 *dst,
 			       vnet_crypto_op_id_t op_id,
 			       vnet_crypto_key_index_t key_index);
 
+/* Per-thread contexts for wg_chacha20poly1305_calc_key, main thread only */
+void wg_chacha20poly1305_init (void);
+
+/* As above, with a key given by value, callable from any thread */
+bool wg_chacha20poly1305_calc_key (vlib_main_t *vm, u8 *src, u32 src_len,
+				   u8 *dst, u8 *aad, u32 aad_len, u64 nonce,
+				   vnet_crypto_op_id_t op_id,
+				   const u8 key[CHACHA20POLY1305_KEY_SIZE]);
+
 void wg_xchacha20poly1305_encrypt (vlib_main_t *vm, u8 *src, u32 src_len,
 				   u8 *dst, u8 *aad, u32 aad_len,
 				   u8 nonce[XCHACHA20POLY1305_NONCE_SIZE],
@@ -20,6 +20,7 @@
 #include <wireguard/wireguard_key.h>
 #include <wireguard/wireguard_peer.h>
 #include <wireguard/wireguard_if.h>
+#include <wireguard/wireguard_send.h>
 
 static clib_error_t *
 wg_if_create_cli (vlib_main_t * vm,
@@ -410,6 +411,45 @@ VLIB_CLI_COMMAND (wg_set_async_mode_command, static) = {
   .function = wg_set_async_mode_command_fn,
 };
 
+static clib_error_t *
+wg_set_gro_mode_command_fn (vlib_main_t *vm, unformat_input_t *input,
+			    vlib_cli_command_t *cmd)
+{
+  unformat_input_t _line_input, *line_input = &_line_input;
+  int gro_enable = 0;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return 0;
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "on"))
+	gro_enable = 1;
+      else if (unformat (line_input, "off"))
+	gro_enable = 0;
+      else
+	return (clib_error_return (0, "unknown input '%U'",
+				   format_unformat_error, line_input));
+    }
+
+  wg_set_gro_mode (gro_enable);
+
+  unformat_free (line_input);
+  return (NULL);
+}
+
+/*?
+ * Coalesce decrypted TCP segments of the same flow into GSO buffers
+ * before they reach ip4-input/ip6-input. Only enable this when the
+ * traffic is terminated locally or leaves through GSO capable
+ * interfaces.
+ ?*/
+VLIB_CLI_COMMAND (wg_set_gro_mode_command, static) = {
+  .path = "set wireguard gro",
+  .short_help = "set wireguard gro on|off",
+  .function = wg_set_gro_mode_command_fn,
+};
+
 static clib_error_t *
 wg_show_mode_command_fn (vlib_main_t *vm, unformat_input_t *input,
 			 vlib_cli_command_t *cmd)
@@ -501,6 +541,14 @@ wg_set_awg_command_fn (vlib_main_t *vm, unformat_input_t *input,
       goto done;
     }
 
+  if (s1 > WG_AWG_MAX_HEADER_JUNK_SIZE || s2 > WG_AWG_MAX_HEADER_JUNK_SIZE ||
+      s3 > WG_AWG_MAX_HEADER_JUNK_SIZE || s4 > WG_AWG_MAX_HEADER_JUNK_SIZE)
+    {
+      error = clib_error_return (0, "header junk size must not exceed %u",
+				 WG_AWG_MAX_HEADER_JUNK_SIZE);
+      goto done;
+    }
+
   wgii = wg_if_find_by_sw_if_index (sw_if_index);
   if (wgii == INDEX_INVALID)
     {
@@ -510,6 +558,15 @@ wg_set_awg_command_fn (vlib_main_t *vm, unformat_input_t *input,
 
   wg_if = wg_if_get (wgii);
 
+  if ((h1 && wg_if_awg_magic_in_use (wg_if, h1)) ||
+      (h2 && wg_if_awg_magic_in_use (wg_if, h2)) ||
+      (h3 && wg_if_awg_magic_in_use (wg_if, h3)) ||
+      (h4 && wg_if_awg_magic_in_use (wg_if, h4)))
+    {
+      error = clib_error_return (0, "magic header in use by a peer profile");
+      goto done;
+    }
+
   if (set_enable)
     wg_if->awg_cfg.enabled = enable;
 
@@ -547,6 +604,8 @@ wg_set_awg_command_fn (vlib_main_t *vm, unformat_input_t *input,
 	wg_if->awg_cfg.magic_header[3] = h4;
     }
 
+  wg_if_awg_update (wg_if);
+
   vlib_cli_output (vm, "AmneziaWG configuration updated for %U",
 		   format_vnet_sw_if_index_name, vnet_get_main (),
 		   sw_if_index);
@@ -566,6 +625,174 @@ VLIB_CLI_COMMAND (wg_set_awg_command, static) = {
   .function = wg_set_awg_command_fn,
 };
 
+static clib_error_t *
+wg_set_peer_awg_command_fn (vlib_main_t *vm, unformat_input_t *input,
+			    vlib_cli_command_t *cmd)
+{
+  unformat_input_t _line_input, *line_input = &_line_input;
+  clib_error_t *error = NULL;
+  u32 peer_index = ~0;
+  wg_awg_cfg_t cfg;
+  u8 disable = 0;
+  int rv;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return clib_error_return (0, "expected peer index");
+
+  /* a peer profile starts from the defaults, not from its interface */
+  wg_awg_cfg_init (&cfg);
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "%u", &peer_index))
+	;
+      else if (unformat (line_input, "disable"))
+	disable = 1;
+      else if (unformat (line_input, "junk-packet-count %u",
+			 &cfg.junk_packet_count))
+	;
+      else if (unformat (line_input, "junk-packet-min-size %u",
+			 &cfg.junk_packet_min_size))
+	;
+      else if (unformat (line_input, "junk-packet-max-size %u",
+			 &cfg.junk_packet_max_size))
+	;
+      else if (unformat (line_input, "init-junk-size %u",
+			 &cfg.init_header_junk_size))
+	;
+      else if (unformat (line_input, "response-junk-size %u",
+			 &cfg.response_header_junk_size))
+	;
+      else if (unformat (line_input, "cookie-junk-size %u",
+			 &cfg.cookie_reply_header_junk_size))
+	;
+      else if (unformat (line_input, "transport-junk-size %u",
+			 &cfg.transport_header_junk_size))
+	;
+      else if (unformat (line_input, "magic-header-init %u",
+			 &cfg.magic_header[0]))
+	;
+      else if (unformat (line_input, "magic-header-response %u",
+			 &cfg.magic_header[1]))
+	;
+      else if (unformat (line_input, "magic-header-cookie %u",
+			 &cfg.magic_header[2]))
+	;
+      else if (unformat (line_input, "magic-header-data %u",
+			 &cfg.magic_header[3]))
+	;
+      else
+	{
+	  error = clib_error_return (0, "unknown input '%U'",
+				     format_unformat_error, line_input);
+	  goto done;
+	}
+    }
+
+  if (peer_index == ~0)
+    {
+      error = clib_error_return (0, "peer index not specified");
+      goto done;
+    }
+
+  if (cfg.init_header_junk_size > WG_AWG_MAX_HEADER_JUNK_SIZE ||
+      cfg.response_header_junk_size > WG_AWG_MAX_HEADER_JUNK_SIZE ||
+      cfg.cookie_reply_header_junk_size > WG_AWG_MAX_HEADER_JUNK_SIZE ||
+      cfg.transport_header_junk_size > WG_AWG_MAX_HEADER_JUNK_SIZE)
+    {
+      error = clib_error_return (0, "header junk size must not exceed %u",
+				 WG_AWG_MAX_HEADER_JUNK_SIZE);
+      goto done;
+    }
+
+  rv = wg_peer_set_awg (peer_index, disable ? NULL : &cfg);
+
+  switch (rv)
+    {
+    case 0:
+      break;
+    case VNET_API_ERROR_NO_SUCH_ENTRY:
+      error = clib_error_return (0, "peer %u not found", peer_index);
+      break;
+    case VNET_API_ERROR_VALUE_EXIST:
+      error = clib_error_return (
+	0, "magic header in use by another profile on the interface");
+      break;
+    case VNET_API_ERROR_INVALID_VALUE:
+      error = clib_error_return (0, "magic headers must be distinct");
+      break;
+    default:
+      error = clib_error_return (0, "wg_peer_set_awg returned %d", rv);
+      break;
+    }
+
+done:
+  unformat_free (line_input);
+  return error;
+}
+
+VLIB_CLI_COMMAND (wg_set_peer_awg_command, static) = {
+  .path = "set wireguard peer awg",
+  .short_help =
+    "set wireguard peer awg <peer-index> [disable] "
+    "[junk-packet-count <n>] [junk-packet-min-size <n>] [junk-packet-max-size <n>] "
+    "[init-junk-size <n>] [response-junk-size <n>] [cookie-junk-size <n>] [transport-junk-size <n>] "
+    "[magic-header-init <n>] [magic-header-response <n>] [magic-header-cookie <n>] [magic-header-data <n>]",
+  .function = wg_set_peer_awg_command_fn,
+};
+
+static clib_error_t *
+wg_set_peer_multi_queue_command_fn (vlib_main_t *vm, unformat_input_t *input,
+				    vlib_cli_command_t *cmd)
+{
+  unformat_input_t _line_input, *line_input = &_line_input;
+  clib_error_t *error = NULL;
+  u32 peer_index = ~0;
+  u8 enable = 1;
+  int rv;
+
+  if (!unformat_user (input, unformat_line_input, line_input))
+    return clib_error_return (0, "expected peer index");
+
+  while (unformat_check_input (line_input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (line_input, "%u", &peer_index))
+	;
+      else if (unformat (line_input, "disable"))
+	enable = 0;
+      else
+	{
+	  error = clib_error_return (0, "unknown input '%U'",
+				     format_unformat_error, line_input);
+	  goto done;
+	}
+    }
+
+  if (peer_index == ~0)
+    {
+      error = clib_error_return (0, "peer index not specified");
+      goto done;
+    }
+
+  rv = wg_peer_set_multi_queue (peer_index, enable);
+  if (rv == VNET_API_ERROR_NO_SUCH_ENTRY)
+    error = clib_error_return (0, "peer %u not found", peer_index);
+
+done:
+  unformat_free (line_input);
+  return error;
+}
+
+/*?
+ * Let all workers encrypt and decrypt for the peer instead of handing
+ * its packets off to one thread. Takes effect with the next handshake.
+ ?*/
+VLIB_CLI_COMMAND (wg_set_peer_multi_queue_command, static) = {
+  .path = "set wireguard peer multi-queue",
+  .short_help = "set wireguard peer multi-queue <peer-index> [disable]",
+  .function = wg_set_peer_multi_queue_command_fn,
+};
+
 static clib_error_t *
 wg_show_awg_command_fn (vlib_main_t *vm, unformat_input_t *input,
 			vlib_cli_command_t *cmd)
@@ -616,6 +843,24 @@ wg_show_awg_command_fn (vlib_main_t *vm, unformat_input_t *input,
 		   cfg->magic_header[0], cfg->magic_header[1],
 		   cfg->magic_header[2], cfg->magic_header[3]);
 
+  wg_if_awg_profile_t *profile;
+  pool_foreach (profile, wg_if->awg_profiles)
+    {
+      cfg = &profile->cfg;
+      vlib_cli_output (vm, "  Peer profile %d (%u peers):",
+		       profile - wg_if->awg_profiles, profile->n_peers);
+      vlib_cli_output (vm, "    Junk packets: count=%u min=%u max=%u",
+		       cfg->junk_packet_count, cfg->junk_packet_min_size,
+		       cfg->junk_packet_max_size);
+      vlib_cli_output (
+	vm, "    Header junk: init=%u response=%u cookie=%u transport=%u",
+	cfg->init_header_junk_size, cfg->response_header_junk_size,
+	cfg->cookie_reply_header_junk_size, cfg->transport_header_junk_size);
+      vlib_cli_output (vm, "    Magic headers: [%u, %u, %u, %u]",
+		       cfg->magic_header[0], cfg->magic_header[1],
+		       cfg->magic_header[2], cfg->magic_header[3]);
+    }
+
   return NULL;
 }
 
@@ -690,6 +935,7 @@ wg_set_i_header_command_fn (vlib_main_t *vm, unformat_input_t *input,
   /* Parse new tag string */
   if (wg_awg_parse_tag_string ((char *) tag_string, ihdr) < 0)
     {
+      wg_if_awg_update (wg_if);
       error = clib_error_return (0, "failed to parse tag string");
       goto done;
     }
@@ -700,6 +946,8 @@ wg_set_i_header_command_fn (vlib_main_t *vm, unformat_input_t *input,
       wg_if->awg_cfg.i_headers_enabled = 1;
     }
 
+  wg_if_awg_update (wg_if);
+
   vlib_cli_output (vm, "i-header i%u configured for %U", i_num,
 		   format_vnet_sw_if_index_name, vnet_get_main (),
 		   sw_if_index);
@@ -803,6 +1051,8 @@ wg_clear_i_header_command_fn (vlib_main_t *vm, unformat_input_t *input,
       error = clib_error_return (0, "i-header number must be 1-5 or 'all'");
     }
 
+  wg_if_awg_update (wg_if);
+
 done:
   unformat_free (line_input);
   return error;
@@ -814,6 +1064,159 @@ VLIB_CLI_COMMAND (wg_clear_i_header_command, static) = {
   .function = wg_clear_i_header_command_fn,
 };
 
+static clib_error_t *
+wg_test_awg_junk_command_fn (vlib_main_t *vm, unformat_input_t *input,
+			     vlib_cli_command_t *cmd)
+{
+  u32 bis[WG_AWG_MAX_PRE_HANDSHAKE_PACKETS];
+  u8 rewrite[sizeof (ip6_udp_header_t)] = { 0 };
+  u32 sw_if_index = ~0, n_iters = 100000, n_pkts = 0, n_bis, i;
+  u64 t0, n_clocks;
+  u8 is_ip4 = 1;
+  wg_if_t *wg_if;
+  index_t wgii;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "%U", unformat_vnet_sw_interface, vnet_get_main (),
+		    &sw_if_index))
+	;
+      else if (unformat (input, "iterations %u", &n_iters))
+	;
+      else if (unformat (input, "ip6"))
+	is_ip4 = 0;
+      else
+	return clib_error_return (0, "unknown input '%U'",
+				  format_unformat_error, input);
+    }
+
+  if (sw_if_index == ~0)
+    return clib_error_return (0, "interface not specified");
+
+  wgii = wg_if_find_by_sw_if_index (sw_if_index);
+  if (wgii == INDEX_INVALID)
+    return clib_error_return (0, "interface is not a wireguard interface");
+
+  wg_if = wg_if_get (wgii);
+  if (!wg_awg_is_enabled (&wg_if->awg_cfg))
+    return clib_error_return (0, "AmneziaWG is not enabled on %U",
+			      format_vnet_sw_if_index_name, vnet_get_main (),
+			      sw_if_index);
+
+  /* build and free the pre-handshake sequence the way wg_send_handshake
+   * does, i-headers included, without sending anything */
+  t0 = clib_cpu_time_now ();
+  for (i = 0; i < n_iters; i++)
+    {
+      n_bis = wg_awg_add_i_header_packets (vm, &wg_if->awg_cfg, rewrite,
+					   is_ip4, bis);
+      n_bis += wg_awg_add_junk_packets (vm, &wg_if->awg_cfg, rewrite, is_ip4,
+					bis + n_bis);
+      vlib_buffer_free (vm, bis, n_bis);
+      n_pkts += n_bis;
+    }
+  n_clocks = clib_cpu_time_now () - t0;
+
+  vlib_cli_output (vm, "%u iterations, %u packets", n_iters, n_pkts);
+  vlib_cli_output (vm, "%.2f clocks/iteration, %.2f clocks/packet",
+		   (f64) n_clocks / clib_max (n_iters, 1),
+		   (f64) n_clocks / clib_max (n_pkts, 1));
+
+  return NULL;
+}
+
+VLIB_CLI_COMMAND (wg_test_awg_junk_command, static) = {
+  .path = "test wireguard awg junk",
+  .short_help = "test wireguard awg junk <interface> [iterations <n>] [ip6]",
+  .function = wg_test_awg_junk_command_fn,
+};
+
+static clib_error_t *
+wg_test_awg_i_header_command_fn (vlib_main_t *vm, unformat_input_t *input,
+				 vlib_cli_command_t *cmd)
+{
+  u32 sw_if_index = ~0, n_iters = 1000, n_same, i, j;
+  u64 t_interp, t_template, t0, now;
+  wg_awg_rng_state_t rng;
+  wg_awg_i_header_t *ihdr;
+  u8 *rendered = 0;
+  wg_if_t *wg_if;
+  index_t wgii;
+  u32 counter;
+
+  while (unformat_check_input (input) != UNFORMAT_END_OF_INPUT)
+    {
+      if (unformat (input, "%U", unformat_vnet_sw_interface, vnet_get_main (),
+		    &sw_if_index))
+	;
+      else if (unformat (input, "iterations %u", &n_iters))
+	;
+      else
+	return clib_error_return (0, "unknown input '%U'",
+				  format_unformat_error, input);
+    }
+
+  if (sw_if_index == ~0)
+    return clib_error_return (0, "interface not specified");
+
+  wgii = wg_if_find_by_sw_if_index (sw_if_index);
+  if (wgii == INDEX_INVALID)
+    return clib_error_return (0, "interface is not a wireguard interface");
+
+  wg_if = wg_if_get (wgii);
+
+  /* each iteration replays the same generator state and counter through
+   * the tag interpreter and the compiled template and compares them */
+  for (i = 0; i < WG_AWG_MAX_I_HEADERS; i++)
+    {
+      ihdr = &wg_if->awg_cfg.i_headers[i];
+      if (!ihdr->enabled || !ihdr->total_size)
+	continue;
+
+      vec_validate (rendered, ihdr->total_size - 1);
+      n_same = t_interp = t_template = 0;
+      now = (u64) unix_time_now ();
+
+      for (j = 0; j < n_iters; j++)
+	{
+	  u8 *packet;
+
+	  wg_awg_rng_save (&rng);
+	  counter = ihdr->counter;
+
+	  t0 = clib_cpu_time_now ();
+	  packet = wg_awg_generate_i_header_packet (ihdr, now);
+	  t_interp += clib_cpu_time_now () - t0;
+
+	  wg_awg_rng_restore (&rng);
+	  ihdr->counter = counter;
+
+	  t0 = clib_cpu_time_now ();
+	  wg_awg_render_i_header (ihdr, rendered, now);
+	  t_template += clib_cpu_time_now () - t0;
+
+	  n_same += !memcmp (packet, rendered, ihdr->total_size);
+	  clib_mem_free (packet);
+	}
+
+      vlib_cli_output (vm,
+		       "i%u: %u bytes, %u/%u identical, interpreter %.2f "
+		       "clocks, template %.2f clocks",
+		       i + 1, ihdr->total_size, n_same, n_iters,
+		       (f64) t_interp / clib_max (n_iters, 1),
+		       (f64) t_template / clib_max (n_iters, 1));
+    }
+
+  vec_free (rendered);
+  return NULL;
+}
+
+VLIB_CLI_COMMAND (wg_test_awg_i_header_command, static) = {
+  .path = "test wireguard awg i-header",
+  .short_help = "test wireguard awg i-header <interface> [iterations <n>]",
+  .function = wg_test_awg_i_header_command_fn,
+};
+
 /*
  * fd.io coding-style-patch-verification: ON
  *
@@ -18,10 +18,10 @@
 #include <stddef.h>
 #include <openssl/rand.h>
 #include <vlib/vlib.h>
+#include <vppinfra/xxhash.h>
 
 #include <wireguard/wireguard_cookie.h>
 #include <wireguard/wireguard_chachapoly.h>
-#include <wireguard/wireguard.h>
 
 static void cookie_precompute_key (uint8_t *,
 				   const uint8_t[COOKIE_INPUT_SIZE],
@@ -34,9 +34,8 @@ static void cookie_checker_make_cookie (vlib_main_t *vm, cookie_checker_t *,
 					uint8_t[COOKIE_COOKIE_SIZE],
 					ip46_address_t *ip, u16 udp_port);
 
-static void ratelimit_init (ratelimit_t *, ratelimit_entry_t *);
+static void ratelimit_init (ratelimit_t *);
 static void ratelimit_deinit (ratelimit_t *);
-static void ratelimit_gc (ratelimit_t *, bool);
 static bool ratelimit_allow (ratelimit_t *, ip46_address_t *);
 
 /* Public Functions */
@@ -44,16 +43,25 @@ void
 cookie_maker_init (cookie_maker_t * cp, const uint8_t key[COOKIE_INPUT_SIZE])
 {
   clib_memset (cp, 0, sizeof (*cp));
+  clib_spinlock_init (&cp->cp_lock);
   cookie_precompute_key (cp->cp_mac1_key, key, COOKIE_MAC1_KEY_LABEL);
   cookie_precompute_key (cp->cp_cookie_key, key, COOKIE_COOKIE_KEY_LABEL);
 }
 
 void
-cookie_checker_init (cookie_checker_t *cc, ratelimit_entry_t *pool)
+cookie_maker_deinit (cookie_maker_t *cp)
+{
+  clib_spinlock_free (&cp->cp_lock);
+  wg_secure_zero_memory (cp, sizeof (*cp));
+}
+
+void
+cookie_checker_init (cookie_checker_t *cc)
 {
   clib_memset (cc, 0, sizeof (*cc));
-  ratelimit_init (&cc->cc_ratelimit_v4, pool);
-  ratelimit_init (&cc->cc_ratelimit_v6, pool);
+  clib_spinlock_init (&cc->cc_secret_lock);
+  ratelimit_init (&cc->cc_ratelimit_v4);
+  ratelimit_init (&cc->cc_ratelimit_v6);
 }
 
 void
@@ -76,6 +84,7 @@ cookie_checker_deinit (cookie_checker_t *cc)
 {
   ratelimit_deinit (&cc->cc_ratelimit_v4);
   ratelimit_deinit (&cc->cc_ratelimit_v6);
+  clib_spinlock_free (&cc->cc_secret_lock);
 }
 
 void
@@ -103,24 +112,26 @@ cookie_maker_consume_payload (vlib_main_t *vm, cookie_maker_t *cp,
 			      uint8_t ecookie[COOKIE_ENCRYPTED_SIZE])
 {
   uint8_t cookie[COOKIE_COOKIE_SIZE];
+  bool ret = false;
 
+  clib_spinlock_lock (&cp->cp_lock);
   if (cp->cp_mac1_valid == 0)
-    {
-      return false;
-    }
+    goto out;
 
   if (!wg_xchacha20poly1305_decrypt (vm, ecookie, COOKIE_ENCRYPTED_SIZE,
 				     cookie, cp->cp_mac1_last, COOKIE_MAC_SIZE,
 				     nonce, cp->cp_cookie_key))
-    {
-      return false;
-    }
+    goto out;
 
   clib_memcpy (cp->cp_cookie, cookie, COOKIE_COOKIE_SIZE);
   cp->cp_birthdate = vlib_time_now (vm);
   cp->cp_mac1_valid = 0;
+  ret = true;
 
-  return true;
+out:
+  clib_spinlock_unlock (&cp->cp_lock);
+  wg_secure_zero_memory (cookie, sizeof (cookie));
+  return ret;
 }
 
 void
@@ -130,6 +141,7 @@ cookie_maker_mac (cookie_maker_t * cp, message_macs_t * cm, void *buf,
   len = len - sizeof (message_macs_t);
   cookie_macs_mac1 (cm, buf, len, cp->cp_mac1_key);
 
+  clib_spinlock_lock (&cp->cp_lock);
   clib_memcpy (cp->cp_mac1_last, cm->mac1, COOKIE_MAC_SIZE);
   cp->cp_mac1_valid = 1;
 
@@ -139,6 +151,7 @@ cookie_maker_mac (cookie_maker_t * cp, message_macs_t * cm, void *buf,
     cookie_macs_mac2 (cm, buf, len, cp->cp_cookie);
   else
     clib_memset (cm->mac2, 0, COOKIE_MAC_SIZE);
+  clib_spinlock_unlock (&cp->cp_lock);
 }
 
 enum cookie_mac_state
@@ -176,6 +189,39 @@ cookie_checker_validate_macs (vlib_main_t *vm, cookie_checker_t *cc,
   return VALID_MAC_WITH_COOKIE;
 }
 
+/* Check only mac1, which needs no state; len covers the whole message */
+bool
+cookie_checker_validate_mac1 (cookie_checker_t *cc, void *buf, size_t len)
+{
+  message_macs_t *cm = buf + len - sizeof (message_macs_t);
+  message_macs_t our_cm;
+
+  cookie_macs_mac1 (&our_cm, buf, len - sizeof (message_macs_t),
+		    cc->cc_mac1_key);
+
+  return (clib_memcmp (our_cm.mac1, cm->mac1, COOKIE_MAC_SIZE) == 0);
+}
+
+void
+cookie_checker_validate_mac1_x4 (cookie_checker_t *cc, void *buf[4],
+				 size_t len, bool valid[4])
+{
+  uint8_t mac1[4][COOKIE_MAC_SIZE];
+  uint8_t *out[4] = { mac1[0], mac1[1], mac1[2], mac1[3] };
+  message_macs_t *cm;
+  int i;
+
+  blake2s_x4 (out, COOKIE_MAC_SIZE, (const uint8_t **) buf,
+	      len - sizeof (message_macs_t), cc->cc_mac1_key,
+	      COOKIE_KEY_SIZE);
+
+  for (i = 0; i < 4; i++)
+    {
+      cm = buf[i] + len - sizeof (message_macs_t);
+      valid[i] = (clib_memcmp (mac1[i], cm->mac1, COOKIE_MAC_SIZE) == 0);
+    }
+}
+
 /* Private functions */
 static void
 cookie_precompute_key (uint8_t * key, const uint8_t input[COOKIE_INPUT_SIZE],
@@ -218,6 +264,8 @@ cookie_checker_make_cookie (vlib_main_t *vm, cookie_checker_t *cc,
 {
   blake2s_state_t state;
 
+  /* the secret is shared by the threads checking this interface's MACs */
+  clib_spinlock_lock (&cc->cc_secret_lock);
   if (wg_birthdate_has_expired (cc->cc_secret_birthdate,
 				COOKIE_SECRET_MAX_AGE))
     {
@@ -227,6 +275,7 @@ cookie_checker_make_cookie (vlib_main_t *vm, cookie_checker_t *cc,
 
   blake2s_init_key (&state, COOKIE_COOKIE_SIZE, cc->cc_secret,
 		    COOKIE_SECRET_SIZE);
+  clib_spinlock_unlock (&cc->cc_secret_lock);
 
   if (ip46_address_is_ip4 (ip))
     {
@@ -241,121 +290,95 @@ cookie_checker_make_cookie (vlib_main_t *vm, cookie_checker_t *cc,
 }
 
 static void
-ratelimit_init (ratelimit_t *rl, ratelimit_entry_t *pool)
+ratelimit_init (ratelimit_t *rl)
 {
-  rl->rl_pool = pool;
+  vec_validate (rl->rl_buckets, vlib_get_n_threads () - 1);
+  RAND_bytes ((u8 *) &rl->rl_seed, sizeof (rl->rl_seed));
 }
 
 static void
 ratelimit_deinit (ratelimit_t *rl)
 {
-  ratelimit_gc (rl, /* force */ true);
-  hash_free (rl->rl_table);
+  ratelimit_bucket_t **buckets;
+
+  vec_foreach (buckets, rl->rl_buckets)
+    vec_free (*buckets);
+  vec_free (rl->rl_buckets);
 }
 
-static void
-ratelimit_gc (ratelimit_t *rl, bool force)
+static_always_inline u32
+ratelimit_now_ms (vlib_main_t *vm)
 {
-  u32 r_key;
-  u32 r_idx;
-  ratelimit_entry_t *r;
-
-  if (force)
-    {
-      /* clang-format off */
-      hash_foreach (r_key, r_idx, rl->rl_table, {
-	r = pool_elt_at_index (rl->rl_pool, r_idx);
-	pool_put (rl->rl_pool, r);
-      });
-      /* clang-format on */
-      return;
-    }
-
-  f64 now = vlib_time_now (vlib_get_main ());
+  /* wraps every 49.7 days; through u64 so the truncation is defined */
+  u32 now = (u32) (u64) (vlib_time_now (vm) * 1e3);
 
-  if ((rl->rl_last_gc + ELEMENT_TIMEOUT) < now)
-    {
-      u32 *r_key_to_del = NULL;
-      u32 *pr_key;
-
-      rl->rl_last_gc = now;
-
-      /* clang-format off */
-      hash_foreach (r_key, r_idx, rl->rl_table, {
-	r = pool_elt_at_index (rl->rl_pool, r_idx);
-	if ((r->r_last_time + ELEMENT_TIMEOUT) < now)
-	  {
-	    vec_add1 (r_key_to_del, r_key);
-	    pool_put (rl->rl_pool, r);
-	  }
-      });
-      /* clang-format on */
-
-      vec_foreach (pr_key, r_key_to_del)
-	{
-	  hash_unset (rl->rl_table, *pr_key);
-	}
-
-      vec_free (r_key_to_del);
-    }
+  /* 0 marks a free way */
+  return now ? now : 1;
 }
 
 static bool
 ratelimit_allow (ratelimit_t *rl, ip46_address_t *ip)
 {
-  u32 r_key;
-  uword *p;
-  u32 r_idx;
-  ratelimit_entry_t *r;
-  f64 now = vlib_time_now (vlib_get_main ());
+  vlib_main_t *vm = vlib_get_main ();
+  ratelimit_bucket_t *b;
+  u32 now, diff;
+  u64 key, tokens;
+  int i, free = -1;
 
   if (ip46_address_is_ip4 (ip))
     /* Use all 4 bytes of IPv4 address */
-    r_key = ip->ip4.as_u32;
+    key = ip->ip4.as_u32;
   else
     /* Use top 8 bytes (/64) of IPv6 address */
-    r_key = ip->ip6.as_u32[0] ^ ip->ip6.as_u32[1];
+    key = ip->ip6.as_u64[0];
+
+  if (PREDICT_FALSE (!rl->rl_buckets[vm->thread_index]))
+    vec_validate_aligned (rl->rl_buckets[vm->thread_index],
+			  RATELIMIT_N_BUCKETS - 1, CLIB_CACHE_LINE_BYTES);
 
-  /* Check if there is already an entry for the IP address */
-  p = hash_get (rl->rl_table, r_key);
-  if (p)
+  /* keyed, so sources cannot be picked to collide */
+  b = rl->rl_buckets[vm->thread_index] +
+      (clib_xxhash (key ^ rl->rl_seed) & (RATELIMIT_N_BUCKETS - 1));
+  now = ratelimit_now_ms (vm);
+
+  for (i = 0; i < RATELIMIT_WAYS; i++)
     {
-      u64 tokens;
-      f64 diff;
+      diff = now - b->rb_last_ms[i];
 
-      r_idx = p[0];
-      r = pool_elt_at_index (rl->rl_pool, r_idx);
+      /* free, or idle long enough to be forgotten */
+      if (!b->rb_last_ms[i] || diff > ELEMENT_TIMEOUT * 1000)
+	{
+	  if (free < 0)
+	    free = i;
+	  continue;
+	}
 
-      diff = now - r->r_last_time;
-      r->r_last_time = now;
+      if (b->rb_key[i] != key)
+	continue;
 
-      tokens = r->r_tokens + diff * NSEC_PER_SEC;
+      b->rb_last_ms[i] = now;
+      tokens = b->rb_tokens[i] + (u64) diff * NSEC_PER_MSEC;
 
       if (tokens > TOKEN_MAX)
 	tokens = TOKEN_MAX;
 
       if (tokens >= INITIATION_COST)
 	{
-	  r->r_tokens = tokens - INITIATION_COST;
+	  b->rb_tokens[i] = tokens - INITIATION_COST;
 	  return true;
 	}
 
-      r->r_tokens = tokens;
+      b->rb_tokens[i] = tokens;
       return false;
     }
 
-  /* No entry for the IP address */
-  ratelimit_gc (rl, /* force */ false);
-
-  if (hash_elts (rl->rl_table) >= RATELIMIT_SIZE_MAX)
+  /* No entry for the source and its bucket is full of active ones */
+  if (free < 0)
     return false;
 
-  pool_get (rl->rl_pool, r);
-  r_idx = r - rl->rl_pool;
-  hash_set (rl->rl_table, r_key, r_idx);
-
-  r->r_last_time = now;
-  r->r_tokens = TOKEN_MAX - INITIATION_COST;
+  b->rb_key[free] = key;
+  b->rb_last_ms[free] = now;
+  b->rb_tokens[free] = TOKEN_MAX - INITIATION_COST;
 
   return true;
 }
@@ -44,8 +44,10 @@ enum cookie_mac_state
 
 /* Constants for initiation rate limiting */
 #define RATELIMIT_SIZE		(1 << 13)
-#define RATELIMIT_SIZE_MAX	(RATELIMIT_SIZE * 8)
+#define RATELIMIT_WAYS		4
+#define RATELIMIT_N_BUCKETS	(RATELIMIT_SIZE / RATELIMIT_WAYS)
 #define NSEC_PER_SEC		1000000000LL
+#define NSEC_PER_MSEC		1000000LL
 #define INITIATIONS_PER_SECOND	20
 #define INITIATIONS_BURSTABLE	5
 #define INITIATION_COST		(NSEC_PER_SEC / INITIATIONS_PER_SECOND)
@@ -58,21 +60,31 @@ typedef struct cookie_macs
   uint8_t mac2[COOKIE_MAC_SIZE];
 } message_macs_t;
 
-typedef struct ratelimit_entry
+/*
+ * One cache line of sources: the key is the IPv4 address or the IPv6 /64,
+ * the time is in milliseconds and 0 marks a free way. Ways whose source
+ * has been idle for ELEMENT_TIMEOUT are reused, so the table never needs
+ * to be walked.
+ */
+typedef struct ratelimit_bucket
 {
-  f64 r_last_time;
-  u64 r_tokens;
-} ratelimit_entry_t;
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  u64 rb_key[RATELIMIT_WAYS];
+  u32 rb_last_ms[RATELIMIT_WAYS];
+  u32 rb_tokens[RATELIMIT_WAYS];
+} ratelimit_bucket_t;
 
 typedef struct ratelimit
 {
-  ratelimit_entry_t *rl_pool;
-  uword *rl_table;
-  f64 rl_last_gc;
+  /* per-thread tables of RATELIMIT_N_BUCKETS, allocated on first use */
+  ratelimit_bucket_t **rl_buckets;
+  u64 rl_seed;
 } ratelimit_t;
 
 typedef struct cookie_maker
 {
+  /* messages to and cookies from a peer are handled on any thread */
+  clib_spinlock_t cp_lock;
   uint8_t cp_mac1_key[COOKIE_KEY_SIZE];
   uint8_t cp_cookie_key[COOKIE_KEY_SIZE];
 
@@ -90,13 +102,15 @@ typedef struct cookie_checker
   uint8_t cc_mac1_key[COOKIE_KEY_SIZE];
   uint8_t cc_cookie_key[COOKIE_KEY_SIZE];
 
+  clib_spinlock_t cc_secret_lock;
   f64 cc_secret_birthdate;
   uint8_t cc_secret[COOKIE_SECRET_SIZE];
 } cookie_checker_t;
 
 
 void cookie_maker_init (cookie_maker_t *, const uint8_t[COOKIE_INPUT_SIZE]);
-void cookie_checker_init (cookie_checker_t *, ratelimit_entry_t *);
+void cookie_maker_deinit (cookie_maker_t *);
+void cookie_checker_init (cookie_checker_t *);
 void cookie_checker_update (cookie_checker_t *, uint8_t[COOKIE_INPUT_SIZE]);
 void cookie_checker_deinit (cookie_checker_t *);
 void cookie_checker_create_payload (vlib_main_t *vm, cookie_checker_t *cc,
@@ -112,6 +126,10 @@ enum cookie_mac_state
 cookie_checker_validate_macs (vlib_main_t *vm, cookie_checker_t *,
 			      message_macs_t *, void *, size_t, bool,
 			      ip46_address_t *ip, u16 udp_port);
+bool cookie_checker_validate_mac1 (cookie_checker_t *cc, void *buf,
+				   size_t len);
+void cookie_checker_validate_mac1_x4 (cookie_checker_t *cc, void *buf[4],
+				      size_t len, bool valid[4]);
 
 #endif /* __included_wg_cookie_h__ */
 
@@ -0,0 +1,45 @@
+# Copyright (c) 2025 Internet Mastering & Company, Inc.
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at:
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# WireGuard/AmneziaWG protocol core: keys, noise, cookies, BLAKE2s and the
+# AWG obfuscation. The wireguard plugin and awg-vpn-standalone both build
+# from this list, so nothing in it may use graph nodes, vlib buffers or
+# plugin state. Data-path crypto goes through vnet_crypto_process_ops ();
+# the per-message handshake and cookie AEAD uses OpenSSL directly, so
+# users must link libcrypto.
+# Paths are relative to WG_CORE_DIR.
+
+set(WG_CORE_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+set(WG_CORE_SOURCES
+  blake/blake2s.c
+  wireguard_key.c
+  wireguard_noise.c
+  wireguard_cookie.c
+  wireguard_chachapoly.c
+  wireguard_awg.c
+  wireguard_awg_tags.c
+)
+
+set(WG_CORE_HEADERS
+  blake/blake2-impl.h
+  blake/blake2s.h
+  wireguard_hchacha20.h
+  wireguard_messages.h
+  wireguard_key.h
+  wireguard_noise.h
+  wireguard_cookie.h
+  wireguard_chachapoly.h
+  wireguard_awg.h
+  wireguard_awg_tags.h
+)
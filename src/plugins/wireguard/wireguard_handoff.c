@@ -36,7 +36,6 @@ static char *wg_handoff_error_strings[] = {
 
 typedef enum
 {
-  WG_HANDOFF_HANDSHAKE,
   WG_HANDOFF_INP_DATA,
   WG_HANDOFF_OUT_TUN,
 } wg_handoff_mode_t;
@@ -79,22 +78,25 @@ wg_handoff (vlib_main_t * vm,
 
   while (n_left_from > 0)
     {
-      const wg_peer_t *peer;
+      wg_peer_t *peer;
       index_t peeri = INDEX_INVALID;
 
-      if (PREDICT_FALSE (mode == WG_HANDOFF_HANDSHAKE))
-	{
-	  ti[0] = 0;
-	}
-      else if (mode == WG_HANDOFF_INP_DATA)
+      if (mode == WG_HANDOFF_INP_DATA)
 	{
 	  message_data_t *data = vlib_buffer_get_current (b[0]);
-	  u32 *entry =
+	  peeri =
 	    wg_index_table_lookup (&wmp->index_table, data->receiver_index);
-	  peeri = *entry;
-	  peer = wg_peer_get (peeri);
 
-	  ti[0] = peer->input_thread_index;
+	  /* the index may have been dropped since wg-input looked it up;
+	   * process locally, where the packet will be dropped */
+	  if (PREDICT_FALSE (peeri == INDEX_INVALID))
+	    ti[0] = vm->thread_index;
+	  else
+	    {
+	      peer = wg_peer_get (peeri);
+	      ti[0] = wg_peer_input_thread (peer, data->receiver_index,
+					    data->counter);
+	    }
 	}
       else
 	{
@@ -129,24 +131,6 @@ wg_handoff (vlib_main_t * vm,
   return n_enq;
 }
 
-VLIB_NODE_FN (wg4_handshake_handoff)
-(vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *from_frame)
-{
-  wg_main_t *wmp = &wg_main;
-
-  return wg_handoff (vm, node, from_frame, wmp->in4_fq_index,
-		     WG_HANDOFF_HANDSHAKE);
-}
-
-VLIB_NODE_FN (wg6_handshake_handoff)
-(vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *from_frame)
-{
-  wg_main_t *wmp = &wg_main;
-
-  return wg_handoff (vm, node, from_frame, wmp->in6_fq_index,
-		     WG_HANDOFF_HANDSHAKE);
-}
-
 VLIB_NODE_FN (wg4_input_data_handoff)
 (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *from_frame)
 {
@@ -183,34 +167,6 @@ VLIB_NODE_FN (wg6_output_tun_handoff)
 		     WG_HANDOFF_OUT_TUN);
 }
 
-VLIB_REGISTER_NODE (wg4_handshake_handoff) =
-{
-  .name = "wg4-handshake-handoff",
-  .vector_size = sizeof (u32),
-  .format_trace = format_wg_handoff_trace,
-  .type = VLIB_NODE_TYPE_INTERNAL,
-  .n_errors = ARRAY_LEN (wg_handoff_error_strings),
-  .error_strings = wg_handoff_error_strings,
-  .n_next_nodes = 1,
-  .next_nodes = {
-    [0] = "error-drop",
-  },
-};
-
-VLIB_REGISTER_NODE (wg6_handshake_handoff) =
-{
-  .name = "wg6-handshake-handoff",
-  .vector_size = sizeof (u32),
-  .format_trace = format_wg_handoff_trace,
-  .type = VLIB_NODE_TYPE_INTERNAL,
-  .n_errors = ARRAY_LEN (wg_handoff_error_strings),
-  .error_strings = wg_handoff_error_strings,
-  .n_next_nodes = 1,
-  .next_nodes = {
-    [0] = "error-drop",
-  },
-};
-
 VLIB_REGISTER_NODE (wg4_input_data_handoff) =
 {
   .name = "wg4-input-data-handoff",
@@ -23,6 +23,7 @@
 #include <wireguard/wireguard_if.h>
 #include <wireguard/wireguard.h>
 #include <wireguard/wireguard_peer.h>
+#include <wireguard/wireguard_chachapoly.h>
 
 /* pool of interfaces */
 wg_if_t *wg_if_pool;
@@ -36,8 +37,8 @@ static index_t *wg_if_index_by_sw_if_index;
 /* vector of interfaces key'd on their UDP port (in network order) */
 index_t **wg_if_indexes_by_port;
 
-/* pool of ratelimit entries */
-static ratelimit_entry_t *wg_ratelimit_pool;
+/* number of interfaces with AWG obfuscation enabled */
+u32 wg_if_n_awg_enabled;
 
 static u8 *
 format_wg_if_name (u8 * s, va_list * args)
@@ -94,23 +95,26 @@ wg_if_find_by_sw_if_index (u32 sw_if_index)
   return (ti);
 }
 
-static walk_rc_t
-wg_if_find_peer_by_public_key (index_t peeri, void *data)
+index_t
+wg_if_peer_find_by_public_key (const wg_if_t *wgi,
+			       const u8 public[NOISE_PUBLIC_KEY_LEN])
 {
-  uint8_t *public = data;
-  wg_peer_t *peer = wg_peer_get (peeri);
+  uword *p;
 
-  if (!memcmp (peer->remote.r_public, public, NOISE_PUBLIC_KEY_LEN))
-    return (WALK_STOP);
-  return (WALK_CONTINUE);
+  p = hash_get_mem (wgi->peers_by_public_key, public);
+  if (NULL == p)
+    return (INDEX_INVALID);
+
+  return (p[0]);
 }
 
 static noise_remote_t *
-wg_remote_get (const uint8_t public[NOISE_PUBLIC_KEY_LEN])
+wg_remote_get (void *arg, const uint8_t public[NOISE_PUBLIC_KEY_LEN])
 {
+  wg_if_t *wgi = wg_if_get (pointer_to_uword (arg));
   index_t peeri;
 
-  peeri = wg_peer_walk (wg_if_find_peer_by_public_key, (void *) public);
+  peeri = wg_if_peer_find_by_public_key (wgi, public);
 
   if (INDEX_INVALID != peeri)
     return &wg_peer_get (peeri)->remote;
@@ -135,6 +139,14 @@ wg_index_drop (vlib_main_t *vm, uint32_t key)
   wg_index_table_del (vm, &wmp->index_table, key);
 }
 
+/* counted once the keys are in place, whichever side started it */
+static void
+wg_rekeyed (vlib_main_t *vm, noise_remote_t *remote)
+{
+  vlib_increment_simple_counter (&wg_peer_counters[WG_PEER_COUNTER_REKEYS],
+				 vm->thread_index, remote->r_peer_idx, 1);
+}
+
 static clib_error_t *
 wg_if_admin_up_down (vnet_main_t * vnm, u32 hw_if_index, u32 flags)
 {
@@ -278,8 +290,17 @@ wg_if_create (u32 user_instance,
     .u_remote_get = wg_remote_get,
     .u_index_set = wg_index_set,
     .u_index_drop = wg_index_drop,
+    .u_rekeyed = wg_rekeyed,
   };
 
+  /* handshakes run on any thread, each with a key of its own */
+  wg_chacha20poly1305_init ();
+  if (!wg_awg_init ())
+    {
+      wg_if_instance_free (instance);
+      return VNET_API_ERROR_INIT_FAILED;
+    }
+
   pool_get (noise_local_pool, local);
 
   noise_local_init (local, &upcall);
@@ -331,7 +352,11 @@ wg_if_create (u32 user_instance,
   wg_if->port = port;
   wg_if->transport = transport;
   wg_if->local_idx = local - noise_local_pool;
-  cookie_checker_init (&wg_if->cookie_checker, wg_ratelimit_pool);
+  /* handshakes look the initiator up among this interface's peers only */
+  local->l_upcall.u_arg = uword_to_pointer (t_idx, void *);
+  wg_if->peers_by_public_key =
+    hash_create_mem (0, NOISE_PUBLIC_KEY_LEN, sizeof (uword));
+  cookie_checker_init (&wg_if->cookie_checker);
   cookie_checker_update (&wg_if->cookie_checker, local->l_public);
 
   hw_if_index = vnet_register_interface (vnm,
@@ -341,6 +366,9 @@ wg_if_create (u32 user_instance,
 
   hi = vnet_get_hw_interface (vnm, hw_if_index);
 
+  /* wg-output segments GSO buffers itself while encrypting them */
+  vnet_hw_if_set_caps (vnm, hw_if_index, VNET_HW_IF_CAP_TCP_GSO);
+
   vec_validate_init_empty (wg_if_index_by_sw_if_index, hi->sw_if_index,
 			   INDEX_INVALID);
   wg_if_index_by_sw_if_index[hi->sw_if_index] = t_idx;
@@ -381,6 +409,10 @@ wg_if_delete (u32 sw_if_index)
   wg_if_peer_walk (wg_if, wg_peer_if_delete, NULL);
 
   hash_free (wg_if->peers);
+  hash_free (wg_if->peers_by_public_key);
+  pool_free (wg_if->awg_profiles);
+  hash_free (wg_if->awg_profile_by_magic);
+  vec_free (wg_if->awg_profile_junk_sizes);
 
   index_t *ii;
   index_t *ifs = wg_if_indexes_get_by_port (wg_if->port);
@@ -412,13 +444,156 @@ wg_if_delete (u32 sw_if_index)
   pool_put_index (noise_local_pool, wg_if->local_idx);
   pool_put (wg_if_pool, wg_if);
 
+  wg_if_awg_update (NULL);
+
   return 0;
 }
 
+/*
+ * Called after an interface's AWG configuration changed (or with NULL after
+ * an interface is deleted) to refresh the data-plane view of it.
+ */
+void
+wg_if_awg_update (wg_if_t *wgi)
+{
+  wg_if_t *wg_if;
+
+  if (wgi)
+    wg_awg_cfg_update_rx (&wgi->awg_cfg);
+
+  wg_if_n_awg_enabled = 0;
+  pool_foreach (wg_if, wg_if_pool)
+    {
+      if (wg_if_awg_is_active (wg_if))
+	wg_if_n_awg_enabled++;
+    }
+}
+
+bool
+wg_if_awg_magic_in_use (const wg_if_t *wgi, u32 magic)
+{
+  return (NULL != hash_get (wgi->awg_profile_by_magic, magic));
+}
+
+static bool
+wg_if_awg_profile_equal (const wg_awg_cfg_t *a, const wg_awg_cfg_t *b)
+{
+  return (a->junk_packet_count == b->junk_packet_count &&
+	  a->junk_packet_min_size == b->junk_packet_min_size &&
+	  a->junk_packet_max_size == b->junk_packet_max_size &&
+	  a->init_header_junk_size == b->init_header_junk_size &&
+	  a->response_header_junk_size == b->response_header_junk_size &&
+	  a->cookie_reply_header_junk_size ==
+	    b->cookie_reply_header_junk_size &&
+	  a->transport_header_junk_size == b->transport_header_junk_size &&
+	  !memcmp (a->magic_header, b->magic_header, sizeof (a->magic_header)));
+}
+
+/* Collect the header junk sizes the magic headers of the profiles follow */
+static void
+wg_if_awg_profile_junk_sizes_update (wg_if_t *wgi)
+{
+  wg_if_awg_profile_t *profile;
+  u32 i;
+
+  vec_reset_length (wgi->awg_profile_junk_sizes);
+  pool_foreach (profile, wgi->awg_profiles)
+    {
+      for (i = 0; i < ARRAY_LEN (profile->cfg.rx_junk); i++)
+	if (vec_search (wgi->awg_profile_junk_sizes,
+			profile->cfg.rx_junk[i]) == ~0)
+	  vec_add1 (wgi->awg_profile_junk_sizes, profile->cfg.rx_junk[i]);
+    }
+}
+
+/*
+ * Take a reference on the interface's profile with these parameters,
+ * creating it if needed. A new profile's magic headers must be distinct
+ * and unused by the other profiles, including the interface's own, since
+ * the receive side tells profiles apart by them.
+ */
+int
+wg_if_awg_profile_lock (wg_if_t *wgi, const wg_awg_cfg_t *cfg,
+			index_t *profilei)
+{
+  wg_if_awg_profile_t *profile;
+  u32 i, j;
+
+  pool_foreach (profile, wgi->awg_profiles)
+    {
+      if (wg_if_awg_profile_equal (&profile->cfg, cfg))
+	{
+	  profile->n_peers++;
+	  *profilei = profile - wgi->awg_profiles;
+	  return (0);
+	}
+    }
+
+  for (i = 0; i < ARRAY_LEN (cfg->magic_header); i++)
+    {
+      if (wg_if_awg_magic_in_use (wgi, cfg->magic_header[i]))
+	return (VNET_API_ERROR_VALUE_EXIST);
+      for (j = 0; j < ARRAY_LEN (cfg->magic_header); j++)
+	if (j != i && cfg->magic_header[j] == cfg->magic_header[i])
+	  return (VNET_API_ERROR_INVALID_VALUE);
+      if (wg_awg_is_enabled (&wgi->awg_cfg))
+	for (j = 0; j < ARRAY_LEN (cfg->magic_header); j++)
+	  if (wgi->awg_cfg.magic_header[j] == cfg->magic_header[i])
+	    return (VNET_API_ERROR_VALUE_EXIST);
+    }
+
+  pool_get (wgi->awg_profiles, profile);
+  wg_awg_cfg_init (&profile->cfg);
+  profile->cfg.enabled = 1;
+  profile->cfg.junk_packet_count = cfg->junk_packet_count;
+  profile->cfg.junk_packet_min_size = cfg->junk_packet_min_size;
+  profile->cfg.junk_packet_max_size = cfg->junk_packet_max_size;
+  profile->cfg.init_header_junk_size = cfg->init_header_junk_size;
+  profile->cfg.response_header_junk_size = cfg->response_header_junk_size;
+  profile->cfg.cookie_reply_header_junk_size =
+    cfg->cookie_reply_header_junk_size;
+  profile->cfg.transport_header_junk_size = cfg->transport_header_junk_size;
+  clib_memcpy (profile->cfg.magic_header, cfg->magic_header,
+	       sizeof (cfg->magic_header));
+  wg_awg_cfg_update_rx (&profile->cfg);
+  profile->n_peers = 1;
+
+  *profilei = profile - wgi->awg_profiles;
+  for (i = 0; i < ARRAY_LEN (cfg->magic_header); i++)
+    hash_set (wgi->awg_profile_by_magic, cfg->magic_header[i], *profilei);
+  wg_if_awg_profile_junk_sizes_update (wgi);
+
+  wg_if_awg_update (NULL);
+
+  return (0);
+}
+
+void
+wg_if_awg_profile_unlock (wg_if_t *wgi, index_t profilei)
+{
+  wg_if_awg_profile_t *profile;
+  u32 i;
+
+  profile = pool_elt_at_index (wgi->awg_profiles, profilei);
+  if (--profile->n_peers)
+    return;
+
+  for (i = 0; i < ARRAY_LEN (profile->cfg.magic_header); i++)
+    hash_unset (wgi->awg_profile_by_magic, profile->cfg.magic_header[i]);
+  pool_put (wgi->awg_profiles, profile);
+  wg_if_awg_profile_junk_sizes_update (wgi);
+
+  wg_if_awg_update (NULL);
+}
+
 void
 wg_if_peer_add (wg_if_t * wgi, index_t peeri)
 {
+  wg_peer_t *peer = wg_peer_get (peeri);
+
   hash_set (wgi->peers, peeri, peeri);
+  hash_set_mem_alloc (&wgi->peers_by_public_key, peer->remote.r_public,
+		      peeri);
 
   if (1 == hash_elts (wgi->peers))
     {
@@ -432,7 +607,10 @@ wg_if_peer_add (wg_if_t * wgi, index_t peeri)
 void
 wg_if_peer_remove (wg_if_t * wgi, index_t peeri)
 {
+  wg_peer_t *peer = wg_peer_get (peeri);
+
   hash_unset (wgi->peers, peeri);
+  hash_unset_mem_free (&wgi->peers_by_public_key, peer->remote.r_public);
 
   if (0 == hash_elts (wgi->peers))
     {
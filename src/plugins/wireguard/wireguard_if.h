@@ -24,6 +24,13 @@
 #include <wireguard/wireguard_awg.h>
 #include <wireguard/wireguard_transport.h>
 
+/* AWG profile shared by the peers that override their interface's */
+typedef struct wg_if_awg_profile_t_
+{
+  wg_awg_cfg_t cfg;
+  u32 n_peers;
+} wg_if_awg_profile_t;
+
 typedef struct wg_if_t_
 {
   int user_instance;
@@ -42,12 +49,26 @@ typedef struct wg_if_t_
   /* hash table of peers on this link */
   uword *peers;
 
-  /* Under load params */
-  f64 handshake_counting_end;
+  /* peers on this link keyed by their static public key */
+  uword *peers_by_public_key;
+
+  /* Under load params: handshakes counted until the end of the counting
+   * interval, in ms, and until when the interface is under load */
   u32 handshake_num;
+  u64 handshake_counting_end_ms;
+  f64 under_load_end;
 
   /* AmneziaWG obfuscation configuration */
   wg_awg_cfg_t awg_cfg;
+
+  /* per-peer AWG profiles, and the profile each of their magic headers
+   * belongs to; a magic header identifies exactly one profile */
+  wg_if_awg_profile_t *awg_profiles;
+  uword *awg_profile_by_magic;
+
+  /* distinct header junk sizes of the profiles, where a received
+   * message's magic header may be */
+  u32 *awg_profile_junk_sizes;
 } wg_if_t;
 
 
@@ -66,9 +87,17 @@ void wg_if_walk (wg_if_walk_cb_t fn, void *data);
 typedef walk_rc_t (*wg_if_peer_walk_cb_t) (index_t peeri, void *data);
 index_t wg_if_peer_walk (wg_if_t * wgi, wg_if_peer_walk_cb_t fn, void *data);
 
+index_t wg_if_peer_find_by_public_key (const wg_if_t *wgi,
+				       const u8 public[NOISE_PUBLIC_KEY_LEN]);
 void wg_if_peer_add (wg_if_t * wgi, index_t peeri);
 void wg_if_peer_remove (wg_if_t * wgi, index_t peeri);
 
+void wg_if_awg_update (wg_if_t *wgi);
+int wg_if_awg_profile_lock (wg_if_t *wgi, const wg_awg_cfg_t *cfg,
+			    index_t *profilei);
+void wg_if_awg_profile_unlock (wg_if_t *wgi, index_t profilei);
+bool wg_if_awg_magic_in_use (const wg_if_t *wgi, u32 magic);
+
 /**
  * Data-plane exposed functions
  */
@@ -94,32 +123,128 @@ wg_if_indexes_get_by_port (u16 port)
   return (wg_if_indexes_by_port[port]);
 }
 
+/* number of interfaces with AWG obfuscation enabled, for them or a peer */
+extern u32 wg_if_n_awg_enabled;
+
+static_always_inline bool
+wg_if_awg_is_active (const wg_if_t *wgi)
+{
+  return (wg_awg_is_enabled (&wgi->awg_cfg) || pool_elts (wgi->awg_profiles));
+}
+
+/*
+ * Interface whose AWG profiles decode datagrams received on a port; the
+ * first interface with obfuscation active wins.
+ */
+static_always_inline wg_if_t *
+wg_if_awg_get_by_port (u16 port)
+{
+  index_t *wgii, *wg_ifs;
+  wg_if_t *wgi;
+
+  wg_ifs = wg_if_indexes_get_by_port (port);
+  vec_foreach (wgii, wg_ifs)
+    {
+      wgi = wg_if_get (*wgii);
+      if (wg_if_awg_is_active (wgi))
+	return (wgi);
+    }
+  return (NULL);
+}
+
+/*
+ * Classify a received datagram against an interface's AWG profiles. The
+ * interface's own profile goes first; without one, plain WireGuard
+ * messages do, so peers without obfuscation only pay a type check. Then
+ * the magic header is read after each header junk size the per-peer
+ * profiles use, usually one, and the profile it belongs to is tried.
+ * Unmatched datagrams are junk on an obfuscated interface and are
+ * otherwise left to the plain decoder.
+ */
+static_always_inline message_type_t
+wg_if_awg_decode (const wg_if_t *wgi, const u8 *msg, u32 len, u32 max_read,
+		  u32 *junk_len)
+{
+  const wg_if_awg_profile_t *profile;
+  message_type_t type = ((message_header_t *) msg)->type;
+  message_type_t awg_type;
+  const u32 *junk;
+  uword *p;
+
+  if (wg_awg_is_enabled (&wgi->awg_cfg))
+    {
+      awg_type = wg_awg_decode (&wgi->awg_cfg, msg, len, max_read, junk_len);
+      if (awg_type != MESSAGE_INVALID)
+	return (awg_type);
+      type = MESSAGE_INVALID;
+    }
+  else if (type >= MESSAGE_HANDSHAKE_INITIATION && type <= MESSAGE_DATA)
+    return (type);
+
+  vec_foreach (junk, wgi->awg_profile_junk_sizes)
+    {
+      if (junk[0] + sizeof (u32) > max_read)
+	continue;
+      p = hash_get (wgi->awg_profile_by_magic,
+		    clib_mem_unaligned (msg + junk[0], u32));
+      if (!p)
+	continue;
+      profile = pool_elt_at_index (wgi->awg_profiles, p[0]);
+      awg_type = wg_awg_decode (&profile->cfg, msg, len, max_read, junk_len);
+      if (awg_type != MESSAGE_INVALID)
+	return (awg_type);
+    }
+
+  return (type);
+}
+
+/*
+ * AWG profile a message arrived with, from its magic header: a per-peer
+ * profile's or else the interface's. Replies to senders not known yet,
+ * i.e. cookies, go out with it.
+ */
+static_always_inline const wg_awg_cfg_t *
+wg_if_awg_cfg_by_magic (const wg_if_t *wgi, u32 magic)
+{
+  uword *p = hash_get (wgi->awg_profile_by_magic, magic);
+
+  if (PREDICT_FALSE (p != NULL))
+    return (&pool_elt_at_index (wgi->awg_profiles, p[0])->cfg);
+  return (&wgi->awg_cfg);
+}
+
 #define HANDSHAKE_COUNTING_INTERVAL		0.5
 #define UNDER_LOAD_INTERVAL			1.0
 #define HANDSHAKE_NUM_PER_PEER_UNTIL_UNDER_LOAD 40
 
+/*
+ * Handshakes are counted by every thread receiving them. The first thread
+ * to find the counting interval over starts the next one with a
+ * compare-and-swap and restarts the count; the others just count.
+ */
 static_always_inline bool
 wg_if_is_under_load (vlib_main_t *vm, wg_if_t *wgi)
 {
-  static f64 wg_under_load_end;
   f64 now = vlib_time_now (vm);
+  u64 now_ms = (u64) (now * 1e3);
+  u64 end_ms = wgi->handshake_counting_end_ms;
   u32 num_until_under_load =
     hash_elts (wgi->peers) * HANDSHAKE_NUM_PER_PEER_UNTIL_UNDER_LOAD;
 
-  if (wgi->handshake_counting_end < now)
-    {
-      wgi->handshake_counting_end = now + HANDSHAKE_COUNTING_INTERVAL;
-      wgi->handshake_num = 0;
-    }
-  wgi->handshake_num++;
+  if (end_ms < now_ms &&
+      clib_atomic_bool_cmp_and_swap (
+	&wgi->handshake_counting_end_ms, end_ms,
+	now_ms + (u64) (HANDSHAKE_COUNTING_INTERVAL * 1e3)))
+    clib_atomic_store_rel_n (&wgi->handshake_num, 0);
 
-  if (wgi->handshake_num >= num_until_under_load)
+  if (clib_atomic_add_fetch (&wgi->handshake_num, 1) >= num_until_under_load)
     {
-      wg_under_load_end = now + UNDER_LOAD_INTERVAL;
+      /* racing threads store about the same deadline, any of them do */
+      wgi->under_load_end = now + UNDER_LOAD_INTERVAL;
       return true;
     }
 
-  if (wg_under_load_end > now)
+  if (wgi->under_load_end > now)
     {
       return true;
     }
@@ -130,7 +255,7 @@ wg_if_is_under_load (vlib_main_t *vm, wg_if_t *wgi)
 static_always_inline void
 wg_if_dec_handshake_num (wg_if_t *wgi)
 {
-  wgi->handshake_num--;
+  clib_atomic_fetch_sub (&wgi->handshake_num, 1);
 }
 
 #endif
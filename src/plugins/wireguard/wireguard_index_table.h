@@ -18,16 +18,38 @@
 
 #include <vlib/vlib.h>
 #include <vppinfra/types.h>
+#include <vnet/dpo/dpo.h>
+#include <vppinfra/bihash_8_8.h>
+#include <vppinfra/bihash_template.h>
 
+#define WG_INDEX_TABLE_N_BUCKETS    (64 << 10)
+#define WG_INDEX_TABLE_MEMORY_SIZE  (64 << 20)
+
+/*
+ * Receiver index -> peer pool index.
+ *
+ * Backed by a bihash, so workers look indexes up without locks while
+ * handshakes add and drop them, and no worker barrier is needed.
+ */
 typedef struct
 {
-  uword *hash;
+  clib_bihash_8_8_t hash;
 } wg_index_table_t;
 
+void wg_index_table_init (wg_index_table_t *table);
 u32 wg_index_table_add (vlib_main_t *vm, wg_index_table_t *table,
 			u32 peer_pool_idx, u32 rnd_seed);
 void wg_index_table_del (vlib_main_t *vm, wg_index_table_t *table, u32 key);
-u32 *wg_index_table_lookup (const wg_index_table_t * table, u32 key);
+
+static_always_inline index_t
+wg_index_table_lookup (wg_index_table_t *table, u32 key)
+{
+  clib_bihash_kv_8_8_t kv = { .key = key };
+
+  if (clib_bihash_search_inline_8_8 (&table->hash, &kv))
+    return (INDEX_INVALID);
+  return (kv.value);
+}
 
 #endif //__included_wg_index_table_h__
 
@@ -21,6 +21,7 @@
 
 #include <wireguard/wireguard_send.h>
 #include <wireguard/wireguard_if.h>
+#include <vnet/gso/gro_func.h>
 
 #define foreach_wg_input_error                                                \
   _ (NONE, "No error")                                                        \
@@ -36,7 +37,9 @@
   _ (COOKIE_SEND, "Failed during sending Cookie")                             \
   _ (NO_BUFFERS, "No buffers")                                                \
   _ (UNDEFINED, "Undefined error")                                            \
-  _ (CRYPTO_ENGINE_ERROR, "crypto engine error (packet dropped)")
+  _ (CRYPTO_ENGINE_ERROR, "crypto engine error (packet dropped)")             \
+  _ (AWG_JUNK, "AWG junk packet dropped")                                     \
+  _ (AWG_I_HEADER, "AWG i-header packet dropped")
 
 typedef enum
 {
@@ -116,7 +119,6 @@ format_wg_input_post_trace (u8 *s, va_list *args)
 
 typedef enum
 {
-  WG_INPUT_NEXT_HANDOFF_HANDSHAKE,
   WG_INPUT_NEXT_HANDOFF_DATA,
   WG_INPUT_NEXT_IP4_INPUT,
   WG_INPUT_NEXT_IP6_INPUT,
@@ -131,18 +133,106 @@ is_ip4_header (u8 *data)
   return (data[0] >> 4) == 0x4;
 }
 
-static wg_input_error_t
-wg_handshake_process (vlib_main_t *vm, wg_main_t *wmp, vlib_buffer_t *b,
-		      u32 node_idx, u8 is_ip4)
+/*
+ * Remove the AWG header junk in front of a wireguard message. The outer
+ * ip/udp header is moved up against the message, since later stages find
+ * the sender's address and port relative to the current data pointer.
+ */
+static_always_inline void
+wg_input_awg_strip_junk (vlib_buffer_t *b, u32 junk_len, u8 is_ip4)
 {
+  u32 hdr_len =
+    is_ip4 ? sizeof (ip4_udp_header_t) : sizeof (ip6_udp_header_t);
+  u8 *cur = vlib_buffer_get_current (b);
+
+  clib_memmove (cur + junk_len - hdr_len, cur - hdr_len, hdr_len);
+  vlib_buffer_advance (b, junk_len);
+}
+
+/*
+ * What is left of a handshake once its DHs are done: installing the
+ * session, the peer's endpoint and timers and the packets in reply all
+ * belong to the main thread.
+ */
+typedef struct wg_handshake_done_args_t_
+{
+  index_t peeri;
+  u32 node_index;
+  message_type_t type;
+  ip46_address_t src_ip;
+  u16 src_port;
+  /* the response to send for an initiation, if it could be created */
+  message_handshake_response_t response;
+  u8 send_response;
+  /* our index of the handshake a response completes */
+  u32 local_index;
+} wg_handshake_done_args_t;
+
+static void
+wg_handshake_done (wg_handshake_done_args_t *a)
+{
+  vlib_main_t *vm = vlib_get_main ();
+  wg_peer_t *peer;
+
   ASSERT (vm->thread_index == 0);
 
+  /* the peer may have gone while the RPC was queued */
+  if (pool_is_free_index (wg_peer_pool, a->peeri))
+    return;
+  peer = wg_peer_get (a->peeri);
+  if (wg_peer_is_dead (peer))
+    return;
+
+  wg_peer_update_endpoint (a->peeri, &a->src_ip, a->src_port);
+
+  if (a->type == MESSAGE_HANDSHAKE_INITIATION)
+    {
+      if (a->send_response &&
+	  PREDICT_FALSE (!wg_send_handshake_response (vm, peer, &a->response)))
+	vlib_node_increment_counter (vm, a->node_index,
+				     WG_INPUT_ERROR_HANDSHAKE_SEND, 1);
+    }
+  else if (noise_remote_begin_session (vm, &peer->remote, a->local_index))
+    {
+      wg_peer_count_handshake (vm, a->peeri);
+      wg_timers_session_derived (peer);
+      wg_timers_handshake_complete (peer);
+      if (PREDICT_FALSE (!wg_send_keepalive (vm, peer)))
+	vlib_node_increment_counter (vm, a->node_index,
+				     WG_INPUT_ERROR_KEEPALIVE_SEND, 1);
+      else
+	wg_peer_update_flags (a->peeri, WG_PEER_ESTABLISHED, true);
+    }
+
+  wg_timers_any_authenticated_packet_received (peer);
+  wg_timers_any_authenticated_packet_traversal (peer);
+}
+
+static_always_inline void
+wg_handshake_done_any_thread (vlib_main_t *vm, wg_handshake_done_args_t *a)
+{
+  if (vm->thread_index == 0)
+    wg_handshake_done (a);
+  else
+    vlib_rpc_call_main_thread (wg_handshake_done, (u8 *) a, sizeof (*a));
+}
+
+/*
+ * Handshake messages are processed on the thread they arrive on: the
+ * MACs, cookies and the DHs of consuming a message and creating the
+ * response run here, and only wg_handshake_done goes to the main thread.
+ */
+static wg_input_error_t
+wg_handshake_process (vlib_main_t *vm, wg_main_t *wmp, vlib_buffer_t *b,
+		      u32 node_idx, message_type_t type, u8 is_ip4)
+{
   enum cookie_mac_state mac_state;
   bool packet_needs_cookie;
   bool under_load;
   index_t *wg_ifs;
   wg_if_t *wg_if;
   wg_peer_t *peer = NULL;
+  wg_handshake_done_args_t done = {};
 
   void *current_b_data = vlib_buffer_get_current (b);
 
@@ -164,16 +254,16 @@ wg_handshake_process (vlib_main_t *vm, wg_main_t *wmp, vlib_buffer_t *b,
   u16 udp_src_port = clib_host_to_net_u16 (uhd->src_port);
   u16 udp_dst_port = clib_host_to_net_u16 (uhd->dst_port);
 
-  message_header_t *header = current_b_data;
-
-  if (PREDICT_FALSE (header->type == MESSAGE_HANDSHAKE_COOKIE))
+  /* with AWG the header carries a magic value; the type is decoded by the
+   * caller, while the MACs still cover the header as received */
+  if (PREDICT_FALSE (type == MESSAGE_HANDSHAKE_COOKIE))
     {
       message_handshake_cookie_t *packet =
 	(message_handshake_cookie_t *) current_b_data;
-      u32 *entry =
+      index_t peeri =
 	wg_index_table_lookup (&wmp->index_table, packet->receiver_index);
-      if (entry)
-	peer = wg_peer_get (*entry);
+      if (peeri != INDEX_INVALID)
+	peer = wg_peer_get (peeri);
       else
 	return WG_INPUT_ERROR_PEER;
 
@@ -184,7 +274,7 @@ wg_handshake_process (vlib_main_t *vm, wg_main_t *wmp, vlib_buffer_t *b,
       return WG_INPUT_ERROR_NONE;
     }
 
-  u32 len = (header->type == MESSAGE_HANDSHAKE_INITIATION ?
+  u32 len = (type == MESSAGE_HANDSHAKE_INITIATION ?
 	     sizeof (message_handshake_initiation_t) :
 	     sizeof (message_handshake_response_t));
 
@@ -228,7 +318,7 @@ wg_handshake_process (vlib_main_t *vm, wg_main_t *wmp, vlib_buffer_t *b,
   else
     return WG_INPUT_ERROR_HANDSHAKE_MAC;
 
-  switch (header->type)
+  switch (type)
     {
     case MESSAGE_HANDSHAKE_INITIATION:
       {
@@ -240,7 +330,9 @@ wg_handshake_process (vlib_main_t *vm, wg_main_t *wmp, vlib_buffer_t *b,
 	    if (!wg_send_handshake_cookie (vm, message->sender_index,
 					   &wg_if->cookie_checker, macs,
 					   &ip_addr_46 (&wg_if->src_ip),
-					   wg_if->port, &src_ip, udp_src_port))
+					   wg_if->port, &src_ip, udp_src_port,
+					   wg_if_awg_cfg_by_magic (
+					     wg_if, message->header.type)))
 	      return WG_INPUT_ERROR_COOKIE_SEND;
 
 	    return WG_INPUT_ERROR_NONE;
@@ -259,13 +351,13 @@ wg_handshake_process (vlib_main_t *vm, wg_main_t *wmp, vlib_buffer_t *b,
 	    return WG_INPUT_ERROR_PEER;
 	  }
 
-	wg_peer_update_endpoint (rp->r_peer_idx, &src_ip, udp_src_port);
-
-	if (PREDICT_FALSE (!wg_send_handshake_response (vm, peer)))
-	  {
-	    vlib_node_increment_counter (vm, node_idx,
-					 WG_INPUT_ERROR_HANDSHAKE_SEND, 1);
-	  }
+	/* the endpoint and timers are updated even without a response */
+	done.peeri = rp->r_peer_idx;
+	done.send_response =
+	  wg_create_handshake_response (vm, peer, &done.response);
+	if (PREDICT_FALSE (!done.send_response))
+	  vlib_node_increment_counter (vm, node_idx,
+				       WG_INPUT_ERROR_HANDSHAKE_SEND, 1);
 	break;
       }
     case MESSAGE_HANDSHAKE_RESPONSE:
@@ -277,19 +369,19 @@ wg_handshake_process (vlib_main_t *vm, wg_main_t *wmp, vlib_buffer_t *b,
 	    if (!wg_send_handshake_cookie (vm, resp->sender_index,
 					   &wg_if->cookie_checker, macs,
 					   &ip_addr_46 (&wg_if->src_ip),
-					   wg_if->port, &src_ip, udp_src_port))
+					   wg_if->port, &src_ip, udp_src_port,
+					   wg_if_awg_cfg_by_magic (
+					     wg_if, resp->header.type)))
 	      return WG_INPUT_ERROR_COOKIE_SEND;
 
 	    return WG_INPUT_ERROR_NONE;
 	  }
 
-	index_t peeri = INDEX_INVALID;
-	u32 *entry =
+	index_t peeri =
 	  wg_index_table_lookup (&wmp->index_table, resp->receiver_index);
 
-	if (PREDICT_TRUE (entry != NULL))
+	if (PREDICT_TRUE (peeri != INDEX_INVALID))
 	  {
-	    peeri = *entry;
 	    peer = wg_peer_get (peeri);
 	    if (wg_peer_is_dead (peer))
 	      return WG_INPUT_ERROR_PEER;
@@ -305,31 +397,19 @@ wg_handshake_process (vlib_main_t *vm, wg_main_t *wmp, vlib_buffer_t *b,
 	    return WG_INPUT_ERROR_PEER;
 	  }
 
-	wg_peer_update_endpoint (peeri, &src_ip, udp_src_port);
-
-	if (noise_remote_begin_session (vm, &peer->remote))
-	  {
-
-	    wg_timers_session_derived (peer);
-	    wg_timers_handshake_complete (peer);
-	    if (PREDICT_FALSE (!wg_send_keepalive (vm, peer)))
-	      {
-		vlib_node_increment_counter (vm, node_idx,
-					     WG_INPUT_ERROR_KEEPALIVE_SEND, 1);
-	      }
-	    else
-	      {
-		wg_peer_update_flags (peeri, WG_PEER_ESTABLISHED, true);
-	      }
-	  }
+	done.peeri = peeri;
+	done.local_index = resp->receiver_index;
 	break;
       }
     default:
       return WG_INPUT_ERROR_HANDSHAKE_RECEIVE;
     }
 
-  wg_timers_any_authenticated_packet_received (peer);
-  wg_timers_any_authenticated_packet_traversal (peer);
+  done.node_index = node_idx;
+  done.type = type;
+  done.src_ip = src_ip;
+  done.src_port = udp_src_port;
+  wg_handshake_done_any_thread (vm, &done);
   return WG_INPUT_ERROR_NONE;
 }
 
@@ -346,7 +426,7 @@ wg_input_post_process (vlib_main_t *vm, vlib_buffer_t *b, u16 *next,
       NULL)
     return -1;
 
-  if (!noise_counter_recv (&kp->kp_ctr, data->counter))
+  if (!noise_keypair_counter_recv (kp, data->counter))
     {
       return -1;
     }
@@ -411,6 +491,20 @@ wg_input_post_process (vlib_main_t *vm, vlib_buffer_t *b, u16 *next,
   return 0;
 }
 
+/* The data message is still in place, its receiver index finds the peer */
+static_always_inline void
+wg_input_count_decrypt_failure (vlib_main_t *vm, vlib_buffer_t *b)
+{
+  message_data_t *data = vlib_buffer_get_current (b);
+  index_t peeri =
+    wg_index_table_lookup (&wg_main.index_table, data->receiver_index);
+
+  if (peeri != INDEX_INVALID)
+    vlib_increment_simple_counter (
+      &wg_peer_counters[WG_PEER_COUNTER_DECRYPT_FAILURES], vm->thread_index,
+      peeri, 1);
+}
+
 static_always_inline void
 wg_input_process_ops (vlib_main_t *vm, vlib_node_runtime_t *node,
 		      vnet_crypto_op_t *ops, vlib_buffer_t *b[], u16 *nexts,
@@ -433,6 +527,7 @@ wg_input_process_ops (vlib_main_t *vm, vlib_node_runtime_t *node,
 	  u32 bi = op->user_data;
 	  b[bi]->error = node->errors[WG_INPUT_ERROR_DECRYPTION];
 	  nexts[bi] = drop_next;
+	  wg_input_count_decrypt_failure (vm, b[bi]);
 	  n_fail--;
 	}
       op++;
@@ -462,6 +557,7 @@ wg_input_process_chained_ops (vlib_main_t *vm, vlib_node_runtime_t *node,
 	  u32 bi = op->user_data;
 	  b[bi]->error = node->errors[WG_INPUT_ERROR_DECRYPTION];
 	  nexts[bi] = drop_next;
+	  wg_input_count_decrypt_failure (vm, b[bi]);
 	  n_fail--;
 	}
       op++;
@@ -636,7 +732,11 @@ wg_input_process (vlib_main_t *vm, wg_per_thread_data_t *ptd,
       clib_rwlock_writer_lock (&r->r_keypair_lock);
       if (kp == r->r_next && kp->kp_local_index == r_idx)
 	{
-	  noise_remote_keypair_free (vm, r, &r->r_previous);
+	  /* other workers may be decrypting with a multi-queue keypair */
+	  if (r->r_previous && noise_keypair_is_multi_queue (r->r_previous))
+	    noise_remote_keypair_free_from_mt (r, r->r_previous);
+	  else
+	    noise_remote_keypair_free (vm, r, &r->r_previous);
 	  r->r_previous = r->r_current;
 	  r->r_current = r->r_next;
 	  r->r_next = NULL;
@@ -684,6 +784,160 @@ wg_find_outer_addr_port (vlib_buffer_t *b, ip46_address_t *addr, u16 *port,
     }
 }
 
+/* a handshake message waiting for its mac1 check */
+typedef struct
+{
+  vlib_buffer_t *b;
+  void *msg;
+  u16 len;
+  u16 port;
+  u16 slot;
+  message_type_t type;
+  u32 junk;
+} wg_input_mac1_t;
+
+/*
+ * The mac1 of a handshake message needs no state, so check it for all of
+ * a frame's initiations and responses first, four messages at a time,
+ * and spend no DH on floods with bad MACs.
+ */
+static_always_inline void
+wg_input_check_mac1 (vlib_node_runtime_t *node, wg_input_mac1_t *hs,
+		     u32 n_hs, u16 *nexts)
+{
+  u8 done[VLIB_FRAME_SIZE] = { 0 };
+  bool valid[VLIB_FRAME_SIZE];
+  u16 grp[VLIB_FRAME_SIZE], pend[VLIB_FRAME_SIZE];
+  u32 i, j, n_grp, n_pend;
+  index_t *wg_ifs, *ii;
+
+  for (i = 0; i < n_hs; i++)
+    {
+      if (done[i])
+	continue;
+
+      /* messages of one type on one port share the candidate keys */
+      n_grp = 0;
+      for (j = i; j < n_hs; j++)
+	if (!done[j] && hs[j].port == hs[i].port && hs[j].len == hs[i].len)
+	  {
+	    done[j] = 1;
+	    valid[j] = false;
+	    grp[n_grp++] = j;
+	  }
+
+      /* wg_handshake_process accounts for an unknown port */
+      wg_ifs = wg_if_indexes_get_by_port (hs[i].port);
+      if (NULL == wg_ifs)
+	continue;
+
+      vec_foreach (ii, wg_ifs)
+	{
+	  cookie_checker_t *cc = &wg_if_get (*ii)->cookie_checker;
+
+	  n_pend = 0;
+	  for (j = 0; j < n_grp; j++)
+	    if (!valid[grp[j]])
+	      pend[n_pend++] = grp[j];
+
+	  for (j = 0; j + 4 <= n_pend; j += 4)
+	    {
+	      void *msgs[4] = { hs[pend[j]].msg, hs[pend[j + 1]].msg,
+				hs[pend[j + 2]].msg, hs[pend[j + 3]].msg };
+	      bool ok[4];
+
+	      cookie_checker_validate_mac1_x4 (cc, msgs, hs[i].len, ok);
+	      valid[pend[j]] = ok[0];
+	      valid[pend[j + 1]] = ok[1];
+	      valid[pend[j + 2]] = ok[2];
+	      valid[pend[j + 3]] = ok[3];
+	    }
+	  for (; j < n_pend; j++)
+	    valid[pend[j]] =
+	      cookie_checker_validate_mac1 (cc, hs[pend[j]].msg, hs[i].len);
+	}
+
+      for (j = 0; j < n_grp; j++)
+	if (!valid[grp[j]])
+	  {
+	    wg_input_mac1_t *h = &hs[grp[j]];
+
+	    nexts[h->slot] = WG_INPUT_NEXT_ERROR;
+	    h->b->error = node->errors[WG_INPUT_ERROR_HANDSHAKE_MAC];
+	  }
+    }
+}
+
+static_always_inline u16
+wg_input_gro_next (vlib_main_t *vm, u32 bi)
+{
+  vlib_buffer_t *b = vlib_get_buffer (vm, bi);
+
+  return is_ip4_header (vlib_buffer_get_current (b)) ?
+	   WG_INPUT_NEXT_IP4_INPUT :
+	   WG_INPUT_NEXT_IP6_INPUT;
+}
+
+/*
+ * Coalesce decrypted TCP segments of the same flow into GSO buffers before
+ * they reach ip4-input/ip6-input. All flows are flushed at the end of the
+ * frame, so nothing is held back across dispatches. bis/nexts are rewritten
+ * in place; returns the new number of buffers.
+ */
+static_always_inline u32
+wg_input_gro (vlib_main_t *vm, vlib_node_runtime_t *node,
+	      wg_per_thread_data_t *ptd, u32 *bis, u16 *nexts, u32 n_left)
+{
+  gro_flow_table_t *ft;
+  u32 i, j, n_to, n = 0;
+  u32 to[2];
+
+  if (PREDICT_FALSE (!ptd->gro_flow_table))
+    gro_flow_table_init (&ptd->gro_flow_table, 0 /* is_l2 */,
+			 node->node_index);
+  if (PREDICT_FALSE (!(ft = ptd->gro_flow_table)))
+    return n_left;
+
+  for (i = 0; i < n_left; i++)
+    {
+      if (nexts[i] != WG_INPUT_NEXT_IP4_INPUT &&
+	  nexts[i] != WG_INPUT_NEXT_IP6_INPUT)
+	{
+	  bis[n] = bis[i];
+	  nexts[n] = nexts[i];
+	  n++;
+	  continue;
+	}
+
+      /* held buffers are not returned, so n never overtakes i */
+      n_to = vnet_gro_flow_table_inline (vm, ft, bis[i], to);
+      for (j = 0; j < n_to; j++)
+	{
+	  bis[n] = to[j];
+	  nexts[n] = wg_input_gro_next (vm, to[j]);
+	  n++;
+	}
+    }
+
+  for (i = 0; ft->flow_table_size && i < GRO_FLOW_TABLE_MAX_SIZE; i++)
+    {
+      gro_flow_t *flow = &ft->gro_flow[i];
+
+      if (!flow->n_buffers)
+	continue;
+
+      if (flow->n_buffers > 1)
+	gro_fixup_header (vm, vlib_get_buffer (vm, flow->buffer_index),
+			  flow->last_ack_number, 0 /* is_l2 */);
+      bis[n] = flow->buffer_index;
+      nexts[n] = wg_input_gro_next (vm, flow->buffer_index);
+      n++;
+      gro_flow_table_reset_flow (ft, flow);
+    }
+
+  return n;
+}
+
 always_inline uword
 wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 		 vlib_frame_t *frame, u8 is_ip4, u16 async_next_node)
@@ -708,6 +962,8 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
   u16 other_nexts[VLIB_FRAME_SIZE], *other_next = other_nexts, n_other = 0;
   u16 data_nexts[VLIB_FRAME_SIZE], *data_next = data_nexts, n_data = 0;
   u16 n_async = 0;
+  wg_input_mac1_t hs[VLIB_FRAME_SIZE];
+  u32 n_hs = 0, i;
   const u8 is_async = wg_op_mode_is_set_ASYNC ();
   vnet_crypto_async_frame_t *async_frame = NULL;
 
@@ -720,13 +976,19 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
   f64 time = clib_time_now (&vm->clib_time) + vm->time_offset;
 
   wg_peer_t *peer = NULL;
-  u32 *last_peer_time_idx = NULL;
+  index_t last_peer_time_idx = INDEX_INVALID;
   u32 last_rec_idx = ~0;
 
   bool is_keepalive = false;
-  u32 *peer_idx = NULL;
+  index_t peer_idx = INDEX_INVALID;
   index_t peeri = INDEX_INVALID;
 
+  /* AWG decode state, resolved by UDP port and cached across the frame */
+  const u8 awg_active = wg_if_n_awg_enabled != 0;
+  wg_if_t *awg_if = NULL;
+  u32 awg_port = ~0;
+  u32 awg_junk;
+
   while (n_left_from > 0)
     {
       if (n_left_from > 2)
@@ -744,23 +1006,58 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 
       header_type =
 	((message_header_t *) vlib_buffer_get_current (b[0]))->type;
+      awg_junk = 0;
+
+      if (PREDICT_FALSE (awg_active))
+	{
+	  udp_header_t *uh =
+	    vlib_buffer_get_current (b[0]) - sizeof (udp_header_t);
+	  u16 port = clib_net_to_host_u16 (uh->dst_port);
+
+	  if (port != awg_port)
+	    {
+	      awg_if = wg_if_awg_get_by_port (port);
+	      awg_port = port;
+	    }
+
+	  if (awg_if)
+	    {
+	      u32 len = vlib_buffer_length_in_chain (vm, b[0]);
+
+	      header_type =
+		wg_if_awg_decode (awg_if, vlib_buffer_get_current (b[0]), len,
+				  b[0]->current_length, &awg_junk);
+
+	      if (PREDICT_FALSE (header_type == MESSAGE_INVALID))
+		{
+		  /* junk packets and i-headers carry no payload for us */
+		  other_next[n_other] = WG_INPUT_NEXT_ERROR;
+		  b[0]->error =
+		    node->errors[wg_awg_is_i_header_len (&awg_if->awg_cfg,
+							 len) ?
+				   WG_INPUT_ERROR_AWG_I_HEADER :
+				   WG_INPUT_ERROR_AWG_JUNK];
+		  other_bi[n_other] = from[b - bufs];
+		  n_other += 1;
+		  goto out;
+		}
+	    }
+	}
 
       if (PREDICT_TRUE (header_type == MESSAGE_DATA))
 	{
-	  message_data_t *data = vlib_buffer_get_current (b[0]);
+	  message_data_t *data = vlib_buffer_get_current (b[0]) + awg_junk;
 	  u8 *iv_data = b[0]->pre_data;
 	  u32 buf_idx = from[b - bufs];
 	  u32 n_bufs;
-	  peer_idx = wg_index_table_lookup (&wmp->index_table,
-					    data->receiver_index);
 
 	  if (data->receiver_index != last_rec_idx)
 	    {
 	      peer_idx = wg_index_table_lookup (&wmp->index_table,
 						data->receiver_index);
-	      if (PREDICT_TRUE (peer_idx != NULL))
+	      if (PREDICT_TRUE (peer_idx != INDEX_INVALID))
 		{
-		  peeri = *peer_idx;
+		  peeri = peer_idx;
 		  peer = wg_peer_get (peeri);
 		  last_rec_idx = data->receiver_index;
 		}
@@ -771,7 +1068,7 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 		}
 	    }
 
-	  if (PREDICT_FALSE (!peer_idx))
+	  if (PREDICT_FALSE (peer_idx == INDEX_INVALID))
 	    {
 	      other_next[n_other] = WG_INPUT_NEXT_ERROR;
 	      b[0]->error = node->errors[WG_INPUT_ERROR_PEER];
@@ -785,11 +1082,16 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	      /* this is the first packet to use this peer, claim the peer
 	       * for this thread.
 	       */
-	      clib_atomic_cmp_and_swap (&peer->input_thread_index, ~0,
-					wg_peer_assign_thread (thread_index));
+	      u32 ti = wg_peer_assign_thread (thread_index);
+
+	      if (~0 == clib_atomic_cmp_and_swap (&peer->input_thread_index,
+						  ~0, ti))
+		wg_timers_bind_thread (peer, ti);
 	    }
 
-	  if (PREDICT_TRUE (thread_index != peer->input_thread_index))
+	  if (PREDICT_TRUE (thread_index !=
+			    wg_peer_input_thread (peer, data->receiver_index,
+						  data->counter)))
 	    {
 	      other_next[n_other] = WG_INPUT_NEXT_HANDOFF_DATA;
 	      other_bi[n_other] = buf_idx;
@@ -797,6 +1099,14 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	      goto next;
 	    }
 
+	  /* the owning thread decodes again, so strip the junk only here */
+	  if (PREDICT_FALSE (awg_junk))
+	    {
+	      wg_input_awg_strip_junk (b[0], awg_junk, is_ip4);
+	      data = vlib_buffer_get_current (b[0]);
+	      data->header.type = MESSAGE_DATA;
+	    }
+
 	  lb = b[0];
 	  n_bufs = vlib_buffer_chain_linearize (vm, b[0]);
 	  if (n_bufs == 0)
@@ -857,7 +1167,10 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 
 	  if (PREDICT_FALSE (state_cr == SC_FAILED))
 	    {
-	      wg_peer_update_flags (*peer_idx, WG_PEER_ESTABLISHED, false);
+	      vlib_increment_simple_counter (
+		&wg_peer_counters[WG_PEER_COUNTER_DECRYPT_FAILURES],
+		thread_index, peer_idx, 1);
+	      wg_peer_update_flags (peer_idx, WG_PEER_ESTABLISHED, false);
 	      other_next[n_other] = WG_INPUT_NEXT_ERROR;
 	      b[0]->error = node->errors[WG_INPUT_ERROR_DECRYPTION];
 	      other_bi[n_other] = buf_idx;
@@ -890,17 +1203,37 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	}
       else
 	{
-	  /* Handshake packets should be processed in main thread */
-	  if (thread_index != 0)
+	  u16 len = header_type == MESSAGE_HANDSHAKE_INITIATION ?
+		      sizeof (message_handshake_initiation_t) :
+		      sizeof (message_handshake_response_t);
+
+	  /* initiations and responses wait for the frame's mac1 check */
+	  if ((header_type == MESSAGE_HANDSHAKE_INITIATION ||
+	       header_type == MESSAGE_HANDSHAKE_RESPONSE) &&
+	      b[0]->current_length >= awg_junk + len)
 	    {
-	      other_next[n_other] = WG_INPUT_NEXT_HANDOFF_HANDSHAKE;
+	      udp_header_t *uh =
+		vlib_buffer_get_current (b[0]) - sizeof (udp_header_t);
+
+	      hs[n_hs].b = b[0];
+	      hs[n_hs].msg = vlib_buffer_get_current (b[0]) + awg_junk;
+	      hs[n_hs].len = len;
+	      hs[n_hs].port = clib_net_to_host_u16 (uh->dst_port);
+	      hs[n_hs].slot = n_other;
+	      hs[n_hs].type = header_type;
+	      hs[n_hs].junk = awg_junk;
+	      n_hs++;
+
 	      other_bi[n_other] = from[b - bufs];
 	      n_other += 1;
-	      goto next;
+	      goto out;
 	    }
 
-	  wg_input_error_t ret =
-	    wg_handshake_process (vm, wmp, b[0], node->node_index, is_ip4);
+	  if (PREDICT_FALSE (awg_junk))
+	    wg_input_awg_strip_junk (b[0], awg_junk, is_ip4);
+
+	  wg_input_error_t ret = wg_handshake_process (
+	    vm, wmp, b[0], node->node_index, header_type, is_ip4);
 	  if (ret != WG_INPUT_ERROR_NONE)
 	    {
 	      other_next[n_other] = WG_INPUT_NEXT_ERROR;
@@ -923,7 +1256,7 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	  t->type = header_type;
 	  t->current_length = b[0]->current_length;
 	  t->is_keepalive = is_keepalive;
-	  t->peer = peer_idx ? peeri : INDEX_INVALID;
+	  t->peer = peer_idx;
 	}
 
     next:
@@ -931,6 +1264,31 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
       b += 1;
     }
 
+  if (n_hs)
+    {
+      wg_input_check_mac1 (node, hs, n_hs, other_nexts);
+
+      for (i = 0; i < n_hs; i++)
+	{
+	  wg_input_mac1_t *h = &hs[i];
+	  wg_input_error_t ret;
+
+	  if (other_nexts[h->slot] == WG_INPUT_NEXT_ERROR)
+	    continue;
+
+	  if (PREDICT_FALSE (h->junk))
+	    wg_input_awg_strip_junk (h->b, h->junk, is_ip4);
+
+	  ret = wg_handshake_process (vm, wmp, h->b, node->node_index,
+				      h->type, is_ip4);
+	  if (ret != WG_INPUT_ERROR_NONE)
+	    {
+	      other_nexts[h->slot] = WG_INPUT_NEXT_ERROR;
+	      h->b->error = node->errors[ret];
+	    }
+	}
+    }
+
   /* decrypt packets */
   wg_input_process_ops (vm, node, ptd->crypto_ops, data_bufs, data_nexts,
 			drop_next);
@@ -941,12 +1299,12 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
   b = data_bufs;
   n_left_from = n_data;
   last_rec_idx = ~0;
-  last_peer_time_idx = NULL;
+  last_peer_time_idx = INDEX_INVALID;
 
   while (n_left_from > 0)
     {
       bool is_keepalive = false;
-      u32 *peer_idx = NULL;
+      index_t peer_idx = INDEX_INVALID;
 
       if (PREDICT_FALSE (data_next[0] == WG_INPUT_NEXT_PUNT))
 	{
@@ -972,9 +1330,9 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	{
 	  peer_idx =
 	    wg_index_table_lookup (&wmp->index_table, data->receiver_index);
-	  if (PREDICT_TRUE (peer_idx != NULL))
+	  if (PREDICT_TRUE (peer_idx != INDEX_INVALID))
 	    {
-	      peeri = *peer_idx;
+	      peeri = peer_idx;
 	      peer = wg_peer_get (peeri);
 	      last_rec_idx = data->receiver_index;
 	    }
@@ -997,7 +1355,8 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	  goto trace;
 	}
 
-      if (PREDICT_FALSE (peer_idx && (last_peer_time_idx != peer_idx)))
+      if (PREDICT_FALSE (peer_idx != INDEX_INVALID &&
+			 last_peer_time_idx != peer_idx))
 	{
 	  if (PREDICT_FALSE (
 		!ip46_address_is_equal (&peer->dst.addr, &out_src_ip) ||
@@ -1006,7 +1365,7 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 					     out_udp_src_port);
 	  wg_timers_any_authenticated_packet_received_opt (peer, time);
 	  wg_timers_any_authenticated_packet_traversal (peer);
-	  wg_peer_update_flags (*peer_idx, WG_PEER_ESTABLISHED, true);
+	  wg_peer_update_flags (peer_idx, WG_PEER_ESTABLISHED, true);
 	  last_peer_time_idx = peer_idx;
 	}
 
@@ -1014,6 +1373,9 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 					 VNET_INTERFACE_COUNTER_RX,
 				       vm->thread_index, peer->wg_sw_if_index,
 				       1 /* packets */, b[0]->current_length);
+      vlib_increment_combined_counter (&wg_peer_rx_counters, vm->thread_index,
+				       peeri, 1 /* packets */,
+				       b[0]->current_length);
 
     trace:
       if (PREDICT_FALSE ((node->flags & VLIB_NODE_FLAG_TRACE) &&
@@ -1023,7 +1385,7 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	  t->type = header_type;
 	  t->current_length = b[0]->current_length;
 	  t->is_keepalive = is_keepalive;
-	  t->peer = peer_idx ? peeri : INDEX_INVALID;
+	  t->peer = peer_idx;
 	}
 
       b += 1;
@@ -1066,7 +1428,11 @@ wg_input_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 
   /* enqueue data bufs */
   if (n_data)
-    vlib_buffer_enqueue_to_next (vm, node, data_bi, data_nexts, n_data);
+    {
+      if (wg_op_mode_is_set_GRO ())
+	n_data = wg_input_gro (vm, node, ptd, data_bi, data_nexts, n_data);
+      vlib_buffer_enqueue_to_next (vm, node, data_bi, data_nexts, n_data);
+    }
 
   return frame->n_vectors;
 }
@@ -1083,8 +1449,8 @@ wg_input_post (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame,
   u32 *from = vlib_frame_vector_args (frame);
   u32 n_left = frame->n_vectors;
   wg_peer_t *peer = NULL;
-  u32 *peer_idx = NULL;
-  u32 *last_peer_time_idx = NULL;
+  index_t peer_idx = INDEX_INVALID;
+  index_t last_peer_time_idx = INDEX_INVALID;
   index_t peeri = INDEX_INVALID;
   u32 last_rec_idx = ~0;
   f64 time = clib_time_now (&vm->clib_time) + vm->time_offset;
@@ -1119,9 +1485,9 @@ wg_input_post (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame,
 	  peer_idx =
 	    wg_index_table_lookup (&wmp->index_table, data->receiver_index);
 
-	  if (PREDICT_TRUE (peer_idx != NULL))
+	  if (PREDICT_TRUE (peer_idx != INDEX_INVALID))
 	    {
-	      peeri = *peer_idx;
+	      peeri = peer_idx;
 	      peer = wg_peer_get (peeri);
 	      last_rec_idx = data->receiver_index;
 	    }
@@ -1144,7 +1510,8 @@ wg_input_post (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame,
 	  goto trace;
 	}
 
-      if (PREDICT_FALSE (peer_idx && (last_peer_time_idx != peer_idx)))
+      if (PREDICT_FALSE (peer_idx != INDEX_INVALID &&
+			 last_peer_time_idx != peer_idx))
 	{
 	  if (PREDICT_FALSE (
 		!ip46_address_is_equal (&peer->dst.addr, &out_src_ip) ||
@@ -1153,7 +1520,7 @@ wg_input_post (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame,
 					     out_udp_src_port);
 	  wg_timers_any_authenticated_packet_received_opt (peer, time);
 	  wg_timers_any_authenticated_packet_traversal (peer);
-	  wg_peer_update_flags (*peer_idx, WG_PEER_ESTABLISHED, true);
+	  wg_peer_update_flags (peer_idx, WG_PEER_ESTABLISHED, true);
 	  last_peer_time_idx = peer_idx;
 	}
 
@@ -1161,6 +1528,9 @@ wg_input_post (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame,
 					 VNET_INTERFACE_COUNTER_RX,
 				       vm->thread_index, peer->wg_sw_if_index,
 				       1 /* packets */, b[0]->current_length);
+      vlib_increment_combined_counter (&wg_peer_rx_counters, vm->thread_index,
+				       peeri, 1 /* packets */,
+				       b[0]->current_length);
 
     trace:
       if (PREDICT_FALSE ((node->flags & VLIB_NODE_FLAG_TRACE) &&
@@ -1169,7 +1539,7 @@ wg_input_post (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame,
 	  wg_input_post_trace_t *t =
 	    vlib_add_trace (vm, node, b[0], sizeof (*t));
 	  t->next = next[0];
-	  t->peer = peer_idx ? peeri : INDEX_INVALID;
+	  t->peer = peer_idx;
 	}
 
       b += 1;
@@ -1177,7 +1547,19 @@ wg_input_post (vlib_main_t *vm, vlib_node_runtime_t *node, vlib_frame_t *frame,
       n_left -= 1;
     }
 
-  vlib_buffer_enqueue_to_next (vm, node, from, nexts, frame->n_vectors);
+  if (wg_op_mode_is_set_GRO ())
+    {
+      wg_per_thread_data_t *ptd =
+	vec_elt_at_index (wmp->per_thread_data, vm->thread_index);
+      u32 bis[VLIB_FRAME_SIZE];
+
+      clib_memcpy_fast (bis, from, frame->n_vectors * sizeof (bis[0]));
+      n_left = wg_input_gro (vm, node, ptd, bis, nexts, frame->n_vectors);
+      vlib_buffer_enqueue_to_next (vm, node, bis, nexts, n_left);
+    }
+  else
+    vlib_buffer_enqueue_to_next (vm, node, from, nexts, frame->n_vectors);
+
   return frame->n_vectors;
 }
 
@@ -1218,7 +1600,6 @@ VLIB_REGISTER_NODE (wg4_input_node) =
   .n_next_nodes = WG_INPUT_N_NEXT,
   /* edit / add dispositions here */
   .next_nodes = {
-        [WG_INPUT_NEXT_HANDOFF_HANDSHAKE] = "wg4-handshake-handoff",
         [WG_INPUT_NEXT_HANDOFF_DATA] = "wg4-input-data-handoff",
         [WG_INPUT_NEXT_IP4_INPUT] = "ip4-input-no-checksum",
         [WG_INPUT_NEXT_IP6_INPUT] = "ip6-input",
@@ -1238,7 +1619,6 @@ VLIB_REGISTER_NODE (wg6_input_node) =
   .n_next_nodes = WG_INPUT_N_NEXT,
   /* edit / add dispositions here */
   .next_nodes = {
-        [WG_INPUT_NEXT_HANDOFF_HANDSHAKE] = "wg6-handshake-handoff",
         [WG_INPUT_NEXT_HANDOFF_DATA] = "wg6-input-data-handoff",
         [WG_INPUT_NEXT_IP4_INPUT] = "ip4-input-no-checksum",
         [WG_INPUT_NEXT_IP6_INPUT] = "ip6-input",
@@ -15,88 +15,317 @@
 
 #include <wireguard/wireguard_key.h>
 #include <openssl/evp.h>
+#include <openssl/rand.h>
 
-bool
-curve25519_gen_shared (u8 shared_key[CURVE25519_KEY_SIZE],
-		       const u8 secret_key[CURVE25519_KEY_SIZE],
-		       const u8 basepoint[CURVE25519_KEY_SIZE])
+/*
+ * X25519 (RFC 7748) over GF(2^255 - 19), with field elements held in five
+ * 51 bit limbs. Everything lives on the stack, so a DH costs no
+ * allocations, and the ladder is constant time.
+ */
+typedef u64 fe25519[5];
+
+#define FE25519_MASK ((1ULL << 51) - 1)
+
+static_always_inline u64
+fe25519_load64 (const u8 *s)
 {
+  return clib_little_to_host_u64 (clib_mem_unaligned (s, u64));
+}
 
-  bool ret;
-  EVP_PKEY_CTX *ctx;
-  size_t key_len;
+static_always_inline void
+fe25519_store64 (u8 *s, u64 v)
+{
+  clib_mem_unaligned (s, u64) = clib_host_to_little_u64 (v);
+}
 
-  EVP_PKEY *peerkey = NULL;
-  EVP_PKEY *pkey =
-    EVP_PKEY_new_raw_private_key (EVP_PKEY_X25519, NULL, secret_key,
-				  CURVE25519_KEY_SIZE);
+static_always_inline void
+fe25519_from_bytes (fe25519 h, const u8 s[CURVE25519_KEY_SIZE])
+{
+  h[0] = fe25519_load64 (s) & FE25519_MASK;
+  h[1] = (fe25519_load64 (s + 6) >> 3) & FE25519_MASK;
+  h[2] = (fe25519_load64 (s + 12) >> 6) & FE25519_MASK;
+  h[3] = (fe25519_load64 (s + 19) >> 1) & FE25519_MASK;
+  h[4] = (fe25519_load64 (s + 24) >> 12) & FE25519_MASK;
+}
 
-  ret = true;
+static_always_inline void
+fe25519_carry (fe25519 h)
+{
+  h[1] += h[0] >> 51;
+  h[0] &= FE25519_MASK;
+  h[2] += h[1] >> 51;
+  h[1] &= FE25519_MASK;
+  h[3] += h[2] >> 51;
+  h[2] &= FE25519_MASK;
+  h[4] += h[3] >> 51;
+  h[3] &= FE25519_MASK;
+  h[0] += 19 * (h[4] >> 51);
+  h[4] &= FE25519_MASK;
+}
 
-  ctx = EVP_PKEY_CTX_new (pkey, NULL);
-  if (EVP_PKEY_derive_init (ctx) <= 0)
-    {
-      ret = false;
-      goto out;
-    }
+static void
+fe25519_to_bytes (u8 s[CURVE25519_KEY_SIZE], const fe25519 f)
+{
+  fe25519 h = { f[0], f[1], f[2], f[3], f[4] };
+
+  fe25519_carry (h);
+  fe25519_carry (h);
+
+  /* h is now below 2^255; add 19 and 2^255 - 19 limb-wise and drop the
+   * carry out of bit 255, which subtracts p exactly when h >= p */
+  h[0] += 19;
+  fe25519_carry (h);
+  h[0] += (1ULL << 51) - 19;
+  h[1] += (1ULL << 51) - 1;
+  h[2] += (1ULL << 51) - 1;
+  h[3] += (1ULL << 51) - 1;
+  h[4] += (1ULL << 51) - 1;
+  h[1] += h[0] >> 51;
+  h[0] &= FE25519_MASK;
+  h[2] += h[1] >> 51;
+  h[1] &= FE25519_MASK;
+  h[3] += h[2] >> 51;
+  h[2] &= FE25519_MASK;
+  h[4] += h[3] >> 51;
+  h[3] &= FE25519_MASK;
+  h[4] &= FE25519_MASK;
+
+  fe25519_store64 (s, h[0] | (h[1] << 51));
+  fe25519_store64 (s + 8, (h[1] >> 13) | (h[2] << 38));
+  fe25519_store64 (s + 16, (h[2] >> 26) | (h[3] << 25));
+  fe25519_store64 (s + 24, (h[3] >> 39) | (h[4] << 12));
+}
+
+static_always_inline void
+fe25519_add (fe25519 h, const fe25519 f, const fe25519 g)
+{
+  h[0] = f[0] + g[0];
+  h[1] = f[1] + g[1];
+  h[2] = f[2] + g[2];
+  h[3] = f[3] + g[3];
+  h[4] = f[4] + g[4];
+}
+
+static_always_inline void
+fe25519_sub (fe25519 h, const fe25519 f, const fe25519 g)
+{
+  /* add 2p so that no limb goes negative */
+  h[0] = f[0] + 0xfffffffffffdaULL - g[0];
+  h[1] = f[1] + 0xffffffffffffeULL - g[1];
+  h[2] = f[2] + 0xffffffffffffeULL - g[2];
+  h[3] = f[3] + 0xffffffffffffeULL - g[3];
+  h[4] = f[4] + 0xffffffffffffeULL - g[4];
+  fe25519_carry (h);
+}
+
+static_always_inline void
+fe25519_reduce (fe25519 h, u128 r0, u128 r1, u128 r2, u128 r3, u128 r4)
+{
+  r1 += (u64) (r0 >> 51);
+  r2 += (u64) (r1 >> 51);
+  r3 += (u64) (r2 >> 51);
+  r4 += (u64) (r3 >> 51);
+  h[0] = ((u64) r0 & FE25519_MASK) + 19 * (u64) (r4 >> 51);
+  h[1] = (u64) r1 & FE25519_MASK;
+  h[2] = (u64) r2 & FE25519_MASK;
+  h[3] = (u64) r3 & FE25519_MASK;
+  h[4] = (u64) r4 & FE25519_MASK;
+  h[1] += h[0] >> 51;
+  h[0] &= FE25519_MASK;
+}
+
+static_always_inline void
+fe25519_mul (fe25519 h, const fe25519 f, const fe25519 g)
+{
+  u64 g1_19 = 19 * g[1], g2_19 = 19 * g[2], g3_19 = 19 * g[3],
+      g4_19 = 19 * g[4];
+  u128 r0, r1, r2, r3, r4;
+
+  r0 = (u128) f[0] * g[0] + (u128) f[1] * g4_19 + (u128) f[2] * g3_19 +
+       (u128) f[3] * g2_19 + (u128) f[4] * g1_19;
+  r1 = (u128) f[0] * g[1] + (u128) f[1] * g[0] + (u128) f[2] * g4_19 +
+       (u128) f[3] * g3_19 + (u128) f[4] * g2_19;
+  r2 = (u128) f[0] * g[2] + (u128) f[1] * g[1] + (u128) f[2] * g[0] +
+       (u128) f[3] * g4_19 + (u128) f[4] * g3_19;
+  r3 = (u128) f[0] * g[3] + (u128) f[1] * g[2] + (u128) f[2] * g[1] +
+       (u128) f[3] * g[0] + (u128) f[4] * g4_19;
+  r4 = (u128) f[0] * g[4] + (u128) f[1] * g[3] + (u128) f[2] * g[2] +
+       (u128) f[3] * g[1] + (u128) f[4] * g[0];
+
+  fe25519_reduce (h, r0, r1, r2, r3, r4);
+}
+
+static_always_inline void
+fe25519_sq (fe25519 h, const fe25519 f)
+{
+  u64 f0_2 = 2 * f[0], f1_2 = 2 * f[1], f1_38 = 38 * f[1], f2_38 = 38 * f[2],
+      f3_38 = 38 * f[3], f3_19 = 19 * f[3], f4_19 = 19 * f[4];
+  u128 r0, r1, r2, r3, r4;
+
+  r0 = (u128) f[0] * f[0] + (u128) f1_38 * f[4] + (u128) f2_38 * f[3];
+  r1 = (u128) f0_2 * f[1] + (u128) f2_38 * f[4] + (u128) f3_19 * f[3];
+  r2 = (u128) f0_2 * f[2] + (u128) f[1] * f[1] + (u128) f3_38 * f[4];
+  r3 = (u128) f0_2 * f[3] + (u128) f1_2 * f[2] + (u128) f4_19 * f[4];
+  r4 = (u128) f0_2 * f[4] + (u128) f1_2 * f[3] + (u128) f[2] * f[2];
+
+  fe25519_reduce (h, r0, r1, r2, r3, r4);
+}
 
-  peerkey =
-    EVP_PKEY_new_raw_public_key (EVP_PKEY_X25519, NULL, basepoint,
-				 CURVE25519_KEY_SIZE);
-  if (EVP_PKEY_derive_set_peer (ctx, peerkey) <= 0)
+static_always_inline void
+fe25519_sq_n (fe25519 h, const fe25519 f, int n)
+{
+  fe25519_sq (h, f);
+  while (--n)
+    fe25519_sq (h, h);
+}
+
+static_always_inline void
+fe25519_mul_a24 (fe25519 h, const fe25519 f)
+{
+  /* (A - 2) / 4 for curve25519 */
+  const u64 a24 = 121665;
+
+  fe25519_reduce (h, (u128) f[0] * a24, (u128) f[1] * a24,
+		  (u128) f[2] * a24, (u128) f[3] * a24, (u128) f[4] * a24);
+}
+
+static_always_inline void
+fe25519_cswap (fe25519 f, fe25519 g, u64 swap)
+{
+  u64 mask = -swap;
+  int i;
+
+  for (i = 0; i < 5; i++)
     {
-      ret = false;
-      goto out;
+      u64 x = mask & (f[i] ^ g[i]);
+      f[i] ^= x;
+      g[i] ^= x;
     }
+}
 
-  key_len = CURVE25519_KEY_SIZE;
-  if (EVP_PKEY_derive (ctx, shared_key, &key_len) <= 0)
+/* z^(p - 2) */
+static void
+fe25519_invert (fe25519 out, const fe25519 z)
+{
+  fe25519 z2, z9, z11, z2_5_0, z2_10_0, z2_20_0, z2_50_0, z2_100_0, t;
+
+  fe25519_sq (z2, z);
+  fe25519_sq_n (t, z2, 2);
+  fe25519_mul (z9, t, z);
+  fe25519_mul (z11, z9, z2);
+  fe25519_sq (t, z11);
+  fe25519_mul (z2_5_0, t, z9);
+  fe25519_sq_n (t, z2_5_0, 5);
+  fe25519_mul (z2_10_0, t, z2_5_0);
+  fe25519_sq_n (t, z2_10_0, 10);
+  fe25519_mul (z2_20_0, t, z2_10_0);
+  fe25519_sq_n (t, z2_20_0, 20);
+  fe25519_mul (t, t, z2_20_0);
+  fe25519_sq_n (t, t, 10);
+  fe25519_mul (z2_50_0, t, z2_10_0);
+  fe25519_sq_n (t, z2_50_0, 50);
+  fe25519_mul (z2_100_0, t, z2_50_0);
+  fe25519_sq_n (t, z2_100_0, 100);
+  fe25519_mul (t, t, z2_100_0);
+  fe25519_sq_n (t, t, 50);
+  fe25519_mul (t, t, z2_50_0);
+  fe25519_sq_n (t, t, 5);
+  fe25519_mul (out, t, z11);
+}
+
+static void
+curve25519_scalarmult (u8 out[CURVE25519_KEY_SIZE],
+		       const u8 scalar[CURVE25519_KEY_SIZE],
+		       const u8 point[CURVE25519_KEY_SIZE])
+{
+  fe25519 x1, x2 = { 1 }, z2 = { 0 }, x3, z3 = { 1 };
+  fe25519 a, aa, b, bb, e, c, d, da, cb;
+  u8 k[CURVE25519_KEY_SIZE];
+  u64 swap = 0, bit;
+  int t;
+
+  clib_memcpy_fast (k, scalar, CURVE25519_KEY_SIZE);
+  k[0] &= 248;
+  k[31] &= 127;
+  k[31] |= 64;
+
+  fe25519_from_bytes (x1, point);
+  clib_memcpy_fast (x3, x1, sizeof (x3));
+
+  for (t = 254; t >= 0; t--)
     {
-      ret = false;
+      bit = (k[t >> 3] >> (t & 7)) & 1;
+      swap ^= bit;
+      fe25519_cswap (x2, x3, swap);
+      fe25519_cswap (z2, z3, swap);
+      swap = bit;
+
+      fe25519_add (a, x2, z2);
+      fe25519_sq (aa, a);
+      fe25519_sub (b, x2, z2);
+      fe25519_sq (bb, b);
+      fe25519_sub (e, aa, bb);
+      fe25519_add (c, x3, z3);
+      fe25519_sub (d, x3, z3);
+      fe25519_mul (da, d, a);
+      fe25519_mul (cb, c, b);
+      fe25519_add (x3, da, cb);
+      fe25519_sq (x3, x3);
+      fe25519_sub (z3, da, cb);
+      fe25519_sq (z3, z3);
+      fe25519_mul (z3, z3, x1);
+      fe25519_mul (x2, aa, bb);
+      fe25519_mul_a24 (z2, e);
+      fe25519_add (z2, z2, aa);
+      fe25519_mul (z2, z2, e);
     }
 
-out:
-  EVP_PKEY_CTX_free (ctx);
-  EVP_PKEY_free (pkey);
-  EVP_PKEY_free (peerkey);
-  return ret;
+  fe25519_cswap (x2, x3, swap);
+  fe25519_cswap (z2, z3, swap);
+
+  fe25519_invert (z2, z2);
+  fe25519_mul (x2, x2, z2);
+  fe25519_to_bytes (out, x2);
+
+  clib_memset (k, 0, sizeof (k));
+}
+
+bool
+curve25519_gen_shared (u8 shared_key[CURVE25519_KEY_SIZE],
+		       const u8 secret_key[CURVE25519_KEY_SIZE],
+		       const u8 basepoint[CURVE25519_KEY_SIZE])
+{
+  u8 acc = 0;
+  int i;
+
+  curve25519_scalarmult (shared_key, secret_key, basepoint);
+
+  /* reject low order points, as the all-zero result tells */
+  for (i = 0; i < CURVE25519_KEY_SIZE; i++)
+    acc |= shared_key[i];
+
+  return acc != 0;
 }
 
 bool
 curve25519_gen_public (u8 public_key[CURVE25519_KEY_SIZE],
 		       const u8 secret_key[CURVE25519_KEY_SIZE])
 {
-  size_t pub_len;
-  EVP_PKEY *pkey =
-    EVP_PKEY_new_raw_private_key (EVP_PKEY_X25519, NULL, secret_key,
-				  CURVE25519_KEY_SIZE);
-  pub_len = CURVE25519_KEY_SIZE;
-  if (!EVP_PKEY_get_raw_public_key (pkey, public_key, &pub_len))
-    {
-      EVP_PKEY_free (pkey);
-      return false;
-    }
-  EVP_PKEY_free (pkey);
+  static const u8 basepoint[CURVE25519_KEY_SIZE] = { 9 };
+
+  curve25519_scalarmult (public_key, secret_key, basepoint);
   return true;
 }
 
 bool
 curve25519_gen_secret (u8 secret_key[CURVE25519_KEY_SIZE])
 {
-  size_t secret_len;
-  EVP_PKEY *pkey = NULL;
-  EVP_PKEY_CTX *pctx = EVP_PKEY_CTX_new_id (EVP_PKEY_X25519, NULL);
-  EVP_PKEY_keygen_init (pctx);
-  EVP_PKEY_keygen (pctx, &pkey);
-  EVP_PKEY_CTX_free (pctx);
+  if (RAND_bytes (secret_key, CURVE25519_KEY_SIZE) != 1)
+    return false;
 
-  secret_len = CURVE25519_KEY_SIZE;
-  if (!EVP_PKEY_get_raw_private_key (pkey, secret_key, &secret_len))
-    {
-      EVP_PKEY_free (pkey);
-      return false;
-    }
-  EVP_PKEY_free (pkey);
+  secret_key[0] &= 248;
+  secret_key[31] &= 127;
+  secret_key[31] |= 64;
   return true;
 }
 
@@ -116,6 +345,13 @@ key_from_base64 (const u8 * src, size_t src_len, u8 * out)
   return true;
 }
 
+void
+wg_secure_zero_memory (void *v, size_t n)
+{
+  static void *(*const volatile memset_v) (void *, int, size_t) = &memset;
+  memset_v (v, 0, n);
+}
+
 /*
  * fd.io coding-style-patch-verification: ON
  *
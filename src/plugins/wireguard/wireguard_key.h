@@ -34,6 +34,8 @@ bool curve25519_gen_public (u8 public_key[CURVE25519_KEY_SIZE],
 bool key_to_base64 (const u8 * src, size_t src_len, u8 * out);
 bool key_from_base64 (const u8 * src, size_t src_len, u8 * out);
 
+void wg_secure_zero_memory (void *v, size_t n);
+
 #endif /* __included_wg_convert_h__ */
 
 /*
@@ -16,7 +16,7 @@
  */
 
 #include <openssl/hmac.h>
-#include <wireguard/wireguard.h>
+#include <wireguard/wireguard_noise.h>
 #include <wireguard/wireguard_chachapoly.h>
 
 /* This implements Noise_IKpsk2:
@@ -30,7 +30,7 @@
 noise_local_t *noise_local_pool;
 
 /* Private functions */
-static noise_keypair_t *noise_remote_keypair_allocate (noise_remote_t *);
+static noise_keypair_t *noise_remote_keypair_allocate (void);
 static void noise_remote_keypair_free (vlib_main_t * vm, noise_remote_t *,
 				       noise_keypair_t **);
 static uint32_t noise_remote_handshake_index_get (vlib_main_t *vm,
@@ -61,9 +61,11 @@ static void noise_param_init (uint8_t[NOISE_HASH_LEN],
 			      const uint8_t[NOISE_PUBLIC_KEY_LEN]);
 
 static void noise_msg_encrypt (vlib_main_t * vm, uint8_t *, uint8_t *, size_t,
-			       uint32_t key_idx, uint8_t[NOISE_HASH_LEN]);
+			       const uint8_t[NOISE_SYMMETRIC_KEY_LEN],
+			       uint8_t[NOISE_HASH_LEN]);
 static bool noise_msg_decrypt (vlib_main_t * vm, uint8_t *, uint8_t *, size_t,
-			       uint32_t key_idx, uint8_t[NOISE_HASH_LEN]);
+			       const uint8_t[NOISE_SYMMETRIC_KEY_LEN],
+			       uint8_t[NOISE_HASH_LEN]);
 static void noise_msg_ephemeral (uint8_t[NOISE_HASH_LEN],
 				 uint8_t[NOISE_HASH_LEN],
 				 const uint8_t src[NOISE_PUBLIC_KEY_LEN]);
@@ -92,9 +94,12 @@ noise_remote_init (vlib_main_t *vm, noise_remote_t *r, uint32_t peer_pool_idx,
 		   const uint8_t public[NOISE_PUBLIC_KEY_LEN],
 		   u32 noise_local_idx)
 {
+  /* called again on every admin up */
+  clib_spinlock_free (&r->r_handshake_lock);
   clib_memset (r, 0, sizeof (*r));
   clib_memcpy (r->r_public, public, NOISE_PUBLIC_KEY_LEN);
   clib_rwlock_init (&r->r_keypair_lock);
+  clib_spinlock_init (&r->r_handshake_lock);
   r->r_peer_idx = peer_pool_idx;
   r->r_local_idx = noise_local_idx;
   r->r_handshake.hs_state = HS_ZEROED;
@@ -121,51 +126,47 @@ noise_create_initiation (vlib_main_t * vm, noise_remote_t * r,
 			 uint8_t es[NOISE_PUBLIC_KEY_LEN + NOISE_AUTHTAG_LEN],
 			 uint8_t ets[NOISE_TIMESTAMP_LEN + NOISE_AUTHTAG_LEN])
 {
-  noise_handshake_t *hs = &r->r_handshake;
+  noise_handshake_t hs;
   noise_local_t *l = noise_local_get (r->r_local_idx);
-  uint8_t _key[NOISE_SYMMETRIC_KEY_LEN] = { 0 };
-  uint32_t key_idx;
-  uint8_t *key;
+  uint8_t key[NOISE_SYMMETRIC_KEY_LEN] = { 0 };
   int ret = false;
 
-  key_idx =
-    vnet_crypto_key_add (vm, VNET_CRYPTO_ALG_CHACHA20_POLY1305, _key,
-			 NOISE_SYMMETRIC_KEY_LEN);
-  key = vnet_crypto_get_key (key_idx)->data;
-
-  noise_param_init (hs->hs_ck, hs->hs_hash, r->r_public);
+  noise_param_init (hs.hs_ck, hs.hs_hash, r->r_public);
 
   /* e */
-  curve25519_gen_secret (hs->hs_e);
-  if (!curve25519_gen_public (ue, hs->hs_e))
+  curve25519_gen_secret (hs.hs_e);
+  if (!curve25519_gen_public (ue, hs.hs_e))
     goto error;
-  noise_msg_ephemeral (hs->hs_ck, hs->hs_hash, ue);
+  noise_msg_ephemeral (hs.hs_ck, hs.hs_hash, ue);
 
   /* es */
-  if (!noise_mix_dh (hs->hs_ck, key, hs->hs_e, r->r_public))
+  if (!noise_mix_dh (hs.hs_ck, key, hs.hs_e, r->r_public))
     goto error;
-  vnet_crypto_key_update (vm, key_idx);
 
   /* s */
-  noise_msg_encrypt (vm, es, l->l_public, NOISE_PUBLIC_KEY_LEN, key_idx,
-		     hs->hs_hash);
+  noise_msg_encrypt (vm, es, l->l_public, NOISE_PUBLIC_KEY_LEN, key,
+		     hs.hs_hash);
 
   /* ss */
-  if (!noise_mix_ss (hs->hs_ck, key, r->r_ss))
+  if (!noise_mix_ss (hs.hs_ck, key, r->r_ss))
     goto error;
-  vnet_crypto_key_update (vm, key_idx);
 
   /* {t} */
   noise_tai64n_now (ets);
-  noise_msg_encrypt (vm, ets, ets, NOISE_TIMESTAMP_LEN, key_idx, hs->hs_hash);
+  noise_msg_encrypt (vm, ets, ets, NOISE_TIMESTAMP_LEN, key, hs.hs_hash);
+
+  clib_spinlock_lock (&r->r_handshake_lock);
   noise_remote_handshake_index_drop (vm, r);
-  hs->hs_state = CREATED_INITIATION;
-  hs->hs_local_index = noise_remote_handshake_index_get (vm, r);
-  *s_idx = hs->hs_local_index;
+  hs.hs_state = CREATED_INITIATION;
+  hs.hs_local_index = noise_remote_handshake_index_get (vm, r);
+  hs.hs_remote_index = 0;
+  r->r_handshake = hs;
+  clib_spinlock_unlock (&r->r_handshake_lock);
+  *s_idx = hs.hs_local_index;
   ret = true;
 error:
   wg_secure_zero_memory (key, NOISE_SYMMETRIC_KEY_LEN);
-  vnet_crypto_key_del (vm, key_idx);
+  wg_secure_zero_memory (&hs, sizeof (hs));
   return ret;
 }
 
@@ -180,18 +181,11 @@ noise_consume_initiation (vlib_main_t * vm, noise_local_t * l,
 {
   noise_remote_t *r;
   noise_handshake_t hs;
-  uint8_t _key[NOISE_SYMMETRIC_KEY_LEN] = { 0 };
+  uint8_t key[NOISE_SYMMETRIC_KEY_LEN] = { 0 };
   uint8_t r_public[NOISE_PUBLIC_KEY_LEN] = { 0 };
   uint8_t timestamp[NOISE_TIMESTAMP_LEN] = { 0 };
-  u32 key_idx;
-  uint8_t *key;
   int ret = false;
 
-  key_idx =
-    vnet_crypto_key_add (vm, VNET_CRYPTO_ALG_CHACHA20_POLY1305, _key,
-			 NOISE_SYMMETRIC_KEY_LEN);
-  key = vnet_crypto_get_key (key_idx)->data;
-
   noise_param_init (hs.hs_ck, hs.hs_hash, l->l_public);
 
   /* e */
@@ -200,47 +194,47 @@ noise_consume_initiation (vlib_main_t * vm, noise_local_t * l,
   /* es */
   if (!noise_mix_dh (hs.hs_ck, key, l->l_private, ue))
     goto error;
-  vnet_crypto_key_update (vm, key_idx);
 
   /* s */
 
   if (!noise_msg_decrypt (vm, r_public, es,
-			  NOISE_PUBLIC_KEY_LEN + NOISE_AUTHTAG_LEN, key_idx,
+			  NOISE_PUBLIC_KEY_LEN + NOISE_AUTHTAG_LEN, key,
 			  hs.hs_hash))
     goto error;
 
   /* Lookup the remote we received from */
-  if ((r = l->l_upcall.u_remote_get (r_public)) == NULL)
+  if ((r = l->l_upcall.u_remote_get (l->l_upcall.u_arg, r_public)) == NULL)
     goto error;
 
   /* ss */
   if (!noise_mix_ss (hs.hs_ck, key, r->r_ss))
     goto error;
-  vnet_crypto_key_update (vm, key_idx);
 
   /* {t} */
   if (!noise_msg_decrypt (vm, timestamp, ets,
-			  NOISE_TIMESTAMP_LEN + NOISE_AUTHTAG_LEN, key_idx,
+			  NOISE_TIMESTAMP_LEN + NOISE_AUTHTAG_LEN, key,
 			  hs.hs_hash))
     goto error;
-  ;
 
   hs.hs_state = CONSUMED_INITIATION;
   hs.hs_local_index = 0;
   hs.hs_remote_index = s_idx;
   clib_memcpy (hs.hs_e, ue, NOISE_PUBLIC_KEY_LEN);
 
+  /* Initiations from one peer may arrive on several threads at once */
+  clib_spinlock_lock (&r->r_handshake_lock);
+
   /* Replay */
   if (clib_memcmp (timestamp, r->r_timestamp, NOISE_TIMESTAMP_LEN) > 0)
     clib_memcpy (r->r_timestamp, timestamp, NOISE_TIMESTAMP_LEN);
   else
-    goto error;
+    goto unlock;
 
   /* Flood attack */
   if (wg_birthdate_has_expired (r->r_last_init, REJECT_INTERVAL))
     r->r_last_init = vlib_time_now (vm);
   else
-    goto error;
+    goto unlock;
 
   /* Ok, we're happy to accept this initiation now */
   noise_remote_handshake_index_drop (vm, r);
@@ -248,9 +242,10 @@ noise_consume_initiation (vlib_main_t * vm, noise_local_t * l,
   *rp = r;
   ret = true;
 
+unlock:
+  clib_spinlock_unlock (&r->r_handshake_lock);
 error:
   wg_secure_zero_memory (key, NOISE_SYMMETRIC_KEY_LEN);
-  vnet_crypto_key_del (vm, key_idx);
   wg_secure_zero_memory (&hs, sizeof (hs));
   return ret;
 }
@@ -260,52 +255,56 @@ noise_create_response (vlib_main_t * vm, noise_remote_t * r, uint32_t * s_idx,
 		       uint32_t * r_idx, uint8_t ue[NOISE_PUBLIC_KEY_LEN],
 		       uint8_t en[0 + NOISE_AUTHTAG_LEN])
 {
-  noise_handshake_t *hs = &r->r_handshake;
-  uint8_t _key[NOISE_SYMMETRIC_KEY_LEN] = { 0 };
+  noise_handshake_t hs;
+  uint8_t key[NOISE_SYMMETRIC_KEY_LEN] = { 0 };
   uint8_t e[NOISE_PUBLIC_KEY_LEN] = { 0 };
-  uint32_t key_idx;
-  uint8_t *key;
   int ret = false;
 
-  key_idx =
-    vnet_crypto_key_add (vm, VNET_CRYPTO_ALG_CHACHA20_POLY1305, _key,
-			 NOISE_SYMMETRIC_KEY_LEN);
-  key = vnet_crypto_get_key (key_idx)->data;
+  clib_spinlock_lock (&r->r_handshake_lock);
+  hs = r->r_handshake;
+  clib_spinlock_unlock (&r->r_handshake_lock);
 
-  if (hs->hs_state != CONSUMED_INITIATION)
+  if (hs.hs_state != CONSUMED_INITIATION)
     goto error;
 
   /* e */
   curve25519_gen_secret (e);
   if (!curve25519_gen_public (ue, e))
     goto error;
-  noise_msg_ephemeral (hs->hs_ck, hs->hs_hash, ue);
+  noise_msg_ephemeral (hs.hs_ck, hs.hs_hash, ue);
 
   /* ee */
-  if (!noise_mix_dh (hs->hs_ck, NULL, e, hs->hs_e))
+  if (!noise_mix_dh (hs.hs_ck, NULL, e, hs.hs_e))
     goto error;
 
   /* se */
-  if (!noise_mix_dh (hs->hs_ck, NULL, e, r->r_public))
+  if (!noise_mix_dh (hs.hs_ck, NULL, e, r->r_public))
     goto error;
 
   /* psk */
-  noise_mix_psk (hs->hs_ck, hs->hs_hash, key, r->r_psk);
-  vnet_crypto_key_update (vm, key_idx);
+  noise_mix_psk (hs.hs_ck, hs.hs_hash, key, r->r_psk);
 
   /* {} */
-  noise_msg_encrypt (vm, en, NULL, 0, key_idx, hs->hs_hash);
+  noise_msg_encrypt (vm, en, NULL, 0, key, hs.hs_hash);
 
-
-  hs->hs_state = CREATED_RESPONSE;
-  hs->hs_local_index = noise_remote_handshake_index_get (vm, r);
-  *r_idx = hs->hs_remote_index;
-  *s_idx = hs->hs_local_index;
-  ret = true;
+  /* unless a newer initiation replaced the one we respond to */
+  clib_spinlock_lock (&r->r_handshake_lock);
+  if (r->r_handshake.hs_state == CONSUMED_INITIATION &&
+      r->r_handshake.hs_remote_index == hs.hs_remote_index &&
+      !clib_memcmp (r->r_handshake.hs_e, hs.hs_e, NOISE_PUBLIC_KEY_LEN))
+    {
+      hs.hs_state = CREATED_RESPONSE;
+      hs.hs_local_index = noise_remote_handshake_index_get (vm, r);
+      r->r_handshake = hs;
+      *r_idx = hs.hs_remote_index;
+      *s_idx = hs.hs_local_index;
+      ret = true;
+    }
+  clib_spinlock_unlock (&r->r_handshake_lock);
 error:
   wg_secure_zero_memory (key, NOISE_SYMMETRIC_KEY_LEN);
-  vnet_crypto_key_del (vm, key_idx);
   wg_secure_zero_memory (e, NOISE_PUBLIC_KEY_LEN);
+  wg_secure_zero_memory (&hs, sizeof (hs));
   return ret;
 }
 
@@ -316,18 +315,13 @@ noise_consume_response (vlib_main_t * vm, noise_remote_t * r, uint32_t s_idx,
 {
   noise_local_t *l = noise_local_get (r->r_local_idx);
   noise_handshake_t hs;
-  uint8_t _key[NOISE_SYMMETRIC_KEY_LEN] = { 0 };
+  uint8_t key[NOISE_SYMMETRIC_KEY_LEN] = { 0 };
   uint8_t preshared_key[NOISE_PUBLIC_KEY_LEN] = { 0 };
-  uint32_t key_idx;
-  uint8_t *key;
   int ret = false;
 
-  key_idx =
-    vnet_crypto_key_add (vm, VNET_CRYPTO_ALG_CHACHA20_POLY1305, _key,
-			 NOISE_SYMMETRIC_KEY_LEN);
-  key = vnet_crypto_get_key (key_idx)->data;
-
+  clib_spinlock_lock (&r->r_handshake_lock);
   hs = r->r_handshake;
+  clib_spinlock_unlock (&r->r_handshake_lock);
   clib_memcpy (preshared_key, r->r_psk, NOISE_SYMMETRIC_KEY_LEN);
 
   if (hs.hs_state != CREATED_INITIATION || hs.hs_local_index != r_idx)
@@ -346,17 +340,17 @@ noise_consume_response (vlib_main_t * vm, noise_remote_t * r, uint32_t s_idx,
 
   /* psk */
   noise_mix_psk (hs.hs_ck, hs.hs_hash, key, preshared_key);
-  vnet_crypto_key_update (vm, key_idx);
 
   /* {} */
 
-  if (!noise_msg_decrypt
-      (vm, NULL, en, 0 + NOISE_AUTHTAG_LEN, key_idx, hs.hs_hash))
+  if (!noise_msg_decrypt (vm, NULL, en, 0 + NOISE_AUTHTAG_LEN, key,
+			  hs.hs_hash))
     goto error;
 
 
   hs.hs_remote_index = s_idx;
 
+  clib_spinlock_lock (&r->r_handshake_lock);
   if (r->r_handshake.hs_state == hs.hs_state &&
       r->r_handshake.hs_local_index == hs.hs_local_index)
     {
@@ -364,40 +358,54 @@ noise_consume_response (vlib_main_t * vm, noise_remote_t * r, uint32_t s_idx,
       r->r_handshake.hs_state = CONSUMED_RESPONSE;
       ret = true;
     }
+  clib_spinlock_unlock (&r->r_handshake_lock);
 error:
   wg_secure_zero_memory (&hs, sizeof (hs));
   wg_secure_zero_memory (key, NOISE_SYMMETRIC_KEY_LEN);
-  vnet_crypto_key_del (vm, key_idx);
+  wg_secure_zero_memory (preshared_key, NOISE_SYMMETRIC_KEY_LEN);
   return ret;
 }
 
 bool
-noise_remote_begin_session (vlib_main_t * vm, noise_remote_t * r)
+noise_remote_begin_session (vlib_main_t *vm, noise_remote_t *r,
+			    uint32_t local_idx)
 {
-  noise_handshake_t *hs = &r->r_handshake;
+  noise_handshake_t hs;
   noise_keypair_t kp, *next, *current, *previous;
+  noise_local_t *local;
+  bool is_rekey;
 
   uint8_t key_send[NOISE_SYMMETRIC_KEY_LEN];
   uint8_t key_recv[NOISE_SYMMETRIC_KEY_LEN];
 
+  /* Take the handshake, unless another one has replaced it since it was
+   * created or consumed. The lock is not held across the barrier below,
+   * which waits for workers that may be spinning on it. */
+  clib_spinlock_lock (&r->r_handshake_lock);
+  hs = r->r_handshake;
+  if (hs.hs_local_index != local_idx ||
+      (hs.hs_state != CONSUMED_RESPONSE && hs.hs_state != CREATED_RESPONSE))
+    {
+      clib_spinlock_unlock (&r->r_handshake_lock);
+      return false;
+    }
+  wg_secure_zero_memory (&r->r_handshake, sizeof (r->r_handshake));
+  clib_spinlock_unlock (&r->r_handshake_lock);
+
   /* We now derive the keypair from the handshake */
-  if (hs->hs_state == CONSUMED_RESPONSE)
+  if (hs.hs_state == CONSUMED_RESPONSE)
     {
       kp.kp_is_initiator = 1;
       noise_kdf (key_send, key_recv, NULL, NULL,
 		 NOISE_SYMMETRIC_KEY_LEN, NOISE_SYMMETRIC_KEY_LEN, 0, 0,
-		 hs->hs_ck);
+		 hs.hs_ck);
     }
-  else if (hs->hs_state == CREATED_RESPONSE)
+  else
     {
       kp.kp_is_initiator = 0;
       noise_kdf (key_recv, key_send, NULL, NULL,
 		 NOISE_SYMMETRIC_KEY_LEN, NOISE_SYMMETRIC_KEY_LEN, 0, 0,
-		 hs->hs_ck);
-    }
-  else
-    {
-      return false;
+		 hs.hs_ck);
     }
 
   kp.kp_valid = 1;
@@ -407,10 +415,18 @@ noise_remote_begin_session (vlib_main_t * vm, noise_remote_t * r)
   kp.kp_recv_index = vnet_crypto_key_add (vm,
 					  VNET_CRYPTO_ALG_CHACHA20_POLY1305,
 					  key_recv, NOISE_SYMMETRIC_KEY_LEN);
-  kp.kp_local_index = hs->hs_local_index;
-  kp.kp_remote_index = hs->hs_remote_index;
+  kp.kp_local_index = hs.hs_local_index;
+  kp.kp_remote_index = hs.hs_remote_index;
   kp.kp_birthdate = vlib_time_now (vm);
   clib_memset (&kp.kp_ctr, 0, sizeof (kp.kp_ctr));
+  kp.kp_send_blocks = NULL;
+  kp.kp_recv_lock = NULL;
+  if (r->r_multi_queue)
+    {
+      vec_validate_aligned (kp.kp_send_blocks, vlib_get_n_threads () - 1,
+			    CLIB_CACHE_LINE_BYTES);
+      clib_spinlock_init (&kp.kp_recv_lock);
+    }
 
   /* Now we need to add_new_keypair */
   clib_rwlock_writer_lock (&r->r_keypair_lock);
@@ -419,6 +435,7 @@ noise_remote_begin_session (vlib_main_t * vm, noise_remote_t * r)
   next = r->r_next;
   current = r->r_current;
   previous = r->r_previous;
+  is_rekey = (next || current);
 
   if (kp.kp_is_initiator)
     {
@@ -435,7 +452,7 @@ noise_remote_begin_session (vlib_main_t * vm, noise_remote_t * r)
 
       noise_remote_keypair_free (vm, r, &previous);
 
-      r->r_current = noise_remote_keypair_allocate (r);
+      r->r_current = noise_remote_keypair_allocate ();
       *r->r_current = kp;
     }
   else
@@ -444,14 +461,23 @@ noise_remote_begin_session (vlib_main_t * vm, noise_remote_t * r)
       r->r_previous = NULL;
       noise_remote_keypair_free (vm, r, &previous);
 
-      r->r_next = noise_remote_keypair_allocate (r);
+      r->r_next = noise_remote_keypair_allocate ();
       *r->r_next = kp;
     }
+  r->r_has_multi_queue_keypair =
+    ((r->r_next && noise_keypair_is_multi_queue (r->r_next)) ||
+     (r->r_current && noise_keypair_is_multi_queue (r->r_current)) ||
+     (r->r_previous && noise_keypair_is_multi_queue (r->r_previous)));
   vlib_worker_thread_barrier_release (vm);
   clib_rwlock_writer_unlock (&r->r_keypair_lock);
 
-  wg_secure_zero_memory (&r->r_handshake, sizeof (r->r_handshake));
+  local = noise_local_get (r->r_local_idx);
+  if (is_rekey && local->l_upcall.u_rekeyed)
+    local->l_upcall.u_rekeyed (vm, r);
 
+  wg_secure_zero_memory (&hs, sizeof (hs));
+  wg_secure_zero_memory (key_send, NOISE_SYMMETRIC_KEY_LEN);
+  wg_secure_zero_memory (key_recv, NOISE_SYMMETRIC_KEY_LEN);
   wg_secure_zero_memory (&kp, sizeof (kp));
   return true;
 }
@@ -459,8 +485,10 @@ noise_remote_begin_session (vlib_main_t * vm, noise_remote_t * r)
 void
 noise_remote_clear (vlib_main_t * vm, noise_remote_t * r)
 {
+  clib_spinlock_lock_if_init (&r->r_handshake_lock);
   noise_remote_handshake_index_drop (vm, r);
   wg_secure_zero_memory (&r->r_handshake, sizeof (r->r_handshake));
+  clib_spinlock_unlock_if_init (&r->r_handshake_lock);
 
   clib_rwlock_writer_lock (&r->r_keypair_lock);
   noise_remote_keypair_free (vm, r, &r->r_next);
@@ -469,9 +497,50 @@ noise_remote_clear (vlib_main_t * vm, noise_remote_t * r)
   r->r_next = NULL;
   r->r_current = NULL;
   r->r_previous = NULL;
+  r->r_has_multi_queue_keypair = 0;
   clib_rwlock_writer_unlock (&r->r_keypair_lock);
 }
 
+typedef struct noise_keypair_free_args_t_
+{
+  noise_keypair_t *kp;
+  uint32_t local_idx;
+} noise_keypair_free_args_t;
+
+static void
+noise_keypair_free_thread_fn (void *arg)
+{
+  noise_keypair_free_args_t *a = arg;
+  vlib_main_t *vm = vlib_get_main ();
+
+  if (!pool_is_free_index (noise_local_pool, a->local_idx))
+    noise_local_get (a->local_idx)
+      ->l_upcall.u_index_drop (vm, a->kp->kp_local_index);
+  vnet_crypto_key_del (vm, a->kp->kp_send_index);
+  vnet_crypto_key_del (vm, a->kp->kp_recv_index);
+  vec_free (a->kp->kp_send_blocks);
+  clib_spinlock_free (&a->kp->kp_recv_lock);
+  clib_mem_free (a->kp);
+}
+
+/*
+ * Free a keypair that other workers may still be decrypting with. The
+ * main thread frees it under the worker barrier, once no dispatch can
+ * hold a pointer to it anymore.
+ */
+void
+noise_remote_keypair_free_from_mt (noise_remote_t *r, noise_keypair_t *kp)
+{
+  noise_keypair_free_args_t args = {
+    .kp = kp,
+    .local_idx = r->r_local_idx,
+  };
+
+  if (kp)
+    vlib_rpc_call_main_thread (noise_keypair_free_thread_fn, (u8 *) &args,
+			       sizeof (args));
+}
+
 void
 noise_remote_expire_current (noise_remote_t * r)
 {
@@ -522,7 +591,8 @@ noise_remote_encrypt (vlib_main_t * vm, noise_remote_t * r, uint32_t * r_idx,
   if (!kp->kp_valid ||
       wg_birthdate_has_expired (kp->kp_birthdate, REJECT_AFTER_TIME) ||
       kp->kp_ctr.c_recv >= REJECT_AFTER_MESSAGES ||
-      ((*nonce = noise_counter_send (&kp->kp_ctr)) > REJECT_AFTER_MESSAGES))
+      ((*nonce = noise_keypair_send_nonce (kp, vm->thread_index)) >
+       REJECT_AFTER_MESSAGES))
     goto error;
 
   /* We encrypt into the same buffer, so the caller must ensure that buf
@@ -555,7 +625,7 @@ error:
 /* Private functions - these should not be called outside this file under any
  * circumstances. */
 static noise_keypair_t *
-noise_remote_keypair_allocate (noise_remote_t * r)
+noise_remote_keypair_allocate (void)
 {
   noise_keypair_t *kp;
   kp = clib_mem_alloc (sizeof (*kp));
@@ -704,24 +774,24 @@ noise_param_init (uint8_t ck[NOISE_HASH_LEN], uint8_t hash[NOISE_HASH_LEN],
 
 static void
 noise_msg_encrypt (vlib_main_t * vm, uint8_t * dst, uint8_t * src,
-		   size_t src_len, uint32_t key_idx,
+		   size_t src_len, const uint8_t key[NOISE_SYMMETRIC_KEY_LEN],
 		   uint8_t hash[NOISE_HASH_LEN])
 {
   /* Nonce always zero for Noise_IK */
-  wg_chacha20poly1305_calc (vm, src, src_len, dst, hash, NOISE_HASH_LEN, 0,
-			    VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC, key_idx);
+  wg_chacha20poly1305_calc_key (vm, src, src_len, dst, hash, NOISE_HASH_LEN,
+				0, VNET_CRYPTO_OP_CHACHA20_POLY1305_ENC, key);
   noise_mix_hash (hash, dst, src_len + NOISE_AUTHTAG_LEN);
 }
 
 static bool
 noise_msg_decrypt (vlib_main_t * vm, uint8_t * dst, uint8_t * src,
-		   size_t src_len, uint32_t key_idx,
+		   size_t src_len, const uint8_t key[NOISE_SYMMETRIC_KEY_LEN],
 		   uint8_t hash[NOISE_HASH_LEN])
 {
   /* Nonce always zero for Noise_IK */
-  if (!wg_chacha20poly1305_calc (vm, src, src_len, dst, hash, NOISE_HASH_LEN,
-				 0, VNET_CRYPTO_OP_CHACHA20_POLY1305_DEC,
-				 key_idx))
+  if (!wg_chacha20poly1305_calc_key (vm, src, src_len, dst, hash,
+				     NOISE_HASH_LEN, 0,
+				     VNET_CRYPTO_OP_CHACHA20_POLY1305_DEC, key))
     return false;
   noise_mix_hash (hash, src, src_len);
   return true;
@@ -39,6 +39,14 @@
 #define COUNTER_NUM		(COUNTER_BITS_TOTAL / COUNTER_BITS)
 #define COUNTER_WINDOW_SIZE	(COUNTER_BITS_TOTAL - COUNTER_BITS)
 
+/* Nonces a worker reserves at once from a multi-queue keypair. A worker
+ * that sends little can sit on a block while the others run the shared
+ * counter far ahead; the rest of its block is given up once it lags the
+ * counter by NOISE_COUNTER_BLOCK_MAX_LAG, so its nonces stay well within
+ * the receiver's window however the load is spread. */
+#define NOISE_COUNTER_BLOCK	64
+#define NOISE_COUNTER_BLOCK_MAX_LAG	(COUNTER_WINDOW_SIZE / 2)
+
 /* Constants for the keypair */
 #define REKEY_AFTER_MESSAGES	(1ull << 60)
 #define REJECT_AFTER_MESSAGES	(UINT64_MAX - COUNTER_WINDOW_SIZE - 1)
@@ -83,6 +91,13 @@ typedef struct noise_counter
   unsigned long c_backtrack[COUNTER_NUM];
 } noise_counter_t;
 
+typedef struct noise_counter_block
+{
+  CLIB_CACHE_LINE_ALIGN_MARK (cacheline0);
+  uint64_t cb_next;
+  uint64_t cb_end;
+} noise_counter_block_t;
+
 typedef struct noise_keypair
 {
   int kp_valid;
@@ -93,6 +108,11 @@ typedef struct noise_keypair
   vnet_crypto_key_index_t kp_recv_index;
   f64 kp_birthdate;
   noise_counter_t kp_ctr;
+
+  /* multi-queue only: per-thread nonce blocks and the lock serializing
+   * the replay window between the workers decrypting for this keypair */
+  noise_counter_block_t *kp_send_blocks;
+  clib_spinlock_t kp_recv_lock;
 } noise_keypair_t;
 
 typedef struct noise_local noise_local_t;
@@ -103,6 +123,8 @@ typedef struct noise_remote
   uint32_t r_local_idx;
   uint8_t r_ss[NOISE_PUBLIC_KEY_LEN];
 
+  /* held while the handshake is read or replaced, not across the DHs */
+  clib_spinlock_t r_handshake_lock;
   noise_handshake_t r_handshake;
   uint8_t r_psk[NOISE_SYMMETRIC_KEY_LEN];
   uint8_t r_timestamp[NOISE_TIMESTAMP_LEN];
@@ -110,6 +132,12 @@ typedef struct noise_remote
 
   clib_rwlock_t r_keypair_lock;
   noise_keypair_t *r_next, *r_current, *r_previous;
+
+  /* keypairs of new sessions may be used from any worker */
+  uint8_t r_multi_queue;
+  /* one of the keypairs above may be multi-queue; updated when a keypair
+   * is installed, so data packets of other peers skip the lookup */
+  uint8_t r_has_multi_queue_keypair;
 } noise_remote_t;
 
 typedef struct noise_local
@@ -120,9 +148,12 @@ typedef struct noise_local
   struct noise_upcall
   {
     void *u_arg;
-    noise_remote_t *(*u_remote_get) (const uint8_t[NOISE_PUBLIC_KEY_LEN]);
+    noise_remote_t *(*u_remote_get) (void *,
+				     const uint8_t[NOISE_PUBLIC_KEY_LEN]);
     uint32_t (*u_index_set) (vlib_main_t *, noise_remote_t *);
     void (*u_index_drop) (vlib_main_t *, uint32_t);
+    /* optional, a session replaced the keys of an earlier one */
+    void (*u_rekeyed) (vlib_main_t *, noise_remote_t *);
   } l_upcall;
 } noise_local_t;
 
@@ -136,6 +167,22 @@ noise_local_get (uint32_t locali)
   return (pool_elt_at_index (noise_local_pool, locali));
 }
 
+static inline bool
+wg_birthdate_has_expired (f64 birthday_seconds, f64 expiration_seconds)
+{
+  if (birthday_seconds == 0.0)
+    return true;
+  f64 now_seconds = vlib_time_now (vlib_get_main ());
+  return (birthday_seconds + expiration_seconds) < now_seconds;
+}
+
+static_always_inline bool
+wg_birthdate_has_expired_opt (f64 birthday_seconds, f64 expiration_seconds,
+			      f64 time)
+{
+  return (birthday_seconds + expiration_seconds) < time;
+}
+
 static_always_inline uint64_t
 noise_counter_send (noise_counter_t *ctr)
 {
@@ -144,6 +191,40 @@ noise_counter_send (noise_counter_t *ctr)
   return ret;
 }
 
+static_always_inline bool
+noise_keypair_is_multi_queue (const noise_keypair_t *kp)
+{
+  return (kp->kp_send_blocks != NULL);
+}
+
+/*
+ * Next send nonce of a keypair. Multi-queue keypairs hand every thread
+ * a block of NOISE_COUNTER_BLOCK nonces, so the shared counter is only
+ * written once per block. Nonces left in a block when the keypair is
+ * replaced, or when the block has fallen too far behind the shared
+ * counter, are never sent, which the receiver's window tolerates.
+ */
+static_always_inline uint64_t
+noise_keypair_send_nonce (noise_keypair_t *kp, u32 thread_index)
+{
+  noise_counter_block_t *cb;
+
+  if (PREDICT_TRUE (!noise_keypair_is_multi_queue (kp)))
+    return noise_counter_send (&kp->kp_ctr);
+
+  cb = vec_elt_at_index (kp->kp_send_blocks, thread_index);
+  if (PREDICT_FALSE (cb->cb_next == cb->cb_end ||
+		     clib_atomic_load_relax_n (&kp->kp_ctr.c_send) -
+			 cb->cb_next >
+		       NOISE_COUNTER_BLOCK_MAX_LAG))
+    {
+      cb->cb_next =
+	clib_atomic_fetch_add (&kp->kp_ctr.c_send, NOISE_COUNTER_BLOCK);
+      cb->cb_end = cb->cb_next + NOISE_COUNTER_BLOCK;
+    }
+  return cb->cb_next++;
+}
+
 void noise_local_init (noise_local_t *, struct noise_upcall *);
 bool noise_local_set_private (noise_local_t *,
 			      const uint8_t[NOISE_PUBLIC_KEY_LEN]);
@@ -184,9 +265,13 @@ bool noise_consume_response (vlib_main_t * vm, noise_remote_t *,
 			     uint8_t ue[NOISE_PUBLIC_KEY_LEN],
 			     uint8_t en[0 + NOISE_AUTHTAG_LEN]);
 
-bool noise_remote_begin_session (vlib_main_t * vm, noise_remote_t * r);
+/* Install the keypair of the handshake with local index local_idx */
+bool noise_remote_begin_session (vlib_main_t *vm, noise_remote_t *r,
+				 uint32_t local_idx);
 void noise_remote_clear (vlib_main_t * vm, noise_remote_t * r);
 void noise_remote_expire_current (noise_remote_t * r);
+void noise_remote_keypair_free_from_mt (noise_remote_t *r,
+					noise_keypair_t *kp);
 
 bool noise_remote_ready (noise_remote_t *);
 
@@ -258,6 +343,20 @@ error:
   return ret;
 }
 
+static_always_inline bool
+noise_keypair_counter_recv (noise_keypair_t *kp, uint64_t recv)
+{
+  bool ret;
+
+  if (PREDICT_TRUE (!noise_keypair_is_multi_queue (kp)))
+    return noise_counter_recv (&kp->kp_ctr, recv);
+
+  clib_spinlock_lock (&kp->kp_recv_lock);
+  ret = noise_counter_recv (&kp->kp_ctr, recv);
+  clib_spinlock_unlock (&kp->kp_recv_lock);
+  return ret;
+}
+
 static_always_inline void
 noise_remote_keypair_free (vlib_main_t *vm, noise_remote_t *r,
 			   noise_keypair_t **kp)
@@ -269,6 +368,11 @@ noise_remote_keypair_free (vlib_main_t *vm, noise_remote_t *r,
       u->u_index_drop (vm, (*kp)->kp_local_index);
       vnet_crypto_key_del (vm, (*kp)->kp_send_index);
       vnet_crypto_key_del (vm, (*kp)->kp_recv_index);
+      if (noise_keypair_is_multi_queue (*kp))
+	{
+	  vec_free ((*kp)->kp_send_blocks);
+	  clib_spinlock_free (&(*kp)->kp_recv_lock);
+	}
       clib_mem_free (*kp);
     }
 }
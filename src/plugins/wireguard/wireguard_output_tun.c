@@ -17,6 +17,7 @@
 #include <vlib/vlib.h>
 #include <vnet/vnet.h>
 #include <vppinfra/error.h>
+#include <vnet/gso/gso.h>
 
 #include <wireguard/wireguard.h>
 #include <wireguard/wireguard_send.h>
@@ -292,7 +293,8 @@ wg_output_tun_process (vlib_main_t *vm, wg_per_thread_data_t *ptd,
       wg_birthdate_has_expired_opt (kp->kp_birthdate, REJECT_AFTER_TIME,
 				    time) ||
       kp->kp_ctr.c_recv >= REJECT_AFTER_MESSAGES ||
-      ((*nonce = noise_counter_send (&kp->kp_ctr)) > REJECT_AFTER_MESSAGES))
+      ((*nonce = noise_keypair_send_nonce (kp, vm->thread_index)) >
+       REJECT_AFTER_MESSAGES))
     goto error;
 
   /* We encrypt into the same buffer, so the caller must ensure that buf
@@ -352,7 +354,8 @@ wg_add_to_async_frame (vlib_main_t *vm, wg_per_thread_data_t *ptd,
       wg_birthdate_has_expired_opt (kp->kp_birthdate, REJECT_AFTER_TIME,
 				    time) ||
       kp->kp_ctr.c_recv >= REJECT_AFTER_MESSAGES ||
-      ((*nonce = noise_counter_send (&kp->kp_ctr)) > REJECT_AFTER_MESSAGES))
+      ((*nonce = noise_keypair_send_nonce (kp, vm->thread_index)) >
+       REJECT_AFTER_MESSAGES))
     goto error;
 
   /* We encrypt into the same buffer, so the caller must ensure that buf
@@ -418,16 +421,33 @@ wg_calc_checksum (vlib_main_t *vm, vlib_buffer_t *b)
     }
 }
 
-/* is_ip4 - inner header flag */
-always_inline uword
-wg_output_tun_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
-		      vlib_frame_t *frame, u8 is_ip4, u16 async_next_node)
+/*
+ * Insert AWG header junk between the udp header and the data message. The
+ * message stays where it was encrypted; the ip/udp header moves down into
+ * the headroom reserved for it.
+ */
+static_always_inline void
+wg_output_tun_add_junk (vlib_buffer_t *b, u32 junk_len, u8 is_ip4)
+{
+  u32 hdr_len =
+    is_ip4 ? sizeof (ip4_udp_header_t) : sizeof (ip6_udp_header_t);
+  u8 *cur = vlib_buffer_get_current (b);
+
+  clib_memmove (cur - junk_len, cur, hdr_len);
+  wg_awg_generate_junk (cur - junk_len + hdr_len, junk_len);
+  vlib_buffer_advance (b, -(word) junk_len);
+}
+
+/*
+ * Encrypt up to VLIB_FRAME_SIZE buffers and enqueue them. Stops at the
+ * first GSO buffer, which the caller segments; returns the number of
+ * buffers consumed.
+ */
+static_always_inline u32
+wg_output_tun_encrypt (vlib_main_t *vm, vlib_node_runtime_t *node,
+		       wg_per_thread_data_t *ptd, u32 *from, u32 n_left_from,
+		       u16 async_next_node)
 {
-  wg_main_t *wmp = &wg_main;
-  wg_per_thread_data_t *ptd =
-    vec_elt_at_index (wmp->per_thread_data, vm->thread_index);
-  u32 *from = vlib_frame_vector_args (frame);
-  u32 n_left_from = frame->n_vectors;
   ip4_udp_wg_header_t *hdr4_out = NULL;
   ip6_udp_wg_header_t *hdr6_out = NULL;
   message_data_t *message_data_wg = NULL;
@@ -457,6 +477,9 @@ wg_output_tun_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
   u32 adj_index = 0;
   u32 last_adj_index = ~0;
   index_t peeri = INDEX_INVALID;
+  const wg_awg_cfg_t *awg_cfg = NULL;
+  u32 data_magic = MESSAGE_DATA;
+  u32 data_junk = 0;
 
   f64 time = clib_time_now (&vm->clib_time) + vm->time_offset;
 
@@ -471,6 +494,9 @@ wg_output_tun_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
       u16 b_space_left_at_beginning;
       u32 bi = from[b - bufs];
 
+      if (PREDICT_FALSE (b[0]->flags & VNET_BUFFER_F_GSO))
+	break;
+
       if (n_left_from > 2)
 	{
 	  u8 *p;
@@ -495,6 +521,9 @@ wg_output_tun_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	      goto out;
 	    }
 	  peer = wg_peer_get (peeri);
+	  awg_cfg = wg_peer_awg_cfg (peer);
+	  data_magic = wg_awg_get_magic_header (awg_cfg, MESSAGE_DATA);
+	  data_junk = wg_awg_get_header_junk_size (awg_cfg, MESSAGE_DATA);
 	}
 
       if (!peer || wg_peer_is_dead (peer))
@@ -507,11 +536,15 @@ wg_output_tun_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	  /* this is the first packet to use this peer, claim the peer
 	   * for this thread.
 	   */
-	  clib_atomic_cmp_and_swap (&peer->output_thread_index, ~0,
-				    wg_peer_assign_thread (thread_index));
+	  u32 ti = wg_peer_assign_thread (thread_index);
+
+	  if (~0 == clib_atomic_cmp_and_swap (&peer->output_thread_index, ~0,
+					      ti))
+	    wg_timers_bind_thread (peer, ti);
 	}
 
-      if (PREDICT_FALSE (thread_index != peer->output_thread_index))
+      if (PREDICT_FALSE (thread_index != peer->output_thread_index &&
+			 !wg_peer_output_any_thread (peer)))
 	{
 	  noop_next[0] = WG_OUTPUT_NEXT_HANDOFF;
 	  err = WG_OUTPUT_NEXT_HANDOFF;
@@ -542,17 +575,17 @@ wg_output_tun_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 
       /* Ensure there is enough free space at the beginning of the first buffer
        * to write ethernet header (e.g. IPv6 VxLAN over IPv6 Wireguard will
-       * trigger this)
+       * trigger this), and the AWG header junk of the data message
        */
       ASSERT ((signed) b[0]->current_data >=
 	      (signed) -VLIB_BUFFER_PRE_DATA_SIZE);
       b_space_left_at_beginning =
 	b[0]->current_data + VLIB_BUFFER_PRE_DATA_SIZE;
       if (PREDICT_FALSE (b_space_left_at_beginning <
-			 sizeof (ethernet_header_t)))
+			 sizeof (ethernet_header_t) + data_junk))
 	{
-	  u32 size_diff =
-	    sizeof (ethernet_header_t) - b_space_left_at_beginning;
+	  u32 size_diff = sizeof (ethernet_header_t) + data_junk -
+			  b_space_left_at_beginning;
 
 	  /* Can only move buffer when it's single and has enough free space*/
 	  if (lb == b[0] &&
@@ -652,10 +685,23 @@ wg_output_tun_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	}
 
       err = WG_OUTPUT_NEXT_INTERFACE_OUTPUT;
+      vlib_increment_combined_counter (&wg_peer_tx_counters, thread_index,
+				       peeri, 1 /* packets */,
+				       plain_data_len_total);
+
+      message_data_wg->header.type = data_magic;
+      if (PREDICT_FALSE (data_junk))
+	{
+	  wg_output_tun_add_junk (b[0], data_junk, is_ip4_out);
+	  if (is_ip4_out)
+	    hdr4_out = vlib_buffer_get_current (b[0]);
+	  else
+	    hdr6_out = vlib_buffer_get_current (b[0]);
+	  encrypted_packet_len += data_junk;
+	}
 
       if (is_ip4_out)
 	{
-	  hdr4_out->wg.header.type = MESSAGE_DATA;
 	  hdr4_out->udp.length = clib_host_to_net_u16 (encrypted_packet_len +
 						       sizeof (udp_header_t));
 	  ip4_header_set_len_w_chksum (
@@ -664,7 +710,6 @@ wg_output_tun_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
 	}
       else
 	{
-	  hdr6_out->wg.header.type = MESSAGE_DATA;
 	  hdr6_out->ip6.payload_length = hdr6_out->udp.length =
 	    clib_host_to_net_u16 (encrypted_packet_len +
 				  sizeof (udp_header_t));
@@ -760,6 +805,73 @@ wg_output_tun_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
       vlib_buffer_enqueue_to_next (vm, node, noop_bi, noop_nexts, n_noop);
     }
 
+  return b - bufs;
+}
+
+/*
+ * Segment a GSO buffer and encrypt its segments. The segments keep the
+ * midchain rewrite of the original, so they are encrypted in the same
+ * dispatch without a trip through the gso node.
+ */
+static_always_inline void
+wg_output_tun_segment (vlib_main_t *vm, vlib_node_runtime_t *node,
+		       wg_per_thread_data_t *ptd, u32 bi, u16 async_next_node)
+{
+  vlib_buffer_t *b = vlib_get_buffer (vm, bi);
+  u32 *from, n_left, n;
+
+  if (PREDICT_FALSE (
+	0 == gso_segment_buffer_inline (vm, &ptd->gso, b, 0 /* is_l2 */)))
+    {
+      b->error = node->errors[WG_OUTPUT_ERROR_NO_BUFFERS];
+      vlib_buffer_enqueue_to_single_next (vm, node, &bi, WG_OUTPUT_NEXT_ERROR,
+					  1);
+      vec_set_len (ptd->gso.split_buffers, 0);
+      return;
+    }
+  vlib_buffer_free_one (vm, bi);
+
+  from = ptd->gso.split_buffers;
+  n_left = vec_len (ptd->gso.split_buffers);
+  while (n_left > 0)
+    {
+      n = wg_output_tun_encrypt (vm, node, ptd, from,
+				 clib_min (n_left, VLIB_FRAME_SIZE),
+				 async_next_node);
+      from += n;
+      n_left -= n;
+    }
+  vec_set_len (ptd->gso.split_buffers, 0);
+}
+
+/* is_ip4 - inner header flag */
+always_inline uword
+wg_output_tun_inline (vlib_main_t *vm, vlib_node_runtime_t *node,
+		      vlib_frame_t *frame, u8 is_ip4, u16 async_next_node)
+{
+  wg_main_t *wmp = &wg_main;
+  wg_per_thread_data_t *ptd =
+    vec_elt_at_index (wmp->per_thread_data, vm->thread_index);
+  u32 *from = vlib_frame_vector_args (frame);
+  u32 n_left_from = frame->n_vectors;
+  u32 n;
+
+  while (n_left_from > 0)
+    {
+      n = wg_output_tun_encrypt (vm, node, ptd, from, n_left_from,
+				 async_next_node);
+      from += n;
+      n_left_from -= n;
+
+      /* the encrypt loop stopped at a GSO buffer */
+      if (PREDICT_FALSE (n_left_from > 0))
+	{
+	  wg_output_tun_segment (vm, node, ptd, from[0], async_next_node);
+	  from += 1;
+	  n_left_from -= 1;
+	}
+    }
+
   return frame->n_vectors;
 }
 
@@ -28,6 +28,24 @@
 
 wg_peer_t *wg_peer_pool;
 
+vlib_combined_counter_main_t wg_peer_rx_counters = {
+  .name = "wg peer rx",
+  .stat_segment_name = "/wg/peer/rx",
+};
+vlib_combined_counter_main_t wg_peer_tx_counters = {
+  .name = "wg peer tx",
+  .stat_segment_name = "/wg/peer/tx",
+};
+vlib_simple_counter_main_t wg_peer_counters[WG_PEER_N_COUNTERS] = {
+#define _(sym, str)                                                           \
+  [WG_PEER_COUNTER_##sym] = {                                                 \
+    .name = "wg peer " str,                                                   \
+    .stat_segment_name = "/wg/peer/" str,                                     \
+  },
+  foreach_wg_peer_counter
+#undef _
+};
+
 index_t *wg_peer_by_adj_index;
 
 static void
@@ -60,7 +78,7 @@ wg_peer_clear (vlib_main_t * vm, wg_peer_t * peer)
 
   peer->last_sent_handshake = vlib_time_now (vm) - (REKEY_TIMEOUT + 1);
 
-  clib_memset (&peer->cookie_maker, 0, sizeof (peer->cookie_maker));
+  cookie_maker_deinit (&peer->cookie_maker);
 
   wg_peer_endpoint_reset (&peer->src);
   wg_peer_endpoint_reset (&peer->dst);
@@ -75,7 +93,9 @@ wg_peer_clear (vlib_main_t * vm, wg_peer_t * peer)
     }
   peer->input_thread_index = ~0;
   peer->output_thread_index = ~0;
+  peer->multi_queue = false;
   peer->timer_wheel = 0;
+  peer->timer_thread_index = 0;
   peer->persistent_keepalive_interval = 0;
   peer->timer_handshake_attempts = 0;
   peer->last_sent_packet = 0;
@@ -90,6 +110,7 @@ wg_peer_clear (vlib_main_t * vm, wg_peer_t * peer)
   vec_free (peer->obfuscated_rewrite);
   peer->obfuscate = false;
   wg_peer_endpoint_reset (&peer->obfuscation_dst);
+  peer->awg_profile = INDEX_INVALID;
   vec_free (peer->allowed_ips);
   vec_free (peer->adj_indices);
 }
@@ -246,6 +267,7 @@ wg_peer_enable (vlib_main_t *vm, wg_peer_t *peer)
   clib_memcpy (public_key, peer->remote.r_public, NOISE_PUBLIC_KEY_LEN);
 
   noise_remote_init (vm, &peer->remote, peeri, public_key, wg_if->local_idx);
+  peer->remote.r_multi_queue = peer->multi_queue;
 
   wg_timers_send_first_handshake (peer);
 }
@@ -340,7 +362,10 @@ wg_peer_fill (vlib_main_t *vm, wg_peer_t *peer, u32 table_id,
 
   peer->table_id = table_id;
   peer->wg_sw_if_index = wg_sw_if_index;
-  peer->timer_wheel = &wg_main.timer_wheel;
+  /* on the main thread's wheel until a worker claims the peer */
+  peer->timer_thread_index = 0;
+  peer->timer_wheel =
+    &wg_main.per_thread_data[peer->timer_thread_index].timer_wheel;
   peer->persistent_keepalive_interval = persistent_keepalive_interval;
   peer->last_sent_handshake = vlib_time_now (vm) - (REKEY_TIMEOUT + 1);
   wg_peer_update_flags (perri, WG_PEER_STATUS_DEAD, false);
@@ -470,7 +495,7 @@ wg_peer_add (u32 tun_sw_if_index, const u8 public_key[NOISE_PUBLIC_KEY_LEN],
 	     const ip46_address_t *obfuscation_endpoint, u16 obfuscation_port,
 	     u32 *peer_index)
 {
-  wg_if_t *wg_if;
+  wg_if_t *wg_if, *other_if;
   wg_peer_t *peer;
   int rv;
 
@@ -483,13 +508,13 @@ wg_peer_add (u32 tun_sw_if_index, const u8 public_key[NOISE_PUBLIC_KEY_LEN],
   if (!wg_if)
     return (VNET_API_ERROR_INVALID_SW_IF_INDEX);
 
-  pool_foreach (peer, wg_peer_pool)
-   {
-    if (!memcmp (peer->remote.r_public, public_key, NOISE_PUBLIC_KEY_LEN))
+  /* public keys are unique across all interfaces */
+  pool_foreach (other_if, wg_if_pool)
     {
-      return (VNET_API_ERROR_ENTRY_ALREADY_EXISTS);
+      if (INDEX_INVALID !=
+	  wg_if_peer_find_by_public_key (other_if, public_key))
+	return (VNET_API_ERROR_ENTRY_ALREADY_EXISTS);
     }
-  }
 
   if (pool_elts (wg_peer_pool) > MAX_PEERS)
     return (VNET_API_ERROR_LIMIT_EXCEEDED);
@@ -498,6 +523,17 @@ wg_peer_add (u32 tun_sw_if_index, const u8 public_key[NOISE_PUBLIC_KEY_LEN],
 
   wg_peer_init (vm, peer);
 
+  index_t peeri = peer - wg_peer_pool;
+  vlib_validate_combined_counter (&wg_peer_rx_counters, peeri);
+  vlib_zero_combined_counter (&wg_peer_rx_counters, peeri);
+  vlib_validate_combined_counter (&wg_peer_tx_counters, peeri);
+  vlib_zero_combined_counter (&wg_peer_tx_counters, peeri);
+  for (int i = 0; i < WG_PEER_N_COUNTERS; i++)
+    {
+      vlib_validate_simple_counter (&wg_peer_counters[i], peeri);
+      vlib_zero_simple_counter (&wg_peer_counters[i], peeri);
+    }
+
   rv = wg_peer_fill (vm, peer, table_id, endpoint, (u16) port,
 		     persistent_keepalive, allowed_ips, tun_sw_if_index,
 		     obfuscate, obfuscation_endpoint, obfuscation_port);
@@ -538,14 +574,71 @@ wg_peer_remove (index_t peeri)
 
   wgi = wg_if_get (wg_if_find_by_sw_if_index (peer->wg_sw_if_index));
   wg_if_peer_remove (wgi, peeri);
+  if (peer->awg_profile != INDEX_INVALID)
+    wg_if_awg_profile_unlock (wgi, peer->awg_profile);
 
   noise_remote_clear (wmp->vlib_main, &peer->remote);
+  clib_spinlock_free (&peer->remote.r_handshake_lock);
   wg_peer_clear (wmp->vlib_main, peer);
   pool_put (wg_peer_pool, peer);
 
   return (0);
 }
 
+/*
+ * Give a peer its own AWG parameters (magic headers and junk sizes), or
+ * with a NULL cfg return it to its interface's.
+ */
+int
+wg_peer_set_awg (index_t peeri, const wg_awg_cfg_t *cfg)
+{
+  index_t profilei = INDEX_INVALID;
+  wg_peer_t *peer;
+  wg_if_t *wgi;
+  int rv;
+
+  if (pool_is_free_index (wg_peer_pool, peeri))
+    return VNET_API_ERROR_NO_SUCH_ENTRY;
+
+  peer = pool_elt_at_index (wg_peer_pool, peeri);
+  wgi = wg_if_get (wg_if_find_by_sw_if_index (peer->wg_sw_if_index));
+
+  /* lock the new profile first so that re-applying the current one
+   * cannot drop its last reference */
+  if (cfg)
+    {
+      rv = wg_if_awg_profile_lock (wgi, cfg, &profilei);
+      if (rv)
+	return (rv);
+    }
+
+  if (peer->awg_profile != INDEX_INVALID)
+    wg_if_awg_profile_unlock (wgi, peer->awg_profile);
+  peer->awg_profile = profilei;
+
+  return (0);
+}
+
+/*
+ * Allow the peer's keypairs to be used from several workers at once. It
+ * applies to the keypairs of the next session; until then the current
+ * one stays with the peer's input and output threads.
+ */
+int
+wg_peer_set_multi_queue (index_t peeri, bool enable)
+{
+  wg_peer_t *peer;
+
+  if (pool_is_free_index (wg_peer_pool, peeri))
+    return VNET_API_ERROR_NO_SUCH_ENTRY;
+
+  peer = pool_elt_at_index (wg_peer_pool, peeri);
+  peer->multi_queue = enable;
+  peer->remote.r_multi_queue = enable;
+
+  return (0);
+}
+
 index_t
 wg_peer_walk (wg_peer_walk_cb_t fn, void *data)
 {
@@ -577,6 +670,7 @@ format_wg_peer (u8 * s, va_list * va)
   fib_prefix_t *allowed_ip;
   adj_index_t *adj_index;
   u8 key[NOISE_KEY_LEN_BASE64];
+  vlib_counter_t rx, tx;
   wg_peer_t *peer;
 
   peer = wg_peer_get (peeri);
@@ -594,6 +688,36 @@ format_wg_peer (u8 * s, va_list * va)
       s = format (s, "\n  obfuscation: enabled, endpoint: %U",
 		  format_wg_peer_endpoint, &peer->obfuscation_dst);
     }
+  if (peer->awg_profile != INDEX_INVALID)
+    {
+      wg_if_t *wgi =
+	wg_if_get (wg_if_find_by_sw_if_index (peer->wg_sw_if_index));
+      wg_awg_cfg_t *cfg = wg_peer_get_awg_cfg (peer, wgi);
+
+      s = format (s, "\n  awg profile:%d magic-headers:[%u, %u, %u, %u]",
+		  peer->awg_profile, cfg->magic_header[0],
+		  cfg->magic_header[1], cfg->magic_header[2],
+		  cfg->magic_header[3]);
+    }
+  if (peer->multi_queue)
+    s = format (s, "\n  multi-queue: enabled, current keypair: %s",
+		peer->remote.r_current &&
+		    noise_keypair_is_multi_queue (peer->remote.r_current) ?
+		  "shared" :
+		  "pinned");
+  s = format (s, "\n  timer-thread: %u", peer->timer_thread_index);
+  vlib_get_combined_counter (&wg_peer_rx_counters, peeri, &rx);
+  vlib_get_combined_counter (&wg_peer_tx_counters, peeri, &tx);
+  s = format (s,
+	      "\n  rx: %llu packets %llu bytes, tx: %llu packets %llu bytes, "
+	      "handshakes: %llu, rekeys: %llu, decrypt-failures: %llu",
+	      rx.packets, rx.bytes, tx.packets, tx.bytes,
+	      vlib_get_simple_counter (
+		&wg_peer_counters[WG_PEER_COUNTER_HANDSHAKES], peeri),
+	      vlib_get_simple_counter (&wg_peer_counters[WG_PEER_COUNTER_REKEYS],
+				       peeri),
+	      vlib_get_simple_counter (
+		&wg_peer_counters[WG_PEER_COUNTER_DECRYPT_FAILURES], peeri));
   s = format (s, "\n  adj:");
   vec_foreach (adj_index, peer->adj_indices)
     {
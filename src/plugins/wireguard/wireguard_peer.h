@@ -79,6 +79,8 @@ typedef struct wg_peer
 
   u32 input_thread_index;
   u32 output_thread_index;
+  /* let workers share the keypairs instead of handing off to the above */
+  bool multi_queue;
 
   /* Peer addresses */
   wg_peer_endpoint_t dst;
@@ -94,6 +96,9 @@ typedef struct wg_peer
   wg_peer_endpoint_t obfuscation_dst; /* Obfuscated destination endpoint */
   u8 *obfuscated_rewrite;	       /* Obfuscated rewrite template */
 
+  /* AWG profile on the interface overriding its own, or INDEX_INVALID */
+  index_t awg_profile;
+
   /* TCP state (only used when transport is TCP) */
   wg_tcp_state_t tcp_state;
 
@@ -110,6 +115,7 @@ typedef struct wg_peer
 
   /* Timers */
   tw_timer_wheel_16t_2w_512sl_t *timer_wheel;
+  u32 timer_thread_index;
   u32 timers[WG_N_TIMERS];
   u8 timers_dispatched[WG_N_TIMERS];
   u32 timer_handshake_attempts;
@@ -149,6 +155,8 @@ int wg_peer_add (u32 tun_sw_if_index,
 		 const ip46_address_t * obfuscation_endpoint,
 		 u16 obfuscation_port, index_t * peer_index);
 int wg_peer_remove (u32 peer_index);
+int wg_peer_set_awg (index_t peeri, const wg_awg_cfg_t *cfg);
+int wg_peer_set_multi_queue (index_t peeri, bool enable);
 
 typedef walk_rc_t (*wg_peer_walk_cb_t) (index_t peeri, void *arg);
 index_t wg_peer_walk (wg_peer_walk_cb_t fn, void *data);
@@ -179,12 +187,45 @@ wg_peer_is_dead (wg_peer_t *peer)
 extern index_t *wg_peer_by_adj_index;
 extern wg_peer_t *wg_peer_pool;
 
+/*
+ * Per-peer counters, indexed by peer pool index and exported in the stats
+ * segment under /wg/peer/, so they can be scraped without an API dump.
+ * last-handshake is a gauge of the unix time, kept in thread 0's slot.
+ */
+#define foreach_wg_peer_counter                                               \
+  _ (HANDSHAKES, "handshakes")                                                \
+  _ (REKEYS, "rekeys")                                                        \
+  _ (DECRYPT_FAILURES, "decrypt-failures")                                    \
+  _ (LAST_HANDSHAKE, "last-handshake")
+
+typedef enum wg_peer_counter_t_
+{
+#define _(sym, str) WG_PEER_COUNTER_##sym,
+  foreach_wg_peer_counter
+#undef _
+    WG_PEER_N_COUNTERS,
+} wg_peer_counter_t;
+
+extern vlib_combined_counter_main_t wg_peer_rx_counters;
+extern vlib_combined_counter_main_t wg_peer_tx_counters;
+extern vlib_simple_counter_main_t wg_peer_counters[WG_PEER_N_COUNTERS];
+
 static inline wg_peer_t *
 wg_peer_get (index_t peeri)
 {
   return (pool_elt_at_index (wg_peer_pool, peeri));
 }
 
+/* A session was derived, by either side of the handshake */
+static_always_inline void
+wg_peer_count_handshake (vlib_main_t *vm, index_t peeri)
+{
+  vlib_increment_simple_counter (
+    &wg_peer_counters[WG_PEER_COUNTER_HANDSHAKES], vm->thread_index, peeri, 1);
+  vlib_set_simple_counter (&wg_peer_counters[WG_PEER_COUNTER_LAST_HANDSHAKE],
+			   0, peeri, (u64) unix_time_now ());
+}
+
 static inline index_t
 wg_peer_get_by_adj_index (index_t ai)
 {
@@ -205,6 +246,38 @@ wg_peer_assign_thread (u32 thread_id)
 	      1) : thread_id));
 }
 
+/*
+ * Multi-queue keypairs encrypt on whichever worker the packet arrives on.
+ */
+static_always_inline bool
+wg_peer_output_any_thread (const wg_peer_t *peer)
+{
+  const noise_keypair_t *kp = peer->remote.r_current;
+
+  return (kp != NULL && noise_keypair_is_multi_queue (kp));
+}
+
+/*
+ * Thread that decrypts a data packet. For multi-queue keypairs the
+ * sender's nonce blocks are spread over the workers, which keeps the
+ * packets of one block, and so mostly of one inner flow, in order.
+ */
+static_always_inline u32
+wg_peer_input_thread (wg_peer_t *peer, u32 r_idx, u64 counter)
+{
+  noise_keypair_t *kp;
+  u32 n_workers;
+
+  if (PREDICT_TRUE (!peer->remote.r_has_multi_queue_keypair))
+    return peer->input_thread_index;
+
+  kp = wg_get_active_keypair (&peer->remote, r_idx);
+  n_workers = vlib_num_workers ();
+  if (kp != NULL && noise_keypair_is_multi_queue (kp) && n_workers)
+    return 1 + (counter / NOISE_COUNTER_BLOCK) % n_workers;
+  return peer->input_thread_index;
+}
+
 static_always_inline bool
 fib_prefix_is_cover_addr_46 (const fib_prefix_t *p1, const ip46_address_t *ip)
 {
@@ -234,6 +307,24 @@ wg_peer_get_rewrite (wg_peer_t *peer)
   return (peer->obfuscate && peer->obfuscated_rewrite) ? peer->obfuscated_rewrite : peer->rewrite;
 }
 
+/* AWG configuration a peer sends with: its own profile or its interface's */
+static inline wg_awg_cfg_t *
+wg_peer_get_awg_cfg (wg_peer_t *peer, wg_if_t *wgi)
+{
+  if (PREDICT_FALSE (peer->awg_profile != INDEX_INVALID))
+    return (&pool_elt_at_index (wgi->awg_profiles, peer->awg_profile)->cfg);
+  return (&wgi->awg_cfg);
+}
+
+/* The same, found from the interface the peer is attached to */
+static inline wg_awg_cfg_t *
+wg_peer_awg_cfg (wg_peer_t *peer)
+{
+  index_t wgii = wg_if_find_by_sw_if_index (peer->wg_sw_if_index);
+
+  return (wg_peer_get_awg_cfg (peer, wg_if_get (wgii)));
+}
+
 #endif // __included_wg_peer_h__
 
 /*
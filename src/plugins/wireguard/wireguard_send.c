@@ -25,25 +25,33 @@
 #include <wireguard/wireguard_awg.h>
 
 int
-ip46_enqueue_packet (vlib_main_t *vm, u32 bi0, int is_ip4)
+ip46_enqueue_packets (vlib_main_t *vm, u32 *bis, u32 n_bis, int is_ip4)
 {
   vlib_frame_t *f = 0;
   u32 lookup_node_index =
     is_ip4 ? ip4_lookup_node.index : ip6_lookup_node.index;
 
+  ASSERT (n_bis <= VLIB_FRAME_SIZE);
+
   f = vlib_get_frame_to_node (vm, lookup_node_index);
   /* f can not be NULL here - frame allocation failure causes panic */
 
   u32 *to_next = vlib_frame_vector_args (f);
-  f->n_vectors = 1;
-  to_next[0] = bi0;
+  f->n_vectors = n_bis;
+  vlib_buffer_copy_indices (to_next, bis, n_bis);
 
   vlib_put_frame_to_node (vm, lookup_node_index, f);
 
   return f->n_vectors;
 }
 
-static void
+int
+ip46_enqueue_packet (vlib_main_t *vm, u32 bi0, int is_ip4)
+{
+  return ip46_enqueue_packets (vm, &bi0, 1, is_ip4);
+}
+
+void
 wg_buffer_prepend_rewrite (vlib_main_t *vm, vlib_buffer_t *b0,
 			   const u8 *rewrite, u8 is_ip4)
 {
@@ -86,9 +94,6 @@ wg_buffer_prepend_rewrite (vlib_main_t *vm, vlib_buffer_t *b0,
     }
 }
 
-/* Forward declaration */
-static int ip46_enqueue_packet (vlib_main_t *vm, u32 bi0, int is_ip4);
-
 bool
 wg_create_buffer (vlib_main_t *vm, const u8 *rewrite, const u8 *packet,
 		  u32 packet_len, u32 *bi, u8 is_ip4)
@@ -148,6 +153,68 @@ wg_create_buffer_with_junk (vlib_main_t *vm, const u8 *rewrite,
   return true;
 }
 
+/*
+ * Junk packets sent ahead of a handshake. The junk is generated straight
+ * into the vlib buffers, which are allocated in one go; the buffer indices
+ * are stored in bis so the caller sends them in one frame with the
+ * handshake.
+ */
+u32
+wg_awg_add_junk_packets (vlib_main_t *vm, const wg_awg_cfg_t *cfg,
+			 const u8 *rewrite, u8 is_ip4, u32 *bis)
+{
+  u32 sizes[WG_AWG_MAX_JUNK_PACKET_COUNT];
+  u32 n_sizes, n_alloc, i;
+
+  if (!(n_sizes = wg_awg_junk_sizes (cfg, sizes)))
+    return 0;
+
+  n_alloc = vlib_buffer_alloc (vm, bis, n_sizes);
+
+  for (i = 0; i < n_alloc; i++)
+    {
+      vlib_buffer_t *b = vlib_get_buffer (vm, bis[i]);
+
+      wg_awg_generate_junk (vlib_buffer_get_current (b), sizes[i]);
+      b->current_length = sizes[i];
+      wg_buffer_prepend_rewrite (vm, b, rewrite, is_ip4);
+    }
+
+  return n_alloc;
+}
+
+/*
+ * i-header signature chain packets (AmneziaWG 1.5), stored as above. Each
+ * one is rendered from its compiled template straight into the buffer.
+ */
+u32
+wg_awg_add_i_header_packets (vlib_main_t *vm, wg_awg_cfg_t *cfg,
+			     const u8 *rewrite, u8 is_ip4, u32 *bis)
+{
+  wg_awg_i_header_t *ihdrs[WG_AWG_MAX_I_HEADERS];
+  u32 i, n_ihdrs, n_alloc;
+  u64 now;
+
+  n_ihdrs =
+    wg_awg_i_headers (cfg, vlib_buffer_get_default_data_size (vm), ihdrs);
+  if (!n_ihdrs)
+    return 0;
+
+  n_alloc = vlib_buffer_alloc (vm, bis, n_ihdrs);
+  now = (u64) unix_time_now ();
+
+  for (i = 0; i < n_alloc; i++)
+    {
+      vlib_buffer_t *b = vlib_get_buffer (vm, bis[i]);
+
+      wg_awg_render_i_header (ihdrs[i], vlib_buffer_get_current (b), now);
+      b->current_length = ihdrs[i]->total_size;
+      wg_buffer_prepend_rewrite (vm, b, rewrite, is_ip4);
+    }
+
+  return n_alloc;
+}
+
 u8 *
 wg_build_rewrite (ip46_address_t *src_addr, u16 src_port,
 		  ip46_address_t *dst_addr, u16 dst_port, u8 is_ip4)
@@ -214,10 +281,8 @@ wg_send_handshake (vlib_main_t * vm, wg_peer_t * peer, bool is_retry)
       wg_peer_is_dead (peer))
     return true;
 
-  /* Get AWG configuration from interface */
-  index_t wgii = wg_if_find_by_sw_if_index (peer->wg_sw_if_index);
-  wg_if_t *wg_if = wg_if_get (wgii);
-  wg_awg_cfg_t *awg_cfg = &wg_if->awg_cfg;
+  /* AWG configuration of the peer, or else of its interface */
+  wg_awg_cfg_t *awg_cfg = wg_peer_awg_cfg (peer);
 
   if (noise_create_initiation (vm,
 			       &peer->remote,
@@ -227,7 +292,8 @@ wg_send_handshake (vlib_main_t * vm, wg_peer_t * peer, bool is_retry)
 			       packet.encrypted_timestamp))
     {
       /* Use AWG magic header if enabled */
-      packet.header.type = wg_awg_get_magic_header (awg_cfg, MESSAGE_HANDSHAKE_INITIATION);
+      packet.header.type =
+	wg_awg_get_magic_header (awg_cfg, MESSAGE_HANDSHAKE_INITIATION);
       cookie_maker_mac (&peer->cookie_maker, &packet.macs, &packet,
 			sizeof (packet));
       wg_timers_any_authenticated_packet_sent (peer);
@@ -240,41 +306,41 @@ wg_send_handshake (vlib_main_t * vm, wg_peer_t * peer, bool is_retry)
     return false;
 
   u8 is_ip4 = ip46_address_is_ip4 (&peer->dst.addr);
-  u32 bi0 = 0;
+  u32 bis[WG_AWG_MAX_PRE_HANDSHAKE_PACKETS + 1];
+  u32 n_bis = 0;
   f64 now = vlib_time_now (vm);
 
   /* Get the appropriate rewrite (normal or obfuscated) for this peer */
   u8 *rewrite = wg_peer_get_rewrite (peer);
 
-  /* Check if this is a special handshake (every 120s) for i-headers */
-  if (wg_awg_is_enabled (awg_cfg) && wg_awg_needs_special_handshake (awg_cfg, now))
-    {
-      /* Send i-header signature chain (i1-i5) for protocol masquerading */
-      wg_awg_send_i_header_packets (vm, awg_cfg, rewrite, is_ip4);
-    }
-
-  /* Send junk packets before handshake if AWG is enabled */
   if (wg_awg_is_enabled (awg_cfg))
     {
-      wg_awg_send_junk_packets (vm, awg_cfg, rewrite, is_ip4);
-    }
+      /* i-header signature chain (i1-i5) on special handshakes (every
+       * 120s) for protocol masquerading, then the junk packets */
+      if (wg_awg_needs_special_handshake (awg_cfg, now))
+	n_bis += wg_awg_add_i_header_packets (vm, awg_cfg, rewrite, is_ip4,
+					      bis + n_bis);
+      n_bis +=
+	wg_awg_add_junk_packets (vm, awg_cfg, rewrite, is_ip4, bis + n_bis);
 
-  /* Create packet with or without AWG junk header */
-  if (wg_awg_is_enabled (awg_cfg))
-    {
       if (!wg_create_buffer_with_junk (vm, rewrite, (u8 *) &packet,
-				       sizeof (packet), &bi0, is_ip4, awg_cfg,
-				       MESSAGE_HANDSHAKE_INITIATION))
-	return false;
+				       sizeof (packet), &bis[n_bis], is_ip4,
+				       awg_cfg, MESSAGE_HANDSHAKE_INITIATION))
+	{
+	  vlib_buffer_free (vm, bis, n_bis);
+	  return false;
+	}
     }
   else
     {
       if (!wg_create_buffer (vm, rewrite, (u8 *) &packet, sizeof (packet),
-			     &bi0, is_ip4))
+			     &bis[n_bis], is_ip4))
 	return false;
     }
+  n_bis++;
 
-  ip46_enqueue_packet (vm, bi0, is_ip4);
+  /* the whole sequence goes out in one frame, in order */
+  ip46_enqueue_packets (vm, bis, n_bis, is_ip4);
   return true;
 }
 
@@ -324,8 +390,6 @@ wg_send_handshake_from_mt (u32 peer_idx, bool is_retry)
 bool
 wg_send_keepalive (vlib_main_t * vm, wg_peer_t * peer)
 {
-  ASSERT (vm->thread_index == 0);
-
   if (!wg_peer_can_send (peer))
     return false;
 
@@ -338,7 +402,7 @@ wg_send_keepalive (vlib_main_t * vm, wg_peer_t * peer)
 
   if (!peer->remote.r_current)
     {
-      wg_send_handshake (vm, peer, false);
+      wg_send_handshake_any_thread (vm, peer, false);
       goto out;
     }
 
@@ -350,7 +414,7 @@ wg_send_keepalive (vlib_main_t * vm, wg_peer_t * peer)
 
   if (PREDICT_FALSE (state == SC_KEEP_KEY_FRESH))
     {
-      wg_send_handshake (vm, peer, false);
+      wg_send_handshake_any_thread (vm, peer, false);
     }
   else if (PREDICT_FALSE (state == SC_FAILED))
     {
@@ -360,11 +424,13 @@ wg_send_keepalive (vlib_main_t * vm, wg_peer_t * peer)
     }
 
   u8 is_ip4 = ip46_address_is_ip4 (&peer->dst.addr);
-  packet->header.type = MESSAGE_DATA;
+  wg_awg_cfg_t *awg_cfg = wg_peer_awg_cfg (peer);
+  packet->header.type = wg_awg_get_magic_header (awg_cfg, MESSAGE_DATA);
   u8 *rewrite = wg_peer_get_rewrite (peer);
 
-  if (!wg_create_buffer (vm, rewrite, (u8 *) packet, size_of_packet,
-			 &bi0, is_ip4))
+  if (!wg_create_buffer_with_junk (vm, rewrite, (u8 *) packet,
+				   size_of_packet, &bi0, is_ip4, awg_cfg,
+				   MESSAGE_DATA))
     {
       ret = false;
       goto out;
@@ -379,44 +445,59 @@ out:
   return ret;
 }
 
+/*
+ * Create the response to the initiation just consumed for a peer. This
+ * is the DH work and runs on the thread the initiation arrived on.
+ */
 bool
-wg_send_handshake_response (vlib_main_t * vm, wg_peer_t * peer)
+wg_create_handshake_response (vlib_main_t *vm, wg_peer_t *peer,
+			      message_handshake_response_t *packet)
 {
-  message_handshake_response_t packet;
+  if (!noise_create_response (vm, &peer->remote, &packet->sender_index,
+			      &packet->receiver_index,
+			      packet->unencrypted_ephemeral,
+			      packet->encrypted_nothing))
+    return false;
+
+  packet->header.type = wg_awg_get_magic_header (wg_peer_awg_cfg (peer),
+						 MESSAGE_HANDSHAKE_RESPONSE);
+  cookie_maker_mac (&peer->cookie_maker, &packet->macs, packet,
+		    sizeof (*packet));
+  return true;
+}
+
+/* Install the session of a created response and send it, main thread */
+bool
+wg_send_handshake_response (vlib_main_t *vm, wg_peer_t *peer,
+			    message_handshake_response_t *packet)
+{
+  wg_awg_cfg_t *awg_cfg;
+
+  ASSERT (vm->thread_index == 0);
 
   if (!wg_peer_can_send (peer))
     return false;
 
-  if (noise_create_response (vm,
-			     &peer->remote,
-			     &packet.sender_index,
-			     &packet.receiver_index,
-			     packet.unencrypted_ephemeral,
-			     packet.encrypted_nothing))
-    {
-      packet.header.type = MESSAGE_HANDSHAKE_RESPONSE;
-      cookie_maker_mac (&peer->cookie_maker, &packet.macs, &packet,
-			sizeof (packet));
+  if (!noise_remote_begin_session (vm, &peer->remote, packet->sender_index))
+    return false;
 
-      if (noise_remote_begin_session (vm, &peer->remote))
-	{
-	  wg_timers_session_derived (peer);
-	  wg_timers_any_authenticated_packet_sent (peer);
-	  wg_timers_any_authenticated_packet_traversal (peer);
-
-	  u32 bi0 = 0;
-	  u8 is_ip4 = ip46_address_is_ip4 (&peer->dst.addr);
-	  u8 *rewrite = wg_peer_get_rewrite (peer);
-	  if (!wg_create_buffer (vm, rewrite, (u8 *) &packet,
-				 sizeof (packet), &bi0, is_ip4))
-	    return false;
-
-	  ip46_enqueue_packet (vm, bi0, is_ip4);
-	  return true;
-	}
-      return false;
-    }
-  return false;
+  wg_peer_count_handshake (vm, peer - wg_peer_pool);
+  wg_timers_session_derived (peer);
+  wg_timers_any_authenticated_packet_sent (peer);
+  wg_timers_any_authenticated_packet_traversal (peer);
+
+  u32 bi0 = 0;
+  u8 is_ip4 = ip46_address_is_ip4 (&peer->dst.addr);
+  u8 *rewrite = wg_peer_get_rewrite (peer);
+
+  awg_cfg = wg_peer_awg_cfg (peer);
+  if (!wg_create_buffer_with_junk (vm, rewrite, (u8 *) packet,
+				   sizeof (*packet), &bi0, is_ip4, awg_cfg,
+				   MESSAGE_HANDSHAKE_RESPONSE))
+    return false;
+
+  ip46_enqueue_packet (vm, bi0, is_ip4);
+  return true;
 }
 
 bool
@@ -424,12 +505,13 @@ wg_send_handshake_cookie (vlib_main_t *vm, u32 sender_index,
 			  cookie_checker_t *cookie_checker,
 			  message_macs_t *macs, ip46_address_t *wg_if_addr,
 			  u16 wg_if_port, ip46_address_t *remote_addr,
-			  u16 remote_port)
+			  u16 remote_port, const wg_awg_cfg_t *awg_cfg)
 {
   message_handshake_cookie_t packet;
   u8 *rewrite;
 
-  packet.header.type = MESSAGE_HANDSHAKE_COOKIE;
+  packet.header.type =
+    wg_awg_get_magic_header (awg_cfg, MESSAGE_HANDSHAKE_COOKIE);
   packet.receiver_index = sender_index;
 
   cookie_checker_create_payload (vm, cookie_checker, macs, packet.nonce,
@@ -442,8 +524,9 @@ wg_send_handshake_cookie (vlib_main_t *vm, u32 sender_index,
   rewrite = wg_build_rewrite (wg_if_addr, wg_if_port, remote_addr, remote_port,
 			      is_ip4);
 
-  ret = wg_create_buffer (vm, rewrite, (u8 *) &packet, sizeof (packet), &bi0,
-			  is_ip4);
+  ret = wg_create_buffer_with_junk (vm, rewrite, (u8 *) &packet,
+				    sizeof (packet), &bi0, is_ip4, awg_cfg,
+				    MESSAGE_HANDSHAKE_COOKIE);
   vec_free (rewrite);
   if (!ret)
     return false;
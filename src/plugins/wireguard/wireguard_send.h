@@ -26,17 +26,43 @@ u8 *wg_build_rewrite (ip46_address_t *src_addr, u16 src_port,
 bool wg_send_keepalive (vlib_main_t * vm, wg_peer_t * peer);
 bool wg_send_handshake (vlib_main_t * vm, wg_peer_t * peer, bool is_retry);
 void wg_send_handshake_from_mt (u32 peer_index, bool is_retry);
-bool wg_send_handshake_response (vlib_main_t * vm, wg_peer_t * peer);
+
+/* Handshakes are created on the main thread, other threads ask it to */
+static_always_inline void
+wg_send_handshake_any_thread (vlib_main_t *vm, wg_peer_t *peer, bool is_retry)
+{
+  if (vm->thread_index == 0)
+    wg_send_handshake (vm, peer, is_retry);
+  else
+    wg_send_handshake_from_mt (peer - wg_peer_pool, is_retry);
+}
+bool wg_create_handshake_response (vlib_main_t *vm, wg_peer_t *peer,
+				   message_handshake_response_t *packet);
+bool wg_send_handshake_response (vlib_main_t *vm, wg_peer_t *peer,
+				 message_handshake_response_t *packet);
 bool wg_send_handshake_cookie (vlib_main_t *vm, u32 sender_index,
 			       cookie_checker_t *cookie_checker,
 			       message_macs_t *macs,
 			       ip46_address_t *wg_if_addr, u16 wg_if_port,
-			       ip46_address_t *remote_addr, u16 remote_port);
+			       ip46_address_t *remote_addr, u16 remote_port,
+			       const wg_awg_cfg_t *awg_cfg);
 
 /* AWG helper functions - exported for use in awg.c */
 bool wg_create_buffer (vlib_main_t *vm, const u8 *rewrite, const u8 *packet,
 		       u32 packet_len, u32 *bi, u8 is_ip4);
+void wg_buffer_prepend_rewrite (vlib_main_t *vm, vlib_buffer_t *b0,
+				const u8 *rewrite, u8 is_ip4);
 int ip46_enqueue_packet (vlib_main_t *vm, u32 bi0, int is_ip4);
+int ip46_enqueue_packets (vlib_main_t *vm, u32 *bis, u32 n_bis, int is_ip4);
+
+/* Build junk packets, storing their buffer indices in bis; returns count */
+u32 wg_awg_add_junk_packets (vlib_main_t *vm, const wg_awg_cfg_t *cfg,
+			     const u8 *rewrite, u8 is_ip4, u32 *bis);
+
+/* Build i-header signature chain packets (i1-i5) before special
+ * handshakes, storing their buffer indices in bis; returns count */
+u32 wg_awg_add_i_header_packets (vlib_main_t *vm, wg_awg_cfg_t *cfg,
+				 const u8 *rewrite, u8 is_ip4, u32 *bis);
 
 always_inline void
 ip4_header_set_len_w_chksum (ip4_header_t * ip4, u16 len)
@@ -43,49 +43,123 @@ stop_timer (wg_peer_t * peer, u32 timer_id)
     }
 }
 
+static vlib_node_registration_t wg_timer_input_node;
+
+/* Wake this worker's wg-timer-input in ticks, unless it is due sooner */
+static void
+wg_timer_input_schedule (vlib_main_t *vm, wg_per_thread_data_t *ptd,
+			 u32 ticks)
+{
+  f64 when = vlib_time_now (vm) + ticks * WG_TICK;
+
+  if (vlib_node_is_scheduled (vm, wg_timer_input_node.index))
+    {
+      if (ptd->timer_wake_time <= when)
+	return;
+      vlib_node_unschedule (vm, wg_timer_input_node.index);
+    }
+  ptd->timer_wake_time = when;
+  vlib_node_schedule (vm, wg_timer_input_node.index, ticks * WG_TICK);
+}
+
 static void
 start_timer (wg_peer_t * peer, u32 timer_id, u32 interval_ticks)
 {
-  ASSERT (vlib_get_thread_index () == 0);
+  vlib_main_t *vm = vlib_get_main ();
+
+  ASSERT (vm->thread_index == peer->timer_thread_index);
 
   if (peer->timers[timer_id] == ~0)
     {
       peer->timers[timer_id] =
 	tw_timer_start_16t_2w_512sl (peer->timer_wheel, peer - wg_peer_pool,
 				     timer_id, interval_ticks);
+
+      /* the main thread's wheel is run by wg-timer-manager */
+      if (vm->thread_index)
+	wg_timer_input_schedule (
+	  vm, vec_elt_at_index (wg_main.per_thread_data, vm->thread_index),
+	  interval_ticks);
     }
 }
 
-typedef struct
+/*
+ * Arm a timer from any thread. The owner of the peer's wheel starts it
+ * directly, other threads queue the request for the owner to apply on
+ * its next tick; at most one request per timer is in flight.
+ */
+static_always_inline void
+start_timer_from_mt (u32 peer_idx, u32 timer_id, u32 interval_ticks)
 {
-  u32 peer_idx;
-  u32 timer_id;
-  u32 interval_ticks;
+  wg_peer_t *peer = wg_peer_get (peer_idx);
+  wg_per_thread_data_t *ptd;
+
+  if (vlib_get_thread_index () == peer->timer_thread_index)
+    {
+      start_timer (peer, timer_id, interval_ticks);
+      return;
+    }
 
-} wg_timers_args;
+  if (PREDICT_FALSE (!peer->timers_dispatched[timer_id]))
+    if (!clib_atomic_cmp_and_swap (&peer->timers_dispatched[timer_id], 0, 1))
+      {
+	wg_timer_arm_t a = {
+	  .peer_idx = peer_idx,
+	  .timer_id = timer_id,
+	  .interval_ticks = interval_ticks,
+	};
+
+	ptd = vec_elt_at_index (wg_main.per_thread_data,
+				peer->timer_thread_index);
+	clib_spinlock_lock (&ptd->timer_lock);
+	vec_add1 (ptd->timer_arms, a);
+	clib_spinlock_unlock (&ptd->timer_lock);
+
+	if (peer->timer_thread_index)
+	  vlib_node_set_interrupt_pending (
+	    vlib_get_main_by_index (peer->timer_thread_index),
+	    wg_timer_input_node.index);
+      }
+}
 
-static void *
-start_timer_thread_fn (void *arg)
+/* Apply the arm requests other threads queued for this thread's wheel */
+static void
+wg_timer_arms_apply (wg_per_thread_data_t *ptd)
 {
-  wg_timers_args *a = arg;
-  wg_peer_t *peer = wg_peer_get (a->peer_idx);
-  start_timer (peer, a->timer_id, a->interval_ticks);
-  return 0;
+  wg_timer_arm_t *a, *arms;
+  wg_peer_t *peer;
+
+  if (!vec_len (ptd->timer_arms))
+    return;
+
+  clib_spinlock_lock (&ptd->timer_lock);
+  arms = ptd->timer_arms;
+  ptd->timer_arms = ptd->timer_arms_drain;
+  clib_spinlock_unlock (&ptd->timer_lock);
+
+  vec_foreach (a, arms)
+    {
+      peer = wg_peer_get (a->peer_idx);
+      start_timer (peer, a->timer_id, a->interval_ticks);
+    }
+
+  vec_reset_length (arms);
+  ptd->timer_arms_drain = arms;
 }
 
-static_always_inline void
-start_timer_from_mt (u32 peer_idx, u32 timer_id, u32 interval_ticks)
+static void *
+wg_zero_key_material_thread_fn (void *arg)
 {
-  wg_timers_args a = {
-    .peer_idx = peer_idx,
-    .timer_id = timer_id,
-    .interval_ticks = interval_ticks,
-  };
-  wg_peer_t *peer = wg_peer_get (peer_idx);
-  if (PREDICT_FALSE (!peer->timers_dispatched[timer_id]))
-    if (!clib_atomic_cmp_and_swap (&peer->timers_dispatched[timer_id], 0, 1))
-      vl_api_rpc_call_main_thread (start_timer_thread_fn, (u8 *) &a,
-				   sizeof (a));
+  u32 *peer_idx = arg;
+  wg_peer_t *peer;
+
+  if (pool_is_free_index (wg_peer_pool, *peer_idx))
+    return 0;
+
+  peer = wg_peer_get (*peer_idx);
+  if (!wg_peer_is_dead (peer))
+    noise_remote_clear (vlib_get_main (), &peer->remote);
+  return 0;
 }
 
 static inline u32
@@ -125,7 +199,7 @@ wg_expired_retransmit_handshake (vlib_main_t * vm, wg_peer_t * peer)
   else
     {
       ++peer->timer_handshake_attempts;
-      wg_send_handshake (vm, peer, true);
+      wg_send_handshake_any_thread (vm, peer, true);
     }
 }
 
@@ -184,7 +258,7 @@ wg_expired_new_handshake (vlib_main_t * vm, wg_peer_t * peer)
       return;
     }
 
-  wg_send_handshake (vm, peer, false);
+  wg_send_handshake_any_thread (vm, peer, false);
 }
 
 static void
@@ -198,6 +272,15 @@ wg_expired_zero_key_material (vlib_main_t * vm, wg_peer_t * peer)
       return;
     }
 
+  /* the index table and the keypairs are managed by the main thread */
+  if (vm->thread_index != 0)
+    {
+      u32 peer_idx = peer - wg_peer_pool;
+      vl_api_rpc_call_main_thread (wg_zero_key_material_thread_fn,
+				   (u8 *) &peer_idx, sizeof (peer_idx));
+      return;
+    }
+
   if (!wg_peer_is_dead (peer))
     {
       noise_remote_clear (vm, &peer->remote);
@@ -324,8 +407,7 @@ expired_timer_callback (u32 * expired_timers)
   u32 timer_id;
   u32 pool_index;
 
-  wg_main_t *wmp = &wg_main;
-  vlib_main_t *vm = wmp->vlib_main;
+  vlib_main_t *vm = vlib_get_main ();
 
   wg_peer_t *peer;
 
@@ -338,8 +420,8 @@ expired_timer_callback (u32 * expired_timers)
       peer = wg_peer_get (pool_index);
       peer->timers[timer_id] = ~0;
 
-      /* Under barrier, no sync needed */
-      peer->timers_dispatched[timer_id] = 0;
+      /* Arm requests from other threads may be queued again */
+      clib_atomic_release (&peer->timers_dispatched[timer_id]);
     }
 
   for (i = 0; i < vec_len (expired_timers); i++)
@@ -375,10 +457,22 @@ void
 wg_timer_wheel_init ()
 {
   wg_main_t *wmp = &wg_main;
-  tw_timer_wheel_16t_2w_512sl_t *tw = &wmp->timer_wheel;
-  tw_timer_wheel_init_16t_2w_512sl (tw,
-				    expired_timer_callback,
-				    WG_TICK /* timer period in s */ , ~0);
+  wg_per_thread_data_t *ptd;
+
+  vec_foreach (ptd, wmp->per_thread_data)
+    {
+      tw_timer_wheel_init_16t_2w_512sl (&ptd->timer_wheel,
+					expired_timer_callback,
+					WG_TICK /* timer period in s */, ~0);
+      clib_spinlock_init (&ptd->timer_lock);
+    }
+}
+
+static_always_inline void
+wg_timer_expire (vlib_main_t *vm, wg_per_thread_data_t *ptd)
+{
+  wg_timer_arms_apply (ptd);
+  tw_timer_expire_timers_16t_2w_512sl (&ptd->timer_wheel, vlib_time_now (vm));
 }
 
 static uword
@@ -386,6 +480,7 @@ wg_timer_mngr_fn (vlib_main_t * vm, vlib_node_runtime_t * rt,
 		  vlib_frame_t * f)
 {
   wg_main_t *wmp = &wg_main;
+  wg_per_thread_data_t *ptd = vec_elt_at_index (wmp->per_thread_data, 0);
   uword event_type = 0;
 
   /* Park the process until the feature is configured */
@@ -406,26 +501,167 @@ wg_timer_mngr_fn (vlib_main_t * vm, vlib_node_runtime_t * rt,
    * Reset the timer wheel time so it won't try to
    * expire Avogadro's number of time slots.
    */
-  wmp->timer_wheel.last_run_time = vlib_time_now (vm);
+  ptd->timer_wheel.last_run_time = vlib_time_now (vm);
 
   while (1)
     {
       vlib_process_wait_for_event_or_clock (vm, WG_TICK);
       vlib_process_get_events (vm, NULL);
 
-      tw_timer_expire_timers_16t_2w_512sl (&wmp->timer_wheel,
-					   vlib_time_now (vm));
+      wg_timer_expire (vm, ptd);
     }
 
   return 0;
 }
 
+static_always_inline bool
+wg_timer_slot_is_empty (tw_timer_wheel_16t_2w_512sl_t *tw,
+			tw_timer_wheel_slot_t *ts)
+{
+  return (pool_elt_at_index (tw->timers, ts->head_index)->next ==
+	  ts->head_index);
+}
+
+/*
+ * Ticks until the wheel next has work: the first occupied slot left in
+ * the fast ring's revolution or, when only the slow ring has timers, the
+ * end of the revolution that deals them into the fast ring. ~0 when the
+ * wheel is empty.
+ */
+static u32
+wg_timer_wheel_next_ticks (tw_timer_wheel_16t_2w_512sl_t *tw)
+{
+  u32 n_slots = ARRAY_LEN (tw->w[0]);
+  u32 fast = tw->current_index[TW_TIMER_RING_FAST];
+  u32 i;
+
+  if (fast >= n_slots)
+    return 1;
+
+  for (i = fast; i < n_slots; i++)
+    if (!wg_timer_slot_is_empty (tw, &tw->w[TW_TIMER_RING_FAST][i]))
+      return i - fast + 1;
+
+  for (i = 0; i < n_slots; i++)
+    if (!wg_timer_slot_is_empty (tw, &tw->w[TW_TIMER_RING_SLOW][i]))
+      return n_slots - fast + 1;
+
+  return ~0;
+}
+
+/*
+ * Workers expire the wheels of the peers they own from their own loop.
+ * The node is scheduled for the wheel's next expiry, when a timer is
+ * started, or interrupted when another thread queues an arm request;
+ * between them it does not run.
+ */
+static uword
+wg_timer_input_fn (vlib_main_t *vm, vlib_node_runtime_t *rt, vlib_frame_t *f)
+{
+  wg_per_thread_data_t *ptd =
+    vec_elt_at_index (wg_main.per_thread_data, vm->thread_index);
+  u32 ticks;
+
+  wg_timer_expire (vm, ptd);
+
+  ticks = wg_timer_wheel_next_ticks (&ptd->timer_wheel);
+  if (ticks != ~0)
+    wg_timer_input_schedule (vm, ptd, ticks);
+  return 0;
+}
+
+typedef struct wg_timers_bind_args_t_
+{
+  u32 peer_idx;
+  u32 thread_index;
+} wg_timers_bind_args_t;
+
+/*
+ * Move a peer's timers from the main thread's wheel to a worker's, on the
+ * main thread under the barrier. Running timers restart a tick from now
+ * on the new wheel: their handlers work out what is left from the peer's
+ * timestamps and re-arm for the rest. Queued arm requests follow.
+ */
+static void
+wg_timers_bind_thread_fn (void *arg)
+{
+  wg_timers_bind_args_t *a = arg;
+  wg_per_thread_data_t *from, *to;
+  wg_peer_t *peer;
+  u32 i;
+
+  if (pool_is_free_index (wg_peer_pool, a->peer_idx))
+    return;
+  peer = wg_peer_get (a->peer_idx);
+  /* the first thread to claim the peer's packets keeps its timers */
+  if (wg_peer_is_dead (peer) || !peer->timer_wheel ||
+      peer->timer_thread_index != 0 || a->thread_index == 0)
+    return;
+
+  from = vec_elt_at_index (wg_main.per_thread_data, peer->timer_thread_index);
+  to = vec_elt_at_index (wg_main.per_thread_data, a->thread_index);
+
+  for (i = 0; i < vec_len (from->timer_arms);)
+    if (from->timer_arms[i].peer_idx == a->peer_idx)
+      {
+	vec_add1 (to->timer_arms, from->timer_arms[i]);
+	vec_delete (from->timer_arms, 1, i);
+      }
+    else
+      i++;
+
+  peer->timer_wheel = &to->timer_wheel;
+  peer->timer_thread_index = a->thread_index;
+
+  for (i = 0; i < WG_N_TIMERS; i++)
+    if (peer->timers[i] != ~0)
+      {
+	tw_timer_stop_16t_2w_512sl (&from->timer_wheel, peer->timers[i]);
+	peer->timers[i] = tw_timer_start_16t_2w_512sl (
+	  peer->timer_wheel, a->peer_idx, i, 1);
+      }
+
+  if (a->thread_index)
+    vlib_node_set_interrupt_pending (vlib_get_main_by_index (a->thread_index),
+				     wg_timer_input_node.index);
+}
+
+/*
+ * Run a peer's timers on the thread that has claimed its packets, so
+ * that arming them from the data path does not cross threads.
+ */
+void
+wg_timers_bind_thread (wg_peer_t *peer, u32 thread_index)
+{
+  wg_timers_bind_args_t a = {
+    .peer_idx = peer - wg_peer_pool,
+    .thread_index = thread_index,
+  };
+
+  if (peer->timer_thread_index != 0 || thread_index == 0)
+    return;
+
+  vl_api_rpc_call_main_thread (wg_timers_bind_thread_fn, (u8 *) &a,
+			       sizeof (a));
+}
+
 void
 wg_timers_stop (wg_peer_t * peer)
 {
+  wg_per_thread_data_t *ptd;
+  u32 peer_idx = peer - wg_peer_pool;
+  int i;
+
+  /* Under barrier, the owner's wheel and queue are ours to change */
   ASSERT (vlib_get_thread_index () == 0);
   if (peer->timer_wheel)
     {
+      ptd = vec_elt_at_index (wg_main.per_thread_data,
+			      peer->timer_thread_index);
+      for (i = vec_len (ptd->timer_arms) - 1; i >= 0; i--)
+	if (ptd->timer_arms[i].peer_idx == peer_idx)
+	  vec_delete (ptd->timer_arms, 1, i);
+
       stop_timer (peer, WG_TIMER_RETRANSMIT_HANDSHAKE);
       stop_timer (peer, WG_TIMER_PERSISTENT_KEEPALIVE);
       stop_timer (peer, WG_TIMER_SEND_KEEPALIVE);
@@ -441,6 +677,13 @@ VLIB_REGISTER_NODE (wg_timer_mngr_node, static) = {
     "wg-timer-manager",
 };
 
+VLIB_REGISTER_NODE (wg_timer_input_node, static) = {
+  .function = wg_timer_input_fn,
+  .type = VLIB_NODE_TYPE_SCHED,
+  .name = "wg-timer-input",
+  .state = VLIB_NODE_STATE_DISABLED,
+};
+
 void
 wg_feature_init (wg_main_t * wmp)
 {
@@ -448,6 +691,15 @@ wg_feature_init (wg_main_t * wmp)
     return;
   vlib_process_signal_event (wmp->vlib_main, wg_timer_mngr_node.index,
 			     WG_START_EVENT, 0);
+  foreach_vlib_main ()
+    if (this_vlib_main->thread_index)
+      {
+	vlib_node_set_state (this_vlib_main, wg_timer_input_node.index,
+			     VLIB_NODE_STATE_INTERRUPT);
+	/* timers started before this are picked up by a first run */
+	vlib_node_set_interrupt_pending (this_vlib_main,
+					 wg_timer_input_node.index);
+      }
   wmp->feature_init = 1;
 }
 
@@ -19,6 +19,7 @@
 #include <vlib/vlib.h>
 #include <vppinfra/clib.h>
 #include <vppinfra/tw_timer_16t_2w_512sl.h>
+#include <wireguard/wireguard_noise.h>
 
 /** WG timers */
 #define foreach_wg_timer                            \
@@ -38,8 +39,17 @@ typedef enum _wg_timers
 
 typedef struct wg_peer wg_peer_t;
 
+/* A request to arm a peer's timer on the thread that owns its wheel */
+typedef struct
+{
+  u32 peer_idx;
+  u32 timer_id;
+  u32 interval_ticks;
+} wg_timer_arm_t;
+
 void wg_timer_wheel_init ();
 void wg_timers_stop (wg_peer_t * peer);
+void wg_timers_bind_thread (wg_peer_t *peer, u32 thread_index);
 void wg_timers_data_sent (wg_peer_t * peer);
 void wg_timers_data_sent_opt (wg_peer_t *peer, f64 time);
 void wg_timers_data_received (wg_peer_t * peer);
@@ -55,22 +65,6 @@ void wg_timers_session_derived (wg_peer_t * peer);
 void wg_timers_any_authenticated_packet_traversal (wg_peer_t * peer);
 
 
-static inline bool
-wg_birthdate_has_expired (f64 birthday_seconds, f64 expiration_seconds)
-{
-  if (birthday_seconds == 0.0)
-    return true;
-  f64 now_seconds = vlib_time_now (vlib_get_main ());
-  return (birthday_seconds + expiration_seconds) < now_seconds;
-}
-
-static_always_inline bool
-wg_birthdate_has_expired_opt (f64 birthday_seconds, f64 expiration_seconds,
-			      f64 time)
-{
-  return (birthday_seconds + expiration_seconds) < time;
-}
-
 #endif /* __included_wg_timer_h__ */
 
 /*
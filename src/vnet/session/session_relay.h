@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+
+#ifndef SRC_VNET_SESSION_SESSION_RELAY_H_
+#define SRC_VNET_SESSION_SESSION_RELAY_H_
+
+/**
+ * @file
+ * @brief Session payload relay helpers
+ *
+ * Shared by every proxy that forwards a VPP session's payload. There are
+ * two cases:
+ *
+ * - Session to session. Both sessions share one pair of fifos, swapped,
+ *   so payload never moves. What remains is telling each transport about
+ *   the other's progress: a TX event when data lands in the shared fifo,
+ *   and an RX event for the sender's transport to reopen its window
+ *   once the fifo is drained.
+ *
+ * - Session to an external byte stream. The stream reads and writes
+ *   straight into the fifo chunks, so each byte is copied once, by the
+ *   stream itself, and never through an intermediate buffer.
+ *
+ * In both cases TX events are coalesced: a fifo gets at most one pending
+ * event however many times it is filled before the transport runs.
+ *
+ * Header only, for applications that proxy sessions through the session
+ * layer's fifos.
+ */
+
+#include <vnet/session/session.h>
+
+/** segments handed to a stream per call; a fifo rarely has more chunks */
+#define SESSION_RELAY_MAX_SEGS 16
+
+/** free space below which the other end is close to running out */
+#define SESSION_RELAY_MSS 1460
+
+/**
+ * @brief Write callback for an external stream
+ *
+ * @return bytes accepted, which may be short, or a negative error
+ */
+typedef ssize_t (session_relay_write_fn) (void *ctx, u8 *data, u32 len);
+
+/**
+ * @brief Read callback for an external stream
+ *
+ * @return bytes read, 0 if nothing is available right now, or a negative
+ *         error, including end of stream
+ */
+typedef ssize_t (session_relay_read_fn) (void *ctx, u8 *buf, u32 len);
+
+/**
+ * @brief Raise a TX event for a fifo unless one is already pending
+ */
+static_always_inline void
+session_relay_tx_event (svm_fifo_t *f, session_handle_t sh)
+{
+  if (svm_fifo_set_event (f))
+    session_program_tx_io_evt (sh, SESSION_IO_EVT_TX);
+}
+
+/**
+ * @brief Tell the peer transport there is data in the shared fifo
+ *
+ * Also asks for a dequeue notification when the fifo is about full, so
+ * the writer hears when the peer makes room.
+ */
+static_always_inline void
+session_relay_notify_peer (svm_fifo_t *f, session_handle_t peer_sh)
+{
+  if (svm_fifo_max_dequeue (f))
+    session_relay_tx_event (f, peer_sh);
+
+  if (svm_fifo_max_enqueue (f) <= SESSION_RELAY_MSS)
+    svm_fifo_add_want_deq_ntf (f, SVM_FIFO_WANT_DEQ_NOTIF);
+}
+
+/**
+ * @brief Whether a drained fifo has room worth announcing
+ *
+ * Acking for every dequeue would double the packet rate, so the window
+ * is only reopened once an eighth of the fifo is free. Below that, the
+ * next dequeue notification is requested instead.
+ */
+static_always_inline int
+session_relay_tx_ready (svm_fifo_t *f)
+{
+  u32 min_free;
+
+  min_free = clib_min (svm_fifo_size (f) >> 3, 128 << 10);
+  if (svm_fifo_max_enqueue (f) >= min_free)
+    return 1;
+
+  svm_fifo_add_want_deq_ntf (f, SVM_FIFO_WANT_DEQ_NOTIF);
+  return 0;
+}
+
+/**
+ * @brief Let a session's transport reopen its receive window
+ *
+ * A transport that closed its window does not learn about the room freed
+ * in its rx fifo on its own. The RX event is queued to the session's
+ * thread, where the transport's app_rx_evt reopens the window if there
+ * is room enough, so this may be called from any thread.
+ */
+static inline void
+session_relay_reopen_window (session_handle_t sh)
+{
+  session_program_transport_io_evt (sh, SESSION_IO_EVT_RX);
+}
+
+/**
+ * @brief Report a drained rx fifo to its transport, if it asked
+ *
+ * A transport that wants to hear about room in its rx fifo asks for a
+ * dequeue notification, as TCP does when it closes its window.
+ */
+static inline void
+session_relay_rx_drained (session_t *s, u32 n_drained)
+{
+  if (!svm_fifo_needs_deq_ntf (s->rx_fifo, n_drained))
+    return;
+
+  svm_fifo_clear_deq_ntf (s->rx_fifo);
+  session_relay_reopen_window (s->handle);
+}
+
+/**
+ * @brief Hand a session's received payload to an external stream
+ *
+ * The stream writes straight from the rx fifo chunks. Only what it
+ * accepted is dropped from the fifo, and a transport waiting for room is
+ * told about it.
+ *
+ * @return bytes consumed, or the stream's error if it took nothing
+ */
+static inline ssize_t
+session_relay_session_to_stream (session_t *s, session_relay_write_fn *fn,
+				 void *ctx, u32 max_bytes)
+{
+  svm_fifo_seg_t segs[SESSION_RELAY_MAX_SEGS];
+  u32 n_segs = SESSION_RELAY_MAX_SEGS, i;
+  ssize_t rv, n_written = 0;
+
+  if (svm_fifo_segments (s->rx_fifo, 0, segs, &n_segs, max_bytes) <= 0)
+    return 0;
+
+  for (i = 0; i < n_segs; i++)
+    {
+      rv = fn (ctx, segs[i].data, segs[i].len);
+      if (rv < 0)
+	{
+	  if (!n_written)
+	    return rv;
+	  break;
+	}
+      n_written += rv;
+      if (rv < segs[i].len)
+	break;
+    }
+
+  if (!n_written)
+    return 0;
+
+  svm_fifo_dequeue_drop (s->rx_fifo, n_written);
+  session_relay_rx_drained (s, n_written);
+
+  return n_written;
+}
+
+/**
+ * @brief Fill a session's tx fifo from an external stream
+ *
+ * The stream reads into chunks provisioned at the fifo tail, which are
+ * then committed without another copy. A full fifo asks for a dequeue
+ * notification so the caller can resume from its tx callback.
+ *
+ * @return bytes queued, or the stream's error if it gave nothing
+ */
+static inline ssize_t
+session_relay_stream_to_session (session_t *s, session_relay_read_fn *fn,
+				 void *ctx, u32 max_bytes)
+{
+  svm_fifo_seg_t segs[SESSION_RELAY_MAX_SEGS];
+  ssize_t rv, n_read = 0;
+  u32 n_free;
+  int i, n_segs;
+
+  n_free = clib_min (svm_fifo_max_enqueue_prod (s->tx_fifo), max_bytes);
+  if (!n_free)
+    {
+      svm_fifo_add_want_deq_ntf (s->tx_fifo, SVM_FIFO_WANT_DEQ_NOTIF);
+      return 0;
+    }
+
+  n_segs = svm_fifo_provision_chunks (s->tx_fifo, segs,
+				      SESSION_RELAY_MAX_SEGS, n_free);
+  if (n_segs <= 0)
+    return 0;
+
+  for (i = 0; i < n_segs; i++)
+    {
+      rv = fn (ctx, segs[i].data, segs[i].len);
+      if (rv < 0)
+	{
+	  if (!n_read)
+	    return rv;
+	  break;
+	}
+      n_read += rv;
+      if (rv < segs[i].len)
+	break;
+    }
+
+  if (!n_read)
+    return 0;
+
+  svm_fifo_enqueue_nocopy (s->tx_fifo, n_read);
+  session_relay_tx_event (s->tx_fifo, s->handle);
+
+  return n_read;
+}
+
+#endif /* SRC_VNET_SESSION_SESSION_RELAY_H_ */
@@ -0,0 +1,277 @@
+from config import config
+from asfframework import VppAsfTestCase, VppTestRunner, get_testcase_dirname
+import json
+import subprocess
+import sys
+import unittest
+from vpp_qemu_utils import (
+    create_host_interface,
+    delete_all_host_interfaces,
+    create_namespace,
+    delete_all_namespaces,
+)
+
+# Shadowsocks AEAD client and echo target, run in the host namespace.
+# Prints a JSON summary of what it saw.
+SS_CLIENT = r"""
+import json, os, socket, struct, sys, threading, time
+from hashlib import md5
+from cryptography.hazmat.primitives import hashes
+from cryptography.hazmat.primitives.ciphers.aead import ChaCha20Poly1305
+from cryptography.hazmat.primitives.kdf.hkdf import HKDF
+
+args = json.loads(sys.argv[1])
+target = (args["target"], args["target_port"])
+
+
+def master_key(password):
+    key, d = b"", b""
+    while len(key) < 32:
+        d = md5(d + password.encode()).digest()
+        key += d
+    return key[:32]
+
+
+def subkey(master, salt):
+    return HKDF(hashes.SHA1(), 32, salt, b"ss-subkey").derive(master)
+
+
+class Aead:
+    def __init__(self, key):
+        self.aead = ChaCha20Poly1305(key)
+        self.nonce = 0
+
+    def _nonce(self):
+        n = self.nonce.to_bytes(12, "little")
+        self.nonce += 1
+        return n
+
+    def seal(self, data):
+        return self.aead.encrypt(self._nonce(), data, None)
+
+    def open(self, data):
+        return self.aead.decrypt(self._nonce(), data, None)
+
+
+def recv_exact(sock, n):
+    buf = b""
+    while len(buf) < n:
+        d = sock.recv(n - len(buf))
+        if not d:
+            raise ConnectionError("closed")
+        buf += d
+    return buf
+
+
+class SsConn:
+    def __init__(self, password):
+        self.master = master_key(password)
+        self.sock = socket.create_connection(
+            (args["server"], args["port"]), timeout=args["timeout"]
+        )
+        salt = os.urandom(32)
+        self.enc = Aead(subkey(self.master, salt))
+        self.dec = None
+        self.head = salt
+        self.addr = b"\x01" + socket.inet_aton(target[0])
+        self.addr += struct.pack("!H", target[1])
+
+    def send(self, data):
+        data, self.addr = self.addr + data, b""
+        out, self.head = self.head, b""
+        while data:
+            chunk, data = data[:0x3FFF], data[0x3FFF:]
+            out += self.enc.seal(struct.pack("!H", len(chunk)))
+            out += self.enc.seal(chunk)
+        self.sock.sendall(out)
+
+    def recv(self, n):
+        if self.dec is None:
+            self.dec = Aead(subkey(self.master, recv_exact(self.sock, 32)))
+        buf = b""
+        while len(buf) < n:
+            (l,) = struct.unpack("!H", self.dec.open(recv_exact(self.sock, 18)))
+            buf += self.dec.open(recv_exact(self.sock, l + 16))
+        return buf
+
+    def round_trip(self, size):
+        data = os.urandom(size)
+        self.send(data)
+        return self.recv(size) == data
+
+
+def echo(conn):
+    while True:
+        d = conn.recv(65536)
+        if not d:
+            break
+        conn.sendall(d)
+    conn.close()
+
+
+def serve():
+    srv = socket.socket()
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(target)
+    srv.listen(64)
+    while True:
+        conn, _ = srv.accept()
+        threading.Thread(target=echo, args=(conn,), daemon=True).start()
+
+
+if args["mode"] == "once":
+    try:
+        ok = SsConn(args["passwords"][0]).round_trip(1000)
+    except Exception:
+        ok = False
+    print(json.dumps({"ok": ok}))
+    sys.exit(0)
+
+threading.Thread(target=serve, daemon=True).start()
+time.sleep(0.5)
+
+# long lived connections, identified before we say we are ready
+conns = [SsConn(p) for p in args["passwords"] for _ in range(args["n_conns"])]
+for c in conns:
+    c.round_trip(100)
+rounds = drops = mismatches = 0
+print("ready", flush=True)
+
+# round trips until the time is up
+end = time.time() + args["duration"]
+while conns and time.time() < end:
+    for c in list(conns):
+        try:
+            if not c.round_trip(1000 + rounds % 4000):
+                mismatches += 1
+        except Exception:
+            drops += 1
+            conns.remove(c)
+        rounds += 1
+print(json.dumps({"rounds": rounds, "drops": drops, "mismatches": mismatches}))
+"""
+
+
+@unittest.skipIf(
+    "outline_server" in config.excluded_plugins, "Exclude Outline Server plugin tests"
+)
+@unittest.skipIf(config.skip_netns_tests, "netns not available or disabled from cli")
+class TestOutlineServerChurn(VppAsfTestCase):
+    """native outline server under key churn"""
+
+    vpp_worker_count = 2
+
+    @classmethod
+    def setUpClass(cls):
+        super(TestOutlineServerChurn, cls).setUpClass()
+
+        cls.ns_history_name = (
+            f"{config.tmp_dir}/{get_testcase_dirname(cls.__name__)}/history_ns.txt"
+        )
+        cls.if_history_name = (
+            f"{config.tmp_dir}/{get_testcase_dirname(cls.__name__)}/history_if.txt"
+        )
+
+        try:
+            # CleanUp
+            delete_all_namespaces(cls.ns_history_name)
+            delete_all_host_interfaces(cls.if_history_name)
+
+            cls.ns_name = create_namespace(cls.ns_history_name)
+            cls.host_if_name, cls.vpp_if_name = create_host_interface(
+                cls.if_history_name, cls.ns_name, "10.10.1.1/24"
+            )
+
+        except Exception as e:
+            cls.logger.warning(f"Unable to complete setup: {e}")
+            raise unittest.SkipTest("Skipping tests due to setup failure.")
+
+        cls.vapi.cli(f"create host-interface name {cls.vpp_if_name}")
+        cls.vapi.cli(f"set int state host-{cls.vpp_if_name} up")
+        cls.vapi.cli(f"set int ip address host-{cls.vpp_if_name} 10.10.1.2/24")
+
+    @classmethod
+    def tearDownClass(cls):
+        delete_all_namespaces(cls.ns_history_name)
+        delete_all_host_interfaces(cls.if_history_name)
+        super(TestOutlineServerChurn, cls).tearDownClass()
+
+    def ss_client(self, mode, passwords, **kwargs):
+        args = {
+            "mode": mode,
+            "passwords": passwords,
+            "server": "10.10.1.2",
+            "port": 8388,
+            "target": "10.10.1.1",
+            "target_port": 7000,
+            "timeout": 2,
+            "n_conns": 0,
+            "duration": 0,
+        }
+        args.update(kwargs)
+        return [
+            "ip",
+            "netns",
+            "exec",
+            self.ns_name,
+            sys.executable,
+            "-c",
+            SS_CLIENT,
+            json.dumps(args),
+        ]
+
+    def connect_once(self, password):
+        process = subprocess.run(
+            self.ss_client("once", [password]), capture_output=True, timeout=10
+        )
+        return json.loads(process.stdout.decode().splitlines()[-1])["ok"]
+
+    def test_outline_server_key_churn(self):
+        """connections survive key churn, new keys work at once"""
+        self.vapi.cli("outline-server add port 8388 password unused")
+        self.vapi.cli("outline-server add key id kept port-id 0 password kept")
+        self.vapi.cli("outline-server add key id doomed port-id 0 password doomed")
+        self.vapi.cli("outline-server start native")
+
+        client = subprocess.Popen(
+            self.ss_client("churn", ["kept", "doomed"], n_conns=4, duration=10),
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+        )
+        self.assertEqual(client.stdout.readline().strip(), b"ready")
+
+        # connections of a deleted key keep it, new ones cannot have it
+        self.vapi.cli("outline-server delete key id doomed")
+        self.assertFalse(self.connect_once("doomed"))
+
+        for i in range(200):
+            self.vapi.cli(
+                f"outline-server add key id churn-{i} port-id 0 password churn-{i}"
+            )
+            if i:
+                self.vapi.cli(f"outline-server delete key id churn-{i - 1}")
+            if i % 10 == 0:
+                self.vapi.cli(
+                    "outline-server add key id kept port-id 0 password kept "
+                    f"data-limit {(1 << 40) + i}"
+                )
+            if i % 50 == 0:
+                self.assertTrue(self.connect_once(f"churn-{i}"))
+
+        stdout, stderr = client.communicate(timeout=30)
+        self.logger.info(self.vapi.cli("show outline-server status"))
+        if client.returncode != 0:
+            self.logger.error(f"stderr: {stderr.decode()}")
+            raise RuntimeError("Client failed")
+
+        result = json.loads(stdout.decode().splitlines()[-1])
+        self.logger.info(f"churn client: {result}")
+        self.assertGreater(result["rounds"], 0)
+        self.assertEqual(result["drops"], 0)
+        self.assertEqual(result["mismatches"], 0)
+
+        self.vapi.cli("outline-server stop")
+
+
+if __name__ == "__main__":
+    unittest.main(testRunner=VppTestRunner)
@@ -0,0 +1,523 @@
+from config import config
+from asfframework import VppAsfTestCase, VppTestRunner, get_testcase_dirname
+import json
+import re
+import subprocess
+import sys
+import unittest
+from vpp_qemu_utils import (
+    add_namespace_route,
+    create_host_interface,
+    delete_all_host_interfaces,
+    create_namespace,
+    delete_all_namespaces,
+)
+
+# SOCKS5 proxy standing in for sing-box, and the clients of the redirected
+# flows, run in the host namespace. The proxy answers a CONNECT by echoing
+# itself and prints one JSON line per request it served; clients print a
+# JSON summary of their round trips.
+SOCKS5_PEER = r"""
+import json, os, socket, struct, sys, threading, time
+
+args = json.loads(sys.argv[1])
+
+
+def recv_exact(sock, n):
+    buf = b""
+    while len(buf) < n:
+        d = sock.recv(n - len(buf))
+        if not d:
+            raise ConnectionError("closed")
+        buf += d
+    return buf
+
+
+def echo(conn):
+    while True:
+        d = conn.recv(65536)
+        if not d:
+            break
+        conn.sendall(d)
+
+
+def proxy_conn(conn):
+    try:
+        _, n = recv_exact(conn, 2)
+        recv_exact(conn, n)
+        conn.sendall(b"\x05\x00")
+        greeted = time.time()
+        _, cmd, _, atyp = recv_exact(conn, 4)
+        if atyp != 1:
+            return
+        addr = socket.inet_ntoa(recv_exact(conn, 4))
+        (port,) = struct.unpack("!H", recv_exact(conn, 2))
+        # a pooled connection idles between its greeting and the CONNECT
+        warm = time.time() - greeted > args["warm_after"]
+        print(json.dumps({"dst": f"{addr}:{port}", "warm": warm}), flush=True)
+        conn.sendall(b"\x05\x00\x00\x01" + bytes(6))
+        echo(conn)
+    except (ConnectionError, OSError):
+        pass
+    finally:
+        conn.close()
+
+
+def proxy():
+    srv = socket.socket()
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind((args["proxy"], args["proxy_port"]))
+    srv.listen(256)
+    print("ready", flush=True)
+    while True:
+        conn, _ = srv.accept()
+        threading.Thread(target=proxy_conn, args=(conn,), daemon=True).start()
+
+
+def round_trips(results):
+    try:
+        sock = socket.create_connection(
+            (args["target"], args["target_port"]), timeout=args["timeout"]
+        )
+        for size in args["sizes"]:
+            # sent aside, large ones do not fit in the buffers on the way
+            data = os.urandom(size)
+            sender = threading.Thread(target=sock.sendall, args=(data,))
+            sender.start()
+            echoed = recv_exact(sock, size)
+            sender.join()
+            if echoed != data:
+                results.append("mismatch")
+                return
+        sock.close()
+        results.append("ok")
+    except (ConnectionError, OSError):
+        results.append("failed")
+
+
+def clients():
+    results = []
+    threads = [
+        threading.Thread(target=round_trips, args=(results,))
+        for _ in range(args["n_conns"])
+    ]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    print(json.dumps({r: results.count(r) for r in ("ok", "failed", "mismatch")}))
+
+
+proxy() if args["mode"] == "proxy" else clients()
+"""
+
+# SOCKS5 client of the server, run in the host namespace along with the
+# TCP and UDP echo servers its requests go to. Prints a JSON summary.
+SOCKS5_CLIENT = r"""
+import json, os, socket, struct, sys, threading, time
+
+args = json.loads(sys.argv[1])
+server = (args["server"], args["port"])
+echo_host = args["echo"]
+
+
+def recv_exact(sock, n):
+    buf = b""
+    while len(buf) < n:
+        d = sock.recv(n - len(buf))
+        if not d:
+            raise ConnectionError("closed")
+        buf += d
+    return buf
+
+
+def tcp_echo():
+    srv = socket.socket()
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind((echo_host, 7000))
+    srv.listen(16)
+    while True:
+        conn, _ = srv.accept()
+        threading.Thread(target=echo, args=(conn,), daemon=True).start()
+
+
+def echo(conn):
+    while True:
+        d = conn.recv(65536)
+        if not d:
+            break
+        conn.sendall(d)
+
+
+def udp_echo():
+    srv = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    srv.bind((echo_host, 7001))
+    while True:
+        d, peer = srv.recvfrom(65536)
+        srv.sendto(d, peer)
+
+
+def socks_addr(host, port):
+    try:
+        addr = b"\x01" + socket.inet_aton(host)
+    except OSError:
+        addr = b"\x03" + bytes([len(host)]) + host.encode()
+    return addr + struct.pack("!H", port)
+
+
+def request(sock, cmd, host, port):
+    sock.sendall(b"\x05\x01\x00")
+    if recv_exact(sock, 2) != b"\x05\x00":
+        raise ConnectionError("no acceptable method")
+    sock.sendall(bytes([5, cmd, 0]) + socks_addr(host, port))
+    _, rep, _, atyp = recv_exact(sock, 4)
+    alen = {1: 4, 4: 16}.get(atyp) or recv_exact(sock, 1)[0]
+    addr = recv_exact(sock, alen)
+    (port,) = struct.unpack("!H", recv_exact(sock, 2))
+    return rep, addr, port
+
+
+def connect(host):
+    sock = socket.create_connection(server, timeout=args["timeout"])
+    rep, _, _ = request(sock, 1, host, 7000)
+    if rep:
+        return rep
+    data = os.urandom(5000)
+    sock.sendall(data)
+    return "ok" if recv_exact(sock, len(data)) == data else "mismatch"
+
+
+def udp_associate(n_dgrams):
+    udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    udp.bind((echo_host, 0))
+    udp.settimeout(args["timeout"])
+    ctl = socket.create_connection(server, timeout=args["timeout"])
+    rep, addr, port = request(ctl, 3, echo_host, udp.getsockname()[1])
+    if rep:
+        return rep
+    relay = (socket.inet_ntoa(addr), port)
+    hdr = b"\x00\x00\x00" + socks_addr(echo_host, 7001)
+    echoed = 0
+    for i in range(n_dgrams):
+        payload = os.urandom(100 + i)
+        udp.sendto(hdr + payload, relay)
+        try:
+            if udp.recvfrom(65536)[0] == hdr + payload:
+                echoed += 1
+        except socket.timeout:
+            pass
+    ctl.close()
+    return echoed
+
+
+threading.Thread(target=tcp_echo, daemon=True).start()
+threading.Thread(target=udp_echo, daemon=True).start()
+time.sleep(0.5)
+
+result = {}
+for host in args["connect"]:
+    result[host] = connect(host)
+if args["udp"]:
+    result["udp"] = udp_associate(args["udp"])
+print(json.dumps(result))
+"""
+
+
+class SingboxRedirectCase(VppAsfTestCase):
+    """flows from a host namespace redirected to a proxy in it"""
+
+    n_rx_queues = 1
+
+    @classmethod
+    def setUpClass(cls):
+        super(SingboxRedirectCase, cls).setUpClass()
+
+        cls.ns_history_name = (
+            f"{config.tmp_dir}/{get_testcase_dirname(cls.__name__)}/history_ns.txt"
+        )
+        cls.if_history_name = (
+            f"{config.tmp_dir}/{get_testcase_dirname(cls.__name__)}/history_if.txt"
+        )
+
+        try:
+            # CleanUp
+            delete_all_namespaces(cls.ns_history_name)
+            delete_all_host_interfaces(cls.if_history_name)
+
+            cls.ns_name = create_namespace(cls.ns_history_name)
+            cls.host_if_name, cls.vpp_if_name = create_host_interface(
+                cls.if_history_name, cls.ns_name, "10.10.1.1/24"
+            )
+            # destinations behind VPP, only ever reached through the proxy
+            add_namespace_route(cls.ns_name, "10.10.9.0/24", "10.10.1.2")
+
+        except Exception as e:
+            cls.logger.warning(f"Unable to complete setup: {e}")
+            raise unittest.SkipTest("Skipping tests due to setup failure.")
+
+        cls.vapi.cli(
+            f"create host-interface name {cls.vpp_if_name} "
+            f"num-rx-queues {cls.n_rx_queues}"
+        )
+        cls.vapi.cli(f"set int state host-{cls.vpp_if_name} up")
+        cls.vapi.cli(f"set int ip address host-{cls.vpp_if_name} 10.10.1.2/24")
+
+    @classmethod
+    def tearDownClass(cls):
+        delete_all_namespaces(cls.ns_history_name)
+        delete_all_host_interfaces(cls.if_history_name)
+        super(SingboxRedirectCase, cls).tearDownClass()
+
+    def setUp(self):
+        super(SingboxRedirectCase, self).setUp()
+        self.proxy = subprocess.Popen(
+            self.socks5_peer("proxy"), stdout=subprocess.PIPE, stderr=subprocess.PIPE
+        )
+        self.assertEqual(self.proxy.stdout.readline().strip(), b"ready")
+
+    def tearDown(self):
+        self.vapi.cli(f"singbox enable host-{self.vpp_if_name} disable")
+        if self.proxy.returncode is None:
+            self.proxy.kill()
+            self.proxy.communicate()
+        super(SingboxRedirectCase, self).tearDown()
+
+    def socks5_peer(self, mode, **kwargs):
+        args = {
+            "mode": mode,
+            "proxy": "10.10.1.1",
+            "proxy_port": 1080,
+            "warm_after": 0.5,
+            "target": "10.10.9.9",
+            "target_port": 7000,
+            "timeout": 5,
+            "n_conns": 1,
+            "sizes": [],
+        }
+        args.update(kwargs)
+        return [
+            "ip",
+            "netns",
+            "exec",
+            self.ns_name,
+            sys.executable,
+            "-c",
+            SOCKS5_PEER,
+            json.dumps(args),
+        ]
+
+    def run_clients(self, **kwargs):
+        process = subprocess.run(
+            self.socks5_peer("clients", **kwargs), capture_output=True, timeout=60
+        )
+        if process.returncode != 0:
+            self.logger.error(f"stderr: {process.stderr.decode()}")
+            raise RuntimeError("Clients failed")
+        return json.loads(process.stdout.decode().splitlines()[-1])
+
+    def proxy_requests(self):
+        """requests the proxy has served so far, the proxy is stopped"""
+        self.proxy.kill()
+        stdout, _ = self.proxy.communicate()
+        return [json.loads(line) for line in stdout.decode().splitlines()]
+
+    def interface_stats(self):
+        out = self.vapi.cli(f"show singbox host-{self.vpp_if_name}")
+        self.logger.info(out)
+        conns = re.search(r"Connections: (\d+) active, (\d+) total", out)
+        pool = re.search(
+            r"Pool: (\d+) warm, \d+ pending, (\d+) hits, (\d+) misses", out
+        )
+        return {
+            "active": int(conns.group(1)),
+            "total": int(conns.group(2)),
+            "warm": int(pool.group(1)),
+            "hits": int(pool.group(2)),
+            "misses": int(pool.group(3)),
+        }
+
+    def wait_for_warm(self, n_warm):
+        for _ in range(50):
+            if self.interface_stats()["warm"] >= n_warm:
+                return
+            self.sleep(0.1)
+        self.fail(f"pool did not warm up to {n_warm} connections")
+
+
+@unittest.skipIf("singbox" in config.excluded_plugins, "Exclude singbox plugin tests")
+@unittest.skipIf(config.skip_netns_tests, "netns not available or disabled from cli")
+class TestSingboxRedirect(SingboxRedirectCase):
+    """singbox transparent redirection to a SOCKS5 proxy"""
+
+    def test_singbox_redirect_splice(self):
+        """redirected flows are spliced to the proxy's connection"""
+        self.vapi.cli("singbox set pool disable")
+        self.vapi.cli(f"singbox enable host-{self.vpp_if_name} proxy 10.10.1.1:1080")
+
+        # small writes and ones larger than the fifos, both ways
+        result = self.run_clients(n_conns=4, sizes=[1, 1000, 1 << 20, 100])
+        self.assertEqual(result, {"ok": 4, "failed": 0, "mismatch": 0})
+
+        # the proxy got the original destination, with the greeting
+        requests = self.proxy_requests()
+        self.assertEqual(len(requests), 4)
+        for request in requests:
+            self.assertEqual(request, {"dst": "10.10.9.9:7000", "warm": False})
+
+        stats = self.interface_stats()
+        self.assertEqual(stats["total"], 4)
+
+    def test_singbox_redirect_pool(self):
+        """warm connections take only a CONNECT, cold ones the handshake"""
+        self.vapi.cli("singbox set pool size 1 idle-timeout 30")
+        self.vapi.cli(f"singbox enable host-{self.vpp_if_name} proxy 10.10.1.1:1080")
+        self.wait_for_warm(1)
+        # for the proxy to tell the warm connection by its idle time
+        self.sleep(1)
+
+        # one flow finds the warm connection, the others connect cold
+        result = self.run_clients(n_conns=3, sizes=[1000])
+        self.assertEqual(result, {"ok": 3, "failed": 0, "mismatch": 0})
+
+        stats = self.interface_stats()
+        self.assertGreaterEqual(stats["hits"], 1)
+        self.assertGreaterEqual(stats["misses"], 1)
+        self.assertEqual(stats["hits"] + stats["misses"], 3)
+
+        # the pool is topped up again after the hit
+        self.wait_for_warm(1)
+
+        requests = self.proxy_requests()
+        self.assertEqual(len(requests), 3)
+        self.assertEqual(sum(r["warm"] for r in requests), stats["hits"])
+        for request in requests:
+            self.assertEqual(request["dst"], "10.10.9.9:7000")
+
+
+@unittest.skipIf("singbox" in config.excluded_plugins, "Exclude singbox plugin tests")
+@unittest.skipIf(config.skip_netns_tests, "netns not available or disabled from cli")
+class TestSingboxRedirectWorkers(SingboxRedirectCase):
+    """singbox redirection with flows spread over workers"""
+
+    vpp_worker_count = 2
+    n_rx_queues = 2
+
+    def test_singbox_redirect_workers(self):
+        """sessions and counters of every worker add up"""
+        self.vapi.cli("singbox set pool disable")
+        self.vapi.cli(f"singbox enable host-{self.vpp_if_name} proxy 10.10.1.1:1080")
+
+        for _ in range(4):
+            result = self.run_clients(n_conns=32, sizes=[100, 10000])
+            self.assertEqual(result, {"ok": 32, "failed": 0, "mismatch": 0})
+        self.assertEqual(len(self.proxy_requests()), 128)
+
+        # every session is gone, whichever worker owned it
+        for _ in range(50):
+            stats = self.interface_stats()
+            if stats["active"] == 0:
+                break
+            self.sleep(0.1)
+        self.assertEqual(stats["active"], 0)
+        self.assertEqual(stats["total"], 128)
+
+
+@unittest.skipIf("singbox" in config.excluded_plugins, "Exclude singbox plugin tests")
+@unittest.skipIf("dns" in config.excluded_plugins, "Exclude dns plugin tests")
+@unittest.skipIf(config.skip_netns_tests, "netns not available or disabled from cli")
+class TestSingboxServer(VppAsfTestCase):
+    """singbox SOCKS5 server"""
+
+    @classmethod
+    def setUpClass(cls):
+        super(TestSingboxServer, cls).setUpClass()
+
+        cls.ns_history_name = (
+            f"{config.tmp_dir}/{get_testcase_dirname(cls.__name__)}/history_ns.txt"
+        )
+        cls.if_history_name = (
+            f"{config.tmp_dir}/{get_testcase_dirname(cls.__name__)}/history_if.txt"
+        )
+
+        try:
+            # CleanUp
+            delete_all_namespaces(cls.ns_history_name)
+            delete_all_host_interfaces(cls.if_history_name)
+
+            cls.ns_name = create_namespace(cls.ns_history_name)
+            cls.host_if_name, cls.vpp_if_name = create_host_interface(
+                cls.if_history_name, cls.ns_name, "10.10.1.1/24"
+            )
+
+        except Exception as e:
+            cls.logger.warning(f"Unable to complete setup: {e}")
+            raise unittest.SkipTest("Skipping tests due to setup failure.")
+
+        cls.vapi.cli(f"create host-interface name {cls.vpp_if_name}")
+        cls.vapi.cli(f"set int state host-{cls.vpp_if_name} up")
+        cls.vapi.cli(f"set int ip address host-{cls.vpp_if_name} 10.10.1.2/24")
+
+        # names are served from the dns plugin's cache, never asked for
+        cls.vapi.cli("dns name-server 10.10.1.1")
+        cls.vapi.cli("dns enable")
+        cls.vapi.cli("dns cache add echo.test 10.10.1.1")
+
+        cls.vapi.cli("singbox server start 10.10.1.2:1080")
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.vapi.cli("singbox server stop")
+        delete_all_namespaces(cls.ns_history_name)
+        delete_all_host_interfaces(cls.if_history_name)
+        super(TestSingboxServer, cls).tearDownClass()
+
+    def run_client(self, connect=(), udp=0):
+        args = {
+            "server": "10.10.1.2",
+            "port": 1080,
+            "echo": "10.10.1.1",
+            # past the server giving up on names, 5s
+            "timeout": 8,
+            "connect": connect,
+            "udp": udp,
+        }
+        process = subprocess.run(
+            [
+                "ip",
+                "netns",
+                "exec",
+                self.ns_name,
+                sys.executable,
+                "-c",
+                SOCKS5_CLIENT,
+                json.dumps(args),
+            ],
+            capture_output=True,
+            timeout=60,
+        )
+        if process.returncode != 0:
+            self.logger.error(f"stderr: {process.stderr.decode()}")
+            raise RuntimeError("Client failed")
+        return json.loads(process.stdout.decode().splitlines()[-1])
+
+    def test_singbox_server_connect(self):
+        """CONNECT to an address and to names in and out of the cache"""
+        result = self.run_client(connect=["10.10.1.1", "echo.test", "nx.test"])
+        self.assertEqual(result["10.10.1.1"], "ok")
+        self.assertEqual(result["echo.test"], "ok")
+        # host unreachable, once the lookup the cache started times out
+        self.assertEqual(result["nx.test"], 4)
+
+    def test_singbox_server_udp_associate(self):
+        """UDP ASSOCIATE relays datagrams both ways"""
+        result = self.run_client(udp=20)
+        self.assertEqual(result["udp"], 20)
+
+        out = self.vapi.cli("show singbox server")
+        self.logger.info(out)
+        relayed = int(re.search(r"UDP datagrams: (\d+) relayed", out).group(1))
+        self.assertGreaterEqual(relayed, 20)
+
+
+if __name__ == "__main__":
+    unittest.main(testRunner=VppTestRunner)
@@ -5,12 +5,13 @@ import datetime
 import base64
 import os
 import struct
+import time
 
 from hashlib import blake2s
 from config import config
 from scapy.packet import Raw
 from scapy.layers.l2 import Ether
-from scapy.layers.inet import IP, UDP
+from scapy.layers.inet import IP, UDP, TCP
 from scapy.layers.inet6 import IPv6
 from scapy.layers.vxlan import VXLAN
 from scapy.contrib.wireguard import (
@@ -42,6 +43,7 @@ from vpp_l2 import VppBridgeDomain, VppBridgeDomainPort
 from vpp_vxlan_tunnel import VppVxlanTunnel
 from vpp_object import VppObject
 from vpp_papi import VppEnum
+from vpp_papi_provider import CliFailedCommandError
 from asfframework import tag_run_solo, tag_fixme_vpp_debug
 from framework import VppTestCase
 from re import compile
@@ -373,6 +375,51 @@ class VppWgPeer(VppObject):
 
         return p
 
+    def mk_awg_handshake(self, tx_itf, magic, junk_len, is_ip6=False):
+        p = self.mk_handshake(tx_itf, is_ip6)
+
+        # the magic header replaces the type and is covered by mac1
+        init = struct.pack("<I", magic) + bytes(p[Wireguard])[4:116]
+        mac_key = blake2s(b"mac1----" + self.itf.public_key_bytes()).digest()
+        mac1 = blake2s(init, digest_size=16, key=mac_key).digest()
+        self.last_mac1 = mac1
+
+        return self.mk_tunnel_header(tx_itf, is_ip6) / Raw(
+            os.urandom(junk_len) + init + mac1 + bytes(16)
+        )
+
+    def mk_awg_transport(self, tx_itf, magic, junk_len, counter, payload):
+        p = Wireguard(message_type=4, reserved_zero=0) / WireguardTransport(
+            receiver_index=self.sender,
+            counter=counter,
+            encrypted_encapsulated_packet=self.encrypt_transport(payload),
+        )
+        return self.mk_tunnel_header(tx_itf) / Raw(
+            os.urandom(junk_len) + struct.pack("<I", magic) + bytes(p)[4:]
+        )
+
+    def awg_unwrap(self, p, magic, junk_len, msg_type, is_ip6=False):
+        """Check the AWG layout of a message from VPP: junk_len bytes of
+        junk, then the magic header. Returns the plain WireGuard message."""
+        self.verify_header(p, is_ip6)
+
+        payload = bytes(p[Raw])
+        self._test.assertEqual(
+            struct.unpack("<I", payload[junk_len : junk_len + 4])[0], magic
+        )
+
+        p = p.copy()
+        p[UDP].remove_payload()
+        p[UDP].add_payload(
+            Raw(struct.pack("<I", msg_type) + payload[junk_len + 4 :])
+        )
+        del p[UDP].len, p[UDP].chksum
+        if is_ip6:
+            del p[IPv6].plen
+        else:
+            del p[IP].len, p[IP].chksum
+        return p.__class__(bytes(p))
+
     def verify_header(self, p, is_ip6=False):
         if is_ip6 is False:
             self._test.assertEqual(p[IP].src, self.itf.src)
@@ -461,6 +508,9 @@ class VppWgPeer(VppObject):
             p[WireguardTransport].receiver_index, self.receiver_index
         )
 
+        # nonces need not be consecutive, e.g. with multi-queue peers
+        cs = self.noise.noise_protocol.cipher_state_decrypt
+        cs.n = p[WireguardTransport].counter
         d = self.noise.decrypt(p[WireguardTransport].encrypted_encapsulated_packet)
         return d
 
@@ -1069,6 +1119,173 @@ class TestWg(VppTestCase):
         peer_2.remove_vpp_config()
         wg0.remove_vpp_config()
 
+    @unittest.skipUnless(config.extended, "part of extended tests")
+    def test_wg_handshake_ratelimiting_flood(self):
+        """Handshake ratelimiting under a flood of cookie-bearing sources"""
+        port = 12331
+        NUM_FLOODERS = 64
+        NUM_PER_FLOODER = 20
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        self.pg1.generate_remote_hosts(NUM_FLOODERS + 1)
+        self.pg1.configure_ipv4_neighbors()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_hosts[0].ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+        self.pg1.get_capture(1, timeout=HANDSHAKE_JITTER)
+
+        # flooders are not peers, they only ever get as far as the ratelimit
+        flooders = []
+        for i in range(NUM_FLOODERS):
+            f = VppWgPeer(self, wg0, self.pg1.remote_hosts[i + 1].ip4, port + 1, [])
+            f.receiver_index = 1000 + i
+            flooders.append(f)
+
+        # go under load, then have every source collect its cookie
+        init = peer_1.mk_handshake(self.pg1)
+        rxs = self.send_and_expect_some(
+            self.pg1, [init] * HANDSHAKE_NUM_PER_PEER_UNTIL_UNDER_LOAD, self.pg1
+        )
+        peer_1.consume_cookie(rxs[-1])
+
+        inits = [f.mk_handshake(self.pg1) for f in flooders]
+        rxs = self.send_and_expect(self.pg1, inits, self.pg1)
+        rx_by_dst = {rx[IP].dst: rx for rx in rxs}
+        txs = []
+        for f in flooders:
+            f.consume_cookie(rx_by_dst[f.endpoint])
+            f.noise_reset()
+            txs += [f.mk_handshake(self.pg1)] * NUM_PER_FLOODER
+
+        self.vapi.cli("clear runtime")
+        self.pg_send(self.pg1, txs)
+        clocks, vectors = self._wg_input_clocks()
+        self.logger.info(
+            "%d sources: %.0f clocks/initiation" % (NUM_FLOODERS, clocks / vectors)
+        )
+
+        # every source gets its burst, allow for one refill each while
+        # the flood is sent; the rest is ratelimited
+        limited = self.statistics.get_err_counter(self.ratelimited4_err)
+        limited -= self.base_ratelimited4_err
+        expected = NUM_FLOODERS * (NUM_PER_FLOODER - HANDSHAKE_NUM_BEFORE_RATELIMITING)
+        self.assertLessEqual(limited, expected)
+        self.assertGreaterEqual(limited, expected - NUM_FLOODERS)
+
+        # and the real peer still completes its handshake
+        peer_1.noise_reset()
+        init = peer_1.mk_handshake(self.pg1)
+        rxs = self.send_and_expect(
+            self.pg1,
+            [init],
+            self.pg1,
+            filter_out_fn=filter_out_misc_and_handshake_init,
+        )
+        peer_1.consume_response(rxs[0])
+
+        # clear up under load state
+        self.sleep(UNDER_LOAD_INTERVAL)
+
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    def _wg_input_clocks(self):
+        """Total clocks and vectors spent in wg4-input since cleared"""
+        clocks = 0.0
+        vectors = 0
+        for line in self.vapi.cli("show runtime wg4-input").splitlines():
+            f = line.split()
+            if len(f) >= 6 and f[0] == "wg4-input":
+                vectors += int(f[3])
+                clocks += float(f[5]) * int(f[3])
+        return clocks, vectors
+
+    @unittest.skipUnless(config.extended, "part of extended tests")
+    def test_wg_handshake_scale(self):
+        """Handshake rate with many peers on the interface"""
+        port = 12329
+        NUM_INITIATORS = 32
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        # one source address per initiator keeps them under the ratelimit
+        self.pg1.generate_remote_hosts(NUM_INITIATORS)
+        self.pg1.configure_ipv4_neighbors()
+
+        # no endpoints, so no handshakes are initiated by VPP
+        initiators = [
+            VppWgPeer(self, wg0, "0.0.0.0", 0, ["10.12.%d.0/24" % i]).add_vpp_config()
+            for i in range(NUM_INITIATORS)
+        ]
+
+        fillers = []
+        cost = {}
+        for n_peers in (1000, 10000, 100000):
+            while NUM_INITIATORS + len(fillers) < n_peers:
+                i = len(fillers)
+                rv = self.vapi.wireguard_peer_add(
+                    peer={
+                        "public_key": os.urandom(32),
+                        "port": 0,
+                        "endpoint": "0.0.0.0",
+                        "n_allowed_ips": 1,
+                        "allowed_ips": [
+                            "10.%d.%d.%d/32"
+                            % (128 + (i >> 16), (i >> 8) & 0xFF, i & 0xFF)
+                        ],
+                        "sw_if_index": wg0.sw_if_index,
+                        "persistent_keepalive": 0,
+                    }
+                )
+                fillers.append(rv.peer_index)
+
+            inits = []
+            for i, peer in enumerate(initiators):
+                peer.noise_reset()
+                peer.change_endpoint(self.pg1.remote_hosts[i].ip4, port + 1)
+                inits.append(peer.mk_handshake(self.pg1))
+
+            self.vapi.cli("clear runtime")
+            start = time.time()
+            rxs = self.send_and_expect(self.pg1, inits, self.pg1)
+            elapsed = time.time() - start
+            clocks, vectors = self._wg_input_clocks()
+
+            rx_by_dst = {rx[IP].dst: rx for rx in rxs}
+            for i, peer in enumerate(initiators):
+                peer.consume_response(rx_by_dst[self.pg1.remote_hosts[i].ip4])
+
+            cost[n_peers] = clocks / vectors
+            self.logger.info(
+                "%d peers: %.0f clocks/handshake, %.0f handshakes/sec"
+                % (n_peers, cost[n_peers], NUM_INITIATORS / elapsed)
+            )
+
+            # the next round's initiations must not be seen as under load
+            self.sleep(UNDER_LOAD_INTERVAL)
+
+        # finding the initiator must not grow with the number of peers;
+        # the crypto dominates the cost of a handshake
+        self.assertLess(cost[100000], 4 * cost[1000])
+
+        for peeri in fillers:
+            self.vapi.wireguard_peer_remove(peer_index=peeri)
+        for peer in initiators:
+            peer.remove_vpp_config()
+        wg0.remove_vpp_config()
+
     def _test_wg_peer_roaming_on_handshake_tmpl(self, is_endpoint_set, is_resp, is_ip6):
         port = 12323
 
@@ -1418,45 +1635,499 @@ class TestWg(VppTestCase):
             b = peer_1.decrypt_transport(rx, True)
             self.assertEqual(0, len(b))
 
-        # send a packets that are routed into the tunnel
-        p = (
-            Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac)
-            / IP(src=self.pg0.remote_ip4, dst="10.11.3.2")
-            / UDP(sport=555, dport=556)
-            / Raw(b"\x00" * 80)
+        # send a packets that are routed into the tunnel
+        p = (
+            Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac)
+            / IP(src=self.pg0.remote_ip4, dst="10.11.3.2")
+            / UDP(sport=555, dport=556)
+            / Raw(b"\x00" * 80)
+        )
+
+        rxs = self.send_and_expect(self.pg0, p * 2, self.pg1)
+        peer_1.validate_encapped(rxs, p, True)
+
+        # send packets into the tunnel, expect to receive them on
+        # the other side
+        p = [
+            (
+                peer_1.mk_tunnel_header(self.pg1, True)
+                / Wireguard(message_type=4, reserved_zero=0)
+                / WireguardTransport(
+                    receiver_index=peer_1.sender,
+                    counter=ii,
+                    encrypted_encapsulated_packet=peer_1.encrypt_transport(
+                        (
+                            IP(src="10.11.3.1", dst=self.pg0.remote_ip4, ttl=20)
+                            / UDP(sport=222, dport=223)
+                            / Raw()
+                        )
+                    ),
+                )
+            )
+            for ii in range(255)
+        ]
+
+        rxs = self.send_and_expect(self.pg1, p, self.pg0)
+
+        for rx in rxs:
+            self.assertEqual(rx[IP].dst, self.pg0.remote_ip4)
+            self.assertEqual(rx[IP].ttl, 19)
+
+        r1.remove_vpp_config()
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    def test_wg_awg_receive(self):
+        """AWG: decode obfuscated messages, drop junk, reply obfuscated"""
+        port = 12323
+        h1, h2, h4 = 0x5A5A1001, 0x5A5A1002, 0x5A5A1004
+        s1, s2, s4 = 40, 24, 16
+        awg_junk_err = self.wg4_input_node_name + "AWG junk packet dropped"
+        base_awg_junk_err = self.statistics.get_err_counter(awg_junk_err)
+
+        # Create interfaces
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+
+        # wait for the peer to send a handshake before obfuscation is on
+        self.pg1.get_capture(1, timeout=2)
+
+        self.vapi.cli(
+            "set wireguard awg %s enable init-junk-size %d response-junk-size %d "
+            "transport-junk-size %d magic-header-init %d "
+            "magic-header-response %d magic-header-data %d"
+            % (wg0.name, s1, s2, s4, h1, h2, h4)
+        )
+
+        # junk packets are dropped without a reply
+        junk = [
+            peer_1.mk_tunnel_header(self.pg1) / Raw(os.urandom(n)) for n in (64, 200)
+        ]
+        self.send_and_assert_no_replies_ignoring_init(self.pg1, junk)
+        self.assertEqual(
+            base_awg_junk_err + 2, self.statistics.get_err_counter(awg_junk_err)
+        )
+
+        # an obfuscated initiation is answered with an obfuscated response:
+        # S2 bytes of junk, then the H2 magic header
+        p = peer_1.mk_awg_handshake(self.pg1, h1, s1)
+        rx = self.send_and_expect(self.pg1, [p], self.pg1)
+        self.assertEqual(len(rx[0][Raw]), s2 + 92)
+        peer_1.consume_response(peer_1.awg_unwrap(rx[0], h2, s2, 2))
+
+        # obfuscated transport packets are decrypted and forwarded
+        p = [
+            peer_1.mk_awg_transport(
+                self.pg1,
+                h4,
+                s4,
+                ii,
+                IP(src="10.11.3.1", dst=self.pg0.remote_ip4, ttl=20)
+                / UDP(sport=222, dport=223)
+                / Raw(),
+            )
+            for ii in range(32)
+        ]
+        rxs = self.send_and_expect(self.pg1, p, self.pg0)
+
+        for rx in rxs:
+            self.assertEqual(rx[IP].dst, self.pg0.remote_ip4)
+            self.assertEqual(rx[IP].ttl, 19)
+
+        # transport packets from VPP carry S4 bytes of junk and H4
+        r1 = VppIpRoute(
+            self, "10.11.3.0", 24, [VppRoutePath("10.11.3.1", wg0.sw_if_index)]
+        ).add_vpp_config()
+        p = (
+            Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac)
+            / IP(src=self.pg0.remote_ip4, dst="10.11.3.2", ttl=20)
+            / UDP(sport=555, dport=556)
+            / Raw(b"\x00" * 80)
+        )
+        rxs = self.send_and_expect(self.pg0, p * 8, self.pg1)
+        peer_1.validate_encapped(
+            [peer_1.awg_unwrap(rx, h4, s4, 4) for rx in rxs], p
+        )
+
+        r1.remove_vpp_config()
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    def test_wg_awg_send_junk(self):
+        """AWG: junk packets precede the handshake in one burst"""
+        port = 12323
+        h1, jc, jmin, jmax = 0x5A5A1001, 3, 40, 80
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.vapi.cli(
+            "set wireguard awg %s enable junk-packet-count %d "
+            "junk-packet-min-size %d junk-packet-max-size %d "
+            "magic-header-init %d" % (wg0.name, jc, jmin, jmax, h1)
+        )
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+
+        rxs = self.pg1.get_capture(jc + 1, timeout=2)
+        for rx in rxs[:jc]:
+            self.assertGreaterEqual(len(rx[UDP].payload), jmin)
+            self.assertLessEqual(len(rx[UDP].payload), jmax)
+        init = bytes(rxs[jc][UDP].payload)
+        self.assertEqual(struct.unpack("<I", init[:4])[0], h1)
+
+        # the pre-handshake build benchmark runs and accounts every packet
+        out = self.vapi.cli("test wireguard awg junk %s iterations 100" % wg0.name)
+        self.assertIn("100 iterations, %d packets" % (100 * jc), out)
+
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    def test_wg_awg_i_header(self):
+        """AWG: i-headers rendered from templates precede the handshake"""
+        port = 12323
+        h1 = 0x5A5A1001
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.vapi.cli(
+            "set wireguard awg %s enable magic-header-init %d" % (wg0.name, h1)
+        )
+        self.vapi.cli(
+            "set wireguard i-header %s i1 {<b 0xc0ffee><r 16><c><t><rc 8><rd 4>}"
+            % wg0.name
+        )
+        self.vapi.cli("set wireguard i-header %s i2 {<b 0x0102><rd 6>}" % wg0.name)
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+
+        rxs = self.pg1.get_capture(3, timeout=2)
+        i1, i2 = bytes(rxs[0][UDP].payload), bytes(rxs[1][UDP].payload)
+        self.assertEqual(len(i1), 47)
+        self.assertEqual(i1[:3], bytes.fromhex("c0ffee"))
+        self.assertEqual(struct.unpack("!Q", i1[19:27])[0], 0)
+        self.assertTrue(i1[35:43].isalnum())
+        self.assertTrue(i1[43:47].isdigit())
+        self.assertEqual(len(i2), 8)
+        self.assertEqual(i2[:2], bytes.fromhex("0102"))
+        self.assertTrue(i2[2:].isdigit())
+        init = bytes(rxs[2][UDP].payload)
+        self.assertEqual(struct.unpack("<I", init[:4])[0], h1)
+
+        # the compiled templates are byte-identical to the tag interpreter
+        out = self.vapi.cli("test wireguard awg i-header %s iterations 100" % wg0.name)
+        self.assertIn("i1: 47 bytes, 100/100 identical", out)
+        self.assertIn("i2: 8 bytes, 100/100 identical", out)
+
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    def _wg_mk_transports(self, peer, counters, magic=None, junk_len=0):
+        src = peer.allowed_ips[0].replace(".0/24", ".1")
+        payload = (
+            IP(src=src, dst=self.pg0.remote_ip4, ttl=20)
+            / UDP(sport=222, dport=223)
+            / Raw()
+        )
+        if magic is not None:
+            return [
+                peer.mk_awg_transport(self.pg1, magic, junk_len, ii, payload)
+                for ii in counters
+            ]
+        return [
+            peer.mk_tunnel_header(self.pg1)
+            / Wireguard(message_type=4, reserved_zero=0)
+            / WireguardTransport(
+                receiver_index=peer.sender,
+                counter=ii,
+                encrypted_encapsulated_packet=peer.encrypt_transport(payload),
+            )
+            for ii in counters
+        ]
+
+    def test_wg_peer_stats(self):
+        """Per-peer counters in the stats segment"""
+        port = 12337
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+        r1 = VppIpRoute(
+            self, "10.11.3.0", 24, [VppRoutePath("10.11.3.1", wg0.sw_if_index)]
+        ).add_vpp_config()
+        self.pg1.get_capture(1, timeout=HANDSHAKE_JITTER)
+
+        def simple(name):
+            return self.statistics["/wg/peer/" + name][:, peer_1.index].sum()
+
+        self.assertEqual(simple("handshakes"), 0)
+        self.assertEqual(simple("last-handshake"), 0)
+
+        p = peer_1.mk_handshake(self.pg1)
+        rx = self.send_and_expect(self.pg1, [p], self.pg1)
+        peer_1.consume_response(rx[0])
+
+        self.assertEqual(simple("handshakes"), 1)
+        self.assertAlmostEqual(simple("last-handshake"), time.time(), delta=5)
+
+        rxs = self.send_and_expect(
+            self.pg1, self._wg_mk_transports(peer_1, range(10)), self.pg0
+        )
+        rx_stats = self.statistics["/wg/peer/rx"][:, peer_1.index]
+        self.assertEqual(rx_stats.sum_packets(), 10)
+        self.assertEqual(rx_stats.sum_octets(), sum(len(rx[IP]) for rx in rxs))
+
+        p = (
+            Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac)
+            / IP(src=self.pg0.remote_ip4, dst="10.11.3.2")
+            / UDP(sport=555, dport=556)
+            / Raw(b"\x00" * 80)
+        )
+        self.send_and_expect(self.pg0, p * 7, self.pg1)
+        tx_stats = self.statistics["/wg/peer/tx"][:, peer_1.index]
+        self.assertEqual(tx_stats.sum_packets(), 7)
+        self.assertEqual(tx_stats.sum_octets(), 7 * len(p[IP]))
+
+        # a transport that does not authenticate
+        bad = (
+            peer_1.mk_tunnel_header(self.pg1)
+            / Wireguard(message_type=4, reserved_zero=0)
+            / WireguardTransport(
+                receiver_index=peer_1.sender,
+                counter=10,
+                encrypted_encapsulated_packet=os.urandom(64),
+            )
+        )
+        self.send_and_assert_no_replies(self.pg1, [bad])
+        self.assertEqual(simple("decrypt-failures"), 1)
+        self.assertIn("handshakes: 1,", self.vapi.cli("show wireguard peer"))
+
+        r1.remove_vpp_config()
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    def test_wg_awg_peer_profile(self):
+        """AWG: per-peer profiles next to plain and interface profile peers"""
+        port = 12323
+        h = [0x6B6B2001, 0x6B6B2002, 0x6B6B2003, 0x6B6B2004]
+        hi = [0x6B6B1001, 0x6B6B1002, 0x6B6B1003, 0x6B6B1004]
+        s1, s2, s3, s4 = 24, 12, 20, 8
+        si1, si2, si4 = 32, 16, 4
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+        peer_2 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 2, ["10.11.4.0/24"]
+        ).add_vpp_config()
+        r2 = VppIpRoute(
+            self, "10.11.4.0", 24, [VppRoutePath("10.11.4.1", wg0.sw_if_index)]
+        ).add_vpp_config()
+        self.pg1.get_capture(2, timeout=2)
+
+        awg = (
+            "magic-header-init %d magic-header-response %d "
+            "magic-header-cookie %d magic-header-data %d "
+            "init-junk-size %d response-junk-size %d cookie-junk-size %d "
+            "transport-junk-size %d" % (*h, s1, s2, s3, s4)
+        )
+        self.vapi.cli("set wireguard peer awg %d %s" % (peer_2.index, awg))
+        self.assertIn("awg profile:", self.vapi.cli("show wireguard peer"))
+        self.assertIn("(1 peers)", self.vapi.cli("show wireguard awg %s" % wg0.name))
+
+        # a second profile may not reuse the magic headers of the first
+        with self.assertRaises(CliFailedCommandError):
+            self.vapi.cli(
+                "set wireguard peer awg %d magic-header-init %d" % (peer_1.index, h[0])
+            )
+
+        def check_peer_2():
+            # the obfuscated peer's response and data carry its H2/S2 and
+            # H4/S4, whatever the interface's own profile is
+            p = peer_2.mk_awg_handshake(self.pg1, h[0], s1)
+            rx = self.send_and_expect(self.pg1, [p], self.pg1)
+            peer_2.consume_response(peer_2.awg_unwrap(rx[0], h[1], s2, 2))
+            rxs = self.send_and_expect(
+                self.pg1, self._wg_mk_transports(peer_2, range(16), h[3], s4), self.pg0
+            )
+            for rx in rxs:
+                self.assertEqual(rx[IP].ttl, 19)
+
+            p = (
+                Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac)
+                / IP(src=self.pg0.remote_ip4, dst="10.11.4.2", ttl=20)
+                / UDP(sport=555, dport=556)
+                / Raw(b"\x00" * 80)
+            )
+            rxs = self.send_and_expect(self.pg0, p * 8, self.pg1)
+            peer_2.validate_encapped(
+                [peer_2.awg_unwrap(rx, h[3], s4, 4) for rx in rxs], p
+            )
+
+        check_peer_2()
+
+        # the plain peer on the same port is unaffected
+        p = peer_1.mk_handshake(self.pg1)
+        rx = self.send_and_expect(self.pg1, [p], self.pg1)
+        peer_1.consume_response(rx[0])
+        rxs = self.send_and_expect(
+            self.pg1, self._wg_mk_transports(peer_1, range(16)), self.pg0
+        )
+        for rx in rxs:
+            self.assertEqual(rx[IP].ttl, 19)
+
+        # an interface profile of its own: peer_1 takes it, peer_2 keeps
+        # its override
+        self.vapi.cli(
+            "set wireguard awg %s enable magic-header-init %d "
+            "magic-header-response %d magic-header-cookie %d "
+            "magic-header-data %d init-junk-size %d response-junk-size %d "
+            "transport-junk-size %d" % (wg0.name, *hi, si1, si2, si4)
+        )
+        p = peer_1.mk_awg_handshake(self.pg1, hi[0], si1)
+        rx = self.send_and_expect(self.pg1, [p], self.pg1)
+        peer_1.consume_response(peer_1.awg_unwrap(rx[0], hi[1], si2, 2))
+
+        check_peer_2()
+
+        # under load, the cookie reply to the peer goes out with its H3/S3
+        init = peer_2.mk_awg_handshake(self.pg1, h[0], s1)
+        txs = [init] * HANDSHAKE_NUM_PER_PEER_UNTIL_UNDER_LOAD * 2
+        rxs = self.send_and_expect_some(self.pg1, txs, self.pg1)
+        peer_2.consume_cookie(peer_2.awg_unwrap(rxs[-1], h[2], s3, 3))
+        self.sleep(UNDER_LOAD_INTERVAL)
+
+        # back to the interface's configuration
+        self.vapi.cli("set wireguard peer awg %d disable" % peer_2.index)
+        self.assertNotIn("awg profile:", self.vapi.cli("show wireguard peer"))
+
+        r2.remove_vpp_config()
+        peer_2.remove_vpp_config()
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    @unittest.skipUnless(config.extended, "part of extended tests")
+    def test_wg_awg_peer_profile_perf(self):
+        """AWG: per-peer profiles cost plain and interface peers nothing"""
+        port = 12323
+        h = [0x6B6B3001, 0x6B6B3002, 0x6B6B3003, 0x6B6B3004]
+        N_ROUNDS = 8
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+        self.pg1.get_capture(1, timeout=2)
+
+        p = peer_1.mk_handshake(self.pg1)
+        rx = self.send_and_expect(self.pg1, [p], self.pg1)
+        peer_1.consume_response(rx[0])
+
+        counter = iter(range(1 << 20))
+
+        def clocks_per_packet(magic=None, junk_len=0):
+            best = None
+            for _ in range(N_ROUNDS):
+                pkts = self._wg_mk_transports(
+                    peer_1, [next(counter) for _ in range(256)], magic, junk_len
+                )
+                self.vapi.cli("clear runtime")
+                self.send_and_expect(self.pg1, pkts, self.pg0)
+                clocks, vectors = self._wg_input_clocks()
+                if vectors:
+                    cpp = clocks / vectors
+                    best = cpp if best is None else min(best, cpp)
+            return best
+
+        # no AWG anywhere: the decode branch is not even taken
+        plain = clocks_per_packet()
+
+        # another peer with a profile on the same interface and port
+        peer_2 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 2, ["10.11.4.0/24"]
+        ).add_vpp_config()
+        self.vapi.cli(
+            "set wireguard peer awg %d magic-header-init %d "
+            "magic-header-response %d magic-header-cookie %d "
+            "magic-header-data %d transport-junk-size 8" % (peer_2.index, *h)
         )
+        mixed = clocks_per_packet()
 
-        rxs = self.send_and_expect(self.pg0, p * 2, self.pg1)
-        peer_1.validate_encapped(rxs, p, True)
+        # the profile removed, the plain path is back
+        self.vapi.cli("set wireguard peer awg %d disable" % peer_2.index)
+        after = clocks_per_packet()
 
-        # send packets into the tunnel, expect to receive them on
-        # the other side
-        p = [
-            (
-                peer_1.mk_tunnel_header(self.pg1, True)
-                / Wireguard(message_type=4, reserved_zero=0)
-                / WireguardTransport(
-                    receiver_index=peer_1.sender,
-                    counter=ii,
-                    encrypted_encapsulated_packet=peer_1.encrypt_transport(
-                        (
-                            IP(src="10.11.3.1", dst=self.pg0.remote_ip4, ttl=20)
-                            / UDP(sport=222, dport=223)
-                            / Raw()
-                        )
-                    ),
-                )
-            )
-            for ii in range(255)
-        ]
+        self.logger.info(
+            "wg4-input clocks/packet: plain %.1f, mixed %.1f, after %.1f"
+            % (plain, mixed, after)
+        )
+        self.assertLess(mixed, plain * 1.1)
+        self.assertLess(after, plain * 1.1)
 
-        rxs = self.send_and_expect(self.pg1, p, self.pg0)
+        # an obfuscated interface: an override that differs from its
+        # profile costs the interface's peers nothing either
+        hi = [0x6B6B4001, 0x6B6B4002, 0x6B6B4003, 0x6B6B4004]
+        self.vapi.cli(
+            "set wireguard awg %s enable magic-header-init %d "
+            "magic-header-response %d magic-header-cookie %d "
+            "magic-header-data %d transport-junk-size 4" % (wg0.name, *hi)
+        )
+        itf = clocks_per_packet(hi[3], 4)
+        self.vapi.cli(
+            "set wireguard peer awg %d magic-header-init %d "
+            "magic-header-response %d magic-header-cookie %d "
+            "magic-header-data %d transport-junk-size 8" % (peer_2.index, *h)
+        )
+        itf_mixed = clocks_per_packet(hi[3], 4)
 
-        for rx in rxs:
-            self.assertEqual(rx[IP].dst, self.pg0.remote_ip4)
-            self.assertEqual(rx[IP].ttl, 19)
+        self.logger.info(
+            "wg4-input clocks/packet: interface profile %.1f, with override %.1f"
+            % (itf, itf_mixed)
+        )
+        self.assertLess(itf_mixed, itf * 1.1)
 
-        r1.remove_vpp_config()
+        peer_2.remove_vpp_config()
         peer_1.remove_vpp_config()
         wg0.remove_vpp_config()
 
@@ -2905,6 +3576,279 @@ class WireguardHandoffTests(TestWg):
         peer_1.remove_vpp_config()
         wg0.remove_vpp_config()
 
+    def test_wg_peer_timers_on_worker(self):
+        """Peer timers run on a worker"""
+        port = 12391
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+        self.assertNotIn("timer-thread: 0", self.vapi.cli("show wireguard peer"))
+
+        # the first handshake is armed from the main thread and the
+        # retransmission from the worker that owns the timers
+        rxs = self.pg1.get_capture(2, timeout=6)
+        for rx in rxs:
+            self.assertEqual(Wireguard(bytes(rx[Raw])).message_type, 1)
+
+        resp = peer_1.consume_init(rxs[1], self.pg1)
+        rxs = self.send_and_expect(self.pg1, [resp], self.pg1)
+        b = peer_1.decrypt_transport(rxs[0])
+        self.assertEqual(0, len(b))
+
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    def test_wg_multi_queue(self):
+        """Multi-queue peer is served by all workers"""
+
+        port = 12387
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+        r1 = VppIpRoute(
+            self, "10.11.3.0", 24, [VppRoutePath("10.11.3.1", wg0.sw_if_index)]
+        ).add_vpp_config()
+        self.vapi.cli("set wireguard peer multi-queue %d" % peer_1.index)
+
+        # skip the first automatic handshake
+        self.pg1.get_capture(1, timeout=HANDSHAKE_JITTER)
+
+        # the session created by this handshake is the first shared one
+        p = peer_1.mk_handshake(self.pg1)
+        rx = self.send_and_expect(self.pg1, [p], self.pg1)
+        peer_1.consume_response(rx[0])
+
+        def mk_transports(counters):
+            return [
+                peer_1.mk_tunnel_header(self.pg1)
+                / Wireguard(message_type=4, reserved_zero=0)
+                / WireguardTransport(
+                    receiver_index=peer_1.sender,
+                    counter=ii,
+                    encrypted_encapsulated_packet=peer_1.encrypt_transport(
+                        IP(src="10.11.3.1", dst=self.pg0.remote_ip4, ttl=20)
+                        / UDP(sport=222, dport=223)
+                        / Raw()
+                    ),
+                )
+                for ii in counters
+            ]
+
+        # confirm the session, then send enough to span several nonce
+        # blocks; each block is decrypted by its own worker
+        self.send_and_expect(self.pg1, mk_transports([0]), self.pg0)
+        rxs = self.send_and_expect(self.pg1, mk_transports(range(1, 256)), self.pg0)
+        for rx in rxs:
+            self.assertEqual(rx[IP].ttl, 19)
+        self.assertIn("current keypair: shared", self.vapi.cli("show wireguard peer"))
+
+        # both workers encrypt locally, from their own blocks of nonces
+        pe = (
+            Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac)
+            / IP(src=self.pg0.remote_ip4, dst="10.11.3.2")
+            / UDP(sport=555, dport=556)
+            / Raw(b"\x00" * 80)
+        )
+        counters = []
+        for worker in (0, 1):
+            rxs = self.send_and_expect(self.pg0, pe * 100, self.pg1, worker=worker)
+            peer_1.validate_encapped(rxs, pe)
+            counters.append(
+                set(Wireguard(bytes(rx[Raw]))[WireguardTransport].counter for rx in rxs)
+            )
+        self.assertEqual(len(counters[0] | counters[1]), 200)
+        self.assertFalse(
+            {c // 64 for c in counters[0]} & {c // 64 for c in counters[1]}
+        )
+
+        r1.remove_vpp_config()
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    def test_wg_handoff_mac1(self):
+        """Handshake mac1 checked before handoff"""
+
+        port = 12385
+        NUM_BAD = 7
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+
+        # skip the first automatic handshake
+        self.pg1.get_capture(1, timeout=HANDSHAKE_JITTER)
+
+        # a batch of initiations with bad MACs around a valid one, received
+        # on a worker; only the valid one reaches the main thread
+        init = peer_1.mk_handshake(self.pg1)
+        bad = []
+        for i in range(NUM_BAD):
+            p = init.copy()
+            p[WireguardInitiation].mac1 = bytes([i + 1] * 16)
+            bad.append(p)
+        peer_1.noise_reset()
+        good = peer_1.mk_handshake(self.pg1)
+
+        rxs = self.send_and_expect(
+            self.pg1, bad[:4] + [good] + bad[4:], self.pg1, worker=1
+        )
+        peer_1.consume_response(rxs[0])
+
+        self.assertEqual(
+            self.base_mac4_err + NUM_BAD,
+            self.statistics.get_err_counter(self.mac4_error),
+        )
+
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    def test_wg_rekey_storm(self):
+        """Handoff with peers rekeying while data flows"""
+
+        port = 12387
+        NUM_PEERS = 8
+        NUM_ROUNDS = 4
+        # the steady peer's stream, per round: 0.1s at DATA_RATE
+        DATA_RATE = 4000
+        N_DATA = 400
+        # a rekey must not hold the data up for longer than this
+        MAX_GAP = 0.02
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        self.pg1.generate_remote_hosts(NUM_PEERS)
+        self.pg1.configure_ipv4_neighbors()
+
+        peers = []
+        for i in range(NUM_PEERS):
+            peers.append(
+                VppWgPeer(
+                    self,
+                    wg0,
+                    self.pg1.remote_hosts[i].ip4,
+                    port + 1,
+                    ["10.11.%d.0/24" % (i + 1)],
+                ).add_vpp_config()
+            )
+        self.assertEqual(len(self.vapi.wireguard_peers_dump()), NUM_PEERS)
+
+        # skip the automatic handshakes
+        self.pg1.get_capture(NUM_PEERS, timeout=HANDSHAKE_JITTER)
+
+        counters = [0] * NUM_PEERS
+
+        def mk_data(i, n):
+            pkts = []
+            for ii in range(n):
+                # the counter rides along, to check order and timing
+                inner = (
+                    IP(src="10.11.%d.1" % (i + 1), dst=self.pg0.remote_ip4, ttl=20)
+                    / UDP(sport=222, dport=223)
+                    / Raw(struct.pack("!Q", counters[i]))
+                )
+                pkts.append(
+                    peers[i].mk_tunnel_header(self.pg1)
+                    / Wireguard(message_type=4, reserved_zero=0)
+                    / WireguardTransport(
+                        receiver_index=peers[i].sender,
+                        counter=counters[i],
+                        encrypted_encapsulated_packet=peers[i].encrypt_transport(inner),
+                    )
+                )
+                counters[i] += 1
+            return pkts
+
+        def mk_rekey(i):
+            peers[i].noise_reset()
+            counters[i] = 0
+            return peers[i].mk_handshake(self.pg1)
+
+        def consume_responses(rxs):
+            endpoints = [p.endpoint for p in peers]
+            for rx in rxs:
+                peers[endpoints.index(rx[IP].dst)].consume_response(rx)
+
+        # bring every peer up; peer 0 then stays on its keys throughout
+        for i in range(NUM_PEERS):
+            rx = self.send_and_expect(self.pg1, [mk_rekey(i)], self.pg1)
+            consume_responses(rx)
+            self.send_and_expect(self.pg1, mk_data(i, 1), self.pg0)
+
+        for r in range(NUM_ROUNDS):
+            # every other peer rekeys on one worker, installing new
+            # receiver indexes and dropping old ones, while the steady
+            # peer's data streams in on the other
+            rekeys = [mk_rekey(i) for i in range(1, NUM_PEERS)]
+            data = mk_data(0, N_DATA)
+            rekey_rate = len(rekeys) * DATA_RATE / N_DATA
+            self.pg1.add_stream(rekeys, worker=0, rate=rekey_rate)
+            self.pg1.add_stream(data, worker=1, rate=DATA_RATE)
+            self.pg_enable_capture(self.pg_interfaces)
+            self.pg_start()
+
+            consume_responses(self.pg1.get_capture(NUM_PEERS - 1))
+            rxs = self.pg0.get_capture(N_DATA)
+
+            # all of it forwarded, in order
+            seqs = [struct.unpack("!Q", rx[Raw].load)[0] for rx in rxs]
+            self.assertEqual(seqs, sorted(seqs))
+            for rx in rxs:
+                self.assertEqual(rx[IP].src, "10.11.1.1")
+                self.assertEqual(rx[IP].ttl, 19)
+
+            # and at the pace it was sent: the gaps between packets, and
+            # the spread of their delays, from when the stream sent them
+            times = [float(rx.time) for rx in rxs]
+            gaps = sorted(b - a for a, b in zip(times, times[1:]))
+            delays = [t - (s - seqs[0]) / DATA_RATE for t, s in zip(times, seqs)]
+            jitter = max(delays) - min(delays)
+            median, p99 = gaps[len(gaps) // 2], gaps[len(gaps) * 99 // 100]
+            self.logger.info(
+                "round %d: gap median %.6f p99 %.6f max %.6f, jitter %.6f"
+                % (r, median, p99, gaps[-1], jitter)
+            )
+            self.assertLess(p99, 10.0 / DATA_RATE)
+            self.assertLess(gaps[-1], MAX_GAP)
+            self.assertLess(jitter, MAX_GAP)
+
+            # the new keys of each rekeyed peer are usable
+            for i in range(1, NUM_PEERS):
+                rxs = self.send_and_expect(self.pg1, mk_data(i, 3), self.pg0)
+                for rx in rxs:
+                    self.assertEqual(rx[IP].src, "10.11.%d.1" % (i + 1))
+
+        for p in peers:
+            p.remove_vpp_config()
+        wg0.remove_vpp_config()
+
     @unittest.skip("test disabled")
     def test_wg_multi_interface(self):
         """Multi-tunnel on the same port"""
@@ -2995,3 +3939,119 @@ class TestWgFIB(VppTestCase):
         r1.remove_vpp_config()
         peer_1.remove_vpp_config()
         wg0.remove_vpp_config()
+
+
+class TestWgGso(VppTestCase):
+    """Wireguard GSO/GRO Test Case"""
+
+    @classmethod
+    def setUpClass(cls):
+        super(TestWgGso, cls).setUpClass()
+        try:
+            # pg0 is the clear side and marks large TCP frames as GSO
+            res_gso = cls.create_pg_interfaces(
+                range(1), csum_offload=0, gso=1, gso_size=1300
+            )
+            res = cls.create_pg_interfaces(range(1, 2))
+            cls.pg_interfaces = res_gso + res
+            for i in cls.pg_interfaces:
+                i.admin_up()
+                i.config_ip4()
+                i.resolve_arp()
+
+        except Exception:
+            super(TestWgGso, cls).tearDownClass()
+            raise
+
+    @classmethod
+    def tearDownClass(cls):
+        super(TestWgGso, cls).tearDownClass()
+
+    def _wg_gso_tunnel(self):
+        port = 12323
+
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+
+        self.pg_enable_capture(self.pg_interfaces)
+        self.pg_start()
+
+        peer_1 = VppWgPeer(
+            self, wg0, self.pg1.remote_ip4, port + 1, ["10.11.3.0/24"]
+        ).add_vpp_config()
+        r1 = VppIpRoute(
+            self, "10.11.3.0", 24, [VppRoutePath("10.11.3.1", wg0.sw_if_index)]
+        ).add_vpp_config()
+
+        # complete the handshake and consume the keepalive
+        rxs = self.pg1.get_capture(1, timeout=2)
+        resp = peer_1.consume_init(rxs[0], self.pg1)
+        rxs = self.send_and_expect(self.pg1, [resp], self.pg1)
+        self.assertEqual(0, len(peer_1.decrypt_transport(rxs[0])))
+
+        return wg0, peer_1, r1
+
+    def test_wg_gso_segment(self):
+        """GSO buffers are segmented by wg-output"""
+        wg0, peer_1, r1 = self._wg_gso_tunnel()
+
+        # a 5200 byte TCP payload arrives as one GSO buffer and must leave
+        # as four encrypted datagrams of at most gso_size each
+        p = (
+            Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac)
+            / IP(src=self.pg0.remote_ip4, dst="10.11.3.2", flags="DF")
+            / TCP(sport=1234, dport=4321, flags="A", seq=1000)
+            / Raw(b"\xa5" * 5200)
+        )
+        rxs = self.send_and_expect(self.pg0, [p], self.pg1, n_rx=4)
+        rxs = peer_1.validate_encapped(rxs, p)
+
+        seq = 1000
+        for rx in rxs:
+            self.assertLessEqual(len(rx[Raw]), 1300)
+            self.assertEqual(rx[TCP].seq, seq)
+            self.assert_tcp_checksum_valid(rx)
+            seq += len(rx[Raw])
+        self.assertEqual(b"".join(bytes(rx[Raw]) for rx in rxs), b"\xa5" * 5200)
+
+        r1.remove_vpp_config()
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
+
+    def test_wg_gro_coalesce(self):
+        """Decrypted TCP segments are coalesced with gro on"""
+        wg0, peer_1, r1 = self._wg_gso_tunnel()
+
+        def mk_segments(counters):
+            return [
+                peer_1.mk_tunnel_header(self.pg1)
+                / Wireguard(message_type=4, reserved_zero=0)
+                / WireguardTransport(
+                    receiver_index=peer_1.sender,
+                    counter=ii,
+                    encrypted_encapsulated_packet=peer_1.encrypt_transport(
+                        IP(src="10.11.3.1", dst=self.pg0.remote_ip4, ttl=20)
+                        / TCP(sport=1234, dport=4321, flags="A", seq=1000 * ii)
+                        / Raw(b"\xa5" * 1000)
+                    ),
+                )
+                for ii in counters
+            ]
+
+        # gro is off by default, every segment is forwarded on its own
+        rxs = self.send_and_expect(self.pg1, mk_segments(range(4)), self.pg0)
+        for rx in rxs:
+            self.assertEqual(len(rx[Raw]), 1000)
+
+        # with gro on, the segments of one frame leave as one GSO packet
+        self.vapi.cli("set wireguard gro on")
+        self.assertIn("gro: enabled", self.vapi.cli("show wireguard mode"))
+        rxs = self.send_and_expect(self.pg1, mk_segments(range(4, 8)), self.pg0, n_rx=1)
+        self.assertEqual(rxs[0][TCP].seq, 4000)
+        self.assertEqual(bytes(rxs[0][Raw]), b"\xa5" * 4000)
+        self.vapi.cli("set wireguard gro off")
+
+        r1.remove_vpp_config()
+        peer_1.remove_vpp_config()
+        wg0.remove_vpp_config()
@@ -0,0 +1,361 @@
+#!/usr/bin/env python3
+""" Wg benchmarks """
+
+import os
+import time
+import unittest
+
+from config import config
+from scapy.packet import Raw
+from scapy.layers.l2 import Ether
+from scapy.layers.inet import IP, UDP
+
+from vpp_ip_route import VppIpRoute, VppRoutePath, VppIpTable
+from vpp_papi import VppEnum
+from framework import VppTestCase
+from asfframework import tag_run_solo
+from test_wireguard import (
+    VppWgInterface,
+    VppWgPeer,
+    UNDER_LOAD_INTERVAL,
+)
+
+""" Throughput and handshake rate of the wireguard plugin.
+
+Both ends of every tunnel live in the same VPP: wg0 and its peers'
+interfaces talk to each other over local addresses, so traffic is fed
+by packet-generator streams and no NICs (or python crypto) are needed.
+
+    make test TEST=test_wireguard_bench EXTENDED_TESTS=1 V=1
+
+Rates are VPP's, not the test's: the packets a pg stream sent or the
+handshakes answered, over the worker clocks "show runtime" accounts to
+the nodes that processed them, at the base frequency of "show cpu".
+Results are logged and written to wg_bench.csv in the test's tempdir.
+"""
+
+# nodes whose cost is reported, per packet they processed
+BENCH_NODES = (
+    "wg4-output-tun",
+    "wg4-output-tun-post-node",
+    "wg4-output-tun-handoff",
+    "wg4-input",
+    "wg4-input-post-node",
+    "wg4-input-data-handoff",
+)
+
+BENCH_PACKETS = 200000
+BENCH_SIZES = (64, 512, 1400)
+BENCH_PEERS = (1, 16)
+BENCH_INITIATORS = 32
+BENCH_HANDSHAKE_ROUNDS = 4
+
+# AWG profile applied to both ends when obfuscation is benchmarked
+BENCH_AWG = (
+    "magic-header-init 1520000001 magic-header-response 1520000002 "
+    "magic-header-cookie 1520000003 magic-header-data 1520000004 "
+    "init-junk-size 16 response-junk-size 16 transport-junk-size 8"
+)
+
+
+@tag_run_solo
+@unittest.skipUnless(config.extended, "part of extended tests")
+class TestWgBench(VppTestCase):
+    """Wireguard benchmarks"""
+
+    vpp_worker_count = 2
+
+    @classmethod
+    def setUpClass(cls):
+        super(TestWgBench, cls).setUpClass()
+        try:
+            cls.create_pg_interfaces(range(4))
+            for i in cls.pg_interfaces:
+                i.admin_up()
+            for i in cls.pg_interfaces[:3]:
+                i.config_ip4()
+                i.resolve_arp()
+
+        except Exception:
+            super(TestWgBench, cls).tearDownClass()
+            raise
+
+    @classmethod
+    def tearDownClass(cls):
+        super(TestWgBench, cls).tearDownClass()
+
+    def setUp(self):
+        super(TestWgBench, self).setUp()
+        self.results = []
+
+    def tearDown(self):
+        self.vapi.wg_set_async_mode(False)
+        super(TestWgBench, self).tearDown()
+        if not self.results:
+            return
+        with open(os.path.join(self.tempdir, "wg_bench.csv"), "a") as f:
+            for r in self.results:
+                f.write(",".join(str(v) for v in r) + "\n")
+
+    def _cpu_hz(self):
+        for line in self.vapi.cli("show cpu").splitlines():
+            if line.startswith("Base frequency:"):
+                return float(line.split()[2]) * 1e9
+        self.fail("no base frequency in show cpu")
+
+    def _node_clocks(self):
+        """Clocks and vectors per node that processed packets, summed over
+        threads; the packet generator's own node is left out"""
+        cost = {}
+        for line in self.vapi.cli("show runtime").splitlines():
+            f = line.split()
+            if len(f) < 7 or f[0] == "pg-input" or not f[3].isdigit():
+                continue
+            if int(f[3]) == 0:
+                continue
+            clocks, vectors = cost.get(f[0], (0.0, 0))
+            cost[f[0]] = (
+                clocks + float(f[5]) * int(f[3]),
+                vectors + int(f[3]),
+            )
+        return cost
+
+    def _rate(self, n, cost):
+        """n per second of the clocks spent on them"""
+        clocks = sum(c for c, _ in cost.values())
+        self.assertGreater(clocks, 0)
+        return n * self._cpu_hz() / clocks
+
+    def _report(self, name, params, rate, unit, cost):
+        per_node = " ".join(
+            "%s=%.0f" % (n, cost[n][0] / cost[n][1])
+            for n in BENCH_NODES
+            if n in cost and cost[n][1]
+        )
+        self.logger.info("%s %s: %.3f %s %s" % (name, params, rate, unit, per_node))
+        self.results.append((name, params, "%.3f" % rate, unit, per_node))
+
+    def _wait_established(self, peers, timeout=5):
+        established = VppEnum.vl_api_wireguard_peer_flags_t.WIREGUARD_PEER_ESTABLISHED
+        want = set(p.index for p in peers)
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            up = set(
+                d.peer.peer_index
+                for d in self.vapi.wireguard_peers_dump()
+                if d.peer.flags & established
+            )
+            if want <= up:
+                return
+            self.sleep(0.1)
+        self.fail("loopback tunnels not established")
+
+    def _loopback_pairs(self, port, n_peers, awg):
+        """wg0 with n_peers peers, each the other end of a wgN interface
+
+        wg0 sends from pg1's address, the far ends listen on pg2's;
+        both are local so the encrypted packets never leave VPP.
+        """
+        objs = []
+        wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+        wg0.admin_up()
+        wg0.config_ip4()
+        if awg:
+            self.vapi.cli("set wireguard awg %s enable %s" % (wg0.name, BENCH_AWG))
+
+        peers = []
+        for i in range(n_peers):
+            wgn = VppWgInterface(
+                self, self.pg2.local_ip4, port + 1 + i
+            ).add_vpp_config()
+            wgn.set_table_ip4(1)
+            wgn.admin_up()
+            wgn.config_ip4()
+            if awg:
+                self.vapi.cli("set wireguard awg %s enable %s" % (wgn.name, BENCH_AWG))
+
+            near = VppWgPeer(
+                self,
+                wg0,
+                self.pg2.local_ip4,
+                port + 1 + i,
+                ["10.200.%d.0/24" % i],
+                persistent_keepalive=0,
+            )
+            near.public_key = wgn.public_key
+            near.add_vpp_config()
+
+            far = VppWgPeer(
+                self,
+                wgn,
+                self.pg1.local_ip4,
+                port,
+                ["0.0.0.0/0"],
+                persistent_keepalive=0,
+            )
+            far.public_key = wg0.public_key
+            far.add_vpp_config()
+
+            route = VppIpRoute(
+                self,
+                "10.200.%d.0" % i,
+                24,
+                [VppRoutePath("10.200.%d.1" % i, wg0.sw_if_index)],
+            ).add_vpp_config()
+            peers.append(near)
+            objs = [route, far, near, wgn] + objs
+        objs.append(wg0)
+
+        out = VppIpRoute(
+            self,
+            "10.200.0.0",
+            16,
+            [VppRoutePath(self.pg3.remote_ip4, self.pg3.sw_if_index)],
+            table_id=1,
+        ).add_vpp_config()
+        objs.insert(0, out)
+
+        # the first packet to each peer starts its handshake
+        self.send_and_assert_no_replies(
+            self.pg0,
+            [
+                Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac)
+                / IP(src=self.pg0.remote_ip4, dst="10.200.%d.1" % i)
+                / UDP(sport=555, dport=556)
+                for i in range(n_peers)
+            ],
+            remark="handshake",
+        )
+        self._wait_established(peers)
+        return objs
+
+    def _bench_data(self, n_peers, awg, is_async, size):
+        streams = [
+            Ether(dst=self.pg0.local_mac, src=self.pg0.remote_mac)
+            / IP(src=self.pg0.remote_ip4, dst="10.200.%d.1" % i)
+            / UDP(sport=555, dport=556)
+            / Raw(b"\x00" * (size - 28))
+            for i in range(n_peers)
+        ]
+        self.vapi.wg_set_async_mode(is_async)
+
+        # counted, not captured
+        for i in self.pg_interfaces:
+            i.disable_capture()
+
+        rx = self.statistics["/if/rx"][:, self.pg0.sw_if_index].sum_packets()
+        tx = self.statistics["/if/tx"][:, self.pg3.sw_if_index].sum_packets()
+        self.vapi.cli("clear runtime")
+        self.pg0.add_stream(streams, nb_replays=BENCH_PACKETS, worker=0)
+        self.pg_start(trace=False)
+        cost = self._node_clocks()
+        rx = self.statistics["/if/rx"][:, self.pg0.sw_if_index].sum_packets() - rx
+        tx = self.statistics["/if/tx"][:, self.pg3.sw_if_index].sum_packets() - tx
+
+        # a benchmark of a broken tunnel is worthless
+        self.assertGreater(tx, rx // 2)
+
+        self._report(
+            "data",
+            "size=%d peers=%d awg=%s async=%s"
+            % (size, n_peers, "on" if awg else "off", "on" if is_async else "off"),
+            self._rate(rx, cost) / 1e6,
+            "Mpps",
+            cost,
+        )
+
+    def test_wg_bench_data(self):
+        """Encrypt and decrypt throughput"""
+        port = 13000
+
+        # decrypted traffic leaves through pg3, in its own table, so
+        # that it is not routed back into wg0
+        table = VppIpTable(self, 1).add_vpp_config()
+        self.pg3.set_table_ip4(1)
+        self.pg3.config_ip4()
+        self.pg3.resolve_arp()
+
+        for awg in (False, True):
+            for n_peers in BENCH_PEERS:
+                objs = self._loopback_pairs(port, n_peers, awg)
+                for is_async in (False, True):
+                    for size in BENCH_SIZES:
+                        self._bench_data(n_peers, awg, is_async, size)
+                for o in objs:
+                    o.remove_vpp_config()
+                port += 100
+
+        self.pg3.unconfig_ip4()
+        self.pg3.set_table_ip4(0)
+        table.remove_vpp_config()
+
+    def test_wg_bench_handshake(self):
+        """Handshake rate"""
+        port = 13500
+
+        for awg in (False, True):
+            wg0 = VppWgInterface(self, self.pg1.local_ip4, port).add_vpp_config()
+            wg0.admin_up()
+            wg0.config_ip4()
+            if awg:
+                self.vapi.cli("set wireguard awg %s enable %s" % (wg0.name, BENCH_AWG))
+
+            # one source address per initiator keeps them under the ratelimit
+            self.pg1.generate_remote_hosts(BENCH_INITIATORS)
+            self.pg1.configure_ipv4_neighbors()
+
+            initiators = [
+                VppWgPeer(
+                    self,
+                    wg0,
+                    "0.0.0.0",
+                    0,
+                    ["10.201.%d.0/24" % i],
+                    persistent_keepalive=0,
+                ).add_vpp_config()
+                for i in range(BENCH_INITIATORS)
+            ]
+
+            for is_async in (False, True):
+                self.vapi.wg_set_async_mode(is_async)
+                n_handshakes = 0
+                cost = {}
+                for _ in range(BENCH_HANDSHAKE_ROUNDS):
+                    inits = []
+                    for i, peer in enumerate(initiators):
+                        peer.noise_reset()
+                        peer.change_endpoint(self.pg1.remote_hosts[i].ip4, port + 1)
+                        if awg:
+                            inits.append(
+                                peer.mk_awg_handshake(self.pg1, 1520000001, 16)
+                            )
+                        else:
+                            inits.append(peer.mk_handshake(self.pg1))
+
+                    self.vapi.cli("clear runtime")
+                    rxs = self.send_and_expect(self.pg1, inits, self.pg1)
+                    n_handshakes += len(rxs)
+                    for n, (c, v) in self._node_clocks().items():
+                        clocks, vectors = cost.get(n, (0.0, 0))
+                        cost[n] = (clocks + c, vectors + v)
+
+                    # the next round must not be seen as under load
+                    self.sleep(UNDER_LOAD_INTERVAL)
+
+                self._report(
+                    "handshake",
+                    "peers=%d awg=%s async=%s"
+                    % (
+                        BENCH_INITIATORS,
+                        "on" if awg else "off",
+                        "on" if is_async else "off",
+                    ),
+                    self._rate(n_handshakes, cost),
+                    "handshakes/sec",
+                    cost,
+                )
+
+            for peer in initiators:
+                peer.remove_vpp_config()
+            wg0.remove_vpp_config()
+            port += 100
@@ -105,7 +105,7 @@ class VppPGInterface(VppInterface):
             return self._cap_name + "-worker%d" % worker
         return self._cap_name
 
-    def get_input_cli(self, nb_replays=None, worker=None):
+    def get_input_cli(self, nb_replays=None, worker=None, rate=None):
         """return CLI string to load the injected packets"""
         input_cli = "packet-generator new pcap %s source pg%u name %s" % (
             self.get_in_path(worker),
@@ -113,9 +113,11 @@ class VppPGInterface(VppInterface):
             self.get_cap_name(worker),
         )
         if nb_replays is not None:
-            return "%s limit %d" % (input_cli, nb_replays)
+            input_cli += " limit %d" % nb_replays
+        if rate is not None:
+            input_cli += " rate %f" % rate
         if worker is not None:
-            return "%s worker %d" % (input_cli, worker)
+            input_cli += " worker %d" % worker
         return input_cli
 
     @property
@@ -239,11 +241,12 @@ class VppPGInterface(VppInterface):
         self._coalesce_enabled = 0
         self.test.vapi.pg_interface_enable_disable_coalesce(self.sw_if_index, 0)
 
-    def add_stream(self, pkts, nb_replays=None, worker=None):
+    def add_stream(self, pkts, nb_replays=None, worker=None, rate=None):
         """
         Add a stream of packets to this packet-generator
 
         :param pkts: iterable packets
+        :param rate: packets per second, as fast as possible if None
 
         """
         in_pcap = self.get_in_path(worker)
@@ -252,7 +255,7 @@ class VppPGInterface(VppInterface):
         wrpcap(in_pcap, pkts)
         self.test.register_pcap(self, worker)
         # FIXME this should be an API, but no such exists atm
-        self.test.vapi.cli(self.get_input_cli(nb_replays, worker))
+        self.test.vapi.cli(self.get_input_cli(nb_replays, worker, rate))
         self.link_pcap_file(self.get_in_path(worker), "inp", self.in_history_counter)
 
     def generate_debug_aid(self, kind):